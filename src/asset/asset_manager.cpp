@@ -7,7 +7,10 @@
 
 #include "asset_table.h"
 #include "asset_type.h"
+#include "font.h"
 #include "mesh.h"
+#include "shader.h"
+#include "texture.h"
 
 #include "../core/includes/alloc.h"
 #include "../core/includes/fileio.h"
@@ -16,12 +19,14 @@
 #include "../core/includes/system.h"
 
 #include <stddef.h>
+#include <string.h>
 
 struct AssetManager {
     struct HashTableEntry {
         AssetId key;
         size_t refcount;
         void *value;
+        kai::AssetType type;
     };
 
     AssetManager() = default;
@@ -163,17 +168,38 @@ struct MeshData {
     kai::MeshHeader header;
 };
 
+struct ShaderData {
+    const kai::ShaderVariant *variant; // The one of the active backend, null if the shader wasn't baked for it
+    Uint32 input_layout_count;
+    kai::RenderInputLayoutInfo input_layouts[KAI_SHADER_MAX_INPUT_LAYOUTS];
+
+    kai::ShaderHeader header;
+};
+
+struct FontData {
+    Bool32 valid;
+    Uint32 padding;
+
+    kai::FontHeader header;
+};
+
 void init_asset_manager(void) {
     if(!asset_manager.pages) {
         asset_manager = AssetManager(kai::gibibytes(4));
     }
 }
 
+static void release_asset_data(kai::AssetType type, void *data);
+
 void destroy_asset_manager(void) {
     if(asset_manager.pages) {
-        // TODO: Before freeing all of the memory, we first need to go through the assets that are still
-        // loaded and unload the ones that have allocated additional memory (RenderBuffers for instance).
-        // The rest will be freed as part of the kai::virtual_free call
+        // Only the assets that have allocated additional memory (RenderBuffers for instance) need to be released,
+        // the rest will be freed as part of the kai::virtual_free call
+        for(size_t i = 0; i < asset_manager.table_entries; i++) {
+            if(asset_manager.table[i].key != 0) {
+                release_asset_data(asset_manager.table[i].type, asset_manager.table[i].value);
+            }
+        }
 
         kai::virtual_free(asset_manager.pages);
         asset_manager.pages = nullptr;
@@ -181,7 +207,88 @@ void destroy_asset_manager(void) {
     }
 }
 
-static void prepare_asset_data(kai::AssetType type, void *data) {
+static bool is_in_asset(Uint64 start, Uint64 size, Uint64 asset_size) {
+    return start <= asset_size && size <= asset_size - start;
+}
+
+// Everything that the header refers to has to be inside of the file, so a broken shader can't be read past its end
+static bool validate_shader(const kai::ShaderHeader *header, size_t file_size) {
+    if(file_size < sizeof(kai::ShaderHeader) || header->version != KAI_SHADER_VERSION || header->size != file_size ||
+       header->input_layouts.count > KAI_SHADER_MAX_INPUT_LAYOUTS ||
+       !is_in_asset(header->variants.start, static_cast<Uint64>(header->variants.count) * sizeof(kai::ShaderVariant), file_size) ||
+       !is_in_asset(header->input_layouts.start, static_cast<Uint64>(header->input_layouts.count) * sizeof(kai::ShaderInputLayout), file_size)) {
+        return false;
+    }
+
+    const unsigned char *start = reinterpret_cast<const unsigned char *>(header);
+
+    const kai::ShaderVariant *variants = reinterpret_cast<const kai::ShaderVariant *>(start + header->variants.start);
+    for(Uint32 i = 0; i < header->variants.count; i++) {
+        if(variants[i].vertex.size == 0 || !is_in_asset(variants[i].vertex.start, variants[i].vertex.size, file_size) ||
+           variants[i].pixel.size == 0 || !is_in_asset(variants[i].pixel.start, variants[i].pixel.size, file_size)) {
+            return false;
+        }
+    }
+
+    const kai::ShaderInputLayout *layouts = reinterpret_cast<const kai::ShaderInputLayout *>(start + header->input_layouts.start);
+    for(Uint32 i = 0; i < header->input_layouts.count; i++) {
+        if(layouts[i].name_start >= file_size || !memchr(start + layouts[i].name_start, '\0', file_size - layouts[i].name_start)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Like validate_shader(), and the glyphs have to be sorted for the lookups of the TextBatch. A font needs at least one
+static bool validate_font(const kai::FontHeader *header, size_t file_size) {
+    if(file_size < sizeof(kai::FontHeader) || header->version != KAI_FONT_VERSION || header->size != file_size ||
+       header->glyphs.count == 0 ||
+       !is_in_asset(header->glyphs.start, static_cast<Uint64>(header->glyphs.count) * sizeof(kai::FontGlyph), file_size) ||
+       (header->default_glyph != KAI_FONT_NO_GLYPH && header->default_glyph >= header->glyphs.count)) {
+        return false;
+    }
+
+    const kai::FontGlyph *glyphs = reinterpret_cast<const kai::FontGlyph *>(reinterpret_cast<const unsigned char *>(header) +
+                                                                            header->glyphs.start);
+    for(Uint32 i = 0; i < header->glyphs.count; i++) {
+        if((i > 0 && glyphs[i].codepoint <= glyphs[i - 1].codepoint) ||
+           glyphs[i].width > header->max_glyph_size || glyphs[i].height > header->max_glyph_size ||
+           !is_in_asset(glyphs[i].bitmap_start, static_cast<Uint64>(glyphs[i].width) * glyphs[i].height, file_size)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Like validate_shader(), the mips have to be the full chain of the format and follow each other without gaps
+bool validate_texture(const kai::TextureHeader *header, size_t file_size) {
+    kai::RenderFormat format = static_cast<kai::RenderFormat>(header->format);
+    Uint32 block_size = kai::get_format_block_size(format);
+
+    if(file_size < sizeof(kai::TextureHeader) || header->version != KAI_TEXTURE_VERSION || header->size != file_size ||
+       !kai::get_format_size(format) || header->mips[0].width % block_size || header->mips[0].height % block_size ||
+       header->mip_count == 0 || header->mip_count > KAI_TEXTURE_MAX_MIPS ||
+       header->mip_count != kai::get_mip_count(header->mips[0].width, header->mips[0].height) ||
+       header->mips[0].start < sizeof(kai::TextureHeader)) {
+        return false;
+    }
+
+    for(Uint32 i = 0; i < header->mip_count; i++) {
+        const kai::TextureMip &mip = header->mips[i];
+
+        if(mip.width != kai::max(header->mips[0].width >> i, 1u) || mip.height != kai::max(header->mips[0].height >> i, 1u) ||
+           mip.size != kai::get_texture_size(format, mip.width, mip.height) || !is_in_asset(mip.start, mip.size, file_size) ||
+           (i > 0 && mip.start != header->mips[i - 1].start + header->mips[i - 1].size)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void prepare_asset_data(kai::AssetType type, void *data, size_t file_size) {
     if(data) {
         switch(type) {
             case kai::AssetType::mesh: {
@@ -212,8 +319,52 @@ static void prepare_asset_data(kai::AssetType type, void *data) {
 
                         device->create_buffer(buffer_info, mesh_data->index_buffer);
                     }
+                }
+
+                break;
+            }
+            case kai::AssetType::shader: {
+                ShaderData *shader_data = reinterpret_cast<ShaderData *>(data);
+                const kai::ShaderHeader *header = &shader_data->header;
+
+                shader_data->variant = nullptr;
+                shader_data->input_layout_count = 0;
+
+                if(!validate_shader(header, file_size)) {
+                    kai::log("Shader asset is invalid or was baked with a different version!\n");
+                    break;
+                }
+
+                const unsigned char *start = reinterpret_cast<const unsigned char *>(header);
+                kai::RenderDevice *device = kai::RenderDevice::get();
+
+                const kai::ShaderVariant *variants = reinterpret_cast<const kai::ShaderVariant *>(start + header->variants.start);
+                for(Uint32 i = 0; device && i < header->variants.count; i++) {
+                    if(variants[i].backend == static_cast<Uint32>(device->backend)) {
+                        shader_data->variant = &variants[i];
+                        break;
+                    }
+                }
 
-                    // TODO: These buffers also need to be destroyed when we unload the asset
+                const kai::ShaderInputLayout *layouts = reinterpret_cast<const kai::ShaderInputLayout *>(start + header->input_layouts.start);
+                for(Uint32 i = 0; i < header->input_layouts.count; i++) {
+                    kai::RenderInputLayoutInfo &layout = shader_data->input_layouts[i];
+                    layout.name = reinterpret_cast<const char *>(start + layouts[i].name_start);
+                    layout.index = layouts[i].index;
+                    layout.format = static_cast<kai::RenderFormat>(layouts[i].format);
+                    layout.offset = layouts[i].offset;
+                    layout.per_instance = layouts[i].per_instance != 0;
+                }
+
+                shader_data->input_layout_count = header->input_layouts.count;
+                break;
+            }
+            case kai::AssetType::font: {
+                FontData *font_data = reinterpret_cast<FontData *>(data);
+                font_data->valid = validate_font(&font_data->header, file_size);
+
+                if(!font_data->valid) {
+                    kai::log("Font asset is invalid or was baked with a different version!\n");
                 }
 
                 break;
@@ -225,24 +376,47 @@ static void prepare_asset_data(kai::AssetType type, void *data) {
     }
 }
 
-void * load_asset(AssetId id) {
-    size_t table_index;
-    AssetManager::HashTableEntry *asset = asset_manager.find(id, &table_index);
+// Frames that are still in flight may draw with the buffers of the asset, so they're only destroyed once those are finished
+static void release_asset_data(kai::AssetType type, void *data) {
+    if(data) {
+        switch(type) {
+            case kai::AssetType::mesh: {
+                kai::RenderDevice *device = kai::RenderDevice::get();
 
-    if(asset && asset->refcount > 0) {
-        asset->refcount++;
-        return asset->value;
+                if(device) {
+                    MeshData *mesh_data = reinterpret_cast<MeshData *>(data);
+                    device->destroy_buffer_deferred(mesh_data->vertex_buffer);
+                    device->destroy_buffer_deferred(mesh_data->index_buffer);
+                }
+
+                break;
+            }
+            default:
+                break;
+        }
     }
+}
 
+const char * get_asset_path(AssetId id) {
     AssetTableHeader *table = asset_manager.file_paths;
 
     size_t index = (id ^ table->mod) % table->count;
     ptrdiff_t start = reinterpret_cast<ptrdiff_t>(table) + offsetof(AssetTableHeader, buffer);
     ptrdiff_t offset = *reinterpret_cast<ptrdiff_t *>(start + (index * sizeof(ptrdiff_t)));
 
-    const char *path = reinterpret_cast<const char *>(start + offset);
+    return reinterpret_cast<const char *>(start + offset);
+}
 
-    kai::FileHandle asset_file = kai::open_file(path);
+void * load_asset(AssetId id) {
+    size_t table_index;
+    AssetManager::HashTableEntry *asset = asset_manager.find(id, &table_index);
+
+    if(asset && asset->refcount > 0) {
+        asset->refcount++;
+        return asset->value;
+    }
+
+    kai::FileHandle asset_file = kai::open_file(get_asset_path(id));
     kai::AssetType type = kai::AssetType::unknown;
 
     void *asset_data = nullptr;
@@ -253,25 +427,33 @@ void * load_asset(AssetId id) {
 
         AssetManager::HashTableEntry *entry = asset_manager.insert_at(table_index, id);
         if(entry) {
-            size_t size = 0;
+            size_t file_size = kai::get_file_size(asset_file);
             ptrdiff_t data_offset = 0;
 
             switch(type) {
                 case kai::AssetType::mesh:
                     data_offset = offsetof(MeshData, header);
-                    size = data_offset + kai::get_file_size(asset_file);
+                    break;
+                case kai::AssetType::shader:
+                    data_offset = offsetof(ShaderData, header);
+                    break;
+                case kai::AssetType::font:
+                    data_offset = offsetof(FontData, header);
                     break;
                 default:
-                    size = kai::get_file_size(asset_file);
                     break;
             }
 
+            size_t size = data_offset + file_size;
+
             entry->value = asset_manager.commit_pages(size);
             KAI_ASSERT(entry->value);
 
             kai::read_file(asset_file, reinterpret_cast<void *>(reinterpret_cast<ptrdiff_t>(entry->value) + data_offset));
 
-            prepare_asset_data(type, entry->value);
+            prepare_asset_data(type, entry->value, file_size);
+
+            entry->type = type;
 
             asset_data = entry->value;
         }
@@ -282,6 +464,44 @@ void * load_asset(AssetId id) {
     return asset_data;
 }
 
+bool get_shader_pipeline_info(const void *shader, kai::RenderPipelineInfo &info,
+                              const kai::RenderInputLayoutInfo *&out_input_layouts, Uint32 &out_input_layout_count) {
+    const ShaderData *shader_data = static_cast<const ShaderData *>(shader);
+
+    if(!shader_data || shader_data->header.asset_type != kai::AssetType::shader || !shader_data->variant) {
+        kai::log("The shader asset has no shaders for the active rendering backend!\n");
+        return false;
+    }
+
+    const unsigned char *start = reinterpret_cast<const unsigned char *>(&shader_data->header);
+    const kai::ShaderVariant *variant = shader_data->variant;
+
+    info.vertex_shader_source = nullptr;
+    info.vertex_shader_entry = nullptr;
+    info.pixel_shader_source = nullptr;
+    info.pixel_shader_entry = nullptr;
+    info.vertex_shader_bytecode = start + variant->vertex.start;
+    info.vertex_shader_bytecode_size = variant->vertex.size;
+    info.pixel_shader_bytecode = start + variant->pixel.start;
+    info.pixel_shader_bytecode_size = variant->pixel.size;
+
+    out_input_layouts = shader_data->input_layouts;
+    out_input_layout_count = shader_data->input_layout_count;
+
+    return true;
+}
+
+const kai::FontHeader * get_font(const void *font) {
+    const FontData *font_data = static_cast<const FontData *>(font);
+
+    if(!font_data || font_data->header.asset_type != kai::AssetType::font || !font_data->valid) {
+        kai::log("The asset is not a valid font!\n");
+        return nullptr;
+    }
+
+    return &font_data->header;
+}
+
 void unload_asset(AssetId id) {
     AssetManager::HashTableEntry *entry = asset_manager.find(id);
 
@@ -291,6 +511,8 @@ void unload_asset(AssetId id) {
         }
 
         if(entry->refcount == 0) {
+            release_asset_data(entry->type, entry->value);
+
             // TODO: Remove entry from the hash table
             memset(entry, 0, sizeof(*entry));
         }
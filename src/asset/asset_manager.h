@@ -7,6 +7,10 @@
 #define KAI_ASSET_MANAGER_H
 
 #include "asset_type.h"
+#include "font.h"
+#include "texture.h"
+
+#include "../core/includes/render.h"
 
 void init_asset_manager(void);
 void destroy_asset_manager(void);
@@ -14,4 +18,20 @@ void destroy_asset_manager(void);
 void * load_asset(AssetId id);
 void unload_asset(AssetId id);
 
+// The file that the asset is loaded from, for assets that are read in pieces like the textures of a TextureStreamer
+const char * get_asset_path(AssetId id);
+
+// Whether the header of a texture asset of 'file_size' bytes is valid, it only needs the header so a texture can be
+// checked before any of its mips are read
+bool validate_texture(const kai::TextureHeader *header, size_t file_size);
+
+// Points the shaders of 'info' at the bytecode that a shader asset (as returned by load_asset()) has for the
+// active rendering backend and returns the input layout that they were baked with. The pointers stay valid
+// until the asset is unloaded
+bool get_shader_pipeline_info(const void *shader, kai::RenderPipelineInfo &info,
+                              const kai::RenderInputLayoutInfo *&out_input_layouts, Uint32 &out_input_layout_count);
+
+// The font of a font asset (as returned by load_asset()) for a TextBatch, null if the asset is broken or isn't a font
+const kai::FontHeader * get_font(const void *font);
+
 #endif /* KAI_ASSET_MANAGER_H */
@@ -18,7 +18,9 @@ namespace kai {
     enum class AssetType : Uint32 {
         unknown = 0,
         texture,
-        mesh
+        mesh,
+        shader,
+        font
     };
 }
 
@@ -0,0 +1,57 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_FONT_H
+#define KAI_FONT_H
+
+#include "asset_type.h"
+
+#include "../core/includes/types.h"
+
+#define KAI_FONT_VERSION 1
+#define KAI_FONT_NO_GLYPH 0xffffffff
+
+// The glyphs are signed distance fields instead of coverage, see FontHeader::sdf_spread
+#define KAI_FONT_FLAG_SDF 0x1
+
+namespace kai {
+    // A font asset is made by src/tools/font_bake and holds the glyphs of a font at the single pixel size that it was baked
+    // at, every glyph with an r_unorm8 bitmap. Text is drawn from a glyph atlas that these bitmaps are copied into on demand,
+    // see text.h. Everything that the header refers to is stored after it in the file and in memory, the starts are
+    // offsets from the start of the header
+#pragma pack(push, 1)
+    struct FontGlyph {
+        Uint32 codepoint;
+        Uint32 bitmap_start; // Of width * height pixels, row by row
+        Uint16 width; // Of the bitmap, 0 for glyphs without any pixels like the space
+        Uint16 height;
+        Int16 offset_x; // From the pen on the baseline to the top left of the bitmap, y goes down
+        Int16 offset_y;
+        Int16 advance; // Of the pen after the glyph
+        Uint16 padding;
+    };
+
+    struct FontHeader {
+        AssetType asset_type;
+        Uint32 version;
+        Uint32 size; // Of the whole asset, including the header
+        Uint32 flags;
+
+        Uint16 line_height; // In pixels, like all of the metrics
+        Int16 ascent; // From the top of a line to the baseline
+        Uint16 sdf_spread; // How far the distances of an SDF reach on both sides of an edge, which is at 0.5
+        Uint16 max_glyph_size; // Of the largest bitmap in either direction
+
+        struct {
+            Uint32 count;
+            Uint32 start; // Of the first FontGlyph, the others follow it sorted by their codepoint
+        } glyphs;
+
+        Uint32 default_glyph; // Index of the glyph that stands in for the missing ones, KAI_FONT_NO_GLYPH if there is none
+    };
+#pragma pack(pop)
+}
+
+#endif /* KAI_FONT_H */
@@ -0,0 +1,56 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_SHADER_H
+#define KAI_SHADER_H
+
+#include "asset_type.h"
+
+#include "../core/includes/types.h"
+
+#define KAI_SHADER_VERSION 1
+#define KAI_SHADER_MAX_INPUT_LAYOUTS 16
+
+namespace kai {
+    // A shader asset is made by src/tools/shader_bake and holds the vertex and pixel shader of a pipeline, precompiled for
+    // every backend that it was baked for, together with the input layout of the vertex shader. Everything that the header
+    // refers to is stored after it in the file and in memory, the starts are offsets from the start of the header
+#pragma pack(push, 1)
+    struct ShaderVariant {
+        Uint32 backend; // RenderingBackend
+
+        struct {
+            Uint32 start;
+            Uint32 size;
+        } vertex, pixel;
+    };
+
+    struct ShaderInputLayout {
+        Uint32 name_start; // Null-terminated
+        Uint32 index;
+        Uint32 format; // RenderFormat
+        Uint32 offset;
+        Uint32 per_instance;
+    };
+
+    struct ShaderHeader {
+        AssetType asset_type;
+        Uint32 version;
+        Uint32 size; // Of the whole asset, including the header
+
+        struct {
+            Uint32 count;
+            Uint32 start; // Of the first ShaderVariant, the others follow it
+        } variants;
+
+        struct {
+            Uint32 count;
+            Uint32 start; // Of the first ShaderInputLayout, the others follow it
+        } input_layouts;
+    };
+#pragma pack(pop)
+}
+
+#endif /* KAI_SHADER_H */
@@ -0,0 +1,42 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_TEXTURE_H
+#define KAI_TEXTURE_H
+
+#include "asset_type.h"
+
+#include "../core/includes/render.h"
+#include "../core/includes/types.h"
+
+#define KAI_TEXTURE_VERSION 1
+
+namespace kai {
+    // A texture asset is made by src/tools/texture_bake and holds the full mip chain of a texture, down to 1x1. The
+    // mips are stored after the header from the largest to the smallest, so any mip and all of the smaller ones are a
+    // single read that can be passed to RenderDevice::create_texture() as is. That's what lets the TextureStreamer
+    // (see texture_streamer.h) keep only some of the mips of a texture in memory. The starts are offsets from the
+    // start of the header
+#pragma pack(push, 1)
+    struct TextureMip {
+        Uint32 width;
+        Uint32 height;
+        Uint32 start;
+        Uint32 size; // Every mip starts where the one before it ends
+    };
+
+    struct TextureHeader {
+        AssetType asset_type;
+        Uint32 version;
+        Uint32 size; // Of the whole asset, including the header
+
+        Uint32 format; // RenderFormat
+        Uint32 mip_count; // Always the full chain, get_mip_count() of the first mip
+        TextureMip mips[KAI_TEXTURE_MAX_MIPS];
+    };
+#pragma pack(pop)
+}
+
+#endif /* KAI_TEXTURE_H */
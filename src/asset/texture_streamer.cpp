@@ -0,0 +1,528 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#include <string.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "texture_streamer.h"
+
+#include "asset_manager.h"
+#include "texture.h"
+
+#include "../core/includes/fileio.h"
+#include "../core/includes/math.h"
+
+// Handles are the index of the slot in the low bits and its generation in the rest, like the ones of the RenderDevice
+#define STREAMER_INDEX_BITS 16
+#define STREAMER_INDEX_MASK ((1u << STREAMER_INDEX_BITS) - 1)
+#define STREAMER_GENERATION_MASK (0xffffffffu >> STREAMER_INDEX_BITS)
+
+#define STREAMER_MAX_LOADS 16
+#define STREAMER_MAX_PATH 260
+
+// Keeping extra mips, then what the requests want, then the idle textures at their tail, then a mip bias per tier
+#define STREAMER_TIER_COUNT (3 + KAI_TEXTURE_MAX_MIPS)
+
+struct kai::StreamedTextureData {
+    char path[STREAMER_MAX_PATH];
+    kai::RenderTexture texture;
+    kai::TextureMip mips[KAI_TEXTURE_MAX_MIPS];
+    kai::RenderFormat format;
+    Uint32 mip_count;
+    Uint32 tail_mip; // The largest mip that is always resident
+    Uint32 resident_mip;
+    Uint32 loading_mip; // KAI_TEXTURE_STREAMING_NO_MIP if there is no load in flight
+    Uint32 wanted_mip; // Of the requests since the last update(), KAI_TEXTURE_STREAMING_NO_MIP without any
+    Uint32 target_mip;
+    Float32 screen_size; // The largest that was requested since the last update()
+    Bool32 broken; // A load failed, so the texture keeps the mips that it has
+    Bool32 used;
+    Uint32 generation;
+    Uint32 next_free; // Index + 1 of the next free slot, only for free slots
+};
+
+enum class TextureLoadState : Uint32 {
+    free,
+    queued, // Owned by the thread of the loader until it's done or failed
+    done,
+    failed
+};
+
+struct TextureLoad {
+    char path[STREAMER_MAX_PATH]; // A copy, the texture may be removed while it's loading
+    kai::ArenaAllocator memory; // What the mips are read into
+    Uint64 offset;
+    Uint64 size;
+    Uint32 texture; // Handle
+    Uint32 first_mip;
+    std::atomic<TextureLoadState> state;
+};
+
+// The thread that reads the mips, update() queues the loads and picks them up once they're done
+struct kai::TextureLoader {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    Uint32 queue[STREAMER_MAX_LOADS]; // Loads in the order they were queued
+    Uint32 queue_start;
+    Uint32 queue_count;
+    Bool32 quit;
+
+    TextureLoad loads[STREAMER_MAX_LOADS];
+};
+
+static void loader_main(kai::TextureLoader *loader) {
+    for(;;) {
+        Uint32 index;
+
+        {
+            std::unique_lock<std::mutex> lock(loader->mutex);
+            while(!loader->quit && loader->queue_count == 0) {
+                loader->work_ready.wait(lock);
+            }
+
+            if(loader->quit) {
+                return;
+            }
+
+            index = loader->queue[loader->queue_start];
+            loader->queue_start = (loader->queue_start + 1) % STREAMER_MAX_LOADS;
+            loader->queue_count--;
+        }
+
+        TextureLoad &load = loader->loads[index];
+        kai::FileHandle file = kai::open_file(load.path);
+        bool read = file && kai::read_file_at(file, load.memory.get_buffer(), static_cast<size_t>(load.size), load.offset);
+        kai::close_file(file);
+
+        load.state.store(read ? TextureLoadState::done : TextureLoadState::failed, std::memory_order_release);
+    }
+}
+
+// The bytes of the mip and all of the ones that are smaller
+static KAI_FORCEINLINE Uint64 get_chain_size(const kai::StreamedTextureData &texture, Uint32 first_mip) {
+    const kai::TextureMip &last = texture.mips[texture.mip_count - 1];
+    return static_cast<Uint64>(last.start) + last.size - texture.mips[first_mip].start;
+}
+
+// The smallest mip that covers the screen size
+static Uint32 get_wanted_mip(const kai::StreamedTextureData &texture) {
+    if(texture.screen_size <= 0.0f) {
+        return KAI_TEXTURE_STREAMING_NO_MIP;
+    }
+
+    Uint32 mip = texture.tail_mip;
+    while(mip > 0 && static_cast<Float32>(kai::max(texture.mips[mip].width, texture.mips[mip].height)) < texture.screen_size) {
+        mip--;
+    }
+
+    return mip;
+}
+
+// The mips that the texture gets in a tier of the budget, the tiers give up more and more of them
+static Uint32 get_target_mip(const kai::StreamedTextureData &texture, Uint32 tier) {
+    Uint32 current = (texture.loading_mip != KAI_TEXTURE_STREAMING_NO_MIP) ? texture.loading_mip : texture.resident_mip;
+
+    if(texture.broken) {
+        return current;
+    }
+
+    if(texture.wanted_mip == KAI_TEXTURE_STREAMING_NO_MIP) {
+        return (tier <= 1) ? current : texture.tail_mip;
+    }
+
+    if(tier == 0) {
+        return kai::min(texture.wanted_mip, current);
+    }
+
+    return kai::min(texture.wanted_mip + ((tier > 2) ? tier - 2 : 0), texture.tail_mip);
+}
+
+kai::TextureStreamer::TextureStreamer(RenderDevice *render_device, Uint64 budget, Uint32 texture_capacity,
+                                      Uint32 load_capacity) {
+    kai::clamp(texture_capacity, 1u, STREAMER_INDEX_MASK);
+    kai::clamp(load_capacity, 1u, static_cast<Uint32>(STREAMER_MAX_LOADS));
+
+    memory = ArenaAllocator(sizeof(TextureLoader) + static_cast<Uint64>(texture_capacity) * sizeof(StreamedTextureData));
+    if(!memory.get_buffer()) {
+        kai::log("Could not allocate %u streamed textures!\n", texture_capacity);
+        return;
+    }
+
+    loader = new(memory.get_buffer()) TextureLoader();
+    textures = reinterpret_cast<StreamedTextureData *>(loader + 1);
+    loader->thread = std::thread(loader_main, loader);
+
+    device = render_device;
+    max_textures = texture_capacity;
+    max_loads = load_capacity;
+    stats.budget = budget;
+}
+
+void kai::TextureStreamer::destroy(void) {
+    if(loader) {
+        {
+            std::lock_guard<std::mutex> lock(loader->mutex);
+            loader->quit = true;
+        }
+
+        loader->work_ready.notify_all();
+        loader->thread.join();
+
+        for(TextureLoad &load : loader->loads) {
+            if(load.state.load(std::memory_order_acquire) != TextureLoadState::free) {
+                load.memory.destroy();
+            }
+        }
+
+        loader->~TextureLoader();
+    }
+
+    // The last frame may still be drawing them
+    for(Uint32 i = 0; i < used_textures; i++) {
+        if(textures[i].used) {
+            device->destroy_texture_deferred(textures[i].texture);
+        }
+    }
+
+    memory.destroy();
+
+    *this = TextureStreamer();
+}
+
+kai::StreamedTexture kai::TextureStreamer::add(AssetId id) {
+    return add(get_asset_path(id));
+}
+
+kai::StreamedTexture kai::TextureStreamer::add(const char *path) {
+    if(!loader || !path || strlen(path) >= STREAMER_MAX_PATH) {
+        kai::log("Can't stream a texture without a path of up to %u characters!\n", STREAMER_MAX_PATH - 1);
+        return StreamedTexture();
+    }
+
+    if(!next_free && used_textures == max_textures) {
+        kai::log("Can't stream more than %u textures!\n", max_textures);
+        return StreamedTexture();
+    }
+
+    kai::FileHandle file = kai::open_file(path);
+    if(!file) {
+        kai::log("Could not open the texture \"%s\"!\n", path);
+        return StreamedTexture();
+    }
+
+    kai::TextureHeader header;
+    size_t file_size = kai::get_file_size(file);
+
+    if(file_size < sizeof(header) || !kai::read_file_at(file, &header, sizeof(header), 0) ||
+       header.asset_type != kai::AssetType::texture || !validate_texture(&header, file_size)) {
+        kai::log("\"%s\" is not a texture asset or was baked with a different version!\n", path);
+        kai::close_file(file);
+        return StreamedTexture();
+    }
+
+    Uint32 index = next_free ? next_free - 1 : used_textures;
+    StreamedTextureData &texture = textures[index];
+    Uint32 generation = texture.generation;
+    Uint32 slot_next_free = texture.next_free;
+
+    memset(&texture, 0, sizeof(texture));
+    memcpy(texture.path, path, strlen(path) + 1);
+    memcpy(texture.mips, header.mips, sizeof(texture.mips));
+    texture.format = static_cast<kai::RenderFormat>(header.format);
+    texture.mip_count = header.mip_count;
+    texture.loading_mip = KAI_TEXTURE_STREAMING_NO_MIP;
+    texture.wanted_mip = KAI_TEXTURE_STREAMING_NO_MIP;
+
+    // A block-compressed texture can only start at a mip that is made of whole blocks, which may be larger than the tail
+    Uint32 block_size = kai::get_format_block_size(texture.format);
+    while(texture.tail_mip + 1 < texture.mip_count &&
+          kai::max(texture.mips[texture.tail_mip].width, texture.mips[texture.tail_mip].height) > KAI_TEXTURE_STREAMING_TAIL_SIZE &&
+          texture.mips[texture.tail_mip + 1].width % block_size == 0 && texture.mips[texture.tail_mip + 1].height % block_size == 0) {
+        texture.tail_mip++;
+    }
+
+    texture.resident_mip = texture.tail_mip;
+    texture.target_mip = texture.tail_mip;
+
+    Uint64 tail_size = get_chain_size(texture, texture.tail_mip);
+    kai::ArenaAllocator tail(tail_size);
+
+    RenderTextureInfo info;
+    info.data = tail.get_buffer();
+    info.width = texture.mips[texture.tail_mip].width;
+    info.height = texture.mips[texture.tail_mip].height;
+    info.mip_count = texture.mip_count - texture.tail_mip;
+    info.format = texture.format;
+
+    bool created = info.data && kai::read_file_at(file, tail.get_buffer(), static_cast<size_t>(tail_size),
+                                                  texture.mips[texture.tail_mip].start) &&
+                   device->create_texture(info, texture.texture);
+
+    tail.destroy();
+    kai::close_file(file);
+
+    if(!created) {
+        kai::log("Could not load the tail of the texture \"%s\"!\n", path);
+        texture.generation = generation;
+        texture.next_free = slot_next_free;
+        return StreamedTexture();
+    }
+
+    if(index == used_textures) {
+        used_textures++;
+    } else {
+        next_free = slot_next_free;
+    }
+
+    texture.used = true;
+    texture.generation = (generation & STREAMER_GENERATION_MASK) ? generation : 1;
+
+    stats.resident_bytes += tail_size;
+    stats.loaded_bytes += tail_size;
+    stats.texture_count++;
+
+    StreamedTexture handle;
+    handle.handle = index | (texture.generation << STREAMER_INDEX_BITS);
+    return handle;
+}
+
+void kai::TextureStreamer::remove(StreamedTexture &texture) {
+    StreamedTextureData *t = get_data(texture.handle);
+
+    if(!t) {
+        kai::log("Tried to remove a streamed texture with a stale or null handle!\n");
+        return;
+    }
+
+    // A load that is still in flight finds the handle stale once it's done and is thrown away
+    if(t->loading_mip != KAI_TEXTURE_STREAMING_NO_MIP && t->loading_mip < t->resident_mip) {
+        upgrade_bytes -= get_chain_size(*t, t->loading_mip) - get_chain_size(*t, t->resident_mip);
+    }
+
+    device->destroy_texture_deferred(t->texture);
+    stats.resident_bytes -= get_chain_size(*t, t->resident_mip);
+    stats.texture_count--;
+
+    Uint32 index = texture.handle & STREAMER_INDEX_MASK;
+    t->used = false;
+    t->generation = (t->generation + 1) & STREAMER_GENERATION_MASK;
+    t->next_free = next_free;
+    next_free = index + 1;
+
+    texture.handle = 0;
+}
+
+void kai::TextureStreamer::request(const StreamedTexture &texture, Float32 screen_size) {
+    StreamedTextureData *t = get_data(texture.handle);
+
+    if(t) {
+        t->screen_size = kai::max(t->screen_size, screen_size);
+    }
+}
+
+void kai::TextureStreamer::update(void) {
+    if(!loader) {
+        return;
+    }
+
+    stats.upgrades = 0;
+    stats.downgrades = 0;
+
+    finish_loads();
+
+    for(Uint32 i = 0; i < used_textures; i++) {
+        textures[i].wanted_mip = get_wanted_mip(textures[i]);
+    }
+
+    // The first tier that fits into the budget, the last one has every texture at its tail and is used either way
+    Uint32 tier = 0;
+    for(; tier < STREAMER_TIER_COUNT - 1; tier++) {
+        Uint64 total = 0;
+
+        for(Uint32 i = 0; i < used_textures; i++) {
+            if(textures[i].used) {
+                total += get_chain_size(textures[i], get_target_mip(textures[i], tier));
+            }
+        }
+
+        if(total <= stats.budget) {
+            break;
+        }
+    }
+
+    stats.wanted_bytes = 0;
+    stats.limited_count = 0;
+    stats.mip_bias = (tier > 2) ? tier - 2 : 0;
+
+    for(Uint32 i = 0; i < used_textures; i++) {
+        StreamedTextureData &t = textures[i];
+        if(t.used) {
+            t.target_mip = get_target_mip(t, tier);
+            stats.wanted_bytes += get_chain_size(t, get_target_mip(t, 2));
+            stats.limited_count += (t.wanted_mip != KAI_TEXTURE_STREAMING_NO_MIP && t.target_mip > t.wanted_mip) ? 1 : 0;
+        }
+    }
+
+    // The loads that free memory go first
+    for(Uint32 i = 0; i < used_textures && stats.pending_loads < max_loads; i++) {
+        StreamedTextureData &t = textures[i];
+        if(t.used && t.loading_mip == KAI_TEXTURE_STREAMING_NO_MIP && t.target_mip > t.resident_mip) {
+            start_load(t, t.target_mip);
+        }
+    }
+
+    // Then the textures that are the furthest from their target, an upgrade that doesn't fit next to the ones in
+    // flight is tried again in the next update()
+    while(stats.pending_loads < max_loads) {
+        StreamedTextureData *best = nullptr;
+
+        for(Uint32 i = 0; i < used_textures; i++) {
+            StreamedTextureData &t = textures[i];
+            if(t.used && t.loading_mip == KAI_TEXTURE_STREAMING_NO_MIP && t.target_mip < t.resident_mip &&
+               (!best || t.resident_mip - t.target_mip > best->resident_mip - best->target_mip ||
+                (t.resident_mip - t.target_mip == best->resident_mip - best->target_mip && t.screen_size > best->screen_size))) {
+                best = &t;
+            }
+        }
+
+        if(!best) {
+            break;
+        }
+
+        Uint64 bytes = get_chain_size(*best, best->target_mip) - get_chain_size(*best, best->resident_mip);
+        if(stats.resident_bytes + upgrade_bytes + bytes > stats.budget) {
+            best->target_mip = best->resident_mip;
+            continue;
+        }
+
+        if(start_load(*best, best->target_mip)) {
+            upgrade_bytes += bytes;
+        } else {
+            best->target_mip = best->resident_mip;
+        }
+    }
+
+    for(Uint32 i = 0; i < used_textures; i++) {
+        textures[i].screen_size = 0.0f;
+    }
+}
+
+kai::RenderTexture kai::TextureStreamer::get_texture(const StreamedTexture &texture) const {
+    const StreamedTextureData *t = get_data(texture.handle);
+    return t ? t->texture : RenderTexture();
+}
+
+Uint32 kai::TextureStreamer::get_resident_mip(const StreamedTexture &texture) const {
+    const StreamedTextureData *t = get_data(texture.handle);
+    return t ? t->resident_mip : KAI_TEXTURE_STREAMING_NO_MIP;
+}
+
+kai::StreamedTextureData * kai::TextureStreamer::get_data(Uint32 handle) const {
+    Uint32 index = handle & STREAMER_INDEX_MASK;
+
+    if(index >= used_textures || !textures[index].used || textures[index].generation != (handle >> STREAMER_INDEX_BITS)) {
+        return nullptr;
+    }
+
+    return &textures[index];
+}
+
+// Replaces the textures of the loads that are done
+void kai::TextureStreamer::finish_loads(void) {
+    for(Uint32 i = 0; i < max_loads; i++) {
+        TextureLoad &load = loader->loads[i];
+        TextureLoadState state = load.state.load(std::memory_order_acquire);
+
+        if(state != TextureLoadState::done && state != TextureLoadState::failed) {
+            continue;
+        }
+
+        StreamedTextureData *t = get_data(load.texture);
+
+        if(t) {
+            Uint64 resident_size = get_chain_size(*t, t->resident_mip);
+            Uint64 loaded_size = get_chain_size(*t, load.first_mip);
+            bool upgrade = load.first_mip < t->resident_mip;
+
+            if(upgrade) {
+                upgrade_bytes -= loaded_size - resident_size;
+            }
+
+            RenderTextureInfo info;
+            info.data = load.memory.get_buffer();
+            info.width = t->mips[load.first_mip].width;
+            info.height = t->mips[load.first_mip].height;
+            info.mip_count = t->mip_count - load.first_mip;
+            info.format = t->format;
+
+            RenderTexture texture;
+            if(state == TextureLoadState::done && device->create_texture(info, texture)) {
+                device->destroy_texture_deferred(t->texture);
+                t->texture = texture;
+                t->resident_mip = load.first_mip;
+
+                stats.resident_bytes = stats.resident_bytes - resident_size + loaded_size;
+                stats.upgrades += upgrade ? 1 : 0;
+                stats.downgrades += upgrade ? 0 : 1;
+            } else {
+                kai::log("Could not load mip %u of the texture \"%s\", it keeps the mips it has!\n", load.first_mip, t->path);
+                t->broken = true;
+            }
+
+            t->loading_mip = KAI_TEXTURE_STREAMING_NO_MIP;
+        }
+
+        stats.loaded_bytes += (state == TextureLoadState::done) ? load.size : 0;
+        stats.pending_loads--;
+
+        load.memory.destroy();
+        load.state.store(TextureLoadState::free, std::memory_order_relaxed);
+    }
+}
+
+bool kai::TextureStreamer::start_load(StreamedTextureData &texture, Uint32 first_mip) {
+    Uint32 index = 0;
+    while(index < max_loads && loader->loads[index].state.load(std::memory_order_relaxed) != TextureLoadState::free) {
+        index++;
+    }
+
+    if(index == max_loads) {
+        return false;
+    }
+
+    TextureLoad &load = loader->loads[index];
+    load.size = get_chain_size(texture, first_mip);
+    load.memory = ArenaAllocator(load.size);
+
+    if(!load.memory.get_buffer()) {
+        kai::log("Could not allocate %llu bytes to load the texture \"%s\"!\n", static_cast<unsigned long long>(load.size),
+                 texture.path);
+        load.memory = ArenaAllocator();
+        return false;
+    }
+
+    memcpy(load.path, texture.path, sizeof(load.path));
+    load.offset = texture.mips[first_mip].start;
+    load.texture = static_cast<Uint32>(&texture - textures) | (texture.generation << STREAMER_INDEX_BITS);
+    load.first_mip = first_mip;
+
+    texture.loading_mip = first_mip;
+    stats.pending_loads++;
+
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        load.state.store(TextureLoadState::queued, std::memory_order_relaxed);
+        loader->queue[(loader->queue_start + loader->queue_count) % STREAMER_MAX_LOADS] = index;
+        loader->queue_count++;
+    }
+
+    loader->work_ready.notify_one();
+    return true;
+}
@@ -0,0 +1,115 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_TEXTURE_STREAMER_H
+#define KAI_TEXTURE_STREAMER_H
+
+#include "asset_type.h"
+
+#include "../core/includes/alloc.h"
+#include "../core/includes/render.h"
+#include "../core/includes/types.h"
+
+#define KAI_TEXTURE_STREAMING_TAIL_SIZE 64 // The mips up to this size are always resident
+#define KAI_TEXTURE_STREAMING_NO_MIP 0xffffffff
+
+namespace kai {
+    struct StreamedTextureData; // See texture_streamer.cpp
+    struct TextureLoader;
+
+    // A texture of a TextureStreamer, like the handles of the RenderDevice a handle of 0 is null
+    struct StreamedTexture {
+        Uint32 handle = 0;
+    };
+
+    struct TextureStreamerStats {
+        Uint64 budget;
+        Uint64 resident_bytes; // Of all of the textures as they are now
+        Uint64 wanted_bytes; // If every requested texture had what it wants, and the rest only their tail
+        Uint64 loaded_bytes; // Read from the assets, since the streamer was created
+        Uint32 texture_count;
+        Uint32 pending_loads;
+
+        // Of the last update()
+        Uint32 upgrades; // Textures that got more mips
+        Uint32 downgrades;
+        Uint32 limited_count; // Requested textures that get fewer mips than they want to stay in the budget
+        Uint32 mip_bias; // Mips that every requested texture gave up on top of that
+    };
+
+    // Keeps only the mips of texture assets (see texture.h) in memory that the screen needs, all of them within a
+    // budget of bytes. Every texture always has its tail resident, the mips up to KAI_TEXTURE_STREAMING_TAIL_SIZE,
+    // which are read when it's added, so it can be drawn right away. Every frame:
+    //
+    //   texture_streamer.request(texture, screen_size); // For every texture that is drawn, as often as it's drawn
+    //   texture_streamer.update();
+    //   command_buffer.bind_texture(texture_streamer.get_texture(texture), 0);
+    //
+    // 'screen_size' is how many pixels the texture covers on the screen along its larger side, the texture wants the
+    // smallest mip that is at least that large. update() looks at the requests since the last update() and decides
+    // how many mips every texture gets: what it wants, and the mips it already has on top of that for as long as the
+    // budget has room for them. Over the budget the extra mips go first, then the textures that weren't requested
+    // drop to their tail, then every requested texture gives up a mip (see TextureStreamerStats::mip_bias) until
+    // everything fits.
+    //
+    // The mips are loaded asynchronously, a thread of the streamer reads the new chain of mips of a texture from its
+    // asset and update() replaces the texture with one of the new size once it's in. The old one is destroyed once
+    // the frames in flight are done with it, so the device holds a bit more than the budget while textures are
+    // swapped. Fewer mips are read again as well, they're at most a quarter of what the texture had. At most
+    // 'max_loads' are in flight, the ones that free memory go first, then the textures that are the furthest from
+    // what they want. An upgrade only starts if it fits into the budget with the ones in flight.
+    //
+    // get_texture() changes whenever the mips of the texture did, so it has to be called again after update(). A
+    // TextureStreamer is meant to be used by a single thread besides its own, update() creates textures and has to
+    // be called on the render thread once per frame.
+    struct TextureStreamer {
+        explicit TextureStreamer(void) = default;
+        TextureStreamer(RenderDevice *device, Uint64 budget, Uint32 max_textures = 1024, Uint32 max_loads = 4);
+
+        void destroy(void);
+
+        // Reads the header and the tail of the texture asset right away, returns a null handle if that fails
+        StreamedTexture add(AssetId id);
+        StreamedTexture add(const char *path);
+
+        void remove(StreamedTexture &texture);
+
+        void request(const StreamedTexture &texture, Float32 screen_size);
+        void update(void);
+
+        void set_budget(Uint64 bytes) {
+            stats.budget = bytes;
+        }
+
+        // A null texture for a stale or null handle
+        RenderTexture get_texture(const StreamedTexture &texture) const;
+
+        // The largest mip that the texture has, KAI_TEXTURE_STREAMING_NO_MIP for a stale or null handle
+        Uint32 get_resident_mip(const StreamedTexture &texture) const;
+
+        const TextureStreamerStats & get_stats(void) const {
+            return stats;
+        }
+
+    private:
+        StreamedTextureData * get_data(Uint32 handle) const;
+        void finish_loads(void);
+        bool start_load(StreamedTextureData &texture, Uint32 first_mip);
+
+        RenderDevice *device = nullptr;
+        ArenaAllocator memory;
+        StreamedTextureData *textures = nullptr;
+        TextureLoader *loader = nullptr;
+        Uint32 max_textures = 0;
+        Uint32 max_loads = 0;
+        Uint32 used_textures = 0; // Slots that were ever used, freed ones are reused first
+        Uint32 next_free = 0; // Index + 1 of the first free slot
+        Uint64 upgrade_bytes = 0; // That the upgrades in flight will add
+
+        TextureStreamerStats stats = {};
+    };
+}
+
+#endif /* KAI_TEXTURE_STREAMER_H */
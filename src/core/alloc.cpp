@@ -8,12 +8,16 @@
 #include "includes/alloc.h"
 #include "includes/utils.h"
 #include "alloc_internal.h"
+#include "sync_internal.h"
 #include "../platform/platform.h"
 
 #define BLOCK_SIZE 256
 
 static MemoryManager memory_manager;
 
+// Allocators can get created on any thread (e.g. CommandBuffers that grow while being recorded in parallel)
+static SpinLock memory_manager_lock;
+
 static void reset_memory_manager(void) {
     memset(&memory_manager, 0, sizeof(memory_manager));
 }
@@ -70,6 +74,8 @@ void MemoryManager::destroy(void) {
 }
 
 bool MemoryManager::reserve_blocks(MemoryHandle &handle, size_t bytes) {
+    ScopedSpinLock lock(memory_manager_lock);
+
     Uint64 bytes_used = memory_manager.bytes_used + bytes;
 
     if(bytes_used < memory_manager.bytes_size) {
@@ -127,6 +133,8 @@ bool MemoryManager::reserve_blocks(MemoryHandle &handle, size_t bytes) {
 }
 
 void MemoryManager::free_blocks(MemoryHandle &handle) {
+    ScopedSpinLock lock(memory_manager_lock);
+
     Uint64 header_index;
     Uint64 header_bit;
     get_initial_header_index(header_index, header_bit, &handle.block_start);
@@ -0,0 +1,175 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_CAPTURE_INTERNAL_H
+#define KAI_CAPTURE_INTERNAL_H
+
+#include "includes/alloc.h"
+#include "includes/render.h"
+#include "includes/types.h"
+#include "render_internal.h"
+
+// A capture holds everything that was executed from capture_next_frame() up to the next present(), so the
+// frame can be executed again offline, see src/tools/replay. The file is laid out as:
+//
+//   CaptureHeader
+//   CapturePipeline * pipeline_count, each followed by its 4 shader strings and its CaptureInputLayouts
+//   CaptureBuffer * buffer_count, each followed by its data
+//   CaptureTexture * texture_count, each followed by the pixels of its mips
+//   CaptureList * list_count, each followed by its commands, instance data and constants
+//
+// Only the pipelines, buffers and textures that the frame uses are stored, the commands refer to them by their index
+// in the file. Strings include their null terminator and every variable sized part is padded to 4 bytes,
+// so a loaded capture can point right into the file.
+//
+// A CaptureList is either an executed CommandBuffer or a call that changed the state of the device in between
+// them. The commands of a CommandBuffer are stored as decoded by CommandDecoder, without merging any draws: the
+// CommandEncoding as one byte, followed by varint operands:
+//
+//   draw:                    [count] [start]
+//   draw_indexed:            [count] [start] [base (zigzag)]
+//   draw_instanced:          [count] [start] [instance count] [instance stride] [instance offset]
+//   draw_indexed_instanced:  the same as draw_instanced, followed by [base (zigzag)]
+//   set_render_pipeline:     [pipeline index]
+//   bind_buffer:             [buffer index] [RenderBufferType] [ShaderType]
+//   bind_constants:          [offset into the constants of the list] [size] [ShaderType]
+//   bind_texture:            [texture index] [slot]
+//   clears:                  no operands
+#define CAPTURE_MAGIC 0x5041434b // "KCAP"
+#define CAPTURE_VERSION 3
+
+struct CaptureHeader {
+    Uint32 magic;
+    Uint32 version;
+    Uint32 pipeline_count;
+    Uint32 buffer_count;
+    Uint32 texture_count;
+    Uint32 list_count;
+    Int32 viewport[4]; // At the start of the capture, a width/height of 0 means the size of the window
+};
+
+#define CAPTURE_PIPELINE_COLOR_ENABLE (1 << 0)
+#define CAPTURE_PIPELINE_DEPTH_ENABLE (1 << 1)
+#define CAPTURE_PIPELINE_STENCIL_ENABLE (1 << 2)
+#define CAPTURE_PIPELINE_FRONT_CCW (1 << 3)
+// The stage was created from bytecode, which is stored in place of its source and without an entry point
+#define CAPTURE_PIPELINE_VERTEX_BYTECODE (1 << 4)
+#define CAPTURE_PIPELINE_PIXEL_BYTECODE (1 << 5)
+
+struct CapturePipeline {
+    Uint32 string_sizes[4]; // Vertex shader source (or bytecode) and entry, pixel shader source (or bytecode) and entry
+    Uint32 input_layout_count;
+    Float32 color_clear_values[4];
+    Float32 depth_clear_value;
+    Uint32 stencil_clear_value;
+    Uint8 fill_mode;
+    Uint8 cull_mode;
+    Uint8 topology;
+    Uint8 flags;
+};
+
+struct CaptureInputLayout {
+    Uint32 name_size;
+    Uint32 index;
+    Uint32 offset;
+    Uint8 format;
+    Uint8 per_instance;
+    Uint8 padding[2];
+};
+
+struct CaptureBuffer {
+    Uint32 byte_size;
+    Uint32 stride;
+    Uint8 type;
+    Uint8 cpu_usage;
+    Uint8 resource_usage;
+    Uint8 has_data; // Buffers that were created without initial data don't store any
+};
+
+struct CaptureTexture {
+    Uint32 width;
+    Uint32 height;
+    Uint8 format;
+    Uint8 resource_usage;
+    Uint8 has_data; // Like CaptureBuffer
+    Uint8 mip_count;
+};
+
+enum class CaptureListType : Uint32 {
+    command_buffer,
+    set_viewport,
+    set_render_pipeline
+};
+
+struct CaptureList {
+    CaptureListType type;
+
+    // command_buffer only
+    Uint32 command_count;
+    Uint32 command_size;
+    Uint32 instance_size;
+    Uint32 constant_size;
+
+    Int32 viewport[4]; // set_viewport only
+    Uint32 pipeline; // set_render_pipeline only
+};
+
+// A capture file that was loaded for replaying. Everything points into the memory of the file
+struct Capture {
+    struct Pipeline {
+        kai::RenderPipelineInfo info;
+        const kai::RenderInputLayoutInfo *input_layouts;
+        Uint32 input_layout_count;
+    };
+
+    struct List {
+        CaptureListType type;
+        Uint32 command_count;
+        const Uint8 *commands;
+        Uint32 command_size;
+        const Uint8 *instance_data;
+        Uint32 instance_size;
+        const Uint8 *constants;
+        Uint32 constant_size;
+        Int32 viewport[4];
+        Uint32 pipeline;
+    };
+
+    kai::ArenaAllocator memory; // The file
+    kai::ArenaAllocator tables;
+    Uint32 file_size;
+
+    Pipeline *pipelines;
+    Uint32 pipeline_count;
+    kai::RenderBufferInfo *buffers;
+    Uint32 buffer_count;
+    kai::RenderTextureInfo *textures;
+    Uint32 texture_count;
+    List *lists;
+    Uint32 list_count;
+    Int32 viewport[4];
+};
+
+bool load_capture(const char *path, Capture &out_capture);
+void destroy_capture(Capture &capture);
+
+// A command of a CaptureList. The handles of set_render_pipeline, bind_buffer and bind_texture are 0, 'resource'
+// is their index in the capture instead. The offset of bind_constants is into the constants of the list
+struct CaptureCommand {
+    CommandEncodingData data;
+    Uint32 resource;
+};
+
+// Reads the command at 'stream' and advances it past the command
+void read_capture_command(const Uint8 *&stream, CaptureCommand &out_command);
+
+// Wraps 'device' into a device that forwards everything to it and can capture frames. It keeps a copy of every
+// pipeline description, buffer and texture that gets created, which is why this has to be opted into with init_renderer()
+kai::RenderDevice * create_capture_device(kai::StackAllocator &allocator, kai::RenderDevice *device);
+
+// The device of the backend, which differs from RenderDevice::get() if the renderer can capture frames
+kai::RenderDevice * get_backend_device(void);
+
+#endif /* KAI_CAPTURE_INTERNAL_H */
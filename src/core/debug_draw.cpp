@@ -0,0 +1,263 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "includes/kai.h"
+#include "includes/debug_draw.h"
+
+static const char *debug_draw_shader_source =
+    "cbuffer Constants : register(b0) { float4x4 view_projection; };\n"
+    "struct VSInput { float3 position : POSITION; float4 color : COLOR; };\n"
+    "struct VSOutput { float4 position : SV_POSITION; float4 color : COLOR; };\n"
+    "VSOutput vs_main(VSInput input) {\n"
+    "    VSOutput output;\n"
+    "    output.position = mul(view_projection, float4(input.position, 1.0f));\n"
+    "    output.color = input.color;\n"
+    "    return output;\n"
+    "}\n"
+    "float4 ps_main(VSOutput input) : SV_TARGET { return input.color; }\n";
+
+// The corners of a box are numbered by their bits, x in bit 0, y in bit 1 and z in bit 2
+static const Uint8 box_edge_corners[24] = {
+    0, 1, 2, 3, 4, 5, 6, 7, // Along x
+    0, 2, 1, 3, 4, 6, 5, 7, // Along y
+    0, 4, 1, 5, 2, 6, 3, 7 // Along z
+};
+
+// A vertex is a single 16 byte store, the position goes into xyz and the color into the bits of w
+static KAI_FORCEINLINE __m128 get_color_lane(Uint32 color) {
+    return _mm_castsi128_ps(_mm_set_epi32(static_cast<Int32>(color), 0, 0, 0));
+}
+
+static KAI_FORCEINLINE void store_vertex(kai::DebugDrawVertex *vertex, __m128 position, __m128 color_lane) {
+    const __m128 xyz_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    _mm_storeu_ps(vertex->position, _mm_or_ps(_mm_and_ps(position, xyz_mask), color_lane));
+}
+
+kai::DebugDraw::DebugDraw(RenderDevice *render_device, Uint32 max_vertices) {
+    // Every shape is made of whole lines
+    max_vertices &= ~1u;
+
+    memory = ArenaAllocator(static_cast<size_t>(max_vertices) * sizeof(DebugDrawVertex));
+    if(!memory.get_buffer()) {
+        kai::log("Could not allocate %u debug draw vertices!\n", max_vertices);
+        return;
+    }
+
+    RenderBufferInfo buffer_info = {};
+    buffer_info.byte_size = static_cast<size_t>(max_vertices) * sizeof(DebugDrawVertex);
+    buffer_info.stride = sizeof(DebugDrawVertex);
+    buffer_info.type = RenderBufferType::vertex;
+    buffer_info.cpu_usage = RenderCPUUsage::write;
+    buffer_info.resource_usage = RenderResourceUsage::cpu_w_gpu_r;
+
+    if(!render_device->create_buffer(buffer_info, vertex_buffer)) {
+        kai::log("Could not create the vertex buffer for debug drawing!\n");
+        memory.destroy();
+        return;
+    }
+
+    RenderPipelineInfo pipeline_info = {};
+    pipeline_info.vertex_shader_source = debug_draw_shader_source;
+    pipeline_info.vertex_shader_entry = "vs_main";
+    pipeline_info.pixel_shader_source = debug_draw_shader_source;
+    pipeline_info.pixel_shader_entry = "ps_main";
+    pipeline_info.cull_mode = RenderPipelineInfo::CullMode::none;
+    pipeline_info.topology = RenderPipelineInfo::TopologyType::line_list;
+    pipeline_info.front_ccw = false;
+
+    const RenderInputLayoutInfo input_layouts[] = {
+        { "POSITION", 0, RenderFormat::rgb_f32, offsetof(DebugDrawVertex, position) },
+        { "COLOR", 0, RenderFormat::rgba_unorm8, offsetof(DebugDrawVertex, color) }
+    };
+
+    if(!render_device->create_render_pipeline(pipeline_info, input_layouts, KAI_ARRAY_COUNT(input_layouts), pipeline)) {
+        kai::log("Could not create the pipeline for debug drawing!\n");
+        render_device->destroy_buffer(vertex_buffer);
+        memory.destroy();
+        return;
+    }
+
+    for(Uint32 i = 0; i < KAI_DEBUG_DRAW_CIRCLE_SEGMENTS; i++) {
+        Float32 angle = static_cast<Float32>(i) * (kai::pi2 / static_cast<Float32>(KAI_DEBUG_DRAW_CIRCLE_SEGMENTS));
+        circle_cos[i] = kai::cosine(angle);
+        circle_sin[i] = kai::sine(angle);
+    }
+
+    device = render_device;
+    vertices = static_cast<DebugDrawVertex *>(memory.get_buffer());
+    capacity = max_vertices;
+
+    begin();
+}
+
+void kai::DebugDraw::destroy(void) {
+    if(device) {
+        // The last frame may still be drawing them
+        device->destroy_buffer_deferred(vertex_buffer);
+        device->destroy_render_pipeline_deferred(pipeline);
+    }
+
+    memory.destroy();
+
+    *this = DebugDraw();
+}
+
+void kai::DebugDraw::begin(void) {
+    vertex_count = 0;
+    dropped_count = 0;
+}
+
+void kai::DebugDraw::end(CommandBuffer &command_buffer, const Mat4x4 &view_projection) {
+    if(!vertex_count) {
+        return;
+    }
+
+    ConstantSlice constants;
+    if(!device->allocate_constants(sizeof(Mat4x4), constants)) {
+        return;
+    }
+
+    memcpy(constants.data, view_projection.m, sizeof(Mat4x4));
+
+    if(!device->update_buffer(vertex_buffer, vertices, vertex_count * static_cast<Uint32>(sizeof(DebugDrawVertex)))) {
+        return;
+    }
+
+    command_buffer.set_render_pipeline(pipeline);
+    command_buffer.bind_buffer(vertex_buffer, RenderBufferType::vertex);
+    command_buffer.bind_constants(constants);
+    command_buffer.draw(vertex_count);
+}
+
+kai::DebugDrawVertex * kai::DebugDraw::reserve(Uint32 count) {
+    if(count > capacity - vertex_count) {
+        dropped_count += count;
+        return nullptr;
+    }
+
+    DebugDrawVertex *reserved = vertices + vertex_count;
+    vertex_count += count;
+
+    return reserved;
+}
+
+void kai::DebugDraw::line(const Vec4 &a, const Vec4 &b, Uint32 color) {
+    DebugDrawVertex *v = reserve(2);
+    if(!v) {
+        return;
+    }
+
+    const __m128 color_lane = get_color_lane(color);
+    store_vertex(v, _mm_loadu_ps(&a.x), color_lane);
+    store_vertex(v + 1, _mm_loadu_ps(&b.x), color_lane);
+}
+
+void kai::DebugDraw::lines(const Vec4 *points, Uint32 line_count, Uint32 color) {
+    DebugDrawVertex *v = reserve(line_count * 2);
+    if(!v) {
+        return;
+    }
+
+    const __m128 color_lane = get_color_lane(color);
+    for(Uint32 i = 0; i < line_count * 2; i++) {
+        store_vertex(v + i, _mm_loadu_ps(&points[i].x), color_lane);
+    }
+}
+
+void kai::DebugDraw::box_edges(const Vec4 *corners, Uint32 color) {
+    DebugDrawVertex *v = reserve(KAI_ARRAY_COUNT(box_edge_corners));
+    if(!v) {
+        return;
+    }
+
+    const __m128 color_lane = get_color_lane(color);
+    for(Uint32 i = 0; i < KAI_ARRAY_COUNT(box_edge_corners); i++) {
+        store_vertex(v + i, _mm_loadu_ps(&corners[box_edge_corners[i]].x), color_lane);
+    }
+}
+
+void kai::DebugDraw::box(const Vec4 &box_min, const Vec4 &box_max, Uint32 color) {
+    Vec4 corners[8];
+    for(Uint32 i = 0; i < 8; i++) {
+        corners[i] = Vec4((i & 1) ? box_max.x : box_min.x, (i & 2) ? box_max.y : box_min.y, (i & 4) ? box_max.z : box_min.z);
+    }
+
+    box_edges(corners, color);
+}
+
+void kai::DebugDraw::box(const Mat4x4 &transform, Uint32 color) {
+    Vec4 corners[8];
+    for(Uint32 i = 0; i < 8; i++) {
+        corners[i] = Vec4((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f, 1.0f);
+    }
+
+    kai::transform(transform, corners, corners, 8);
+
+    // Frustums are usually drawn from an inverse projection, which leaves w != 1
+    for(Vec4 &corner : corners) {
+        corner /= corner.w;
+    }
+
+    box_edges(corners, color);
+}
+
+void kai::DebugDraw::circle_axes(const Vec4 &center, const Vec4 &u, const Vec4 &v, Uint32 color) {
+    DebugDrawVertex *out = reserve(KAI_DEBUG_DRAW_CIRCLE_SEGMENTS * 2);
+    if(!out) {
+        return;
+    }
+
+    typedef simd::Float4 L;
+
+    const __m128 c = L::load(&center.x);
+    const __m128 cu = L::load(&u.x);
+    const __m128 cv = L::load(&v.x);
+    const __m128 color_lane = get_color_lane(color);
+
+    // Every point ends one segment and starts the next one
+    __m128 first = L::add(c, cu);
+    __m128 previous = first;
+
+    for(Uint32 i = 1; i < KAI_DEBUG_DRAW_CIRCLE_SEGMENTS; i++) {
+        __m128 point = L::madd(L::set1(circle_cos[i]), cu, L::madd(L::set1(circle_sin[i]), cv, c));
+
+        store_vertex(out++, previous, color_lane);
+        store_vertex(out++, point, color_lane);
+        previous = point;
+    }
+
+    store_vertex(out++, previous, color_lane);
+    store_vertex(out, first, color_lane);
+}
+
+void kai::DebugDraw::circle(const Vec4 &center, const Vec4 &normal, Float32 radius, Uint32 color) {
+    Vec4 n = normal;
+    n.w = 0.0f;
+    n.normalize();
+
+    // Any vector that isn't parallel to the normal gives the plane of the circle
+    Vec4 u = kai::cross(n, (kai::abs(n.x) < 0.9f) ? Vec4(1.0f) : Vec4(0.0f, 1.0f));
+    u.normalize();
+
+    Vec4 v = kai::cross(n, u);
+
+    u *= radius;
+    v *= radius;
+
+    circle_axes(center, u, v, color);
+}
+
+void kai::DebugDraw::sphere(const Vec4 &center, Float32 radius, Uint32 color) {
+    const Vec4 x(radius);
+    const Vec4 y(0.0f, radius);
+    const Vec4 z(0.0f, 0.0f, radius);
+
+    circle_axes(center, x, y, color);
+    circle_axes(center, y, z, color);
+    circle_axes(center, z, x, color);
+}
@@ -0,0 +1,603 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#include <string.h>
+
+#include "includes/frame_graph.h"
+#include "includes/kai.h"
+
+struct kai::FrameGraph::Pass {
+    const char *name;
+    FrameGraphPassProc proc;
+    void *user_data;
+    Uint32 first_access; // The accesses of a pass are grouped together by compile()
+    Uint32 access_count;
+    Bool32 side_effects;
+    Bool32 culled;
+};
+
+struct kai::FrameGraph::Resource {
+    const char *name;
+    FrameGraphResourceInfo info;
+    void *memory; // Imported resources only
+    Uint64 size;
+    Uint64 offset;
+    Uint32 first_use; // Index into the schedule
+    Uint32 last_use;
+    Bool32 imported;
+    Bool32 output;
+
+    // While the dependencies are built
+    Uint32 last_writer;
+    Uint32 first_reader; // Index of the first access that read the resource since the last write
+};
+
+struct kai::FrameGraph::Access {
+    FrameGraphPass pass;
+    FrameGraphResource resource;
+    Bool32 write;
+    Uint32 next_reader;
+};
+
+struct kai::FrameGraph::Edge {
+    Uint32 from;
+    Uint32 to;
+    Bool32 data; // Order only dependencies don't keep the earlier pass alive
+};
+
+// ------------ Building the graph ------------ //
+kai::FrameGraph::FrameGraph(Uint32 pass_capacity, Uint32 resource_capacity, Uint32 access_capacity) {
+    Uint64 bytes = static_cast<Uint64>(pass_capacity) * (sizeof(Pass) + sizeof(FrameGraphPass)) +
+                   static_cast<Uint64>(resource_capacity) * sizeof(Resource) +
+                   static_cast<Uint64>(access_capacity) * sizeof(Access);
+
+    memory = StackAllocator(static_cast<Uint32>(bytes));
+
+    passes = memory.alloc<Pass>(nullptr, pass_capacity);
+    resources = memory.alloc<Resource>(nullptr, resource_capacity);
+    accesses = memory.alloc<Access>(nullptr, access_capacity);
+    schedule = memory.alloc<FrameGraphPass>(nullptr, pass_capacity);
+
+    if(!passes || !resources || !accesses || !schedule) {
+        kai::log("Could not allocate a frame graph for %u passes and %u resources!\n", pass_capacity, resource_capacity);
+        memory.destroy();
+        *this = FrameGraph();
+        return;
+    }
+
+    max_passes = pass_capacity;
+    max_resources = resource_capacity;
+    max_accesses = access_capacity;
+}
+
+void kai::FrameGraph::destroy(void) {
+    memory.destroy();
+    scratch.destroy();
+    heap.destroy();
+
+    *this = FrameGraph();
+}
+
+void kai::FrameGraph::begin(void) {
+    pass_count = 0;
+    resource_count = 0;
+    access_count = 0;
+    scheduled_count = 0;
+    compiled = false;
+    stats = {};
+}
+
+kai::FrameGraphResource kai::FrameGraph::create_resource(const char *name, const FrameGraphResourceInfo &info) {
+    if(resource_count >= max_resources) {
+        kai::log("Frame graph: Too many resources, '%s' was not created!\n", name);
+        return KAI_FRAME_GRAPH_INVALID;
+    }
+
+    KAI_ASSERT(info.alignment > 0 && (info.alignment & (info.alignment - 1)) == 0);
+
+    Resource &resource = resources[resource_count];
+    resource = {};
+    resource.name = name;
+    resource.info = info;
+
+    if(info.width > 0 && info.height > 0 && info.format != RenderFormat::unknown) {
+        resource.size = static_cast<Uint64>(info.width) * info.height * kai::get_format_size(info.format);
+    } else {
+        resource.size = info.byte_size;
+    }
+
+    align_to_pow2(resource.size, static_cast<Uint64>(info.alignment));
+
+    return resource_count++;
+}
+
+kai::FrameGraphResource kai::FrameGraph::import_resource(const char *name, void *resource_memory, const FrameGraphResourceInfo &info) {
+    FrameGraphResource resource = create_resource(name, info);
+
+    if(resource != KAI_FRAME_GRAPH_INVALID) {
+        resources[resource].memory = resource_memory;
+        resources[resource].imported = true;
+    }
+
+    return resource;
+}
+
+void kai::FrameGraph::mark_output(FrameGraphResource resource) {
+    if(resource < resource_count) {
+        resources[resource].output = true;
+    }
+}
+
+kai::FrameGraphPass kai::FrameGraph::add_pass(const char *name, FrameGraphPassProc proc, void *user_data, Bool32 side_effects) {
+    if(pass_count >= max_passes) {
+        kai::log("Frame graph: Too many passes, '%s' was not added!\n", name);
+        return KAI_FRAME_GRAPH_INVALID;
+    }
+
+    Pass &pass = passes[pass_count];
+    pass = {};
+    pass.name = name;
+    pass.proc = proc;
+    pass.user_data = user_data;
+    pass.side_effects = side_effects;
+
+    return pass_count++;
+}
+
+void kai::FrameGraph::read(FrameGraphPass pass, FrameGraphResource resource) {
+    if(pass >= pass_count || resource >= resource_count) {
+        return;
+    }
+
+    if(access_count >= max_accesses) {
+        kai::log("Frame graph: Too many accesses, '%s' can't read '%s'!\n", passes[pass].name, resources[resource].name);
+        return;
+    }
+
+    accesses[access_count++] = { pass, resource, false, KAI_FRAME_GRAPH_INVALID };
+}
+
+void kai::FrameGraph::write(FrameGraphPass pass, FrameGraphResource resource) {
+    if(pass >= pass_count || resource >= resource_count) {
+        return;
+    }
+
+    if(access_count >= max_accesses) {
+        kai::log("Frame graph: Too many accesses, '%s' can't write '%s'!\n", passes[pass].name, resources[resource].name);
+        return;
+    }
+
+    accesses[access_count++] = { pass, resource, true, KAI_FRAME_GRAPH_INVALID };
+}
+
+// ------------ Compile ------------ //
+// Walks the accesses in the order of the passes. Both a read and a write depend on the last write of the resource,
+// a write also has to wait for the reads of the previous contents
+Uint32 kai::FrameGraph::build_edges(Edge *out_edges) {
+    for(Uint32 i = 0; i < resource_count; i++) {
+        resources[i].last_writer = KAI_FRAME_GRAPH_INVALID;
+        resources[i].first_reader = KAI_FRAME_GRAPH_INVALID;
+    }
+
+    Uint32 edge_count = 0;
+    auto add_edge = [&](Uint32 from, Uint32 to, Bool32 data) {
+        if(from != to) {
+            if(out_edges) {
+                out_edges[edge_count] = { from, to, data };
+            }
+            edge_count++;
+        }
+    };
+
+    for(Uint32 first = 0; first < access_count;) {
+        Uint32 pass = accesses[first].pass;
+        Uint32 end = first;
+
+        for(; end < access_count && accesses[end].pass == pass; end++) {
+            Access &access = accesses[end];
+            Resource &resource = resources[access.resource];
+
+            if(resource.last_writer != KAI_FRAME_GRAPH_INVALID) {
+                add_edge(resource.last_writer, pass, true);
+            }
+
+            if(access.write) {
+                for(Uint32 reader = resource.first_reader; reader != KAI_FRAME_GRAPH_INVALID; reader = accesses[reader].next_reader) {
+                    add_edge(accesses[reader].pass, pass, false);
+                }
+            }
+        }
+
+        // Only updated once the whole pass was seen, a pass that reads and writes a resource reads the previous contents
+        for(Uint32 i = first; i < end; i++) {
+            Access &access = accesses[i];
+            Resource &resource = resources[access.resource];
+
+            if(access.write) {
+                resource.last_writer = pass;
+                resource.first_reader = KAI_FRAME_GRAPH_INVALID;
+                access.next_reader = KAI_FRAME_GRAPH_INVALID;
+            } else {
+                access.next_reader = resource.first_reader;
+                resource.first_reader = i;
+            }
+        }
+
+        first = end;
+    }
+
+    return edge_count;
+}
+
+bool kai::FrameGraph::compile(void) {
+    Uint64 start = get_timestamp();
+
+    // Group the accesses by pass while keeping their order, they're usually added pass by pass already
+    for(Uint32 i = 1; i < access_count; i++) {
+        Access access = accesses[i];
+        Uint32 j = i;
+
+        for(; j > 0 && accesses[j - 1].pass > access.pass; j--) {
+            accesses[j] = accesses[j - 1];
+        }
+
+        accesses[j] = access;
+    }
+
+    for(Uint32 i = 0; i < pass_count; i++) {
+        passes[i].first_access = 0;
+        passes[i].access_count = 0;
+        passes[i].culled = true;
+    }
+
+    for(Uint32 i = access_count; i > 0; i--) {
+        Pass &pass = passes[accesses[i - 1].pass];
+        pass.first_access = i - 1;
+        pass.access_count++;
+    }
+
+    Uint32 edge_count = build_edges(nullptr);
+
+    // Every array gets at least one element, so a graph without edges or resources doesn't allocate zero bytes
+    Uint32 edge_slots = kai::max(edge_count, 1u);
+    Uint32 pass_slots = kai::max(pass_count, 1u);
+    Uint32 resource_slots = kai::max(resource_count, 1u);
+
+    // Edges, the incoming and outgoing edges of every pass, the state of the passes and the order of the resources
+    Uint64 scratch_bytes = static_cast<Uint64>(edge_slots) * (sizeof(Edge) + 2 * sizeof(Uint32)) +
+                           static_cast<Uint64>(pass_count + 1) * 2 * sizeof(Uint32) +
+                           static_cast<Uint64>(pass_slots) * 3 * sizeof(Uint32) +
+                           static_cast<Uint64>(resource_slots) * 2 * sizeof(Uint32);
+
+    if(scratch_bytes > scratch_capacity) {
+        Uint32 capacity = kai::max(static_cast<Uint32>(scratch_bytes), 2 * scratch_capacity);
+
+        scratch.destroy();
+        scratch = StackAllocator(capacity);
+        scratch_capacity = scratch.get_data() ? capacity : 0;
+    }
+
+    StackMarker marker = 0;
+    Edge *edges = scratch.alloc<Edge>(&marker, edge_slots);
+    Uint32 *in_offsets = scratch.alloc<Uint32>(nullptr, pass_count + 1);
+    Uint32 *in_passes = scratch.alloc<Uint32>(nullptr, edge_slots);
+    Uint32 *out_offsets = scratch.alloc<Uint32>(nullptr, pass_count + 1);
+    Uint32 *out_passes = scratch.alloc<Uint32>(nullptr, edge_slots);
+    Uint32 *in_degrees = scratch.alloc<Uint32>(nullptr, pass_slots);
+    Uint32 *worklist = scratch.alloc<Uint32>(nullptr, pass_slots);
+    Uint32 *ready = scratch.alloc<Uint32>(nullptr, pass_slots);
+    Uint32 *order = scratch.alloc<Uint32>(nullptr, resource_slots);
+    Uint32 *placed = scratch.alloc<Uint32>(nullptr, resource_slots);
+
+    if(!edges || !in_offsets || !in_passes || !out_offsets || !out_passes || !in_degrees || !worklist || !ready || !order || !placed) {
+        kai::log("Frame graph: Could not allocate %llu bytes to compile the graph!\n", static_cast<unsigned long long>(scratch_bytes));
+        scratch.free(marker);
+        return false;
+    }
+
+    build_edges(edges);
+
+    // ----- Culling ----- //
+    // A pass is needed if it has side effects, writes an output or something a needed pass depends on
+    memset(in_offsets, 0, (pass_count + 1) * sizeof(Uint32));
+    for(Uint32 i = 0; i < edge_count; i++) {
+        in_offsets[edges[i].to + 1] += edges[i].data ? 1 : 0;
+    }
+
+    for(Uint32 i = 0; i < pass_count; i++) {
+        in_offsets[i + 1] += in_offsets[i];
+    }
+
+    for(Uint32 i = 0; i < edge_count; i++) {
+        if(edges[i].data) {
+            in_passes[in_offsets[edges[i].to]++] = edges[i].from;
+        }
+    }
+
+    // Filling the lists moved every offset to the start of the next pass
+    for(Uint32 i = pass_count; i > 0; i--) {
+        in_offsets[i] = in_offsets[i - 1];
+    }
+    in_offsets[0] = 0;
+
+    Uint32 worklist_count = 0;
+    for(Uint32 i = 0; i < pass_count; i++) {
+        Pass &pass = passes[i];
+        bool needed = pass.side_effects;
+
+        for(Uint32 j = 0; j < pass.access_count && !needed; j++) {
+            const Access &access = accesses[pass.first_access + j];
+            const Resource &resource = resources[access.resource];
+            needed = access.write && (resource.imported || resource.output);
+        }
+
+        if(needed) {
+            pass.culled = false;
+            worklist[worklist_count++] = i;
+        }
+    }
+
+    while(worklist_count > 0) {
+        Uint32 pass = worklist[--worklist_count];
+
+        for(Uint32 i = in_offsets[pass]; i < in_offsets[pass + 1]; i++) {
+            Pass &dependency = passes[in_passes[i]];
+
+            if(dependency.culled) {
+                dependency.culled = false;
+                worklist[worklist_count++] = in_passes[i];
+            }
+        }
+    }
+
+    // ----- Scheduling ----- //
+    memset(out_offsets, 0, (pass_count + 1) * sizeof(Uint32));
+    memset(in_degrees, 0, pass_count * sizeof(Uint32));
+
+    for(Uint32 i = 0; i < edge_count; i++) {
+        if(!passes[edges[i].from].culled && !passes[edges[i].to].culled) {
+            out_offsets[edges[i].from + 1]++;
+            in_degrees[edges[i].to]++;
+        }
+    }
+
+    for(Uint32 i = 0; i < pass_count; i++) {
+        out_offsets[i + 1] += out_offsets[i];
+    }
+
+    for(Uint32 i = 0; i < edge_count; i++) {
+        if(!passes[edges[i].from].culled && !passes[edges[i].to].culled) {
+            out_passes[out_offsets[edges[i].from]++] = edges[i].to;
+        }
+    }
+
+    for(Uint32 i = pass_count; i > 0; i--) {
+        out_offsets[i] = out_offsets[i - 1];
+    }
+    out_offsets[0] = 0;
+
+    Uint32 alive_count = 0;
+    for(Uint32 i = 0; i < pass_count; i++) {
+        ready[i] = !passes[i].culled && in_degrees[i] == 0;
+        alive_count += passes[i].culled ? 0 : 1;
+    }
+
+    // Prefer a pass that the last scheduled pass made ready, so that what it wrote gets consumed right away.
+    // Otherwise, the pass that was added first
+    scheduled_count = 0;
+    Uint32 preferred = KAI_FRAME_GRAPH_INVALID;
+
+    while(scheduled_count < alive_count) {
+        Uint32 next = preferred;
+
+        if(next == KAI_FRAME_GRAPH_INVALID) {
+            for(Uint32 i = 0; i < pass_count; i++) {
+                if(ready[i]) {
+                    next = i;
+                    break;
+                }
+            }
+        }
+
+        KAI_ASSERT(next != KAI_FRAME_GRAPH_INVALID);
+
+        ready[next] = false;
+        schedule[scheduled_count++] = next;
+        preferred = KAI_FRAME_GRAPH_INVALID;
+
+        for(Uint32 i = out_offsets[next]; i < out_offsets[next + 1]; i++) {
+            Uint32 dependent = out_passes[i];
+
+            if(--in_degrees[dependent] == 0) {
+                ready[dependent] = true;
+                preferred = kai::min(preferred, dependent);
+            }
+        }
+    }
+
+    // ----- Aliasing ----- //
+    for(Uint32 i = 0; i < resource_count; i++) {
+        resources[i].first_use = KAI_FRAME_GRAPH_INVALID;
+        resources[i].last_use = 0;
+    }
+
+    for(Uint32 i = 0; i < scheduled_count; i++) {
+        const Pass &pass = passes[schedule[i]];
+
+        for(Uint32 j = 0; j < pass.access_count; j++) {
+            Resource &resource = resources[accesses[pass.first_access + j].resource];
+            resource.first_use = kai::min(resource.first_use, i);
+            resource.last_use = kai::max(resource.last_use, i);
+        }
+    }
+
+    Uint32 order_count = 0;
+    stats.transient_bytes = 0;
+
+    for(Uint32 i = 0; i < resource_count; i++) {
+        if(!resources[i].imported && resources[i].first_use != KAI_FRAME_GRAPH_INVALID) {
+            order[order_count++] = i;
+            stats.transient_bytes += resources[i].size;
+        }
+    }
+
+    // Largest first, the smaller resources then fill the gaps that are left
+    for(Uint32 i = 1; i < order_count; i++) {
+        Uint32 resource = order[i];
+        Uint32 j = i;
+
+        for(; j > 0 && resources[order[j - 1]].size < resources[resource].size; j--) {
+            order[j] = order[j - 1];
+        }
+
+        order[j] = resource;
+    }
+
+    // Every resource goes to the lowest offset where it doesn't overlap any of the placed resources that are alive at
+    // the same time. The candidates are the start of the heap and the end of each of those
+    Uint64 heap_bytes = 0;
+
+    for(Uint32 i = 0; i < order_count; i++) {
+        Resource &resource = resources[order[i]];
+        Uint32 overlap_count = 0;
+
+        for(Uint32 j = 0; j < i; j++) {
+            const Resource &other = resources[order[j]];
+
+            if(other.first_use <= resource.last_use && resource.first_use <= other.last_use) {
+                placed[overlap_count++] = order[j];
+            }
+        }
+
+        Uint64 best = ~0ull;
+        for(Uint32 candidate = 0; candidate <= overlap_count; candidate++) {
+            Uint64 offset = candidate == overlap_count ? 0 : resources[placed[candidate]].offset + resources[placed[candidate]].size;
+            align_to_pow2(offset, static_cast<Uint64>(resource.info.alignment));
+
+            if(offset >= best) {
+                continue;
+            }
+
+            bool fits = true;
+            for(Uint32 j = 0; j < overlap_count && fits; j++) {
+                const Resource &other = resources[placed[j]];
+                fits = offset + resource.size <= other.offset || other.offset + other.size <= offset;
+            }
+
+            if(fits) {
+                best = offset;
+            }
+        }
+
+        resource.offset = best;
+        heap_bytes = kai::max(heap_bytes, best + resource.size);
+    }
+
+    scratch.free(marker);
+
+    if(heap_bytes > heap_capacity) {
+        heap.destroy();
+        heap = ArenaAllocator(heap_bytes);
+        heap_memory = static_cast<Uint8 *>(heap.get_buffer());
+        heap_capacity = heap_memory ? heap_bytes : 0;
+
+        if(!heap_capacity) {
+            kai::log("Frame graph: Could not allocate a %llu byte heap!\n", static_cast<unsigned long long>(heap_bytes));
+            return false;
+        }
+    }
+
+    stats.pass_count = pass_count;
+    stats.culled_pass_count = pass_count - scheduled_count;
+    stats.resource_count = order_count;
+    stats.heap_bytes = heap_bytes;
+    stats.compile_ms = static_cast<Float64>(get_timestamp() - start) * 1000.0 / static_cast<Float64>(get_timestamp_frequency());
+    compiled = true;
+
+    return true;
+}
+
+void kai::FrameGraph::execute(void) const {
+    if(!compiled) {
+        return;
+    }
+
+    for(Uint32 i = 0; i < scheduled_count; i++) {
+        const Pass &pass = passes[schedule[i]];
+
+        if(pass.proc) {
+            FrameGraphContext context = { this, schedule[i] };
+            pass.proc(context, pass.user_data);
+        }
+    }
+}
+
+// ------------ Queries ------------ //
+kai::FrameGraphPass kai::FrameGraph::get_scheduled_pass(Uint32 index) const {
+    return index < scheduled_count ? schedule[index] : KAI_FRAME_GRAPH_INVALID;
+}
+
+bool kai::FrameGraph::is_culled(FrameGraphPass pass) const {
+    return pass >= pass_count || passes[pass].culled;
+}
+
+const char * kai::FrameGraph::get_pass_name(FrameGraphPass pass) const {
+    return pass < pass_count ? passes[pass].name : nullptr;
+}
+
+const char * kai::FrameGraph::get_resource_name(FrameGraphResource resource) const {
+    return resource < resource_count ? resources[resource].name : nullptr;
+}
+
+const kai::FrameGraphResourceInfo & kai::FrameGraph::get_resource_info(FrameGraphResource resource) const {
+    KAI_ASSERT(resource < resource_count);
+    return resources[resource].info;
+}
+
+bool kai::FrameGraph::get_placement(FrameGraphResource resource, Uint64 &out_offset, Uint32 &out_first, Uint32 &out_last) const {
+    if(!compiled || resource >= resource_count) {
+        return false;
+    }
+
+    const Resource &r = resources[resource];
+    if(r.imported || r.first_use == KAI_FRAME_GRAPH_INVALID) {
+        return false;
+    }
+
+    out_offset = r.offset;
+    out_first = r.first_use;
+    out_last = r.last_use;
+
+    return true;
+}
+
+bool kai::FrameGraph::has_access(FrameGraphPass pass, FrameGraphResource resource) const {
+    const Pass &p = passes[pass];
+
+    for(Uint32 i = 0; i < p.access_count; i++) {
+        if(accesses[p.first_access + i].resource == resource) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void * kai::FrameGraph::get_memory(FrameGraphResource resource) const {
+    const Resource &r = resources[resource];
+    return r.imported ? r.memory : heap_memory + r.offset;
+}
+
+void * kai::FrameGraphContext::get_memory(FrameGraphResource resource) const {
+    if(resource >= graph->resource_count || !graph->has_access(pass, resource)) {
+        return nullptr;
+    }
+
+    return graph->get_memory(resource);
+}
+
+const kai::FrameGraphResourceInfo & kai::FrameGraphContext::get_info(FrameGraphResource resource) const {
+    return graph->get_resource_info(resource);
+}
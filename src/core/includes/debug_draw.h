@@ -0,0 +1,95 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_DEBUG_DRAW_H
+#define KAI_DEBUG_DRAW_H
+
+#include "alloc.h"
+#include "math.h"
+#include "render.h"
+#include "types.h"
+#include "utils.h"
+
+#define KAI_DEBUG_DRAW_CIRCLE_SEGMENTS 32
+
+namespace kai {
+    // The vertex format of the debug lines, the color is read as rgba_unorm8
+    struct DebugDrawVertex {
+        Float32 position[3];
+        Uint32 color;
+    };
+
+    // Immediate-mode lines for debugging. Every shape is turned into line list vertices right away and all of
+    // them are uploaded into a single dynamic vertex buffer at the end of the frame. Every frame:
+    //
+    //   debug_draw.begin();
+    //   debug_draw.line(...);
+    //   debug_draw.box(...);
+    //   debug_draw.sphere(...);
+    //   debug_draw.end(command_buffer, view_projection); // One upload and one draw
+    //
+    // A shape costs a few SIMD stores per vertex and nothing else, there's no draw, bind or allocation of its
+    // own. Shapes that don't fit into 'max_vertices' anymore are dropped and counted, see get_dropped_count().
+    // The lines are drawn on top of everything, pipelines don't share a depth buffer that they could test against.
+    //
+    // A DebugDraw is meant to be used by a single thread. end() calls RenderDevice::update_buffer(), so it has
+    // to be called on the render thread once per frame, and the CommandBuffer shouldn't use auto-instancing.
+    // Colors are packed as 0xAABBGGRR. The software backend doesn't rasterize lines, so nothing shows up there.
+    struct DebugDraw {
+        KAI_API explicit DebugDraw(void) = default;
+        KAI_API DebugDraw(RenderDevice *device, Uint32 max_vertices);
+
+        KAI_API void destroy(void);
+
+        KAI_API void begin(void);
+        KAI_API void end(CommandBuffer &command_buffer, const Mat4x4 &view_projection);
+
+        // Only xyz of the points is used
+        KAI_API void line(const Vec4 &a, const Vec4 &b, Uint32 color);
+
+        // 'points' holds 2 points for each of the 'line_count' lines
+        KAI_API void lines(const Vec4 *points, Uint32 line_count, Uint32 color);
+
+        KAI_API void box(const Vec4 &box_min, const Vec4 &box_max, Uint32 color);
+
+        // The cube from -1 to 1 transformed by 'transform', for oriented boxes and frustums
+        KAI_API void box(const Mat4x4 &transform, Uint32 color);
+
+        KAI_API void circle(const Vec4 &center, const Vec4 &normal, Float32 radius, Uint32 color);
+
+        // A circle around each of the axes
+        KAI_API void sphere(const Vec4 &center, Float32 radius, Uint32 color);
+
+        // Vertices since begin()
+        Uint32 get_vertex_count(void) const {
+            return vertex_count;
+        }
+
+        Uint32 get_dropped_count(void) const {
+            return dropped_count;
+        }
+
+    private:
+        DebugDrawVertex * reserve(Uint32 count);
+        void circle_axes(const Vec4 &center, const Vec4 &u, const Vec4 &v, Uint32 color); // u and v are scaled by the radius
+        void box_edges(const Vec4 *corners, Uint32 color);
+
+        RenderDevice *device = nullptr;
+        RenderBuffer vertex_buffer;
+        RenderPipeline pipeline;
+
+        ArenaAllocator memory;
+        DebugDrawVertex *vertices = nullptr;
+        Uint32 capacity = 0;
+        Uint32 vertex_count = 0;
+        Uint32 dropped_count = 0;
+
+        // The unit circle, cosine and sine of every segment
+        Float32 circle_cos[KAI_DEBUG_DRAW_CIRCLE_SEGMENTS] = {};
+        Float32 circle_sin[KAI_DEBUG_DRAW_CIRCLE_SEGMENTS] = {};
+    };
+}
+
+#endif /* KAI_DEBUG_DRAW_H */
@@ -16,7 +16,8 @@ namespace kai {
         FILE_NONE = 0,
         FILE_READ = 1 << 0,
         FILE_WRITE = 1 << 1,
-        FILE_DELETE = 1 << 2
+        FILE_DELETE = 1 << 2,
+        FILE_CREATE = 1 << 3 // Only for the access flags, creates the file or truncates an existing one
     };
 
     // TODO: Change open_file to take a UTF-8 string for the path once that's implemented
@@ -26,6 +27,11 @@ namespace kai {
     KAI_API size_t get_file_size(FileHandle file);
 
     KAI_API bool read_file(FileHandle file, void *buffer, size_t byte_count = 0);
+    KAI_API bool write_file(FileHandle file, const void *buffer, size_t byte_count);
+
+    // Reads 'byte_count' bytes that start 'offset' bytes into the file, no matter where the last read ended.
+    // Several threads can read from the same file like this
+    KAI_API bool read_file_at(FileHandle file, void *buffer, size_t byte_count, Uint64 offset);
     KAI_API void rewind_file(FileHandle file);
 }
 
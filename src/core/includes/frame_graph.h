@@ -0,0 +1,166 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_FRAME_GRAPH_H
+#define KAI_FRAME_GRAPH_H
+
+#include "alloc.h"
+#include "render.h"
+#include "types.h"
+#include "utils.h"
+
+namespace kai {
+    typedef Uint32 FrameGraphResource;
+    typedef Uint32 FrameGraphPass;
+
+#define KAI_FRAME_GRAPH_INVALID 0xffffffff
+
+    // A width and height with a format describe a 2D render target, otherwise 'byte_size' is used as is
+    struct FrameGraphResourceInfo {
+        Uint32 width = 0;
+        Uint32 height = 0;
+        RenderFormat format = RenderFormat::unknown;
+
+        Uint64 byte_size = 0;
+        Uint32 alignment = 256;
+    };
+
+    struct FrameGraphStats {
+        Uint32 pass_count; // Declared passes, including the culled ones
+        Uint32 culled_pass_count;
+        Uint32 resource_count; // Transient resources that are used by the passes that weren't culled
+        Uint64 transient_bytes; // What the transient resources would take without aliasing
+        Uint64 heap_bytes; // What they take with aliasing
+        Float64 compile_ms;
+    };
+
+    struct FrameGraph;
+
+    // What a pass gets to see of the graph while it executes
+    struct FrameGraphContext {
+        // The memory of a resource that the pass declared a read or write of, null for any other resource
+        KAI_API void * get_memory(FrameGraphResource resource) const;
+        KAI_API const FrameGraphResourceInfo & get_info(FrameGraphResource resource) const;
+
+        const FrameGraph *graph;
+        FrameGraphPass pass;
+    };
+
+    typedef void (*FrameGraphPassProc)(const FrameGraphContext &context, void *user_data);
+
+    // Describes the passes of a frame and the resources they read and write, instead of ordering the passes and
+    // keeping their render targets alive by hand. Every frame:
+    //
+    //   graph.begin();
+    //   FrameGraphResource depth = graph.create_resource("depth", depth_info);
+    //   FrameGraphPass pass = graph.add_pass("gbuffer", gbuffer_proc, &scene);
+    //   graph.write(pass, depth);
+    //   ...
+    //   graph.compile();
+    //   graph.execute();
+    //
+    // The accesses of the passes are ordered by the order in which the passes were added: a read sees the last write
+    // of a pass that was added before it. compile() then:
+    //  - Culls the passes whose writes never reach an output, i.e. an imported resource, a resource marked with
+    //    mark_output() or a pass with side effects. A write of a resource that was written before depends on the
+    //    earlier write, since it may only write parts of it
+    //  - Orders the remaining passes by their dependencies. Out of the passes that could run next, the one that
+    //    consumes the output of the most recently scheduled pass goes first, which keeps the lifetimes short
+    //  - Places the transient resources into a single heap, resources whose lifetimes don't overlap share memory
+    //
+    // Transient resources only live from their first to their last use in a frame, their contents are undefined
+    // before the first write. Imported resources are owned by the caller and never aliased (e.g. the back buffer).
+    // The RenderDevice has no placed resources to alias, so the heap is host memory for now: CPU passes and the
+    // headless backends use it directly and the placement is what a GPU heap would need.
+    //
+    // Names aren't copied, they need to stay around until the next begin().
+    struct FrameGraph {
+        KAI_API explicit FrameGraph(void) = default;
+        KAI_API FrameGraph(Uint32 max_passes, Uint32 max_resources, Uint32 max_accesses);
+
+        KAI_API void destroy(void);
+
+        KAI_API void begin(void);
+
+        KAI_API FrameGraphResource create_resource(const char *name, const FrameGraphResourceInfo &info);
+        KAI_API FrameGraphResource import_resource(const char *name, void *memory, const FrameGraphResourceInfo &info);
+        KAI_API void mark_output(FrameGraphResource resource);
+
+        // Passes with side effects are never culled, e.g. the ones that present or read back
+        KAI_API FrameGraphPass add_pass(const char *name, FrameGraphPassProc proc, void *user_data = nullptr,
+                                        Bool32 side_effects = false);
+        KAI_API void read(FrameGraphPass pass, FrameGraphResource resource);
+        KAI_API void write(FrameGraphPass pass, FrameGraphResource resource);
+
+        // Returns false if the heap couldn't be allocated. Since a pass can only depend on the passes that were added
+        // before it, the graph can't have any cycles
+        KAI_API bool compile(void);
+        KAI_API void execute(void) const;
+
+        // Only valid after compile()
+        const FrameGraphStats & get_stats(void) const {
+            return stats;
+        }
+
+        Uint32 get_scheduled_pass_count(void) const {
+            return scheduled_count;
+        }
+
+        // The passes in execution order
+        KAI_API FrameGraphPass get_scheduled_pass(Uint32 index) const;
+        KAI_API bool is_culled(FrameGraphPass pass) const;
+        KAI_API const char * get_pass_name(FrameGraphPass pass) const;
+
+        Uint32 get_resource_count(void) const {
+            return resource_count;
+        }
+
+        KAI_API const char * get_resource_name(FrameGraphResource resource) const;
+        KAI_API const FrameGraphResourceInfo & get_resource_info(FrameGraphResource resource) const;
+
+        // Where a transient resource is placed in the heap and the scheduled passes from its first to its last use.
+        // Returns false for imported resources and the ones that aren't used
+        KAI_API bool get_placement(FrameGraphResource resource, Uint64 &out_offset, Uint32 &out_first, Uint32 &out_last) const;
+
+    private:
+        friend struct FrameGraphContext;
+
+        struct Pass;
+        struct Resource;
+        struct Access;
+        struct Edge;
+
+        // Returns the number of dependencies between the passes, they're only stored if 'out_edges' isn't null
+        Uint32 build_edges(Edge *out_edges);
+        bool has_access(FrameGraphPass pass, FrameGraphResource resource) const;
+        void * get_memory(FrameGraphResource resource) const;
+
+        StackAllocator memory; // The passes, resources and accesses of the frame
+        StackAllocator scratch; // What compile() works with
+        ArenaAllocator heap; // Both grow as needed and are kept across frames
+        Uint8 *heap_memory = nullptr;
+        Uint32 scratch_capacity = 0;
+        Uint64 heap_capacity = 0;
+
+        Pass *passes = nullptr;
+        Resource *resources = nullptr;
+        Access *accesses = nullptr;
+        FrameGraphPass *schedule = nullptr;
+
+        Uint32 max_passes = 0;
+        Uint32 max_resources = 0;
+        Uint32 max_accesses = 0;
+
+        Uint32 pass_count = 0;
+        Uint32 resource_count = 0;
+        Uint32 access_count = 0;
+        Uint32 scheduled_count = 0;
+        Bool32 compiled = false;
+
+        FrameGraphStats stats = {};
+    };
+}
+
+#endif /* KAI_FRAME_GRAPH_H */
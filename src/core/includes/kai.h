@@ -7,14 +7,22 @@
 #define KAI_ENGINE_H
 
 #include "alloc.h"
+#include "debug_draw.h"
 #include "fileio.h"
+#include "frame_graph.h"
 #include "input.h"
 #include "math.h"
+#include "occlusion.h"
+#include "pack.h"
 #include "render.h"
+#include "sprite_batch.h"
 #include "system.h"
+#include "text.h"
 #include "types.h"
 #include "utils.h"
 
+#include <stdarg.h>
+
 // All of the required callbacks have the same signature
 #define KAI_GAME_CALLBACK_FUNC(name) void (name)(void)
 
@@ -6,6 +6,7 @@
 #ifndef KAI_MATH_H
 #define KAI_MATH_H
 
+#include "simd.h"
 #include "types.h"
 
 #include <float.h>
@@ -44,36 +45,218 @@ namespace kai {
         return (rad / pi) * 180.0f;
     }
 
+    // Selects between the libm backed implementations and the approximations.
+    // The fast variants are explicitly opted into by the caller, their max errors
+    // are documented below as src/tools/math_bench measures them: in ULPs of the
+    // exact result (of 1 for sine and cosine, which go through zero) and over the
+    // input ranges given there
+    enum class Precision {
+        exact,
+        fast
+    };
+
+    // The fast kernels are written once against the lane interface in simd.h and get
+    // instantiated for the scalar overloads as well as for the 4/8 wide batch versions
+    struct SineKernel {
+        // sin(x) is reduced to r in [-pi/2, pi/2] with x = k * pi + r (3 part Cody-Waite
+        // reduction) and evaluated with an 11th degree minimax polynomial.
+        // Max error: 1.2 ULP, 1.4e-7 absolute for |x| <= 100 * pi
+        template<typename L>
+        static KAI_FORCEINLINE typename L::Type apply(typename L::Type x) {
+            typedef typename L::Type T;
+
+            typename L::IntType k = L::round_to_int(L::mul(x, L::set1(1.0f / pi)));
+            T kf = L::to_float(k);
+            T r = L::sub(x, L::mul(kf, L::set1(3.140625f)));
+            r = L::sub(r, L::mul(kf, L::set1(9.67502593994140625e-4f)));
+            r = L::sub(r, L::mul(kf, L::set1(1.509957990978376432e-7f)));
+
+            T r2 = L::mul(r, r);
+            T p = L::madd(L::set1(-2.3889859e-08f), r2, L::set1(2.7525562e-06f));
+            p = L::madd(p, r2, L::set1(-0.00019840874f));
+            p = L::madd(p, r2, L::set1(0.0083333310f));
+            p = L::madd(p, r2, L::set1(-0.16666667f));
+            p = L::madd(p, r2, L::set1(1.0f));
+
+            // sin(k * pi + r) = (-1)^k * sin(r)
+            return L::bit_xor(L::mul(p, r), L::odd_sign_mask(k));
+        }
+    };
+
+    struct CosineKernel {
+        // Same reduction as SineKernel with a 10th degree minimax polynomial for cos(r).
+        // Max error: 1.2 ULP, 1.4e-7 absolute for |x| <= 100 * pi
+        template<typename L>
+        static KAI_FORCEINLINE typename L::Type apply(typename L::Type x) {
+            typedef typename L::Type T;
+
+            typename L::IntType k = L::round_to_int(L::mul(x, L::set1(1.0f / pi)));
+            T kf = L::to_float(k);
+            T r = L::sub(x, L::mul(kf, L::set1(3.140625f)));
+            r = L::sub(r, L::mul(kf, L::set1(9.67502593994140625e-4f)));
+            r = L::sub(r, L::mul(kf, L::set1(1.509957990978376432e-7f)));
+
+            T r2 = L::mul(r, r);
+            T p = L::madd(L::set1(-2.6051615e-07f), r2, L::set1(2.4760495e-05f));
+            p = L::madd(p, r2, L::set1(-0.0013888378f));
+            p = L::madd(p, r2, L::set1(0.041666638f));
+            p = L::madd(p, r2, L::set1(-0.5f));
+            p = L::madd(p, r2, L::set1(1.0f));
+
+            return L::bit_xor(p, L::odd_sign_mask(k));
+        }
+    };
+
+    struct TangentKernel {
+        // sin(x) / cos(x) from the kernels above. The error is relative to the result
+        // and grows towards the poles and towards zero, where the absolute error of the
+        // sine dominates. Max error: 18.7 ULP for |x| <= 1.5, 1.3e-6 relative where
+        // |tan(x)| > 1e-3
+        template<typename L>
+        static KAI_FORCEINLINE typename L::Type apply(typename L::Type x) {
+            return L::div(SineKernel::apply<L>(x), CosineKernel::apply<L>(x));
+        }
+    };
+
+    struct RsqrtKernel {
+        // Hardware estimate (12 bits) refined with one Newton-Raphson step.
+        // Max error: 3.6 ULP, 2.4e-7 relative for normal, positive inputs
+        template<typename L>
+        static KAI_FORCEINLINE typename L::Type apply(typename L::Type x) {
+            typedef typename L::Type T;
+
+            T y = L::rsqrt_estimate(x);
+            T half_xy = L::mul(L::mul(L::set1(0.5f), x), y);
+            return L::mul(y, L::sub(L::set1(1.5f), L::mul(half_xy, y)));
+        }
+    };
+
+    struct SquareRootKernel {
+        // x * rsqrt(x), with 0 for inputs <= 0 instead of the NaN that the multiplication would produce.
+        // Max error: 3.4 ULP, 2.7e-7 relative. A single value goes through sqrtss instead, which is
+        // both faster than the estimate and its Newton step and exact (0.5 ULP)
+        template<typename L>
+        static KAI_FORCEINLINE typename L::Type apply(typename L::Type x) {
+            if constexpr(L::lanes == 1) {
+                return (x > 0.0f) ? L::sqrt(x) : 0.0f;
+            } else {
+                return L::bit_and(L::cmp_gt(x, L::zero()), L::mul(x, RsqrtKernel::apply<L>(x)));
+            }
+        }
+    };
+
+    // Applies a kernel to 'count' values. Uses the widest lane type available and
+    // falls back to the scalar lane for the remainder, 'in' and 'out' may alias
+    template<typename KERNEL>
+    void apply_kernel(const Float32 *in, Float32 *out, Uint32 count) {
+        typedef simd::FloatN L;
+
+        Uint32 i = 0;
+        for(; (i + L::lanes) <= count; i += L::lanes) {
+            L::store(out + i, KERNEL::template apply<L>(L::load(in + i)));
+        }
+
+        for(; i < count; i++) {
+            out[i] = KERNEL::template apply<simd::Float1>(in[i]);
+        }
+    }
+
     bool nearly_equal(Float32 a, Float32 b) {
         return abs(a - b) <= FLT_EPSILON;
     }
 
-    Float32 square_root(Float32 value) {
-        return sqrtf(value);
+    template<Precision P = Precision::exact>
+    KAI_FORCEINLINE Float32 square_root(Float32 value) {
+        if constexpr(P == Precision::fast) {
+            return SquareRootKernel::apply<simd::Float1>(value);
+        } else {
+            return sqrtf(value);
+        }
     }
 
-    Float32 cosine(Float32 angle) {
-        return cosf(angle);
+    template<Precision P = Precision::exact>
+    KAI_FORCEINLINE Float32 rsqrt(Float32 value) {
+        if constexpr(P == Precision::fast) {
+            return RsqrtKernel::apply<simd::Float1>(value);
+        } else {
+            return 1.0f / sqrtf(value);
+        }
     }
 
-    Float32 sine(Float32 angle) {
-        return sinf(angle);
+    template<Precision P = Precision::exact>
+    KAI_FORCEINLINE Float32 cosine(Float32 angle) {
+        if constexpr(P == Precision::fast) {
+            return CosineKernel::apply<simd::Float1>(angle);
+        } else {
+            return cosf(angle);
+        }
     }
 
-    Float32 tangent(Float32 angle) {
-        return tanf(angle);
+    template<Precision P = Precision::exact>
+    KAI_FORCEINLINE Float32 sine(Float32 angle) {
+        if constexpr(P == Precision::fast) {
+            return SineKernel::apply<simd::Float1>(angle);
+        } else {
+            return sinf(angle);
+        }
     }
 
-    template<typename T>
+    // Both at once for rotations. The fast variant inlines both kernels, which share their range reduction
+    template<Precision P = Precision::exact>
+    KAI_FORCEINLINE void sine_cosine(Float32 angle, Float32 &s, Float32 &c) {
+        if constexpr(P == Precision::fast) {
+            s = SineKernel::apply<simd::Float1>(angle);
+            c = CosineKernel::apply<simd::Float1>(angle);
+        } else {
+            s = sinf(angle);
+            c = cosf(angle);
+        }
+    }
+
+    template<Precision P = Precision::exact>
+    KAI_FORCEINLINE Float32 tangent(Float32 angle) {
+        if constexpr(P == Precision::fast) {
+            return TangentKernel::apply<simd::Float1>(angle);
+        } else {
+            return tanf(angle);
+        }
+    }
+
+    // Batch versions, these process 4 or 8 values at a time when 'P' is Precision::fast
+#define KAI_MATH_BATCH_FUNC(name, kernel, exact_func) \
+    template<Precision P = Precision::exact> \
+    void name(const Float32 *in, Float32 *out, Uint32 count) { \
+        if constexpr(P == Precision::fast) { \
+            apply_kernel<kernel>(in, out, count); \
+        } else { \
+            for(Uint32 i = 0; i < count; i++) { \
+                out[i] = exact_func(in[i]); \
+            } \
+        } \
+    }
+
+    KAI_MATH_BATCH_FUNC(square_root, SquareRootKernel, sqrtf)
+    KAI_MATH_BATCH_FUNC(rsqrt, RsqrtKernel, 1.0f / sqrtf)
+    KAI_MATH_BATCH_FUNC(cosine, CosineKernel, cosf)
+    KAI_MATH_BATCH_FUNC(sine, SineKernel, sinf)
+    KAI_MATH_BATCH_FUNC(tangent, TangentKernel, tanf)
+
+#undef KAI_MATH_BATCH_FUNC
+
+    template<Precision P = Precision::exact, typename T>
     Float32 magnitude(const T &vec) {
-        return square_root((vec * vec).sum());
+        return square_root<P>((vec * vec).sum());
     }
 
-    template<typename T>
+    template<Precision P = Precision::exact, typename T>
     void normalize(T &vec) {
-        Float32 mag = magnitude(vec);
-        if(mag != 0.0f) {
-            vec /= mag;
+        Float32 sq_mag = (vec * vec).sum();
+        if(sq_mag != 0.0f) {
+            if constexpr(P == Precision::fast) {
+                vec *= rsqrt<P>(sq_mag);
+            } else {
+                vec /= square_root(sq_mag);
+            }
         }
     }
 
@@ -94,6 +277,11 @@ namespace kai {
             return !(*this == rhs);
         }
 
+        void operator*=(Float32 scalar) {
+            x *= scalar;
+            y *= scalar;
+        }
+
         void operator/=(Float32 scalar) {
             x /= scalar;
             y /= scalar;
@@ -103,8 +291,10 @@ namespace kai {
             return x + y;
         }
 
-        Float32 magnitude(void) const { return kai::magnitude(*this); }
-        void normalize(void) { kai::normalize(*this); }
+        template<Precision P = Precision::exact>
+        Float32 magnitude(void) const { return kai::magnitude<P>(*this); }
+        template<Precision P = Precision::exact>
+        void normalize(void) { kai::normalize<P>(*this); }
         Float32 dot(const Vec2 &other) const { return kai::dot(*this, other); }
 
         Float32 x = 0.0f;
@@ -144,6 +334,13 @@ namespace kai {
             return !(*this == rhs);
         }
 
+        void operator*=(Float32 scalar) {
+            x *= scalar;
+            y *= scalar;
+            z *= scalar;
+            w *= scalar;
+        }
+
         void operator/=(Float32 scalar) {
             x /= scalar;
             y /= scalar;
@@ -155,8 +352,10 @@ namespace kai {
             return x + y + z + w;
         }
 
-        Float32 magnitude(void) const { return kai::magnitude(*this); }
-        void normalize(void) { kai::normalize(*this); }
+        template<Precision P = Precision::exact>
+        Float32 magnitude(void) const { return kai::magnitude<P>(*this); }
+        template<Precision P = Precision::exact>
+        void normalize(void) { kai::normalize<P>(*this); }
         Float32 dot(const Vec4 &other) const { return kai::dot(*this, other); }
 
         // For the cross product the vectors are treated as 3D vectors instead,
@@ -208,6 +407,54 @@ namespace kai {
         return kai::cross(*this, rhs);
     }
 
+    // Normalizes 'count' vectors in place, 4 at a time. Zero length vectors are left as they are
+    template<Precision P = Precision::exact>
+    void normalize(Vec4 *vecs, Uint32 count) {
+        typedef simd::Float4 L;
+        static_assert(sizeof(Vec4) == sizeof(Float32) * L::lanes, "Vec4 needs to be tightly packed");
+
+        Float32 *data = &vecs->x;
+
+        Uint32 i = 0;
+        for(; (i + L::lanes) <= count; i += L::lanes) {
+            __m128 v0 = L::load(data + (i + 0) * 4);
+            __m128 v1 = L::load(data + (i + 1) * 4);
+            __m128 v2 = L::load(data + (i + 2) * 4);
+            __m128 v3 = L::load(data + (i + 3) * 4);
+
+            // Transposed so that each register holds one component of the 4 vectors
+            _MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+
+            __m128 sq_mag = L::madd(v0, v0, L::madd(v1, v1, L::madd(v2, v2, L::mul(v3, v3))));
+            __m128 mask = L::cmp_gt(sq_mag, L::zero());
+
+            if constexpr(P == Precision::fast) {
+                __m128 scale = L::bit_and(mask, RsqrtKernel::apply<L>(sq_mag));
+                v0 = L::mul(v0, scale);
+                v1 = L::mul(v1, scale);
+                v2 = L::mul(v2, scale);
+                v3 = L::mul(v3, scale);
+            } else {
+                __m128 mag = L::sqrt(sq_mag);
+                v0 = L::bit_and(mask, L::div(v0, mag));
+                v1 = L::bit_and(mask, L::div(v1, mag));
+                v2 = L::bit_and(mask, L::div(v2, mag));
+                v3 = L::bit_and(mask, L::div(v3, mag));
+            }
+
+            _MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+
+            L::store(data + (i + 0) * 4, v0);
+            L::store(data + (i + 1) * 4, v1);
+            L::store(data + (i + 2) * 4, v2);
+            L::store(data + (i + 3) * 4, v3);
+        }
+
+        for(; i < count; i++) {
+            normalize<P>(vecs[i]);
+        }
+    }
+
     union Mat4x4 {
         Mat4x4(void) = default;
 
@@ -362,20 +609,81 @@ namespace kai {
     };
 
     Mat4x4 operator*(const Mat4x4 &a, const Mat4x4 &b) {
+        typedef simd::Float4 L;
+
+        // Every column of the result is a linear combination of the columns of 'a'.
+        // The additions happen in the same order as in the scalar version, so the results are identical
+        const __m128 a0 = L::load(a.m[0]);
+        const __m128 a1 = L::load(a.m[1]);
+        const __m128 a2 = L::load(a.m[2]);
+        const __m128 a3 = L::load(a.m[3]);
+
         Mat4x4 m;
 
         for(Int32 i = 0; i < 4; i++) {
-            for(Int32 j = 0; j < 4; j++) {
-                m.m[i][j] =
-                    a.m[0][j] * b.m[i][0] +
-                    a.m[1][j] * b.m[i][1] +
-                    a.m[2][j] * b.m[i][2] +
-                    a.m[3][j] * b.m[i][3];
-            }
+            __m128 c = L::mul(a0, L::set1(b.m[i][0]));
+            c = L::add(c, L::mul(a1, L::set1(b.m[i][1])));
+            c = L::add(c, L::mul(a2, L::set1(b.m[i][2])));
+            c = L::add(c, L::mul(a3, L::set1(b.m[i][3])));
+            L::store(m.m[i], c);
         }
 
         return m;
     }
+
+    Vec4 operator*(const Mat4x4 &m, const Vec4 &v) {
+        return {
+            m.m[0][0] * v.x + m.m[1][0] * v.y + m.m[2][0] * v.z + m.m[3][0] * v.w,
+            m.m[0][1] * v.x + m.m[1][1] * v.y + m.m[2][1] * v.z + m.m[3][1] * v.w,
+            m.m[0][2] * v.x + m.m[1][2] * v.y + m.m[2][2] * v.z + m.m[3][2] * v.w,
+            m.m[0][3] * v.x + m.m[1][3] * v.y + m.m[2][3] * v.z + m.m[3][3] * v.w
+        };
+    }
+
+    // Batch version of 'm * v'. 'in' and 'out' may alias
+    void transform(const Mat4x4 &m, const Vec4 *in, Vec4 *out, Uint32 count) {
+        typedef simd::Float4 L;
+
+        const __m128 c0 = L::load(m.m[0]);
+        const __m128 c1 = L::load(m.m[1]);
+        const __m128 c2 = L::load(m.m[2]);
+        const __m128 c3 = L::load(m.m[3]);
+
+        for(Uint32 i = 0; i < count; i++) {
+            __m128 r = L::mul(c0, L::set1(in[i].x));
+            r = L::add(r, L::mul(c1, L::set1(in[i].y)));
+            r = L::add(r, L::mul(c2, L::set1(in[i].z)));
+            r = L::add(r, L::mul(c3, L::set1(in[i].w)));
+            L::store(&out[i].x, r);
+        }
+    }
+
+    // Transforms 'count' points (the w component of the input is ignored and treated as 1)
+    // into clip space and applies the perspective divide. The outputs hold the normalized
+    // device coordinates in xyz and 1 / w_clip in w
+    void project(const Mat4x4 &view_projection, const Vec4 *in, Vec4 *out, Uint32 count) {
+        typedef simd::Float4 L;
+
+        const __m128 c0 = L::load(view_projection.m[0]);
+        const __m128 c1 = L::load(view_projection.m[1]);
+        const __m128 c2 = L::load(view_projection.m[2]);
+        const __m128 c3 = L::load(view_projection.m[3]);
+        const __m128 one = L::set1(1.0f);
+
+        for(Uint32 i = 0; i < count; i++) {
+            __m128 r = L::mul(c0, L::set1(in[i].x));
+            r = L::add(r, L::mul(c1, L::set1(in[i].y)));
+            r = L::add(r, L::mul(c2, L::set1(in[i].z)));
+            r = L::add(r, c3);
+
+            __m128 inv_w = L::div(one, _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)));
+
+            // Replace w with 1 / w after the divide
+            __m128 ndc = L::mul(r, inv_w);
+            ndc = _mm_shuffle_ps(ndc, _mm_unpackhi_ps(ndc, inv_w), _MM_SHUFFLE(3, 0, 1, 0));
+            L::store(&out[i].x, ndc);
+        }
+    }
 }
 
 #endif /* KAI_MATH_H */
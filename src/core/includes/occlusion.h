@@ -0,0 +1,98 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_OCCLUSION_H
+#define KAI_OCCLUSION_H
+
+#include "alloc.h"
+#include "math.h"
+#include "types.h"
+#include "utils.h"
+
+namespace kai {
+    enum class OcclusionResult {
+        visible,
+        outside_frustum,
+        occluded
+    };
+
+    // Low resolution depth-only view of the scene, used to skip draws that are hidden behind large occluders
+    // before they're recorded into a CommandBuffer. Every frame:
+    //
+    //   buffer.begin();
+    //   buffer.add_occluder(...); // The few large meshes that hide most of the scene (walls, terrain, buildings)
+    //   buffer.end();
+    //   if(buffer.test_box(...) == OcclusionResult::visible) { command_buffer.draw(...); }
+    //
+    // Occluders are rasterized conservatively: a pixel only gets written if the triangle covers all of it, and
+    // it gets the depth of the triangle's farthest vertex. So a box that is reported as occluded is guaranteed
+    // to be hidden, while a visible one may still end up hidden. Occluder triangles that cross the near plane
+    // are skipped, which is conservative as well.
+    // end() builds the maximum depth of every 8x8 block of pixels, which lets most boxes be tested without
+    // looking at single pixels. test_box() doesn't modify the buffer and can be called from multiple threads.
+    //
+    // Depths follow the D3D convention: z / w in [0, 1] after the projection, larger values are farther away.
+    struct OcclusionBuffer {
+        KAI_API explicit OcclusionBuffer(void) = default;
+        KAI_API OcclusionBuffer(Uint32 width, Uint32 height); // Rounded up to multiples of 8
+
+        KAI_API void destroy(void);
+
+        KAI_API void begin(void);
+        KAI_API void end(void);
+
+        // 'vertices' holds 'vertex_count' positions of 3 floats each, 'vertex_stride' bytes apart (e.g. the
+        // vertex data of a MeshHeader), 'world_view_projection' transforms them into clip space
+        KAI_API void add_occluder(const Mat4x4 &world_view_projection, const void *vertices, Uint32 vertex_stride,
+                                  Uint32 vertex_count, const Uint32 *indices, Uint32 index_count);
+
+        // Tests the bounding box from 'box_min' to 'box_max' (xyz, w is ignored) against the occluders
+        KAI_API OcclusionResult test_box(const Mat4x4 &world_view_projection, const Vec4 &box_min, const Vec4 &box_max) const;
+
+        Uint32 get_width(void) const {
+            return width;
+        }
+
+        Uint32 get_height(void) const {
+            return height;
+        }
+
+        const Float32 * get_depth(void) const {
+            return depth;
+        }
+
+        // Occluder triangles since begin() and how many of them wrote any pixels
+        Uint32 get_occluder_triangle_count(void) const {
+            return occluder_triangle_count;
+        }
+
+        Uint32 get_rasterized_triangle_count(void) const {
+            return rasterized_triangle_count;
+        }
+
+    private:
+        void rasterize_triangle(const Vec4 &v0, const Vec4 &v1, const Vec4 &v2);
+
+        ArenaAllocator memory;
+        Float32 *depth = nullptr;
+        Float32 *block_depth = nullptr; // The farthest depth of every 8x8 block
+
+        // Scratch memory for the vertices of the occluder that is being added
+        ArenaAllocator vertex_memory;
+        Vec4 *positions = nullptr;
+        Vec4 *clip_positions = nullptr;
+        Uint32 vertex_capacity = 0;
+
+        Uint32 width = 0;
+        Uint32 height = 0;
+        Uint32 blocks_x = 0;
+        Uint32 blocks_y = 0;
+
+        Uint32 occluder_triangle_count = 0;
+        Uint32 rasterized_triangle_count = 0;
+    };
+}
+
+#endif /* KAI_OCCLUSION_H */
@@ -0,0 +1,316 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_PACK_H
+#define KAI_PACK_H
+
+#include "math.h"
+#include "simd.h"
+#include "types.h"
+
+// Conversion kernels used to compress vertex attributes. Everything in here is
+// header-only so that the same code can be used by the offline tools and at runtime.
+namespace kai {
+    // IEEE 754 binary16. Conversions round to nearest even, overflow to infinity and
+    // keep denormals. NaNs are converted to a quiet NaN.
+    struct Float16 {
+        Float16(void) = default;
+        explicit Float16(Float32 value) : bits(from_float(value)) {}
+
+        Float32 to_float(void) const { return to_float(bits); }
+
+        static Uint16 from_float(Float32 value) {
+            Uint32 f;
+            memcpy(&f, &value, sizeof(f));
+
+            const Uint32 f32_infinity = 255u << 23;
+            const Uint32 f16_max = (127u + 16u) << 23;
+            const Uint32 denorm_magic_bits = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+            Uint32 sign = f & 0x80000000u;
+            f ^= sign;
+
+            Uint16 result;
+            if(f >= f16_max) {
+                result = (f > f32_infinity) ? 0x7e00 : 0x7c00;
+            } else if(f < (113u << 23)) {
+                // The result is a denormal or zero, adding the magic value makes the FPU do the rounding
+                Float32 denorm_magic;
+                memcpy(&denorm_magic, &denorm_magic_bits, sizeof(denorm_magic));
+
+                Float32 v;
+                memcpy(&v, &f, sizeof(v));
+                v += denorm_magic;
+                memcpy(&f, &v, sizeof(f));
+
+                result = static_cast<Uint16>(f - denorm_magic_bits);
+            } else {
+                Uint32 mantissa_odd = (f >> 13) & 1;
+                f += (static_cast<Uint32>(15 - 127) << 23) + 0xfff;
+                f += mantissa_odd;
+                result = static_cast<Uint16>(f >> 13);
+            }
+
+            return static_cast<Uint16>(result | (sign >> 16));
+        }
+
+        static Float32 to_float(Uint16 half) {
+            const Uint32 shifted_exponent = 0x7c00u << 13;
+            const Uint32 magic_bits = 113u << 23;
+
+            Uint32 f = (half & 0x7fffu) << 13;
+            Uint32 exponent = f & shifted_exponent;
+            f += (127u - 15u) << 23;
+
+            if(exponent == shifted_exponent) {
+                f += (128u - 16u) << 23; // Inf/NaN
+            } else if(exponent == 0) {
+                // Denormal, renormalize through the FPU
+                Float32 magic;
+                memcpy(&magic, &magic_bits, sizeof(magic));
+
+                f += 1u << 23;
+
+                Float32 v;
+                memcpy(&v, &f, sizeof(v));
+                v -= magic;
+                memcpy(&f, &v, sizeof(f));
+            }
+
+            f |= static_cast<Uint32>(half & 0x8000u) << 16;
+
+            Float32 result;
+            memcpy(&result, &f, sizeof(result));
+            return result;
+        }
+
+        Uint16 bits = 0;
+    };
+
+    static_assert(sizeof(Float16) == sizeof(Uint16), "Float16 needs to be usable as a vertex attribute");
+
+    // SSE2 versions of the scalar conversions above, 4 values at a time
+    KAI_FORCEINLINE __m128i float_to_half_sse2(__m128 f) {
+        const __m128i f16_max = _mm_set1_epi32((127 + 16) << 23);
+        const __m128i min_normal = _mm_set1_epi32((127 - 14) << 23);
+        const __m128i denorm_magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+        const __m128i normal_bias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+
+        __m128 sign = _mm_and_ps(_mm_set1_ps(-0.0f), f);
+        __m128 abs_f = _mm_xor_ps(f, sign);
+        __m128i abs_i = _mm_castps_si128(abs_f);
+
+        __m128i is_nan = _mm_castps_si128(_mm_cmpunord_ps(abs_f, abs_f));
+        __m128i is_regular = _mm_cmpgt_epi32(f16_max, abs_i);
+        __m128i inf_or_nan = _mm_or_si128(_mm_and_si128(is_nan, _mm_set1_epi32(0x200)), _mm_set1_epi32(0x7c00));
+
+        __m128i is_denormal = _mm_cmpgt_epi32(min_normal, abs_i);
+        __m128 denormal_f = _mm_add_ps(abs_f, _mm_castsi128_ps(denorm_magic));
+        __m128i denormal = _mm_sub_epi32(_mm_castps_si128(denormal_f), denorm_magic);
+
+        // Round to nearest even by biasing towards rounding up if the resulting mantissa is odd
+        __m128i mantissa_odd = _mm_srai_epi32(_mm_slli_epi32(abs_i, 31 - 13), 31);
+        __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(abs_i, normal_bias), mantissa_odd), 13);
+
+        __m128i finite = _mm_or_si128(_mm_and_si128(is_denormal, denormal), _mm_andnot_si128(is_denormal, normal));
+        __m128i result = _mm_or_si128(_mm_and_si128(is_regular, finite), _mm_andnot_si128(is_regular, inf_or_nan));
+
+        // The arithmetic shift smears the sign into the upper 16 bits, which keeps the signed pack exact
+        return _mm_or_si128(result, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+    }
+
+    // Same steps as Float16::to_float() on the integer side, only the denormals go through the FPU. They're
+    // converted from their integer mantissa, so no denormal float is ever an input or an output
+    KAI_FORCEINLINE __m128 half_to_float_sse2(__m128i h) {
+        const __m128i shifted_exponent = _mm_set1_epi32(0x7c00 << 13);
+
+        __m128i exp_mantissa = _mm_and_si128(_mm_set1_epi32(0x7fff), h);
+        __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, exp_mantissa), 16);
+
+        __m128i shifted = _mm_slli_epi32(exp_mantissa, 13);
+        __m128i exponent = _mm_and_si128(shifted, shifted_exponent);
+        __m128i normal = _mm_add_epi32(shifted, _mm_set1_epi32((127 - 15) << 23));
+
+        __m128i is_infnan = _mm_cmpeq_epi32(exponent, shifted_exponent);
+        normal = _mm_add_epi32(normal, _mm_and_si128(is_infnan, _mm_set1_epi32((128 - 16) << 23)));
+
+        // A denormal is its mantissa * 2^-24
+        __m128i is_denormal = _mm_cmpeq_epi32(exponent, _mm_setzero_si128());
+        __m128 denormal = _mm_mul_ps(_mm_cvtepi32_ps(exp_mantissa), _mm_set1_ps(1.0f / 16777216.0f));
+
+        __m128i result = _mm_or_si128(_mm_and_si128(is_denormal, _mm_castps_si128(denormal)),
+                                      _mm_andnot_si128(is_denormal, normal));
+        return _mm_castsi128_ps(_mm_or_si128(result, sign));
+    }
+
+    // Batch conversions. These use F16C when the compiler targets it and SSE2 otherwise
+    inline void convert_to_f16(const Float32 *in, Float16 *out, Uint32 count) {
+        Uint32 i = 0;
+
+#if KAI_SIMD_HAS_F16C
+        for(; (i + 8) <= count; i += 8) {
+            __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), h);
+        }
+#endif
+
+        for(; (i + 8) <= count; i += 8) {
+            __m128i lo = float_to_half_sse2(_mm_loadu_ps(in + i));
+            __m128i hi = float_to_half_sse2(_mm_loadu_ps(in + i + 4));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packs_epi32(lo, hi));
+        }
+
+        for(; i < count; i++) {
+            out[i].bits = Float16::from_float(in[i]);
+        }
+    }
+
+    inline void convert_from_f16(const Float16 *in, Float32 *out, Uint32 count) {
+        Uint32 i = 0;
+
+#if KAI_SIMD_HAS_F16C
+        for(; (i + 8) <= count; i += 8) {
+            __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+            _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+        }
+#endif
+
+        for(; (i + 8) <= count; i += 8) {
+            __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+            __m128i zero = _mm_setzero_si128();
+            _mm_storeu_ps(out + i, half_to_float_sse2(_mm_unpacklo_epi16(h, zero)));
+            _mm_storeu_ps(out + i + 4, half_to_float_sse2(_mm_unpackhi_epi16(h, zero)));
+        }
+
+        for(; i < count; i++) {
+            out[i] = Float16::to_float(in[i].bits);
+        }
+    }
+
+    // Normalized integer packing. Values are clamped to [0, 1] (unorm) or [-1, 1] (snorm), NaN becomes 0 (unorm)
+    // or -1 (snorm), and rounded to the nearest even integer like D3D does it. The batch versions below use the same
+    // clamp and the same rounding, so they match these bit for bit. Unpacking follows the D3D/GL conversion rules.
+    KAI_FORCEINLINE Float32 clamp_normalized(Float32 v, Float32 lo) {
+        // In the order of _mm_max_ps() and _mm_min_ps(), which return the second operand for NaN
+        v = (v > lo) ? v : lo;
+        return (v < 1.0f) ? v : 1.0f;
+    }
+
+    KAI_FORCEINLINE Int32 round_normalized(Float32 v) { return simd::Float1::round_to_int(v); }
+
+    KAI_FORCEINLINE Uint8 pack_unorm8(Float32 v) { return static_cast<Uint8>(round_normalized(clamp_normalized(v, 0.0f) * 255.0f)); }
+    KAI_FORCEINLINE Uint16 pack_unorm16(Float32 v) { return static_cast<Uint16>(round_normalized(clamp_normalized(v, 0.0f) * 65535.0f)); }
+    KAI_FORCEINLINE Int8 pack_snorm8(Float32 v) { return static_cast<Int8>(round_normalized(clamp_normalized(v, -1.0f) * 127.0f)); }
+    KAI_FORCEINLINE Int16 pack_snorm16(Float32 v) { return static_cast<Int16>(round_normalized(clamp_normalized(v, -1.0f) * 32767.0f)); }
+
+    KAI_FORCEINLINE Float32 unpack_unorm8(Uint8 v) { return static_cast<Float32>(v) / 255.0f; }
+    KAI_FORCEINLINE Float32 unpack_unorm16(Uint16 v) { return static_cast<Float32>(v) / 65535.0f; }
+    KAI_FORCEINLINE Float32 unpack_snorm8(Int8 v) { return max(static_cast<Float32>(v) / 127.0f, -1.0f); }
+    KAI_FORCEINLINE Float32 unpack_snorm16(Int16 v) { return max(static_cast<Float32>(v) / 32767.0f, -1.0f); }
+
+    // Clamps, scales and rounds 8 values at a time to 32-bit integers which 'pack_func' then
+    // narrows down and stores. The remainder goes through 'scalar_func'
+    template<typename T, typename SCALAR_FUNC, typename PACK_FUNC>
+    KAI_FORCEINLINE void pack_normalized(const Float32 *in, T *out, Uint32 count, Float32 lo, Float32 scale,
+                                         SCALAR_FUNC scalar_func, PACK_FUNC pack_func) {
+        const __m128 min_v = _mm_set1_ps(lo);
+        const __m128 max_v = _mm_set1_ps(1.0f);
+        const __m128 scale_v = _mm_set1_ps(scale);
+
+        Uint32 i = 0;
+        for(; (i + 8) <= count; i += 8) {
+            __m128 a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), min_v), max_v), scale_v);
+            __m128 b = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + 4), min_v), max_v), scale_v);
+            pack_func(out + i, _mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        }
+
+        for(; i < count; i++) {
+            out[i] = scalar_func(in[i]);
+        }
+    }
+
+    inline void pack_unorm8(const Float32 *in, Uint8 *out, Uint32 count) {
+        pack_normalized(in, out, count, 0.0f, 255.0f, [](Float32 v) { return pack_unorm8(v); },
+                        [](Uint8 *dst, __m128i a, __m128i b) {
+                            __m128i v = _mm_packs_epi32(a, b);
+                            _mm_storel_epi64(reinterpret_cast<__m128i *>(dst), _mm_packus_epi16(v, v));
+                        });
+    }
+
+    inline void pack_snorm8(const Float32 *in, Int8 *out, Uint32 count) {
+        pack_normalized(in, out, count, -1.0f, 127.0f, [](Float32 v) { return pack_snorm8(v); },
+                        [](Int8 *dst, __m128i a, __m128i b) {
+                            __m128i v = _mm_packs_epi32(a, b);
+                            _mm_storel_epi64(reinterpret_cast<__m128i *>(dst), _mm_packs_epi16(v, v));
+                        });
+    }
+
+    inline void pack_unorm16(const Float32 *in, Uint16 *out, Uint32 count) {
+        // There's no unsigned 32 -> 16 bit saturating pack in SSE2, so the values get
+        // biased into the signed range and the bias is flipped back afterwards
+        pack_normalized(in, out, count, 0.0f, 65535.0f, [](Float32 v) { return pack_unorm16(v); },
+                        [](Uint16 *dst, __m128i a, __m128i b) {
+                            const __m128i bias = _mm_set1_epi32(32768);
+                            __m128i v = _mm_packs_epi32(_mm_sub_epi32(a, bias), _mm_sub_epi32(b, bias));
+                            v = _mm_xor_si128(v, _mm_set1_epi16(static_cast<Int16>(0x8000)));
+                            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), v);
+                        });
+    }
+
+    inline void pack_snorm16(const Float32 *in, Int16 *out, Uint32 count) {
+        pack_normalized(in, out, count, -1.0f, 32767.0f, [](Float32 v) { return pack_snorm16(v); },
+                        [](Int16 *dst, __m128i a, __m128i b) {
+                            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_packs_epi32(a, b));
+                        });
+    }
+
+    // Octahedral normal encoding: the unit sphere is projected onto an octahedron which is then
+    // unfolded onto the [-1, 1] square. Stored as two snorm16 values the max angular error is ~0.004 degrees
+    // (~0.95 degrees with snorm8), see src/tools/pack_bench.
+    inline Vec2 encode_octahedral(Float32 x, Float32 y, Float32 z) {
+        Float32 inv_l1 = 1.0f / (abs(x) + abs(y) + abs(z));
+        Float32 u = x * inv_l1;
+        Float32 v = y * inv_l1;
+
+        if(z < 0.0f) {
+            Float32 t = (1.0f - abs(v)) * ((u >= 0.0f) ? 1.0f : -1.0f);
+            v = (1.0f - abs(u)) * ((v >= 0.0f) ? 1.0f : -1.0f);
+            u = t;
+        }
+
+        return Vec2(u, v);
+    }
+
+    inline Vec4 decode_octahedral(Float32 u, Float32 v) {
+        Vec4 n(u, v, 1.0f - abs(u) - abs(v), 0.0f);
+
+        Float32 t = max(-n.z, 0.0f);
+        n.x += (n.x >= 0.0f) ? -t : t;
+        n.y += (n.y >= 0.0f) ? -t : t;
+
+        normalize(n);
+        return n;
+    }
+
+    // Encodes 'count' tightly packed float3 normals into 2 snorm16 values each (RenderFormat::rg_snorm16)
+    inline void encode_octahedral_snorm16(const Float32 *normals, Int16 *out, Uint32 count) {
+        for(Uint32 i = 0; i < count; i++) {
+            Vec2 e = encode_octahedral(normals[i * 3 + 0], normals[i * 3 + 1], normals[i * 3 + 2]);
+            out[i * 2 + 0] = pack_snorm16(e.x);
+            out[i * 2 + 1] = pack_snorm16(e.y);
+        }
+    }
+
+    // Encodes 'count' tightly packed float3 normals into 2 snorm8 values each (RenderFormat::rg_snorm8)
+    inline void encode_octahedral_snorm8(const Float32 *normals, Int8 *out, Uint32 count) {
+        for(Uint32 i = 0; i < count; i++) {
+            Vec2 e = encode_octahedral(normals[i * 3 + 0], normals[i * 3 + 1], normals[i * 3 + 2]);
+            out[i * 2 + 0] = pack_snorm8(e.x);
+            out[i * 2 + 1] = pack_snorm8(e.y);
+        }
+    }
+}
+
+#endif /* KAI_PACK_H */
@@ -6,8 +6,17 @@
 #ifndef KAI_RENDER_H
 #define KAI_RENDER_H
 
+#include "alloc.h"
+#include "math.h"
 #include "types.h"
 
+// Internal to the renderer, see render_internal.h
+enum class CommandEncoding : Uint8;
+union CommandEncodingData;
+struct CommandChunk;
+struct ConstantRing;
+struct RetireQueue;
+
 namespace kai {
     typedef uintptr_t VertexShaderID;
     typedef uintptr_t PixelShaderID;
@@ -25,7 +34,32 @@ namespace kai {
         r_f32,
         rg_f32,
         rgb_f32,
-        rgba_f32
+        rgba_f32,
+
+        // Compressed vertex formats, see pack.h for the conversion kernels
+        r_f16,
+        rg_f16,
+        rgba_f16,
+        r_unorm8,
+        rg_unorm8,
+        rgba_unorm8,
+        r_snorm8,
+        rg_snorm8,
+        rgba_snorm8,
+        r_unorm16,
+        rg_unorm16,
+        rgba_unorm16,
+        r_snorm16,
+        rg_snorm16,
+        rgba_snorm16,
+
+        // Block-compressed texture formats, the pixels are stored in blocks of 4x4 (see get_format_block_size()), so
+        // the largest mip of a texture has to be a multiple of 4 in both directions. Encoded by src/tools/texture_bake
+        bc1_unorm, // RGB and 1 bit of alpha, 8 bytes per block
+        bc3_unorm, // RGBA, 16 bytes per block
+        bc4_unorm, // R, 8 bytes per block
+        bc5_unorm, // RG, like the XY of normal maps, 16 bytes per block
+        bc7_unorm // RGBA at a higher quality than bc1 and bc3, 16 bytes per block
     };
 
     struct Window {
@@ -37,6 +71,8 @@ namespace kai {
     enum class RenderingBackend {
         unknown,
         dx11,
+        null, // Headless, executes CommandBuffers without a GPU and only records statistics
+        software, // Tiled rasterizer on the CPU with a fixed function in place of the shaders
     };
 
     enum class RenderResourceUsage {
@@ -70,9 +106,44 @@ namespace kai {
         RenderResourceUsage resource_usage = RenderResourceUsage::gpu_r;
     };
 
+    // A handle to a buffer of the RenderDevice. It's only a value, so it can be copied around and recorded
+    // on any thread. A handle of 0 is null, binding a destroyed buffer is detected and ignored
     struct RenderBuffer {
-        void *data = nullptr;
-        Uint32 stride = 0;
+        Uint32 handle = 0;
+    };
+
+    // The bytes of a single vertex attribute or pixel in the format, of a block for the block-compressed formats
+    KAI_API Uint32 get_format_size(RenderFormat format);
+
+    // The width and height of the blocks that a texture of the format is stored in, 1 unless it's block-compressed
+    KAI_API Uint32 get_format_block_size(RenderFormat format);
+
+#define KAI_TEXTURE_SLOT_COUNT 4
+
+#define KAI_TEXTURE_MAX_MIPS 16 // Up to 32768x32768
+
+    // A 2D texture that is sampled by the pixel shader, 'data' holds the rows of pixels (or of blocks of pixels) without
+    // any padding. With more than one mip, the mips follow each other in 'data' from the largest to the smallest, each
+    // one is half the size of the one before it (rounded down, but at least 1)
+    struct RenderTextureInfo {
+        const void *data = nullptr;
+        Uint32 width = 0;
+        Uint32 height = 0;
+        Uint32 mip_count = 1; // Up to get_mip_count() of the size
+
+        RenderFormat format = RenderFormat::rgba_unorm8;
+        RenderResourceUsage resource_usage = RenderResourceUsage::gpu_r;
+    };
+
+    // The mips of a full chain down to 1x1
+    KAI_API Uint32 get_mip_count(Uint32 width, Uint32 height);
+
+    // The bytes of the first 'mip_count' mips of a texture, mips that are smaller than a block take a whole block
+    KAI_API Uint64 get_texture_size(RenderFormat format, Uint32 width, Uint32 height, Uint32 mip_count = 1);
+
+    // A handle to a texture of the RenderDevice, like RenderBuffer
+    struct RenderTexture {
+        Uint32 handle = 0;
     };
 
 #define KAI_INPUT_LAYOUT_APPEND 0xffffffff
@@ -82,6 +153,7 @@ namespace kai {
         Uint32 index;
         RenderFormat format;
         Uint32 offset;
+        Bool32 per_instance = false; // Read from the instance data of instanced draws, once per instance
     };
 
     struct RenderPipelineInfo {
@@ -90,6 +162,13 @@ namespace kai {
         const char *pixel_shader_source;
         const char *pixel_shader_entry;
 
+        // Precompiled bytecode for the active backend, e.g. from a shader asset. A stage with bytecode
+        // is created from it and its source and entry point are ignored
+        const void *vertex_shader_bytecode = nullptr;
+        Uint32 vertex_shader_bytecode_size = 0;
+        const void *pixel_shader_bytecode = nullptr;
+        Uint32 pixel_shader_bytecode_size = 0;
+
         enum class FillMode {
             solid,
             wireframe
@@ -122,15 +201,70 @@ namespace kai {
         Bool32 front_ccw;
     };
 
+    // A handle to a pipeline of the RenderDevice, like RenderBuffer
     struct RenderPipeline {
-        void *data;
-        VertexShaderID vertex_shader;
-        PixelShaderID pixel_shader;
+        Uint32 handle = 0;
+    };
+
+    enum class CommandBufferMode {
+        immediate, // Commands are executed in the order they were recorded
+        sorted // Draws are reordered by their sort key in end() to minimize state changes
+    };
+
+    // The per-instance data of auto-instanced draws. The transform is stored as its first 3 rows,
+    // the last row is always (0, 0, 0, 1). Shaders read it as 3 per-instance float4 attributes
+    struct InstanceTransform {
+        Float32 rows[3][4];
+    };
+
+    // A piece of the RenderDevice's constant ring buffer, see RenderDevice::allocate_constants()
+    struct ConstantSlice {
+        void *data; // Where the constants have to be written to
+        Uint32 offset;
+        Uint32 size;
     };
 
+    struct CommandBufferSortStats {
+        Uint32 draw_count;
+
+        // Pipeline and buffer binds needed to execute the draws in the recorded order vs. in the sorted order
+        Uint32 state_changes_unsorted;
+        Uint32 state_changes_sorted;
+
+        Float64 sort_ms;
+    };
+
+    // In CommandBufferMode::sorted every draw captures the pipeline and buffers that are bound at
+    // the time it's recorded, along with a 64-bit sort key (from most to least significant bits):
+    //
+    //   | sequence (8) | layer (8) | pipeline (10) | vertex buffer (12) | index buffer (10) | depth (16) |
+    //
+    // The sequence is bumped by every clear, so draws never move across a clear. Layer and depth
+    // are set with set_sort_layer() and set_sort_depth(), the others are the low bits of the slot
+    // indices of the bound handles. Textures are rebound as needed but don't take part in the key.
+    // end() radix sorts the draws and only emits the binds that are needed between them.
+    // Buffer contents aren't versioned, so a buffer that is updated while recording shouldn't be
+    // shared between draws of the same sorted CommandBuffer.
+    //
+    // CommandBuffers can be recorded on different threads at the same time, as long as every buffer
+    // is only recorded by one thread. Pipelines and buffers are recorded as their handles, recording
+    // never reads the RenderDevice or memory of the caller.
+    //
+    // The commands are stored in a linked list of fixed size chunks that are taken from a pool shared
+    // by all CommandBuffers, so there's no limit on how many commands can be recorded. A buffer keeps
+    // its chunks across begin() calls and only returns them to the pool in destroy().
+    // 'command_count' is only a hint for how many draws are sorted at once in CommandBufferMode::sorted.
+    //
+    // With auto-instancing enabled, runs of draws with the same arguments and nothing else in between
+    // are turned into a single instanced draw, with the transform of every draw as its instance data.
+    // In CommandBufferMode::sorted this happens after sorting, which is what groups the draws of the
+    // same mesh together. In CommandBufferMode::immediate only the runs in the recorded order are found,
+    // draws that aren't recorded grouped by mesh still pay for their instance data without getting merged.
+    // Every draw turns into an instanced one, so the pipelines need to read the InstanceTransform through
+    // per-instance input layouts.
     struct CommandBuffer {
         KAI_API explicit CommandBuffer(void) = default;
-        KAI_API explicit CommandBuffer(Uint32 command_count);
+        KAI_API explicit CommandBuffer(Uint32 command_count, CommandBufferMode mode = CommandBufferMode::immediate);
 
         KAI_API void destroy(void);
 
@@ -140,20 +274,179 @@ namespace kai {
         KAI_API void draw(Uint32 vertex_count, Uint32 starting_index = 0);
         KAI_API void draw_indexed(Uint32 index_count, Uint32 starting_index = 0, Int32 base_offset = 0);
 
-        KAI_API void bind_buffer(RenderBuffer &buffer, RenderBufferType type,
+        // 'instance_data' holds 'instance_count' elements of 'instance_stride' bytes each. It's copied into the
+        // CommandBuffer and can be null if the shaders only need the instance id
+        KAI_API void draw_instanced(Uint32 vertex_count, Uint32 instance_count, const void *instance_data = nullptr,
+                                    Uint32 instance_stride = 0, Uint32 starting_index = 0);
+        KAI_API void draw_indexed_instanced(Uint32 index_count, Uint32 instance_count, const void *instance_data = nullptr,
+                                            Uint32 instance_stride = 0, Uint32 starting_index = 0, Int32 base_offset = 0);
+
+        KAI_API void set_render_pipeline(const RenderPipeline &pipeline);
+
+        KAI_API void bind_buffer(const RenderBuffer &buffer, RenderBufferType type,
                                  ShaderType shader_type = ShaderType::vertex);
 
+        // Binds a slice of the constant ring buffer in place of a constant buffer
+        KAI_API void bind_constants(const ConstantSlice &slice, ShaderType shader_type = ShaderType::vertex);
+
+        // Binds a texture to one of the KAI_TEXTURE_SLOT_COUNT slots of the pixel shader
+        KAI_API void bind_texture(const RenderTexture &texture, Uint32 slot = 0);
+
         KAI_API void clear_color(void);
         KAI_API void clear_depth(void);
         KAI_API void clear_stencil(void);
         KAI_API void clear_depth_stencil(void);
 
-        const void * get_data(void) const {
-            return allocator.get_data();
+        // These only affect the sort keys of the draws that follow, so they're ignored in CommandBufferMode::immediate.
+        // 'depth' is expected to be in [0, 1] and is sorted front to back, pass (1 - depth) to sort back to front instead
+        KAI_API void set_sort_layer(Uint8 layer);
+        KAI_API void set_sort_depth(Float32 depth);
+
+        // Should be called before begin(). The transform applies to the draws that follow
+        KAI_API void set_auto_instancing(Bool32 enable);
+        KAI_API void set_instance_transform(const Mat4x4 &transform);
+
+        // CommandBuffers that are submitted together are executed in ascending submission order
+        void set_submission_order(Uint32 order) {
+            submission_order = order;
+        }
+
+        Uint32 get_submission_order(void) const {
+            return submission_order;
+        }
+
+        // Pipeline and buffer binds that were dropped since the same state was already bound
+        Uint32 get_elided_count(void) const {
+            return elided_count;
+        }
+
+        // Draws that were folded into the instanced draw before them by auto-instancing
+        Uint32 get_auto_instanced_count(void) const {
+            return auto_instanced_count;
+        }
+
+        // Only filled in by end() in CommandBufferMode::sorted
+        const CommandBufferSortStats & get_sort_stats(void) const {
+            return sort_stats;
+        }
+
+        // Set when memory for the commands ran out during the recording, everything after that point was dropped.
+        // It sticks until the next begin() and the devices refuse to execute the CommandBuffer while it's set
+        Bool32 has_overflowed(void) const {
+            return overflowed;
+        }
+
+        const CommandChunk * get_first_chunk(void) const {
+            return first_chunk;
+        }
+
+        // The encoded size of the recorded commands in bytes
+        Uint32 get_size(void) const {
+            return size;
+        }
+
+        // The per-instance data of all of the instanced draws, the backends upload it once per CommandBuffer
+        const void * get_instance_data(void) const {
+            return instance_allocator.get_data();
+        }
+
+        Uint32 get_instance_data_size(void) const {
+            return instance_size;
         }
 
     private:
-        kai::StackAllocator allocator;
+        struct BoundState {
+            RenderPipeline pipeline;
+            RenderBuffer vertex_buffer;
+            RenderBuffer index_buffer;
+            RenderBuffer constant_buffers[2]; // Indexed by ShaderType
+
+            // A size of 0 means that no ConstantSlice is bound, a slice and a constant buffer are never bound at the same time
+            Uint32 constant_offsets[2];
+            Uint32 constant_sizes[2];
+
+            RenderTexture textures[KAI_TEXTURE_SLOT_COUNT];
+        };
+
+        struct DrawPacket; // Defined in render.cpp
+
+        static Uint32 apply_state(BoundState &current, const BoundState &next, Bool32 draw, CommandBuffer *encoder);
+
+        Uint64 get_sort_key(void) const;
+        void push_packet(const CommandEncodingData &command, Uint64 key);
+        void push_clear(CommandEncoding encoding);
+        void flush_packets(void);
+
+        void encode(const CommandEncodingData &command);
+
+        Uint32 push_instance_data(const void *data, Uint32 bytes);
+        void instance_draw(const CommandEncodingData &command, const InstanceTransform &transform);
+        void flush_instances(void);
+
+        CommandChunk *first_chunk = nullptr;
+        CommandChunk *current_chunk = nullptr;
+        Uint32 size = 0;
+        Bool32 overflowed = false;
+
+        kai::StackAllocator packet_allocator; // Draw packets and sort scratch memory for CommandBufferMode::sorted
+        kai::StackAllocator instance_allocator; // Grows as needed
+        kai::StackAllocator transform_allocator; // The InstanceTransform of every packet in CommandBufferMode::sorted
+        CommandBufferSortStats sort_stats = {};
+        CommandBufferMode mode = CommandBufferMode::immediate;
+
+        BoundState recorded_state = {}; // What is bound at this point of the recording
+        BoundState emitted_state = {}; // What the sorted command stream has bound so far
+        BoundState unsorted_state = {}; // Only used to count the state changes of the recorded order
+
+        Uint32 submission_order = 0;
+        Uint32 elided_count = 0;
+        Uint32 packet_capacity = 0;
+        Uint32 packet_count = 0;
+        Uint32 sort_sequence = 0;
+        Uint16 sort_depth = 0;
+        Uint8 sort_layer = 0;
+
+        Uint32 instance_capacity = 0;
+        Uint32 instance_size = 0;
+        Uint32 auto_instanced_count = 0;
+        Bool32 auto_instancing = false;
+        InstanceTransform instance_transform = {};
+
+        // The run of identical draws that auto-instancing is collecting, its transforms are at the end of the instance data
+        CommandEncoding pending_encoding = {};
+        Uint32 pending_count = 0;
+        Uint32 pending_start = 0;
+        Int32 pending_base = 0;
+        Uint32 pending_instance_count = 0;
+        Uint32 pending_instance_offset = 0;
+
+        // The previous draw and draw_indexed, the encoding is relative to them
+        Uint32 last_draw_start[2] = {};
+        Uint32 last_draw_count[2] = {};
+        Int32 last_draw_base = 0;
+        Uint32 last_instance_end = 0;
+    };
+
+    // Counters of the last presented frame. The backends only bump them while executing, so they're always
+    // collected, see set_render_counters_log_interval() to log them as well
+    struct RenderFrameCounters {
+        Uint32 commands_executed;
+        Uint32 draws; // Draw calls as they were issued, after merging and with instanced draws counted once
+        Uint64 vertices; // Vertices of the draws and indices of the indexed ones, instances included
+        Uint32 pipeline_binds;
+        Uint32 buffer_binds;
+        Uint32 constant_binds; // Constant buffers and slices of the constant ring buffer
+        Uint32 texture_binds;
+        Uint32 binds_elided; // Redundant pipeline and buffer binds that were dropped while recording
+        Uint32 draws_merged; // Adjacent draws that were merged into one while executing
+        Uint32 draws_instanced; // Draws that auto-instancing folded into instanced draws
+        Uint32 command_bytes; // Encoded size of the executed CommandBuffers
+        Uint32 constant_bytes_uploaded; // From the constant ring buffer
+        Uint32 buffer_bytes_updated; // With RenderDevice::update_buffer()
+        Uint32 texture_bytes_updated; // With RenderDevice::update_texture()
+        Uint64 buffer_bytes[3]; // Of the buffers that were alive at present(), indexed by RenderBufferType
+        Uint64 texture_bytes; // Of the textures that were alive at present()
+        Float64 execute_ms; // CPU time spent in execute()
     };
 
     // Abstraction for both the GPU and rendering API
@@ -163,6 +456,10 @@ namespace kai {
         virtual void destroy(void) = 0;
 
         virtual void execute(const CommandBuffer &command_buffer) const = 0;
+
+        // Executes all of the buffers in the order of their submission order, buffers with the same order keep
+        // their relative order in the array. Typically used for CommandBuffers that were recorded in parallel
+        KAI_API void execute(const CommandBuffer *const *command_buffers, Uint32 count) const;
         virtual void present(void) const = 0;
 
         // A width/height of 0 simply means that it'll use the window's width/height
@@ -182,13 +479,69 @@ namespace kai {
 
         virtual void destroy_buffer(RenderBuffer &buffer) = 0;
 
+        // Replaces the first 'bytes' of a buffer that was created with RenderResourceUsage::cpu_w_gpu_r, the rest of
+        // its contents are undefined afterwards. Has to be called on the thread that executes the CommandBuffers,
+        // everything that is executed after it sees the new contents
+        virtual bool update_buffer(const RenderBuffer &buffer, const void *contents, Uint32 bytes) const = 0;
+
+        virtual bool create_texture(const RenderTextureInfo &info, RenderTexture &out_texture) const = 0;
+
+        virtual void destroy_texture(RenderTexture &texture) = 0;
+
+        // Replaces a 'width' x 'height' rectangle of pixels at 'x', 'y' of the largest mip of a texture that was
+        // created with RenderResourceUsage::cpu_w_gpu_r, the rows of 'contents' have no padding. The rest of the
+        // texture keeps its contents. Has to be called on the thread that executes the CommandBuffers, like
+        // update_buffer(). For a block-compressed format the rectangle has to be made of whole blocks, and 'contents'
+        // holds the rows of blocks
+        virtual bool update_texture(const RenderTexture &texture, Uint32 x, Uint32 y, Uint32 width, Uint32 height,
+                                    const void *contents) const = 0;
+
+        // Destroy the resource once the frames that may still use it have finished, which is
+        // FRAMES_IN_FLIGHT calls to present() later. The handle is cleared right away. Can be called from
+        // any thread, e.g. while unloading an asset in the middle of a frame
+        KAI_API void destroy_buffer_deferred(RenderBuffer &buffer);
+        KAI_API void destroy_render_pipeline_deferred(RenderPipeline &pipeline);
+        KAI_API void destroy_texture_deferred(RenderTexture &texture);
+
+        // Sub-allocates 'bytes' from a large dynamic constant buffer that all CommandBuffers of a frame share, so
+        // per-draw constants don't need their own buffer or a map per draw. The data has to be written before the
+        // CommandBuffers that bind it get executed, the memory is reused once the GPU has finished the frame.
+        // Can be called from multiple threads. Returns false if the frame ran out of space in the ring buffer
+        KAI_API bool allocate_constants(Uint32 bytes, ConstantSlice &out_slice) const;
+
+        const RenderFrameCounters & get_frame_counters(void) const {
+            return last_frame_counters;
+        }
+
         void *data;
         Uint32 id;
         RenderingBackend backend;
         char name[128] = {}; // TODO: Change to UTF-8 string once that is implemented
+        ConstantRing *constant_ring = nullptr; // Created by the backend, see render_internal.h
+        RetireQueue *retire_queue = nullptr; // Created by init_renderer(), see render_internal.h
+
+    protected:
+        // Backends accumulate into frame_counters while executing and call this at the end of present()
+        void finish_frame_counters(void) const;
+
+        // Backends call this in present() once the frame that goes out of flight has finished on the GPU
+        void retire_resources(void) const;
+
+        mutable RenderFrameCounters frame_counters = {};
+        mutable RenderFrameCounters last_frame_counters = {};
+        mutable Uint64 buffer_bytes[3] = {}; // Updated by create_buffer() and destroy_buffer() of the backends
+        mutable Uint64 texture_bytes = 0; // Updated by create_texture() and destroy_texture()
+        mutable Uint32 frames_presented = 0;
     };
 
     KAI_API Window * get_window(void);
+
+    // Logs the counters of every 'frames'th frame in a single line, 0 turns it off (the default)
+    KAI_API void set_render_counters_log_interval(Uint32 frames);
+
+    // Writes everything that gets executed from now on up to the next present() into a capture file at 'path',
+    // which src/tools/replay can execute again. Only works if the renderer was initialized with capture support
+    KAI_API bool capture_next_frame(const char *path);
 }
 
 #endif /* KAI_RENDER_H */
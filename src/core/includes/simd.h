@@ -0,0 +1,140 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_SIMD_H
+#define KAI_SIMD_H
+
+#include "types.h"
+#include "utils.h"
+
+#include <immintrin.h>
+#include <string.h>
+
+// Thin wrappers around the SSE/AVX intrinsics so that the vectorized kernels only
+// need to be written once and can then be instantiated for 4 or 8 lanes.
+// SSE2 is always available on x64, the 8 lane variant is only compiled in when the
+// compiler targets AVX2 (/arch:AVX2 with MSVC, -mavx2 with GCC/Clang).
+namespace kai::simd {
+    // Scalar "lane" with the same interface, used for the remainder of a batch and
+    // for the single value overloads so that they produce identical results
+    struct Float1 {
+        typedef Float32 Type;
+        typedef Int32 IntType;
+
+        static constexpr Uint32 lanes = 1;
+
+        static KAI_FORCEINLINE Type load(const Float32 *src) { return *src; }
+        static KAI_FORCEINLINE void store(Float32 *dst, Type v) { *dst = v; }
+        static KAI_FORCEINLINE Type set1(Float32 value) { return value; }
+        static KAI_FORCEINLINE Type zero(void) { return 0.0f; }
+
+        static KAI_FORCEINLINE Type add(Type a, Type b) { return a + b; }
+        static KAI_FORCEINLINE Type sub(Type a, Type b) { return a - b; }
+        static KAI_FORCEINLINE Type mul(Type a, Type b) { return a * b; }
+        static KAI_FORCEINLINE Type div(Type a, Type b) { return a / b; }
+        static KAI_FORCEINLINE Type madd(Type a, Type b, Type c) { return a * b + c; }
+
+        static KAI_FORCEINLINE Type bit_and(Type a, Type b) { return from_bits(to_bits(a) & to_bits(b)); }
+        static KAI_FORCEINLINE Type bit_xor(Type a, Type b) { return from_bits(to_bits(a) ^ to_bits(b)); }
+        static KAI_FORCEINLINE Type cmp_gt(Type a, Type b) { return from_bits((a > b) ? 0xffffffffu : 0u); }
+
+        static KAI_FORCEINLINE Type sqrt(Type v) { return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(v))); }
+        static KAI_FORCEINLINE Type rsqrt_estimate(Type v) { return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(v))); }
+
+        static KAI_FORCEINLINE IntType round_to_int(Type v) { return _mm_cvtss_si32(_mm_set_ss(v)); }
+        static KAI_FORCEINLINE Type to_float(IntType v) { return static_cast<Float32>(v); }
+
+        static KAI_FORCEINLINE Type odd_sign_mask(IntType v) { return from_bits(static_cast<Uint32>(v) << 31); }
+
+    private:
+        static KAI_FORCEINLINE Uint32 to_bits(Float32 v) { Uint32 u; memcpy(&u, &v, sizeof(u)); return u; }
+        static KAI_FORCEINLINE Float32 from_bits(Uint32 u) { Float32 v; memcpy(&v, &u, sizeof(v)); return v; }
+    };
+
+    struct Float4 {
+        typedef __m128 Type;
+        typedef __m128i IntType;
+
+        static constexpr Uint32 lanes = 4;
+
+        static KAI_FORCEINLINE Type load(const Float32 *src) { return _mm_loadu_ps(src); }
+        static KAI_FORCEINLINE void store(Float32 *dst, Type v) { _mm_storeu_ps(dst, v); }
+        static KAI_FORCEINLINE Type set1(Float32 value) { return _mm_set1_ps(value); }
+        static KAI_FORCEINLINE Type zero(void) { return _mm_setzero_ps(); }
+
+        static KAI_FORCEINLINE Type add(Type a, Type b) { return _mm_add_ps(a, b); }
+        static KAI_FORCEINLINE Type sub(Type a, Type b) { return _mm_sub_ps(a, b); }
+        static KAI_FORCEINLINE Type mul(Type a, Type b) { return _mm_mul_ps(a, b); }
+        static KAI_FORCEINLINE Type div(Type a, Type b) { return _mm_div_ps(a, b); }
+        static KAI_FORCEINLINE Type madd(Type a, Type b, Type c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+
+        static KAI_FORCEINLINE Type bit_and(Type a, Type b) { return _mm_and_ps(a, b); }
+        static KAI_FORCEINLINE Type bit_xor(Type a, Type b) { return _mm_xor_ps(a, b); }
+        static KAI_FORCEINLINE Type cmp_gt(Type a, Type b) { return _mm_cmpgt_ps(a, b); }
+
+        static KAI_FORCEINLINE Type sqrt(Type v) { return _mm_sqrt_ps(v); }
+        static KAI_FORCEINLINE Type rsqrt_estimate(Type v) { return _mm_rsqrt_ps(v); }
+
+        // Rounds to the nearest integer (the default MXCSR rounding mode)
+        static KAI_FORCEINLINE IntType round_to_int(Type v) { return _mm_cvtps_epi32(v); }
+        static KAI_FORCEINLINE Type to_float(IntType v) { return _mm_cvtepi32_ps(v); }
+
+        // Returns -0.0f for odd and 0.0f for even integers, xor'ing a float with it flips the sign for odd lanes
+        static KAI_FORCEINLINE Type odd_sign_mask(IntType v) { return _mm_castsi128_ps(_mm_slli_epi32(v, 31)); }
+    };
+
+#if defined(__AVX2__)
+#define KAI_SIMD_HAS_FLOAT8 1
+
+    struct Float8 {
+        typedef __m256 Type;
+        typedef __m256i IntType;
+
+        static constexpr Uint32 lanes = 8;
+
+        static KAI_FORCEINLINE Type load(const Float32 *src) { return _mm256_loadu_ps(src); }
+        static KAI_FORCEINLINE void store(Float32 *dst, Type v) { _mm256_storeu_ps(dst, v); }
+        static KAI_FORCEINLINE Type set1(Float32 value) { return _mm256_set1_ps(value); }
+        static KAI_FORCEINLINE Type zero(void) { return _mm256_setzero_ps(); }
+
+        static KAI_FORCEINLINE Type add(Type a, Type b) { return _mm256_add_ps(a, b); }
+        static KAI_FORCEINLINE Type sub(Type a, Type b) { return _mm256_sub_ps(a, b); }
+        static KAI_FORCEINLINE Type mul(Type a, Type b) { return _mm256_mul_ps(a, b); }
+        static KAI_FORCEINLINE Type div(Type a, Type b) { return _mm256_div_ps(a, b); }
+#if defined(__FMA__)
+        static KAI_FORCEINLINE Type madd(Type a, Type b, Type c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+        static KAI_FORCEINLINE Type madd(Type a, Type b, Type c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+
+        static KAI_FORCEINLINE Type bit_and(Type a, Type b) { return _mm256_and_ps(a, b); }
+        static KAI_FORCEINLINE Type bit_xor(Type a, Type b) { return _mm256_xor_ps(a, b); }
+        static KAI_FORCEINLINE Type cmp_gt(Type a, Type b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+
+        static KAI_FORCEINLINE Type sqrt(Type v) { return _mm256_sqrt_ps(v); }
+        static KAI_FORCEINLINE Type rsqrt_estimate(Type v) { return _mm256_rsqrt_ps(v); }
+
+        static KAI_FORCEINLINE IntType round_to_int(Type v) { return _mm256_cvtps_epi32(v); }
+        static KAI_FORCEINLINE Type to_float(IntType v) { return _mm256_cvtepi32_ps(v); }
+
+        static KAI_FORCEINLINE Type odd_sign_mask(IntType v) { return _mm256_castsi256_ps(_mm256_slli_epi32(v, 31)); }
+    };
+
+    typedef Float8 FloatN;
+#else
+#define KAI_SIMD_HAS_FLOAT8 0
+
+    typedef Float4 FloatN;
+#endif
+
+// MSVC doesn't have a separate switch for F16C, it's implied by /arch:AVX2
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define KAI_SIMD_HAS_F16C 1
+#else
+#define KAI_SIMD_HAS_F16C 0
+#endif
+}
+
+#endif /* KAI_SIMD_H */
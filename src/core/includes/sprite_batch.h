@@ -0,0 +1,104 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_SPRITE_BATCH_H
+#define KAI_SPRITE_BATCH_H
+
+#include "alloc.h"
+#include "math.h"
+#include "render.h"
+#include "types.h"
+#include "utils.h"
+
+namespace kai {
+    // The vertex format of the sprites, the color is read as rgba_unorm8
+    struct SpriteVertex {
+        Float32 position[2];
+        Float32 uv[2];
+        Uint32 color;
+    };
+
+    struct Sprite {
+        RenderTexture texture; // A null texture draws a white texel, so the sprite only has its color
+
+        Vec2 position; // Where the origin ends up
+        Vec2 size;
+        Vec2 origin = Vec2(0.5f, 0.5f); // The point that the sprite is placed and rotated around, relative to its size
+        Float32 rotation = 0.0f; // In radians
+
+        Float32 uv[4] = { 0.0f, 0.0f, 1.0f, 1.0f }; // The rectangle of the texture, min u, min v, max u, max v
+        Uint32 color = 0xffffffff; // Multiplied with the texture
+        Uint8 layer = 0; // Lower layers are drawn first
+    };
+
+    // Batches textured quads into a single dynamic vertex buffer per frame. add() transforms a sprite into its 4
+    // vertices right away, end() uploads them, sorts the sprites by layer and texture and draws every run of
+    // sprites that share a texture with one draw_indexed(). Every frame:
+    //
+    //   sprite_batch.begin();
+    //   sprite_batch.add(sprite);
+    //   sprite_batch.end(command_buffer, view_projection); // One upload and a draw per texture change
+    //
+    // The vertices are never moved, the sorted order only goes into the indices that are drawn. Sprites that are
+    // added in layer and texture order already skip the sort and the indices are static then.
+    //
+    // The sort is stable, so sprites of the same layer and texture are drawn in the order they were added. Within
+    // a layer the sprites are grouped by texture though, so overlapping sprites that need a specific order have
+    // to go into different layers. Pipelines don't blend, transparent texels (alpha < 0.5) are discarded instead.
+    // Sprites that don't fit into 'max_sprites' (at most 2^24) anymore are dropped and counted, see
+    // get_dropped_count().
+    //
+    // A SpriteBatch is meant to be used by a single thread. end() calls RenderDevice::update_buffer(), so it has
+    // to be called on the render thread once per frame, and the CommandBuffer shouldn't use auto-instancing.
+    // Colors are packed as 0xAABBGGRR.
+    struct SpriteBatch {
+        KAI_API explicit SpriteBatch(void) = default;
+        KAI_API SpriteBatch(RenderDevice *device, Uint32 max_sprites);
+
+        KAI_API void destroy(void);
+
+        KAI_API void begin(void);
+        KAI_API void end(CommandBuffer &command_buffer, const Mat4x4 &view_projection);
+
+        KAI_API void add(const Sprite &sprite);
+        KAI_API void add(const Sprite *sprites, Uint32 count);
+
+        // Sprites since begin()
+        Uint32 get_sprite_count(void) const {
+            return sprite_count;
+        }
+
+        Uint32 get_dropped_count(void) const {
+            return dropped_count;
+        }
+
+        // Of the last end()
+        Uint32 get_draw_count(void) const {
+            return draw_count;
+        }
+
+    private:
+        RenderDevice *device = nullptr;
+        RenderBuffer vertex_buffer;
+        RenderBuffer index_buffer; // The quads in the order they were added
+        RenderBuffer sorted_index_buffer;
+        RenderPipeline pipeline;
+        RenderTexture white_texture;
+
+        ArenaAllocator memory;
+        Uint64 *entries = nullptr; // One per sprite to sort them, see sprite_batch.cpp, followed by as many for sorting
+        SpriteVertex *vertices = nullptr;
+        void *indices = nullptr; // Of the sorted quads, 16 or 32-bit
+        Bool32 small_indices = false;
+        Uint32 capacity = 0;
+        Uint32 sprite_count = 0;
+        Uint32 dropped_count = 0;
+        Uint32 draw_count = 0;
+        Bool32 unsorted = false; // If a sprite was added out of order since begin()
+        Uint64 varying_bits = 0; // The bits of the sort entries that differ since begin()
+    };
+}
+
+#endif /* KAI_SPRITE_BATCH_H */
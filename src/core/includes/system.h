@@ -30,6 +30,10 @@ namespace kai {
     KAI_API void decommit_pages(void *pages, size_t page_count);
     KAI_API void virtual_free(void *address);
     KAI_API size_t get_page_size(void);
+
+    // High resolution monotonic timestamp, get_timestamp_frequency() returns the ticks per second
+    KAI_API Uint64 get_timestamp(void);
+    KAI_API Uint64 get_timestamp_frequency(void);
 }
 
 #endif /* KAI_SYSTEM_H */
@@ -0,0 +1,135 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_TEXT_H
+#define KAI_TEXT_H
+
+#include "alloc.h"
+#include "math.h"
+#include "render.h"
+#include "types.h"
+#include "utils.h"
+
+namespace kai {
+    struct FontHeader; // See src/asset/font.h, a font asset gives it through get_font()
+
+    // The vertex format of the glyphs, the color is read as rgba_unorm8
+    struct GlyphVertex {
+        Float32 position[2];
+        Float32 uv[2];
+        Uint32 color;
+    };
+
+    // Lays out text into glyph quads that all sample a single r_unorm8 glyph atlas, so that all of the text of a frame
+    // is one upload and a single draw_indexed(). Every frame:
+    //
+    //   text_batch.begin();
+    //   text_batch.add(font, "Hello", Vec2(16.0f, 16.0f));
+    //   text_batch.end(command_buffer, view_projection);
+    //
+    // The atlas is a grid of 'glyph_size' cells that works as a cache: a glyph is copied in from its font the first time
+    // it's drawn and stays there for as long as it's used. Once the atlas is full, the least recently used glyph makes
+    // room for the new one, and only the rows of the atlas that changed are uploaded in end(). Glyphs that don't fit into
+    // a cell with a pixel to spare, or that find every cell used by the current frame already, are dropped and counted.
+    // Fonts of any size share the atlas, an SDF font can be baked at a size that fits the cells and scaled up instead.
+    //
+    // Pipelines don't blend, so the edges of glyphs are alpha-tested at half their coverage (or at the edge of an SDF).
+    // Fonts may be unloaded only after remove_font(), the atlas would keep their glyphs around otherwise.
+    //
+    // A TextBatch is meant to be used by a single thread. end() calls RenderDevice::update_buffer() and update_texture(),
+    // so it has to be called on the render thread once per frame. Colors are packed as 0xAABBGGRR.
+    struct TextBatch {
+        KAI_API explicit TextBatch(void) = default;
+        KAI_API TextBatch(RenderDevice *device, Uint32 max_glyphs, Uint32 glyph_size = 32, Uint32 atlas_size = 1024);
+
+        KAI_API void destroy(void);
+
+        KAI_API void begin(void);
+        KAI_API void end(CommandBuffer &command_buffer, const Mat4x4 &view_projection);
+
+        // Adds the UTF-8 'text' with the top left of its first line at 'position', a '\n' starts a new line. The glyphs
+        // are scaled by 'scale' and glyphs that aren't in the font are drawn with its default glyph. Returns where the
+        // next glyph would go
+        KAI_API Vec2 add(const FontHeader *font, const char *text, const Vec2 &position, Float32 scale = 1.0f,
+                         Uint32 color = 0xffffffff);
+
+        // Forgets the glyphs of 'font', which has to happen before it's unloaded
+        KAI_API void remove_font(const FontHeader *font);
+
+        // Glyphs since begin()
+        Uint32 get_glyph_count(void) const {
+            return glyph_count;
+        }
+
+        Uint32 get_dropped_count(void) const {
+            return dropped_count;
+        }
+
+        // Glyphs that were copied into the atlas since begin(), and how many of them replaced another glyph
+        Uint32 get_cache_miss_count(void) const {
+            return cache_miss_count;
+        }
+
+        Uint32 get_eviction_count(void) const {
+            return eviction_count;
+        }
+
+        // Of the last end()
+        Uint32 get_draw_count(void) const {
+            return draw_count;
+        }
+
+        const RenderTexture & get_atlas(void) const {
+            return atlas;
+        }
+
+    private:
+        struct AtlasCell {
+            const FontHeader *font; // Null while the cell is free
+            Uint32 glyph; // Index into the glyphs of the font
+            Uint32 hash;
+            Uint32 last_used; // Frame
+            Uint32 previous; // In the LRU list
+            Uint32 next;
+        };
+
+        // The cell that holds the glyph, after copying it into the atlas if it wasn't there yet
+        Uint32 get_cell(const FontHeader *font, Uint32 glyph);
+        void remove_cell(Uint32 cell); // From the table
+        void unlink_cell(Uint32 cell); // From the LRU list
+        void move_to_front(Uint32 cell);
+
+        RenderDevice *device = nullptr;
+        RenderBuffer vertex_buffer;
+        RenderBuffer index_buffer;
+        RenderPipeline pipeline;
+        RenderTexture atlas;
+
+        ArenaAllocator memory;
+        GlyphVertex *vertices = nullptr;
+        Uint8 *atlas_pixels = nullptr; // What the atlas holds, the rows between dirty_start and dirty_end aren't uploaded yet
+        AtlasCell *cells = nullptr;
+        Uint32 *cell_table = nullptr; // Open addressing from the font and glyph to the cell
+        Uint32 cell_table_mask = 0;
+        Uint32 cell_count = 0;
+        Uint32 cells_per_row = 0;
+        Uint32 lru_head = 0; // Most recently used
+        Uint32 lru_tail = 0;
+        Uint32 glyph_size = 0;
+        Uint32 atlas_size = 0;
+        Uint32 dirty_start = 0;
+        Uint32 dirty_end = 0;
+        Uint32 frame = 0;
+
+        Uint32 capacity = 0;
+        Uint32 glyph_count = 0;
+        Uint32 dropped_count = 0;
+        Uint32 cache_miss_count = 0;
+        Uint32 eviction_count = 0;
+        Uint32 draw_count = 0;
+    };
+}
+
+#endif /* KAI_TEXT_H */
@@ -24,6 +24,18 @@
     __pragma(warning(disable: __VA_ARGS__))
 #define KAI_POP_COMPILER_WARNINGS __pragma(warning(pop))
 
+#elif defined(KAI_PLATFORM_LINUX)
+
+#define KAI_API __attribute__((visibility("default")))
+#define KAI_FORCEINLINE inline __attribute__((always_inline))
+
+// NOTE: This *MUST* always be the last member in a struct and there can only be *ONE* of these per struct
+#define KAI_FLEXIBLE_ARRAY(name) name[]
+
+// The warnings that get disabled are MSVC specific, so these are no-ops for GCC/Clang
+#define KAI_PUSH_DISABLE_COMPILER_WARNINGS(...)
+#define KAI_POP_COMPILER_WARNINGS
+
 #else
 
 #define KAI_FORCEINLINE inline
@@ -9,10 +9,18 @@
 #include "kai_internal.h"
 
 #include "alloc.cpp"
+#include "debug_draw.cpp"
+#include "frame_graph.cpp"
 #include "input.cpp"
+#include "occlusion.cpp"
+#include "pipeline_cache.cpp"
 #include "render.cpp"
+#include "render_capture.cpp"
+#include "sprite_batch.cpp"
+#include "text.cpp"
 
 #include "../asset/asset_manager.cpp"
+#include "../asset/texture_streamer.cpp"
 
 #define STUB_NAME_HELPER(name) name##_stub
 #define STUB_NAME(name) STUB_NAME_HELPER(name)
@@ -39,13 +47,21 @@ static struct {
 
 static kai::StackAllocator engine_memory;
 static KaiLogProc log_func = nullptr;
+static Uint64 engine_start_timestamp = 0; // Reset to 0 once the time to the first frame was logged
 
 void init_engine(void) {
+    engine_start_timestamp = kai::get_timestamp();
+
     MemoryManager::init(kai::gibibytes(4));
     engine_memory = kai::StackAllocator(static_cast<Uint32>(kai::mebibytes(64)));
 
     init_input();
+#ifdef KAI_RENDER_CAPTURE
+    // Lets the game call kai::capture_next_frame(), at the cost of a copy of every pipeline and buffer in memory
+    init_renderer(kai::RenderingBackend::dx11, nullptr, true);
+#else
     init_renderer(kai::RenderingBackend::dx11);
+#endif
 
     init_asset_manager();
 
@@ -58,6 +74,15 @@ void init_engine(void) {
 bool tick_engine(void) {
     game_manager.callbacks.update();
 
+    // Everything from the start of init_engine() to the end of the first update, the shader compiles are the
+    // ones that missed the shader cache (baked shaders never get compiled)
+    if(engine_start_timestamp) {
+        Float64 ms = static_cast<Float64>(kai::get_timestamp() - engine_start_timestamp) * 1000.0 /
+            static_cast<Float64>(kai::get_timestamp_frequency());
+        kai::log("Time to first frame: %.2f ms (%u shaders compiled)\n", ms, get_shader_cache_stats().misses);
+        engine_start_timestamp = 0;
+    }
+
 #ifdef KAI_DEBUG
     if(kai::key_down(kai::Key::escape)) {
         return false;
@@ -0,0 +1,364 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#include <math.h>
+#include <string.h>
+
+#include "includes/kai.h"
+#include "includes/occlusion.h"
+
+#define OCCLUSION_BLOCK_SHIFT 3
+#define OCCLUSION_BLOCK_SIZE (1 << OCCLUSION_BLOCK_SHIFT)
+#define OCCLUSION_NEAR_W 1e-5f
+#define OCCLUSION_GUARD_BAND 1048576.0f
+
+kai::OcclusionBuffer::OcclusionBuffer(Uint32 buffer_width, Uint32 buffer_height) {
+    kai::align_to_pow2(buffer_width, static_cast<Uint32>(OCCLUSION_BLOCK_SIZE));
+    kai::align_to_pow2(buffer_height, static_cast<Uint32>(OCCLUSION_BLOCK_SIZE));
+
+    Uint32 block_count = (buffer_width >> OCCLUSION_BLOCK_SHIFT) * (buffer_height >> OCCLUSION_BLOCK_SHIFT);
+    memory = ArenaAllocator((static_cast<Uint64>(buffer_width) * buffer_height + block_count) * sizeof(Float32));
+
+    if(!memory.get_buffer()) {
+        kai::log("Could not allocate a %ux%u occlusion buffer!\n", buffer_width, buffer_height);
+        return;
+    }
+
+    width = buffer_width;
+    height = buffer_height;
+    blocks_x = width >> OCCLUSION_BLOCK_SHIFT;
+    blocks_y = height >> OCCLUSION_BLOCK_SHIFT;
+    depth = static_cast<Float32 *>(memory.get_buffer());
+    block_depth = depth + static_cast<size_t>(width) * height;
+
+    begin();
+    end();
+}
+
+void kai::OcclusionBuffer::destroy(void) {
+    memory.destroy();
+    vertex_memory.destroy();
+
+    *this = OcclusionBuffer();
+}
+
+void kai::OcclusionBuffer::begin(void) {
+    const __m128 far_depth = _mm_set1_ps(1.0f);
+    for(size_t i = 0; i < static_cast<size_t>(width) * height; i += 4) {
+        _mm_storeu_ps(depth + i, far_depth);
+    }
+
+    occluder_triangle_count = 0;
+    rasterized_triangle_count = 0;
+}
+
+void kai::OcclusionBuffer::end(void) {
+    for(Uint32 block_y = 0; block_y < blocks_y; block_y++) {
+        for(Uint32 block_x = 0; block_x < blocks_x; block_x++) {
+            const Float32 *row = depth + (static_cast<size_t>(block_y) * width + block_x) * OCCLUSION_BLOCK_SIZE;
+            __m128 farthest = _mm_setzero_ps();
+
+            for(Uint32 y = 0; y < OCCLUSION_BLOCK_SIZE; y++, row += width) {
+                farthest = _mm_max_ps(farthest, _mm_max_ps(_mm_loadu_ps(row), _mm_loadu_ps(row + 4)));
+            }
+
+            farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+            farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+            block_depth[block_y * blocks_x + block_x] = _mm_cvtss_f32(farthest);
+        }
+    }
+}
+
+void kai::OcclusionBuffer::add_occluder(const Mat4x4 &world_view_projection, const void *vertices, Uint32 vertex_stride,
+                                        Uint32 vertex_count, const Uint32 *indices, Uint32 index_count) {
+    if(!depth || !vertices || !indices) {
+        return;
+    }
+
+    if(vertex_count > vertex_capacity) {
+        Uint32 capacity = kai::max(vertex_count, vertex_capacity * 2);
+
+        vertex_memory.destroy();
+        vertex_memory = ArenaAllocator(static_cast<Uint64>(capacity) * 2 * sizeof(Vec4));
+
+        if(!vertex_memory.get_buffer()) {
+            kai::log("Could not allocate the vertices of an occluder!\n");
+            vertex_capacity = 0;
+            return;
+        }
+
+        positions = static_cast<Vec4 *>(vertex_memory.get_buffer());
+        clip_positions = positions + capacity;
+        vertex_capacity = capacity;
+    }
+
+    const Uint8 *vertex_data = static_cast<const Uint8 *>(vertices);
+    for(Uint32 i = 0; i < vertex_count; i++) {
+        Float32 position[3];
+        memcpy(position, vertex_data + static_cast<size_t>(i) * vertex_stride, sizeof(position));
+        positions[i] = Vec4(position[0], position[1], position[2], 1.0f);
+    }
+
+    kai::transform(world_view_projection, positions, clip_positions, vertex_count);
+
+    for(Uint32 i = 0; i + 2 < index_count; i += 3) {
+        if(indices[i] >= vertex_count || indices[i + 1] >= vertex_count || indices[i + 2] >= vertex_count) {
+            continue;
+        }
+
+        occluder_triangle_count++;
+
+        const Vec4 &v0 = clip_positions[indices[i]];
+        const Vec4 &v1 = clip_positions[indices[i + 1]];
+        const Vec4 &v2 = clip_positions[indices[i + 2]];
+
+        // Not drawing an occluder triangle is always safe, so there's no need for clipping
+        if(v0.w < OCCLUSION_NEAR_W || v1.w < OCCLUSION_NEAR_W || v2.w < OCCLUSION_NEAR_W ||
+           v0.z < 0.0f || v1.z < 0.0f || v2.z < 0.0f) {
+            continue;
+        }
+
+        rasterize_triangle(v0, v1, v2);
+    }
+}
+
+void kai::OcclusionBuffer::rasterize_triangle(const Vec4 &v0, const Vec4 &v1, const Vec4 &v2) {
+    const Vec4 *clip[3] = { &v0, &v1, &v2 };
+    Float32 x[3];
+    Float32 y[3];
+    Float32 farthest_z = 0.0f;
+
+    for(Uint32 i = 0; i < 3; i++) {
+        Float32 inv_w = 1.0f / clip[i]->w;
+        x[i] = (clip[i]->x * inv_w * 0.5f + 0.5f) * static_cast<Float32>(width);
+        y[i] = (0.5f - clip[i]->y * inv_w * 0.5f) * static_cast<Float32>(height);
+        farthest_z = kai::max(farthest_z, clip[i]->z * inv_w);
+
+        if(fabsf(x[i]) > OCCLUSION_GUARD_BAND || fabsf(y[i]) > OCCLUSION_GUARD_BAND) {
+            return;
+        }
+    }
+
+    // Both sides of an occluder hide what's behind them
+    Float32 area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if(area == 0.0f) {
+        return;
+    }
+
+    if(area < 0.0f) {
+        kai::swap(x[1], x[2]);
+        kai::swap(y[1], y[2]);
+    }
+
+    Float32 min_xf = kai::max(kai::min(kai::min(x[0], x[1]), x[2]), 0.0f);
+    Float32 min_yf = kai::max(kai::min(kai::min(y[0], y[1]), y[2]), 0.0f);
+    Float32 max_xf = kai::min(kai::max(kai::max(x[0], x[1]), x[2]), static_cast<Float32>(width - 1));
+    Float32 max_yf = kai::min(kai::max(kai::max(y[0], y[1]), y[2]), static_cast<Float32>(height - 1));
+
+    if(min_xf > max_xf || min_yf > max_yf) {
+        return;
+    }
+
+    Int32 min_x = static_cast<Int32>(min_xf);
+    Int32 min_y = static_cast<Int32>(min_yf);
+    Int32 max_x = static_cast<Int32>(max_xf);
+    Int32 max_y = static_cast<Int32>(max_yf);
+
+    // Edge functions that are >= 0 inside. Evaluating them at the pixel center, offset towards the corner that
+    // is farthest outside of the edge, only accepts pixels that the triangle covers completely
+    Float32 edge_a[3];
+    Float32 edge_b[3];
+    Float32 edge_c[3];
+
+    for(Uint32 i = 0; i < 3; i++) {
+        Uint32 j = (i + 1) % 3;
+        edge_a[i] = y[i] - y[j];
+        edge_b[i] = x[j] - x[i];
+        edge_c[i] = -(edge_a[i] * x[i] + edge_b[i] * y[i]) - 0.5f * (fabsf(edge_a[i]) + fabsf(edge_b[i]));
+    }
+
+    const __m128 lane_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 first_x = _mm_set1_ps(static_cast<Float32>(min_x));
+    const __m128 end_x = _mm_set1_ps(static_cast<Float32>(max_x + 1));
+    const __m128 four = _mm_set1_ps(4.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 z = _mm_set1_ps(farthest_z);
+    const __m128 a0 = _mm_set1_ps(edge_a[0]);
+    const __m128 a1 = _mm_set1_ps(edge_a[1]);
+    const __m128 a2 = _mm_set1_ps(edge_a[2]);
+    const Int32 start_x = min_x & ~3;
+
+    int written = 0;
+
+    for(Int32 py = min_y; py <= max_y; py++) {
+        const Float32 pixel_y = static_cast<Float32>(py) + 0.5f;
+        const __m128 c0 = _mm_set1_ps(edge_b[0] * pixel_y + edge_c[0]);
+        const __m128 c1 = _mm_set1_ps(edge_b[1] * pixel_y + edge_c[1]);
+        const __m128 c2 = _mm_set1_ps(edge_b[2] * pixel_y + edge_c[2]);
+
+        Float32 *row = depth + static_cast<size_t>(py) * width;
+        __m128 pixel_x = _mm_add_ps(_mm_set1_ps(static_cast<Float32>(start_x)), lane_offsets);
+
+        for(Int32 px = start_x; px <= max_x; px += 4, pixel_x = _mm_add_ps(pixel_x, four)) {
+            __m128 mask = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, pixel_x), c0), zero);
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, pixel_x), c1), zero));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, pixel_x), c2), zero));
+            mask = _mm_and_ps(mask, _mm_cmpgt_ps(pixel_x, first_x));
+            mask = _mm_and_ps(mask, _mm_cmplt_ps(pixel_x, end_x));
+
+            int lanes = _mm_movemask_ps(mask);
+            if(!lanes) {
+                continue;
+            }
+
+            __m128 old_depth = _mm_loadu_ps(row + px);
+            __m128 new_depth = _mm_min_ps(old_depth, z);
+            _mm_storeu_ps(row + px, _mm_or_ps(_mm_and_ps(mask, new_depth), _mm_andnot_ps(mask, old_depth)));
+            written |= lanes;
+        }
+    }
+
+    rasterized_triangle_count += written ? 1 : 0;
+}
+
+// Smallest and largest of the 8 values in 'lo' and 'hi'
+static KAI_FORCEINLINE void get_min_max(__m128 lo, __m128 hi, Float32 &out_min, Float32 &out_max) {
+    __m128 smallest = _mm_min_ps(lo, hi);
+    __m128 largest = _mm_max_ps(lo, hi);
+
+    smallest = _mm_min_ps(smallest, _mm_shuffle_ps(smallest, smallest, _MM_SHUFFLE(1, 0, 3, 2)));
+    largest = _mm_max_ps(largest, _mm_shuffle_ps(largest, largest, _MM_SHUFFLE(1, 0, 3, 2)));
+    smallest = _mm_min_ps(smallest, _mm_shuffle_ps(smallest, smallest, _MM_SHUFFLE(2, 3, 0, 1)));
+    largest = _mm_max_ps(largest, _mm_shuffle_ps(largest, largest, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    out_min = _mm_cvtss_f32(smallest);
+    out_max = _mm_cvtss_f32(largest);
+}
+
+// True if all 8 corners are on the outer side, 'lo' and 'hi' are the comparisons of corners 0-3 and 4-7
+static KAI_FORCEINLINE bool all_outside(__m128 lo, __m128 hi) {
+    return _mm_movemask_ps(_mm_and_ps(lo, hi)) == 0xf;
+}
+
+kai::OcclusionResult kai::OcclusionBuffer::test_box(const Mat4x4 &world_view_projection, const Vec4 &box_min, const Vec4 &box_max) const {
+    // Most boxes are rejected by the frustum test, so the corners are built and tested 4 at a time. The box
+    // is the transformed min corner plus any combination of its transformed edges, which only needs one
+    // transform instead of 8. Corner i is at the max along x if bit 0 is set, along y for bit 1 and z for bit 2,
+    // lo[] holds the x, y, z and w of corners 0-3 and hi[] the ones of corners 4-7
+    const __m128 c0 = _mm_loadu_ps(world_view_projection.m[0]);
+    const __m128 c1 = _mm_loadu_ps(world_view_projection.m[1]);
+    const __m128 c2 = _mm_loadu_ps(world_view_projection.m[2]);
+    const __m128 c3 = _mm_loadu_ps(world_view_projection.m[3]);
+
+    __m128 origin = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(box_min.x)), _mm_mul_ps(c1, _mm_set1_ps(box_min.y)));
+    origin = _mm_add_ps(origin, _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(box_min.z)), c3));
+
+    Float32 base[4];
+    Float32 edge_x[4];
+    Float32 edge_y[4];
+    Float32 edge_z[4];
+    _mm_storeu_ps(base, origin);
+    _mm_storeu_ps(edge_x, _mm_mul_ps(c0, _mm_set1_ps(box_max.x - box_min.x)));
+    _mm_storeu_ps(edge_y, _mm_mul_ps(c1, _mm_set1_ps(box_max.y - box_min.y)));
+    _mm_storeu_ps(edge_z, _mm_mul_ps(c2, _mm_set1_ps(box_max.z - box_min.z)));
+
+    const __m128 select_x = _mm_setr_ps(0.0f, 1.0f, 0.0f, 1.0f);
+    const __m128 select_y = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+
+    __m128 lo[4];
+    __m128 hi[4];
+    for(Uint32 i = 0; i < 4; i++) {
+        lo[i] = _mm_add_ps(_mm_set1_ps(base[i]), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edge_x[i]), select_x),
+                                                            _mm_mul_ps(_mm_set1_ps(edge_y[i]), select_y)));
+        hi[i] = _mm_add_ps(lo[i], _mm_set1_ps(edge_z[i]));
+    }
+
+    // Outside if all of the corners are on the outer side of the same plane
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 neg_w_lo = _mm_sub_ps(zero, lo[3]);
+    const __m128 neg_w_hi = _mm_sub_ps(zero, hi[3]);
+
+    if(all_outside(_mm_cmplt_ps(lo[0], neg_w_lo), _mm_cmplt_ps(hi[0], neg_w_hi)) ||
+       all_outside(_mm_cmpgt_ps(lo[0], lo[3]), _mm_cmpgt_ps(hi[0], hi[3])) ||
+       all_outside(_mm_cmplt_ps(lo[1], neg_w_lo), _mm_cmplt_ps(hi[1], neg_w_hi)) ||
+       all_outside(_mm_cmpgt_ps(lo[1], lo[3]), _mm_cmpgt_ps(hi[1], hi[3])) ||
+       all_outside(_mm_cmplt_ps(lo[2], zero), _mm_cmplt_ps(hi[2], zero)) ||
+       all_outside(_mm_cmpgt_ps(lo[2], lo[3]), _mm_cmpgt_ps(hi[2], hi[3]))) {
+        return OcclusionResult::outside_frustum;
+    }
+
+    // Boxes that reach behind the camera can't be projected, and likely are too close to be hidden anyway
+    const __m128 near_w = _mm_set1_ps(OCCLUSION_NEAR_W);
+    __m128 crosses_near = _mm_or_ps(_mm_cmplt_ps(lo[2], zero), _mm_cmplt_ps(lo[3], near_w));
+    crosses_near = _mm_or_ps(crosses_near, _mm_or_ps(_mm_cmplt_ps(hi[2], zero), _mm_cmplt_ps(hi[3], near_w)));
+
+    if(_mm_movemask_ps(crosses_near) || !depth) {
+        return OcclusionResult::visible;
+    }
+
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 inv_w_lo = _mm_div_ps(one, lo[3]);
+    const __m128 inv_w_hi = _mm_div_ps(one, hi[3]);
+
+    Float32 min_ndc_x, max_ndc_x, min_ndc_y, max_ndc_y, min_ndc_z, max_ndc_z;
+    get_min_max(_mm_mul_ps(lo[0], inv_w_lo), _mm_mul_ps(hi[0], inv_w_hi), min_ndc_x, max_ndc_x);
+    get_min_max(_mm_mul_ps(lo[1], inv_w_lo), _mm_mul_ps(hi[1], inv_w_hi), min_ndc_y, max_ndc_y);
+    get_min_max(_mm_mul_ps(lo[2], inv_w_lo), _mm_mul_ps(hi[2], inv_w_hi), min_ndc_z, max_ndc_z);
+
+    // Every pixel that the box's rectangle touches, y points down in the buffer
+    Float32 min_xf = kai::min((min_ndc_x * 0.5f + 0.5f) * static_cast<Float32>(width), static_cast<Float32>(width));
+    Float32 min_yf = kai::min((0.5f - max_ndc_y * 0.5f) * static_cast<Float32>(height), static_cast<Float32>(height));
+    Float32 max_xf = kai::max((max_ndc_x * 0.5f + 0.5f) * static_cast<Float32>(width), 0.0f);
+    Float32 max_yf = kai::max((0.5f - min_ndc_y * 0.5f) * static_cast<Float32>(height), 0.0f);
+    Float32 nearest_z = kai::min(min_ndc_z, 1.0f);
+
+    Int32 min_x = static_cast<Int32>(kai::max(min_xf, 0.0f));
+    Int32 min_y = static_cast<Int32>(kai::max(min_yf, 0.0f));
+    Int32 max_x = static_cast<Int32>(kai::min(max_xf, static_cast<Float32>(width - 1)));
+    Int32 max_y = static_cast<Int32>(kai::min(max_yf, static_cast<Float32>(height - 1)));
+
+    if(min_x > max_x || min_y > max_y) {
+        return OcclusionResult::outside_frustum;
+    }
+
+    const __m128 z = _mm_set1_ps(nearest_z);
+    const __m128i lane_index_lo = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i lane_index_hi = _mm_setr_epi32(4, 5, 6, 7);
+    const __m128i first_x = _mm_set1_epi32(min_x - 1);
+    const __m128i last_x = _mm_set1_epi32(max_x + 1);
+
+    for(Int32 block_y = min_y >> OCCLUSION_BLOCK_SHIFT; block_y <= (max_y >> OCCLUSION_BLOCK_SHIFT); block_y++) {
+        for(Int32 block_x = min_x >> OCCLUSION_BLOCK_SHIFT; block_x <= (max_x >> OCCLUSION_BLOCK_SHIFT); block_x++) {
+            // The whole block is in front of the box
+            if(block_depth[block_y * static_cast<Int32>(blocks_x) + block_x] <= nearest_z) {
+                continue;
+            }
+
+            // A block is 8 pixels wide, the columns outside of the box's rectangle are masked out
+            const Int32 x0 = block_x << OCCLUSION_BLOCK_SHIFT;
+            const __m128i column_lo = _mm_add_epi32(_mm_set1_epi32(x0), lane_index_lo);
+            const __m128i column_hi = _mm_add_epi32(_mm_set1_epi32(x0), lane_index_hi);
+            const __m128 inside_lo = _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(column_lo, first_x),
+                                                                    _mm_cmplt_epi32(column_lo, last_x)));
+            const __m128 inside_hi = _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(column_hi, first_x),
+                                                                    _mm_cmplt_epi32(column_hi, last_x)));
+
+            Int32 y0 = kai::max(min_y, block_y << OCCLUSION_BLOCK_SHIFT);
+            Int32 y1 = kai::min(max_y, (block_y << OCCLUSION_BLOCK_SHIFT) + OCCLUSION_BLOCK_SIZE - 1);
+
+            for(Int32 y = y0; y <= y1; y++) {
+                const Float32 *row = depth + static_cast<size_t>(y) * width + x0;
+                __m128 farther = _mm_and_ps(_mm_cmpgt_ps(_mm_loadu_ps(row), z), inside_lo);
+                farther = _mm_or_ps(farther, _mm_and_ps(_mm_cmpgt_ps(_mm_loadu_ps(row + 4), z), inside_hi));
+
+                if(_mm_movemask_ps(farther)) {
+                    return OcclusionResult::visible;
+                }
+            }
+        }
+    }
+
+    return OcclusionResult::occluded;
+}
@@ -0,0 +1,494 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#include <string.h>
+
+#include "includes/fileio.h"
+#include "includes/kai.h"
+#include "pipeline_cache_internal.h"
+#include "sync_internal.h"
+
+#define FNV1A64_OFFSET 0xcbf29ce484222325ull
+#define FNV1A64_PRIME 0x100000001b3ull
+
+static Uint64 hash_bytes(Uint64 hash, const void *bytes, size_t byte_count) {
+    const Uint8 *b = static_cast<const Uint8 *>(bytes);
+    for(size_t i = 0; i < byte_count; i++) {
+        hash = (hash ^ b[i]) * FNV1A64_PRIME;
+    }
+
+    return hash;
+}
+
+static Uint64 hash_value(Uint64 hash, Uint32 value) {
+    return hash_bytes(hash, &value, sizeof(value));
+}
+
+// The length goes first, so that a null string, an empty one and two strings that follow each other can't collide
+static Uint64 hash_string(Uint64 hash, const char *str) {
+    Uint32 length = str ? static_cast<Uint32>(strlen(str)) + 1 : 0;
+    return hash_bytes(hash_value(hash, length), str, length);
+}
+
+// -------------------------------------------------- Shader bytecode -------------------------------------------------- //
+// The file is a ShaderCacheFileHeader, followed by a ShaderCacheFileEntry per shader and then the bytecode of all of
+// them. The offsets are into the bytecode, every shader starts at a multiple of 4
+struct ShaderCacheFileHeader {
+    Uint32 magic;
+    Uint32 version;
+    Uint32 shader_count;
+    Uint32 data_size;
+};
+
+struct ShaderCacheFileEntry {
+    Uint64 key;
+    Uint32 offset;
+    Uint32 size;
+};
+
+#define SHADER_BLOCK_SIZE static_cast<Uint32>(kai::kibibytes(256))
+
+// The bytecode lives in blocks that never move, so the pointers that were handed out stay valid. A loaded file is
+// a block of its own and its shaders point right into it
+struct ShaderBlock {
+    ShaderBlock *next;
+    kai::ArenaAllocator arena; // The memory of the block itself
+    Uint32 used;
+    Uint32 capacity;
+    Uint8 KAI_FLEXIBLE_ARRAY(data);
+};
+
+struct ShaderEntry {
+    Uint64 key; // 0 for an empty slot
+    const Uint8 *bytecode;
+    Uint32 size;
+};
+
+static struct {
+    kai::StackAllocator table_memory;
+    ShaderEntry *table;
+    Uint32 table_bits;
+
+    ShaderBlock *blocks;
+    Bool32 dirty;
+    ShaderCacheStats stats;
+    SpinLock lock;
+} shader_cache;
+
+static ShaderBlock * create_shader_block(Uint32 capacity) {
+    kai::ArenaAllocator arena(offsetof(ShaderBlock, data) + static_cast<Uint64>(capacity));
+    ShaderBlock *block = static_cast<ShaderBlock *>(arena.get_buffer());
+
+    if(!block) {
+        return nullptr;
+    }
+
+    block->arena = arena;
+    block->used = 0;
+    block->capacity = capacity;
+    block->next = shader_cache.blocks;
+    shader_cache.blocks = block;
+
+    return block;
+}
+
+static ShaderEntry * find_shader_slot(Uint64 key) {
+    Uint32 mask = (1u << shader_cache.table_bits) - 1;
+    for(Uint32 i = static_cast<Uint32>(key) & mask;; i = (i + 1) & mask) {
+        if(shader_cache.table[i].key == key || !shader_cache.table[i].key) {
+            return &shader_cache.table[i];
+        }
+    }
+}
+
+// Keeps the table at most half full
+static bool reserve_shader_slots(Uint32 count) {
+    if(shader_cache.table && (count * 2) <= (1u << shader_cache.table_bits)) {
+        return true;
+    }
+
+    Uint32 bits = kai::max(shader_cache.table_bits, 6u);
+    while((1u << bits) < count * 2) {
+        bits++;
+    }
+
+    kai::StackAllocator memory(static_cast<Uint32>(sizeof(ShaderEntry)) << bits);
+    ShaderEntry *table = memory.alloc<ShaderEntry>(nullptr, 1u << bits);
+
+    if(!table) {
+        memory.destroy();
+        return false;
+    }
+
+    memset(table, 0, sizeof(ShaderEntry) << bits);
+
+    ShaderEntry *old_table = shader_cache.table;
+    Uint32 old_count = old_table ? (1u << shader_cache.table_bits) : 0;
+    kai::StackAllocator old_memory = shader_cache.table_memory;
+
+    shader_cache.table_memory = memory;
+    shader_cache.table = table;
+    shader_cache.table_bits = bits;
+
+    for(Uint32 i = 0; i < old_count; i++) {
+        if(old_table[i].key) {
+            *find_shader_slot(old_table[i].key) = old_table[i];
+        }
+    }
+
+    old_memory.destroy();
+    return true;
+}
+
+Uint64 hash_shader(const char *source, const char *entry, kai::ShaderType type, const char *target, Uint32 flags) {
+    Uint64 hash = hash_string(FNV1A64_OFFSET, source);
+    hash = hash_string(hash, entry);
+    hash = hash_string(hash, target);
+    hash = hash_value(hash, static_cast<Uint32>(type));
+    hash = hash_value(hash, flags);
+
+    return hash ? hash : 1; // 0 marks the empty slots
+}
+
+Uint64 hash_shader_bytecode(const void *bytecode, Uint32 size, kai::ShaderType type) {
+    Uint64 hash = hash_bytes(hash_value(FNV1A64_OFFSET, size), bytecode, size);
+    hash = hash_value(hash, static_cast<Uint32>(type));
+
+    return hash ? hash : 1;
+}
+
+bool find_shader_bytecode(Uint64 key, const void *&out_bytecode, Uint32 &out_size) {
+    ScopedSpinLock lock(shader_cache.lock);
+
+    const ShaderEntry *entry = shader_cache.table ? find_shader_slot(key) : nullptr;
+    if(!entry || !entry->key) {
+        shader_cache.stats.misses++;
+        return false;
+    }
+
+    out_bytecode = entry->bytecode;
+    out_size = entry->size;
+    shader_cache.stats.hits++;
+
+    return true;
+}
+
+bool store_shader_bytecode(Uint64 key, const void *bytecode, Uint32 size, const void *&out_bytecode) {
+    ScopedSpinLock lock(shader_cache.lock);
+
+    if(!reserve_shader_slots(shader_cache.stats.shader_count + 1)) {
+        kai::log("Could not grow the shader cache!\n");
+        return false;
+    }
+
+    ShaderEntry *entry = find_shader_slot(key);
+    if(entry->key) {
+        out_bytecode = entry->bytecode;
+        return true;
+    }
+
+    Uint32 padded_size = size;
+    kai::align_to_pow2(padded_size, 4u);
+
+    ShaderBlock *block = shader_cache.blocks;
+    if(!block || block->capacity - block->used < padded_size) {
+        block = create_shader_block(kai::max(SHADER_BLOCK_SIZE, padded_size));
+
+        if(!block) {
+            kai::log("Could not allocate %u bytes for the shader cache!\n", padded_size);
+            return false;
+        }
+    }
+
+    Uint8 *copy = block->data + block->used;
+    memcpy(copy, bytecode, size);
+    block->used += padded_size;
+
+    entry->key = key;
+    entry->bytecode = copy;
+    entry->size = size;
+
+    shader_cache.stats.shader_count++;
+    shader_cache.stats.bytecode_size += size;
+    shader_cache.dirty = true;
+
+    out_bytecode = copy;
+    return true;
+}
+
+bool load_shader_cache(const char *path) {
+    kai::FileHandle file = kai::open_file(path);
+    if(!file) {
+        return false;
+    }
+
+    size_t file_size = kai::get_file_size(file);
+    ShaderCacheFileHeader header;
+
+    if(file_size < sizeof(header) || file_size > 0xfffffff0 || !kai::read_file(file, &header, sizeof(header)) ||
+       header.magic != SHADER_CACHE_MAGIC || header.version != SHADER_CACHE_VERSION ||
+       static_cast<Uint64>(header.shader_count) * sizeof(ShaderCacheFileEntry) + sizeof(header) + header.data_size != file_size) {
+        kai::log("%s is not a shader cache of version %u, the shaders will be compiled again\n", path, SHADER_CACHE_VERSION);
+        kai::close_file(file);
+        return false;
+    }
+
+    ScopedSpinLock lock(shader_cache.lock);
+
+    ShaderBlock *block = create_shader_block(static_cast<Uint32>(file_size));
+    kai::rewind_file(file);
+    bool read = block && kai::read_file(file, block->data, file_size);
+    kai::close_file(file);
+
+    if(!read || !reserve_shader_slots(shader_cache.stats.shader_count + header.shader_count)) {
+        kai::log("Could not load the shader cache %s!\n", path);
+        return false;
+    }
+
+    block->used = block->capacity;
+
+    const ShaderCacheFileEntry *entries = reinterpret_cast<const ShaderCacheFileEntry *>(block->data + sizeof(header));
+    const Uint8 *data = reinterpret_cast<const Uint8 *>(entries + header.shader_count);
+
+    for(Uint32 i = 0; i < header.shader_count; i++) {
+        const ShaderCacheFileEntry &file_entry = entries[i];
+
+        if(!file_entry.key || file_entry.offset > header.data_size || file_entry.size > header.data_size - file_entry.offset) {
+            kai::log("The shader cache %s is corrupted, %u of its shaders were skipped\n", path, header.shader_count - i);
+            break;
+        }
+
+        ShaderEntry *entry = find_shader_slot(file_entry.key);
+        if(!entry->key) {
+            entry->key = file_entry.key;
+            entry->bytecode = data + file_entry.offset;
+            entry->size = file_entry.size;
+
+            shader_cache.stats.shader_count++;
+            shader_cache.stats.bytecode_size += file_entry.size;
+        }
+    }
+
+    return true;
+}
+
+bool save_shader_cache(const char *path) {
+    ScopedSpinLock lock(shader_cache.lock);
+
+    if(!shader_cache.dirty) {
+        return true;
+    }
+
+    Uint32 shader_count = shader_cache.stats.shader_count;
+    kai::StackAllocator memory(kai::max(shader_count, 1u) * static_cast<Uint32>(sizeof(ShaderCacheFileEntry)));
+    ShaderCacheFileEntry *entries = memory.alloc<ShaderCacheFileEntry>(nullptr, kai::max(shader_count, 1u));
+
+    if(!entries) {
+        kai::log("Could not save the shader cache %s!\n", path);
+        memory.destroy();
+        return false;
+    }
+
+    ShaderCacheFileHeader header = { SHADER_CACHE_MAGIC, SHADER_CACHE_VERSION, 0, 0 };
+
+    for(Uint32 i = 0; i < (1u << shader_cache.table_bits) && shader_cache.table; i++) {
+        const ShaderEntry &entry = shader_cache.table[i];
+
+        if(entry.key) {
+            entries[header.shader_count++] = { entry.key, header.data_size, entry.size };
+
+            header.data_size += entry.size;
+            kai::align_to_pow2(header.data_size, 4u);
+        }
+    }
+
+    kai::FileHandle file = kai::open_file(path, static_cast<kai::FileFlags>(kai::FILE_WRITE | kai::FILE_CREATE));
+    bool written = file && kai::write_file(file, &header, sizeof(header));
+    written = written && (!header.shader_count || kai::write_file(file, entries, header.shader_count * sizeof(ShaderCacheFileEntry)));
+
+    for(Uint32 i = 0; i < header.shader_count && written; i++) {
+        const Uint8 padding[4] = {};
+        const ShaderEntry *entry = find_shader_slot(entries[i].key);
+        Uint32 padded_size = entry->size;
+        kai::align_to_pow2(padded_size, 4u);
+
+        written = (!entry->size || kai::write_file(file, entry->bytecode, entry->size)) &&
+                  (padded_size == entry->size || kai::write_file(file, padding, padded_size - entry->size));
+    }
+
+    if(file) {
+        kai::close_file(file);
+    }
+
+    memory.destroy();
+
+    if(!written) {
+        kai::log("Could not write the shader cache %s!\n", path);
+        return false;
+    }
+
+    shader_cache.dirty = false;
+    return true;
+}
+
+void destroy_shader_cache(void) {
+    for(ShaderBlock *block = shader_cache.blocks; block;) {
+        ShaderBlock *next = block->next;
+        block->arena.destroy();
+        block = next;
+    }
+
+    shader_cache.table_memory.destroy();
+    shader_cache.table = nullptr;
+    shader_cache.table_bits = 0;
+    shader_cache.blocks = nullptr;
+    shader_cache.dirty = false;
+    shader_cache.stats = {};
+}
+
+const ShaderCacheStats & get_shader_cache_stats(void) {
+    return shader_cache.stats;
+}
+
+// -------------------------------------------------- Pipelines -------------------------------------------------- //
+struct CachedPipeline {
+    const kai::RenderDevice *device;
+    Uint64 key;
+    kai::RenderPipeline pipeline;
+    Uint32 references;
+};
+
+// Pipelines are only created and destroyed once in a while and a backend can't have many of them,
+// a plain array is enough
+static struct {
+    kai::StackAllocator memory;
+    CachedPipeline *pipelines;
+    Uint32 count;
+    Uint32 capacity;
+    SpinLock lock;
+} pipeline_cache;
+
+// A stage with bytecode is created from it alone, so the source and entry point don't matter then
+static Uint64 hash_stage(Uint64 hash, const char *source, const char *entry, const void *bytecode, Uint32 bytecode_size) {
+    if(bytecode) {
+        hash = hash_value(hash, 1);
+        return hash_bytes(hash_value(hash, bytecode_size), bytecode, bytecode_size);
+    }
+
+    hash = hash_value(hash, 0);
+    hash = hash_string(hash, source);
+    return hash_string(hash, entry);
+}
+
+Uint64 hash_pipeline(const kai::RenderPipelineInfo &info, const kai::RenderInputLayoutInfo *input_layouts, Uint32 input_layout_count) {
+    Uint64 hash = hash_stage(FNV1A64_OFFSET, info.vertex_shader_source, info.vertex_shader_entry,
+                             info.vertex_shader_bytecode, info.vertex_shader_bytecode_size);
+    hash = hash_stage(hash, info.pixel_shader_source, info.pixel_shader_entry,
+                      info.pixel_shader_bytecode, info.pixel_shader_bytecode_size);
+
+    hash = hash_value(hash, static_cast<Uint32>(info.fill_mode));
+    hash = hash_value(hash, static_cast<Uint32>(info.cull_mode));
+    hash = hash_value(hash, static_cast<Uint32>(info.topology));
+    hash = hash_value(hash, info.color_enable ? 1 : 0);
+    hash = hash_bytes(hash, info.color_clear_values, sizeof(info.color_clear_values));
+    hash = hash_value(hash, info.depth_enable ? 1 : 0);
+    hash = hash_bytes(hash, &info.depth_clear_value, sizeof(info.depth_clear_value));
+    hash = hash_value(hash, info.stencil_enable ? 1 : 0);
+    hash = hash_value(hash, info.stencil_clear_value);
+    hash = hash_value(hash, info.front_ccw ? 1 : 0);
+
+    hash = hash_value(hash, input_layout_count);
+    for(Uint32 i = 0; i < input_layout_count && input_layouts; i++) {
+        const kai::RenderInputLayoutInfo &layout = input_layouts[i];
+
+        hash = hash_string(hash, layout.name);
+        hash = hash_value(hash, layout.index);
+        hash = hash_value(hash, static_cast<Uint32>(layout.format));
+        hash = hash_value(hash, layout.offset);
+        hash = hash_value(hash, layout.per_instance ? 1 : 0);
+    }
+
+    return hash;
+}
+
+bool acquire_cached_pipeline(const kai::RenderDevice *device, Uint64 key, kai::RenderPipeline &out_pipeline) {
+    ScopedSpinLock lock(pipeline_cache.lock);
+
+    for(Uint32 i = 0; i < pipeline_cache.count; i++) {
+        CachedPipeline &cached = pipeline_cache.pipelines[i];
+
+        if(cached.key == key && cached.device == device) {
+            cached.references++;
+            out_pipeline = cached.pipeline;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void add_cached_pipeline(const kai::RenderDevice *device, Uint64 key, const kai::RenderPipeline &pipeline) {
+    ScopedSpinLock lock(pipeline_cache.lock);
+
+    if(pipeline_cache.count == pipeline_cache.capacity) {
+        Uint32 capacity = kai::max(pipeline_cache.capacity * 2, 32u);
+        kai::StackAllocator memory(capacity * static_cast<Uint32>(sizeof(CachedPipeline)));
+        CachedPipeline *pipelines = memory.alloc<CachedPipeline>(nullptr, capacity);
+
+        // Without the cache entry the pipeline still works, it just won't be shared
+        if(!pipelines) {
+            memory.destroy();
+            return;
+        }
+
+        if(pipeline_cache.count) {
+            memcpy(pipelines, pipeline_cache.pipelines, pipeline_cache.count * sizeof(CachedPipeline));
+        }
+
+        pipeline_cache.memory.destroy();
+        pipeline_cache.memory = memory;
+        pipeline_cache.pipelines = pipelines;
+        pipeline_cache.capacity = capacity;
+    }
+
+    pipeline_cache.pipelines[pipeline_cache.count++] = { device, key, pipeline, 1 };
+}
+
+bool release_cached_pipeline(const kai::RenderPipeline &pipeline) {
+    ScopedSpinLock lock(pipeline_cache.lock);
+
+    for(Uint32 i = 0; i < pipeline_cache.count; i++) {
+        CachedPipeline &cached = pipeline_cache.pipelines[i];
+
+        if(cached.pipeline.handle == pipeline.handle) {
+            if(--cached.references > 0) {
+                return false;
+            }
+
+            cached = pipeline_cache.pipelines[--pipeline_cache.count];
+            return true;
+        }
+    }
+
+    return true;
+}
+
+void get_pipeline_cache_counts(Uint32 &out_pipelines, Uint32 &out_references) {
+    ScopedSpinLock lock(pipeline_cache.lock);
+
+    out_pipelines = pipeline_cache.count;
+    out_references = 0;
+
+    for(Uint32 i = 0; i < pipeline_cache.count; i++) {
+        out_references += pipeline_cache.pipelines[i].references;
+    }
+}
+
+void destroy_pipeline_cache(void) {
+    pipeline_cache.memory.destroy();
+    pipeline_cache.pipelines = nullptr;
+    pipeline_cache.count = 0;
+    pipeline_cache.capacity = 0;
+}
@@ -0,0 +1,91 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_PIPELINE_CACHE_INTERNAL_H
+#define KAI_PIPELINE_CACHE_INTERNAL_H
+
+#include "includes/render.h"
+#include "includes/types.h"
+
+// Caches that the backends share, so that identical shaders are compiled once and identical pipelines are
+// created once. Both are keyed by a hash of the content, the pointers in the descriptions don't matter.
+
+// ----- Shader bytecode ----- //
+// The bytecode of every shader that was compiled, keyed by hash_shader(). It gets loaded from the file at
+// KAI_SHADER_CACHE_PATH by init_renderer() and written back by destroy_renderer() if anything was added,
+// so a shader that was compiled once isn't compiled again on the next start. A backend looks the bytecode
+// up before it compiles a shader and stores what it compiled:
+//
+//   Uint64 key = hash_shader(source, entry, type, "vs_5_0", flags);
+//   if(!find_shader_bytecode(key, bytecode, size)) {
+//       compile...
+//       store_shader_bytecode(key, compiled, compiled_size, bytecode);
+//   }
+//
+// The bytecode stays valid until destroy_shader_cache()
+#ifndef KAI_SHADER_CACHE_PATH
+#define KAI_SHADER_CACHE_PATH "shader_cache.bin"
+#endif
+
+#define SHADER_CACHE_MAGIC 0x4348534b // "KSHC"
+#define SHADER_CACHE_VERSION 1
+
+// 'target' and 'flags' identify the compiler and its settings, e.g. the shader model and the debug flag
+Uint64 hash_shader(const char *source, const char *entry, kai::ShaderType type, const char *target, Uint32 flags);
+
+// Identifies precompiled bytecode that doesn't go through the cache, e.g. the variants of a shader asset
+Uint64 hash_shader_bytecode(const void *bytecode, Uint32 size, kai::ShaderType type);
+
+bool find_shader_bytecode(Uint64 key, const void *&out_bytecode, Uint32 &out_size);
+
+// Keeps a copy of the bytecode and returns it in 'out_bytecode'
+bool store_shader_bytecode(Uint64 key, const void *bytecode, Uint32 size, const void *&out_bytecode);
+
+// Adds the shaders of the file at 'path' to the cache. Returns false if the file doesn't exist or is invalid
+bool load_shader_cache(const char *path);
+
+// Writes every shader of the cache to 'path', but only if shaders were added since the last load or save
+bool save_shader_cache(const char *path);
+void destroy_shader_cache(void);
+
+struct ShaderCacheStats {
+    Uint32 shader_count;
+    Uint32 bytecode_size;
+    Uint32 hits;
+    Uint32 misses;
+};
+
+const ShaderCacheStats & get_shader_cache_stats(void);
+
+// ----- Pipelines ----- //
+// Every pipeline that a backend creates is added with its hash, so that creating an identical one returns
+// the existing pipeline with another reference instead. Destroying a pipeline drops a reference and the
+// backend only destroys it once the last one is gone:
+//
+//   Uint64 key = hash_pipeline(info, input_layouts, input_layout_count);
+//   if(acquire_cached_pipeline(this, key, out_pipeline)) {
+//       return true;
+//   }
+//   create...
+//   add_cached_pipeline(this, key, out_pipeline);
+//
+//   if(!release_cached_pipeline(pipeline)) {
+//       memset(&pipeline, 0, sizeof(pipeline));
+//       return;
+//   }
+//   destroy...
+Uint64 hash_pipeline(const kai::RenderPipelineInfo &info, const kai::RenderInputLayoutInfo *input_layouts, Uint32 input_layout_count);
+
+bool acquire_cached_pipeline(const kai::RenderDevice *device, Uint64 key, kai::RenderPipeline &out_pipeline);
+void add_cached_pipeline(const kai::RenderDevice *device, Uint64 key, const kai::RenderPipeline &pipeline);
+
+// Returns true if that was the last reference, or if the pipeline isn't in the cache
+bool release_cached_pipeline(const kai::RenderPipeline &pipeline);
+
+// The number of distinct pipelines and the references to them
+void get_pipeline_cache_counts(Uint32 &out_pipelines, Uint32 &out_references);
+void destroy_pipeline_cache(void);
+
+#endif /* KAI_PIPELINE_CACHE_INTERNAL_H */
@@ -6,13 +6,19 @@
 #include <string.h>
 
 #include "includes/render.h"
+#include "includes/pack.h"
+#include "includes/system.h"
+#include "capture_internal.h"
+#include "pipeline_cache_internal.h"
 #include "render_internal.h"
+#include "sync_internal.h"
 
 static kai::RenderDevice * init_device(void);
 static kai::RenderDevice * init_device(Uint32 id);
 static kai::RenderDevice *g_device = nullptr;
+static Uint32 counters_log_interval = 0;
 
-void init_renderer(kai::RenderingBackend backend, const Uint32 *device_id) {
+void init_renderer(kai::RenderingBackend backend, const Uint32 *device_id, Bool32 capture) {
 #ifndef KAI_PLATFORM_WIN32
     if(backend == kai::RenderingBackend::dx11) {
         kai::log("Direct3D11 is not supported on this platform!\n");
@@ -20,84 +26,1328 @@ void init_renderer(kai::RenderingBackend backend, const Uint32 *device_id) {
     }
 #endif
 
+    load_shader_cache(KAI_SHADER_CACHE_PATH);
+
     platform_renderer_init_backend(backend);
     device_id ? init_device(*device_id) : init_device();
+
+    if(capture && g_device) {
+        g_device = create_capture_device(*get_engine_memory(), g_device);
+    }
+
+    // Only the device that the game sees gets a queue, the capture device forwards to the one it wraps
+    if(g_device) {
+        g_device->retire_queue = create_retire_queue();
+    }
 }
 
 void destroy_renderer(void) {
+    destroy_retire_queue(g_device, g_device->retire_queue);
+    g_device->retire_queue = nullptr;
     g_device->destroy();
     platform_renderer_destroy_backend();
+    destroy_command_chunk_pool();
+
+    save_shader_cache(KAI_SHADER_CACHE_PATH);
+    destroy_shader_cache();
+    destroy_pipeline_cache();
+}
+
+// -------------------------------------------------- CommandChunk -------------------------------------------------- //
+static struct {
+    CommandChunk *free_chunks;
+    Uint32 chunk_count; // All chunks, including the ones that are in use
+    SpinLock lock;
+} chunk_pool;
+
+// Chunks are only allocated from the MemoryManager when the pool runs dry, otherwise they're recycled
+static CommandChunk * acquire_command_chunk(void) {
+    {
+        ScopedSpinLock lock(chunk_pool.lock);
+
+        if(chunk_pool.free_chunks) {
+            CommandChunk *chunk = chunk_pool.free_chunks;
+            chunk_pool.free_chunks = chunk->next;
+            chunk->next = nullptr;
+            chunk->used = 0;
+            return chunk;
+        }
+
+        chunk_pool.chunk_count++;
+    }
+
+    kai::ArenaAllocator arena(COMMAND_CHUNK_SIZE);
+    CommandChunk *chunk = static_cast<CommandChunk *>(arena.get_buffer());
+
+    if(!chunk) {
+        kai::log("Could not allocate a new CommandChunk!\n");
+
+        ScopedSpinLock lock(chunk_pool.lock);
+        chunk_pool.chunk_count--;
+        return nullptr;
+    }
+
+    chunk->next = nullptr;
+    chunk->arena = arena;
+    chunk->used = 0;
+    return chunk;
+}
+
+// Returns a whole list of chunks to the pool
+static void release_command_chunks(CommandChunk *first) {
+    if(!first) {
+        return;
+    }
+
+    CommandChunk *last = first;
+    while(last->next) {
+        last = last->next;
+    }
+
+    ScopedSpinLock lock(chunk_pool.lock);
+    last->next = chunk_pool.free_chunks;
+    chunk_pool.free_chunks = first;
+}
+
+void destroy_command_chunk_pool(void) {
+    ScopedSpinLock lock(chunk_pool.lock);
+
+    for(CommandChunk *chunk = chunk_pool.free_chunks; chunk;) {
+        CommandChunk *next = chunk->next;
+        kai::ArenaAllocator arena = chunk->arena;
+        arena.destroy();
+        chunk_pool.chunk_count--;
+        chunk = next;
+    }
+
+    if(chunk_pool.chunk_count > 0) {
+        kai::log("%u CommandChunks are still in use, CommandBuffers need to be destroyed before the renderer!\n",
+                 chunk_pool.chunk_count);
+    }
+
+    chunk_pool.free_chunks = nullptr;
+}
+
+// -------------------------------------------------- ConstantRing -------------------------------------------------- //
+ConstantRing * create_constant_ring(Uint32 bytes) {
+    kai::ArenaAllocator arena(sizeof(ConstantRing) + bytes);
+    ConstantRing *ring = static_cast<ConstantRing *>(arena.get_buffer());
+
+    if(!ring) {
+        kai::log("Could not allocate the constant ring buffer!\n");
+        return nullptr;
+    }
+
+    new(ring) ConstantRing();
+    ring->data = reinterpret_cast<Uint8 *>(ring + 1);
+    ring->arena = arena;
+    ring->size = bytes;
+    ring->limit = bytes;
+
+    return ring;
+}
+
+void destroy_constant_ring(ConstantRing *ring) {
+    if(ring) {
+        kai::ArenaAllocator arena = ring->arena;
+        arena.destroy();
+    }
+}
+
+Uint32 ConstantRing::get_pending_uploads(Uint32 offsets[2], Uint32 sizes[2]) {
+    Uint64 end = head.load(std::memory_order_acquire);
+    Uint32 count = 0;
+
+    // Includes the parts at the end of the ring that were skipped by a wrap, they're not worth a separate map
+    while(uploaded < end) {
+        Uint32 offset = static_cast<Uint32>(uploaded % size);
+        Uint32 bytes = static_cast<Uint32>(kai::min<Uint64>(end - uploaded, size - offset));
+
+        offsets[count] = offset;
+        sizes[count] = bytes;
+        count++;
+
+        uploaded += bytes;
+    }
+
+    return count;
+}
+
+void ConstantRing::next_frame(void) {
+    // The frame that used this slot before has been waited on, so its memory is free now
+    frame++;
+    frame_starts[frame % FRAMES_IN_FLIGHT] = head.load(std::memory_order_relaxed);
+
+    // The next slot belongs to the oldest frame that may still be in flight
+    limit = frame_starts[(frame + 1) % FRAMES_IN_FLIGHT] + size;
+}
+
+// -------------------------------------------------- RetireQueue -------------------------------------------------- //
+#define RETIRE_QUEUE_MIN_CAPACITY 64
+
+RetireQueue * create_retire_queue(void) {
+    kai::ArenaAllocator arena(sizeof(RetireQueue));
+    RetireQueue *queue = static_cast<RetireQueue *>(arena.get_buffer());
+
+    if(!queue) {
+        kai::log("Could not allocate the retire queue!\n");
+        return nullptr;
+    }
+
+    new(queue) RetireQueue();
+    queue->arena = arena;
+
+    return queue;
+}
+
+static void retire_bucket(kai::RenderDevice *device, RetireQueue::Bucket &bucket) {
+    for(Uint32 i = 0; i < bucket.count; i++) {
+        const RetireQueue::Entry &entry = bucket.entries[i];
+
+        switch(entry.type) {
+            case RetireQueue::Type::buffer: {
+                kai::RenderBuffer buffer;
+                buffer.handle = entry.handle;
+                device->destroy_buffer(buffer);
+                break;
+            }
+            case RetireQueue::Type::pipeline: {
+                kai::RenderPipeline pipeline;
+                pipeline.handle = entry.handle;
+                device->destroy_render_pipeline(pipeline);
+                break;
+            }
+            case RetireQueue::Type::texture: {
+                kai::RenderTexture texture;
+                texture.handle = entry.handle;
+                device->destroy_texture(texture);
+                break;
+            }
+        }
+    }
+
+    bucket.count = 0;
+}
+
+void destroy_retire_queue(kai::RenderDevice *device, RetireQueue *queue) {
+    if(!queue) {
+        return;
+    }
+
+    // Oldest first, like they would have been retired
+    for(Uint32 i = 1; i <= FRAMES_IN_FLIGHT; i++) {
+        retire_bucket(device, queue->buckets[(queue->frame + i) % FRAMES_IN_FLIGHT]);
+    }
+
+    for(RetireQueue::Bucket &bucket : queue->buckets) {
+        bucket.memory.destroy();
+    }
+
+    queue->retiring.memory.destroy();
+
+    kai::ArenaAllocator arena = queue->arena;
+    arena.destroy();
+}
+
+// Returns false if the bucket couldn't grow, the caller holds the lock
+static bool push_retire_entry(RetireQueue::Bucket &bucket, Uint32 handle, RetireQueue::Type type) {
+    if(bucket.count == bucket.capacity) {
+        Uint32 new_capacity = kai::max<Uint32>(bucket.capacity * 2, RETIRE_QUEUE_MIN_CAPACITY);
+        kai::StackAllocator new_memory(new_capacity * static_cast<Uint32>(sizeof(RetireQueue::Entry)));
+
+        if(!new_memory.get_data()) {
+            return false;
+        }
+
+        if(bucket.count) {
+            memcpy(new_memory.get_data(), bucket.entries, bucket.count * sizeof(RetireQueue::Entry));
+        }
+
+        bucket.memory.destroy();
+        bucket.memory = new_memory;
+        bucket.entries = static_cast<RetireQueue::Entry *>(bucket.memory.get_data());
+        bucket.capacity = new_capacity;
+    }
+
+    bucket.entries[bucket.count++] = { handle, type };
+    return true;
+}
+
+// -------------------------------------------------- RenderHandleTable -------------------------------------------------- //
+#define RENDER_HANDLE_TABLE_MIN_CAPACITY 64
+
+void RenderHandleTable::destroy(void) {
+    memory.destroy();
+    *this = RenderHandleTable();
+}
+
+Uint32 RenderHandleTable::add(void *object) {
+    Uint32 index;
+
+    if(free_list) {
+        index = free_list - 1;
+        free_list = slots[index].next_free;
+    } else {
+        if(used == capacity) {
+            Uint32 new_capacity = kai::max<Uint32>(capacity * 2, RENDER_HANDLE_TABLE_MIN_CAPACITY);
+            if(new_capacity > RENDER_HANDLE_INDEX_MASK + 1) {
+                kai::log("Ran out of render resource handles!\n");
+                return 0;
+            }
+
+            kai::StackAllocator new_memory(new_capacity * static_cast<Uint32>(sizeof(Slot)));
+            if(!new_memory.get_data()) {
+                kai::log("Could not grow the render resource handle table!\n");
+                return 0;
+            }
+
+            if(used) {
+                memcpy(new_memory.get_data(), slots, used * sizeof(Slot));
+            }
+
+            memory.destroy();
+            memory = new_memory;
+            slots = static_cast<Slot *>(memory.get_data());
+            capacity = new_capacity;
+        }
+
+        index = used++;
+        slots[index].generation = 1;
+    }
+
+    slots[index].object = object;
+    slots[index].next_free = 0;
+    count++;
+
+    return (slots[index].generation << RENDER_HANDLE_INDEX_BITS) | index;
+}
+
+void * RenderHandleTable::remove(Uint32 handle) {
+    void *object = get(handle);
+    if(!object) {
+        return nullptr;
+    }
+
+    Uint32 index = handle & RENDER_HANDLE_INDEX_MASK;
+    Slot &slot = slots[index];
+
+    // A generation of 0 would let the null handle resolve
+    slot.generation = (slot.generation + 1) & RENDER_HANDLE_GENERATION_MASK;
+    slot.generation = slot.generation ? slot.generation : 1;
+    slot.object = nullptr;
+    slot.next_free = free_list;
+    free_list = index + 1;
+    count--;
+
+    return object;
 }
 
 // -------------------------------------------------- CommandBuffer -------------------------------------------------- //
-kai::CommandBuffer::CommandBuffer(Uint32 command_count) {
-    // TODO: The StackAllocator should probably be extended to allow reallocs if specified
+struct kai::CommandBuffer::DrawPacket {
+    BoundState state;
+    CommandEncodingData command;
+};
 
-    // We add one to accommodate for the CommandEncoding::end that needs to be appended to the CommandBuffer
-    allocator = kai::StackAllocator((command_count + 1) * sizeof(CommandEncodingData));
+struct SortEntry {
+    Uint64 key;
+    Uint32 index;
+};
+
+// See render.h for the layout of the sort key
+#define SORT_KEY_SEQUENCE_SHIFT 56
+#define SORT_KEY_LAYER_SHIFT 48
+#define SORT_KEY_PIPELINE_SHIFT 38
+#define SORT_KEY_VERTEX_BUFFER_SHIFT 26
+#define SORT_KEY_INDEX_BUFFER_SHIFT 16
+#define SORT_KEY_MAX_SEQUENCE 0xff
+
+// Handles are dense slot indices, so their low bits already spread well. A collision only costs some sorting quality
+static KAI_FORCEINLINE Uint64 get_sort_bits(Uint32 handle, Uint32 bits) {
+    return handle & RENDER_HANDLE_INDEX_MASK & ((1u << bits) - 1);
+}
+
+// Stable LSD radix sort over 8-bit digits. Returns either 'entries' or 'scratch', depending on where the result ended up
+static SortEntry * radix_sort(SortEntry *entries, SortEntry *scratch, Uint32 count) {
+    Uint32 histograms[8][256] = {};
+    for(Uint32 i = 0; i < count; i++) {
+        Uint64 key = entries[i].key;
+        for(Uint32 digit = 0; digit < 8; digit++) {
+            histograms[digit][(key >> (digit * 8)) & 0xff]++;
+        }
+    }
+
+    for(Uint32 digit = 0; digit < 8; digit++) {
+        Uint32 *histogram = histograms[digit];
+        Uint32 shift = digit * 8;
+
+        // All keys share this digit (e.g. unused layers or a single pipeline), the pass wouldn't change the order
+        if(histogram[(entries[0].key >> shift) & 0xff] == count) {
+            continue;
+        }
+
+        Uint32 offset = 0;
+        for(Uint32 i = 0; i < 256; i++) {
+            Uint32 c = histogram[i];
+            histogram[i] = offset;
+            offset += c;
+        }
+
+        for(Uint32 i = 0; i < count; i++) {
+            scratch[histogram[(entries[i].key >> shift) & 0xff]++] = entries[i];
+        }
+
+        SortEntry *temp = entries;
+        entries = scratch;
+        scratch = temp;
+    }
+
+    return entries;
+}
+
+#define INVALID_INSTANCE_OFFSET 0xffffffff
+
+// Commands that need the vertex and index buffers to be bound
+static KAI_FORCEINLINE bool is_draw(CommandEncoding encoding) {
+    return encoding == CommandEncoding::draw || encoding == CommandEncoding::draw_indexed ||
+           encoding == CommandEncoding::draw_instanced || encoding == CommandEncoding::draw_indexed_instanced;
+}
+
+kai::CommandBuffer::CommandBuffer(Uint32 command_count, CommandBufferMode buffer_mode) : mode(buffer_mode) {
+    if(mode == CommandBufferMode::sorted) {
+        packet_capacity = (command_count > 1) ? command_count : 1;
+        packet_allocator = kai::StackAllocator(packet_capacity * (sizeof(DrawPacket) + 2 * sizeof(SortEntry)));
+    }
 }
 
 void kai::CommandBuffer::destroy(void) {
-    allocator.destroy();
+    release_command_chunks(first_chunk);
+    packet_allocator.destroy();
+    instance_allocator.destroy();
+    transform_allocator.destroy();
     memset(this, 0, sizeof(*this));
 }
 
 void kai::CommandBuffer::begin(void) {
-    allocator.clear();
-}
+    // Rewind to the first chunk, the following ones get reused as the recording reaches them
+    current_chunk = first_chunk;
+    if(current_chunk) {
+        current_chunk->used = 0;
+    }
+
+    size = 0;
+    overflowed = false;
 
-static KAI_FORCEINLINE void push_command(kai::StackAllocator &allocator, CommandEncoding encoding) {
-    *static_cast<CommandEncoding *>(allocator.alloc(sizeof(CommandEncoding))) = encoding;
+    sort_stats = {};
+    elided_count = 0;
+    recorded_state = {};
+    emitted_state = {};
+    unsorted_state = {};
+    packet_count = 0;
+    sort_sequence = 0;
+    sort_depth = 0;
+    sort_layer = 0;
+
+    memset(last_draw_start, 0, sizeof(last_draw_start));
+    memset(last_draw_count, 0, sizeof(last_draw_count));
+    last_draw_base = 0;
+    last_instance_end = 0;
+
+    instance_size = 0;
+    auto_instanced_count = 0;
+    pending_instance_count = 0;
 }
 
 void kai::CommandBuffer::end(void) {
-    push_command(allocator, CommandEncoding::end);
+    if(mode == CommandBufferMode::sorted) {
+        flush_packets();
+    }
+
+    CommandEncodingData command;
+    command.draw.encoding = CommandEncoding::end;
+    encode(command);
+}
+
+static KAI_FORCEINLINE Uint32 write_varint(Uint8 *out, Uint32 value) {
+    Uint32 size = 0;
+    while(value >= 0x80) {
+        out[size++] = static_cast<Uint8>(value) | 0x80;
+        value >>= 7;
+    }
+
+    out[size++] = static_cast<Uint8>(value);
+    return size;
+}
+
+static KAI_FORCEINLINE Uint32 read_varint(const Uint8 *&in) {
+    Uint32 value = 0;
+    for(Uint32 shift = 0;; shift += 7) {
+        Uint8 byte = *in++;
+        value |= static_cast<Uint32>(byte & 0x7f) << shift;
+
+        if(!(byte & 0x80)) {
+            return value;
+        }
+    }
+}
+
+// Maps small negative deltas to small unsigned values so that they stay short as a varint
+static KAI_FORCEINLINE Uint32 zigzag_encode(Uint32 delta) {
+    return (delta << 1) ^ static_cast<Uint32>(static_cast<Int32>(delta) >> 31);
+}
+
+static KAI_FORCEINLINE Uint32 zigzag_decode(Uint32 value) {
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+// A handle is split into its index and generation, since both are small varints on their own
+static KAI_FORCEINLINE Uint32 write_handle(Uint8 *out, Uint8 &opcode, Uint32 handle) {
+    Uint32 size = write_varint(out, handle & RENDER_HANDLE_INDEX_MASK);
+    Uint32 generation = handle >> RENDER_HANDLE_INDEX_BITS;
+
+    if(generation == 1) {
+        opcode |= COMMAND_FLAG_FIRST_GENERATION;
+    } else {
+        size += write_varint(out + size, generation);
+    }
+
+    return size;
+}
+
+static KAI_FORCEINLINE Uint32 read_handle(const Uint8 *&in, Uint8 opcode) {
+    Uint32 index = read_varint(in);
+    Uint32 generation = (opcode & COMMAND_FLAG_FIRST_GENERATION) ? 1 : read_varint(in);
+
+    return (generation << RENDER_HANDLE_INDEX_BITS) | (index & RENDER_HANDLE_INDEX_MASK);
+}
+
+void kai::CommandBuffer::encode(const CommandEncodingData &command) {
+    // The commands after a dropped one could depend on it, so nothing gets recorded anymore until the next begin()
+    if(overflowed) {
+        return;
+    }
+
+    // Anything that gets encoded ends the run of identical draws
+    if(pending_instance_count) {
+        flush_instances();
+    }
+
+    Uint8 bytes[MAX_ENCODED_COMMAND_SIZE];
+    Uint32 size = 1;
+
+    CommandEncoding encoding = command.draw.encoding;
+    Uint8 opcode = static_cast<Uint8>(encoding);
+
+    switch(encoding) {
+        case CommandEncoding::draw:
+        case CommandEncoding::draw_indexed: {
+            Uint32 kind = (encoding == CommandEncoding::draw_indexed) ? 1 : 0;
+            Uint32 count = kind ? command.draw_indexed.count : command.draw.count;
+            Uint32 start = kind ? command.draw_indexed.start : command.draw.start;
+
+            if(count == last_draw_count[kind]) {
+                opcode |= COMMAND_FLAG_SAME_COUNT;
+            } else {
+                size += write_varint(bytes + size, count);
+            }
+
+            if(start == last_draw_start[kind] + last_draw_count[kind]) {
+                opcode |= COMMAND_FLAG_CONTINUES;
+            } else if(start == last_draw_start[kind]) {
+                opcode |= COMMAND_FLAG_SAME_START;
+            } else {
+                size += write_varint(bytes + size, zigzag_encode(start - last_draw_start[kind]));
+            }
+
+            if(kind) {
+                Int32 base = command.draw_indexed.base;
+                if(base == last_draw_base) {
+                    opcode |= COMMAND_FLAG_SAME_BASE;
+                } else {
+                    size += write_varint(bytes + size, zigzag_encode(static_cast<Uint32>(base - last_draw_base)));
+                }
+
+                last_draw_base = base;
+            }
+
+            last_draw_start[kind] = start;
+            last_draw_count[kind] = count;
+            break;
+        }
+        case CommandEncoding::draw_instanced:
+        case CommandEncoding::draw_indexed_instanced: {
+            // Both share the layout up to the base
+            const auto c = &command.draw_indexed_instanced;
+            size += write_varint(bytes + size, c->count);
+            size += write_varint(bytes + size, c->instance_count);
+            size += write_varint(bytes + size, c->start);
+
+            if(encoding == CommandEncoding::draw_indexed_instanced) {
+                size += write_varint(bytes + size, zigzag_encode(static_cast<Uint32>(c->base)));
+            }
+
+            size += write_varint(bytes + size, c->instance_stride);
+            if(c->instance_stride) {
+                if(c->instance_offset == last_instance_end) {
+                    opcode |= COMMAND_FLAG_CONTINUES;
+                } else {
+                    size += write_varint(bytes + size, c->instance_offset);
+                }
+
+                last_instance_end = c->instance_offset + c->instance_count * c->instance_stride;
+            }
+
+            break;
+        }
+        case CommandEncoding::set_render_pipeline:
+            size += write_handle(bytes + size, opcode, command.set_render_pipeline.pipeline);
+            break;
+        case CommandEncoding::bind_buffer:
+            opcode |= static_cast<Uint8>(static_cast<Uint32>(command.bind_buffer.type) << COMMAND_BIND_TYPE_SHIFT);
+            opcode |= static_cast<Uint8>(static_cast<Uint32>(command.bind_buffer.shader_type) << COMMAND_BIND_SHADER_SHIFT);
+            size += write_handle(bytes + size, opcode, command.bind_buffer.buffer);
+            break;
+        case CommandEncoding::bind_constants:
+            opcode |= static_cast<Uint8>(static_cast<Uint32>(command.bind_constants.shader_type) << COMMAND_BIND_SHADER_SHIFT);
+            size += write_varint(bytes + size, command.bind_constants.offset / CONSTANT_RING_ALIGNMENT);
+            size += write_varint(bytes + size, command.bind_constants.size / 16);
+            break;
+        case CommandEncoding::bind_texture:
+            opcode |= static_cast<Uint8>(command.bind_texture.slot << COMMAND_BIND_SLOT_SHIFT);
+            size += write_handle(bytes + size, opcode, command.bind_texture.texture);
+            break;
+        default:
+            break;
+    }
+
+    bytes[0] = opcode;
+
+    // Commands never straddle two chunks, so the decoder only has to check for the end of a chunk between commands
+    if(!current_chunk || current_chunk->used + size > COMMAND_CHUNK_DATA_SIZE) {
+        CommandChunk *next = current_chunk ? current_chunk->next : first_chunk;
+
+        if(next) {
+            next->used = 0;
+        } else {
+            next = acquire_command_chunk();
+            if(!next) {
+                kai::log("The CommandBuffer ran out of memory after %u bytes, it won't be executed!\n", this->size);
+                overflowed = true;
+                return;
+            }
+
+            (current_chunk ? current_chunk->next : first_chunk) = next;
+        }
+
+        current_chunk = next;
+    }
+
+    memcpy(current_chunk->data + current_chunk->used, bytes, size);
+    current_chunk->used += size;
+    this->size += size;
+}
+
+// Appends to the instance data and returns the offset of 'data' in it
+Uint32 kai::CommandBuffer::push_instance_data(const void *data, Uint32 bytes) {
+    Uint32 offset = instance_size;
+    kai::align_to_pow2<Uint32>(offset, 4);
+
+    if(offset + bytes > instance_capacity) {
+        Uint32 capacity = kai::max(instance_capacity * 2, static_cast<Uint32>(kai::kibibytes(4)));
+        while(capacity < offset + bytes) {
+            capacity *= 2;
+        }
+
+        kai::StackAllocator instances(capacity);
+        if(!instances.get_data()) {
+            kai::log("Could not grow the instance data of the CommandBuffer!\n");
+            return INVALID_INSTANCE_OFFSET;
+        }
+
+        if(instance_size) {
+            memcpy(instances.get_data(), instance_allocator.get_data(), instance_size);
+        }
+
+        instance_allocator.destroy();
+        instance_allocator = instances;
+        instance_capacity = capacity;
+    }
+
+    memcpy(static_cast<Uint8 *>(instance_allocator.get_data()) + offset, data, bytes);
+    instance_size = offset + bytes;
+
+    return offset;
+}
+
+// Adds a draw or draw_indexed to the run of identical draws, or starts a new one with it
+void kai::CommandBuffer::instance_draw(const CommandEncodingData &command, const InstanceTransform &transform) {
+    // draw and draw_indexed share the same layout for the count and start
+    Int32 base = (command.draw.encoding == CommandEncoding::draw_indexed) ? command.draw_indexed.base : 0;
+
+    Bool32 same = pending_instance_count > 0 &&
+                  pending_encoding == command.draw.encoding &&
+                  pending_count == command.draw.count &&
+                  pending_start == command.draw.start &&
+                  pending_base == base;
+
+    if(!same) {
+        flush_instances();
+    }
+
+    // Nothing else can append to the instance data while there's a run, so its transforms stay contiguous
+    Uint32 offset = push_instance_data(&transform, sizeof(transform));
+    if(offset == INVALID_INSTANCE_OFFSET) {
+        return;
+    }
+
+    if(same) {
+        pending_instance_count++;
+        auto_instanced_count++;
+        return;
+    }
+
+    pending_encoding = command.draw.encoding;
+    pending_count = command.draw.count;
+    pending_start = command.draw.start;
+    pending_base = base;
+    pending_instance_count = 1;
+    pending_instance_offset = offset;
+}
+
+void kai::CommandBuffer::flush_instances(void) {
+    if(pending_instance_count == 0) {
+        return;
+    }
+
+    CommandEncodingData command;
+    if(pending_encoding == CommandEncoding::draw_indexed) {
+        command.draw_indexed_instanced = {
+            CommandEncoding::draw_indexed_instanced,
+            pending_count,
+            pending_start,
+            pending_instance_count,
+            sizeof(InstanceTransform),
+            pending_instance_offset,
+            pending_base
+        };
+    } else {
+        command.draw_instanced = {
+            CommandEncoding::draw_instanced,
+            pending_count,
+            pending_start,
+            pending_instance_count,
+            sizeof(InstanceTransform),
+            pending_instance_offset
+        };
+    }
+
+    pending_instance_count = 0;
+    encode(command);
+}
+
+// Brings 'current' to the state in 'next' and returns the number of binds that were needed for it.
+// Clears only depend on the pipeline. A null 'encoder' only counts the binds without emitting them
+Uint32 kai::CommandBuffer::apply_state(BoundState &current, const BoundState &next, Bool32 draw, CommandBuffer *encoder) {
+    Uint32 changes = 0;
+
+    // Null state was never bound while recording, so whatever the device has bound is used
+    if(next.pipeline.handle && next.pipeline.handle != current.pipeline.handle) {
+        if(encoder) {
+            CommandEncodingData command;
+            command.set_render_pipeline = {
+                CommandEncoding::set_render_pipeline,
+                next.pipeline.handle
+            };
+
+            encoder->encode(command);
+        }
+
+        current.pipeline = next.pipeline;
+        changes++;
+    }
+
+    if(!draw) {
+        return changes;
+    }
+
+    auto bind = [&](RenderBuffer &bound, RenderBuffer buffer, RenderBufferType type, ShaderType shader_type) -> bool {
+        if(buffer.handle && buffer.handle != bound.handle) {
+            if(encoder) {
+                CommandEncodingData command;
+                command.bind_buffer = {
+                    CommandEncoding::bind_buffer,
+                    buffer.handle,
+                    type,
+                    shader_type
+                };
+
+                encoder->encode(command);
+            }
+
+            bound = buffer;
+            changes++;
+            return true;
+        }
+
+        return false;
+    };
+
+    bind(current.vertex_buffer, next.vertex_buffer, RenderBufferType::vertex, ShaderType::vertex);
+    bind(current.index_buffer, next.index_buffer, RenderBufferType::index, ShaderType::vertex);
+    for(Uint32 i = 0; i < KAI_ARRAY_COUNT(next.constant_buffers); i++) {
+        if(!next.constant_sizes[i]) {
+            if(bind(current.constant_buffers[i], next.constant_buffers[i], RenderBufferType::constant, static_cast<ShaderType>(i))) {
+                current.constant_sizes[i] = 0;
+            }
+
+            continue;
+        }
+
+        if(current.constant_buffers[i].handle ||
+           current.constant_offsets[i] != next.constant_offsets[i] ||
+           current.constant_sizes[i] != next.constant_sizes[i]) {
+            if(encoder) {
+                CommandEncodingData command;
+                command.bind_constants = {
+                    CommandEncoding::bind_constants,
+                    next.constant_offsets[i],
+                    next.constant_sizes[i],
+                    static_cast<ShaderType>(i)
+                };
+
+                encoder->encode(command);
+            }
+
+            current.constant_buffers[i] = {};
+            current.constant_offsets[i] = next.constant_offsets[i];
+            current.constant_sizes[i] = next.constant_sizes[i];
+            changes++;
+        }
+    }
+
+    for(Uint32 i = 0; i < KAI_TEXTURE_SLOT_COUNT; i++) {
+        if(next.textures[i].handle && next.textures[i].handle != current.textures[i].handle) {
+            if(encoder) {
+                CommandEncodingData command;
+                command.bind_texture = {
+                    CommandEncoding::bind_texture,
+                    next.textures[i].handle,
+                    i
+                };
+
+                encoder->encode(command);
+            }
+
+            current.textures[i] = next.textures[i];
+            changes++;
+        }
+    }
+
+    return changes;
+}
+
+Uint64 kai::CommandBuffer::get_sort_key(void) const {
+    return (static_cast<Uint64>(sort_sequence) << SORT_KEY_SEQUENCE_SHIFT) |
+           (static_cast<Uint64>(sort_layer) << SORT_KEY_LAYER_SHIFT) |
+           (get_sort_bits(recorded_state.pipeline.handle, 10) << SORT_KEY_PIPELINE_SHIFT) |
+           (get_sort_bits(recorded_state.vertex_buffer.handle, 12) << SORT_KEY_VERTEX_BUFFER_SHIFT) |
+           (get_sort_bits(recorded_state.index_buffer.handle, 10) << SORT_KEY_INDEX_BUFFER_SHIFT) |
+           static_cast<Uint64>(sort_depth);
 }
 
-#define PUSH_TO_COMMAND_BUFFER(var) \
-    do { \
-        void *data = allocator.alloc(sizeof(var)); \
-        memcpy(data, &var, sizeof(var)); \
-    } while(0)
+void kai::CommandBuffer::push_packet(const CommandEncodingData &command, Uint64 key) {
+    if(packet_count == packet_capacity) {
+        flush_packets();
+    }
+
+    Uint8 *data = static_cast<Uint8 *>(packet_allocator.get_data());
+    DrawPacket *packet = reinterpret_cast<DrawPacket *>(data) + packet_count;
+    SortEntry *entry = reinterpret_cast<SortEntry *>(data + packet_capacity * sizeof(DrawPacket)) + packet_count;
+
+    packet->state = recorded_state;
+    packet->command = command;
+
+    if(auto_instancing) {
+        static_cast<InstanceTransform *>(transform_allocator.get_data())[packet_count] = instance_transform;
+    }
+
+    entry->key = key;
+    entry->index = packet_count++;
+}
+
+// Sorts the recorded packets and appends them, along with the binds they need, to the command stream
+void kai::CommandBuffer::flush_packets(void) {
+    if(packet_count == 0) {
+        return;
+    }
+
+    Uint64 start = kai::get_timestamp();
+
+    Uint8 *data = static_cast<Uint8 *>(packet_allocator.get_data());
+    const DrawPacket *packets = reinterpret_cast<const DrawPacket *>(data);
+    SortEntry *entries = reinterpret_cast<SortEntry *>(data + packet_capacity * sizeof(DrawPacket));
+
+    Uint32 draw_count = 0;
+    for(Uint32 i = 0; i < packet_count; i++) {
+        Bool32 draw = is_draw(packets[i].command.draw.encoding);
+
+        sort_stats.state_changes_unsorted += apply_state(unsorted_state, packets[i].state, draw, nullptr);
+        draw_count += draw ? 1 : 0;
+    }
+
+    const SortEntry *sorted = radix_sort(entries, entries + packet_capacity, packet_count);
+    const InstanceTransform *transforms = static_cast<const InstanceTransform *>(transform_allocator.get_data());
+
+    for(Uint32 i = 0; i < packet_count; i++) {
+        const DrawPacket &packet = packets[sorted[i].index];
+        CommandEncoding encoding = packet.command.draw.encoding;
+
+        sort_stats.state_changes_sorted += apply_state(emitted_state, packet.state, is_draw(encoding), this);
+
+        if(auto_instancing && (encoding == CommandEncoding::draw || encoding == CommandEncoding::draw_indexed)) {
+            instance_draw(packet.command, transforms[sorted[i].index]);
+        } else {
+            encode(packet.command);
+        }
+    }
+
+    sort_stats.draw_count += draw_count;
+    sort_stats.sort_ms += static_cast<Float64>(kai::get_timestamp() - start) * 1000.0 /
+                          static_cast<Float64>(kai::get_timestamp_frequency());
+
+    packet_count = 0;
+}
 
 void kai::CommandBuffer::draw(Uint32 vertex_count, Uint32 starting_index) {
-    CommandEncodingData::Draw command = {
+    CommandEncodingData command;
+    command.draw = {
         CommandEncoding::draw,
         vertex_count,
         starting_index
     };
 
-    PUSH_TO_COMMAND_BUFFER(command);
+    if(mode == CommandBufferMode::sorted) {
+        push_packet(command, get_sort_key());
+    } else if(auto_instancing) {
+        instance_draw(command, instance_transform);
+    } else {
+        encode(command);
+    }
 }
 
 void kai::CommandBuffer::draw_indexed(Uint32 index_count, Uint32 starting_index, Int32 base_offset) {
-    CommandEncodingData::DrawIndexed command = {
+    CommandEncodingData command;
+    command.draw_indexed = {
         CommandEncoding::draw_indexed,
         index_count,
         starting_index,
         base_offset
     };
 
-    PUSH_TO_COMMAND_BUFFER(command);
+    if(mode == CommandBufferMode::sorted) {
+        push_packet(command, get_sort_key());
+    } else if(auto_instancing) {
+        instance_draw(command, instance_transform);
+    } else {
+        encode(command);
+    }
+}
+
+void kai::CommandBuffer::draw_instanced(Uint32 vertex_count, Uint32 instance_count, const void *instance_data,
+                                        Uint32 instance_stride, Uint32 starting_index) {
+    CommandEncodingData command;
+    command.draw_instanced = {
+        CommandEncoding::draw_instanced,
+        vertex_count,
+        starting_index,
+        instance_count,
+        0,
+        0
+    };
+
+    if(instance_data && instance_stride) {
+        // The transforms of a run that auto-instancing is still collecting have to stay contiguous
+        flush_instances();
+
+        Uint32 offset = push_instance_data(instance_data, instance_count * instance_stride);
+        if(offset == INVALID_INSTANCE_OFFSET) {
+            return;
+        }
+
+        command.draw_instanced.instance_stride = instance_stride;
+        command.draw_instanced.instance_offset = offset;
+    }
+
+    if(mode == CommandBufferMode::sorted) {
+        push_packet(command, get_sort_key());
+    } else {
+        encode(command);
+    }
+}
+
+void kai::CommandBuffer::draw_indexed_instanced(Uint32 index_count, Uint32 instance_count, const void *instance_data,
+                                                Uint32 instance_stride, Uint32 starting_index, Int32 base_offset) {
+    CommandEncodingData command;
+    command.draw_indexed_instanced = {
+        CommandEncoding::draw_indexed_instanced,
+        index_count,
+        starting_index,
+        instance_count,
+        0,
+        0,
+        base_offset
+    };
+
+    if(instance_data && instance_stride) {
+        flush_instances();
+
+        Uint32 offset = push_instance_data(instance_data, instance_count * instance_stride);
+        if(offset == INVALID_INSTANCE_OFFSET) {
+            return;
+        }
+
+        command.draw_indexed_instanced.instance_stride = instance_stride;
+        command.draw_indexed_instanced.instance_offset = offset;
+    }
+
+    if(mode == CommandBufferMode::sorted) {
+        push_packet(command, get_sort_key());
+    } else {
+        encode(command);
+    }
+}
+
+void kai::CommandBuffer::set_render_pipeline(const kai::RenderPipeline &pipeline) {
+    if(recorded_state.pipeline.handle == pipeline.handle) {
+        elided_count++;
+        return;
+    }
+
+    recorded_state.pipeline = pipeline;
+
+    if(mode == CommandBufferMode::sorted) {
+        return;
+    }
+
+    CommandEncodingData command;
+    command.set_render_pipeline = {
+        CommandEncoding::set_render_pipeline,
+        pipeline.handle
+    };
+
+    encode(command);
 }
 
-void kai::CommandBuffer::bind_buffer(kai::RenderBuffer &buffer, kai::RenderBufferType type, kai::ShaderType shader_type) {
-    CommandEncodingData::BindBuffer command = {
+void kai::CommandBuffer::bind_buffer(const kai::RenderBuffer &buffer, kai::RenderBufferType type, kai::ShaderType shader_type) {
+    RenderBuffer *bound = nullptr;
+    switch(type) {
+        case RenderBufferType::vertex: bound = &recorded_state.vertex_buffer; break;
+        case RenderBufferType::index: bound = &recorded_state.index_buffer; break;
+        case RenderBufferType::constant: bound = &recorded_state.constant_buffers[static_cast<Uint32>(shader_type)]; break;
+    }
+
+    if(bound->handle == buffer.handle) {
+        elided_count++;
+        return;
+    }
+
+    *bound = buffer;
+
+    if(type == RenderBufferType::constant) {
+        recorded_state.constant_sizes[static_cast<Uint32>(shader_type)] = 0;
+    }
+
+    if(mode == CommandBufferMode::sorted) {
+        return;
+    }
+
+    CommandEncodingData command;
+    command.bind_buffer = {
         CommandEncoding::bind_buffer,
-        &buffer,
+        buffer.handle,
         type,
         shader_type
     };
 
-    PUSH_TO_COMMAND_BUFFER(command);
+    encode(command);
+}
+
+void kai::CommandBuffer::bind_constants(const kai::ConstantSlice &slice, kai::ShaderType shader_type) {
+    Uint32 i = static_cast<Uint32>(shader_type);
+
+    if(recorded_state.constant_offsets[i] == slice.offset && recorded_state.constant_sizes[i] == slice.size) {
+        elided_count++;
+        return;
+    }
+
+    recorded_state.constant_buffers[i] = {};
+    recorded_state.constant_offsets[i] = slice.offset;
+    recorded_state.constant_sizes[i] = slice.size;
+
+    if(mode == CommandBufferMode::sorted) {
+        return;
+    }
+
+    CommandEncodingData command;
+    command.bind_constants = {
+        CommandEncoding::bind_constants,
+        slice.offset,
+        slice.size,
+        shader_type
+    };
+
+    encode(command);
+}
+
+void kai::CommandBuffer::bind_texture(const kai::RenderTexture &texture, Uint32 slot) {
+    if(slot >= KAI_TEXTURE_SLOT_COUNT) {
+        kai::log("Tried to bind a texture to slot %u, there are only %u slots!\n", slot, KAI_TEXTURE_SLOT_COUNT);
+        return;
+    }
+
+    if(recorded_state.textures[slot].handle == texture.handle) {
+        elided_count++;
+        return;
+    }
+
+    recorded_state.textures[slot] = texture;
+
+    if(mode == CommandBufferMode::sorted) {
+        return;
+    }
+
+    CommandEncodingData command;
+    command.bind_texture = {
+        CommandEncoding::bind_texture,
+        texture.handle,
+        slot
+    };
+
+    encode(command);
+}
+
+void kai::CommandBuffer::set_sort_layer(Uint8 layer) {
+    sort_layer = layer;
+}
+
+void kai::CommandBuffer::set_sort_depth(Float32 depth) {
+    sort_depth = kai::pack_unorm16(depth);
+}
+
+void kai::CommandBuffer::set_auto_instancing(Bool32 enable) {
+    auto_instancing = enable;
+
+    // Sorting needs the transform of every packet until the packets are flushed
+    if(enable && mode == CommandBufferMode::sorted && !transform_allocator.get_data()) {
+        transform_allocator = kai::StackAllocator(packet_capacity * sizeof(InstanceTransform));
+    }
+}
+
+void kai::CommandBuffer::set_instance_transform(const kai::Mat4x4 &transform) {
+    // Mat4x4 is stored in column-major order
+    for(Uint32 row = 0; row < 3; row++) {
+        for(Uint32 column = 0; column < 4; column++) {
+            instance_transform.rows[row][column] = transform.m[column][row];
+        }
+    }
 }
 
-void kai::CommandBuffer::clear_color(void) { push_command(allocator, CommandEncoding::clear_color); }
-void kai::CommandBuffer::clear_depth(void) { push_command(allocator, CommandEncoding::clear_depth); }
-void kai::CommandBuffer::clear_stencil(void) { push_command(allocator, CommandEncoding::clear_stencil); }
-void kai::CommandBuffer::clear_depth_stencil(void) { push_command(allocator, CommandEncoding::clear_depth_stencil); }
+void kai::CommandBuffer::push_clear(CommandEncoding encoding) {
+    CommandEncodingData command;
+    command.draw.encoding = encoding;
 
-#undef PUSH_TO_COMMAND_BUFFER
+    if(mode != CommandBufferMode::sorted) {
+        encode(command);
+        return;
+    }
+
+    if(sort_sequence == SORT_KEY_MAX_SEQUENCE) {
+        flush_packets();
+        sort_sequence = 0;
+    }
+
+    // The clear starts a new sequence, with the lowest key in it. The sort is stable, so it stays ahead of the
+    // draws that follow even if their keys are all zeros as well
+    sort_sequence++;
+
+    push_packet(command, static_cast<Uint64>(sort_sequence) << SORT_KEY_SEQUENCE_SHIFT);
+}
+
+void kai::CommandBuffer::clear_color(void) { push_clear(CommandEncoding::clear_color); }
+void kai::CommandBuffer::clear_depth(void) { push_clear(CommandEncoding::clear_depth); }
+void kai::CommandBuffer::clear_stencil(void) { push_clear(CommandEncoding::clear_stencil); }
+void kai::CommandBuffer::clear_depth_stencil(void) { push_clear(CommandEncoding::clear_depth_stencil); }
+
+// -------------------------------------------------- CommandDecoder -------------------------------------------------- //
+// An overflowed CommandBuffer is missing commands and its end, so it decodes as an empty one
+CommandDecoder::CommandDecoder(const kai::CommandBuffer &command_buffer, Bool32 merge) :
+    chunk(command_buffer.has_overflowed() ? nullptr : command_buffer.get_first_chunk()),
+    merge_vertices(merge ? 1 : 0) {
+
+    if(chunk) {
+        stream = chunk->data;
+        chunk_end = stream + chunk->used;
+    }
+}
+
+// Returns the opcode of the next command without consuming it, the end of the last chunk reads as the end of the buffer
+KAI_FORCEINLINE Uint8 CommandDecoder::peek(void) {
+    if(stream == chunk_end) {
+        if(!chunk->next) {
+            return static_cast<Uint8>(CommandEncoding::end);
+        }
+
+        chunk = chunk->next;
+        stream = chunk->data;
+        chunk_end = stream + chunk->used;
+    }
+
+    return *stream;
+}
+
+// Mirrors CommandBuffer::encode, see render_internal.h for the format
+void CommandDecoder::decode(CommandEncodingData &command) {
+    Uint8 opcode = peek();
+    stream++;
+    CommandEncoding encoding = static_cast<CommandEncoding>(opcode & COMMAND_ENCODING_MASK);
+
+    switch(encoding) {
+        case CommandEncoding::draw:
+        case CommandEncoding::draw_indexed: {
+            Uint32 kind = (encoding == CommandEncoding::draw_indexed) ? 1 : 0;
+            Uint32 count = (opcode & COMMAND_FLAG_SAME_COUNT) ? last_draw_count[kind] : read_varint(stream);
+
+            Uint32 start = last_draw_start[kind];
+            if(opcode & COMMAND_FLAG_CONTINUES) {
+                start += last_draw_count[kind];
+            } else if(!(opcode & COMMAND_FLAG_SAME_START)) {
+                start += zigzag_decode(read_varint(stream));
+            }
+
+            last_draw_start[kind] = start;
+            last_draw_count[kind] = count;
+
+            if(kind) {
+                if(!(opcode & COMMAND_FLAG_SAME_BASE)) {
+                    last_draw_base += static_cast<Int32>(zigzag_decode(read_varint(stream)));
+                }
+
+                command.draw_indexed = { encoding, count, start, last_draw_base };
+            } else {
+                command.draw = { encoding, count, start };
+            }
+
+            break;
+        }
+        case CommandEncoding::draw_instanced:
+        case CommandEncoding::draw_indexed_instanced: {
+            auto c = &command.draw_indexed_instanced;
+            c->encoding = encoding;
+            c->count = read_varint(stream);
+            c->instance_count = read_varint(stream);
+            c->start = read_varint(stream);
+
+            if(encoding == CommandEncoding::draw_indexed_instanced) {
+                c->base = static_cast<Int32>(zigzag_decode(read_varint(stream)));
+            }
+
+            c->instance_stride = read_varint(stream);
+            c->instance_offset = 0;
+            if(c->instance_stride) {
+                c->instance_offset = (opcode & COMMAND_FLAG_CONTINUES) ? last_instance_end : read_varint(stream);
+                last_instance_end = c->instance_offset + c->instance_count * c->instance_stride;
+            }
+
+            break;
+        }
+        case CommandEncoding::set_render_pipeline:
+            command.set_render_pipeline = {
+                encoding,
+                read_handle(stream, opcode)
+            };
+            break;
+        case CommandEncoding::bind_buffer:
+            command.bind_buffer = {
+                encoding,
+                read_handle(stream, opcode),
+                static_cast<kai::RenderBufferType>((opcode >> COMMAND_BIND_TYPE_SHIFT) & 0x3),
+                static_cast<kai::ShaderType>((opcode >> COMMAND_BIND_SHADER_SHIFT) & 0x1)
+            };
+            break;
+        case CommandEncoding::bind_constants: {
+            Uint32 offset = read_varint(stream) * CONSTANT_RING_ALIGNMENT;
+            command.bind_constants = {
+                encoding,
+                offset,
+                read_varint(stream) * 16,
+                static_cast<kai::ShaderType>((opcode >> COMMAND_BIND_SHADER_SHIFT) & 0x1)
+            };
+            break;
+        }
+        case CommandEncoding::bind_texture:
+            command.bind_texture = {
+                encoding,
+                read_handle(stream, opcode),
+                static_cast<Uint32>((opcode >> COMMAND_BIND_SLOT_SHIFT) & 0x3)
+            };
+            break;
+        default:
+            command.draw.encoding = encoding;
+            break;
+    }
+}
+
+bool CommandDecoder::next(CommandEncodingData &command) {
+    if(has_pending) {
+        command = pending;
+        has_pending = false;
+    } else if(!chunk || (peek() & COMMAND_ENCODING_MASK) == static_cast<Uint8>(CommandEncoding::end)) {
+        return false;
+    } else {
+        decode(command);
+    }
+
+    // Nothing can change in between two adjacent draws, so if they continue each other's range they can be a single draw.
+    // That is exactly what the continues flag of the encoding says, so there's no need to decode the next draw up front.
+    // Only draws of whole primitives are merged though, otherwise the vertices left over from one draw would form a
+    // primitive with the ones of the next (e.g. 4 + 2 vertices are 1 + 0 triangles, but 6 are 2)
+    if(merge_vertices && (command.draw.encoding == CommandEncoding::draw || command.draw.encoding == CommandEncoding::draw_indexed) &&
+       command.draw.count % merge_vertices == 0) {
+        Uint8 mergeable = static_cast<Uint8>(command.draw.encoding) | COMMAND_FLAG_CONTINUES;
+        Uint8 mask = COMMAND_ENCODING_MASK | COMMAND_FLAG_CONTINUES;
+
+        if(command.draw.encoding == CommandEncoding::draw_indexed) {
+            mergeable |= COMMAND_FLAG_SAME_BASE;
+            mask |= COMMAND_FLAG_SAME_BASE;
+        }
+
+        while((peek() & mask) == mergeable) {
+            CommandEncodingData n;
+            decode(n);
+
+            // draw and draw_indexed share the same layout for the count
+            if(n.draw.count % merge_vertices) {
+                pending = n;
+                has_pending = true;
+                break;
+            }
+
+            command.draw.count += n.draw.count;
+            merged_draw_count++;
+        }
+    }
+
+    return true;
+}
+
+void CommandDecoder::set_merge_draws(kai::RenderPipelineInfo::TopologyType topology) {
+    // Merging two strips would connect them with extra primitives
+    switch(topology) {
+        case kai::RenderPipelineInfo::TopologyType::point_list: merge_vertices = 1; break;
+        case kai::RenderPipelineInfo::TopologyType::line_list: merge_vertices = 2; break;
+        case kai::RenderPipelineInfo::TopologyType::triangle_list: merge_vertices = 3; break;
+        default: merge_vertices = 0; break;
+    }
+}
 
 // -------------------------------------------------- RenderDevice  -------------------------------------------------- //
 static kai::RenderDevice * init_device(void) {
@@ -116,10 +1366,238 @@ static kai::RenderDevice * init_device(Uint32 id) {
     return g_device;
 }
 
+Uint32 kai::get_format_size(kai::RenderFormat format) {
+    switch(format) {
+        case kai::RenderFormat::r_u8:
+        case kai::RenderFormat::r_unorm8:
+        case kai::RenderFormat::r_snorm8:
+            return 1;
+        case kai::RenderFormat::rg_u8:
+        case kai::RenderFormat::rg_unorm8:
+        case kai::RenderFormat::rg_snorm8:
+        case kai::RenderFormat::r_f16:
+        case kai::RenderFormat::r_unorm16:
+        case kai::RenderFormat::r_snorm16:
+            return 2;
+        case kai::RenderFormat::rgba_u8:
+        case kai::RenderFormat::rgba_unorm8:
+        case kai::RenderFormat::rgba_snorm8:
+        case kai::RenderFormat::r_f32:
+        case kai::RenderFormat::rg_f16:
+        case kai::RenderFormat::rg_unorm16:
+        case kai::RenderFormat::rg_snorm16:
+            return 4;
+        case kai::RenderFormat::rg_f32:
+        case kai::RenderFormat::rgba_f16:
+        case kai::RenderFormat::rgba_unorm16:
+        case kai::RenderFormat::rgba_snorm16:
+            return 8;
+        case kai::RenderFormat::rgb_f32:
+            return 12;
+        case kai::RenderFormat::rgba_f32:
+            return 16;
+        case kai::RenderFormat::bc1_unorm:
+        case kai::RenderFormat::bc4_unorm:
+            return 8;
+        case kai::RenderFormat::bc3_unorm:
+        case kai::RenderFormat::bc5_unorm:
+        case kai::RenderFormat::bc7_unorm:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+Uint32 kai::get_format_block_size(kai::RenderFormat format) {
+    switch(format) {
+        case kai::RenderFormat::bc1_unorm:
+        case kai::RenderFormat::bc3_unorm:
+        case kai::RenderFormat::bc4_unorm:
+        case kai::RenderFormat::bc5_unorm:
+        case kai::RenderFormat::bc7_unorm:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+Uint32 kai::get_mip_count(Uint32 width, Uint32 height) {
+    Uint32 count = 1;
+    for(Uint32 size = kai::max(width, height); size > 1; size >>= 1) {
+        count++;
+    }
+
+    return count;
+}
+
+Uint64 kai::get_texture_size(kai::RenderFormat format, Uint32 width, Uint32 height, Uint32 mip_count) {
+    Uint32 block_size = kai::get_format_block_size(format);
+    Uint64 size = 0;
+
+    for(Uint32 i = 0; i < mip_count; i++) {
+        Uint64 blocks_x = (kai::max(width >> i, 1u) + block_size - 1) / block_size;
+        Uint64 blocks_y = (kai::max(height >> i, 1u) + block_size - 1) / block_size;
+        size += blocks_x * blocks_y * kai::get_format_size(format);
+    }
+
+    return size;
+}
+
 kai::RenderDevice * kai::RenderDevice::get(void) {
     return g_device;
 }
 
+bool kai::RenderDevice::allocate_constants(Uint32 bytes, kai::ConstantSlice &out_slice) const {
+    ConstantRing *ring = constant_ring;
+    if(!ring || bytes == 0) {
+        return false;
+    }
+
+    kai::align_to_pow2<Uint32>(bytes, CONSTANT_RING_ALIGNMENT);
+
+    Uint64 head = ring->head.load(std::memory_order_relaxed);
+    Uint64 start;
+
+    do {
+        // Slices never wrap around the end of the ring, the rest of it is skipped instead
+        start = head;
+        Uint32 offset = static_cast<Uint32>(start % ring->size);
+        if(offset + bytes > ring->size) {
+            start += ring->size - offset;
+        }
+
+        if(start + bytes > ring->limit) {
+            kai::log("The constant ring buffer is full, %u bytes couldn't be allocated!\n", bytes);
+            return false;
+        }
+    } while(!ring->head.compare_exchange_weak(head, start + bytes, std::memory_order_relaxed));
+
+    out_slice.offset = static_cast<Uint32>(start % ring->size);
+    out_slice.size = bytes;
+    out_slice.data = ring->data + out_slice.offset;
+
+    return true;
+}
+
+void kai::RenderDevice::execute(const kai::CommandBuffer *const *command_buffers, Uint32 count) const {
+    if(count == 0) {
+        return;
+    }
+
+    kai::StackAllocator &scratch = *get_engine_memory();
+    kai::StackMarker marker;
+    const kai::CommandBuffer **sorted = scratch.alloc<const kai::CommandBuffer *>(&marker, count);
+
+    if(!sorted) {
+        kai::log("Not enough memory to sort the submitted CommandBuffers!\n");
+        return;
+    }
+
+    // Stable insertion sort, there's usually only a handful of buffers (about one per recording thread)
+    for(Uint32 i = 0; i < count; i++) {
+        const kai::CommandBuffer *buffer = command_buffers[i];
+        Uint32 j = i;
+        for(; j > 0 && sorted[j - 1]->get_submission_order() > buffer->get_submission_order(); j--) {
+            sorted[j] = sorted[j - 1];
+        }
+
+        sorted[j] = buffer;
+    }
+
+    for(Uint32 i = 0; i < count; i++) {
+        execute(*sorted[i]);
+    }
+
+    scratch.free(marker);
+}
+
+void kai::RenderDevice::finish_frame_counters(void) const {
+    memcpy(frame_counters.buffer_bytes, buffer_bytes, sizeof(buffer_bytes));
+    frame_counters.texture_bytes = texture_bytes;
+    last_frame_counters = frame_counters;
+    frame_counters = {};
+
+    frames_presented++;
+
+    if(counters_log_interval && (frames_presented % counters_log_interval) == 0) {
+        const RenderFrameCounters &c = last_frame_counters;
+        const Float64 mib = 1.0 / static_cast<Float64>(kai::mebibytes(1));
+
+        kai::log("Frame %u: %u draws, %llu vertices, %u/%u/%u pipeline/buffer/constant binds, %u command bytes, "
+                 "%.2f/%.2f/%.2f MiB vertex/index/constant buffers, %.3f ms execute\n",
+                 frames_presented, c.draws, static_cast<unsigned long long>(c.vertices),
+                 c.pipeline_binds, c.buffer_binds, c.constant_binds, c.command_bytes,
+                 static_cast<Float64>(c.buffer_bytes[0]) * mib, static_cast<Float64>(c.buffer_bytes[1]) * mib,
+                 static_cast<Float64>(c.buffer_bytes[2]) * mib, c.execute_ms);
+    }
+}
+
+// Returns false if the resource has to be destroyed right away instead, because the device has no queue
+// (it wasn't created by init_renderer()) or the queue couldn't grow
+static bool queue_retire(RetireQueue *queue, Uint32 handle, RetireQueue::Type type) {
+    if(!queue) {
+        return false;
+    }
+
+    ScopedSpinLock lock(queue->lock);
+    if(!push_retire_entry(queue->buckets[queue->frame % FRAMES_IN_FLIGHT], handle, type)) {
+        kai::log("The retire queue is full, the resource is destroyed right away!\n");
+        return false;
+    }
+
+    return true;
+}
+
+void kai::RenderDevice::destroy_buffer_deferred(kai::RenderBuffer &buffer) {
+    if(buffer.handle && !queue_retire(retire_queue, buffer.handle, RetireQueue::Type::buffer)) {
+        destroy_buffer(buffer);
+    }
+
+    buffer = {};
+}
+
+void kai::RenderDevice::destroy_render_pipeline_deferred(kai::RenderPipeline &pipeline) {
+    if(pipeline.handle && !queue_retire(retire_queue, pipeline.handle, RetireQueue::Type::pipeline)) {
+        destroy_render_pipeline(pipeline);
+    }
+
+    pipeline = {};
+}
+
+void kai::RenderDevice::destroy_texture_deferred(kai::RenderTexture &texture) {
+    if(texture.handle && !queue_retire(retire_queue, texture.handle, RetireQueue::Type::texture)) {
+        destroy_texture(texture);
+    }
+
+    texture = {};
+}
+
+void kai::RenderDevice::retire_resources(void) const {
+    RetireQueue *queue = retire_queue;
+    if(!queue) {
+        return;
+    }
+
+    {
+        ScopedSpinLock lock(queue->lock);
+
+        // The bucket of the frame that went out of flight becomes the one of the next frame
+        queue->frame++;
+        RetireQueue::Bucket &bucket = queue->buckets[queue->frame % FRAMES_IN_FLIGHT];
+
+        RetireQueue::Bucket empty = queue->retiring;
+        queue->retiring = bucket;
+        bucket = empty;
+    }
+
+    // present() is const, but destroying a resource isn't
+    retire_bucket(const_cast<kai::RenderDevice *>(this), queue->retiring);
+}
+
 kai::Window * kai::get_window(void) {
     return platform_get_kai_window();
 }
+
+void kai::set_render_counters_log_interval(Uint32 frames) {
+    counters_log_interval = frames;
+}
@@ -0,0 +1,1299 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#include <string.h>
+
+#include "includes/fileio.h"
+#include "includes/render.h"
+#include "capture_internal.h"
+#include "render_internal.h"
+
+// The varint and zigzag helpers are the ones of render.cpp
+
+#define CAPTURE_INITIAL_SLOT_BITS 10
+#define CAPTURE_INVALID_INDEX 0xffffffff
+#define CAPTURE_MAX_PATH 260
+
+static KAI_FORCEINLINE Uint32 pad_to_4(Uint32 size) {
+    kai::align_to_pow2<Uint32>(size, 4);
+    return size;
+}
+
+static KAI_FORCEINLINE Uint32 get_string_size(const char *str) {
+    return str ? static_cast<Uint32>(strlen(str)) + 1 : 0;
+}
+
+// -------------------------------------------------- CaptureStream -------------------------------------------------- //
+// Growable memory that the parts of a capture are written into while the frame is being captured
+struct CaptureStream {
+    Uint8 * reserve(Uint32 byte_count);
+
+    void write(const void *bytes, Uint32 byte_count) {
+        Uint8 *out = reserve(byte_count);
+        if(out) {
+            memcpy(out, bytes, byte_count);
+        }
+    }
+
+    void write_varint(Uint32 value) {
+        Uint8 bytes[5];
+        write(bytes, ::write_varint(bytes, value));
+    }
+
+    void pad(void) {
+        Uint32 padding = pad_to_4(size) - size;
+        Uint8 *out = reserve(padding);
+        if(out) {
+            memset(out, 0, padding);
+        }
+    }
+
+    const Uint8 * get_data(void) const {
+        return static_cast<const Uint8 *>(memory.get_data());
+    }
+
+    kai::StackAllocator memory;
+    Uint32 size;
+    Uint32 capacity;
+    Bool32 failed;
+};
+
+Uint8 * CaptureStream::reserve(Uint32 byte_count) {
+    if(failed) {
+        return nullptr;
+    }
+
+    if(static_cast<Uint64>(size) + byte_count > capacity) {
+        Uint64 new_capacity = kai::max(static_cast<Uint64>(capacity) * 2, kai::kibibytes(64));
+        while(new_capacity < static_cast<Uint64>(size) + byte_count) {
+            new_capacity *= 2;
+        }
+
+        kai::StackAllocator new_memory;
+        if(new_capacity <= 0xffffffff) {
+            new_memory = kai::StackAllocator(static_cast<Uint32>(new_capacity));
+        }
+
+        if(!new_memory.get_data()) {
+            kai::log("Ran out of memory while capturing the frame!\n");
+            failed = true;
+            return nullptr;
+        }
+
+        if(size) {
+            memcpy(new_memory.get_data(), memory.get_data(), size);
+        }
+
+        memory.destroy();
+        memory = new_memory;
+        capacity = static_cast<Uint32>(new_capacity);
+    }
+
+    Uint8 *out = static_cast<Uint8 *>(memory.get_data()) + size;
+    size += byte_count;
+
+    return out;
+}
+
+// -------------------------------------------------- CaptureDevice -------------------------------------------------- //
+// The capture device keeps a record of every pipeline, buffer and texture that exists, already serialized as it
+// goes into a capture file. Records are looked up by the handle of the resource, which is what CommandBuffers
+// reference. Every type of resource has a handle table of its own, so the key tells them apart as well
+enum class CaptureRecordType : Uint32 {
+    pipeline,
+    buffer,
+    texture
+};
+
+struct CaptureRecord {
+    Uint64 key; // See get_record_key()
+    kai::ArenaAllocator arena; // The memory of the record itself
+    Uint32 size;
+    Uint32 capture_index;
+    Uint32 capture_generation; // 'capture_index' is only valid during the capture with this generation
+    CaptureRecordType type;
+    Uint32 references; // Identical pipelines share a handle, see pipeline_cache_internal.h
+    Uint8 KAI_FLEXIBLE_ARRAY(data); // CapturePipeline, CaptureBuffer or CaptureTexture, followed by their strings or data
+};
+
+struct CaptureDeviceData {
+    kai::RenderDevice *device;
+
+    // Open addressing hash table of the records, kept at most half full
+    kai::StackAllocator slot_memory;
+    CaptureRecord **slots;
+    Uint32 slot_bits;
+    Uint32 record_count;
+
+    Int32 viewport[4];
+
+    Bool32 capturing;
+    Uint32 generation;
+    char path[CAPTURE_MAX_PATH];
+    Int32 capture_viewport[4];
+
+    CaptureStream pipelines;
+    CaptureStream buffers;
+    CaptureStream textures;
+    CaptureStream lists;
+    CaptureStream commands; // Of the CommandBuffer that is being captured
+    CaptureStream constants;
+    Uint32 pipeline_count;
+    Uint32 buffer_count;
+    Uint32 texture_count;
+    Uint32 list_count;
+};
+
+struct CaptureDevice : public kai::RenderDevice {
+    CaptureDevice(void) = default;
+
+    void destroy(void) override;
+
+    using kai::RenderDevice::execute;
+    void execute(const kai::CommandBuffer &command_buffer) const override;
+    void present(void) const override;
+
+    void set_viewport(Int32 x, Int32 y, Uint32 width = 0, Uint32 height = 0) const override;
+
+    bool compile_shader(const char *shader_stream, kai::ShaderType type,
+                        const char *entry, void *out_id, void **bytecode = nullptr) const override;
+
+    bool create_render_pipeline(const kai::RenderPipelineInfo &info, const kai::RenderInputLayoutInfo *input_layouts,
+                                Uint32 input_layout_count, kai::RenderPipeline &out_pipeline) const override;
+    void destroy_render_pipeline(kai::RenderPipeline &pipeline) override;
+    void set_render_pipeline(const kai::RenderPipeline &pipeline) const override;
+
+    bool create_buffer(const kai::RenderBufferInfo &info, kai::RenderBuffer &out_buffer) const override;
+    void destroy_buffer(kai::RenderBuffer &buffer) override;
+    bool update_buffer(const kai::RenderBuffer &buffer, const void *contents, Uint32 bytes) const override;
+
+    bool create_texture(const kai::RenderTextureInfo &info, kai::RenderTexture &out_texture) const override;
+    void destroy_texture(kai::RenderTexture &texture) override;
+    bool update_texture(const kai::RenderTexture &texture, Uint32 x, Uint32 y, Uint32 width, Uint32 height,
+                        const void *contents) const override;
+};
+
+static struct {
+    CaptureDeviceData data;
+    CaptureDevice *device;
+} capture_state;
+
+static KAI_FORCEINLINE Uint64 get_record_key(Uint32 handle, CaptureRecordType type) {
+    return (static_cast<Uint64>(type) << 32) | handle;
+}
+
+static KAI_FORCEINLINE Uint32 get_home_slot(Uint64 key, Uint32 bits) {
+    // Fibonacci hashing, the top bits are the best mixed ones
+    return static_cast<Uint32>((key * 0x9e3779b97f4a7c15ull) >> (64 - bits));
+}
+
+static CaptureRecord ** find_slot(CaptureDeviceData *d, Uint64 key) {
+    Uint32 mask = (1u << d->slot_bits) - 1;
+    Uint32 i = get_home_slot(key, d->slot_bits);
+
+    while(d->slots[i] && d->slots[i]->key != key) {
+        i = (i + 1) & mask;
+    }
+
+    return &d->slots[i];
+}
+
+static bool grow_slots(CaptureDeviceData *d) {
+    Uint32 bits = d->slot_bits + 1;
+    Uint32 bytes = (1u << bits) * static_cast<Uint32>(sizeof(CaptureRecord *));
+
+    kai::StackAllocator memory(bytes);
+    if(!memory.get_data()) {
+        return false;
+    }
+
+    memset(memory.get_data(), 0, bytes);
+
+    CaptureRecord **old_slots = d->slots;
+    Uint32 old_count = 1u << d->slot_bits;
+
+    kai::StackAllocator old_memory = d->slot_memory;
+    d->slot_memory = memory;
+    d->slots = static_cast<CaptureRecord **>(memory.get_data());
+    d->slot_bits = bits;
+
+    for(Uint32 i = 0; i < old_count; i++) {
+        if(old_slots[i]) {
+            *find_slot(d, old_slots[i]->key) = old_slots[i];
+        }
+    }
+
+    old_memory.destroy();
+    return true;
+}
+
+static void add_record(CaptureDeviceData *d, CaptureRecord *record) {
+    if((d->record_count + 1) * 2 > (1u << d->slot_bits) && !grow_slots(d)) {
+        kai::log("Could not grow the resource table of the capture device!\n");
+        record->arena.destroy();
+        return;
+    }
+
+    *find_slot(d, record->key) = record;
+    d->record_count++;
+}
+
+static void remove_record(CaptureDeviceData *d, Uint64 key) {
+    CaptureRecord **slot = find_slot(d, key);
+    if(!*slot) {
+        return;
+    }
+
+    (*slot)->arena.destroy();
+    *slot = nullptr;
+    d->record_count--;
+
+    // Moves the records that follow back into the hole if it's between them and their home slot, so that
+    // every record stays reachable from its home slot without tombstones
+    Uint32 mask = (1u << d->slot_bits) - 1;
+    Uint32 hole = static_cast<Uint32>(slot - d->slots);
+
+    for(Uint32 i = (hole + 1) & mask; d->slots[i]; i = (i + 1) & mask) {
+        Uint32 home = get_home_slot(d->slots[i]->key, d->slot_bits);
+        if(((i - home) & mask) >= ((i - hole) & mask)) {
+            d->slots[hole] = d->slots[i];
+            d->slots[i] = nullptr;
+            hole = i;
+        }
+    }
+}
+
+static CaptureRecord * create_record(Uint32 handle, Uint32 size, CaptureRecordType type) {
+    kai::ArenaAllocator arena(offsetof(CaptureRecord, data) + size);
+    CaptureRecord *record = static_cast<CaptureRecord *>(arena.get_buffer());
+
+    if(!record) {
+        kai::log("Not enough memory to keep a copy of the resource for frame captures!\n");
+        return nullptr;
+    }
+
+    record->key = get_record_key(handle, type);
+    record->arena = arena;
+    record->size = size;
+    record->capture_index = CAPTURE_INVALID_INDEX;
+    record->capture_generation = 0;
+    record->type = type;
+    record->references = 1;
+
+    return record;
+}
+
+static void reset_capture(CaptureDeviceData *d) {
+    CaptureStream *streams[] = { &d->pipelines, &d->buffers, &d->textures, &d->lists, &d->commands, &d->constants };
+    for(CaptureStream *stream : streams) {
+        stream->size = 0;
+        stream->failed = false;
+    }
+
+    d->pipeline_count = 0;
+    d->buffer_count = 0;
+    d->texture_count = 0;
+    d->list_count = 0;
+}
+
+static void destroy_streams(CaptureDeviceData *d) {
+    CaptureStream *streams[] = { &d->pipelines, &d->buffers, &d->textures, &d->lists, &d->commands, &d->constants };
+    for(CaptureStream *stream : streams) {
+        stream->memory.destroy();
+        *stream = {};
+    }
+}
+
+static void abort_capture(CaptureDeviceData *d, const char *reason) {
+    kai::log("The capture of %s failed: %s!\n", d->path, reason);
+    d->capturing = false;
+    reset_capture(d);
+}
+
+// Writes the record into the capture the first time the frame uses it and returns its index in the capture
+static Uint32 get_capture_index(CaptureDeviceData *d, Uint32 handle, CaptureRecordType type) {
+    CaptureRecord *record = *find_slot(d, get_record_key(handle, type));
+    if(!record) {
+        return CAPTURE_INVALID_INDEX;
+    }
+
+    if(record->capture_generation != d->generation) {
+        CaptureStream *streams[] = { &d->pipelines, &d->buffers, &d->textures };
+        Uint32 *counts[] = { &d->pipeline_count, &d->buffer_count, &d->texture_count };
+
+        streams[static_cast<Uint32>(type)]->write(record->data, record->size);
+        record->capture_index = (*counts[static_cast<Uint32>(type)])++;
+        record->capture_generation = d->generation;
+    }
+
+    return record->capture_index;
+}
+
+static void finish_capture(CaptureDeviceData *d) {
+    d->capturing = false;
+
+    if(d->pipelines.failed || d->buffers.failed || d->textures.failed || d->lists.failed) {
+        abort_capture(d, "the frame didn't fit into memory");
+        return;
+    }
+
+    CaptureHeader header = {};
+    header.magic = CAPTURE_MAGIC;
+    header.version = CAPTURE_VERSION;
+    header.pipeline_count = d->pipeline_count;
+    header.buffer_count = d->buffer_count;
+    header.texture_count = d->texture_count;
+    header.list_count = d->list_count;
+    memcpy(header.viewport, d->capture_viewport, sizeof(header.viewport));
+
+    kai::FileHandle file = kai::open_file(d->path, static_cast<kai::FileFlags>(kai::FILE_WRITE | kai::FILE_CREATE));
+    if(!file) {
+        abort_capture(d, "the file couldn't be created");
+        return;
+    }
+
+    // A size of 0 has a null buffer, which write_file() doesn't take
+    bool written = kai::write_file(file, &header, sizeof(header));
+    written = written && (!d->pipelines.size || kai::write_file(file, d->pipelines.get_data(), d->pipelines.size));
+    written = written && (!d->buffers.size || kai::write_file(file, d->buffers.get_data(), d->buffers.size));
+    written = written && (!d->textures.size || kai::write_file(file, d->textures.get_data(), d->textures.size));
+    written = written && (!d->lists.size || kai::write_file(file, d->lists.get_data(), d->lists.size));
+    kai::close_file(file);
+
+    if(!written) {
+        abort_capture(d, "the file couldn't be written");
+        return;
+    }
+
+    kai::log("Captured %u pipelines, %u buffers, %u textures and %u lists of commands into %s\n",
+             d->pipeline_count, d->buffer_count, d->texture_count, d->list_count, d->path);
+    reset_capture(d);
+}
+
+static void capture_command_buffer(CaptureDeviceData *d, const ConstantRing *ring, const kai::CommandBuffer &command_buffer);
+
+kai::RenderDevice * create_capture_device(kai::StackAllocator &allocator, kai::RenderDevice *device) {
+    if(capture_state.device) {
+        kai::log("Only one capture device can exist at a time!\n");
+        return device;
+    }
+
+    kai::StackMarker marker;
+    CaptureDevice *capture = allocator.alloc<CaptureDevice, CaptureDevice>(&marker);
+    if(!capture) {
+        return device;
+    }
+
+    CaptureDeviceData *d = &capture_state.data;
+    *d = CaptureDeviceData();
+    d->device = device;
+    d->slot_bits = CAPTURE_INITIAL_SLOT_BITS;
+    d->slot_memory = kai::StackAllocator((1u << d->slot_bits) * static_cast<Uint32>(sizeof(CaptureRecord *)));
+    d->slots = static_cast<CaptureRecord **>(d->slot_memory.get_data());
+
+    if(!d->slots) {
+        allocator.free(marker);
+        return device;
+    }
+
+    memset(d->slots, 0, (1u << d->slot_bits) * sizeof(CaptureRecord *));
+    d->generation = 1;
+
+    capture->data = d;
+    capture->id = device->id;
+    capture->backend = device->backend;
+    capture->constant_ring = device->constant_ring;
+    memcpy(capture->name, device->name, sizeof(capture->name));
+
+    capture_state.device = capture;
+    return capture;
+}
+
+kai::RenderDevice * get_backend_device(void) {
+    return capture_state.device ? capture_state.data.device : kai::RenderDevice::get();
+}
+
+bool kai::capture_next_frame(const char *path) {
+    CaptureDeviceData *d = &capture_state.data;
+
+    if(!capture_state.device) {
+        kai::log("Frames can only be captured if the renderer was initialized with capture support!\n");
+        return false;
+    }
+
+    if(d->capturing) {
+        kai::log("A frame is already being captured into %s!\n", d->path);
+        return false;
+    }
+
+    if(!path || strlen(path) >= CAPTURE_MAX_PATH) {
+        kai::log("Invalid path for the frame capture!\n");
+        return false;
+    }
+
+    strcpy(d->path, path);
+    memcpy(d->capture_viewport, d->viewport, sizeof(d->capture_viewport));
+    reset_capture(d);
+
+    // Bumping the generation forgets which records were written into the previous capture
+    if(++d->generation == 0) {
+        for(Uint32 i = 0; i < (1u << d->slot_bits); i++) {
+            if(d->slots[i]) {
+                d->slots[i]->capture_generation = 0;
+            }
+        }
+
+        d->generation = 1;
+    }
+
+    d->capturing = true;
+    return true;
+}
+
+void CaptureDevice::destroy(void) {
+    CaptureDeviceData *d = static_cast<CaptureDeviceData *>(data);
+    d->device->destroy();
+
+    for(Uint32 i = 0; i < (1u << d->slot_bits); i++) {
+        if(d->slots[i]) {
+            d->slots[i]->arena.destroy();
+        }
+    }
+
+    d->slot_memory.destroy();
+    destroy_streams(d);
+
+    *d = CaptureDeviceData();
+    capture_state.device = nullptr;
+}
+
+void CaptureDevice::execute(const kai::CommandBuffer &command_buffer) const {
+    CaptureDeviceData *d = static_cast<CaptureDeviceData *>(data);
+
+    if(d->capturing) {
+        capture_command_buffer(d, constant_ring, command_buffer);
+    }
+
+    d->device->execute(command_buffer);
+}
+
+void CaptureDevice::present(void) const {
+    CaptureDeviceData *d = static_cast<CaptureDeviceData *>(data);
+    d->device->present();
+    last_frame_counters = d->device->get_frame_counters();
+
+    // The queue belongs to this device, so the resources are retired through it and leave the capture as well
+    retire_resources();
+
+    if(d->capturing) {
+        finish_capture(d);
+    }
+}
+
+void CaptureDevice::set_viewport(Int32 x, Int32 y, Uint32 width, Uint32 height) const {
+    CaptureDeviceData *d = static_cast<CaptureDeviceData *>(data);
+    d->device->set_viewport(x, y, width, height);
+
+    d->viewport[0] = x;
+    d->viewport[1] = y;
+    d->viewport[2] = static_cast<Int32>(width);
+    d->viewport[3] = static_cast<Int32>(height);
+
+    if(d->capturing) {
+        CaptureList list = {};
+        list.type = CaptureListType::set_viewport;
+        memcpy(list.viewport, d->viewport, sizeof(list.viewport));
+
+        d->lists.write(&list, sizeof(list));
+        d->list_count++;
+    }
+}
+
+bool CaptureDevice::compile_shader(const char *shader_stream, kai::ShaderType type,
+                                   const char *entry, void *out_id, void **bytecode) const {
+    return static_cast<CaptureDeviceData *>(data)->device->compile_shader(shader_stream, type, entry, out_id, bytecode);
+}
+
+bool CaptureDevice::create_render_pipeline(const kai::RenderPipelineInfo &info, const kai::RenderInputLayoutInfo *input_layouts,
+                                           Uint32 input_layout_count, kai::RenderPipeline &out_pipeline) const {
+    CaptureDeviceData *d = static_cast<CaptureDeviceData *>(data);
+    if(!d->device->create_render_pipeline(info, input_layouts, input_layout_count, out_pipeline)) {
+        return false;
+    }
+
+    // The backend returned a pipeline that already exists, its record describes it already
+    CaptureRecord *existing = *find_slot(d, get_record_key(out_pipeline.handle, CaptureRecordType::pipeline));
+    if(existing) {
+        existing->references++;
+        return true;
+    }
+
+    const void *strings[4] = {
+        info.vertex_shader_source, info.vertex_shader_entry, info.pixel_shader_source, info.pixel_shader_entry
+    };
+
+    Uint32 string_sizes[4];
+    for(Uint32 i = 0; i < KAI_ARRAY_COUNT(strings); i++) {
+        string_sizes[i] = get_string_size(static_cast<const char *>(strings[i]));
+    }
+
+    if(info.vertex_shader_bytecode) {
+        strings[0] = info.vertex_shader_bytecode;
+        string_sizes[0] = info.vertex_shader_bytecode_size;
+        string_sizes[1] = 0;
+    }
+
+    if(info.pixel_shader_bytecode) {
+        strings[2] = info.pixel_shader_bytecode;
+        string_sizes[2] = info.pixel_shader_bytecode_size;
+        string_sizes[3] = 0;
+    }
+
+    Uint32 size = sizeof(CapturePipeline);
+    for(Uint32 string_size : string_sizes) {
+        size += pad_to_4(string_size);
+    }
+
+    for(Uint32 i = 0; i < input_layout_count; i++) {
+        size += sizeof(CaptureInputLayout) + pad_to_4(get_string_size(input_layouts[i].name));
+    }
+
+    CaptureRecord *record = create_record(out_pipeline.handle, size, CaptureRecordType::pipeline);
+    if(!record) {
+        return true;
+    }
+
+    memset(record->data, 0, size);
+
+    CapturePipeline *pipeline = reinterpret_cast<CapturePipeline *>(record->data);
+    pipeline->input_layout_count = input_layout_count;
+    memcpy(pipeline->color_clear_values, info.color_clear_values, sizeof(pipeline->color_clear_values));
+    pipeline->depth_clear_value = info.depth_clear_value;
+    pipeline->stencil_clear_value = info.stencil_clear_value;
+    pipeline->fill_mode = static_cast<Uint8>(info.fill_mode);
+    pipeline->cull_mode = static_cast<Uint8>(info.cull_mode);
+    pipeline->topology = static_cast<Uint8>(info.topology);
+    pipeline->flags = (info.color_enable ? CAPTURE_PIPELINE_COLOR_ENABLE : 0) |
+                      (info.depth_enable ? CAPTURE_PIPELINE_DEPTH_ENABLE : 0) |
+                      (info.stencil_enable ? CAPTURE_PIPELINE_STENCIL_ENABLE : 0) |
+                      (info.front_ccw ? CAPTURE_PIPELINE_FRONT_CCW : 0) |
+                      (info.vertex_shader_bytecode ? CAPTURE_PIPELINE_VERTEX_BYTECODE : 0) |
+                      (info.pixel_shader_bytecode ? CAPTURE_PIPELINE_PIXEL_BYTECODE : 0);
+
+    Uint8 *out = record->data + sizeof(CapturePipeline);
+    for(Uint32 i = 0; i < KAI_ARRAY_COUNT(strings); i++) {
+        pipeline->string_sizes[i] = string_sizes[i];
+        if(strings[i] && string_sizes[i]) {
+            memcpy(out, strings[i], pipeline->string_sizes[i]);
+        }
+
+        out += pad_to_4(pipeline->string_sizes[i]);
+    }
+
+    for(Uint32 i = 0; i < input_layout_count; i++) {
+        const kai::RenderInputLayoutInfo &layout_info = input_layouts[i];
+
+        CaptureInputLayout *layout = reinterpret_cast<CaptureInputLayout *>(out);
+        layout->name_size = get_string_size(layout_info.name);
+        layout->index = layout_info.index;
+        layout->offset = layout_info.offset;
+        layout->format = static_cast<Uint8>(layout_info.format);
+        layout->per_instance = layout_info.per_instance ? 1 : 0;
+        out += sizeof(CaptureInputLayout);
+
+        if(layout_info.name) {
+            memcpy(out, layout_info.name, layout->name_size);
+        }
+
+        out += pad_to_4(layout->name_size);
+    }
+
+    add_record(d, record);
+    return true;
+}
+
+void CaptureDevice::destroy_render_pipeline(kai::RenderPipeline &pipeline) {
+    CaptureDeviceData *d = static_cast<CaptureDeviceData *>(data);
+
+    Uint64 key = get_record_key(pipeline.handle, CaptureRecordType::pipeline);
+    CaptureRecord *record = *find_slot(d, key);
+    if(record && --record->references == 0) {
+        remove_record(d, key);
+    }
+
+    d->device->destroy_render_pipeline(pipeline);
+}
+
+void CaptureDevice::set_render_pipeline(const kai::RenderPipeline &pipeline) const {
+    CaptureDeviceData *d = static_cast<CaptureDeviceData *>(data);
+    d->device->set_render_pipeline(pipeline);
+
+    if(d->capturing) {
+        CaptureList list = {};
+        list.type = CaptureListType::set_render_pipeline;
+        list.pipeline = get_capture_index(d, pipeline.handle, CaptureRecordType::pipeline);
+
+        if(list.pipeline == CAPTURE_INVALID_INDEX) {
+            abort_capture(d, "a pipeline was set that wasn't created through the capture device");
+            return;
+        }
+
+        d->lists.write(&list, sizeof(list));
+        d->list_count++;
+    }
+}
+
+bool CaptureDevice::create_buffer(const kai::RenderBufferInfo &info, kai::RenderBuffer &out_buffer) const {
+    CaptureDeviceData *d = static_cast<CaptureDeviceData *>(data);
+    if(!d->device->create_buffer(info, out_buffer)) {
+        return false;
+    }
+
+    if(info.byte_size > 0xffffffff) {
+        kai::log("Buffers larger than 4GB can't be captured!\n");
+        return true;
+    }
+
+    Uint32 byte_size = static_cast<Uint32>(info.byte_size);
+    Uint32 data_size = info.data ? pad_to_4(byte_size) : 0;
+
+    CaptureRecord *record = create_record(out_buffer.handle, sizeof(CaptureBuffer) + data_size, CaptureRecordType::buffer);
+    if(!record) {
+        return true;
+    }
+
+    CaptureBuffer *buffer = reinterpret_cast<CaptureBuffer *>(record->data);
+    buffer->byte_size = byte_size;
+    buffer->stride = info.stride;
+    buffer->type = static_cast<Uint8>(info.type);
+    buffer->cpu_usage = static_cast<Uint8>(info.cpu_usage);
+    buffer->resource_usage = static_cast<Uint8>(info.resource_usage);
+    buffer->has_data = info.data ? 1 : 0;
+
+    if(info.data) {
+        memcpy(record->data + sizeof(CaptureBuffer), info.data, byte_size);
+        memset(record->data + sizeof(CaptureBuffer) + byte_size, 0, data_size - byte_size);
+    }
+
+    add_record(d, record);
+    return true;
+}
+
+void CaptureDevice::destroy_buffer(kai::RenderBuffer &buffer) {
+    CaptureDeviceData *d = static_cast<CaptureDeviceData *>(data);
+    remove_record(d, get_record_key(buffer.handle, CaptureRecordType::buffer));
+    d->device->destroy_buffer(buffer);
+}
+
+bool CaptureDevice::update_buffer(const kai::RenderBuffer &buffer, const void *contents, Uint32 bytes) const {
+    CaptureDeviceData *d = static_cast<CaptureDeviceData *>(data);
+    if(!d->device->update_buffer(buffer, contents, bytes)) {
+        return false;
+    }
+
+    Uint64 key = get_record_key(buffer.handle, CaptureRecordType::buffer);
+    CaptureRecord *record = *find_slot(d, key);
+    if(!record) {
+        return true;
+    }
+
+    // The record holds the contents that the next capture writes, a buffer that was created without
+    // data needs a record with room for them first
+    CaptureBuffer *b = reinterpret_cast<CaptureBuffer *>(record->data);
+    if(!b->has_data) {
+        Uint32 data_size = pad_to_4(b->byte_size);
+        CaptureRecord *with_data = create_record(buffer.handle, sizeof(CaptureBuffer) + data_size, CaptureRecordType::buffer);
+        if(!with_data) {
+            return true;
+        }
+
+        with_data->capture_index = record->capture_index;
+        with_data->capture_generation = record->capture_generation;
+        memcpy(with_data->data, record->data, sizeof(CaptureBuffer));
+        memset(with_data->data + sizeof(CaptureBuffer), 0, data_size);
+
+        remove_record(d, key);
+        add_record(d, with_data);
+
+        record = with_data;
+        b = reinterpret_cast<CaptureBuffer *>(record->data);
+        b->has_data = 1;
+    }
+
+    memcpy(record->data + sizeof(CaptureBuffer), contents, bytes);
+    return true;
+}
+
+bool CaptureDevice::create_texture(const kai::RenderTextureInfo &info, kai::RenderTexture &out_texture) const {
+    CaptureDeviceData *d = static_cast<CaptureDeviceData *>(data);
+    if(!d->device->create_texture(info, out_texture)) {
+        return false;
+    }
+
+    Uint64 byte_size = kai::get_texture_size(info.format, info.width, info.height, info.mip_count);
+    if(byte_size > 0xfffffff0) {
+        kai::log("Textures larger than 4GB can't be captured!\n");
+        return true;
+    }
+
+    Uint32 data_size = info.data ? pad_to_4(static_cast<Uint32>(byte_size)) : 0;
+
+    CaptureRecord *record = create_record(out_texture.handle, sizeof(CaptureTexture) + data_size, CaptureRecordType::texture);
+    if(!record) {
+        return true;
+    }
+
+    CaptureTexture *texture = reinterpret_cast<CaptureTexture *>(record->data);
+    *texture = {};
+    texture->width = info.width;
+    texture->height = info.height;
+    texture->format = static_cast<Uint8>(info.format);
+    texture->resource_usage = static_cast<Uint8>(info.resource_usage);
+    texture->has_data = info.data ? 1 : 0;
+    texture->mip_count = static_cast<Uint8>(info.mip_count);
+
+    if(info.data) {
+        memcpy(record->data + sizeof(CaptureTexture), info.data, static_cast<size_t>(byte_size));
+        memset(record->data + sizeof(CaptureTexture) + byte_size, 0, data_size - static_cast<Uint32>(byte_size));
+    }
+
+    add_record(d, record);
+    return true;
+}
+
+void CaptureDevice::destroy_texture(kai::RenderTexture &texture) {
+    CaptureDeviceData *d = static_cast<CaptureDeviceData *>(data);
+    remove_record(d, get_record_key(texture.handle, CaptureRecordType::texture));
+    d->device->destroy_texture(texture);
+}
+
+bool CaptureDevice::update_texture(const kai::RenderTexture &texture, Uint32 x, Uint32 y, Uint32 width, Uint32 height,
+                                   const void *contents) const {
+    CaptureDeviceData *d = static_cast<CaptureDeviceData *>(data);
+    if(!d->device->update_texture(texture, x, y, width, height, contents)) {
+        return false;
+    }
+
+    Uint64 key = get_record_key(texture.handle, CaptureRecordType::texture);
+    CaptureRecord *record = *find_slot(d, key);
+    if(!record) {
+        return true;
+    }
+
+    // Like update_buffer(), the record keeps the whole texture up to date
+    CaptureTexture *t = reinterpret_cast<CaptureTexture *>(record->data);
+    Uint32 pixel_size = kai::get_format_size(static_cast<kai::RenderFormat>(t->format));
+    Uint32 byte_size = static_cast<Uint32>(kai::get_texture_size(static_cast<kai::RenderFormat>(t->format), t->width,
+                                                                 t->height, t->mip_count));
+
+    if(!t->has_data) {
+        Uint32 data_size = pad_to_4(byte_size);
+        CaptureRecord *with_data = create_record(texture.handle, sizeof(CaptureTexture) + data_size, CaptureRecordType::texture);
+        if(!with_data) {
+            return true;
+        }
+
+        with_data->capture_index = record->capture_index;
+        with_data->capture_generation = record->capture_generation;
+        memcpy(with_data->data, record->data, sizeof(CaptureTexture));
+        memset(with_data->data + sizeof(CaptureTexture), 0, data_size);
+
+        remove_record(d, key);
+        add_record(d, with_data);
+
+        record = with_data;
+        t = reinterpret_cast<CaptureTexture *>(record->data);
+        t->has_data = 1;
+    }
+
+    // The device checked that the rectangle is made of whole blocks
+    Uint32 block_size = kai::get_format_block_size(static_cast<kai::RenderFormat>(t->format));
+    Uint32 row_size = width / block_size * pixel_size;
+    Uint32 pitch = t->width / block_size * pixel_size;
+    const Uint8 *src = static_cast<const Uint8 *>(contents);
+    Uint8 *dst = record->data + sizeof(CaptureTexture) + static_cast<size_t>(y / block_size) * pitch + x / block_size * pixel_size;
+
+    for(Uint32 row = 0; row < height / block_size; row++) {
+        memcpy(dst, src, row_size);
+        src += row_size;
+        dst += pitch;
+    }
+
+    return true;
+}
+
+static void capture_command_buffer(CaptureDeviceData *d, const ConstantRing *ring, const kai::CommandBuffer &command_buffer) {
+    d->commands.size = 0;
+    d->constants.size = 0;
+
+    Uint32 command_count = 0;
+    CommandDecoder decoder(command_buffer, false);
+    CommandEncodingData command;
+
+    while(decoder.next(command)) {
+        CommandEncoding encoding = command.draw.encoding;
+        d->commands.write(&encoding, 1);
+        command_count++;
+
+        switch(encoding) {
+            case CommandEncoding::draw:
+                d->commands.write_varint(command.draw.count);
+                d->commands.write_varint(command.draw.start);
+                break;
+            case CommandEncoding::draw_indexed:
+                d->commands.write_varint(command.draw_indexed.count);
+                d->commands.write_varint(command.draw_indexed.start);
+                d->commands.write_varint(zigzag_encode(static_cast<Uint32>(command.draw_indexed.base)));
+                break;
+            case CommandEncoding::draw_instanced:
+            case CommandEncoding::draw_indexed_instanced: {
+                // Both share the layout up to the base
+                const auto c = &command.draw_indexed_instanced;
+                d->commands.write_varint(c->count);
+                d->commands.write_varint(c->start);
+                d->commands.write_varint(c->instance_count);
+                d->commands.write_varint(c->instance_stride);
+                d->commands.write_varint(c->instance_offset);
+
+                if(encoding == CommandEncoding::draw_indexed_instanced) {
+                    d->commands.write_varint(zigzag_encode(static_cast<Uint32>(c->base)));
+                }
+
+                break;
+            }
+            case CommandEncoding::set_render_pipeline: {
+                Uint32 index = get_capture_index(d, command.set_render_pipeline.pipeline, CaptureRecordType::pipeline);
+                if(index == CAPTURE_INVALID_INDEX) {
+                    abort_capture(d, "a CommandBuffer uses a pipeline that wasn't created through the capture device");
+                    return;
+                }
+
+                d->commands.write_varint(index);
+                break;
+            }
+            case CommandEncoding::bind_buffer: {
+                Uint32 index = get_capture_index(d, command.bind_buffer.buffer, CaptureRecordType::buffer);
+                if(index == CAPTURE_INVALID_INDEX) {
+                    abort_capture(d, "a CommandBuffer uses a buffer that wasn't created through the capture device");
+                    return;
+                }
+
+                d->commands.write_varint(index);
+                d->commands.write_varint(static_cast<Uint32>(command.bind_buffer.type));
+                d->commands.write_varint(static_cast<Uint32>(command.bind_buffer.shader_type));
+                break;
+            }
+            case CommandEncoding::bind_constants: {
+                // The constants are copied out of the ring, they only stay there for a few frames
+                const auto c = &command.bind_constants;
+                if(!ring || c->offset + c->size > ring->size) {
+                    abort_capture(d, "a CommandBuffer binds constants outside of the constant ring buffer");
+                    return;
+                }
+
+                d->commands.write_varint(d->constants.size);
+                d->commands.write_varint(c->size);
+                d->commands.write_varint(static_cast<Uint32>(c->shader_type));
+                d->constants.write(ring->data + c->offset, c->size);
+                break;
+            }
+            case CommandEncoding::bind_texture: {
+                Uint32 index = get_capture_index(d, command.bind_texture.texture, CaptureRecordType::texture);
+                if(index == CAPTURE_INVALID_INDEX) {
+                    abort_capture(d, "a CommandBuffer uses a texture that wasn't created through the capture device");
+                    return;
+                }
+
+                d->commands.write_varint(index);
+                d->commands.write_varint(command.bind_texture.slot);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    CaptureList list = {};
+    list.type = CaptureListType::command_buffer;
+    list.command_count = command_count;
+    list.command_size = d->commands.size;
+    list.instance_size = command_buffer.get_instance_data_size();
+    list.constant_size = d->constants.size;
+
+    if(d->commands.failed || d->constants.failed) {
+        abort_capture(d, "the frame didn't fit into memory");
+        return;
+    }
+
+    d->lists.write(&list, sizeof(list));
+    d->lists.write(d->commands.get_data(), d->commands.size);
+    d->lists.pad();
+
+    if(list.instance_size) {
+        d->lists.write(command_buffer.get_instance_data(), list.instance_size);
+        d->lists.pad();
+    }
+
+    d->lists.write(d->constants.get_data(), d->constants.size);
+    d->list_count++;
+}
+
+// -------------------------------------------------- Loading -------------------------------------------------- //
+// Reads the parts of a capture file, every read is padded to 4 bytes and fails instead of reading past the end
+struct CaptureReader {
+    const Uint8 * read(Uint32 byte_count) {
+        Uint64 padded = static_cast<Uint64>(pad_to_4(byte_count));
+        if(byte_count > 0xfffffff0 || offset + padded > size) {
+            return nullptr;
+        }
+
+        const Uint8 *out = data + offset;
+        offset += static_cast<Uint32>(padded);
+
+        return out;
+    }
+
+    template<typename T>
+    const T * read(void) {
+        return reinterpret_cast<const T *>(read(sizeof(T)));
+    }
+
+    // Null for a size of 0, fails if the string isn't null-terminated
+    bool read_string(Uint32 string_size, const char *&out_string) {
+        out_string = nullptr;
+        if(string_size == 0) {
+            return true;
+        }
+
+        const char *str = reinterpret_cast<const char *>(read(string_size));
+        if(!str || str[string_size - 1] != '\0') {
+            return false;
+        }
+
+        out_string = str;
+        return true;
+    }
+
+    const Uint8 *data;
+    Uint32 size;
+    Uint32 offset;
+};
+
+// Walks the whole file. Without tables in 'capture' it only validates it and counts the input layouts
+static bool parse_capture(CaptureReader reader, const CaptureHeader &header, Capture &capture,
+                          kai::RenderInputLayoutInfo *layouts, Uint32 &layout_count) {
+    layout_count = 0;
+    if(!reader.read<CaptureHeader>()) {
+        return false;
+    }
+
+    for(Uint32 i = 0; i < header.pipeline_count; i++) {
+        const CapturePipeline *p = reader.read<CapturePipeline>();
+        if(!p || p->topology > static_cast<Uint8>(kai::RenderPipelineInfo::TopologyType::triangle_strip)) {
+            return false;
+        }
+
+        // Bytecode isn't null-terminated, it's read as it is
+        const char *strings[4] = {};
+        const void *bytecode[2] = {};
+        const Uint8 bytecode_flags[2] = { CAPTURE_PIPELINE_VERTEX_BYTECODE, CAPTURE_PIPELINE_PIXEL_BYTECODE };
+        for(Uint32 j = 0; j < KAI_ARRAY_COUNT(bytecode); j++) {
+            if(p->flags & bytecode_flags[j]) {
+                bytecode[j] = reader.read(p->string_sizes[j * 2]);
+                if(!bytecode[j] || p->string_sizes[j * 2] == 0) {
+                    return false;
+                }
+            } else if(!reader.read_string(p->string_sizes[j * 2], strings[j * 2])) {
+                return false;
+            }
+
+            if(!reader.read_string(p->string_sizes[j * 2 + 1], strings[j * 2 + 1])) {
+                return false;
+            }
+        }
+
+        if(capture.pipelines) {
+            Capture::Pipeline *pipeline = &capture.pipelines[i];
+            kai::RenderPipelineInfo &info = pipeline->info;
+            info = kai::RenderPipelineInfo();
+            info.vertex_shader_source = strings[0];
+            info.vertex_shader_entry = strings[1];
+            info.pixel_shader_source = strings[2];
+            info.pixel_shader_entry = strings[3];
+            info.vertex_shader_bytecode = bytecode[0];
+            info.vertex_shader_bytecode_size = bytecode[0] ? p->string_sizes[0] : 0;
+            info.pixel_shader_bytecode = bytecode[1];
+            info.pixel_shader_bytecode_size = bytecode[1] ? p->string_sizes[2] : 0;
+            info.fill_mode = static_cast<kai::RenderPipelineInfo::FillMode>(p->fill_mode);
+            info.cull_mode = static_cast<kai::RenderPipelineInfo::CullMode>(p->cull_mode);
+            info.topology = static_cast<kai::RenderPipelineInfo::TopologyType>(p->topology);
+            info.color_enable = (p->flags & CAPTURE_PIPELINE_COLOR_ENABLE) != 0;
+            memcpy(info.color_clear_values, p->color_clear_values, sizeof(info.color_clear_values));
+            info.depth_enable = (p->flags & CAPTURE_PIPELINE_DEPTH_ENABLE) != 0;
+            info.depth_clear_value = p->depth_clear_value;
+            info.stencil_enable = (p->flags & CAPTURE_PIPELINE_STENCIL_ENABLE) != 0;
+            info.stencil_clear_value = p->stencil_clear_value;
+            info.front_ccw = (p->flags & CAPTURE_PIPELINE_FRONT_CCW) != 0;
+
+            pipeline->input_layouts = layouts ? layouts + layout_count : nullptr;
+            pipeline->input_layout_count = p->input_layout_count;
+        }
+
+        for(Uint32 j = 0; j < p->input_layout_count; j++) {
+            const CaptureInputLayout *l = reader.read<CaptureInputLayout>();
+            const char *name;
+
+            if(!l || !reader.read_string(l->name_size, name)) {
+                return false;
+            }
+
+            if(capture.pipelines && layouts) {
+                layouts[layout_count + j] = { name, l->index, static_cast<kai::RenderFormat>(l->format), l->offset, l->per_instance != 0 };
+            }
+        }
+
+        layout_count += p->input_layout_count;
+    }
+
+    for(Uint32 i = 0; i < header.buffer_count; i++) {
+        const CaptureBuffer *b = reader.read<CaptureBuffer>();
+        if(!b || b->type > static_cast<Uint8>(kai::RenderBufferType::constant)) {
+            return false;
+        }
+
+        const Uint8 *buffer_data = nullptr;
+        if(b->has_data && !(buffer_data = reader.read(b->byte_size))) {
+            return false;
+        }
+
+        if(capture.buffers) {
+            kai::RenderBufferInfo &info = capture.buffers[i];
+            info = kai::RenderBufferInfo();
+            info.data = buffer_data;
+            info.byte_size = b->byte_size;
+            info.stride = b->stride;
+            info.type = static_cast<kai::RenderBufferType>(b->type);
+            info.cpu_usage = static_cast<kai::RenderCPUUsage>(b->cpu_usage);
+            info.resource_usage = static_cast<kai::RenderResourceUsage>(b->resource_usage);
+        }
+    }
+
+    for(Uint32 i = 0; i < header.texture_count; i++) {
+        const CaptureTexture *t = reader.read<CaptureTexture>();
+        Uint32 pixel_size = t ? kai::get_format_size(static_cast<kai::RenderFormat>(t->format)) : 0;
+        Uint32 block_size = t ? kai::get_format_block_size(static_cast<kai::RenderFormat>(t->format)) : 1;
+        Uint64 byte_size = 0;
+
+        if(!t || !pixel_size || !t->width || !t->height || t->width % block_size || t->height % block_size || !t->mip_count || t->mip_count > KAI_TEXTURE_MAX_MIPS ||
+           t->mip_count > kai::get_mip_count(t->width, t->height) ||
+           (byte_size = kai::get_texture_size(static_cast<kai::RenderFormat>(t->format), t->width, t->height,
+                                              t->mip_count)) > 0xfffffff0) {
+            return false;
+        }
+
+        const Uint8 *texture_data = nullptr;
+        if(t->has_data && !(texture_data = reader.read(static_cast<Uint32>(byte_size)))) {
+            return false;
+        }
+
+        if(capture.textures) {
+            kai::RenderTextureInfo &info = capture.textures[i];
+            info = kai::RenderTextureInfo();
+            info.data = texture_data;
+            info.width = t->width;
+            info.height = t->height;
+            info.mip_count = t->mip_count;
+            info.format = static_cast<kai::RenderFormat>(t->format);
+            info.resource_usage = static_cast<kai::RenderResourceUsage>(t->resource_usage);
+        }
+    }
+
+    for(Uint32 i = 0; i < header.list_count; i++) {
+        const CaptureList *l = reader.read<CaptureList>();
+        if(!l || l->type > CaptureListType::set_render_pipeline ||
+           (l->type == CaptureListType::set_render_pipeline && l->pipeline >= header.pipeline_count)) {
+            return false;
+        }
+
+        Capture::List list = {};
+        list.type = l->type;
+        memcpy(list.viewport, l->viewport, sizeof(list.viewport));
+        list.pipeline = l->pipeline;
+
+        if(l->type == CaptureListType::command_buffer) {
+            list.command_count = l->command_count;
+            list.command_size = l->command_size;
+            list.instance_size = l->instance_size;
+            list.constant_size = l->constant_size;
+
+            if(!(list.commands = reader.read(l->command_size)) ||
+               !(list.instance_data = reader.read(l->instance_size)) ||
+               !(list.constants = reader.read(l->constant_size))) {
+                return false;
+            }
+        }
+
+        if(capture.lists) {
+            capture.lists[i] = list;
+        }
+    }
+
+    return true;
+}
+
+bool load_capture(const char *path, Capture &out_capture) {
+    out_capture = Capture();
+
+    kai::FileHandle file = kai::open_file(path);
+    if(!file) {
+        kai::log("Could not open the capture %s!\n", path);
+        return false;
+    }
+
+    size_t file_size = kai::get_file_size(file);
+    CaptureHeader header;
+
+    if(file_size < sizeof(CaptureHeader) || file_size > 0xfffffff0 || !kai::read_file(file, &header, sizeof(header))) {
+        kai::log("%s is not a capture file!\n", path);
+        kai::close_file(file);
+        return false;
+    }
+
+    if(header.magic != CAPTURE_MAGIC || header.version != CAPTURE_VERSION) {
+        kai::log("%s is not a capture file of version %u!\n", path, CAPTURE_VERSION);
+        kai::close_file(file);
+        return false;
+    }
+
+    // Zeroes after the end of the file, so that commands that are cut off can't be read past the memory
+    Uint64 file_memory = file_size + MAX_ENCODED_COMMAND_SIZE;
+    kai::align_to_pow2<Uint64>(file_memory, 16);
+
+    kai::ArenaAllocator memory(file_memory);
+    Uint8 *file_data = static_cast<Uint8 *>(memory.get_buffer());
+
+    kai::rewind_file(file);
+    bool read = file_data && kai::read_file(file, file_data);
+    kai::close_file(file);
+
+    if(!read) {
+        kai::log("Could not read the capture %s!\n", path);
+        memory.destroy();
+        return false;
+    }
+
+    memset(file_data + file_size, 0, static_cast<size_t>(file_memory - file_size));
+
+    CaptureReader reader = { file_data, static_cast<Uint32>(file_size), 0 };
+    Uint32 layout_count;
+
+    if(!parse_capture(reader, header, out_capture, nullptr, layout_count)) {
+        kai::log("The capture %s is corrupted!\n", path);
+        memory.destroy();
+        return false;
+    }
+
+    // The tables point into the file, they're allocated behind it in a second pass
+    Uint64 pipelines_size = static_cast<Uint64>(header.pipeline_count) * sizeof(Capture::Pipeline);
+    Uint64 layouts_size = static_cast<Uint64>(layout_count) * sizeof(kai::RenderInputLayoutInfo);
+    Uint64 buffers_size = static_cast<Uint64>(header.buffer_count) * sizeof(kai::RenderBufferInfo);
+    Uint64 textures_size = static_cast<Uint64>(header.texture_count) * sizeof(kai::RenderTextureInfo);
+    Uint64 lists_size = static_cast<Uint64>(header.list_count) * sizeof(Capture::List);
+
+    kai::ArenaAllocator tables(pipelines_size + layouts_size + buffers_size + textures_size + lists_size + 8);
+    Uint8 *table_data = static_cast<Uint8 *>(tables.get_buffer());
+
+    if(!table_data) {
+        kai::log("Not enough memory to load the capture %s!\n", path);
+        memory.destroy();
+        return false;
+    }
+
+    // Every table is a multiple of 8 bytes, so they stay aligned
+    kai::RenderInputLayoutInfo *layouts = reinterpret_cast<kai::RenderInputLayoutInfo *>(table_data + pipelines_size);
+    out_capture.pipelines = reinterpret_cast<Capture::Pipeline *>(table_data);
+    out_capture.buffers = reinterpret_cast<kai::RenderBufferInfo *>(table_data + pipelines_size + layouts_size);
+    out_capture.textures = reinterpret_cast<kai::RenderTextureInfo *>(table_data + pipelines_size + layouts_size + buffers_size);
+    out_capture.lists = reinterpret_cast<Capture::List *>(table_data + pipelines_size + layouts_size + buffers_size + textures_size);
+
+    parse_capture(reader, header, out_capture, layouts, layout_count);
+
+    out_capture.memory = memory;
+    out_capture.tables = tables;
+    out_capture.file_size = static_cast<Uint32>(file_size);
+    out_capture.pipeline_count = header.pipeline_count;
+    out_capture.buffer_count = header.buffer_count;
+    out_capture.texture_count = header.texture_count;
+    out_capture.list_count = header.list_count;
+    memcpy(out_capture.viewport, header.viewport, sizeof(out_capture.viewport));
+
+    return true;
+}
+
+void destroy_capture(Capture &capture) {
+    capture.tables.destroy();
+    capture.memory.destroy();
+    capture = Capture();
+}
+
+void read_capture_command(const Uint8 *&stream, CaptureCommand &out_command) {
+    CommandEncoding encoding = static_cast<CommandEncoding>(*stream++);
+    CommandEncodingData &command = out_command.data;
+    out_command.resource = 0;
+
+    switch(encoding) {
+        case CommandEncoding::draw:
+            command.draw.encoding = encoding;
+            command.draw.count = read_varint(stream);
+            command.draw.start = read_varint(stream);
+            break;
+        case CommandEncoding::draw_indexed:
+            command.draw_indexed.encoding = encoding;
+            command.draw_indexed.count = read_varint(stream);
+            command.draw_indexed.start = read_varint(stream);
+            command.draw_indexed.base = static_cast<Int32>(zigzag_decode(read_varint(stream)));
+            break;
+        case CommandEncoding::draw_instanced:
+        case CommandEncoding::draw_indexed_instanced: {
+            auto c = &command.draw_indexed_instanced;
+            c->encoding = encoding;
+            c->count = read_varint(stream);
+            c->start = read_varint(stream);
+            c->instance_count = read_varint(stream);
+            c->instance_stride = read_varint(stream);
+            c->instance_offset = read_varint(stream);
+            c->base = (encoding == CommandEncoding::draw_indexed_instanced) ?
+                      static_cast<Int32>(zigzag_decode(read_varint(stream))) : 0;
+            break;
+        }
+        case CommandEncoding::set_render_pipeline:
+            command.set_render_pipeline = { encoding, 0 };
+            out_command.resource = read_varint(stream);
+            break;
+        case CommandEncoding::bind_buffer: {
+            out_command.resource = read_varint(stream);
+            Uint32 type = read_varint(stream);
+            Uint32 shader_type = read_varint(stream);
+            command.bind_buffer = {
+                encoding, 0, static_cast<kai::RenderBufferType>(type), static_cast<kai::ShaderType>(shader_type)
+            };
+            break;
+        }
+        case CommandEncoding::bind_constants: {
+            Uint32 offset = read_varint(stream);
+            Uint32 size = read_varint(stream);
+            Uint32 shader_type = read_varint(stream);
+            command.bind_constants = { encoding, offset, size, static_cast<kai::ShaderType>(shader_type) };
+            break;
+        }
+        case CommandEncoding::bind_texture:
+            out_command.resource = read_varint(stream);
+            command.bind_texture = { encoding, 0, read_varint(stream) };
+            break;
+        default:
+            command.draw.encoding = encoding;
+            break;
+    }
+}
@@ -6,24 +6,195 @@
 #ifndef KAI_RENDER_INTERNAL_H
 #define KAI_RENDER_INTERNAL_H
 
+#include <stddef.h>
+
+#include <atomic>
+
+#include "includes/alloc.h"
 #include "includes/render.h"
 #include "includes/types.h"
+#include "sync_internal.h"
 
-void init_renderer(kai::RenderingBackend backend, const Uint32 *device_id = nullptr);
+// With 'capture' the device is wrapped into one that can capture frames, see capture_internal.h
+void init_renderer(kai::RenderingBackend backend, const Uint32 *device_id = nullptr, Bool32 capture = false);
 void destroy_renderer(void);
 
-enum class CommandEncoding : Uint32 {
+#define COMMAND_CHUNK_SIZE static_cast<Uint32>(kai::kibibytes(16))
+#define COMMAND_CHUNK_DATA_SIZE (COMMAND_CHUNK_SIZE - static_cast<Uint32>(offsetof(CommandChunk, data)))
+
+// A piece of a CommandBuffer's command stream, CommandBuffers are linked lists of them
+struct CommandChunk {
+    CommandChunk *next;
+    kai::ArenaAllocator arena; // The memory of the chunk itself
+    Uint32 used;
+    Uint8 KAI_FLEXIBLE_ARRAY(data);
+};
+
+// Frees the chunks of all destroyed CommandBuffers
+void destroy_command_chunk_pool(void);
+
+#define CONSTANT_RING_SIZE static_cast<Uint32>(kai::mebibytes(4))
+#define CONSTANT_RING_ALIGNMENT 256 // Offsets into constant buffers are in multiples of 16 constants of 16 bytes
+#define FRAMES_IN_FLIGHT 3 // Including the one that is being recorded
+
+// The CPU side of the constant ring buffer. Slices are handed out with an atomic bump of 'head', which only ever
+// grows, the offset into the ring is 'head' modulo its size. A slice never wraps around the end of the ring.
+// Backends upload everything that was written since the last upload before they execute a CommandBuffer and
+// call next_frame() on present, once they have waited for the GPU to finish the frame that goes out of flight.
+// The ring can only be written up to where the oldest frame that might still be in flight starts.
+struct ConstantRing {
+    // Returns the ranges that were allocated since the last call, there are two if the allocations wrapped around
+    Uint32 get_pending_uploads(Uint32 offsets[2], Uint32 sizes[2]);
+    void next_frame(void);
+
+    Uint8 *data;
+    kai::ArenaAllocator arena; // The memory of the ring itself
+    Uint32 size;
+
+    std::atomic<Uint64> head;
+    Uint64 limit;
+    Uint64 uploaded;
+
+    Uint64 frame_starts[FRAMES_IN_FLIGHT];
+    Uint32 frame;
+};
+
+ConstantRing * create_constant_ring(Uint32 bytes);
+void destroy_constant_ring(ConstantRing *ring);
+
+// The resources that were passed to destroy_buffer_deferred(), destroy_render_pipeline_deferred() and
+// destroy_texture_deferred(), in one bucket per frame in flight. Every present() swaps out the bucket of the
+// frame that just went out of flight under the lock and destroys its resources after, so queueing from other
+// threads never waits on the backend. Queueing in a frame lands in the bucket that gets retired
+// FRAMES_IN_FLIGHT presents later
+struct RetireQueue {
+    enum class Type : Uint32 {
+        buffer,
+        pipeline,
+        texture
+    };
+
+    struct Entry {
+        Uint32 handle;
+        Type type;
+    };
+
+    struct Bucket {
+        kai::StackAllocator memory;
+        Entry *entries = nullptr;
+        Uint32 count = 0;
+        Uint32 capacity = 0;
+    };
+
+    Bucket buckets[FRAMES_IN_FLIGHT];
+    Bucket retiring; // Only touched by present(), keeps its memory to be swapped in again
+    Uint32 frame = 0; // The number of presents so far
+    SpinLock lock;
+
+    kai::ArenaAllocator arena; // The memory of the queue itself
+};
+
+RetireQueue * create_retire_queue(void);
+
+// Destroys everything that is still queued, so the device needs to be idle, then frees the queue
+void destroy_retire_queue(kai::RenderDevice *device, RetireQueue *queue);
+
+// RenderPipelines, RenderBuffers and RenderTextures are 32-bit handles into a RenderHandleTable of the backend. The low
+// RENDER_HANDLE_INDEX_BITS are the index of a slot in the table, the rest is the generation that the slot had
+// when the handle was made. Freeing a slot bumps its generation, so a handle to a destroyed resource stops
+// resolving, even once the slot is reused. Generations start at 1, which makes a handle of 0 always null.
+// The slots are a dense array that only grows, freed slots are reused first. A table isn't thread-safe,
+// the backends create, destroy and execute on a single thread
+#define RENDER_HANDLE_INDEX_BITS 20
+#define RENDER_HANDLE_INDEX_MASK ((1u << RENDER_HANDLE_INDEX_BITS) - 1)
+#define RENDER_HANDLE_GENERATION_MASK (0xffffffffu >> RENDER_HANDLE_INDEX_BITS)
+
+struct RenderHandleTable {
+    void destroy(void);
+
+    // Returns 0 if the table is full
+    Uint32 add(void *object);
+
+    // Frees the slot of the handle and returns its object, null if the handle was already stale
+    void * remove(Uint32 handle);
+
+    // Null for a null or stale handle
+    KAI_FORCEINLINE void * get(Uint32 handle) const {
+        Uint32 index = handle & RENDER_HANDLE_INDEX_MASK;
+        if(index >= used || slots[index].generation != (handle >> RENDER_HANDLE_INDEX_BITS)) {
+            return nullptr;
+        }
+
+        return slots[index].object;
+    }
+
+    Uint32 get_count(void) const {
+        return count;
+    }
+
+    struct Slot {
+        void *object;
+        Uint32 generation; // The one of the handle that currently resolves to 'object'
+        Uint32 next_free; // Index + 1 of the next free slot, only for free slots
+    };
+
+    kai::StackAllocator memory;
+    Slot *slots = nullptr;
+    Uint32 capacity = 0;
+    Uint32 used = 0; // Slots that were handed out at least once
+    Uint32 count = 0;
+    Uint32 free_list = 0; // Index + 1 of the first free slot, 0 if there's none
+};
+
+enum class CommandEncoding : Uint8 {
     draw,
     draw_indexed,
+    set_render_pipeline,
     bind_buffer,
     clear_color,
     clear_depth,
     clear_stencil,
     clear_depth_stencil,
+    draw_instanced,
+    draw_indexed_instanced,
+    bind_constants,
+    bind_texture,
 
     end
 };
 
+// Commands are stored as an 8-bit opcode, followed by a variable number of LEB128 varint operands.
+// The low 4 bits of the opcode are the CommandEncoding, the high 4 bits are command specific flags:
+//
+//   draw, draw_indexed:   [count] [start] [base] (draw_indexed only)
+//                         Every operand is left out if the flags say that it can be derived from the previous
+//                         draw of the same kind, start and base are zigzag encoded deltas to it otherwise
+//   set_render_pipeline:  [handle index] [handle generation]
+//   bind_buffer:          [handle index] [handle generation], the flags hold the RenderBufferType and ShaderType
+//                         The generation is left out if it's 1, which it is for every slot that was never reused
+//   bind_constants:       [offset / CONSTANT_RING_ALIGNMENT] [size / 16], the flags hold the ShaderType
+//   bind_texture:         [handle index] [handle generation], the flags hold the slot
+//   draw_instanced, draw_indexed_instanced:
+//                         [count] [instance count] [start] [base] (draw_indexed_instanced only, zigzag encoded)
+//                         [instance stride] [instance offset] (only for a non-zero stride)
+//                         The offset is left out if the instance data directly follows the one of the previous
+//                         instanced draw, which is the case for all draws created by auto-instancing
+//   clears and end:       no operands
+//
+// Pipelines and buffers are stored as their handles, so recording never touches anything but the CommandBuffer
+// and the backend resolves the handles while executing. CommandEncodingData is the decoded form of a command.
+#define COMMAND_ENCODING_MASK 0x0f
+#define COMMAND_FLAG_SAME_COUNT 0x10
+#define COMMAND_FLAG_SAME_START 0x20
+#define COMMAND_FLAG_CONTINUES 0x40 // Starts where the previous draw of the same kind ended
+#define COMMAND_FLAG_SAME_BASE 0x80
+#define COMMAND_BIND_TYPE_SHIFT 4 // 2 bits
+#define COMMAND_BIND_SHADER_SHIFT 6 // 1 bit
+#define COMMAND_BIND_SLOT_SHIFT 4 // 2 bits, of bind_texture
+#define COMMAND_FLAG_FIRST_GENERATION 0x80 // Of set_render_pipeline, bind_buffer and bind_texture
+
+#define MAX_ENCODED_COMMAND_SIZE 32 // Opcode + 6 varints of up to 5 bytes each
+
 #define COMMAND_DEFAULT_MEMBERS \
     CommandEncoding encoding
 
@@ -41,14 +212,89 @@ union CommandEncodingData {
         Int32 base;
     } draw_indexed;
 
+    // The instance data is at 'instance_offset' bytes into the CommandBuffer's instance data, a stride of
+    // zero means that the draw doesn't have any. Both instanced draws share the layout up to the base
+    struct DrawInstanced {
+        COMMAND_DEFAULT_MEMBERS;
+        Uint32 count;
+        Uint32 start;
+        Uint32 instance_count;
+        Uint32 instance_stride;
+        Uint32 instance_offset;
+    } draw_instanced;
+
+    struct DrawIndexedInstanced {
+        COMMAND_DEFAULT_MEMBERS;
+        Uint32 count;
+        Uint32 start;
+        Uint32 instance_count;
+        Uint32 instance_stride;
+        Uint32 instance_offset;
+        Int32 base;
+    } draw_indexed_instanced;
+
+    struct SetRenderPipeline {
+        COMMAND_DEFAULT_MEMBERS;
+        Uint32 pipeline; // The handle, the union can't hold a kai::RenderPipeline
+    } set_render_pipeline;
+
     struct BindBuffer {
         COMMAND_DEFAULT_MEMBERS;
-        kai::RenderBuffer *buffer;
+        Uint32 buffer; // The handle
         kai::RenderBufferType type;
         kai::ShaderType shader_type;
     } bind_buffer;
+
+    // The offset and size are in bytes into the RenderDevice's constant ring buffer
+    struct BindConstants {
+        COMMAND_DEFAULT_MEMBERS;
+        Uint32 offset;
+        Uint32 size;
+        kai::ShaderType shader_type;
+    } bind_constants;
+
+    struct BindTexture {
+        COMMAND_DEFAULT_MEMBERS;
+        Uint32 texture; // The handle
+        Uint32 slot;
+    } bind_texture;
 };
 
 #undef COMMAND_DEFAULT_MEMBERS
 
+// Decodes the commands of a CommandBuffer one at a time, independent of the backend. Adjacent draws
+// of the same kind whose ranges continue each other are merged into a single draw, as long as the
+// topology of the active pipeline allows it and every one of them is made of whole primitives. Backends
+// need to call set_merge_draws() whenever they execute a set_render_pipeline command. The 'merge' of the
+// constructor merges regardless of the primitives until then.
+struct CommandDecoder {
+    CommandDecoder(const kai::CommandBuffer &command_buffer, Bool32 merge);
+
+    // Returns false once the end of the CommandBuffer has been reached
+    bool next(CommandEncodingData &command);
+
+    void set_merge_draws(kai::RenderPipelineInfo::TopologyType topology);
+
+    Uint32 merged_draw_count = 0;
+
+private:
+    Uint8 peek(void);
+    void decode(CommandEncodingData &command);
+
+    const CommandChunk *chunk;
+    const Uint8 *stream = nullptr;
+    const Uint8 *chunk_end = nullptr;
+    Uint32 merge_vertices; // Per primitive, 0 if draws aren't merged
+
+    // A draw that continued the previous one but couldn't be merged with it, it's returned by the next call
+    CommandEncodingData pending;
+    Bool32 has_pending = false;
+
+    // The previous draw and draw_indexed, the encoding is relative to them
+    Uint32 last_draw_start[2] = {};
+    Uint32 last_draw_count[2] = {};
+    Int32 last_draw_base = 0;
+    Uint32 last_instance_end = 0;
+};
+
 #endif /* KAI_RENDER_INTERNAL_H */
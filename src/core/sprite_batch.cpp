@@ -0,0 +1,357 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "includes/kai.h"
+#include "includes/sprite_batch.h"
+
+static const char *sprite_shader_source =
+    "cbuffer Constants : register(b0) { float4x4 view_projection; };\n"
+    "Texture2D sprite_texture : register(t0);\n"
+    "SamplerState sprite_sampler : register(s0);\n"
+    "struct VSInput { float2 position : POSITION; float2 uv : TEXCOORD; float4 color : COLOR; };\n"
+    "struct VSOutput { float4 position : SV_POSITION; float2 uv : TEXCOORD; float4 color : COLOR; };\n"
+    "VSOutput vs_main(VSInput input) {\n"
+    "    VSOutput output;\n"
+    "    output.position = mul(view_projection, float4(input.position, 0.0f, 1.0f));\n"
+    "    output.uv = input.uv;\n"
+    "    output.color = input.color;\n"
+    "    return output;\n"
+    "}\n"
+    "float4 ps_main(VSOutput input) : SV_TARGET {\n"
+    "    float4 color = sprite_texture.Sample(sprite_sampler, input.uv) * input.color;\n"
+    "    clip(color.a - 0.5f);\n"
+    "    return color;\n"
+    "}\n";
+
+// Every sprite has a 64-bit sort entry, from the top: its layer, the handle of its texture and its index.
+// Sorting the entries groups the sprites by layer and texture, the texture of a run is read back from them
+#define SPRITE_SORT_LAYER_SHIFT 56
+#define SPRITE_SORT_TEXTURE_SHIFT 24
+#define SPRITE_SORT_INDEX_MASK 0xffffff
+#define SPRITE_SORT_FIRST_DIGIT 3 // The digits below it only hold the index
+#define SPRITE_MAX_COUNT (SPRITE_SORT_INDEX_MASK + 1)
+
+// Stable LSD radix sort over the 8-bit digits of the layer and texture, like the one of the sorted CommandBuffers.
+// Only the digits with a bit in 'varying_bits' are sorted, a single layer or a handful of textures leave most
+// of them the same for every sprite. Returns either 'entries' or 'scratch', depending on where the result ended up
+static Uint64 * sort_sprites(Uint64 *entries, Uint64 *scratch, Uint32 count, Uint64 varying_bits) {
+    Uint32 digits[8];
+    Uint32 digit_count = 0;
+    for(Uint32 digit = SPRITE_SORT_FIRST_DIGIT; digit < 8; digit++) {
+        if((varying_bits >> (digit * 8)) & 0xff) {
+            digits[digit_count++] = digit;
+        }
+    }
+
+    Uint32 histograms[8][256] = {};
+    for(Uint32 i = 0; i < count; i++) {
+        Uint64 entry = entries[i];
+        for(Uint32 d = 0; d < digit_count; d++) {
+            histograms[d][(entry >> (digits[d] * 8)) & 0xff]++;
+        }
+    }
+
+    for(Uint32 d = 0; d < digit_count; d++) {
+        Uint32 *histogram = histograms[d];
+        Uint32 shift = digits[d] * 8;
+
+        Uint32 offset = 0;
+        for(Uint32 i = 0; i < 256; i++) {
+            Uint32 c = histogram[i];
+            histogram[i] = offset;
+            offset += c;
+        }
+
+        for(Uint32 i = 0; i < count; i++) {
+            scratch[histogram[(entries[i] >> shift) & 0xff]++] = entries[i];
+        }
+
+        Uint64 *temp = entries;
+        entries = scratch;
+        scratch = temp;
+    }
+
+    return entries;
+}
+
+static KAI_FORCEINLINE Uint32 get_sort_texture(Uint64 entry) {
+    return static_cast<Uint32>(entry >> SPRITE_SORT_TEXTURE_SHIFT);
+}
+
+// Writes the two triangles of every quad in 'order', a null order writes them in the order of the quads
+template<typename T>
+static void write_quad_indices(T *indices, const Uint64 *order, Uint32 quad_count) {
+    for(Uint32 i = 0; i < quad_count; i++) {
+        Uint32 quad = order ? static_cast<Uint32>(order[i] & SPRITE_SORT_INDEX_MASK) : i;
+        T first = static_cast<T>(quad * 4);
+        T *out = indices + i * 6;
+
+        out[0] = first;
+        out[1] = static_cast<T>(first + 1);
+        out[2] = static_cast<T>(first + 2);
+        out[3] = first;
+        out[4] = static_cast<T>(first + 2);
+        out[5] = static_cast<T>(first + 3);
+    }
+}
+
+kai::SpriteBatch::SpriteBatch(RenderDevice *render_device, Uint32 max_sprites) {
+    kai::clamp(max_sprites, 1u, static_cast<Uint32>(SPRITE_MAX_COUNT));
+
+    small_indices = max_sprites * 4 <= 0x10000;
+    Uint32 index_size = static_cast<Uint32>(small_indices ? sizeof(Uint16) : sizeof(Uint32));
+
+    size_t entries_size = static_cast<size_t>(max_sprites) * 2 * sizeof(Uint64);
+    size_t vertices_size = static_cast<size_t>(max_sprites) * 4 * sizeof(SpriteVertex);
+    size_t indices_size = static_cast<size_t>(max_sprites) * 6 * index_size;
+
+    memory = ArenaAllocator(entries_size + vertices_size + indices_size);
+    if(!memory.get_buffer()) {
+        kai::log("Could not allocate %u sprites!\n", max_sprites);
+        return;
+    }
+
+    Uint8 *buffer = static_cast<Uint8 *>(memory.get_buffer());
+    void *sprite_indices = buffer + entries_size + vertices_size;
+
+    if(small_indices) {
+        write_quad_indices(static_cast<Uint16 *>(sprite_indices), nullptr, max_sprites);
+    } else {
+        write_quad_indices(static_cast<Uint32 *>(sprite_indices), nullptr, max_sprites);
+    }
+
+    RenderBufferInfo buffer_info = {};
+    buffer_info.data = sprite_indices;
+    buffer_info.byte_size = indices_size;
+    buffer_info.stride = index_size;
+    buffer_info.type = RenderBufferType::index;
+
+    bool created = render_device->create_buffer(buffer_info, index_buffer);
+
+    // Sprites that were added out of order are drawn through indices in the sorted order instead
+    buffer_info.data = nullptr;
+    buffer_info.cpu_usage = RenderCPUUsage::write;
+    buffer_info.resource_usage = RenderResourceUsage::cpu_w_gpu_r;
+    created = created && render_device->create_buffer(buffer_info, sorted_index_buffer);
+
+    buffer_info = {};
+    buffer_info.byte_size = vertices_size;
+    buffer_info.stride = sizeof(SpriteVertex);
+    buffer_info.type = RenderBufferType::vertex;
+    buffer_info.cpu_usage = RenderCPUUsage::write;
+    buffer_info.resource_usage = RenderResourceUsage::cpu_w_gpu_r;
+    created = created && render_device->create_buffer(buffer_info, vertex_buffer);
+
+    const Uint32 white = 0xffffffff;
+
+    RenderTextureInfo texture_info = {};
+    texture_info.data = &white;
+    texture_info.width = 1;
+    texture_info.height = 1;
+    created = created && render_device->create_texture(texture_info, white_texture);
+
+    RenderPipelineInfo pipeline_info = {};
+    pipeline_info.vertex_shader_source = sprite_shader_source;
+    pipeline_info.vertex_shader_entry = "vs_main";
+    pipeline_info.pixel_shader_source = sprite_shader_source;
+    pipeline_info.pixel_shader_entry = "ps_main";
+    pipeline_info.cull_mode = RenderPipelineInfo::CullMode::none;
+    pipeline_info.front_ccw = false;
+
+    const RenderInputLayoutInfo input_layouts[] = {
+        { "POSITION", 0, RenderFormat::rg_f32, offsetof(SpriteVertex, position) },
+        { "TEXCOORD", 0, RenderFormat::rg_f32, offsetof(SpriteVertex, uv) },
+        { "COLOR", 0, RenderFormat::rgba_unorm8, offsetof(SpriteVertex, color) }
+    };
+
+    created = created && render_device->create_render_pipeline(pipeline_info, input_layouts,
+                                                                KAI_ARRAY_COUNT(input_layouts), pipeline);
+
+    if(!created) {
+        kai::log("Could not create the render resources for the sprites!\n");
+
+        RenderBuffer *buffers[] = { &index_buffer, &sorted_index_buffer, &vertex_buffer };
+        for(RenderBuffer *b : buffers) {
+            if(b->handle) {
+                render_device->destroy_buffer(*b);
+            }
+        }
+
+        if(white_texture.handle) {
+            render_device->destroy_texture(white_texture);
+        }
+
+        memory.destroy();
+        *this = SpriteBatch();
+        return;
+    }
+
+    device = render_device;
+    entries = reinterpret_cast<Uint64 *>(buffer);
+    vertices = reinterpret_cast<SpriteVertex *>(buffer + entries_size);
+    indices = sprite_indices;
+    capacity = max_sprites;
+
+    begin();
+}
+
+void kai::SpriteBatch::destroy(void) {
+    if(device) {
+        // The last frame may still be drawing them
+        device->destroy_buffer_deferred(vertex_buffer);
+        device->destroy_buffer_deferred(index_buffer);
+        device->destroy_buffer_deferred(sorted_index_buffer);
+        device->destroy_texture_deferred(white_texture);
+        device->destroy_render_pipeline_deferred(pipeline);
+    }
+
+    memory.destroy();
+
+    *this = SpriteBatch();
+}
+
+void kai::SpriteBatch::begin(void) {
+    sprite_count = 0;
+    dropped_count = 0;
+    unsorted = false;
+    varying_bits = 0;
+}
+
+void kai::SpriteBatch::add(const Sprite &sprite) {
+    if(sprite_count == capacity) {
+        dropped_count++;
+        return;
+    }
+
+    Float32 c = 1.0f;
+    Float32 s = 0.0f;
+    if(sprite.rotation != 0.0f) {
+        kai::sine_cosine<Precision::fast>(sprite.rotation, s, c);
+    }
+
+    // The edges that leave the corner at the min uv towards max u and max v
+    Float32 ux = c * sprite.size.x;
+    Float32 uy = s * sprite.size.x;
+    Float32 vx = -s * sprite.size.y;
+    Float32 vy = c * sprite.size.y;
+
+    Float32 corner_x = sprite.position.x - sprite.origin.x * ux - sprite.origin.y * vx;
+    Float32 corner_y = sprite.position.y - sprite.origin.x * uy - sprite.origin.y * vy;
+
+    // The corners go around the quad from the min uv, which is what the indices expect
+    const __m128 weights_u = _mm_setr_ps(0.0f, 1.0f, 1.0f, 0.0f);
+    const __m128 weights_v = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+
+    __m128 xs = _mm_add_ps(_mm_set1_ps(corner_x), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ux), weights_u),
+                                                             _mm_mul_ps(_mm_set1_ps(vx), weights_v)));
+    __m128 ys = _mm_add_ps(_mm_set1_ps(corner_y), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(uy), weights_u),
+                                                             _mm_mul_ps(_mm_set1_ps(vy), weights_v)));
+
+    // u0 u1 u1 u0 and v0 v0 v1 v1
+    __m128 uv = _mm_loadu_ps(sprite.uv);
+    __m128 us = _mm_shuffle_ps(uv, uv, _MM_SHUFFLE(0, 2, 2, 0));
+    __m128 vs = _mm_shuffle_ps(uv, uv, _MM_SHUFFLE(3, 3, 1, 1));
+
+    __m128 xy01 = _mm_unpacklo_ps(xs, ys);
+    __m128 xy23 = _mm_unpackhi_ps(xs, ys);
+    __m128 uv01 = _mm_unpacklo_ps(us, vs);
+    __m128 uv23 = _mm_unpackhi_ps(us, vs);
+
+    // Position and uv of a vertex are a single store
+    SpriteVertex *out = vertices + sprite_count * 4;
+    _mm_storeu_ps(out[0].position, _mm_movelh_ps(xy01, uv01));
+    _mm_storeu_ps(out[1].position, _mm_movehl_ps(uv01, xy01));
+    _mm_storeu_ps(out[2].position, _mm_movelh_ps(xy23, uv23));
+    _mm_storeu_ps(out[3].position, _mm_movehl_ps(uv23, xy23));
+
+    out[0].color = sprite.color;
+    out[1].color = sprite.color;
+    out[2].color = sprite.color;
+    out[3].color = sprite.color;
+
+    Uint32 texture = sprite.texture.handle ? sprite.texture.handle : white_texture.handle;
+    Uint64 entry = (static_cast<Uint64>(sprite.layer) << SPRITE_SORT_LAYER_SHIFT) |
+                   (static_cast<Uint64>(texture) << SPRITE_SORT_TEXTURE_SHIFT) | sprite_count;
+
+    // Sprites that are added grouped by layer and texture don't need to be sorted
+    unsorted |= sprite_count && entry < entries[sprite_count - 1];
+    varying_bits |= sprite_count ? (entry ^ entries[0]) : 0;
+
+    entries[sprite_count++] = entry;
+}
+
+void kai::SpriteBatch::add(const Sprite *sprites, Uint32 count) {
+    for(Uint32 i = 0; i < count; i++) {
+        add(sprites[i]);
+    }
+}
+
+void kai::SpriteBatch::end(CommandBuffer &command_buffer, const Mat4x4 &view_projection) {
+    draw_count = 0;
+
+    if(!sprite_count) {
+        return;
+    }
+
+    ConstantSlice constants;
+    if(!device->allocate_constants(sizeof(Mat4x4), constants)) {
+        return;
+    }
+
+    memcpy(constants.data, view_projection.m, sizeof(Mat4x4));
+
+    if(!device->update_buffer(vertex_buffer, vertices, sprite_count * 4 * static_cast<Uint32>(sizeof(SpriteVertex)))) {
+        return;
+    }
+
+    // The vertices stay where they are, only the indices are written in the sorted order
+    const Uint64 *sorted = entries;
+    const RenderBuffer *indices_to_draw = &index_buffer;
+
+    if(unsorted) {
+        sorted = sort_sprites(entries, entries + capacity, sprite_count, varying_bits);
+        indices_to_draw = &sorted_index_buffer;
+
+        Uint32 index_bytes = sprite_count * 6;
+        if(small_indices) {
+            write_quad_indices(static_cast<Uint16 *>(indices), sorted, sprite_count);
+            index_bytes *= sizeof(Uint16);
+        } else {
+            write_quad_indices(static_cast<Uint32 *>(indices), sorted, sprite_count);
+            index_bytes *= sizeof(Uint32);
+        }
+
+        if(!device->update_buffer(sorted_index_buffer, indices, index_bytes)) {
+            return;
+        }
+    }
+
+    command_buffer.set_render_pipeline(pipeline);
+    command_buffer.bind_buffer(vertex_buffer, RenderBufferType::vertex);
+    command_buffer.bind_buffer(*indices_to_draw, RenderBufferType::index);
+    command_buffer.bind_constants(constants);
+
+    // Layers only decide the order, a run of the same texture carries on across them
+    Uint32 run_start = 0;
+    Uint32 run_texture = get_sort_texture(sorted[0]);
+
+    for(Uint32 i = 1; i <= sprite_count; i++) {
+        if(i < sprite_count && get_sort_texture(sorted[i]) == run_texture) {
+            continue;
+        }
+
+        command_buffer.bind_texture({ run_texture });
+        command_buffer.draw_indexed((i - run_start) * 6, run_start * 6);
+        draw_count++;
+
+        if(i < sprite_count) {
+            run_start = i;
+            run_texture = get_sort_texture(sorted[i]);
+        }
+    }
+}
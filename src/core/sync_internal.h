@@ -0,0 +1,46 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_SYNC_INTERNAL_H
+#define KAI_SYNC_INTERNAL_H
+
+#include <atomic>
+
+#include "includes/types.h"
+#include "includes/utils.h"
+
+// Only meant for very short critical sections, e.g. taking an element out of a free list
+struct SpinLock {
+    void lock(void) {
+        while(flag.test_and_set(std::memory_order_acquire)) {
+        }
+    }
+
+    void unlock(void) {
+        flag.clear(std::memory_order_release);
+    }
+
+private:
+    std::atomic_flag flag = ATOMIC_FLAG_INIT;
+};
+
+// Locks the SpinLock for the rest of the scope
+struct ScopedSpinLock {
+    explicit ScopedSpinLock(SpinLock &spin_lock) : lock(spin_lock) {
+        lock.lock();
+    }
+
+    ~ScopedSpinLock(void) {
+        lock.unlock();
+    }
+
+    ScopedSpinLock(const ScopedSpinLock &) = delete;
+    ScopedSpinLock & operator=(const ScopedSpinLock &) = delete;
+
+private:
+    SpinLock &lock;
+};
+
+#endif /* KAI_SYNC_INTERNAL_H */
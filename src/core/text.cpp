@@ -0,0 +1,507 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "includes/kai.h"
+#include "includes/text.h"
+
+#include "../asset/font.h"
+
+static const char *text_shader_source =
+    "cbuffer Constants : register(b0) { float4x4 view_projection; };\n"
+    "Texture2D glyph_atlas : register(t0);\n"
+    "SamplerState atlas_sampler : register(s0);\n"
+    "struct VSInput { float2 position : POSITION; float2 uv : TEXCOORD; float4 color : COLOR; };\n"
+    "struct VSOutput { float4 position : SV_POSITION; float2 uv : TEXCOORD; float4 color : COLOR; };\n"
+    "VSOutput vs_main(VSInput input) {\n"
+    "    VSOutput output;\n"
+    "    output.position = mul(view_projection, float4(input.position, 0.0f, 1.0f));\n"
+    "    output.uv = input.uv;\n"
+    "    output.color = input.color;\n"
+    "    return output;\n"
+    "}\n"
+    "float4 ps_main(VSOutput input) : SV_TARGET {\n"
+    "    clip(glyph_atlas.Sample(atlas_sampler, input.uv).r - 0.5f);\n"
+    "    return input.color;\n"
+    "}\n";
+
+#define TEXT_NO_CELL 0xffffffff
+#define TEXT_MAX_GLYPHS (1u << 24)
+
+static KAI_FORCEINLINE const kai::FontGlyph * get_glyphs(const kai::FontHeader *font) {
+    return reinterpret_cast<const kai::FontGlyph *>(reinterpret_cast<const Uint8 *>(font) + font->glyphs.start);
+}
+
+// The glyphs are sorted by their codepoint, missing ones fall back to the default glyph. Fonts usually start with a
+// run of consecutive codepoints (like ASCII), which are found right away
+static Uint32 find_glyph(const kai::FontHeader *font, Uint32 codepoint) {
+    const kai::FontGlyph *glyphs = get_glyphs(font);
+    Uint32 count = font->glyphs.count;
+
+    // The asset manager rejects empty fonts, but a font may come from somewhere else
+    if(!count) {
+        return KAI_FONT_NO_GLYPH;
+    }
+
+    Uint32 direct = codepoint - glyphs[0].codepoint;
+    if(direct < count && glyphs[direct].codepoint == codepoint) {
+        return direct;
+    }
+
+    // Branchless, the comparisons of text can't be predicted anyway
+    Uint32 first = 0;
+    while(count > 1) {
+        Uint32 half = count / 2;
+        first = (glyphs[first + half].codepoint <= codepoint) ? first + half : first;
+        count -= half;
+    }
+
+    return (count && glyphs[first].codepoint == codepoint) ? first : font->default_glyph;
+}
+
+// Decodes the codepoint at 'text' and moves past it. A broken sequence decodes to U+FFFD and only skips its first byte,
+// that includes lead bytes that don't start a sequence of up to 4 bytes and overlong encodings, surrogates and
+// codepoints past U+10FFFF
+static Uint32 decode_utf8(const char *&text) {
+    const Uint8 *s = reinterpret_cast<const Uint8 *>(text);
+
+    if(s[0] < 0x80) {
+        text++;
+        return s[0];
+    }
+
+    // The smallest codepoint of every length, anything below it should have been encoded with fewer bytes
+    static const Uint32 min_codepoints[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+    Uint32 length = (s[0] >= 0xf8) ? 0 : (s[0] >= 0xf0) ? 4 : (s[0] >= 0xe0) ? 3 : (s[0] >= 0xc0) ? 2 : 0;
+    Uint32 codepoint = s[0] & (0x7f >> length);
+
+    for(Uint32 i = 1; i < length; i++) {
+        if((s[i] & 0xc0) != 0x80) {
+            length = 0;
+            break;
+        }
+
+        codepoint = (codepoint << 6) | (s[i] & 0x3f);
+    }
+
+    if(length == 0 || codepoint < min_codepoints[length] || codepoint > 0x10ffff || (codepoint >= 0xd800 && codepoint <= 0xdfff)) {
+        text++;
+        return 0xfffd;
+    }
+
+    text += length;
+    return codepoint;
+}
+
+static KAI_FORCEINLINE Uint32 get_cell_hash(const kai::FontHeader *font, Uint32 glyph) {
+    Uint64 key = static_cast<Uint64>(reinterpret_cast<uintptr_t>(font)) ^ (static_cast<Uint64>(glyph) << 32);
+    return static_cast<Uint32>((key * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+kai::TextBatch::TextBatch(RenderDevice *render_device, Uint32 max_glyphs, Uint32 cell_size, Uint32 atlas_width) {
+    kai::clamp(max_glyphs, 1u, TEXT_MAX_GLYPHS);
+    kai::clamp(atlas_width, 64u, 4096u);
+    kai::clamp(cell_size, 8u, atlas_width);
+
+    Uint32 per_row = atlas_width / cell_size;
+    Uint32 cell_total = per_row * per_row;
+    Uint32 table_size = 1;
+
+    while(table_size < cell_total * 2) {
+        table_size <<= 1;
+    }
+
+    size_t vertices_size = static_cast<size_t>(max_glyphs) * 4 * sizeof(GlyphVertex);
+    size_t pixels_size = static_cast<size_t>(atlas_width) * atlas_width;
+    size_t cells_size = static_cast<size_t>(cell_total) * sizeof(AtlasCell);
+    size_t table_size_bytes = static_cast<size_t>(table_size) * sizeof(Uint32);
+
+    memory = ArenaAllocator(vertices_size + cells_size + table_size_bytes + pixels_size);
+    if(!memory.get_buffer()) {
+        kai::log("Could not allocate %u glyphs!\n", max_glyphs);
+        return;
+    }
+
+    Uint8 *buffer = static_cast<Uint8 *>(memory.get_buffer());
+    GlyphVertex *glyph_vertices = reinterpret_cast<GlyphVertex *>(buffer);
+    AtlasCell *atlas_cells = reinterpret_cast<AtlasCell *>(buffer + vertices_size);
+    Uint32 *table = reinterpret_cast<Uint32 *>(buffer + vertices_size + cells_size);
+    Uint8 *pixels = buffer + vertices_size + cells_size + table_size_bytes;
+
+    // The indices are only needed to create the index buffer, so they borrow the memory of the vertices
+    bool small_indices = max_glyphs * 4 <= 0x10000;
+    Uint32 index_size = static_cast<Uint32>(small_indices ? sizeof(Uint16) : sizeof(Uint32));
+
+    for(Uint32 i = 0; i < max_glyphs; i++) {
+        Uint32 quad_indices[6] = { i * 4, i * 4 + 1, i * 4 + 2, i * 4, i * 4 + 2, i * 4 + 3 };
+        for(Uint32 j = 0; j < 6; j++) {
+            if(small_indices) {
+                reinterpret_cast<Uint16 *>(glyph_vertices)[i * 6 + j] = static_cast<Uint16>(quad_indices[j]);
+            } else {
+                reinterpret_cast<Uint32 *>(glyph_vertices)[i * 6 + j] = quad_indices[j];
+            }
+        }
+    }
+
+    RenderBufferInfo buffer_info = {};
+    buffer_info.data = glyph_vertices;
+    buffer_info.byte_size = static_cast<size_t>(max_glyphs) * 6 * index_size;
+    buffer_info.stride = index_size;
+    buffer_info.type = RenderBufferType::index;
+
+    bool created = render_device->create_buffer(buffer_info, index_buffer);
+
+    buffer_info = {};
+    buffer_info.byte_size = vertices_size;
+    buffer_info.stride = sizeof(GlyphVertex);
+    buffer_info.type = RenderBufferType::vertex;
+    buffer_info.cpu_usage = RenderCPUUsage::write;
+    buffer_info.resource_usage = RenderResourceUsage::cpu_w_gpu_r;
+    created = created && render_device->create_buffer(buffer_info, vertex_buffer);
+
+    RenderTextureInfo texture_info = {};
+    texture_info.data = pixels;
+    texture_info.width = atlas_width;
+    texture_info.height = atlas_width;
+    texture_info.format = RenderFormat::r_unorm8;
+    texture_info.resource_usage = RenderResourceUsage::cpu_w_gpu_r;
+    created = created && render_device->create_texture(texture_info, atlas);
+
+    RenderPipelineInfo pipeline_info = {};
+    pipeline_info.vertex_shader_source = text_shader_source;
+    pipeline_info.vertex_shader_entry = "vs_main";
+    pipeline_info.pixel_shader_source = text_shader_source;
+    pipeline_info.pixel_shader_entry = "ps_main";
+    pipeline_info.cull_mode = RenderPipelineInfo::CullMode::none;
+    pipeline_info.front_ccw = false;
+
+    const RenderInputLayoutInfo input_layouts[] = {
+        { "POSITION", 0, RenderFormat::rg_f32, offsetof(GlyphVertex, position) },
+        { "TEXCOORD", 0, RenderFormat::rg_f32, offsetof(GlyphVertex, uv) },
+        { "COLOR", 0, RenderFormat::rgba_unorm8, offsetof(GlyphVertex, color) }
+    };
+
+    created = created && render_device->create_render_pipeline(pipeline_info, input_layouts,
+                                                                KAI_ARRAY_COUNT(input_layouts), pipeline);
+
+    if(!created) {
+        kai::log("Could not create the render resources for the text!\n");
+
+        if(index_buffer.handle) {
+            render_device->destroy_buffer(index_buffer);
+        }
+
+        if(vertex_buffer.handle) {
+            render_device->destroy_buffer(vertex_buffer);
+        }
+
+        if(atlas.handle) {
+            render_device->destroy_texture(atlas);
+        }
+
+        memory.destroy();
+        *this = TextBatch();
+        return;
+    }
+
+    // Every cell starts out free in the LRU list, the free ones are always at its tail
+    for(Uint32 i = 0; i < cell_total; i++) {
+        atlas_cells[i] = { nullptr, 0, 0, 0, i - 1, i + 1 };
+    }
+
+    memset(table, 0xff, table_size_bytes);
+
+    device = render_device;
+    vertices = glyph_vertices;
+    atlas_pixels = pixels;
+    cells = atlas_cells;
+    cell_table = table;
+    cell_table_mask = table_size - 1;
+    cell_count = cell_total;
+    cells_per_row = per_row;
+    lru_head = 0;
+    lru_tail = cell_total - 1;
+    glyph_size = cell_size;
+    atlas_size = atlas_width;
+    capacity = max_glyphs;
+
+    begin();
+}
+
+void kai::TextBatch::destroy(void) {
+    if(device) {
+        // The last frame may still be drawing them
+        device->destroy_buffer_deferred(vertex_buffer);
+        device->destroy_buffer_deferred(index_buffer);
+        device->destroy_texture_deferred(atlas);
+        device->destroy_render_pipeline_deferred(pipeline);
+    }
+
+    memory.destroy();
+
+    *this = TextBatch();
+}
+
+void kai::TextBatch::begin(void) {
+    frame++;
+    glyph_count = 0;
+    dropped_count = 0;
+    cache_miss_count = 0;
+    eviction_count = 0;
+}
+
+void kai::TextBatch::end(CommandBuffer &command_buffer, const Mat4x4 &view_projection) {
+    draw_count = 0;
+
+    if(!device) {
+        return;
+    }
+
+    // Kept dirty if it fails, so that the next end() tries again
+    if(dirty_start != dirty_end && device->update_texture(atlas, 0, dirty_start, atlas_size, dirty_end - dirty_start,
+                                                          atlas_pixels + static_cast<size_t>(dirty_start) * atlas_size)) {
+        dirty_start = 0;
+        dirty_end = 0;
+    }
+
+    if(!glyph_count) {
+        return;
+    }
+
+    ConstantSlice constants;
+    if(!device->allocate_constants(sizeof(Mat4x4), constants)) {
+        return;
+    }
+
+    memcpy(constants.data, view_projection.m, sizeof(Mat4x4));
+
+    if(!device->update_buffer(vertex_buffer, vertices, glyph_count * 4 * static_cast<Uint32>(sizeof(GlyphVertex)))) {
+        return;
+    }
+
+    command_buffer.set_render_pipeline(pipeline);
+    command_buffer.bind_buffer(vertex_buffer, RenderBufferType::vertex);
+    command_buffer.bind_buffer(index_buffer, RenderBufferType::index);
+    command_buffer.bind_constants(constants);
+    command_buffer.bind_texture(atlas);
+    command_buffer.draw_indexed(glyph_count * 6);
+    draw_count = 1;
+}
+
+kai::Vec2 kai::TextBatch::add(const FontHeader *font, const char *text, const Vec2 &position, Float32 scale, Uint32 color) {
+    Vec2 pen = position;
+
+    if(!device || !font || !text) {
+        return pen;
+    }
+
+    const FontGlyph *glyphs = get_glyphs(font);
+    const Float32 baseline = static_cast<Float32>(font->ascent) * scale;
+    const Float32 texel = 1.0f / static_cast<Float32>(atlas_size);
+    const bool snap = !(font->flags & KAI_FONT_FLAG_SDF);
+
+    while(*text) {
+        Uint32 codepoint = decode_utf8(text);
+
+        if(codepoint == '\n') {
+            pen.x = position.x;
+            pen.y += static_cast<Float32>(font->line_height) * scale;
+            continue;
+        }
+
+        Uint32 index = find_glyph(font, codepoint);
+        if(index == KAI_FONT_NO_GLYPH) {
+            continue;
+        }
+
+        const FontGlyph &glyph = glyphs[index];
+
+        if(glyph.width && glyph.height) {
+            Uint32 cell = (glyph_count < capacity) ? get_cell(font, index) : TEXT_NO_CELL;
+
+            if(cell != TEXT_NO_CELL) {
+                Float32 x0 = pen.x + static_cast<Float32>(glyph.offset_x) * scale;
+                Float32 y0 = pen.y + baseline + static_cast<Float32>(glyph.offset_y) * scale;
+
+                // Bitmaps only stay sharp on whole pixels
+                if(snap) {
+                    x0 = floorf(x0 + 0.5f);
+                    y0 = floorf(y0 + 0.5f);
+                }
+
+                Float32 x1 = x0 + static_cast<Float32>(glyph.width) * scale;
+                Float32 y1 = y0 + static_cast<Float32>(glyph.height) * scale;
+
+                Uint32 cell_x = (cell % cells_per_row) * glyph_size;
+                Uint32 cell_y = (cell / cells_per_row) * glyph_size;
+                Float32 u0 = static_cast<Float32>(cell_x) * texel;
+                Float32 v0 = static_cast<Float32>(cell_y) * texel;
+                Float32 u1 = static_cast<Float32>(cell_x + glyph.width) * texel;
+                Float32 v1 = static_cast<Float32>(cell_y + glyph.height) * texel;
+
+                // The corners go around the quad from the top left, like the ones of the sprites
+                GlyphVertex *v = vertices + glyph_count * 4;
+                v[0] = { { x0, y0 }, { u0, v0 }, color };
+                v[1] = { { x1, y0 }, { u1, v0 }, color };
+                v[2] = { { x1, y1 }, { u1, v1 }, color };
+                v[3] = { { x0, y1 }, { u0, v1 }, color };
+                glyph_count++;
+            } else {
+                dropped_count++;
+            }
+        }
+
+        pen.x += static_cast<Float32>(glyph.advance) * scale;
+    }
+
+    return pen;
+}
+
+void kai::TextBatch::remove_font(const FontHeader *font) {
+    for(Uint32 i = 0; device && i < cell_count; i++) {
+        if(cells[i].font != font) {
+            continue;
+        }
+
+        remove_cell(i);
+        cells[i].font = nullptr;
+        cells[i].last_used = 0;
+
+        // Free cells go to the tail, so that they're the first ones to be reused
+        if(i != lru_tail) {
+            unlink_cell(i);
+            cells[i].previous = lru_tail;
+            cells[lru_tail].next = i;
+            lru_tail = i;
+        }
+    }
+}
+
+Uint32 kai::TextBatch::get_cell(const FontHeader *font, Uint32 glyph) {
+    Uint32 hash = get_cell_hash(font, glyph);
+
+    for(Uint32 slot = hash & cell_table_mask; cell_table[slot] != TEXT_NO_CELL; slot = (slot + 1) & cell_table_mask) {
+        AtlasCell &cell = cells[cell_table[slot]];
+
+        if(cell.font == font && cell.glyph == glyph) {
+            // The list is only ordered by frame, which is all that the eviction needs
+            if(cell.last_used != frame) {
+                cell.last_used = frame;
+                move_to_front(cell_table[slot]);
+            }
+
+            return cell_table[slot];
+        }
+    }
+
+    // A pixel of space is left around every glyph, so that filtering doesn't pick up its neighbors
+    const FontGlyph &g = get_glyphs(font)[glyph];
+    if(g.width >= glyph_size || g.height >= glyph_size) {
+        return TEXT_NO_CELL;
+    }
+
+    // The least recently used cell makes room, unless every cell is drawn by the current frame already
+    Uint32 index = lru_tail;
+    if(cells[index].last_used == frame) {
+        return TEXT_NO_CELL;
+    }
+
+    if(cells[index].font) {
+        remove_cell(index);
+        eviction_count++;
+    }
+
+    cells[index].font = font;
+    cells[index].glyph = glyph;
+    cells[index].hash = hash;
+    cells[index].last_used = frame;
+    move_to_front(index);
+
+    Uint32 slot = hash & cell_table_mask;
+    while(cell_table[slot] != TEXT_NO_CELL) {
+        slot = (slot + 1) & cell_table_mask;
+    }
+
+    cell_table[slot] = index;
+
+    Uint32 cell_x = (index % cells_per_row) * glyph_size;
+    Uint32 cell_y = (index / cells_per_row) * glyph_size;
+    Uint8 *out = atlas_pixels + static_cast<size_t>(cell_y) * atlas_size + cell_x;
+    const Uint8 *bitmap = reinterpret_cast<const Uint8 *>(font) + g.bitmap_start;
+
+    // The previous glyph of the cell may have been larger
+    for(Uint32 y = 0; y < glyph_size; y++) {
+        Uint8 *row = out + static_cast<size_t>(y) * atlas_size;
+
+        if(y < g.height) {
+            memcpy(row, bitmap + static_cast<size_t>(y) * g.width, g.width);
+            memset(row + g.width, 0, glyph_size - g.width);
+        } else {
+            memset(row, 0, glyph_size);
+        }
+    }
+
+    if(dirty_start == dirty_end) {
+        dirty_start = cell_y;
+        dirty_end = cell_y + glyph_size;
+    } else {
+        dirty_start = kai::min(dirty_start, cell_y);
+        dirty_end = kai::max(dirty_end, cell_y + glyph_size);
+    }
+
+    cache_miss_count++;
+    return index;
+}
+
+// Takes the cell out of the table. The entries after it move back into the hole, as long as that doesn't put them before
+// the slot that their lookups start at, so that the table never needs tombstones
+void kai::TextBatch::remove_cell(Uint32 cell) {
+    Uint32 hole = cells[cell].hash & cell_table_mask;
+    while(cell_table[hole] != cell) {
+        hole = (hole + 1) & cell_table_mask;
+    }
+
+    for(Uint32 slot = (hole + 1) & cell_table_mask; cell_table[slot] != TEXT_NO_CELL; slot = (slot + 1) & cell_table_mask) {
+        Uint32 home = cells[cell_table[slot]].hash & cell_table_mask;
+
+        if(((slot - home) & cell_table_mask) >= ((slot - hole) & cell_table_mask)) {
+            cell_table[hole] = cell_table[slot];
+            hole = slot;
+        }
+    }
+
+    cell_table[hole] = TEXT_NO_CELL;
+}
+
+void kai::TextBatch::unlink_cell(Uint32 cell) {
+    Uint32 previous = cells[cell].previous;
+    Uint32 next = cells[cell].next;
+
+    if(cell == lru_head) {
+        lru_head = next;
+    } else {
+        cells[previous].next = next;
+    }
+
+    if(cell == lru_tail) {
+        lru_tail = previous;
+    } else {
+        cells[next].previous = previous;
+    }
+}
+
+void kai::TextBatch::move_to_front(Uint32 cell) {
+    if(cell == lru_head) {
+        return;
+    }
+
+    unlink_cell(cell);
+    cells[cell].next = lru_head;
+    cells[lru_head].previous = cell;
+    lru_head = cell;
+}
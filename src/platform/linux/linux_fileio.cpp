@@ -0,0 +1,134 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "linux_fileio.h"
+
+// File handles are the file descriptor plus one, so that descriptor 0 isn't a null handle
+static KAI_FORCEINLINE int get_descriptor(kai::FileHandle file) {
+    return static_cast<int>(reinterpret_cast<intptr_t>(file) - 1);
+}
+
+static size_t get_file_size(kai::FileHandle file) {
+    KAI_ASSERT(file);
+
+    struct stat info;
+    if(fstat(get_descriptor(file), &info) != 0) {
+        return 0;
+    }
+
+    return static_cast<size_t>(info.st_size);
+}
+
+// POSIX has no sharing modes, the share flags are ignored
+kai::FileHandle kai::open_file(const char *path, FileFlags access_flags, FileFlags) {
+    int flags = 0;
+    if((access_flags & kai::FILE_READ) && (access_flags & kai::FILE_WRITE)) {
+        flags = O_RDWR;
+    } else if(access_flags & kai::FILE_WRITE) {
+        flags = O_WRONLY;
+    } else {
+        flags = O_RDONLY;
+    }
+
+    if(access_flags & kai::FILE_CREATE) {
+        flags |= O_CREAT | O_TRUNC;
+    }
+
+    int fd = open(path, flags, 0644);
+    return (fd >= 0) ? reinterpret_cast<kai::FileHandle>(static_cast<intptr_t>(fd) + 1) : nullptr;
+}
+
+void kai::close_file(kai::FileHandle file) {
+    if(file) {
+        close(get_descriptor(file));
+    }
+}
+
+size_t kai::get_file_size(kai::FileHandle file) {
+    if(file) {
+        return ::get_file_size(file);
+    }
+
+    return 0;
+}
+
+bool kai::read_file(kai::FileHandle file, void *buffer, size_t byte_count) {
+    if(file && buffer) {
+        size_t size = ::get_file_size(file);
+        if(byte_count > size) {
+            return false;
+        }
+
+        Uint8 *bytes = static_cast<Uint8 *>(buffer);
+        size_t remaining = (byte_count > 0) ? byte_count : size;
+
+        // read() may return less than what was asked for
+        while(remaining > 0) {
+            ssize_t result = read(get_descriptor(file), bytes, remaining);
+            if(result <= 0) {
+                return false;
+            }
+
+            bytes += result;
+            remaining -= static_cast<size_t>(result);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+bool kai::write_file(kai::FileHandle file, const void *buffer, size_t byte_count) {
+    if(file && buffer) {
+        const Uint8 *bytes = static_cast<const Uint8 *>(buffer);
+
+        while(byte_count > 0) {
+            ssize_t result = write(get_descriptor(file), bytes, byte_count);
+            if(result <= 0) {
+                return false;
+            }
+
+            bytes += result;
+            byte_count -= static_cast<size_t>(result);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+bool kai::read_file_at(kai::FileHandle file, void *buffer, size_t byte_count, Uint64 offset) {
+    if(file && buffer) {
+        Uint8 *bytes = static_cast<Uint8 *>(buffer);
+
+        // pread() leaves the position of the file alone, and may also return less than what was asked for
+        while(byte_count > 0) {
+            ssize_t result = pread(get_descriptor(file), bytes, byte_count, static_cast<off_t>(offset));
+            if(result <= 0) {
+                return false;
+            }
+
+            bytes += result;
+            byte_count -= static_cast<size_t>(result);
+            offset += static_cast<Uint64>(result);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void kai::rewind_file(kai::FileHandle file) {
+    if(file) {
+        lseek(get_descriptor(file), 0, SEEK_SET);
+    }
+}
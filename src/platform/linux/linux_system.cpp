@@ -0,0 +1,102 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../core/includes/system.h"
+#include "../platform.h"
+
+// Unlike VirtualFree, munmap needs to know the size of the mapping. Every mapping therefore
+// starts with an extra page that holds its size, the returned address is the page after it
+struct LinuxMappingHeader {
+    size_t bytes;
+};
+
+static KAI_FORCEINLINE int get_protection_flags(kai::PageProtection page_protection) {
+    switch(page_protection) {
+        case kai::PageProtection::execute: return PROT_EXEC;
+        case kai::PageProtection::execute_read: return PROT_EXEC | PROT_READ;
+        case kai::PageProtection::execute_read_write: return PROT_EXEC | PROT_READ | PROT_WRITE;
+        case kai::PageProtection::read: return PROT_READ;
+        case kai::PageProtection::read_write: return PROT_READ | PROT_WRITE;
+        case kai::PageProtection::no_access: case kai::PageProtection::guard: default: return PROT_NONE;
+    }
+}
+
+void * kai::virtual_alloc(void *starting_address, size_t bytes, kai::PageAllocFlags page_flags, kai::PageProtection page_protection) {
+    size_t page_size = kai::get_page_size();
+    kai::align_to_pow2(bytes, page_size);
+
+    // Committing pages of an existing reservation
+    if(!(page_flags & kai::ALLOC_RESERVE)) {
+        if(!starting_address || mprotect(starting_address, bytes, get_protection_flags(page_protection)) != 0) {
+            return nullptr;
+        }
+
+        return starting_address;
+    }
+
+    Uint8 *hint = starting_address ? static_cast<Uint8 *>(starting_address) - page_size : nullptr;
+    int protection = (page_flags & kai::ALLOC_COMMIT) ? get_protection_flags(page_protection) : PROT_NONE;
+
+    void *mapping = mmap(hint, bytes + page_size, protection, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(mapping == MAP_FAILED) {
+        return nullptr;
+    }
+
+    mprotect(mapping, page_size, PROT_READ | PROT_WRITE);
+    static_cast<LinuxMappingHeader *>(mapping)->bytes = bytes + page_size;
+
+    return static_cast<Uint8 *>(mapping) + page_size;
+}
+
+void * kai::reserve_pages(void *starting_address, size_t page_count) {
+    return kai::virtual_alloc(starting_address, kai::get_page_size() * page_count,
+                              kai::ALLOC_RESERVE, kai::PageProtection::no_access);
+}
+
+void * kai::commit_pages(void *reserved_pages, size_t page_count) {
+    return kai::virtual_alloc(reserved_pages, kai::get_page_size() * page_count,
+                              kai::ALLOC_COMMIT, kai::PageProtection::read_write);
+}
+
+void kai::decommit_pages(void *pages, size_t page_count) {
+    size_t bytes = kai::get_page_size() * page_count;
+    madvise(pages, bytes, MADV_DONTNEED);
+    mprotect(pages, bytes, PROT_NONE);
+}
+
+void kai::virtual_free(void *pages) {
+    if(pages) {
+        Uint8 *mapping = static_cast<Uint8 *>(pages) - kai::get_page_size();
+        munmap(mapping, reinterpret_cast<LinuxMappingHeader *>(mapping)->bytes);
+    }
+}
+
+size_t kai::get_page_size(void) {
+    static size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return page_size;
+}
+
+Uint64 kai::get_timestamp(void) {
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<Uint64>(time.tv_sec) * 1000000000ull + static_cast<Uint64>(time.tv_nsec);
+}
+
+Uint64 kai::get_timestamp_frequency(void) {
+    return 1000000000ull;
+}
+
+void * platform_alloc_mem_arena(size_t bytes, void *address) {
+    return kai::virtual_alloc(address, bytes, static_cast<kai::PageAllocFlags>(kai::ALLOC_RESERVE | kai::ALLOC_COMMIT),
+                              kai::PageProtection::read_write);
+}
+
+void platform_free_mem_arena(void *arena) {
+    kai::virtual_free(arena);
+}
@@ -0,0 +1,664 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#include <string.h>
+
+#include "null_renderer.h"
+#include "../platform.h"
+#include "../../core/pipeline_cache_internal.h"
+
+#define NULL_RENDER_PIPELINE_POOL_COUNT 32
+
+struct NullBufferData {
+    kai::ArenaAllocator arena; // The memory of the buffer itself
+    Uint32 byte_size;
+    Uint32 stride;
+    kai::RenderBufferType type;
+    Uint8 KAI_FLEXIBLE_ARRAY(data);
+};
+
+struct NullTextureData {
+    kai::ArenaAllocator arena; // The memory of the texture itself
+    Uint32 width;
+    Uint32 height;
+    Uint32 mip_count;
+    Uint32 byte_size;
+    kai::RenderFormat format;
+    Uint8 KAI_FLEXIBLE_ARRAY(data); // The mips from the largest to the smallest
+};
+
+struct NullRenderPipelineData {
+    kai::VertexShaderID vertex_shader;
+    kai::PixelShaderID pixel_shader;
+    kai::RenderPipelineInfo::TopologyType topology;
+    Bool32 color_enable;
+    Bool32 depth_enable;
+    Bool32 stencil_enable;
+};
+
+struct NullDeviceData {
+    NullRenderPipelineData *active_pipeline;
+    const NullBufferData *vertex_buffer;
+    const NullBufferData *index_buffer;
+    const NullTextureData *textures[KAI_TEXTURE_SLOT_COUNT];
+    Int32 viewport[4];
+
+    // What would be uploaded to the GPU: the instance data of the CommandBuffer that is being executed
+    // and the GPU side of the constant ring buffer
+    kai::StackAllocator instance_memory;
+    Uint32 instance_capacity;
+    Uint32 instance_size;
+    kai::ArenaAllocator constant_memory;
+
+    Uint64 last_present;
+};
+
+static struct {
+    NullDeviceData device;
+    Bool32 device_created;
+    Bool32 initialized;
+
+    kai::PoolAllocator pipelines_pool;
+    RenderHandleTable pipelines; // NullRenderPipelineData
+    RenderHandleTable buffers; // NullBufferData
+    RenderHandleTable textures; // NullTextureData
+} null_state;
+
+void init_null_renderer(void) {
+    if(!null_state.initialized) {
+        null_state.pipelines_pool = kai::PoolAllocator(sizeof(NullRenderPipelineData), NULL_RENDER_PIPELINE_POOL_COUNT);
+        null_state.initialized = true;
+    }
+}
+
+void destroy_null_renderer(void) {
+    null_state.pipelines.destroy();
+    null_state.buffers.destroy();
+    null_state.textures.destroy();
+    null_state.pipelines_pool.destroy();
+    null_state.initialized = false;
+}
+
+// There's only ever a single null device, it doesn't stand for any hardware
+kai::RenderDevice * null_renderer_init_device(kai::StackAllocator &allocator) {
+    if(null_state.device_created) {
+        kai::log("Only one null render device can exist at a time!\n");
+        return nullptr;
+    }
+
+    kai::StackMarker marker;
+    NullRenderer *device = allocator.alloc<NullRenderer, NullRenderer>(&marker);
+
+    if(!device) {
+        return nullptr;
+    }
+
+    null_state.device = NullDeviceData();
+    null_state.device.constant_memory = kai::ArenaAllocator(CONSTANT_RING_SIZE);
+    null_state.device_created = true;
+
+    device->data = &null_state.device;
+    device->id = 0;
+    device->backend = kai::RenderingBackend::null;
+    strncpy(device->name, "Null (headless)", sizeof(device->name) - 1);
+    device->constant_ring = create_constant_ring(CONSTANT_RING_SIZE);
+
+    return device;
+}
+
+void NullRenderer::destroy(void) {
+    NullDeviceData *d = static_cast<NullDeviceData *>(data);
+
+    d->instance_memory.destroy();
+    d->constant_memory.destroy();
+    destroy_constant_ring(constant_ring);
+
+    null_state.device_created = false;
+
+    memset(this, 0, sizeof(*this));
+}
+
+// Copies the instance data like it would be uploaded to the GPU, the host buffer only grows
+static bool upload_instance_data(NullDeviceData *d, const kai::CommandBuffer &command_buffer) {
+    Uint32 size = command_buffer.get_instance_data_size();
+
+    if(size > d->instance_capacity) {
+        Uint32 capacity = kai::max(d->instance_capacity * 2, size);
+
+        d->instance_memory.destroy();
+        d->instance_memory = kai::StackAllocator(capacity);
+        d->instance_capacity = d->instance_memory.get_data() ? capacity : 0;
+
+        if(!d->instance_capacity) {
+            kai::log("Could not allocate the instance buffer!\n");
+            d->instance_size = 0;
+            return false;
+        }
+    }
+
+    memcpy(d->instance_memory.get_data(), command_buffer.get_instance_data(), size);
+    d->instance_size = size;
+
+    return true;
+}
+
+static Uint32 upload_constants(NullDeviceData *d, ConstantRing *ring) {
+    Uint32 offsets[2];
+    Uint32 sizes[2];
+    Uint32 count = ring->get_pending_uploads(offsets, sizes);
+
+    Uint8 *gpu_memory = static_cast<Uint8 *>(d->constant_memory.get_buffer());
+    Uint32 bytes = 0;
+
+    for(Uint32 i = 0; i < count; i++) {
+        memcpy(gpu_memory + offsets[i], ring->data + offsets[i], sizes[i]);
+        bytes += sizes[i];
+    }
+
+    return bytes;
+}
+
+// Whether 'count' elements of 'stride' bytes starting at element 'start' are inside of the buffer
+static KAI_FORCEINLINE bool in_bounds(const NullBufferData *buffer, Uint32 start, Uint32 count, Uint32 stride) {
+    return (static_cast<Uint64>(start) + count) * stride <= buffer->byte_size;
+}
+
+static KAI_FORCEINLINE Uint32 get_index_stride(const NullBufferData *buffer) {
+    return (buffer->stride == 2) ? 2 : 4;
+}
+
+void NullRenderer::execute(const kai::CommandBuffer &command_buffer) const {
+    Uint64 start_time = kai::get_timestamp();
+
+    NullDeviceData *d = static_cast<NullDeviceData *>(data);
+    NullRenderPipelineData *p = d->active_pipeline;
+
+    CommandDecoder decoder(command_buffer, false);
+    if(p) {
+        decoder.set_merge_draws(p->topology);
+    }
+
+    d->instance_size = 0;
+    if(command_buffer.get_instance_data_size() > 0 && upload_instance_data(d, command_buffer)) {
+        frame_stats.instance_bytes_uploaded += d->instance_size;
+    }
+
+    if(constant_ring) {
+        frame_counters.constant_bytes_uploaded += upload_constants(d, constant_ring);
+    }
+
+    frame_stats.command_buffers++;
+    frame_counters.command_bytes += command_buffer.get_size();
+
+    CommandEncodingData command;
+    while(decoder.next(command)) {
+        frame_counters.commands_executed++;
+
+        switch(command.draw.encoding) {
+            case CommandEncoding::draw: {
+                const auto c = &command.draw;
+                if(d->vertex_buffer && d->vertex_buffer->stride &&
+                   !in_bounds(d->vertex_buffer, c->start, c->count, d->vertex_buffer->stride)) {
+                    frame_stats.errors++;
+                }
+
+                frame_counters.draws++;
+                frame_counters.vertices += c->count;
+                break;
+            }
+            case CommandEncoding::draw_indexed: {
+                const auto c = &command.draw_indexed;
+                if(!d->index_buffer || !in_bounds(d->index_buffer, c->start, c->count, get_index_stride(d->index_buffer))) {
+                    frame_stats.errors++;
+                }
+
+                frame_counters.draws++;
+                frame_counters.vertices += c->count;
+                break;
+            }
+            case CommandEncoding::draw_instanced:
+            case CommandEncoding::draw_indexed_instanced: {
+                // Both share the layout up to the base
+                const auto c = &command.draw_indexed_instanced;
+                if(c->encoding == CommandEncoding::draw_indexed_instanced &&
+                   (!d->index_buffer || !in_bounds(d->index_buffer, c->start, c->count, get_index_stride(d->index_buffer)))) {
+                    frame_stats.errors++;
+                }
+
+                if(c->instance_stride &&
+                   static_cast<Uint64>(c->instance_offset) + c->instance_count * c->instance_stride > d->instance_size) {
+                    frame_stats.errors++;
+                }
+
+                frame_counters.draws++;
+                frame_stats.instances += c->instance_count;
+                frame_counters.vertices += static_cast<Uint64>(c->count) * c->instance_count;
+                break;
+            }
+            case CommandEncoding::set_render_pipeline: {
+                set_render_pipeline({ command.set_render_pipeline.pipeline });
+                p = d->active_pipeline;
+
+                // The pipeline was destroyed after the command was recorded
+                if(!p) {
+                    frame_stats.errors++;
+                    continue;
+                }
+
+                decoder.set_merge_draws(p->topology);
+                break;
+            }
+            case CommandEncoding::bind_buffer: {
+                const auto c = &command.bind_buffer;
+                const NullBufferData *b = static_cast<const NullBufferData *>(null_state.buffers.get(c->buffer));
+
+                // A buffer can only be bound as what it was created for, and only while it exists
+                if(!b || b->type != c->type) {
+                    frame_stats.errors++;
+                    continue;
+                }
+
+                switch(c->type) {
+                    case kai::RenderBufferType::vertex: d->vertex_buffer = b; break;
+                    case kai::RenderBufferType::index: d->index_buffer = b; break;
+                    case kai::RenderBufferType::constant: default: break;
+                }
+
+                frame_counters.buffer_binds++;
+                break;
+            }
+            case CommandEncoding::bind_constants: {
+                const auto c = &command.bind_constants;
+                if(!constant_ring || static_cast<Uint64>(c->offset) + c->size > constant_ring->size) {
+                    frame_stats.errors++;
+                }
+
+                frame_counters.constant_binds++;
+                break;
+            }
+            case CommandEncoding::bind_texture: {
+                const auto c = &command.bind_texture;
+                const NullTextureData *t = static_cast<const NullTextureData *>(null_state.textures.get(c->texture));
+
+                if(!t) {
+                    frame_stats.errors++;
+                    continue;
+                }
+
+                d->textures[c->slot] = t;
+                frame_counters.texture_binds++;
+                break;
+            }
+
+            case CommandEncoding::clear_color:
+            case CommandEncoding::clear_depth:
+            case CommandEncoding::clear_stencil:
+            case CommandEncoding::clear_depth_stencil:
+                // The clear values come from the active pipeline
+                if(!p) {
+                    frame_stats.errors++;
+                }
+
+                frame_stats.clears++;
+                break;
+
+            default:
+                continue;
+        }
+    }
+
+    frame_counters.binds_elided += command_buffer.get_elided_count();
+    frame_counters.draws_merged += decoder.merged_draw_count;
+    frame_counters.draws_instanced += command_buffer.get_auto_instanced_count();
+
+    frame_counters.execute_ms += static_cast<Float64>(kai::get_timestamp() - start_time) * 1000.0 /
+                                 static_cast<Float64>(kai::get_timestamp_frequency());
+}
+
+void NullRenderer::present(void) const {
+    NullDeviceData *d = static_cast<NullDeviceData *>(data);
+
+    Uint64 now = kai::get_timestamp();
+    if(d->last_present) {
+        frame_stats.frame_ms = static_cast<Float64>(now - d->last_present) * 1000.0 /
+                               static_cast<Float64>(kai::get_timestamp_frequency());
+    }
+
+    d->last_present = now;
+
+    // Everything is "executed" right away, so no frame is ever in flight
+    if(constant_ring) {
+        constant_ring->next_frame();
+    }
+
+    retire_resources();
+
+    last_frame_stats = frame_stats;
+    frame_stats = {};
+
+    finish_frame_counters();
+}
+
+void NullRenderer::set_viewport(Int32 x, Int32 y, Uint32 width, Uint32 height) const {
+    kai::Window *window = kai::get_window();
+    if(window) {
+        width = (width > 0) ? width : window->width;
+        height = (height > 0) ? height : window->height;
+    }
+
+    NullDeviceData *d = static_cast<NullDeviceData *>(data);
+    d->viewport[0] = x;
+    d->viewport[1] = y;
+    d->viewport[2] = static_cast<Int32>(width);
+    d->viewport[3] = static_cast<Int32>(height);
+}
+
+bool NullRenderer::compile_shader(const char *shader_stream, kai::ShaderType type,
+                                  const char *entry, void *out_id, void **bytecode) const {
+    if(!shader_stream || !entry) {
+        kai::log("Null renderer: a shader needs both its source and entry point!\n");
+        return false;
+    }
+
+    // There's no shader compiler, the source only gets hashed so that the same shader always gets the same id
+    Uint64 hash = kai::fnv1a64_str_hash(shader_stream) ^ (kai::fnv1a64_str_hash(entry) * 31);
+    hash += static_cast<Uint64>(type) + 1;
+
+    if(out_id) {
+        *static_cast<uintptr_t *>(out_id) = static_cast<uintptr_t>(hash);
+    }
+
+    if(bytecode) {
+        *bytecode = nullptr;
+    }
+
+    return true;
+}
+
+// A baked shader has no source, so its bytecode gets hashed instead to give it a stable id as well
+static bool create_null_shader(const NullRenderer *device, const char *source, const char *entry, const void *bytecode,
+                               Uint32 bytecode_size, kai::ShaderType type, void *out_id) {
+    if(bytecode) {
+        *static_cast<uintptr_t *>(out_id) = static_cast<uintptr_t>(hash_shader_bytecode(bytecode, bytecode_size, type));
+        return true;
+    }
+
+    return device->compile_shader(source, type, entry, out_id);
+}
+
+bool NullRenderer::create_render_pipeline(const kai::RenderPipelineInfo &info, const kai::RenderInputLayoutInfo *input_layouts,
+                                          Uint32 input_layout_count, kai::RenderPipeline &out_pipeline) const {
+    if(input_layout_count > 0 && !input_layouts) {
+        return false;
+    }
+
+    Uint64 key = hash_pipeline(info, input_layouts, input_layout_count);
+    if(acquire_cached_pipeline(this, key, out_pipeline)) {
+        return true;
+    }
+
+    NullRenderPipelineData *null_pipeline = static_cast<NullRenderPipelineData *>(null_state.pipelines_pool.alloc());
+
+    if(!null_pipeline) {
+        kai::log("Could not create a new render pipeline object!\n");
+        return false;
+    }
+
+    if(!create_null_shader(this, info.vertex_shader_source, info.vertex_shader_entry, info.vertex_shader_bytecode,
+                           info.vertex_shader_bytecode_size, kai::ShaderType::vertex, &null_pipeline->vertex_shader) ||
+       !create_null_shader(this, info.pixel_shader_source, info.pixel_shader_entry, info.pixel_shader_bytecode,
+                           info.pixel_shader_bytecode_size, kai::ShaderType::pixel, &null_pipeline->pixel_shader)) {
+        null_state.pipelines_pool.free(null_pipeline);
+        return false;
+    }
+
+    Uint32 handle = null_state.pipelines.add(null_pipeline);
+    if(!handle) {
+        null_state.pipelines_pool.free(null_pipeline);
+        return false;
+    }
+
+    null_pipeline->topology = info.topology;
+    null_pipeline->color_enable = info.color_enable;
+    null_pipeline->depth_enable = info.depth_enable;
+    null_pipeline->stencil_enable = info.stencil_enable;
+
+    out_pipeline.handle = handle;
+    add_cached_pipeline(this, key, out_pipeline);
+
+    return true;
+}
+
+void NullRenderer::destroy_render_pipeline(kai::RenderPipeline &pipeline) {
+    if(!release_cached_pipeline(pipeline)) {
+        memset(&pipeline, 0, sizeof(pipeline));
+        return;
+    }
+
+    NullDeviceData *d = static_cast<NullDeviceData *>(data);
+    NullRenderPipelineData *p = static_cast<NullRenderPipelineData *>(null_state.pipelines.remove(pipeline.handle));
+
+    if(!p) {
+        kai::log("Tried to destroy a render pipeline with a stale or null handle!\n");
+        return;
+    }
+
+    if(d->active_pipeline == p) {
+        d->active_pipeline = nullptr;
+    }
+
+    null_state.pipelines_pool.free(p);
+
+    memset(&pipeline, 0, sizeof(pipeline));
+}
+
+void NullRenderer::set_render_pipeline(const kai::RenderPipeline &pipeline) const {
+    static_cast<NullDeviceData *>(data)->active_pipeline = static_cast<NullRenderPipelineData *>(null_state.pipelines.get(pipeline.handle));
+    frame_counters.pipeline_binds++;
+}
+
+bool NullRenderer::create_buffer(const kai::RenderBufferInfo &info, kai::RenderBuffer &out_buffer) const {
+    kai::ArenaAllocator arena(sizeof(NullBufferData) + info.byte_size);
+    NullBufferData *buffer = static_cast<NullBufferData *>(arena.get_buffer());
+
+    if(!buffer) {
+        kai::log("Could not allocate a buffer of %zu bytes!\n", info.byte_size);
+        return false;
+    }
+
+    buffer->arena = arena;
+    buffer->byte_size = static_cast<Uint32>(info.byte_size);
+    buffer->stride = info.stride;
+    buffer->type = info.type;
+
+    if(info.data) {
+        memcpy(buffer->data, info.data, info.byte_size);
+    } else {
+        memset(buffer->data, 0, info.byte_size);
+    }
+
+    out_buffer.handle = null_state.buffers.add(buffer);
+    if(!out_buffer.handle) {
+        arena.destroy();
+        return false;
+    }
+
+    buffer_bytes[static_cast<Uint32>(info.type)] += info.byte_size;
+
+    return true;
+}
+
+void NullRenderer::destroy_buffer(kai::RenderBuffer &buffer) {
+    NullDeviceData *d = static_cast<NullDeviceData *>(data);
+    NullBufferData *b = static_cast<NullBufferData *>(null_state.buffers.remove(buffer.handle));
+
+    if(!b) {
+        kai::log("Tried to destroy a buffer with a stale or null handle!\n");
+        return;
+    }
+
+    if(d->vertex_buffer == b) {
+        d->vertex_buffer = nullptr;
+    }
+
+    if(d->index_buffer == b) {
+        d->index_buffer = nullptr;
+    }
+
+    buffer_bytes[static_cast<Uint32>(b->type)] -= b->byte_size;
+
+    kai::ArenaAllocator arena = b->arena;
+    arena.destroy();
+
+    memset(&buffer, 0, sizeof(buffer));
+}
+
+bool NullRenderer::update_buffer(const kai::RenderBuffer &buffer, const void *contents, Uint32 bytes) const {
+    NullBufferData *b = static_cast<NullBufferData *>(null_state.buffers.get(buffer.handle));
+
+    if(!b) {
+        kai::log("Tried to update a buffer with a stale or null handle!\n");
+        return false;
+    }
+
+    if(bytes > b->byte_size) {
+        kai::log("Tried to write %u bytes into a buffer of %u bytes!\n", bytes, b->byte_size);
+        return false;
+    }
+
+    memcpy(b->data, contents, bytes);
+    frame_counters.buffer_bytes_updated += bytes;
+
+    return true;
+}
+
+bool NullRenderer::create_texture(const kai::RenderTextureInfo &info, kai::RenderTexture &out_texture) const {
+    Uint32 pixel_size = kai::get_format_size(info.format);
+    Uint32 block_size = kai::get_format_block_size(info.format);
+
+    if(!info.width || !info.height || !pixel_size || info.width % block_size || info.height % block_size || !info.mip_count ||
+       info.mip_count > KAI_TEXTURE_MAX_MIPS || info.mip_count > kai::get_mip_count(info.width, info.height)) {
+        kai::log("Invalid size, format or mip count for a texture!\n");
+        return false;
+    }
+
+    Uint64 byte_size = kai::get_texture_size(info.format, info.width, info.height, info.mip_count);
+    kai::ArenaAllocator arena(sizeof(NullTextureData) + byte_size);
+    NullTextureData *texture = static_cast<NullTextureData *>(arena.get_buffer());
+
+    if(!texture) {
+        kai::log("Could not allocate a %ux%u texture!\n", info.width, info.height);
+        return false;
+    }
+
+    texture->arena = arena;
+    texture->width = info.width;
+    texture->height = info.height;
+    texture->mip_count = info.mip_count;
+    texture->byte_size = static_cast<Uint32>(byte_size);
+    texture->format = info.format;
+
+    if(info.data) {
+        memcpy(texture->data, info.data, byte_size);
+    } else {
+        memset(texture->data, 0, byte_size);
+    }
+
+    out_texture.handle = null_state.textures.add(texture);
+    if(!out_texture.handle) {
+        arena.destroy();
+        return false;
+    }
+
+    texture_bytes += byte_size;
+
+    return true;
+}
+
+void NullRenderer::destroy_texture(kai::RenderTexture &texture) {
+    NullDeviceData *d = static_cast<NullDeviceData *>(data);
+    NullTextureData *t = static_cast<NullTextureData *>(null_state.textures.remove(texture.handle));
+
+    if(!t) {
+        kai::log("Tried to destroy a texture with a stale or null handle!\n");
+        return;
+    }
+
+    for(const NullTextureData *&bound : d->textures) {
+        if(bound == t) {
+            bound = nullptr;
+        }
+    }
+
+    texture_bytes -= t->byte_size;
+
+    kai::ArenaAllocator arena = t->arena;
+    arena.destroy();
+
+    memset(&texture, 0, sizeof(texture));
+}
+
+bool NullRenderer::update_texture(const kai::RenderTexture &texture, Uint32 x, Uint32 y, Uint32 width, Uint32 height,
+                                  const void *contents) const {
+    NullTextureData *t = static_cast<NullTextureData *>(null_state.textures.get(texture.handle));
+
+    if(!t) {
+        kai::log("Tried to update a texture with a stale or null handle!\n");
+        return false;
+    }
+
+    if(x > t->width || width > t->width - x || y > t->height || height > t->height - y) {
+        kai::log("Tried to write %ux%u pixels at %u, %u into a %ux%u texture!\n", width, height, x, y, t->width, t->height);
+        return false;
+    }
+
+    Uint32 block_size = kai::get_format_block_size(t->format);
+    if(x % block_size || y % block_size || width % block_size || height % block_size) {
+        kai::log("Tried to write %ux%u pixels at %u, %u that aren't whole blocks of a texture!\n", width, height, x, y);
+        return false;
+    }
+
+    // In rows of blocks, which are rows of pixels for the formats that aren't block-compressed
+    Uint32 pixel_size = kai::get_format_size(t->format);
+    Uint32 row_size = width / block_size * pixel_size;
+    Uint32 pitch = t->width / block_size * pixel_size;
+    const Uint8 *src = static_cast<const Uint8 *>(contents);
+    Uint8 *dst = t->data + static_cast<size_t>(y / block_size) * pitch + x / block_size * pixel_size;
+
+    for(Uint32 row = 0; row < height / block_size; row++) {
+        memcpy(dst, src, row_size);
+        src += row_size;
+        dst += pitch;
+    }
+
+    frame_counters.texture_bytes_updated += row_size * (height / block_size);
+
+    return true;
+}
+
+const void * NullRenderer::get_texture_data(const kai::RenderTexture &texture) const {
+    const NullTextureData *t = static_cast<const NullTextureData *>(null_state.textures.get(texture.handle));
+    return t ? t->data : nullptr;
+}
+
+bool NullRenderer::get_texture_info(const kai::RenderTexture &texture, kai::RenderTextureInfo &out_info) const {
+    const NullTextureData *t = static_cast<const NullTextureData *>(null_state.textures.get(texture.handle));
+    if(!t) {
+        return false;
+    }
+
+    out_info = kai::RenderTextureInfo();
+    out_info.data = t->data;
+    out_info.width = t->width;
+    out_info.height = t->height;
+    out_info.mip_count = t->mip_count;
+    out_info.format = t->format;
+    return true;
+}
+
+const void * NullRenderer::get_buffer_data(const kai::RenderBuffer &buffer) const {
+    const NullBufferData *b = static_cast<const NullBufferData *>(null_state.buffers.get(buffer.handle));
+    return b ? b->data : nullptr;
+}
@@ -0,0 +1,79 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_NULL_RENDERER_H
+#define KAI_NULL_RENDERER_H
+
+#include "../../core/includes/kai.h"
+
+void init_null_renderer(void);
+void destroy_null_renderer(void);
+
+kai::RenderDevice * null_renderer_init_device(kai::StackAllocator &allocator);
+
+// What the GPU would have been asked to do in a frame, on top of the RenderFrameCounters that every backend has
+struct NullFrameStats {
+    Uint32 command_buffers;
+    Uint32 instances;
+    Uint32 clears;
+    Uint64 instance_bytes_uploaded;
+
+    // Commands that a real backend would fail on or that would read out of bounds,
+    // e.g. an indexed draw without an index buffer or a clear without a pipeline
+    Uint32 errors;
+
+    Float64 frame_ms; // Time between the last two present() calls
+};
+
+// Headless backend that executes CommandBuffers without a GPU. It decodes them the same way the
+// other backends do and keeps the buffers and textures in host memory, but instead of drawing it
+// validates the commands and records the statistics of every frame. Useful to benchmark and test
+// the CPU side of the renderer on machines without a GPU.
+struct NullRenderer : public kai::RenderDevice {
+    NullRenderer(void) = default;
+
+    void destroy(void) override;
+
+    using kai::RenderDevice::execute;
+    void execute(const kai::CommandBuffer &command_buffer) const override;
+    void present(void) const override;
+
+    void set_viewport(Int32 x, Int32 y, Uint32 width = 0, Uint32 height = 0) const override;
+
+    bool compile_shader(const char *shader_stream, kai::ShaderType type,
+                        const char *entry, void *out_id, void **bytecode = nullptr) const override;
+
+    bool create_render_pipeline(const kai::RenderPipelineInfo &info, const kai::RenderInputLayoutInfo *input_layouts,
+                                Uint32 input_layout_count, kai::RenderPipeline &out_pipeline) const override;
+    void destroy_render_pipeline(kai::RenderPipeline &pipeline) override;
+    void set_render_pipeline(const kai::RenderPipeline &pipeline) const override;
+
+    bool create_buffer(const kai::RenderBufferInfo &info, kai::RenderBuffer &out_buffer) const override;
+    void destroy_buffer(kai::RenderBuffer &buffer) override;
+    bool update_buffer(const kai::RenderBuffer &buffer, const void *contents, Uint32 bytes) const override;
+
+    bool create_texture(const kai::RenderTextureInfo &info, kai::RenderTexture &out_texture) const override;
+    void destroy_texture(kai::RenderTexture &texture) override;
+    bool update_texture(const kai::RenderTexture &texture, Uint32 x, Uint32 y, Uint32 width, Uint32 height,
+                        const void *contents) const override;
+
+    // The statistics of the last presented frame
+    const NullFrameStats & get_frame_stats(void) const {
+        return last_frame_stats;
+    }
+
+    // The contents of a buffer, as the GPU would see them
+    const void * get_buffer_data(const kai::RenderBuffer &buffer) const;
+    const void * get_texture_data(const kai::RenderTexture &texture) const;
+
+    // What the texture was created with, 'data' points at its current contents. False for a stale or null handle
+    bool get_texture_info(const kai::RenderTexture &texture, kai::RenderTextureInfo &out_info) const;
+
+private:
+    mutable NullFrameStats frame_stats = {};
+    mutable NullFrameStats last_frame_stats = {};
+};
+
+#endif /* KAI_NULL_RENDERER_H */
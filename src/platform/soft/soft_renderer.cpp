@@ -0,0 +1,1338 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "soft_renderer.h"
+#include "../platform.h"
+#include "../../core/pipeline_cache_internal.h"
+
+#define SOFT_TILE_SHIFT 6
+#define SOFT_TILE_SIZE (1 << SOFT_TILE_SHIFT)
+#define SOFT_RENDER_PIPELINE_POOL_COUNT 32
+#define SOFT_MAX_THREADS 64
+
+#define SOFT_NEAR_W 1e-5f // Triangles with a vertex that has a smaller w after clipping are dropped
+#define SOFT_GUARD_BAND 1048576.0f // Triangles past this many pixels lose too much precision in the edge functions
+
+#define SOFT_BIN_CLEAR_BIT 0x80000000u // Bin entries are triangle indices, or clear indices with this bit set
+
+#define SOFT_WRITE_COLOR 0x1
+#define SOFT_WRITE_DEPTH 0x2
+
+// Growable array in memory from the MemoryManager, it never shrinks and is only reset between frames
+template<typename T>
+struct SoftArray {
+    bool reserve(Uint32 count) {
+        if(count <= capacity) {
+            return true;
+        }
+
+        Uint32 new_capacity = kai::max(kai::max(capacity * 2, count), 64u);
+        kai::StackAllocator new_memory(new_capacity * static_cast<Uint32>(sizeof(T)));
+
+        if(!new_memory.get_data()) {
+            return false;
+        }
+
+        if(size) {
+            memcpy(new_memory.get_data(), data, size * sizeof(T));
+        }
+
+        memory.destroy();
+        memory = new_memory;
+        data = static_cast<T *>(memory.get_data());
+        capacity = new_capacity;
+
+        return true;
+    }
+
+    T * push(void) {
+        if(size == capacity && !reserve(size + 1)) {
+            return nullptr;
+        }
+
+        return &data[size++];
+    }
+
+    void destroy(void) {
+        memory.destroy();
+        *this = SoftArray();
+    }
+
+    kai::StackAllocator memory;
+    T *data = nullptr;
+    Uint32 size = 0;
+    Uint32 capacity = 0;
+};
+
+struct SoftBufferData {
+    kai::ArenaAllocator arena; // The memory of the buffer itself
+    Uint32 byte_size;
+    Uint32 stride;
+    kai::RenderBufferType type;
+    Uint8 KAI_FLEXIBLE_ARRAY(data);
+};
+
+// Only kept so that the handles resolve, the fixed function doesn't sample textures
+struct SoftTextureData {
+    kai::ArenaAllocator arena; // The memory of the texture itself
+    Uint32 width;
+    Uint32 height;
+    Uint32 mip_count;
+    Uint32 byte_size;
+    kai::RenderFormat format;
+    Uint8 KAI_FLEXIBLE_ARRAY(data); // The mips from the largest to the smallest
+};
+
+struct SoftRenderPipelineData {
+    kai::VertexShaderID vertex_shader;
+    kai::PixelShaderID pixel_shader;
+    kai::RenderPipelineInfo::TopologyType topology;
+    kai::RenderPipelineInfo::CullMode cull_mode;
+    Bool32 front_ccw;
+    Bool32 color_enable;
+    Bool32 depth_enable;
+    Uint32 clear_color; // RGBA8
+    Float32 depth_clear;
+    Uint32 position_offset;
+};
+
+// Everything the tiles need to rasterize a triangle. A pixel is covered if all three edge functions
+// E(x, y) = a * x + b * y + c are >= their bias at its center, which is either 0 or FLT_MIN
+// so that pixels exactly on an edge only belong to the triangle if it's a top or left edge
+struct SoftTriangle {
+    Float32 edge_a[3];
+    Float32 edge_b[3];
+    Float32 edge_c[3];
+    Float32 edge_bias[3];
+
+    // The depth is a plane in screen space
+    Float32 z_a;
+    Float32 z_b;
+    Float32 z_c;
+
+    // Inclusive and clipped to the viewport
+    Int32 min_x;
+    Int32 min_y;
+    Int32 max_x;
+    Int32 max_y;
+
+    Uint32 color;
+    Uint32 write_mask;
+};
+
+struct SoftClear {
+    Uint32 color;
+    Float32 depth;
+    Uint32 write_mask;
+};
+
+struct SoftDeviceData {
+    Uint32 width;
+    Uint32 height;
+    Uint32 tiles_x;
+    Uint32 tiles_y;
+    Uint32 pitch; // The frame is padded to whole tiles, so rasterizing a tile never needs to check the frame's bounds
+
+    kai::ArenaAllocator frame_memory;
+    Uint32 *color;
+    Float32 *depth;
+    SoftArray<Uint32> *bins; // One per tile
+
+    SoftArray<SoftTriangle> triangles;
+    SoftArray<SoftClear> clears;
+    SoftArray<kai::Vec4> positions;
+    SoftArray<kai::Vec4> clip_positions;
+
+    SoftRenderPipelineData *active_pipeline;
+    const SoftBufferData *vertex_buffer;
+    const SoftBufferData *index_buffer;
+    const Uint8 *vertex_constants;
+    Uint32 vertex_constant_size;
+
+    Int32 viewport[4];
+    Uint64 last_present;
+};
+
+static struct {
+    SoftDeviceData device;
+    Bool32 device_created;
+    Bool32 initialized;
+
+    kai::PoolAllocator pipelines_pool;
+    RenderHandleTable pipelines; // SoftRenderPipelineData
+    RenderHandleTable buffers; // SoftBufferData
+    RenderHandleTable textures; // SoftTextureData
+
+    // The threads that rasterize the tiles besides the one that calls present()
+    std::thread workers[SOFT_MAX_THREADS];
+    Uint32 worker_count;
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    Uint64 job; // Bumped for every frame that the workers need to rasterize
+    Uint32 busy_workers;
+    Bool32 quit;
+    std::atomic<Uint32> next_tile;
+} soft_state;
+
+void init_soft_renderer(void) {
+    if(!soft_state.initialized) {
+        soft_state.pipelines_pool = kai::PoolAllocator(sizeof(SoftRenderPipelineData), SOFT_RENDER_PIPELINE_POOL_COUNT);
+        soft_state.initialized = true;
+    }
+}
+
+void destroy_soft_renderer(void) {
+    soft_state.pipelines.destroy();
+    soft_state.buffers.destroy();
+    soft_state.textures.destroy();
+    soft_state.pipelines_pool.destroy();
+    soft_state.initialized = false;
+}
+
+static KAI_FORCEINLINE Uint32 pack_rgba8(Float32 r, Float32 g, Float32 b, Float32 a) {
+    auto to_unorm8 = [](Float32 value) {
+        kai::clamp(value, 0.0f, 1.0f);
+        return static_cast<Uint32>(value * 255.0f + 0.5f);
+    };
+
+    return to_unorm8(r) | (to_unorm8(g) << 8) | (to_unorm8(b) << 16) | (to_unorm8(a) << 24);
+}
+
+// ----- Rasterization ----- //
+static void rasterize_triangle(SoftDeviceData *d, const SoftTriangle &t, Int32 tile_x, Int32 tile_y) {
+    Int32 min_x = kai::max(t.min_x, tile_x);
+    Int32 min_y = kai::max(t.min_y, tile_y);
+    Int32 max_x = kai::min(t.max_x, tile_x + SOFT_TILE_SIZE - 1);
+    Int32 max_y = kai::min(t.max_y, tile_y + SOFT_TILE_SIZE - 1);
+
+    if(min_x > max_x || min_y > max_y) {
+        return;
+    }
+
+    // 4 pixels of a row at a time, starting at a multiple of 4 so the frame can be accessed in whole vectors
+    const Int32 start_x = min_x & ~3;
+    const __m128 lane_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 first_x = _mm_set1_ps(static_cast<Float32>(min_x));
+    const __m128 end_x = _mm_set1_ps(static_cast<Float32>(max_x + 1));
+    const __m128 four = _mm_set1_ps(4.0f);
+
+    const __m128 a0 = _mm_set1_ps(t.edge_a[0]), a1 = _mm_set1_ps(t.edge_a[1]), a2 = _mm_set1_ps(t.edge_a[2]);
+    const __m128 bias0 = _mm_set1_ps(t.edge_bias[0]);
+    const __m128 bias1 = _mm_set1_ps(t.edge_bias[1]);
+    const __m128 bias2 = _mm_set1_ps(t.edge_bias[2]);
+    const __m128 z_a = _mm_set1_ps(t.z_a);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128i color = _mm_set1_epi32(static_cast<Int32>(t.color));
+
+    for(Int32 y = min_y; y <= max_y; y++) {
+        const Float32 pixel_y = static_cast<Float32>(y) + 0.5f;
+        const __m128 c0 = _mm_set1_ps(t.edge_b[0] * pixel_y + t.edge_c[0]);
+        const __m128 c1 = _mm_set1_ps(t.edge_b[1] * pixel_y + t.edge_c[1]);
+        const __m128 c2 = _mm_set1_ps(t.edge_b[2] * pixel_y + t.edge_c[2]);
+        const __m128 z_c = _mm_set1_ps(t.z_b * pixel_y + t.z_c);
+
+        Uint32 *color_row = d->color + static_cast<size_t>(y) * d->pitch;
+        Float32 *depth_row = d->depth + static_cast<size_t>(y) * d->pitch;
+
+        __m128 pixel_x = _mm_add_ps(_mm_set1_ps(static_cast<Float32>(start_x)), lane_offsets);
+
+        for(Int32 x = start_x; x <= max_x; x += 4, pixel_x = _mm_add_ps(pixel_x, four)) {
+            // The B terms are folded into c, so only x is left per pixel
+            __m128 mask = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, pixel_x), c0), bias0);
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, pixel_x), c1), bias1));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, pixel_x), c2), bias2));
+
+            // Pixel centers are at +0.5, the lanes outside of [min_x, max_x] belong to other tiles or the viewport
+            mask = _mm_and_ps(mask, _mm_cmpgt_ps(pixel_x, first_x));
+            mask = _mm_and_ps(mask, _mm_cmplt_ps(pixel_x, end_x));
+
+            if(!_mm_movemask_ps(mask)) {
+                continue;
+            }
+
+            if(t.write_mask & SOFT_WRITE_DEPTH) {
+                __m128 z = _mm_add_ps(_mm_mul_ps(z_a, pixel_x), z_c);
+                __m128 old_z = _mm_loadu_ps(depth_row + x);
+
+                // Depth test (less) and clipping against the near and far planes
+                mask = _mm_and_ps(mask, _mm_cmplt_ps(z, old_z));
+                mask = _mm_and_ps(mask, _mm_cmpge_ps(z, zero));
+                mask = _mm_and_ps(mask, _mm_cmple_ps(z, one));
+
+                if(!_mm_movemask_ps(mask)) {
+                    continue;
+                }
+
+                _mm_storeu_ps(depth_row + x, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, old_z)));
+            }
+
+            if(t.write_mask & SOFT_WRITE_COLOR) {
+                __m128i pixel_mask = _mm_castps_si128(mask);
+                __m128i old_color = _mm_loadu_si128(reinterpret_cast<const __m128i *>(color_row + x));
+                __m128i new_color = _mm_or_si128(_mm_and_si128(pixel_mask, color), _mm_andnot_si128(pixel_mask, old_color));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(color_row + x), new_color);
+            }
+        }
+    }
+}
+
+static void clear_tile(SoftDeviceData *d, const SoftClear &clear, Int32 tile_x, Int32 tile_y) {
+    for(Int32 y = tile_y; y < tile_y + SOFT_TILE_SIZE; y++) {
+        size_t row = static_cast<size_t>(y) * d->pitch + static_cast<size_t>(tile_x);
+
+        for(Int32 x = 0; x < SOFT_TILE_SIZE; x++) {
+            if(clear.write_mask & SOFT_WRITE_COLOR) {
+                d->color[row + x] = clear.color;
+            }
+
+            if(clear.write_mask & SOFT_WRITE_DEPTH) {
+                d->depth[row + x] = clear.depth;
+            }
+        }
+    }
+}
+
+static void rasterize_tile(SoftDeviceData *d, Uint32 tile) {
+    const SoftArray<Uint32> &bin = d->bins[tile];
+    Int32 tile_x = static_cast<Int32>((tile % d->tiles_x) << SOFT_TILE_SHIFT);
+    Int32 tile_y = static_cast<Int32>((tile / d->tiles_x) << SOFT_TILE_SHIFT);
+
+    for(Uint32 i = 0; i < bin.size; i++) {
+        Uint32 entry = bin.data[i];
+
+        if(entry & SOFT_BIN_CLEAR_BIT) {
+            clear_tile(d, d->clears.data[entry & ~SOFT_BIN_CLEAR_BIT], tile_x, tile_y);
+        } else {
+            rasterize_triangle(d, d->triangles.data[entry], tile_x, tile_y);
+        }
+    }
+}
+
+// Every thread takes the next tile until there are none left, a tile is only ever touched by one thread
+static void rasterize_tiles(void) {
+    SoftDeviceData *d = &soft_state.device;
+    Uint32 tile_count = d->tiles_x * d->tiles_y;
+
+    for(;;) {
+        Uint32 tile = soft_state.next_tile.fetch_add(1, std::memory_order_relaxed);
+
+        if(tile >= tile_count) {
+            break;
+        }
+
+        if(d->bins[tile].size > 0) {
+            rasterize_tile(d, tile);
+        }
+    }
+}
+
+static void worker_main(Uint64 job) {
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock(soft_state.mutex);
+            soft_state.work_ready.wait(lock, [job]() { return soft_state.quit || soft_state.job != job; });
+
+            if(soft_state.quit) {
+                return;
+            }
+
+            job = soft_state.job;
+        }
+
+        rasterize_tiles();
+
+        std::lock_guard<std::mutex> lock(soft_state.mutex);
+        if(--soft_state.busy_workers == 0) {
+            soft_state.work_done.notify_one();
+        }
+    }
+}
+
+// ----- Triangle setup and binning ----- //
+static void bin_entry(SoftDeviceData *d, SoftFrameStats &stats, Uint32 entry,
+                      Int32 min_x, Int32 min_y, Int32 max_x, Int32 max_y) {
+    for(Int32 tile_y = min_y >> SOFT_TILE_SHIFT; tile_y <= (max_y >> SOFT_TILE_SHIFT); tile_y++) {
+        for(Int32 tile_x = min_x >> SOFT_TILE_SHIFT; tile_x <= (max_x >> SOFT_TILE_SHIFT); tile_x++) {
+            Uint32 *slot = d->bins[static_cast<Uint32>(tile_y) * d->tiles_x + static_cast<Uint32>(tile_x)].push();
+
+            if(slot) {
+                *slot = entry;
+                stats.bin_entries++;
+            }
+        }
+    }
+}
+
+static void setup_triangle(SoftDeviceData *d, SoftFrameStats &stats, const SoftRenderPipelineData *p,
+                           const kai::Vec4 &clip0, const kai::Vec4 &clip1, const kai::Vec4 &clip2, Uint32 color) {
+    const kai::Vec4 *clip[3] = { &clip0, &clip1, &clip2 };
+
+    // Trivially outside of one of the side planes
+    bool outside = (clip0.x > clip0.w && clip1.x > clip1.w && clip2.x > clip2.w) ||
+                   (clip0.x < -clip0.w && clip1.x < -clip1.w && clip2.x < -clip2.w) ||
+                   (clip0.y > clip0.w && clip1.y > clip1.w && clip2.y > clip2.w) ||
+                   (clip0.y < -clip0.w && clip1.y < -clip1.w && clip2.y < -clip2.w);
+
+    if(outside || clip0.w < SOFT_NEAR_W || clip1.w < SOFT_NEAR_W || clip2.w < SOFT_NEAR_W) {
+        stats.triangles_culled++;
+        return;
+    }
+
+    const Float32 viewport_x = static_cast<Float32>(d->viewport[0]);
+    const Float32 viewport_y = static_cast<Float32>(d->viewport[1]);
+    const Float32 viewport_width = static_cast<Float32>(d->viewport[2]);
+    const Float32 viewport_height = static_cast<Float32>(d->viewport[3]);
+
+    Float32 x[3];
+    Float32 y[3];
+    Float32 z[3];
+
+    for(Uint32 i = 0; i < 3; i++) {
+        Float32 inv_w = 1.0f / clip[i]->w;
+        x[i] = viewport_x + (clip[i]->x * inv_w * 0.5f + 0.5f) * viewport_width;
+        y[i] = viewport_y + (0.5f - clip[i]->y * inv_w * 0.5f) * viewport_height;
+        z[i] = clip[i]->z * inv_w;
+
+        if(fabsf(x[i]) > SOFT_GUARD_BAND || fabsf(y[i]) > SOFT_GUARD_BAND) {
+            stats.triangles_culled++;
+            return;
+        }
+    }
+
+    // Positive for triangles that are clockwise on the screen
+    Float32 area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    bool front = p->front_ccw ? (area < 0.0f) : (area > 0.0f);
+
+    if(area == 0.0f ||
+       (p->cull_mode == kai::RenderPipelineInfo::CullMode::back && !front) ||
+       (p->cull_mode == kai::RenderPipelineInfo::CullMode::front && front)) {
+        stats.triangles_culled++;
+        return;
+    }
+
+    if(area < 0.0f) {
+        kai::swap(x[1], x[2]);
+        kai::swap(y[1], y[2]);
+        kai::swap(z[1], z[2]);
+        area = -area;
+    }
+
+    Float32 min_x = kai::max(kai::min(kai::min(x[0], x[1]), x[2]), viewport_x);
+    Float32 min_y = kai::max(kai::min(kai::min(y[0], y[1]), y[2]), viewport_y);
+    Float32 max_x = kai::min(kai::max(kai::max(x[0], x[1]), x[2]), viewport_x + viewport_width - 1.0f);
+    Float32 max_y = kai::min(kai::max(kai::max(y[0], y[1]), y[2]), viewport_y + viewport_height - 1.0f);
+
+    if(min_x > max_x || min_y > max_y) {
+        stats.triangles_culled++;
+        return;
+    }
+
+    SoftTriangle *t = d->triangles.push();
+    if(!t) {
+        return;
+    }
+
+    for(Uint32 i = 0; i < 3; i++) {
+        Uint32 j = (i + 1) % 3;
+        t->edge_a[i] = y[i] - y[j];
+        t->edge_b[i] = x[j] - x[i];
+        t->edge_c[i] = -(t->edge_a[i] * x[i] + t->edge_b[i] * y[i]);
+
+        // Inside is to the right of left edges and below top edges
+        bool top_left = t->edge_a[i] > 0.0f || (t->edge_a[i] == 0.0f && t->edge_b[i] > 0.0f);
+        t->edge_bias[i] = top_left ? 0.0f : FLT_MIN;
+    }
+
+    // Edge i is opposite of vertex (i + 2) % 3, its normalized edge function is that vertex's barycentric weight
+    Float32 inv_area = 1.0f / area;
+    t->z_a = (t->edge_a[1] * z[0] + t->edge_a[2] * z[1] + t->edge_a[0] * z[2]) * inv_area;
+    t->z_b = (t->edge_b[1] * z[0] + t->edge_b[2] * z[1] + t->edge_b[0] * z[2]) * inv_area;
+    t->z_c = (t->edge_c[1] * z[0] + t->edge_c[2] * z[1] + t->edge_c[0] * z[2]) * inv_area;
+
+    t->min_x = static_cast<Int32>(floorf(min_x));
+    t->min_y = static_cast<Int32>(floorf(min_y));
+    t->max_x = static_cast<Int32>(ceilf(max_x));
+    t->max_y = static_cast<Int32>(ceilf(max_y));
+    t->color = color;
+    t->write_mask = (p->color_enable ? SOFT_WRITE_COLOR : 0) | (p->depth_enable ? SOFT_WRITE_DEPTH : 0);
+
+    stats.triangles++;
+    bin_entry(d, stats, d->triangles.size - 1, t->min_x, t->min_y, t->max_x, t->max_y);
+}
+
+// Clips the triangle against the near plane (z = 0 in clip space, like in D3D), which leaves up to 2 triangles
+static void clip_triangle(SoftDeviceData *d, SoftFrameStats &stats, const SoftRenderPipelineData *p,
+                          const kai::Vec4 &clip0, const kai::Vec4 &clip1, const kai::Vec4 &clip2, Uint32 color) {
+    if(clip0.z >= 0.0f && clip1.z >= 0.0f && clip2.z >= 0.0f) {
+        setup_triangle(d, stats, p, clip0, clip1, clip2, color);
+        return;
+    }
+
+    const kai::Vec4 *in[3] = { &clip0, &clip1, &clip2 };
+    kai::Vec4 out[4];
+    Uint32 out_count = 0;
+
+    for(Uint32 i = 0; i < 3; i++) {
+        const kai::Vec4 &a = *in[i];
+        const kai::Vec4 &b = *in[(i + 1) % 3];
+
+        if(a.z >= 0.0f) {
+            out[out_count++] = a;
+        }
+
+        if((a.z >= 0.0f) != (b.z >= 0.0f)) {
+            Float32 t = a.z / (a.z - b.z);
+            out[out_count++] = kai::Vec4(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, 0.0f, a.w + (b.w - a.w) * t);
+        }
+    }
+
+    if(out_count < 3) {
+        stats.triangles_culled++;
+        return;
+    }
+
+    setup_triangle(d, stats, p, out[0], out[1], out[2], color);
+
+    if(out_count == 4) {
+        setup_triangle(d, stats, p, out[0], out[2], out[3], color);
+    }
+}
+
+static KAI_FORCEINLINE Uint32 read_index(const Uint8 *indices, Uint32 index_stride, Uint32 i) {
+    if(index_stride == 2) {
+        Uint16 index;
+        memcpy(&index, indices + i * 2, sizeof(index));
+        return index;
+    }
+
+    Uint32 index;
+    memcpy(&index, indices + i * 4, sizeof(index));
+    return index;
+}
+
+// Transforms the vertices of a draw and sets up its triangles, once per instance. 'instances' is null
+// for draws without per-instance transforms
+static void draw_triangles(SoftDeviceData *d, SoftFrameStats &stats, Uint32 start, Uint32 count, Bool32 indexed, Int32 base,
+                           const Uint8 *instances, Uint32 instance_count, Uint32 instance_stride) {
+    const SoftRenderPipelineData *p = d->active_pipeline;
+
+    if(!p || !d->vertex_buffer || (indexed && !d->index_buffer) ||
+       (p->topology != kai::RenderPipelineInfo::TopologyType::triangle_list &&
+        p->topology != kai::RenderPipelineInfo::TopologyType::triangle_strip)) {
+        return;
+    }
+
+    const SoftBufferData *vertex_data = d->vertex_buffer;
+    const Uint32 vertex_stride = vertex_data->stride ? vertex_data->stride : 3 * sizeof(Float32);
+    const Uint32 vertex_end = p->position_offset + 3 * sizeof(Float32);
+    const Uint32 buffer_vertex_count = (vertex_data->byte_size >= vertex_end) ?
+                                       (vertex_data->byte_size - vertex_end) / vertex_stride + 1 : 0;
+
+    const Uint8 *indices = nullptr;
+    Uint32 index_stride = 0;
+
+    // Only the range of vertices that the draw references gets transformed
+    Uint32 first_vertex = start;
+    Uint32 last_vertex = start + count - 1;
+
+    if(indexed) {
+        const SoftBufferData *index_data = d->index_buffer;
+        index_stride = (index_data->stride == 2) ? 2 : 4;
+
+        if((static_cast<Uint64>(start) + count) * index_stride > index_data->byte_size) {
+            return;
+        }
+
+        indices = index_data->data + start * index_stride;
+        first_vertex = ~0u;
+        last_vertex = 0;
+
+        for(Uint32 i = 0; i < count; i++) {
+            Uint32 vertex = read_index(indices, index_stride, i) + static_cast<Uint32>(base);
+            first_vertex = kai::min(first_vertex, vertex);
+            last_vertex = kai::max(last_vertex, vertex);
+        }
+    }
+
+    if(count < 3 || last_vertex >= buffer_vertex_count) {
+        return;
+    }
+
+    Uint32 vertex_count = last_vertex - first_vertex + 1;
+    if(!d->positions.reserve(vertex_count) || !d->clip_positions.reserve(vertex_count)) {
+        return;
+    }
+
+    kai::Vec4 *positions = d->positions.data;
+    kai::Vec4 *clip_positions = d->clip_positions.data;
+    const Uint8 *vertices = vertex_data->data + p->position_offset;
+
+    for(Uint32 i = 0; i < vertex_count; i++) {
+        Float32 position[3];
+        memcpy(position, vertices + static_cast<size_t>(first_vertex + i) * vertex_stride, sizeof(position));
+        positions[i] = kai::Vec4(position[0], position[1], position[2], 1.0f);
+    }
+
+    kai::Mat4x4 transform = kai::Mat4x4::identity();
+    Float32 color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    if(d->vertex_constants && d->vertex_constant_size >= sizeof(kai::Mat4x4)) {
+        memcpy(transform.m, d->vertex_constants, sizeof(transform.m));
+
+        if(d->vertex_constant_size >= sizeof(kai::Mat4x4) + sizeof(color)) {
+            memcpy(color, d->vertex_constants + sizeof(kai::Mat4x4), sizeof(color));
+        }
+    }
+
+    const bool strip = p->topology == kai::RenderPipelineInfo::TopologyType::triangle_strip;
+    const Uint32 triangle_count = strip ? count - 2 : count / 3;
+    const Float32 light[3] = { 0.37139f, 0.74278f, 0.55709f };
+
+    for(Uint32 instance = 0; instance < instance_count; instance++) {
+        kai::Mat4x4 m = transform;
+
+        if(instances) {
+            kai::InstanceTransform instance_transform;
+            memcpy(&instance_transform, instances + instance * instance_stride, sizeof(instance_transform));
+
+            kai::Mat4x4 world = kai::Mat4x4::identity();
+            for(Uint32 row = 0; row < 3; row++) {
+                for(Uint32 column = 0; column < 4; column++) {
+                    world.m[column][row] = instance_transform.rows[row][column];
+                }
+            }
+
+            m = transform * world;
+        }
+
+        kai::transform(m, positions, clip_positions, vertex_count);
+
+        for(Uint32 i = 0; i < triangle_count; i++) {
+            Uint32 v[3];
+            for(Uint32 j = 0; j < 3; j++) {
+                Uint32 k = strip ? i + j : i * 3 + j;
+                v[j] = (indexed ? read_index(indices, index_stride, k) + static_cast<Uint32>(base) : start + k) - first_vertex;
+            }
+
+            // Every other triangle of a strip has the opposite winding
+            if(strip && (i & 1)) {
+                kai::swap(v[1], v[2]);
+            }
+
+            const kai::Vec4 &p0 = positions[v[0]];
+            const kai::Vec4 &p1 = positions[v[1]];
+            const kai::Vec4 &p2 = positions[v[2]];
+
+            Float32 e0[3] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+            Float32 e1[3] = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+            Float32 n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+            Float32 length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            Float32 shade = (length > 0.0f) ? 0.25f + 0.75f * fabsf(n[0] * light[0] + n[1] * light[1] + n[2] * light[2]) / length : 1.0f;
+
+            clip_triangle(d, stats, p, clip_positions[v[0]], clip_positions[v[1]], clip_positions[v[2]],
+                           pack_rgba8(color[0] * shade, color[1] * shade, color[2] * shade, color[3]));
+        }
+    }
+
+    stats.draws++;
+}
+
+// ----- SoftRenderer ----- //
+// There's only ever a single software device, since the rasterizer threads are shared
+kai::RenderDevice * soft_renderer_init_device(kai::StackAllocator &allocator, Uint32 width, Uint32 height, Uint32 thread_count) {
+    if(soft_state.device_created) {
+        kai::log("Only one software render device can exist at a time!\n");
+        return nullptr;
+    }
+
+    if(width == 0 || height == 0) {
+        kai::log("The software renderer needs a frame size!\n");
+        return nullptr;
+    }
+
+    kai::StackMarker marker;
+    SoftRenderer *device = allocator.alloc<SoftRenderer, SoftRenderer>(&marker);
+
+    if(!device) {
+        return nullptr;
+    }
+
+    SoftDeviceData *d = &soft_state.device;
+    *d = SoftDeviceData();
+    d->width = width;
+    d->height = height;
+    d->tiles_x = (width + SOFT_TILE_SIZE - 1) >> SOFT_TILE_SHIFT;
+    d->tiles_y = (height + SOFT_TILE_SIZE - 1) >> SOFT_TILE_SHIFT;
+    d->pitch = d->tiles_x << SOFT_TILE_SHIFT;
+
+    Uint32 tile_count = d->tiles_x * d->tiles_y;
+    Uint64 pixel_count = static_cast<Uint64>(d->pitch) * (d->tiles_y << SOFT_TILE_SHIFT);
+    d->frame_memory = kai::ArenaAllocator(pixel_count * (sizeof(Uint32) + sizeof(Float32)) + tile_count * sizeof(SoftArray<Uint32>));
+
+    if(!d->frame_memory.get_buffer()) {
+        kai::log("Could not allocate a %ux%u frame!\n", width, height);
+        allocator.free(marker);
+        return nullptr;
+    }
+
+    d->color = static_cast<Uint32 *>(d->frame_memory.get_buffer());
+    d->depth = reinterpret_cast<Float32 *>(d->color + pixel_count);
+    d->bins = reinterpret_cast<SoftArray<Uint32> *>(d->depth + pixel_count);
+
+    for(Uint64 i = 0; i < pixel_count; i++) {
+        d->color[i] = 0xff000000;
+        d->depth[i] = 1.0f;
+    }
+
+    for(Uint32 i = 0; i < tile_count; i++) {
+        new(&d->bins[i]) SoftArray<Uint32>();
+    }
+
+    d->viewport[2] = static_cast<Int32>(width);
+    d->viewport[3] = static_cast<Int32>(height);
+
+    if(thread_count == 0) {
+        thread_count = std::thread::hardware_concurrency();
+    }
+
+    kai::clamp(thread_count, 1u, static_cast<Uint32>(SOFT_MAX_THREADS));
+
+    soft_state.quit = false;
+    soft_state.worker_count = thread_count - 1;
+    for(Uint32 i = 0; i < soft_state.worker_count; i++) {
+        soft_state.workers[i] = std::thread(worker_main, soft_state.job);
+    }
+
+    soft_state.device_created = true;
+
+    device->data = d;
+    device->id = 0;
+    device->backend = kai::RenderingBackend::software;
+    strncpy(device->name, "Software rasterizer", sizeof(device->name) - 1);
+    device->constant_ring = create_constant_ring(CONSTANT_RING_SIZE);
+
+    return device;
+}
+
+void SoftRenderer::destroy(void) {
+    SoftDeviceData *d = static_cast<SoftDeviceData *>(data);
+
+    {
+        std::lock_guard<std::mutex> lock(soft_state.mutex);
+        soft_state.quit = true;
+    }
+
+    soft_state.work_ready.notify_all();
+    for(Uint32 i = 0; i < soft_state.worker_count; i++) {
+        soft_state.workers[i].join();
+    }
+
+    soft_state.worker_count = 0;
+
+    for(Uint32 i = 0; i < d->tiles_x * d->tiles_y; i++) {
+        d->bins[i].destroy();
+    }
+
+    d->triangles.destroy();
+    d->clears.destroy();
+    d->positions.destroy();
+    d->clip_positions.destroy();
+    d->frame_memory.destroy();
+    destroy_constant_ring(constant_ring);
+
+    soft_state.device_created = false;
+
+    memset(this, 0, sizeof(*this));
+}
+
+void SoftRenderer::execute(const kai::CommandBuffer &command_buffer) const {
+    Uint64 start_time = kai::get_timestamp();
+
+    SoftDeviceData *d = static_cast<SoftDeviceData *>(data);
+    SoftRenderPipelineData *p = d->active_pipeline;
+
+    CommandDecoder decoder(command_buffer, false);
+    if(p) {
+        decoder.set_merge_draws(p->topology);
+    }
+
+    const Uint8 *instance_data = static_cast<const Uint8 *>(command_buffer.get_instance_data());
+    const Uint32 instance_size = command_buffer.get_instance_data_size();
+
+    CommandEncodingData command;
+    while(decoder.next(command)) {
+        frame_counters.commands_executed++;
+
+        switch(command.draw.encoding) {
+            case CommandEncoding::draw: {
+                const auto c = &command.draw;
+                draw_triangles(d, frame_stats, c->start, c->count, false, 0, nullptr, 1, 0);
+                frame_counters.draws++;
+                frame_counters.vertices += c->count;
+                break;
+            }
+            case CommandEncoding::draw_indexed: {
+                const auto c = &command.draw_indexed;
+                draw_triangles(d, frame_stats, c->start, c->count, true, c->base, nullptr, 1, 0);
+                frame_counters.draws++;
+                frame_counters.vertices += c->count;
+                break;
+            }
+            case CommandEncoding::draw_instanced:
+            case CommandEncoding::draw_indexed_instanced: {
+                // Both share the layout up to the base
+                const auto c = &command.draw_indexed_instanced;
+                bool indexed = c->encoding == CommandEncoding::draw_indexed_instanced;
+
+                // Without per-instance transforms every instance would end up in the same place
+                bool has_transforms = c->instance_stride >= sizeof(kai::InstanceTransform) &&
+                                      static_cast<Uint64>(c->instance_offset) + c->instance_count * c->instance_stride <= instance_size;
+
+                draw_triangles(d, frame_stats, c->start, c->count, indexed, indexed ? c->base : 0,
+                               has_transforms ? instance_data + c->instance_offset : nullptr,
+                               has_transforms ? c->instance_count : 1, c->instance_stride);
+                frame_counters.draws++;
+                frame_counters.vertices += static_cast<Uint64>(c->count) * c->instance_count;
+                break;
+            }
+            case CommandEncoding::set_render_pipeline: {
+                set_render_pipeline({ command.set_render_pipeline.pipeline });
+                p = d->active_pipeline;
+
+                // The pipeline was destroyed after the command was recorded, draw_triangles() skips the draws
+                if(p) {
+                    decoder.set_merge_draws(p->topology);
+                }
+                break;
+            }
+            case CommandEncoding::bind_buffer: {
+                const auto c = &command.bind_buffer;
+                const SoftBufferData *b = static_cast<const SoftBufferData *>(soft_state.buffers.get(c->buffer));
+
+                if(!b) {
+                    continue;
+                }
+
+                switch(c->type) {
+                    case kai::RenderBufferType::vertex: d->vertex_buffer = b; break;
+                    case kai::RenderBufferType::index: d->index_buffer = b; break;
+                    case kai::RenderBufferType::constant:
+                        if(c->shader_type == kai::ShaderType::vertex) {
+                            d->vertex_constants = b->data;
+                            d->vertex_constant_size = b->byte_size;
+                        }
+                        break;
+                    default: break;
+                }
+
+                frame_counters.buffer_binds++;
+                break;
+            }
+            case CommandEncoding::bind_constants: {
+                // The ring buffer already is in host memory, so there's nothing to upload
+                const auto c = &command.bind_constants;
+                if(c->shader_type == kai::ShaderType::vertex && constant_ring &&
+                   static_cast<Uint64>(c->offset) + c->size <= constant_ring->size) {
+                    d->vertex_constants = constant_ring->data + c->offset;
+                    d->vertex_constant_size = c->size;
+                }
+
+                frame_counters.constant_binds++;
+                break;
+            }
+            case CommandEncoding::bind_texture:
+                if(soft_state.textures.get(command.bind_texture.texture)) {
+                    frame_counters.texture_binds++;
+                }
+                break;
+
+            case CommandEncoding::clear_color:
+            case CommandEncoding::clear_depth:
+            case CommandEncoding::clear_depth_stencil: {
+                // There's no stencil buffer, so clear_stencil is ignored. The pipeline may have been destroyed after
+                // the command was recorded, or a replayed capture never bound one
+                if(!p) {
+                    frame_stats.clears_skipped++;
+                    continue;
+                }
+
+                SoftClear *clear = d->clears.push();
+                if(!clear) {
+                    continue;
+                }
+
+                clear->color = p->clear_color;
+                clear->depth = p->depth_clear;
+                clear->write_mask = (command.draw.encoding == CommandEncoding::clear_color) ? SOFT_WRITE_COLOR : SOFT_WRITE_DEPTH;
+
+                bin_entry(d, frame_stats, (d->clears.size - 1) | SOFT_BIN_CLEAR_BIT, 0, 0,
+                          static_cast<Int32>(d->width) - 1, static_cast<Int32>(d->height) - 1);
+                break;
+            }
+
+            default:
+                continue;
+        }
+    }
+
+    frame_counters.binds_elided += command_buffer.get_elided_count();
+    frame_counters.draws_merged += decoder.merged_draw_count;
+    frame_counters.draws_instanced += command_buffer.get_auto_instanced_count();
+    frame_counters.command_bytes += command_buffer.get_size();
+
+    Float64 execute_ms = static_cast<Float64>(kai::get_timestamp() - start_time) * 1000.0 /
+                         static_cast<Float64>(kai::get_timestamp_frequency());
+    frame_stats.execute_ms += execute_ms;
+    frame_counters.execute_ms += execute_ms;
+}
+
+void SoftRenderer::present(void) const {
+    SoftDeviceData *d = static_cast<SoftDeviceData *>(data);
+    const Float64 frequency = static_cast<Float64>(kai::get_timestamp_frequency());
+
+    Uint64 raster_start = kai::get_timestamp();
+
+    if(frame_stats.bin_entries > 0) {
+        soft_state.next_tile.store(0, std::memory_order_relaxed);
+
+        {
+            std::lock_guard<std::mutex> lock(soft_state.mutex);
+            soft_state.busy_workers = soft_state.worker_count;
+            soft_state.job++;
+        }
+
+        soft_state.work_ready.notify_all();
+        rasterize_tiles();
+
+        std::unique_lock<std::mutex> lock(soft_state.mutex);
+        soft_state.work_done.wait(lock, []() { return soft_state.busy_workers == 0; });
+    }
+
+    for(Uint32 i = 0; i < d->tiles_x * d->tiles_y; i++) {
+        d->bins[i].size = 0;
+    }
+
+    d->triangles.size = 0;
+    d->clears.size = 0;
+
+    Uint64 now = kai::get_timestamp();
+    frame_stats.raster_ms = static_cast<Float64>(now - raster_start) * 1000.0 / frequency;
+
+    if(d->last_present) {
+        frame_stats.frame_ms = static_cast<Float64>(now - d->last_present) * 1000.0 / frequency;
+    }
+
+    d->last_present = now;
+
+    // The frame is finished once present() returns, so no frame is ever in flight
+    if(constant_ring) {
+        constant_ring->next_frame();
+    }
+
+    retire_resources();
+
+    last_frame_stats = frame_stats;
+    frame_stats = {};
+
+    finish_frame_counters();
+}
+
+void SoftRenderer::set_viewport(Int32 x, Int32 y, Uint32 width, Uint32 height) const {
+    SoftDeviceData *d = static_cast<SoftDeviceData *>(data);
+
+    // Unlike the other backends the size defaults to the frame's, since there's no window
+    width = (width > 0) ? width : d->width;
+    height = (height > 0) ? height : d->height;
+
+    Int32 x0 = kai::max(x, 0);
+    Int32 y0 = kai::max(y, 0);
+    Int32 x1 = kai::min(x + static_cast<Int32>(width), static_cast<Int32>(d->width));
+    Int32 y1 = kai::min(y + static_cast<Int32>(height), static_cast<Int32>(d->height));
+
+    d->viewport[0] = x0;
+    d->viewport[1] = y0;
+    d->viewport[2] = kai::max(x1 - x0, 0);
+    d->viewport[3] = kai::max(y1 - y0, 0);
+}
+
+bool SoftRenderer::compile_shader(const char *shader_stream, kai::ShaderType type,
+                                  const char *entry, void *out_id, void **bytecode) const {
+    if(!shader_stream || !entry) {
+        kai::log("Software renderer: a shader needs both its source and entry point!\n");
+        return false;
+    }
+
+    // The shaders are replaced by the fixed function, the source only gets hashed so that the same shader always gets the same id
+    Uint64 hash = kai::fnv1a64_str_hash(shader_stream) ^ (kai::fnv1a64_str_hash(entry) * 31);
+    hash += static_cast<Uint64>(type) + 1;
+
+    if(out_id) {
+        *static_cast<uintptr_t *>(out_id) = static_cast<uintptr_t>(hash);
+    }
+
+    if(bytecode) {
+        *bytecode = nullptr;
+    }
+
+    return true;
+}
+
+// A baked shader has no source, so its bytecode gets hashed instead to give it a stable id as well
+static bool create_soft_shader(const SoftRenderer *device, const char *source, const char *entry, const void *bytecode,
+                               Uint32 bytecode_size, kai::ShaderType type, void *out_id) {
+    if(bytecode) {
+        *static_cast<uintptr_t *>(out_id) = static_cast<uintptr_t>(hash_shader_bytecode(bytecode, bytecode_size, type));
+        return true;
+    }
+
+    return device->compile_shader(source, type, entry, out_id);
+}
+
+bool SoftRenderer::create_render_pipeline(const kai::RenderPipelineInfo &info, const kai::RenderInputLayoutInfo *input_layouts,
+                                          Uint32 input_layout_count, kai::RenderPipeline &out_pipeline) const {
+    if(input_layout_count > 0 && !input_layouts) {
+        return false;
+    }
+
+    Uint32 position_offset = 0;
+    for(Uint32 i = 0; i < input_layout_count; i++) {
+        const kai::RenderInputLayoutInfo &layout = input_layouts[i];
+
+        if(!layout.per_instance && layout.name && !strcmp(layout.name, "POSITION")) {
+            if(layout.format != kai::RenderFormat::rgb_f32 && layout.format != kai::RenderFormat::rgba_f32) {
+                kai::log("The software renderer only supports 32-bit float positions!\n");
+                return false;
+            }
+
+            position_offset = layout.offset;
+            break;
+        }
+    }
+
+    Uint64 key = hash_pipeline(info, input_layouts, input_layout_count);
+    if(acquire_cached_pipeline(this, key, out_pipeline)) {
+        return true;
+    }
+
+    SoftRenderPipelineData *soft_pipeline = static_cast<SoftRenderPipelineData *>(soft_state.pipelines_pool.alloc());
+
+    if(!soft_pipeline) {
+        kai::log("Could not create a new render pipeline object!\n");
+        return false;
+    }
+
+    if(!create_soft_shader(this, info.vertex_shader_source, info.vertex_shader_entry, info.vertex_shader_bytecode,
+                           info.vertex_shader_bytecode_size, kai::ShaderType::vertex, &soft_pipeline->vertex_shader) ||
+       !create_soft_shader(this, info.pixel_shader_source, info.pixel_shader_entry, info.pixel_shader_bytecode,
+                           info.pixel_shader_bytecode_size, kai::ShaderType::pixel, &soft_pipeline->pixel_shader)) {
+        soft_state.pipelines_pool.free(soft_pipeline);
+        return false;
+    }
+
+    Uint32 handle = soft_state.pipelines.add(soft_pipeline);
+    if(!handle) {
+        soft_state.pipelines_pool.free(soft_pipeline);
+        return false;
+    }
+
+    soft_pipeline->topology = info.topology;
+    soft_pipeline->cull_mode = info.cull_mode;
+    soft_pipeline->front_ccw = info.front_ccw;
+    soft_pipeline->color_enable = info.color_enable;
+    soft_pipeline->depth_enable = info.depth_enable;
+    soft_pipeline->clear_color = pack_rgba8(info.color_clear_values[0], info.color_clear_values[1],
+                                            info.color_clear_values[2], info.color_clear_values[3]);
+    soft_pipeline->depth_clear = info.depth_clear_value;
+    kai::clamp(soft_pipeline->depth_clear, 0.0f, 1.0f);
+    soft_pipeline->position_offset = position_offset;
+
+    out_pipeline.handle = handle;
+    add_cached_pipeline(this, key, out_pipeline);
+
+    return true;
+}
+
+void SoftRenderer::destroy_render_pipeline(kai::RenderPipeline &pipeline) {
+    if(!release_cached_pipeline(pipeline)) {
+        memset(&pipeline, 0, sizeof(pipeline));
+        return;
+    }
+
+    SoftDeviceData *d = static_cast<SoftDeviceData *>(data);
+    SoftRenderPipelineData *p = static_cast<SoftRenderPipelineData *>(soft_state.pipelines.remove(pipeline.handle));
+
+    if(!p) {
+        kai::log("Tried to destroy a render pipeline with a stale or null handle!\n");
+        return;
+    }
+
+    if(d->active_pipeline == p) {
+        d->active_pipeline = nullptr;
+    }
+
+    soft_state.pipelines_pool.free(p);
+
+    memset(&pipeline, 0, sizeof(pipeline));
+}
+
+void SoftRenderer::set_render_pipeline(const kai::RenderPipeline &pipeline) const {
+    static_cast<SoftDeviceData *>(data)->active_pipeline = static_cast<SoftRenderPipelineData *>(soft_state.pipelines.get(pipeline.handle));
+    frame_counters.pipeline_binds++;
+}
+
+bool SoftRenderer::create_buffer(const kai::RenderBufferInfo &info, kai::RenderBuffer &out_buffer) const {
+    kai::ArenaAllocator arena(sizeof(SoftBufferData) + info.byte_size);
+    SoftBufferData *buffer = static_cast<SoftBufferData *>(arena.get_buffer());
+
+    if(!buffer) {
+        kai::log("Could not allocate a buffer of %zu bytes!\n", info.byte_size);
+        return false;
+    }
+
+    buffer->arena = arena;
+    buffer->byte_size = static_cast<Uint32>(info.byte_size);
+    buffer->stride = info.stride;
+    buffer->type = info.type;
+
+    if(info.data) {
+        memcpy(buffer->data, info.data, info.byte_size);
+    } else {
+        memset(buffer->data, 0, info.byte_size);
+    }
+
+    out_buffer.handle = soft_state.buffers.add(buffer);
+    if(!out_buffer.handle) {
+        arena.destroy();
+        return false;
+    }
+
+    buffer_bytes[static_cast<Uint32>(info.type)] += info.byte_size;
+
+    return true;
+}
+
+void SoftRenderer::destroy_buffer(kai::RenderBuffer &buffer) {
+    SoftDeviceData *d = static_cast<SoftDeviceData *>(data);
+    SoftBufferData *b = static_cast<SoftBufferData *>(soft_state.buffers.remove(buffer.handle));
+
+    if(!b) {
+        kai::log("Tried to destroy a buffer with a stale or null handle!\n");
+        return;
+    }
+
+    if(d->vertex_buffer == b) {
+        d->vertex_buffer = nullptr;
+    }
+
+    if(d->index_buffer == b) {
+        d->index_buffer = nullptr;
+    }
+
+    if(d->vertex_constants == b->data) {
+        d->vertex_constants = nullptr;
+        d->vertex_constant_size = 0;
+    }
+
+    buffer_bytes[static_cast<Uint32>(b->type)] -= b->byte_size;
+
+    kai::ArenaAllocator arena = b->arena;
+    arena.destroy();
+
+    memset(&buffer, 0, sizeof(buffer));
+}
+
+bool SoftRenderer::update_buffer(const kai::RenderBuffer &buffer, const void *contents, Uint32 bytes) const {
+    SoftBufferData *b = static_cast<SoftBufferData *>(soft_state.buffers.get(buffer.handle));
+
+    if(!b) {
+        kai::log("Tried to update a buffer with a stale or null handle!\n");
+        return false;
+    }
+
+    if(bytes > b->byte_size) {
+        kai::log("Tried to write %u bytes into a buffer of %u bytes!\n", bytes, b->byte_size);
+        return false;
+    }
+
+    memcpy(b->data, contents, bytes);
+    frame_counters.buffer_bytes_updated += bytes;
+
+    return true;
+}
+
+bool SoftRenderer::create_texture(const kai::RenderTextureInfo &info, kai::RenderTexture &out_texture) const {
+    Uint32 pixel_size = kai::get_format_size(info.format);
+    Uint32 block_size = kai::get_format_block_size(info.format);
+
+    if(!info.width || !info.height || !pixel_size || info.width % block_size || info.height % block_size || !info.mip_count ||
+       info.mip_count > KAI_TEXTURE_MAX_MIPS || info.mip_count > kai::get_mip_count(info.width, info.height)) {
+        kai::log("Invalid size, format or mip count for a texture!\n");
+        return false;
+    }
+
+    Uint64 byte_size = kai::get_texture_size(info.format, info.width, info.height, info.mip_count);
+    kai::ArenaAllocator arena(sizeof(SoftTextureData) + byte_size);
+    SoftTextureData *texture = static_cast<SoftTextureData *>(arena.get_buffer());
+
+    if(!texture) {
+        kai::log("Could not allocate a %ux%u texture!\n", info.width, info.height);
+        return false;
+    }
+
+    texture->arena = arena;
+    texture->width = info.width;
+    texture->height = info.height;
+    texture->mip_count = info.mip_count;
+    texture->byte_size = static_cast<Uint32>(byte_size);
+    texture->format = info.format;
+
+    if(info.data) {
+        memcpy(texture->data, info.data, byte_size);
+    } else {
+        memset(texture->data, 0, byte_size);
+    }
+
+    out_texture.handle = soft_state.textures.add(texture);
+    if(!out_texture.handle) {
+        arena.destroy();
+        return false;
+    }
+
+    texture_bytes += byte_size;
+
+    return true;
+}
+
+void SoftRenderer::destroy_texture(kai::RenderTexture &texture) {
+    SoftTextureData *t = static_cast<SoftTextureData *>(soft_state.textures.remove(texture.handle));
+
+    if(!t) {
+        kai::log("Tried to destroy a texture with a stale or null handle!\n");
+        return;
+    }
+
+    texture_bytes -= t->byte_size;
+
+    kai::ArenaAllocator arena = t->arena;
+    arena.destroy();
+
+    memset(&texture, 0, sizeof(texture));
+}
+
+bool SoftRenderer::update_texture(const kai::RenderTexture &texture, Uint32 x, Uint32 y, Uint32 width, Uint32 height,
+                                  const void *contents) const {
+    SoftTextureData *t = static_cast<SoftTextureData *>(soft_state.textures.get(texture.handle));
+
+    if(!t) {
+        kai::log("Tried to update a texture with a stale or null handle!\n");
+        return false;
+    }
+
+    if(x > t->width || width > t->width - x || y > t->height || height > t->height - y) {
+        kai::log("Tried to write %ux%u pixels at %u, %u into a %ux%u texture!\n", width, height, x, y, t->width, t->height);
+        return false;
+    }
+
+    Uint32 block_size = kai::get_format_block_size(t->format);
+    if(x % block_size || y % block_size || width % block_size || height % block_size) {
+        kai::log("Tried to write %ux%u pixels at %u, %u that aren't whole blocks of a texture!\n", width, height, x, y);
+        return false;
+    }
+
+    // In rows of blocks, which are rows of pixels for the formats that aren't block-compressed
+    Uint32 pixel_size = kai::get_format_size(t->format);
+    Uint32 row_size = width / block_size * pixel_size;
+    Uint32 pitch = t->width / block_size * pixel_size;
+    const Uint8 *src = static_cast<const Uint8 *>(contents);
+    Uint8 *dst = t->data + static_cast<size_t>(y / block_size) * pitch + x / block_size * pixel_size;
+
+    for(Uint32 row = 0; row < height / block_size; row++) {
+        memcpy(dst, src, row_size);
+        src += row_size;
+        dst += pitch;
+    }
+
+    frame_counters.texture_bytes_updated += row_size * (height / block_size);
+
+    return true;
+}
+
+const Uint32 * SoftRenderer::get_frame(void) const {
+    return static_cast<const SoftDeviceData *>(data)->color;
+}
+
+Uint32 SoftRenderer::get_frame_pitch(void) const {
+    return static_cast<const SoftDeviceData *>(data)->pitch;
+}
+
+Uint32 SoftRenderer::get_width(void) const {
+    return static_cast<const SoftDeviceData *>(data)->width;
+}
+
+Uint32 SoftRenderer::get_height(void) const {
+    return static_cast<const SoftDeviceData *>(data)->height;
+}
+
+Uint32 SoftRenderer::get_thread_count(void) const {
+    return soft_state.worker_count + 1;
+}
+
+bool SoftRenderer::save_frame(const char *path) const {
+    const SoftDeviceData *d = static_cast<const SoftDeviceData *>(data);
+
+    FILE *file = fopen(path, "wb");
+    if(!file) {
+        kai::log("Could not open %s for writing!\n", path);
+        return false;
+    }
+
+    // Uncompressed true-color image, 8 bits of alpha and the first row at the top
+    Uint8 header[18] = {};
+    header[2] = 2;
+    header[12] = static_cast<Uint8>(d->width & 0xff);
+    header[13] = static_cast<Uint8>(d->width >> 8);
+    header[14] = static_cast<Uint8>(d->height & 0xff);
+    header[15] = static_cast<Uint8>(d->height >> 8);
+    header[16] = 32;
+    header[17] = 0x28;
+
+    kai::StackAllocator row_memory(d->width * 4);
+    Uint8 *row = static_cast<Uint8 *>(row_memory.get_data());
+    bool retval = row && fwrite(header, sizeof(header), 1, file) == 1;
+
+    for(Uint32 y = 0; retval && y < d->height; y++) {
+        const Uint32 *pixels = d->color + static_cast<size_t>(y) * d->pitch;
+
+        // TGA stores the pixels as BGRA
+        for(Uint32 x = 0; x < d->width; x++) {
+            row[x * 4 + 0] = static_cast<Uint8>(pixels[x] >> 16);
+            row[x * 4 + 1] = static_cast<Uint8>(pixels[x] >> 8);
+            row[x * 4 + 2] = static_cast<Uint8>(pixels[x]);
+            row[x * 4 + 3] = static_cast<Uint8>(pixels[x] >> 24);
+        }
+
+        retval = fwrite(row, d->width * 4, 1, file) == 1;
+    }
+
+    row_memory.destroy();
+    fclose(file);
+
+    if(!retval) {
+        kai::log("Could not write the frame to %s!\n", path);
+    }
+
+    return retval;
+}
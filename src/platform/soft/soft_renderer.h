@@ -0,0 +1,95 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+#ifndef KAI_SOFT_RENDERER_H
+#define KAI_SOFT_RENDERER_H
+
+#include "../../core/includes/kai.h"
+
+void init_soft_renderer(void);
+void destroy_soft_renderer(void);
+
+// The device renders into its own 'width' x 'height' RGBA8 frame. A 'thread_count' of 0 uses every core
+kai::RenderDevice * soft_renderer_init_device(kai::StackAllocator &allocator, Uint32 width, Uint32 height,
+                                              Uint32 thread_count = 0);
+
+struct SoftFrameStats {
+    Uint32 draws;
+    Uint32 triangles; // Triangles that made it into the tile bins
+    Uint32 triangles_culled; // Backfacing, degenerate, off screen or closer than the near plane
+    Uint32 bin_entries; // Triangles and clears across all of the tiles
+    Uint32 clears_skipped; // Without a live pipeline, which holds the clear values
+
+    Float64 execute_ms; // Vertex transform, triangle setup and binning
+    Float64 raster_ms; // Rasterizing the tiles on all threads
+    Float64 frame_ms; // Time between the last two present() calls
+};
+
+// CPU backend for machines without a GPU, e.g. for thumbnails or visual tests on servers.
+//
+// There's no way to run the HLSL shaders on the CPU, so every pipeline is replaced by the same
+// fixed function:
+//  - The position is read as 3 floats from the input layout named "POSITION" (offset 0 without one)
+//  - The constants bound to the vertex shader start with a column-major Mat4x4 that transforms it into
+//    clip space, optionally followed by a float4 color. Without constants the positions already are in
+//    clip space and the color is white
+//  - For instanced draws with instance data, the InstanceTransform is applied before that matrix
+//  - Triangles are flat shaded with a fixed light in object space. Only triangle lists and strips
+//    are drawn, triangles are clipped against the near plane and scissored to the viewport
+//  - Textures can be created and bound, but they aren't sampled
+//
+// execute() transforms the vertices (SIMD, 4 lanes per vertex), sets up the triangles and bins them
+// into 64x64 pixel tiles. present() rasterizes all tiles in parallel, each tile in the order its
+// triangles and clears were binned, with a depth test against a 32-bit float depth buffer.
+struct SoftRenderer : public kai::RenderDevice {
+    SoftRenderer(void) = default;
+
+    void destroy(void) override;
+
+    using kai::RenderDevice::execute;
+    void execute(const kai::CommandBuffer &command_buffer) const override;
+    void present(void) const override;
+
+    void set_viewport(Int32 x, Int32 y, Uint32 width = 0, Uint32 height = 0) const override;
+
+    bool compile_shader(const char *shader_stream, kai::ShaderType type,
+                        const char *entry, void *out_id, void **bytecode = nullptr) const override;
+
+    bool create_render_pipeline(const kai::RenderPipelineInfo &info, const kai::RenderInputLayoutInfo *input_layouts,
+                                Uint32 input_layout_count, kai::RenderPipeline &out_pipeline) const override;
+    void destroy_render_pipeline(kai::RenderPipeline &pipeline) override;
+    void set_render_pipeline(const kai::RenderPipeline &pipeline) const override;
+
+    bool create_buffer(const kai::RenderBufferInfo &info, kai::RenderBuffer &out_buffer) const override;
+    void destroy_buffer(kai::RenderBuffer &buffer) override;
+    bool update_buffer(const kai::RenderBuffer &buffer, const void *contents, Uint32 bytes) const override;
+
+    bool create_texture(const kai::RenderTextureInfo &info, kai::RenderTexture &out_texture) const override;
+    void destroy_texture(kai::RenderTexture &texture) override;
+    bool update_texture(const kai::RenderTexture &texture, Uint32 x, Uint32 y, Uint32 width, Uint32 height,
+                        const void *contents) const override;
+
+    const SoftFrameStats & get_frame_stats(void) const {
+        return last_frame_stats;
+    }
+
+    // The last presented frame, RGBA8 with 'get_frame_pitch()' pixels per row
+    const Uint32 * get_frame(void) const;
+    Uint32 get_frame_pitch(void) const;
+    Uint32 get_width(void) const;
+    Uint32 get_height(void) const;
+
+    // Including the thread that calls present()
+    Uint32 get_thread_count(void) const;
+
+    // Writes the last presented frame as an uncompressed 32-bit TGA
+    bool save_frame(const char *path) const;
+
+private:
+    mutable SoftFrameStats frame_stats = {};
+    mutable SoftFrameStats last_frame_stats = {};
+};
+
+#endif /* KAI_SOFT_RENDERER_H */
@@ -5,8 +5,10 @@
 
 #include "win32_dx11.h"
 #include "../platform.h"
+#include "../../core/pipeline_cache_internal.h"
 
 #include <d3d11.h>
+#include <d3d11_1.h>
 #include <dxgi.h>
 #include <d3dcompiler.h>
 #include <malloc.h>
@@ -18,27 +20,152 @@ struct DX11DeviceData {
     ID3D11DeviceContext *context;
     IDXGISwapChain *swap_chain;
     ID3D11RenderTargetView *render_target_view;
+
+    // Holds the instance data of the CommandBuffer that is being executed
+    ID3D11Buffer *instance_buffer;
+    Uint32 instance_buffer_size;
+
+    // The GPU side of the constant ring buffer. Binding slices of it needs D3D 11.1, without it every bind of a
+    // slice is copied into the scratch buffer instead
+    ID3D11DeviceContext1 *context1;
+    ID3D11Buffer *constant_ring_buffer;
+    ID3D11Buffer *constant_scratch_buffer;
+    Bool32 constant_ring_mapped;
+
+    ID3D11Query *frame_fences[FRAMES_IN_FLIGHT];
+    Uint32 frame;
+
+    // Linear filtering with wrapping, set on every texture slot once
+    ID3D11SamplerState *sampler;
 };
 
 #define DX11_RENDER_PIPELINE_POOL_COUNT 32
 
 struct DX11RenderPipelineData {
+    ID3D11VertexShader *vertex_shader;
+    ID3D11PixelShader *pixel_shader;
     ID3D11RasterizerState *rasterizer_state;
     ID3D11InputLayout *input_layout;
     ID3D11DepthStencilView *depth_stencil_view;
     D3D11_PRIMITIVE_TOPOLOGY topology;
+    kai::RenderPipelineInfo::TopologyType kai_topology;
     Float32 clear_color[4];
     Float32 depth_clear;
     Uint32 stencil_clear;
 };
 
+#define DX11_BUFFER_POOL_COUNT 1024
+
+struct DX11BufferData {
+    ID3D11Buffer *buffer;
+    Uint32 stride;
+    Uint32 byte_size;
+    kai::RenderBufferType type;
+};
+
+#define DX11_TEXTURE_POOL_COUNT 256
+
+struct DX11TextureData {
+    ID3D11Texture2D *texture;
+    ID3D11ShaderResourceView *view;
+    Uint32 width;
+    Uint32 height;
+    Uint32 pixel_size; // Of a block for the block-compressed formats
+    Uint32 block_size;
+    Uint32 byte_size;
+};
+
+#define DX11_MAX_POOL_PAGES 16
+
+// A pool of backend objects that grows with their RenderHandleTable: when all of its pages are full it adds another
+// one as large as all of the ones before, up to as many objects as there are handles. Objects never move, so the
+// tables can keep pointing at them. The *_POOL_COUNT defines are the size of the first page
+struct DX11ObjectPool {
+    void init(Uint32 object_size, Uint32 first_page_count, const char *pool_name) {
+        size = object_size;
+        capacity = 0;
+        page_count = 0;
+        name = pool_name;
+        add_page(first_page_count);
+    }
+
+    void destroy(void) {
+        for(Uint32 i = 0; i < page_count; i++) {
+            pages[i].destroy();
+        }
+
+        page_count = 0;
+        capacity = 0;
+    }
+
+    // The objects are zeroed, so the COM pointers that a create function doesn't get to are null
+    void * alloc(void) {
+        void *object = nullptr;
+
+        // The newest page is the largest one and the most likely to have space
+        for(Uint32 i = page_count; i > 0 && !object; i--) {
+            object = pages[i - 1].alloc();
+        }
+
+        if(!object) {
+            // No more objects than there are handles
+            Uint32 count = kai::min(capacity, RENDER_HANDLE_INDEX_MASK + 1 - capacity);
+            if(page_count == DX11_MAX_POOL_PAGES || count < 2 || !add_page(count)) {
+                kai::log("Ran out of %s objects, the limit is %u!\n", name, capacity);
+                return nullptr;
+            }
+
+            object = pages[page_count - 1].alloc();
+        }
+
+        if(object) {
+            memset(object, 0, size);
+        }
+
+        return object;
+    }
+
+    // Every page has the same layout and lives until destroy(), so the object can go into the free list of any of them
+    void free(void *object) {
+        pages[page_count - 1].free(object);
+    }
+
+    bool add_page(Uint32 count) {
+        kai::PoolAllocator page(size, count);
+
+        // A pool that couldn't get its memory has nothing to hand out
+        void *first = page.alloc();
+        if(!first) {
+            kai::log("Could not allocate %u more %s objects!\n", count, name);
+            page.destroy();
+            return false;
+        }
+
+        page.free(first);
+        pages[page_count++] = page;
+        capacity += count;
+        return true;
+    }
+
+    kai::PoolAllocator pages[DX11_MAX_POOL_PAGES];
+    Uint32 page_count;
+    Uint32 size;
+    Uint32 capacity;
+    const char *name;
+};
+
 static struct {
     IDXGIFactory *factory;
     DX11RenderPipelineData *active_pipeline;
     DX11Renderer renderer;
 
     kai::PoolAllocator devices_pool;
-    kai::PoolAllocator pipelines_pool;
+    DX11ObjectPool pipelines_pool;
+    DX11ObjectPool buffers_pool;
+    DX11ObjectPool textures_pool;
+    RenderHandleTable pipelines; // DX11RenderPipelineData
+    RenderHandleTable buffers; // DX11BufferData
+    RenderHandleTable textures; // DX11TextureData
 } dx11_state;
 
 static void dx11_state_setup(DX11Renderer &renderer) {
@@ -72,6 +199,50 @@ static void dx11_state_setup(DX11Renderer &renderer) {
 
     back_buffer->Release();
 
+    D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+    data->device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+
+    if(options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer) {
+        data->context->QueryInterface(__uuidof(ID3D11DeviceContext1), reinterpret_cast<void **>(&data->context1));
+    }
+
+    D3D11_BUFFER_DESC buffer_desc = {};
+    buffer_desc.ByteWidth = data->context1 ? CONSTANT_RING_SIZE : D3D11_REQ_CONSTANT_BUFFER_ELEMENT_COUNT * 16;
+    buffer_desc.Usage = D3D11_USAGE_DYNAMIC;
+    buffer_desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    buffer_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+    ID3D11Buffer **constant_buffer = data->context1 ? &data->constant_ring_buffer : &data->constant_scratch_buffer;
+    if(data->device->CreateBuffer(&buffer_desc, nullptr, constant_buffer) != S_OK) {
+        kai::log("Error: failed creating the constant ring buffer!\n");
+    } else {
+        renderer.constant_ring = create_constant_ring(CONSTANT_RING_SIZE);
+    }
+
+    D3D11_QUERY_DESC query_desc = {};
+    query_desc.Query = D3D11_QUERY_EVENT;
+    for(Uint32 i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        data->device->CreateQuery(&query_desc, &data->frame_fences[i]);
+    }
+
+    D3D11_SAMPLER_DESC sampler_desc = {};
+    sampler_desc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+    sampler_desc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+    sampler_desc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+    sampler_desc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+    sampler_desc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+    sampler_desc.MaxLOD = D3D11_FLOAT32_MAX;
+
+    if(data->device->CreateSamplerState(&sampler_desc, &data->sampler) != S_OK) {
+        kai::log("Error: failed creating the texture sampler!\n");
+    } else {
+        ID3D11SamplerState *samplers[KAI_TEXTURE_SLOT_COUNT];
+        for(ID3D11SamplerState *&sampler : samplers) {
+            sampler = data->sampler;
+        }
+
+        data->context->PSSetSamplers(0, KAI_TEXTURE_SLOT_COUNT, samplers);
+    }
 }
 
 static bool create_dx11_device(DX11Renderer &dx11_renderer, IDXGIAdapter *adapter = nullptr) {
@@ -99,6 +270,15 @@ static bool create_dx11_device(DX11Renderer &dx11_renderer, IDXGIAdapter *adapte
                                      &data->context) == S_OK;
 
     if(success) {
+        data->instance_buffer = nullptr;
+        data->instance_buffer_size = 0;
+        data->context1 = nullptr;
+        data->constant_ring_buffer = nullptr;
+        data->constant_scratch_buffer = nullptr;
+        data->constant_ring_mapped = false;
+        memset(data->frame_fences, 0, sizeof(data->frame_fences));
+        data->frame = 0;
+
         dx11_renderer.data = data;
         dx11_state_setup(dx11_renderer);
     } else {
@@ -188,109 +368,327 @@ void DX11Renderer::destroy(void) {
     d->swap_chain->Release();
     d->render_target_view->Release();
 
+#define RELEASE_IF_NEEDED(item) \
+    if(item) { \
+        item->Release(); \
+    }
+
+    RELEASE_IF_NEEDED(d->instance_buffer);
+    RELEASE_IF_NEEDED(d->context1);
+    RELEASE_IF_NEEDED(d->constant_ring_buffer);
+    RELEASE_IF_NEEDED(d->constant_scratch_buffer);
+    for(Uint32 i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        RELEASE_IF_NEEDED(d->frame_fences[i]);
+    }
+    RELEASE_IF_NEEDED(d->sampler);
+
+#undef RELEASE_IF_NEEDED
+
+    destroy_constant_ring(constant_ring);
+
     dx11_state.devices_pool.free(d);
 
     memset(this, 0, sizeof(*this));
 }
 
-void DX11Renderer::execute(const kai::CommandBuffer &command_buffer) const {
-    KAI_ASSERT(dx11_state.active_pipeline);
+// Uploads the instance data of a CommandBuffer, the buffer only grows
+static bool upload_instance_data(DX11DeviceData *d, const kai::CommandBuffer &command_buffer) {
+    Uint32 size = command_buffer.get_instance_data_size();
 
-    Uint32 offset = 0;
-    auto fetch_next_command = [data = command_buffer.get_data(), &offset](CommandEncoding &encoding, const void **address) {
-        const Uint8 *buffer = static_cast<const Uint8 *>(data) + offset;
-        encoding = *reinterpret_cast<const CommandEncoding *>(buffer);
+    if(size > d->instance_buffer_size) {
+        if(d->instance_buffer) {
+            d->instance_buffer->Release();
+            d->instance_buffer = nullptr;
+        }
 
-        switch(encoding) {
-            case CommandEncoding::draw:
-                offset += sizeof(CommandEncodingData::Draw);
-                break;
-            case CommandEncoding::draw_indexed:
-                offset += sizeof(CommandEncodingData::DrawIndexed);
-                break;
-            case CommandEncoding::bind_buffer:
-                offset += sizeof(CommandEncodingData::BindBuffer);
-                break;
+        Uint32 capacity = kai::max(d->instance_buffer_size * 2, size);
 
-            // These don't have any data, only an id for the command to execute
-            case CommandEncoding::clear_color:
-            case CommandEncoding::clear_depth:
-            case CommandEncoding::clear_stencil:
-            case CommandEncoding::clear_depth_stencil:
-                offset += sizeof(CommandEncoding);
-                break;
+        D3D11_BUFFER_DESC buffer_desc = {};
+        buffer_desc.ByteWidth = capacity;
+        buffer_desc.Usage = D3D11_USAGE_DYNAMIC;
+        buffer_desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+        buffer_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 
-            case CommandEncoding::end:
-            default:
-                return false;
+        if(d->device->CreateBuffer(&buffer_desc, nullptr, &d->instance_buffer) != S_OK) {
+            kai::log("Error: failed creating the instance buffer!\n");
+            d->instance_buffer_size = 0;
+            return false;
         }
 
-        *address = buffer;
-        return true;
-    };
+        d->instance_buffer_size = capacity;
+    }
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if(d->context->Map(d->instance_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped) != S_OK) {
+        return false;
+    }
+
+    memcpy(mapped.pData, command_buffer.get_instance_data(), size);
+    d->context->Unmap(d->instance_buffer, 0);
+
+    return true;
+}
+
+// Copies everything that was allocated from the constant ring buffer since the last upload with a single map
+static Uint32 upload_constants(DX11DeviceData *d, ConstantRing *ring) {
+    Uint32 offsets[2];
+    Uint32 sizes[2];
+    Uint32 count = ring->get_pending_uploads(offsets, sizes);
+
+    // Without D3D 11.1 the slices are copied when they're bound
+    if(count == 0 || !d->context1) {
+        return 0;
+    }
+
+    // NO_OVERWRITE promises not to touch anything the GPU might still read, which the frame fences guarantee.
+    // A dynamic buffer has to be mapped with DISCARD once before that is allowed
+    D3D11_MAP map_type = d->constant_ring_mapped ? D3D11_MAP_WRITE_NO_OVERWRITE : D3D11_MAP_WRITE_DISCARD;
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if(d->context->Map(d->constant_ring_buffer, 0, map_type, 0, &mapped) != S_OK) {
+        return 0;
+    }
+
+    Uint32 bytes = 0;
+    for(Uint32 i = 0; i < count; i++) {
+        memcpy(static_cast<Uint8 *>(mapped.pData) + offsets[i], ring->data + offsets[i], sizes[i]);
+        bytes += sizes[i];
+    }
+
+    d->context->Unmap(d->constant_ring_buffer, 0);
+    d->constant_ring_mapped = true;
+
+    return bytes;
+}
+
+void DX11Renderer::execute(const kai::CommandBuffer &command_buffer) const {
+    Uint64 start_time = kai::get_timestamp();
 
     DX11DeviceData *d = static_cast<DX11DeviceData *>(data);
+    // The clears use the values of the active pipeline, which is either set on the device or in the CommandBuffer
     DX11RenderPipelineData *p = dx11_state.active_pipeline;
 
-    CommandEncoding encoding;
-    const void *address;
-    while(fetch_next_command(encoding, &address)) {
-        switch(encoding) {
+    CommandDecoder decoder(command_buffer, false);
+    if(p) {
+        decoder.set_merge_draws(p->kai_topology);
+    }
+
+    bool has_instance_data = command_buffer.get_instance_data_size() > 0 && upload_instance_data(d, command_buffer);
+
+    if(constant_ring) {
+        frame_counters.constant_bytes_uploaded += upload_constants(d, constant_ring);
+    }
+
+    CommandEncodingData command;
+    while(decoder.next(command)) {
+        frame_counters.commands_executed++;
+
+        switch(command.draw.encoding) {
             case CommandEncoding::draw: {
-                const auto c = static_cast<const CommandEncodingData::Draw *>(address);
+                const auto c = &command.draw;
                 d->context->Draw(c->count, c->start);
+                frame_counters.draws++;
+                frame_counters.vertices += c->count;
                 break;
             }
             case CommandEncoding::draw_indexed: {
-                const auto c = static_cast<const CommandEncodingData::DrawIndexed *>(address);
+                const auto c = &command.draw_indexed;
                 d->context->DrawIndexed(c->count, c->start, c->base);
+                frame_counters.draws++;
+                frame_counters.vertices += c->count;
+                break;
+            }
+            case CommandEncoding::draw_instanced:
+            case CommandEncoding::draw_indexed_instanced: {
+                // Both share the layout up to the base
+                const auto c = &command.draw_indexed_instanced;
+                if(c->instance_stride) {
+                    if(!has_instance_data) {
+                        continue;
+                    }
+
+                    UINT stride = c->instance_stride;
+                    UINT off = c->instance_offset;
+                    d->context->IASetVertexBuffers(1, 1, &d->instance_buffer, &stride, &off);
+                }
+
+                if(c->encoding == CommandEncoding::draw_indexed_instanced) {
+                    d->context->DrawIndexedInstanced(c->count, c->instance_count, c->start, c->base, 0);
+                } else {
+                    d->context->DrawInstanced(c->count, c->instance_count, c->start, 0);
+                }
+
+                frame_counters.draws++;
+                frame_counters.vertices += static_cast<Uint64>(c->count) * c->instance_count;
+                break;
+            }
+            case CommandEncoding::set_render_pipeline: {
+                const auto c = &command.set_render_pipeline;
+                p = static_cast<DX11RenderPipelineData *>(dx11_state.pipelines.get(c->pipeline));
+
+                // The pipeline was destroyed after the command was recorded
+                if(!p) {
+                    p = dx11_state.active_pipeline;
+                    continue;
+                }
+
+                set_render_pipeline({ c->pipeline });
+                decoder.set_merge_draws(p->kai_topology);
                 break;
             }
             case CommandEncoding::bind_buffer: {
-                const auto c = static_cast<const CommandEncodingData::BindBuffer *>(address);
-                Uint32 stride = c->buffer->stride;
+                const auto c = &command.bind_buffer;
+                const DX11BufferData *b = static_cast<const DX11BufferData *>(dx11_state.buffers.get(c->buffer));
+
+                if(!b) {
+                    continue;
+                }
+
+                ID3D11Buffer *buffer = b->buffer;
+                Uint32 stride = b->stride;
                 Uint32 off = 0;
                 switch(c->type) {
                     case kai::RenderBufferType::vertex:
-                        d->context->IASetVertexBuffers(0, 1, &static_cast<ID3D11Buffer *>(c->buffer->data), &stride, &off);
+                        d->context->IASetVertexBuffers(0, 1, &buffer, &stride, &off);
+                        break;
+                    case kai::RenderBufferType::index:
+                        d->context->IASetIndexBuffer(buffer,
+                                                     (stride == 2) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, 0);
                         break;
                     case kai::RenderBufferType::constant:
                         if(c->shader_type == kai::ShaderType::vertex) {
-                            d->context->VSSetConstantBuffers(0, 1, &static_cast<ID3D11Buffer *>(c->buffer->data));
+                            d->context->VSSetConstantBuffers(0, 1, &buffer);
                         } else if(c->shader_type == kai::ShaderType::pixel) {
-                            d->context->PSSetConstantBuffers(0, 1, &static_cast<ID3D11Buffer *>(c->buffer->data));
+                            d->context->PSSetConstantBuffers(0, 1, &buffer);
                         }
                         break;
                     default:
                         break;
                 }
+
+                frame_counters.buffer_binds++;
+                break;
+            }
+            case CommandEncoding::bind_texture: {
+                const auto c = &command.bind_texture;
+                const DX11TextureData *t = static_cast<const DX11TextureData *>(dx11_state.textures.get(c->texture));
+
+                if(!t) {
+                    continue;
+                }
+
+                ID3D11ShaderResourceView *view = t->view;
+                d->context->PSSetShaderResources(c->slot, 1, &view);
+                frame_counters.texture_binds++;
+                break;
+            }
+
+            case CommandEncoding::bind_constants: {
+                const auto c = &command.bind_constants;
+                KAI_ASSERT(constant_ring);
+                frame_counters.constant_binds++;
+
+                ID3D11Buffer *buffer = d->constant_ring_buffer;
+                UINT first_constant = c->offset / 16;
+                UINT constant_count = c->size / 16;
+
+                if(d->context1) {
+                    if(c->shader_type == kai::ShaderType::vertex) {
+                        d->context1->VSSetConstantBuffers1(0, 1, &buffer, &first_constant, &constant_count);
+                    } else {
+                        d->context1->PSSetConstantBuffers1(0, 1, &buffer, &first_constant, &constant_count);
+                    }
+
+                    break;
+                }
+
+                buffer = d->constant_scratch_buffer;
+                Uint32 bytes = kai::min<Uint32>(c->size, D3D11_REQ_CONSTANT_BUFFER_ELEMENT_COUNT * 16);
+
+                D3D11_MAPPED_SUBRESOURCE mapped;
+                if(d->context->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped) != S_OK) {
+                    continue;
+                }
+
+                memcpy(mapped.pData, constant_ring->data + c->offset, bytes);
+                d->context->Unmap(buffer, 0);
+                frame_counters.constant_bytes_uploaded += bytes;
+
+                if(c->shader_type == kai::ShaderType::vertex) {
+                    d->context->VSSetConstantBuffers(0, 1, &buffer);
+                } else {
+                    d->context->PSSetConstantBuffers(0, 1, &buffer);
+                }
+
                 break;
             }
 
             case CommandEncoding::clear_color:
-                d->context->ClearRenderTargetView(d->render_target_view, p->clear_color);
+                // The clear values come from the active pipeline, which may have been destroyed after the recording
+                if(p) {
+                    d->context->ClearRenderTargetView(d->render_target_view, p->clear_color);
+                }
                 break;
             case CommandEncoding::clear_depth:
-                d->context->ClearDepthStencilView(p->depth_stencil_view, D3D11_CLEAR_DEPTH,
-                                                  p->depth_clear, 0);
+                // Only pipelines with depth enabled have a depth stencil view
+                if(p && p->depth_stencil_view) {
+                    d->context->ClearDepthStencilView(p->depth_stencil_view, D3D11_CLEAR_DEPTH,
+                                                      p->depth_clear, 0);
+                }
                 break;
             case CommandEncoding::clear_stencil:
-                d->context->ClearDepthStencilView(p->depth_stencil_view, D3D11_CLEAR_STENCIL,
-                                                  0.0f, static_cast<Uint8>(p->stencil_clear));
+                if(p && p->depth_stencil_view) {
+                    d->context->ClearDepthStencilView(p->depth_stencil_view, D3D11_CLEAR_STENCIL,
+                                                      0.0f, static_cast<Uint8>(p->stencil_clear));
+                }
                 break;
             case CommandEncoding::clear_depth_stencil:
-                d->context->ClearDepthStencilView(p->depth_stencil_view, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL,
-                                                  p->depth_clear, static_cast<Uint8>(p->stencil_clear));
+                if(p && p->depth_stencil_view) {
+                    d->context->ClearDepthStencilView(p->depth_stencil_view, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL,
+                                                      p->depth_clear, static_cast<Uint8>(p->stencil_clear));
+                }
                 break;
 
             default:
                 continue;
         }
     }
+
+    frame_counters.binds_elided += command_buffer.get_elided_count();
+    frame_counters.draws_merged += decoder.merged_draw_count;
+    frame_counters.draws_instanced += command_buffer.get_auto_instanced_count();
+    frame_counters.command_bytes += command_buffer.get_size();
+
+    frame_counters.execute_ms += static_cast<Float64>(kai::get_timestamp() - start_time) * 1000.0 /
+                                 static_cast<Float64>(kai::get_timestamp_frequency());
 }
 
 void DX11Renderer::present(void) const {
-    static_cast<DX11DeviceData *>(data)->swap_chain->Present(1, 0);
+    DX11DeviceData *d = static_cast<DX11DeviceData *>(data);
+    d->swap_chain->Present(1, 0);
+
+    // Fences the end of this frame and waits for the frame that goes out of flight, so that the constant ring
+    // buffer can reuse its memory
+    if(d->frame_fences[d->frame % FRAMES_IN_FLIGHT]) {
+        d->context->End(d->frame_fences[d->frame % FRAMES_IN_FLIGHT]);
+    }
+
+    d->frame++;
+
+    ID3D11Query *fence = d->frame_fences[d->frame % FRAMES_IN_FLIGHT];
+    if(fence && d->frame >= FRAMES_IN_FLIGHT) {
+        while(d->context->GetData(fence, nullptr, 0, 0) == S_FALSE) {
+            YieldProcessor();
+        }
+    }
+
+    if(constant_ring) {
+        constant_ring->next_frame();
+    }
+
+    retire_resources();
+
+    finish_frame_counters();
 }
 
 void DX11Renderer::set_viewport(Int32 x, Int32 y, Uint32 width, Uint32 height) const {
@@ -309,12 +707,9 @@ void DX11Renderer::set_viewport(Int32 x, Int32 y, Uint32 width, Uint32 height) c
     static_cast<DX11DeviceData *>(data)->context->RSSetViewports(1, &viewport);
 }
 
-bool DX11Renderer::compile_shader(const char *shader_stream, kai::ShaderType type,
-                                  const char *entry, void *out_id, void **bytecode) const {
-    DX11DeviceData *d = static_cast<DX11DeviceData *>(data);
-
-    ID3DBlob *buffer = nullptr;
-    ID3DBlob *error = nullptr;
+// Looks the bytecode up in the shader cache and only compiles the shader if it isn't in there yet
+static bool get_dx11_bytecode(const char *shader_stream, kai::ShaderType type, const char *entry,
+                              const void *&out_bytecode, Uint32 &out_size) {
     UINT compile_flags = D3DCOMPILE_PACK_MATRIX_COLUMN_MAJOR;
 #ifdef KAI_DEBUG
     compile_flags |= D3DCOMPILE_DEBUG;
@@ -326,22 +721,44 @@ bool DX11Renderer::compile_shader(const char *shader_stream, kai::ShaderType typ
         case kai::ShaderType::pixel: version = "ps_5_0"; break;
     }
 
+    Uint64 key = hash_shader(shader_stream, entry, type, version, compile_flags);
+    if(find_shader_bytecode(key, out_bytecode, out_size)) {
+        return true;
+    }
+
+    ID3DBlob *buffer = nullptr;
+    ID3DBlob *error = nullptr;
+
     D3DCompile(shader_stream, strlen(shader_stream), nullptr, nullptr, nullptr, entry, version,
                compile_flags, 0, &buffer, &error);
 
     if(error) {
         kai::log(static_cast<LPCSTR>(error->GetBufferPointer()));
         error->Release();
+
+        if(buffer) {
+            buffer->Release();
+        }
+
         return false;
     }
 
+    if(!buffer) {
+        return false;
+    }
+
+    out_size = static_cast<Uint32>(buffer->GetBufferSize());
+    bool stored = store_shader_bytecode(key, buffer->GetBufferPointer(), out_size, out_bytecode);
+    buffer->Release();
+
+    return stored;
+}
+
+static void create_dx11_shader(DX11DeviceData *d, kai::ShaderType type, const void *bytecode, Uint32 size, void *out_id) {
     switch(type) {
         case kai::ShaderType::vertex: {
             ID3D11VertexShader *shader;
-            d->device->CreateVertexShader(buffer->GetBufferPointer(),
-                                          buffer->GetBufferSize(),
-                                          nullptr,
-                                          &shader);
+            d->device->CreateVertexShader(bytecode, size, nullptr, &shader);
 
             if(out_id) {
                 *reinterpret_cast<kai::VertexShaderID *>(out_id) = reinterpret_cast<kai::VertexShaderID>(shader);
@@ -351,10 +768,7 @@ bool DX11Renderer::compile_shader(const char *shader_stream, kai::ShaderType typ
         }
         case kai::ShaderType::pixel: {
             ID3D11PixelShader *shader;
-            d->device->CreatePixelShader(buffer->GetBufferPointer(),
-                                         buffer->GetBufferSize(),
-                                         nullptr,
-                                         &shader);
+            d->device->CreatePixelShader(bytecode, size, nullptr, &shader);
 
             if(out_id) {
                 *reinterpret_cast<kai::PixelShaderID *>(out_id) = reinterpret_cast<kai::PixelShaderID>(shader);
@@ -363,11 +777,27 @@ bool DX11Renderer::compile_shader(const char *shader_stream, kai::ShaderType typ
             break;
         }
     }
+}
+
+bool DX11Renderer::compile_shader(const char *shader_stream, kai::ShaderType type,
+                                  const char *entry, void *out_id, void **bytecode) const {
+    const void *code;
+    Uint32 size;
+
+    if(!shader_stream || !entry || !get_dx11_bytecode(shader_stream, type, entry, code, size)) {
+        return false;
+    }
 
+    create_dx11_shader(static_cast<DX11DeviceData *>(data), type, code, size, out_id);
+
+    // The cached bytecode stays with the cache, the caller gets a copy that it releases like before
     if(bytecode && type == kai::ShaderType::vertex) {
-        *bytecode = buffer;
-    } else {
-        buffer->Release();
+        ID3DBlob *blob = nullptr;
+        if(D3DCreateBlob(size, &blob) == S_OK) {
+            memcpy(blob->GetBufferPointer(), code, size);
+        }
+
+        *bytecode = blob;
     }
 
     return true;
@@ -382,15 +812,82 @@ static KAI_FORCEINLINE DXGI_FORMAT get_dxgi_format(kai::RenderFormat format) {
         case kai::RenderFormat::rg_f32: return DXGI_FORMAT_R32G32_FLOAT;
         case kai::RenderFormat::rgb_f32: return DXGI_FORMAT_R32G32B32_FLOAT;
         case kai::RenderFormat::rgba_f32: return DXGI_FORMAT_R32G32B32A32_FLOAT;
+        case kai::RenderFormat::r_f16: return DXGI_FORMAT_R16_FLOAT;
+        case kai::RenderFormat::rg_f16: return DXGI_FORMAT_R16G16_FLOAT;
+        case kai::RenderFormat::rgba_f16: return DXGI_FORMAT_R16G16B16A16_FLOAT;
+        case kai::RenderFormat::r_unorm8: return DXGI_FORMAT_R8_UNORM;
+        case kai::RenderFormat::rg_unorm8: return DXGI_FORMAT_R8G8_UNORM;
+        case kai::RenderFormat::rgba_unorm8: return DXGI_FORMAT_R8G8B8A8_UNORM;
+        case kai::RenderFormat::r_snorm8: return DXGI_FORMAT_R8_SNORM;
+        case kai::RenderFormat::rg_snorm8: return DXGI_FORMAT_R8G8_SNORM;
+        case kai::RenderFormat::rgba_snorm8: return DXGI_FORMAT_R8G8B8A8_SNORM;
+        case kai::RenderFormat::r_unorm16: return DXGI_FORMAT_R16_UNORM;
+        case kai::RenderFormat::rg_unorm16: return DXGI_FORMAT_R16G16_UNORM;
+        case kai::RenderFormat::rgba_unorm16: return DXGI_FORMAT_R16G16B16A16_UNORM;
+        case kai::RenderFormat::r_snorm16: return DXGI_FORMAT_R16_SNORM;
+        case kai::RenderFormat::rg_snorm16: return DXGI_FORMAT_R16G16_SNORM;
+        case kai::RenderFormat::rgba_snorm16: return DXGI_FORMAT_R16G16B16A16_SNORM;
+        case kai::RenderFormat::bc1_unorm: return DXGI_FORMAT_BC1_UNORM;
+        case kai::RenderFormat::bc3_unorm: return DXGI_FORMAT_BC3_UNORM;
+        case kai::RenderFormat::bc4_unorm: return DXGI_FORMAT_BC4_UNORM;
+        case kai::RenderFormat::bc5_unorm: return DXGI_FORMAT_BC5_UNORM;
+        case kai::RenderFormat::bc7_unorm: return DXGI_FORMAT_BC7_UNORM;
         case kai::RenderFormat::unknown: default: return DXGI_FORMAT_UNKNOWN;
 
     }
 }
 
+// Pipelines without depth have no depth stencil view, and any of the other objects may have failed to create.
+// The pool hands out zeroed pipelines, so whatever wasn't created is null
+static void release_pipeline_objects(DX11RenderPipelineData *p) {
+#define RELEASE_IF_NEEDED(item) \
+    if(item) { \
+        item->Release(); \
+        item = nullptr; \
+    }
+
+    RELEASE_IF_NEEDED(p->rasterizer_state);
+    RELEASE_IF_NEEDED(p->input_layout);
+    RELEASE_IF_NEEDED(p->depth_stencil_view);
+    RELEASE_IF_NEEDED(p->vertex_shader);
+    RELEASE_IF_NEEDED(p->pixel_shader);
+
+#undef RELEASE_IF_NEEDED
+}
+
 bool DX11Renderer::create_render_pipeline(const kai::RenderPipelineInfo &info, const kai::RenderInputLayoutInfo *input_layouts,
                                           Uint32 input_layout_count, kai::RenderPipeline &out_pipeline) const {
 
+    Uint64 key = hash_pipeline(info, input_layouts, input_layout_count);
+    if(acquire_cached_pipeline(this, key, out_pipeline)) {
+        return true;
+    }
+
     DX11DeviceData *d = static_cast<DX11DeviceData *>(data);
+    const void *vs_bytecode;
+    const void *ps_bytecode;
+    Uint32 vs_bytecode_size;
+    Uint32 ps_bytecode_size;
+
+    // Baked shaders are already compiled, only the ones that come as source go through the compiler (and its cache)
+    if(info.vertex_shader_bytecode) {
+        vs_bytecode = info.vertex_shader_bytecode;
+        vs_bytecode_size = info.vertex_shader_bytecode_size;
+    } else if(!info.vertex_shader_source || !info.vertex_shader_entry ||
+              !get_dx11_bytecode(info.vertex_shader_source, kai::ShaderType::vertex, info.vertex_shader_entry, vs_bytecode, vs_bytecode_size)) {
+        kai::log("Vertex shader compilation failed!\n");
+        return false;
+    }
+
+    if(info.pixel_shader_bytecode) {
+        ps_bytecode = info.pixel_shader_bytecode;
+        ps_bytecode_size = info.pixel_shader_bytecode_size;
+    } else if(!info.pixel_shader_source || !info.pixel_shader_entry ||
+              !get_dx11_bytecode(info.pixel_shader_source, kai::ShaderType::pixel, info.pixel_shader_entry, ps_bytecode, ps_bytecode_size)) {
+        kai::log("Pixel shader compilation failed!\n");
+        return false;
+    }
+
     DX11RenderPipelineData *dx11_pipeline = static_cast<DX11RenderPipelineData *>(dx11_state.pipelines_pool.alloc());
 
     if(!dx11_pipeline) {
@@ -475,19 +972,8 @@ bool DX11Renderer::create_render_pipeline(const kai::RenderPipelineInfo &info, c
     d->device->CreateRasterizerState(&rasterizer_desc, &dx11_pipeline->rasterizer_state);
 
 
-    ID3DBlob *vs_bytecode;
-    if(!compile_shader(info.vertex_shader_source, kai::ShaderType::vertex, info.vertex_shader_entry,
-                      &out_pipeline.vertex_shader, reinterpret_cast<void **>(&vs_bytecode))) {
-        kai::log("Vertex shader compilation failed!\n");
-        return false;
-    }
-    if(!compile_shader(info.pixel_shader_source, kai::ShaderType::pixel, info.pixel_shader_entry,
-                       &out_pipeline.pixel_shader)) {
-        kai::log("Pixel shader compilation failed!\n");
-        return false;
-    }
-
-    out_pipeline.data = dx11_pipeline;
+    create_dx11_shader(d, kai::ShaderType::vertex, vs_bytecode, vs_bytecode_size, &dx11_pipeline->vertex_shader);
+    create_dx11_shader(d, kai::ShaderType::pixel, ps_bytecode, ps_bytecode_size, &dx11_pipeline->pixel_shader);
 
 
     size_t input_size = sizeof(D3D11_INPUT_ELEMENT_DESC) * input_layout_count;
@@ -498,16 +984,22 @@ bool DX11Renderer::create_render_pipeline(const kai::RenderPipelineInfo &info, c
         input_descs[i].SemanticName = input_layouts[i].name;
         input_descs[i].SemanticIndex = input_layouts[i].index;
         input_descs[i].Format = get_dxgi_format(input_layouts[i].format);
-        input_descs[i].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+        // Per-instance data comes from the instance buffer in slot 1, see DX11Renderer::execute
+        if(input_layouts[i].per_instance) {
+            input_descs[i].InputSlot = 1;
+            input_descs[i].InputSlotClass = D3D11_INPUT_PER_INSTANCE_DATA;
+            input_descs[i].InstanceDataStepRate = 1;
+        } else {
+            input_descs[i].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+        }
+
         input_descs[i].AlignedByteOffset = (input_layouts[i].offset != KAI_INPUT_LAYOUT_APPEND) ?
             input_layouts[i].offset : D3D11_APPEND_ALIGNED_ELEMENT;
     }
 
-    d->device->CreateInputLayout(input_descs, input_layout_count, vs_bytecode->GetBufferPointer(),
-                                 vs_bytecode->GetBufferSize(), &dx11_pipeline->input_layout);
-
-    vs_bytecode->Release();
+    d->device->CreateInputLayout(input_descs, input_layout_count, vs_bytecode, vs_bytecode_size, &dx11_pipeline->input_layout);
 
+    dx11_pipeline->kai_topology = info.topology;
     dx11_pipeline->topology = [topology = info.topology]() {
         switch(topology) {
             case kai::RenderPipelineInfo::TopologyType::point_list: return D3D11_PRIMITIVE_TOPOLOGY_POINTLIST;
@@ -524,17 +1016,36 @@ bool DX11Renderer::create_render_pipeline(const kai::RenderPipelineInfo &info, c
         kai::clamp(dx11_pipeline->clear_color[i], 0.0f, 1.0f);
     }
 
+    out_pipeline.handle = dx11_state.pipelines.add(dx11_pipeline);
+    if(!out_pipeline.handle) {
+        release_pipeline_objects(dx11_pipeline);
+        dx11_state.pipelines_pool.free(dx11_pipeline);
+        return false;
+    }
+
+    add_cached_pipeline(this, key, out_pipeline);
+
     return true;
 }
 
 void DX11Renderer::destroy_render_pipeline(kai::RenderPipeline &pipeline) {
-    DX11RenderPipelineData *p = static_cast<DX11RenderPipelineData *>(pipeline.data);
+    if(!release_cached_pipeline(pipeline)) {
+        memset(&pipeline, 0, sizeof(pipeline));
+        return;
+    }
+
+    DX11RenderPipelineData *p = static_cast<DX11RenderPipelineData *>(dx11_state.pipelines.remove(pipeline.handle));
+
+    if(!p) {
+        kai::log("Tried to destroy a render pipeline with a stale or null handle!\n");
+        return;
+    }
+
+    if(dx11_state.active_pipeline == p) {
+        dx11_state.active_pipeline = nullptr;
+    }
 
-    p->rasterizer_state->Release();
-    p->input_layout->Release();
-    p->depth_stencil_view->Release();
-    reinterpret_cast<ID3D11VertexShader *>(pipeline.vertex_shader)->Release();
-    reinterpret_cast<ID3D11PixelShader *>(pipeline.pixel_shader)->Release();
+    release_pipeline_objects(p);
 
     dx11_state.pipelines_pool.free(p);
 
@@ -543,17 +1054,22 @@ void DX11Renderer::destroy_render_pipeline(kai::RenderPipeline &pipeline) {
 
 void DX11Renderer::set_render_pipeline(const kai::RenderPipeline &pipeline) const {
     DX11DeviceData *d = static_cast<DX11DeviceData *>(data);
-    DX11RenderPipelineData *p = static_cast<DX11RenderPipelineData *>(pipeline.data);
+    DX11RenderPipelineData *p = static_cast<DX11RenderPipelineData *>(dx11_state.pipelines.get(pipeline.handle));
+
+    if(!p) {
+        return;
+    }
 
     d->context->RSSetState(p->rasterizer_state);
-    d->context->VSSetShader(reinterpret_cast<ID3D11VertexShader *>(pipeline.vertex_shader), nullptr, 0);
-    d->context->PSSetShader(reinterpret_cast<ID3D11PixelShader *>(pipeline.pixel_shader), nullptr, 0);
+    d->context->VSSetShader(p->vertex_shader, nullptr, 0);
+    d->context->PSSetShader(p->pixel_shader, nullptr, 0);
     d->context->IASetInputLayout(p->input_layout);
     d->context->IASetPrimitiveTopology(p->topology);
 
     d->context->OMSetRenderTargets(1, &d->render_target_view, p->depth_stencil_view);
 
     dx11_state.active_pipeline = p;
+    frame_counters.pipeline_binds++;
 }
 
 bool DX11Renderer::create_buffer(const kai::RenderBufferInfo &info, kai::RenderBuffer &out_buffer) const {
@@ -587,22 +1103,214 @@ bool DX11Renderer::create_buffer(const kai::RenderBufferInfo &info, kai::RenderB
     D3D11_SUBRESOURCE_DATA subresource = {};
     subresource.pSysMem = info.data;
 
+    // Dynamic buffers are usually created empty and filled with update_buffer()
     ID3D11Buffer *buffer_data;
-    if(static_cast<DX11DeviceData *>(data)->device->CreateBuffer(&buffer_desc, &subresource, &buffer_data) != S_OK) {
+    if(static_cast<DX11DeviceData *>(data)->device->CreateBuffer(&buffer_desc, info.data ? &subresource : nullptr, &buffer_data) != S_OK) {
+        return false;
+    }
+
+    DX11BufferData *b = static_cast<DX11BufferData *>(dx11_state.buffers_pool.alloc());
+    if(!b) {
+        kai::log("Could not create a new buffer object!\n");
+        buffer_data->Release();
+        return false;
+    }
+
+    b->buffer = buffer_data;
+    b->stride = info.stride;
+    b->byte_size = static_cast<Uint32>(info.byte_size);
+    b->type = info.type;
+
+    out_buffer.handle = dx11_state.buffers.add(b);
+    if(!out_buffer.handle) {
+        dx11_state.buffers_pool.free(b);
+        buffer_data->Release();
         return false;
     }
 
-    out_buffer.data = buffer_data;
-    out_buffer.stride = info.stride;
+    buffer_bytes[static_cast<Uint32>(info.type)] += info.byte_size;
 
     return true;
 }
 
 void DX11Renderer::destroy_buffer(kai::RenderBuffer &buffer) {
-    static_cast<ID3D11Buffer *>( buffer.data )->Release();
+    DX11BufferData *b = static_cast<DX11BufferData *>(dx11_state.buffers.remove(buffer.handle));
+
+    if(!b) {
+        kai::log("Tried to destroy a buffer with a stale or null handle!\n");
+        return;
+    }
+
+    buffer_bytes[static_cast<Uint32>(b->type)] -= b->byte_size;
+
+    if(b->buffer) {
+        b->buffer->Release();
+    }
+
+    dx11_state.buffers_pool.free(b);
+
     memset(&buffer, 0, sizeof(buffer));
 }
 
+bool DX11Renderer::update_buffer(const kai::RenderBuffer &buffer, const void *contents, Uint32 bytes) const {
+    DX11DeviceData *d = static_cast<DX11DeviceData *>(data);
+    DX11BufferData *b = static_cast<DX11BufferData *>(dx11_state.buffers.get(buffer.handle));
+
+    if(!b) {
+        kai::log("Tried to update a buffer with a stale or null handle!\n");
+        return false;
+    }
+
+    if(bytes > b->byte_size) {
+        kai::log("Tried to write %u bytes into a buffer of %u bytes!\n", bytes, b->byte_size);
+        return false;
+    }
+
+    // Discarding hands out fresh memory while the GPU may still read the previous contents
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if(d->context->Map(b->buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped) != S_OK) {
+        kai::log("Could not map the buffer, only cpu_w_gpu_r buffers can be updated!\n");
+        return false;
+    }
+
+    memcpy(mapped.pData, contents, bytes);
+    d->context->Unmap(b->buffer, 0);
+    frame_counters.buffer_bytes_updated += bytes;
+
+    return true;
+}
+
+bool DX11Renderer::create_texture(const kai::RenderTextureInfo &info, kai::RenderTexture &out_texture) const {
+    DX11DeviceData *d = static_cast<DX11DeviceData *>(data);
+    Uint32 pixel_size = kai::get_format_size(info.format);
+    Uint32 block_size = kai::get_format_block_size(info.format);
+
+    if(!info.width || !info.height || !pixel_size || info.width % block_size || info.height % block_size || !info.mip_count ||
+       info.mip_count > KAI_TEXTURE_MAX_MIPS || info.mip_count > kai::get_mip_count(info.width, info.height)) {
+        kai::log("Invalid size, format or mip count for a texture!\n");
+        return false;
+    }
+
+    D3D11_TEXTURE2D_DESC texture_desc = {};
+    texture_desc.Width = info.width;
+    texture_desc.Height = info.height;
+    texture_desc.MipLevels = info.mip_count;
+    texture_desc.ArraySize = 1;
+    texture_desc.Format = get_dxgi_format(info.format);
+    texture_desc.SampleDesc.Count = 1;
+    texture_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    // Immutable textures need their contents right away, an empty one is filled by the GPU or not at all.
+    // Written ones stay default, a dynamic texture could only be replaced as a whole, see update_texture()
+    texture_desc.Usage = (info.resource_usage == kai::RenderResourceUsage::gpu_r && info.data) ? D3D11_USAGE_IMMUTABLE
+                                                                                                : D3D11_USAGE_DEFAULT;
+
+    D3D11_SUBRESOURCE_DATA subresources[KAI_TEXTURE_MAX_MIPS] = {};
+    const Uint8 *mip_data = static_cast<const Uint8 *>(info.data);
+
+    for(Uint32 i = 0; info.data && i < info.mip_count; i++) {
+        Uint32 mip_width = kai::max(info.width >> i, 1u);
+        Uint32 mip_height = kai::max(info.height >> i, 1u);
+
+        subresources[i].pSysMem = mip_data;
+        subresources[i].SysMemPitch = (mip_width + block_size - 1) / block_size * pixel_size;
+        mip_data += kai::get_texture_size(info.format, mip_width, mip_height);
+    }
+
+    ID3D11Texture2D *texture;
+    if(d->device->CreateTexture2D(&texture_desc, info.data ? subresources : nullptr, &texture) != S_OK) {
+        kai::log("Could not create a %ux%u texture!\n", info.width, info.height);
+        return false;
+    }
+
+    ID3D11ShaderResourceView *view;
+    if(d->device->CreateShaderResourceView(texture, nullptr, &view) != S_OK) {
+        kai::log("Could not create the shader resource view of a texture!\n");
+        texture->Release();
+        return false;
+    }
+
+    DX11TextureData *t = static_cast<DX11TextureData *>(dx11_state.textures_pool.alloc());
+    if(!t) {
+        kai::log("Could not create a new texture object!\n");
+        view->Release();
+        texture->Release();
+        return false;
+    }
+
+    t->texture = texture;
+    t->view = view;
+    t->width = info.width;
+    t->height = info.height;
+    t->pixel_size = pixel_size;
+    t->block_size = block_size;
+    t->byte_size = static_cast<Uint32>(kai::get_texture_size(info.format, info.width, info.height, info.mip_count));
+
+    out_texture.handle = dx11_state.textures.add(t);
+    if(!out_texture.handle) {
+        dx11_state.textures_pool.free(t);
+        view->Release();
+        texture->Release();
+        return false;
+    }
+
+    texture_bytes += t->byte_size;
+
+    return true;
+}
+
+void DX11Renderer::destroy_texture(kai::RenderTexture &texture) {
+    DX11TextureData *t = static_cast<DX11TextureData *>(dx11_state.textures.remove(texture.handle));
+
+    if(!t) {
+        kai::log("Tried to destroy a texture with a stale or null handle!\n");
+        return;
+    }
+
+    texture_bytes -= t->byte_size;
+
+    if(t->view) {
+        t->view->Release();
+    }
+
+    if(t->texture) {
+        t->texture->Release();
+    }
+
+    dx11_state.textures_pool.free(t);
+
+    memset(&texture, 0, sizeof(texture));
+}
+
+bool DX11Renderer::update_texture(const kai::RenderTexture &texture, Uint32 x, Uint32 y, Uint32 width, Uint32 height,
+                                  const void *contents) const {
+    DX11DeviceData *d = static_cast<DX11DeviceData *>(data);
+    DX11TextureData *t = static_cast<DX11TextureData *>(dx11_state.textures.get(texture.handle));
+
+    if(!t) {
+        kai::log("Tried to update a texture with a stale or null handle!\n");
+        return false;
+    }
+
+    if(x > t->width || width > t->width - x || y > t->height || height > t->height - y) {
+        kai::log("Tried to write %ux%u pixels at %u, %u into a %ux%u texture!\n", width, height, x, y, t->width, t->height);
+        return false;
+    }
+
+    if(x % t->block_size || y % t->block_size || width % t->block_size || height % t->block_size) {
+        kai::log("Tried to write %ux%u pixels at %u, %u that aren't whole blocks of a texture!\n", width, height, x, y);
+        return false;
+    }
+
+    // The driver keeps the previous contents around for the frames that may still sample them
+    Uint32 row_size = width / t->block_size * t->pixel_size;
+    D3D11_BOX box = { x, y, 0, x + width, y + height, 1 };
+    d->context->UpdateSubresource(t->texture, 0, &box, contents, row_size, 0);
+    frame_counters.texture_bytes_updated += row_size * (height / t->block_size);
+
+    return true;
+}
+
 void init_dx11(void) {
     if(!dx11_state.factory) {
         if(CreateDXGIFactory(__uuidof(IDXGIFactory), reinterpret_cast<void **>(&dx11_state.factory)) != S_OK) {
@@ -611,7 +1319,9 @@ void init_dx11(void) {
         }
 
         dx11_state.devices_pool = kai::PoolAllocator(sizeof(DX11DeviceData), DX11_DEVICE_POOL_COUNT);
-        dx11_state.pipelines_pool = kai::PoolAllocator(sizeof(DX11RenderPipelineData), DX11_RENDER_PIPELINE_POOL_COUNT);
+        dx11_state.pipelines_pool.init(sizeof(DX11RenderPipelineData), DX11_RENDER_PIPELINE_POOL_COUNT, "render pipeline");
+        dx11_state.buffers_pool.init(sizeof(DX11BufferData), DX11_BUFFER_POOL_COUNT, "buffer");
+        dx11_state.textures_pool.init(sizeof(DX11TextureData), DX11_TEXTURE_POOL_COUNT, "texture");
     }
 }
 
@@ -626,6 +1336,11 @@ void destroy_dx11(void) {
 
     dx11_state.devices_pool.destroy();
     dx11_state.pipelines_pool.destroy();
+    dx11_state.buffers_pool.destroy();
+    dx11_state.textures_pool.destroy();
+    dx11_state.pipelines.destroy();
+    dx11_state.buffers.destroy();
+    dx11_state.textures.destroy();
 
 #undef DESTROY_IF_NEEDED
 }
@@ -18,6 +18,7 @@ struct DX11Renderer : public kai::RenderDevice {
 
     void destroy(void) override;
 
+    using kai::RenderDevice::execute;
     void execute(const kai::CommandBuffer &command_buffer) const override;
     void present(void) const override;
 
@@ -33,6 +34,12 @@ struct DX11Renderer : public kai::RenderDevice {
 
     bool create_buffer(const kai::RenderBufferInfo &info, kai::RenderBuffer &out_buffer) const override;
     void destroy_buffer(kai::RenderBuffer &buffer) override;
+    bool update_buffer(const kai::RenderBuffer &buffer, const void *contents, Uint32 bytes) const override;
+
+    bool create_texture(const kai::RenderTextureInfo &info, kai::RenderTexture &out_texture) const override;
+    void destroy_texture(kai::RenderTexture &texture) override;
+    bool update_texture(const kai::RenderTexture &texture, Uint32 x, Uint32 y, Uint32 width, Uint32 height,
+                        const void *contents) const override;
 };
 
 #endif /* KAI_WIN32_DX11_H */
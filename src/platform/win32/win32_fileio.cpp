@@ -34,8 +34,10 @@ kai::FileHandle kai::open_file(const char *path, FileFlags access_flags, FileFla
 
 #undef MAP_FLAG
 
+    DWORD disposition = (access_flags & kai::FILE_CREATE) ? CREATE_ALWAYS : OPEN_EXISTING;
+
     // TODO: Change to CreateFileW once this takes a UTF-8 string
-    HANDLE f = CreateFileA(path, access, share, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    HANDLE f = CreateFileA(path, access, share, nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
     return (f != INVALID_HANDLE_VALUE) ? static_cast<kai::FileHandle>(f) : nullptr;
 }
 
@@ -68,6 +70,56 @@ bool kai::read_file(kai::FileHandle file, void *buffer, size_t byte_count) {
     return false;
 }
 
+bool kai::write_file(kai::FileHandle file, const void *buffer, size_t byte_count) {
+    if(file && buffer) {
+        const Uint8 *bytes = static_cast<const Uint8 *>(buffer);
+
+        // WriteFile only takes a 32-bit size
+        while(byte_count > 0) {
+            DWORD size = static_cast<DWORD>(kai::min<size_t>(byte_count, 0x80000000));
+            DWORD bytes_written;
+
+            if(!WriteFile(file, bytes, size, &bytes_written, nullptr) || bytes_written != size) {
+                return false;
+            }
+
+            bytes += size;
+            byte_count -= size;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+bool kai::read_file_at(kai::FileHandle file, void *buffer, size_t byte_count, Uint64 offset) {
+    if(file && buffer) {
+        Uint8 *bytes = static_cast<Uint8 *>(buffer);
+
+        // The offset goes into the OVERLAPPED, so threads that read from the same file don't race on its position
+        while(byte_count > 0) {
+            DWORD size = static_cast<DWORD>(kai::min<size_t>(byte_count, 0x80000000));
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+            DWORD bytes_read;
+            if(!ReadFile(file, bytes, size, &bytes_read, &overlapped) || bytes_read != size) {
+                return false;
+            }
+
+            bytes += size;
+            byte_count -= size;
+            offset += size;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
 void kai::rewind_file(kai::FileHandle file) {
     if(file) {
         SetFilePointer(static_cast<HANDLE>(file), 0, nullptr, FILE_BEGIN);
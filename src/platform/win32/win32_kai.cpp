@@ -298,3 +298,15 @@ void kai::virtual_free(void *pages) {
 size_t kai::get_page_size(void) {
     return win32_state.page_size;
 }
+
+Uint64 kai::get_timestamp(void) {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return static_cast<Uint64>(counter.QuadPart);
+}
+
+Uint64 kai::get_timestamp_frequency(void) {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return static_cast<Uint64>(frequency.QuadPart);
+}
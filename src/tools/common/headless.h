@@ -0,0 +1,85 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+// The engine sources and hooks that every headless tool needs, so a tool can run the core without the game,
+// a window or a GPU. It's included once by the main.cpp of a tool, after that the tool includes the extra
+// core sources it tests (e.g. occlusion.cpp or soft_renderer.cpp).
+//
+// The renderer hooks don't create anything by default, the tool creates the device it wants itself.
+// Define KAI_HEADLESS_NULL_RENDERER before including this to make init_renderer() go to the null backend.
+
+#ifndef KAI_TOOLS_HEADLESS_H
+#define KAI_TOOLS_HEADLESS_H
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "../../core/includes/kai.h"
+#include "../../core/kai_internal.h"
+#include "../../platform/platform.h"
+
+#include "../../core/alloc.cpp"
+#include "../../core/pipeline_cache.cpp"
+#include "../../core/render.cpp"
+#include "../../core/render_capture.cpp"
+#include "../../platform/linux/linux_fileio.cpp"
+#include "../../platform/linux/linux_system.cpp"
+
+#ifdef KAI_HEADLESS_NULL_RENDERER
+#include "../../platform/null/null_renderer.cpp"
+#endif
+
+// ----- Engine hooks ----- //
+static kai::StackAllocator engine_memory;
+static kai::Window window = { nullptr, 1280, 720 };
+
+kai::StackAllocator * get_engine_memory(void) {
+    return &engine_memory;
+}
+
+void kai::log(const char *str, ...) {
+    va_list vlist;
+    va_start(vlist, str);
+    vfprintf(stderr, str, vlist);
+    va_end(vlist);
+}
+
+kai::Window * platform_get_kai_window(void) { return &window; }
+
+#ifdef KAI_HEADLESS_NULL_RENDERER
+void platform_renderer_init_backend(kai::RenderingBackend) { init_null_renderer(); }
+void platform_renderer_destroy_backend(void) { destroy_null_renderer(); }
+kai::RenderDevice * platform_renderer_init_device(kai::StackAllocator &allocator) { return null_renderer_init_device(allocator); }
+kai::RenderDevice * platform_renderer_init_device(kai::StackAllocator &allocator, Uint32) { return null_renderer_init_device(allocator); }
+#else
+void platform_renderer_init_backend(kai::RenderingBackend) {}
+void platform_renderer_destroy_backend(void) {}
+kai::RenderDevice * platform_renderer_init_device(kai::StackAllocator &) { return nullptr; }
+kai::RenderDevice * platform_renderer_init_device(kai::StackAllocator &, Uint32) { return nullptr; }
+#endif
+
+// A device that accepts everything and does nothing, for the tools that only need to see what reaches
+// execute(). They derive from it and override what they look at
+struct HeadlessDevice : public kai::RenderDevice {
+    using kai::RenderDevice::execute;
+
+    void destroy(void) override {}
+    void execute(const kai::CommandBuffer &) const override {}
+    void present(void) const override {}
+    void set_viewport(Int32, Int32, Uint32, Uint32) const override {}
+    bool compile_shader(const char *, kai::ShaderType, const char *, void *, void **) const override { return false; }
+    bool create_render_pipeline(const kai::RenderPipelineInfo &, const kai::RenderInputLayoutInfo *,
+                                Uint32, kai::RenderPipeline &) const override { return false; }
+    void destroy_render_pipeline(kai::RenderPipeline &) override {}
+    void set_render_pipeline(const kai::RenderPipeline &) const override {}
+    bool create_buffer(const kai::RenderBufferInfo &, kai::RenderBuffer &) const override { return false; }
+    void destroy_buffer(kai::RenderBuffer &) override {}
+    bool update_buffer(const kai::RenderBuffer &, const void *, Uint32) const override { return false; }
+    bool create_texture(const kai::RenderTextureInfo &, kai::RenderTexture &) const override { return false; }
+    void destroy_texture(kai::RenderTexture &) override {}
+    bool update_texture(const kai::RenderTexture &, Uint32, Uint32, Uint32, Uint32, const void *) const override { return false; }
+};
+
+#endif
@@ -0,0 +1,11 @@
+#!/bin/sh
+
+mkdir -p bin
+
+EXECUTABLE=debug_draw_bench
+COMPILER_FLAGS="-std=c++17 -O2 -g -Wall -Wextra -Wno-class-memaccess -fno-exceptions"
+ARCH_FLAGS=${ARCH_FLAGS:--march=native}
+DEFINES="-DKAI_PLATFORM_LINUX"
+
+cd bin
+${CXX:-g++} $DEFINES $COMPILER_FLAGS $ARCH_FLAGS ../main.cpp -lm -o $EXECUTABLE && cp -f $EXECUTABLE ..
@@ -0,0 +1,222 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+// Benchmark for DebugDraw on the null backend. Every frame adds a field of lines, boxes and spheres and
+// ends with the single upload and draw of DebugDraw::end(). For comparison the same lines are drawn from
+// a static buffer with a draw call each, the way they would be without batching. The null device validates
+// every command and the contents of the vertex buffer are checked against the lines that were added.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KAI_HEADLESS_NULL_RENDERER
+#include "../common/headless.h"
+
+#include "../../core/debug_draw.cpp"
+
+static Float64 to_ms(Uint64 ticks) {
+    return static_cast<Float64>(ticks) * 1000.0 / static_cast<Float64>(kai::get_timestamp_frequency());
+}
+
+static kai::Vec4 get_line_point(Uint32 line, Uint32 end, Uint32 frame) {
+    Float32 x = static_cast<Float32>(line % 1000);
+    Float32 z = static_cast<Float32>(line / 1000);
+    return kai::Vec4(x, end ? 1.0f : 0.0f, z + static_cast<Float32>(frame & 7));
+}
+
+int main(int argc, char **argv) {
+    Uint32 line_count = 100000;
+    Uint32 shape_count = 1000;
+    Uint32 frame_count = 100;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--lines") && i + 1 < argc) {
+            line_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--shapes") && i + 1 < argc) {
+            shape_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frame_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else {
+            printf("Usage: %s [--lines N] [--shapes N] [--frames N]\n", argv[0]);
+            return 0;
+        }
+    }
+
+    kai::clamp(line_count, 1u, 1000000u);
+    kai::clamp(shape_count, 0u, 100000u);
+    frame_count = kai::max(frame_count, 1u);
+
+    // A box is 12 lines and a sphere 3 circles
+    Uint32 shape_vertices = (shape_count / 2) * 24 + (shape_count - shape_count / 2) * 3 * KAI_DEBUG_DRAW_CIRCLE_SEGMENTS * 2;
+    Uint32 max_vertices = line_count * 2 + shape_vertices;
+
+    MemoryManager::init(kai::gibibytes(4));
+    engine_memory = kai::StackAllocator(static_cast<Uint32>(kai::mebibytes(1)));
+
+    init_renderer(kai::RenderingBackend::null, nullptr, false);
+    kai::RenderDevice *device = kai::RenderDevice::get();
+    NullRenderer *null_device = static_cast<NullRenderer *>(get_backend_device());
+
+    if(!device) {
+        printf("Error: could not create the null render device!\n");
+        return -1;
+    }
+
+    kai::DebugDraw debug_draw(device, max_vertices);
+    kai::CommandBuffer buffer(1024);
+
+    Uint64 add_ticks = 0;
+    Uint64 end_ticks = 0;
+    Uint64 batched_ticks = 0;
+    Uint32 errors = 0;
+    Uint32 mismatches = 0;
+
+    kai::Mat4x4 view_projection = kai::Mat4x4::perspective(kai::deg_to_rad(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+
+    // ----- Batched ----- //
+    for(Uint32 frame = 0; frame < frame_count; frame++) {
+        Uint64 start = kai::get_timestamp();
+
+        debug_draw.begin();
+
+        for(Uint32 i = 0; i < line_count; i++) {
+            debug_draw.line(get_line_point(i, 0, frame), get_line_point(i, 1, frame), 0xff00ff00 | i);
+        }
+
+        for(Uint32 i = 0; i < shape_count; i++) {
+            kai::Vec4 center(static_cast<Float32>(i % 100), 2.0f, static_cast<Float32>(i / 100));
+            if(i & 1) {
+                debug_draw.sphere(center, 0.5f, 0xff0000ff);
+            } else {
+                debug_draw.box(center, center + kai::Vec4(0.5f, 0.5f, 0.5f), 0xffff0000);
+            }
+        }
+
+        Uint64 added = kai::get_timestamp();
+
+        buffer.begin();
+        debug_draw.end(buffer, view_projection);
+        buffer.end();
+
+        Uint64 ended = kai::get_timestamp();
+
+        device->execute(buffer);
+        device->present();
+
+        add_ticks += added - start;
+        end_ticks += ended - added;
+        batched_ticks += kai::get_timestamp() - start;
+        errors += null_device->get_frame_stats().errors;
+    }
+
+    const kai::RenderFrameCounters batched_counters = device->get_frame_counters();
+    Uint32 vertex_count = debug_draw.get_vertex_count();
+    Uint32 dropped_count = debug_draw.get_dropped_count();
+
+    // The vertex buffer of the last frame has to hold the lines as they were added, it's found through its bind
+    CommandDecoder decoder(buffer, false);
+    CommandEncodingData command;
+    const kai::DebugDrawVertex *uploaded = nullptr;
+
+    while(decoder.next(command)) {
+        if(command.bind_buffer.encoding == CommandEncoding::bind_buffer) {
+            uploaded = static_cast<const kai::DebugDrawVertex *>(null_device->get_buffer_data({ command.bind_buffer.buffer }));
+        }
+    }
+
+    for(Uint32 i = 0; i < line_count * 2; i++) {
+        kai::Vec4 expected = get_line_point(i / 2, i & 1, frame_count - 1);
+        if(!uploaded || uploaded[i].position[0] != expected.x || uploaded[i].position[1] != expected.y ||
+           uploaded[i].position[2] != expected.z || uploaded[i].color != (0xff00ff00 | (i / 2))) {
+            mismatches++;
+        }
+    }
+
+    // ----- One draw per line ----- //
+    kai::RenderPipelineInfo pipeline_info = {};
+    pipeline_info.vertex_shader_source = "vs";
+    pipeline_info.vertex_shader_entry = "main";
+    pipeline_info.pixel_shader_source = "ps";
+    pipeline_info.pixel_shader_entry = "main";
+    pipeline_info.topology = kai::RenderPipelineInfo::TopologyType::line_list;
+
+    kai::RenderPipeline pipeline;
+    device->create_render_pipeline(pipeline_info, nullptr, 0, pipeline);
+
+    kai::RenderBufferInfo buffer_info = {};
+    buffer_info.byte_size = static_cast<size_t>(line_count) * 2 * sizeof(kai::DebugDrawVertex);
+    buffer_info.stride = sizeof(kai::DebugDrawVertex);
+    buffer_info.type = kai::RenderBufferType::vertex;
+
+    kai::RenderBuffer line_buffer;
+    device->create_buffer(buffer_info, line_buffer);
+
+    Uint64 unbatched_ticks = 0;
+
+    for(Uint32 frame = 0; frame < frame_count; frame++) {
+        Uint64 start = kai::get_timestamp();
+
+        buffer.begin();
+        buffer.set_render_pipeline(pipeline);
+        buffer.bind_buffer(line_buffer, kai::RenderBufferType::vertex);
+
+        // Backwards, so that the device can't merge the draws
+        for(Uint32 i = line_count; i > 0; i--) {
+            buffer.draw(2, (i - 1) * 2);
+        }
+
+        buffer.end();
+
+        device->execute(buffer);
+        device->present();
+
+        unbatched_ticks += kai::get_timestamp() - start;
+        errors += null_device->get_frame_stats().errors;
+    }
+
+    const kai::RenderFrameCounters unbatched_counters = device->get_frame_counters();
+
+    Float64 frames = static_cast<Float64>(frame_count);
+    printf("%u lines and %u shapes per frame, %u frames\n\n", line_count, shape_count, frame_count);
+
+    printf("Batched (DebugDraw):\n");
+    printf("  frame ms            %.3f\n", to_ms(batched_ticks) / frames);
+    printf("  adding shapes ms    %.3f (%.2f ns per vertex)\n", to_ms(add_ticks) / frames,
+           to_ms(add_ticks) * 1e6 / (frames * static_cast<Float64>(vertex_count)));
+    printf("  end() ms            %.3f\n", to_ms(end_ticks) / frames);
+    printf("  vertices            %u (%u dropped)\n", vertex_count, dropped_count);
+    printf("  draw calls          %u\n", batched_counters.draws);
+    printf("  commands executed   %u\n", batched_counters.commands_executed);
+    printf("  bytes updated       %u\n\n", batched_counters.buffer_bytes_updated);
+
+    printf("One draw per line:\n");
+    printf("  frame ms            %.3f\n", to_ms(unbatched_ticks) / frames);
+    printf("  draw calls          %u\n", unbatched_counters.draws);
+    printf("  commands executed   %u\n", unbatched_counters.commands_executed);
+    printf("  encoded bytes       %u\n", unbatched_counters.command_bytes);
+
+    int retval = 0;
+    if(errors > 0) {
+        printf("Error: the null device found %u invalid commands!\n", errors);
+        retval = -1;
+    }
+
+    if(mismatches > 0) {
+        printf("Error: %u uploaded vertices don't match the lines that were added!\n", mismatches);
+        retval = -1;
+    }
+
+    buffer.destroy();
+    debug_draw.destroy();
+    device->destroy_buffer(line_buffer);
+    device->destroy_render_pipeline(pipeline);
+
+    destroy_renderer();
+    engine_memory.destroy();
+    MemoryManager::destroy();
+
+    return retval;
+}
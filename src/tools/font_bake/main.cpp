@@ -0,0 +1,323 @@
+// Offline tool that bakes a BDF bitmap font into a font asset (see src/asset/font.h), which the TextBatch copies glyphs
+// from into its atlas while drawing text.
+//
+// Every glyph of the font that has an encoding is baked, its bitmap becomes r_unorm8 coverage of 0 or 255. With "sdf" the
+// bitmaps become signed distance fields instead, padded by SPREAD pixels on every side, so that the text can be scaled
+// up with smooth edges:
+//
+//   font_bake fonts/terminus.bdf data/terminus.font
+//   font_bake fonts/terminus.bdf data/terminus_sdf.font sdf 4
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <vector>
+
+#include "../../asset/font.h"
+
+#define MAX_SDF_SPREAD 32
+
+struct Glyph {
+    Uint32 codepoint;
+    Int32 width;
+    Int32 height;
+    Int32 offset_x;
+    Int32 offset_y;
+    Int32 advance;
+    std::vector<unsigned char> bitmap; // One byte per pixel, 0 or 255
+};
+
+static void print_usage(void) {
+    fprintf(stdout, "Font bake usage:\n"
+            "\tfont_bake <name of BDF font> <name of font asset> [sdf <spread in pixels>]\n");
+}
+
+static bool read_text_file(const char *path, std::string &out_text) {
+    FILE *f = fopen(path, "rb");
+    if(!f) {
+        fprintf(stderr, "[ERROR] - File \"%s\" was not found or it couldn't be opened\n", path);
+        return false;
+    }
+
+    char buffer[4096];
+    size_t read;
+    while((read = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        out_text.append(buffer, read);
+    }
+
+    fclose(f);
+    return true;
+}
+
+static bool parse_bitmap_row(const std::string &line, Glyph &glyph, Int32 row) {
+    Int32 digits = (glyph.width + 3) / 4;
+    if(static_cast<Int32>(line.size()) < digits) {
+        return false;
+    }
+
+    for(Int32 x = 0; x < glyph.width; x++) {
+        char c = line[x / 4];
+        Int32 nibble = (c >= '0' && c <= '9') ? c - '0' : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+        if(nibble < 0) {
+            return false;
+        }
+
+        glyph.bitmap[row * glyph.width + x] = (nibble & (8 >> (x % 4))) ? 255 : 0;
+    }
+
+    return true;
+}
+
+// Only the parts of the BDF format that are needed for the glyphs and the metrics are read, the properties are skipped
+static bool parse_bdf(const char *path, const std::string &text, std::vector<Glyph> &out_glyphs, Int32 &out_ascent,
+                      Int32 &out_descent, Int32 &out_default_char) {
+    Glyph glyph = {};
+    Int32 encoding = -1;
+    Int32 bitmap_row = -1; // Inside of BITMAP while not negative
+    bool in_char = false;
+    bool has_bbx = false;
+
+    out_ascent = 0;
+    out_descent = 0;
+    out_default_char = -1;
+
+    size_t line_start = 0;
+    Uint32 line_number = 0;
+    while(line_start < text.size()) {
+        size_t line_end = text.find('\n', line_start);
+        line_end = (line_end == std::string::npos) ? text.size() : line_end;
+
+        std::string line = text.substr(line_start, line_end - line_start);
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        line_start = line_end + 1;
+        line_number++;
+
+        bool valid = true;
+        if(bitmap_row >= 0) {
+            if(line == "ENDCHAR") {
+                valid = bitmap_row == glyph.height;
+                bitmap_row = -1;
+            } else {
+                valid = bitmap_row < glyph.height && parse_bitmap_row(line, glyph, bitmap_row);
+                bitmap_row++;
+
+                if(valid) {
+                    continue;
+                }
+            }
+        } else if(!line.compare(0, 12, "FONT_ASCENT ")) {
+            out_ascent = atoi(line.c_str() + 12);
+        } else if(!line.compare(0, 13, "FONT_DESCENT ")) {
+            out_descent = atoi(line.c_str() + 13);
+        } else if(!line.compare(0, 13, "DEFAULT_CHAR ")) {
+            out_default_char = atoi(line.c_str() + 13);
+        } else if(!line.compare(0, 10, "STARTCHAR ")) {
+            glyph = {};
+            encoding = -1;
+            in_char = true;
+            has_bbx = false;
+        } else if(in_char && !line.compare(0, 9, "ENCODING ")) {
+            // "ENCODING -1 n" are glyphs without a standard encoding, they're skipped
+            encoding = atoi(line.c_str() + 9);
+        } else if(in_char && !line.compare(0, 7, "DWIDTH ")) {
+            glyph.advance = atoi(line.c_str() + 7);
+        } else if(in_char && !line.compare(0, 4, "BBX ")) {
+            int w, h, x, y;
+            valid = sscanf(line.c_str() + 4, "%d %d %d %d", &w, &h, &x, &y) == 4 && w >= 0 && h >= 0 && w <= 0xffff && h <= 0xffff;
+            glyph.width = w;
+            glyph.height = h;
+            glyph.offset_x = x;
+            glyph.offset_y = -(y + h); // BDF places the bottom of the box relative to the baseline, y up
+            has_bbx = valid;
+        } else if(in_char && line == "ENDCHAR") {
+            valid = glyph.bitmap.size() == static_cast<size_t>(glyph.width) * glyph.height;
+        } else if(in_char && line == "BITMAP") {
+            valid = has_bbx;
+            glyph.bitmap.assign(static_cast<size_t>(glyph.width) * glyph.height, 0);
+            bitmap_row = 0;
+            continue;
+        }
+
+        if(!valid) {
+            fprintf(stderr, "[ERROR] - %s(%u): Couldn't parse \"%s\"\n", path, line_number, line.c_str());
+            return false;
+        }
+
+        // The glyph is complete once its bitmap has been read
+        if(in_char && line == "ENDCHAR") {
+            if(encoding >= 0) {
+                glyph.codepoint = static_cast<Uint32>(encoding);
+                out_glyphs.push_back(glyph);
+            }
+
+            in_char = false;
+        }
+    }
+
+    if(out_glyphs.empty()) {
+        fprintf(stderr, "[ERROR] - \"%s\" has no glyphs\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+// Turns the coverage of a glyph into a signed distance field that is 'spread' pixels larger on every side. The edge of
+// a pixel is half a pixel away from its center, so that is where the distance crosses 0 (stored as 0.5)
+static void make_sdf(Glyph &glyph, Int32 spread) {
+    Int32 width = glyph.width + spread * 2;
+    Int32 height = glyph.height + spread * 2;
+    std::vector<unsigned char> sdf(static_cast<size_t>(width) * height);
+
+    auto is_inside = [&glyph](Int32 x, Int32 y) {
+        return x >= 0 && y >= 0 && x < glyph.width && y < glyph.height && glyph.bitmap[y * glyph.width + x] != 0;
+    };
+
+    for(Int32 y = 0; y < height; y++) {
+        for(Int32 x = 0; x < width; x++) {
+            Int32 gx = x - spread;
+            Int32 gy = y - spread;
+            bool inside = is_inside(gx, gy);
+
+            // The closest pixel of the other kind is at most spread + 1 pixels away, anything further is clamped anyway
+            Int32 closest = (spread + 1) * (spread + 1) * 2;
+            for(Int32 dy = -spread - 1; dy <= spread + 1; dy++) {
+                for(Int32 dx = -spread - 1; dx <= spread + 1; dx++) {
+                    if(is_inside(gx + dx, gy + dy) != inside) {
+                        closest = std::min(closest, dx * dx + dy * dy);
+                    }
+                }
+            }
+
+            Float32 distance = sqrtf(static_cast<Float32>(closest)) - 0.5f;
+            Float32 value = 0.5f + (inside ? distance : -distance) / static_cast<Float32>(spread * 2);
+            sdf[static_cast<size_t>(y) * width + x] = static_cast<unsigned char>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+        }
+    }
+
+    glyph.width = width;
+    glyph.height = height;
+    glyph.offset_x -= spread;
+    glyph.offset_y -= spread;
+    glyph.bitmap.swap(sdf);
+}
+
+int main(int argc, char **argv) {
+    Int32 spread = 0;
+
+    if(argc == 5 && !strcmp(argv[3], "sdf")) {
+        spread = atoi(argv[4]);
+
+        if(spread < 1 || spread > MAX_SDF_SPREAD) {
+            fprintf(stderr, "[ERROR] - The spread of an SDF has to be between 1 and %d pixels\n", MAX_SDF_SPREAD);
+            return -1;
+        }
+    } else if(argc != 3) {
+        print_usage();
+        return -1;
+    }
+
+    std::string text;
+    if(!read_text_file(argv[1], text)) {
+        return -1;
+    }
+
+    std::vector<Glyph> glyphs;
+    Int32 ascent;
+    Int32 descent;
+    Int32 default_char;
+
+    if(!parse_bdf(argv[1], text, glyphs, ascent, descent, default_char)) {
+        return -1;
+    }
+
+    std::sort(glyphs.begin(), glyphs.end(), [](const Glyph &a, const Glyph &b) { return a.codepoint < b.codepoint; });
+
+    for(size_t i = 1; i < glyphs.size(); i++) {
+        if(glyphs[i].codepoint == glyphs[i - 1].codepoint) {
+            fprintf(stderr, "[ERROR] - \"%s\" has more than one glyph for the codepoint %u\n", argv[1], glyphs[i].codepoint);
+            return -1;
+        }
+    }
+
+    // Empty glyphs only advance the pen, they don't get a bitmap even as an SDF
+    Int32 max_glyph_size = 0;
+    for(Glyph &glyph : glyphs) {
+        if(glyph.width == 0 || glyph.height == 0) {
+            glyph.width = 0;
+            glyph.height = 0;
+            glyph.bitmap.clear();
+        } else if(spread > 0) {
+            make_sdf(glyph, spread);
+        }
+
+        max_glyph_size = std::max(max_glyph_size, std::max(glyph.width, glyph.height));
+    }
+
+    if(max_glyph_size > 0xffff) {
+        fprintf(stderr, "[ERROR] - The glyphs of \"%s\" are too large\n", argv[1]);
+        return -1;
+    }
+
+    kai::FontHeader header = {};
+    header.asset_type = kai::AssetType::font;
+    header.version = KAI_FONT_VERSION;
+    header.flags = (spread > 0) ? KAI_FONT_FLAG_SDF : 0;
+    header.line_height = static_cast<Uint16>(ascent + descent);
+    header.ascent = static_cast<Int16>(ascent);
+    header.sdf_spread = static_cast<Uint16>(spread);
+    header.max_glyph_size = static_cast<Uint16>(max_glyph_size);
+    header.glyphs.count = static_cast<Uint32>(glyphs.size());
+    header.glyphs.start = sizeof(kai::FontHeader);
+    header.default_glyph = KAI_FONT_NO_GLYPH;
+
+    // Header and glyphs first, followed by the bitmaps
+    std::vector<unsigned char> data(header.glyphs.start + header.glyphs.count * sizeof(kai::FontGlyph));
+    std::vector<kai::FontGlyph> file_glyphs;
+
+    for(const Glyph &glyph : glyphs) {
+        if(default_char >= 0 && glyph.codepoint == static_cast<Uint32>(default_char)) {
+            header.default_glyph = static_cast<Uint32>(file_glyphs.size());
+        }
+
+        kai::FontGlyph file_glyph = {};
+        file_glyph.codepoint = glyph.codepoint;
+        file_glyph.bitmap_start = static_cast<Uint32>(data.size());
+        file_glyph.width = static_cast<Uint16>(glyph.width);
+        file_glyph.height = static_cast<Uint16>(glyph.height);
+        file_glyph.offset_x = static_cast<Int16>(glyph.offset_x);
+        file_glyph.offset_y = static_cast<Int16>(glyph.offset_y);
+        file_glyph.advance = static_cast<Int16>(glyph.advance);
+        file_glyphs.push_back(file_glyph);
+
+        data.insert(data.end(), glyph.bitmap.begin(), glyph.bitmap.end());
+    }
+
+    while(data.size() % 4) {
+        data.push_back(0);
+    }
+
+    header.size = static_cast<Uint32>(data.size());
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + header.glyphs.start, file_glyphs.data(), file_glyphs.size() * sizeof(kai::FontGlyph));
+
+    FILE *out = fopen(argv[2], "wb");
+    if(!out || fwrite(data.data(), 1, data.size(), out) != data.size()) {
+        fprintf(stderr, "[ERROR] - Couldn't write the font asset \"%s\"\n", argv[2]);
+
+        if(out) {
+            fclose(out);
+        }
+
+        return -1;
+    }
+
+    fclose(out);
+    fprintf(stdout, "Baked \"%s\": %u glyphs, %u pixel lines%s, %u bytes\n", argv[2], header.glyphs.count, header.line_height,
+            (spread > 0) ? " as SDF" : "", header.size);
+
+    return 0;
+}
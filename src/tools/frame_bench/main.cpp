@@ -0,0 +1,244 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+// Headless end-to-end frame benchmark. The renderer is initialized with RenderingBackend::null,
+// so every frame goes through the same path as on a real device: per-object constants are written
+// into the constant ring, a CommandBuffer is recorded and executed by the device and the frame is
+// presented. Only the work that would've happened on the GPU is missing, which makes the frame
+// time the CPU cost of the engine's renderer. The null device validates every command, so a frame
+// with errors fails the benchmark.
+// --capture writes the last frame into a capture file, which src/tools/replay can execute again.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KAI_HEADLESS_NULL_RENDERER
+#include "../common/headless.h"
+
+#define MESH_COUNT 64
+#define PIPELINE_COUNT 8
+#define MAX_FRAMES 100000
+
+struct ObjectConstants {
+    kai::Mat4x4 world;
+    Float32 color[4];
+};
+
+static const char *vertex_shader_sources[PIPELINE_COUNT] = {
+    "vs 0", "vs 1", "vs 2", "vs 3", "vs 4", "vs 5", "vs 6", "vs 7"
+};
+
+static int compare_float64(const void *a, const void *b) {
+    Float64 x = *static_cast<const Float64 *>(a);
+    Float64 y = *static_cast<const Float64 *>(b);
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+int main(int argc, char **argv) {
+    // Every object takes 256 bytes of the constant ring and a frame can use up to a third of it
+    Uint32 object_count = 5000;
+    Uint32 frame_count = 200;
+    Bool32 auto_instancing = false;
+    kai::CommandBufferMode mode = kai::CommandBufferMode::immediate;
+    const char *capture_path = nullptr;
+    Uint32 log_interval = 0;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--objects") && i + 1 < argc) {
+            object_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frame_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--auto-instancing")) {
+            auto_instancing = true;
+        } else if(!strcmp(argv[i], "--sorted")) {
+            mode = kai::CommandBufferMode::sorted;
+        } else if(!strcmp(argv[i], "--capture") && i + 1 < argc) {
+            capture_path = argv[++i];
+        } else if(!strcmp(argv[i], "--log-counters") && i + 1 < argc) {
+            log_interval = static_cast<Uint32>(atoi(argv[++i]));
+        } else {
+            printf("Usage: %s [--objects N] [--frames N] [--auto-instancing] [--sorted] [--capture PATH] [--log-counters N]\n",
+                   argv[0]);
+            return 0;
+        }
+    }
+
+    object_count = kai::max(object_count, 1u);
+    kai::clamp(frame_count, 2u, static_cast<Uint32>(MAX_FRAMES));
+
+    MemoryManager::init(kai::gibibytes(4));
+    engine_memory = kai::StackAllocator(static_cast<Uint32>(kai::mebibytes(1)));
+
+    init_renderer(kai::RenderingBackend::null, nullptr, capture_path != nullptr);
+    kai::set_render_counters_log_interval(log_interval);
+    kai::RenderDevice *device = kai::RenderDevice::get();
+    NullRenderer *null_device = static_cast<NullRenderer *>(get_backend_device());
+
+    if(!device) {
+        printf("Error: could not create the null render device!\n");
+        return -1;
+    }
+
+    kai::RenderPipeline pipelines[PIPELINE_COUNT];
+    for(Uint32 i = 0; i < PIPELINE_COUNT; i++) {
+        kai::RenderPipelineInfo info = {};
+        info.vertex_shader_source = vertex_shader_sources[i];
+        info.vertex_shader_entry = "main";
+        info.pixel_shader_source = "ps";
+        info.pixel_shader_entry = "main";
+        info.depth_enable = true;
+
+        device->create_render_pipeline(info, nullptr, 0, pipelines[i]);
+    }
+
+    kai::RenderBuffer vertex_buffers[MESH_COUNT];
+    kai::RenderBuffer index_buffers[MESH_COUNT];
+    for(Uint32 i = 0; i < MESH_COUNT; i++) {
+        kai::RenderBufferInfo info = {};
+        info.byte_size = 24 * (i + 1) * 32;
+        info.stride = 32;
+        info.type = kai::RenderBufferType::vertex;
+        device->create_buffer(info, vertex_buffers[i]);
+
+        info.byte_size = 36 * (i + 1) * sizeof(Uint16);
+        info.stride = sizeof(Uint16);
+        info.type = kai::RenderBufferType::index;
+        device->create_buffer(info, index_buffers[i]);
+    }
+
+    kai::CommandBuffer buffer(object_count, mode);
+    buffer.set_auto_instancing(auto_instancing);
+
+    Float64 *frame_times = static_cast<Float64 *>(malloc(frame_count * sizeof(Float64)));
+    Uint32 timed_frames = 0;
+    Uint32 failed_allocations = 0;
+    Uint32 errors = 0;
+    Bool32 capture_failed = false;
+
+    // The first present() only starts the clock
+    device->present();
+
+    for(Uint32 frame = 0; frame < frame_count; frame++) {
+        if(capture_path && frame == frame_count - 1 && !kai::capture_next_frame(capture_path)) {
+            capture_failed = true;
+        }
+
+        buffer.begin();
+        buffer.set_render_pipeline(pipelines[0]);
+        buffer.clear_color();
+        buffer.clear_depth();
+
+        for(Uint32 i = 0; i < object_count; i++) {
+            Uint32 mesh = i % MESH_COUNT;
+            Float32 x = static_cast<Float32>(i % 100);
+            Float32 y = static_cast<Float32>(i / 100);
+
+            kai::Mat4x4 world = kai::Mat4x4::translate(x, y, static_cast<Float32>(frame));
+
+            kai::ConstantSlice slice;
+            if(!device->allocate_constants(sizeof(ObjectConstants), slice)) {
+                failed_allocations += object_count - i;
+                break;
+            }
+
+            ObjectConstants *constants = static_cast<ObjectConstants *>(slice.data);
+            constants->world = world;
+            constants->color[0] = x / 100.0f;
+            constants->color[1] = 1.0f;
+            constants->color[2] = 0.0f;
+            constants->color[3] = 1.0f;
+
+            buffer.set_render_pipeline(pipelines[mesh % PIPELINE_COUNT]);
+            buffer.bind_buffer(vertex_buffers[mesh], kai::RenderBufferType::vertex);
+            buffer.bind_buffer(index_buffers[mesh], kai::RenderBufferType::index);
+            buffer.bind_constants(slice);
+            buffer.set_instance_transform(world);
+            buffer.draw_indexed(36 * (mesh + 1));
+        }
+
+        buffer.end();
+
+        device->execute(buffer);
+        device->present();
+
+        const NullFrameStats &stats = null_device->get_frame_stats();
+        frame_times[timed_frames++] = stats.frame_ms;
+        errors += stats.errors;
+    }
+
+    const NullFrameStats &stats = null_device->get_frame_stats();
+    const kai::RenderFrameCounters &counters = device->get_frame_counters();
+
+    Float64 mean = 0.0;
+    for(Uint32 i = 0; i < timed_frames; i++) {
+        mean += frame_times[i];
+    }
+
+    mean /= static_cast<Float64>(timed_frames);
+    qsort(frame_times, timed_frames, sizeof(Float64), compare_float64);
+
+    printf("%u objects using %u meshes and %u pipelines, %u frames, %s, auto-instancing %s\n\n",
+           object_count, MESH_COUNT, PIPELINE_COUNT, frame_count,
+           (mode == kai::CommandBufferMode::sorted) ? "sorted" : "immediate", auto_instancing ? "on" : "off");
+
+    printf("frame ms     mean %.3f  p50 %.3f  p99 %.3f  min %.3f  max %.3f\n",
+           mean, frame_times[timed_frames / 2], frame_times[(timed_frames * 99) / 100],
+           frame_times[0], frame_times[timed_frames - 1]);
+    printf("execute ms   %.3f (last frame)\n\n", counters.execute_ms);
+
+    printf("Last frame:\n");
+    printf("  draw calls          %u\n", counters.draws);
+    printf("  instances           %u\n", stats.instances);
+    printf("  vertices            %llu\n", static_cast<unsigned long long>(counters.vertices));
+    printf("  pipeline binds      %u\n", counters.pipeline_binds);
+    printf("  buffer binds        %u\n", counters.buffer_binds);
+    printf("  constant binds      %u\n", counters.constant_binds);
+    printf("  clears              %u\n", stats.clears);
+    printf("  commands executed   %u\n", counters.commands_executed);
+    printf("  binds elided        %u\n", counters.binds_elided);
+    printf("  draws merged        %u\n", counters.draws_merged);
+    printf("  draws instanced     %u\n", counters.draws_instanced);
+    printf("  encoded bytes       %u\n", counters.command_bytes);
+    printf("  constant bytes      %u\n", counters.constant_bytes_uploaded);
+    printf("  instance bytes      %llu\n", static_cast<unsigned long long>(stats.instance_bytes_uploaded));
+    printf("  buffer bytes        %llu vertex, %llu index, %llu constant\n",
+           static_cast<unsigned long long>(counters.buffer_bytes[0]), static_cast<unsigned long long>(counters.buffer_bytes[1]),
+           static_cast<unsigned long long>(counters.buffer_bytes[2]));
+
+    int retval = 0;
+    if(errors > 0) {
+        printf("Error: the null device found %u invalid commands!\n", errors);
+        retval = -1;
+    }
+
+    if(failed_allocations > 0) {
+        printf("Error: %u constant allocations didn't fit into the constant ring!\n", failed_allocations);
+        retval = -1;
+    }
+
+    if(capture_failed) {
+        printf("Error: the last frame couldn't be captured!\n");
+        retval = -1;
+    }
+
+    free(frame_times);
+    buffer.destroy();
+
+    for(Uint32 i = 0; i < MESH_COUNT; i++) {
+        device->destroy_buffer(vertex_buffers[i]);
+        device->destroy_buffer(index_buffers[i]);
+    }
+
+    for(Uint32 i = 0; i < PIPELINE_COUNT; i++) {
+        device->destroy_render_pipeline(pipelines[i]);
+    }
+
+    destroy_renderer();
+    engine_memory.destroy();
+    MemoryManager::destroy();
+
+    return retval;
+}
@@ -0,0 +1,404 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+// Builds the FrameGraph of a deferred renderer every frame and runs it on the null backend: a shadow map, a
+// G-buffer, SSAO, lighting, a bloom chain and tone mapping into the back buffer. The velocity, motion blur and
+// debug overlay passes write something that never reaches the back buffer, so they have to be culled.
+// Every pass records a clear and a fullscreen triangle that the null device executes. It also stamps a tag into
+// every page of the resources it writes and checks the tags of the resources it reads, so two resources that
+// share memory while they're both alive are caught. The report shows the schedule, where every resource was
+// placed and how much memory the aliasing saved. Graphs of only independent passes with side effects and no
+// resources are compiled as well.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KAI_HEADLESS_NULL_RENDERER
+#include "../common/headless.h"
+
+#include "../../core/frame_graph.cpp"
+
+#define PAGE_SIZE 4096
+#define MAX_PASS_RESOURCES 6
+
+enum Resource {
+    shadow_map,
+    depth,
+    albedo,
+    normals,
+    material,
+    velocity,
+    ssao,
+    ssao_blurred,
+    hdr,
+    motion_blurred,
+    bloom_0,
+    bloom_1,
+    bloom_2,
+    bloom_up_1,
+    bloom_up_0,
+    debug_overlay,
+    back_buffer,
+    resource_count
+};
+
+struct PassData {
+    const char *name;
+    Resource reads[MAX_PASS_RESOURCES];
+    Uint32 read_count;
+    Resource writes[MAX_PASS_RESOURCES];
+    Uint32 write_count;
+};
+
+static const PassData pass_data[] = {
+    { "shadows", {}, 0, { shadow_map }, 1 },
+    { "gbuffer", {}, 0, { depth, albedo, normals, material }, 4 },
+    { "velocity", { depth }, 1, { velocity }, 1 },
+    { "ssao", { depth, normals }, 2, { ssao }, 1 },
+    { "ssao_blur", { ssao, depth }, 2, { ssao_blurred }, 1 },
+    { "lighting", { shadow_map, depth, albedo, normals, material, ssao_blurred }, 6, { hdr }, 1 },
+    { "motion_blur", { hdr, velocity }, 2, { motion_blurred }, 1 },
+    { "bloom_down_0", { hdr }, 1, { bloom_0 }, 1 },
+    { "bloom_down_1", { bloom_0 }, 1, { bloom_1 }, 1 },
+    { "bloom_down_2", { bloom_1 }, 1, { bloom_2 }, 1 },
+    { "bloom_up_1", { bloom_2, bloom_1 }, 2, { bloom_up_1 }, 1 },
+    { "bloom_up_0", { bloom_up_1, bloom_0 }, 2, { bloom_up_0 }, 1 },
+    { "debug_overlay", { depth }, 1, { debug_overlay }, 1 },
+    { "tonemap", { hdr, bloom_up_0 }, 2, { back_buffer }, 1 }
+};
+
+struct Frame {
+    kai::FrameGraphResource resources[resource_count];
+    Uint32 tags[resource_count]; // What the last writer stamped into the resource
+    Uint32 frame;
+    Uint32 pass_runs;
+    Uint32 corrupted_reads;
+    Uint32 missing_memory;
+
+    kai::RenderDevice *device;
+    kai::RenderPipeline pipeline;
+    kai::CommandBuffer *buffer;
+};
+
+static Frame frame_state;
+
+static Uint64 get_size(const kai::FrameGraphResourceInfo &info) {
+    return static_cast<Uint64>(info.width) * info.height * get_format_size(info.format);
+}
+
+static void run_pass(const kai::FrameGraphContext &context, void *user_data) {
+    const PassData &pass = *static_cast<const PassData *>(user_data);
+    Frame &frame = frame_state;
+
+    for(Uint32 i = 0; i < pass.read_count; i++) {
+        kai::FrameGraphResource resource = frame.resources[pass.reads[i]];
+        Uint8 *memory = static_cast<Uint8 *>(context.get_memory(resource));
+        const kai::FrameGraphResourceInfo &info = context.get_info(resource);
+
+        if(!memory) {
+            frame.missing_memory++;
+            continue;
+        }
+
+        Uint64 size = get_size(info);
+        for(Uint64 offset = 0; offset + sizeof(Uint32) <= size; offset += PAGE_SIZE) {
+            Uint32 tag;
+            memcpy(&tag, memory + offset, sizeof(tag));
+
+            if(tag != frame.tags[pass.reads[i]]) {
+                frame.corrupted_reads++;
+                break;
+            }
+        }
+    }
+
+    for(Uint32 i = 0; i < pass.write_count; i++) {
+        kai::FrameGraphResource resource = frame.resources[pass.writes[i]];
+        Uint8 *memory = static_cast<Uint8 *>(context.get_memory(resource));
+        const kai::FrameGraphResourceInfo &info = context.get_info(resource);
+
+        if(!memory) {
+            frame.missing_memory++;
+            continue;
+        }
+
+        Uint32 tag = (frame.frame << 16) | (context.pass << 8) | pass.writes[i];
+        frame.tags[pass.writes[i]] = tag;
+
+        Uint64 size = get_size(info);
+        for(Uint64 offset = 0; offset + sizeof(Uint32) <= size; offset += PAGE_SIZE) {
+            memcpy(memory + offset, &tag, sizeof(tag));
+        }
+    }
+
+    frame.buffer->begin();
+    frame.buffer->set_render_pipeline(frame.pipeline);
+    frame.buffer->clear_color();
+    frame.buffer->draw(3);
+    frame.buffer->end();
+
+    frame.device->execute(*frame.buffer);
+    frame.pass_runs++;
+}
+
+static kai::FrameGraphResourceInfo make_info(Uint32 width, Uint32 height, kai::RenderFormat format) {
+    kai::FrameGraphResourceInfo info;
+    info.width = kai::max(width, 1u);
+    info.height = kai::max(height, 1u);
+    info.format = format;
+    info.alignment = 64 * 1024;
+    return info;
+}
+
+static void build_frame(kai::FrameGraph &graph, Uint32 width, Uint32 height, void *back_buffer_memory) {
+    static const char *names[resource_count] = {
+        "shadow_map", "depth", "albedo", "normals", "material", "velocity", "ssao", "ssao_blurred", "hdr",
+        "motion_blurred", "bloom_0", "bloom_1", "bloom_2", "bloom_up_1", "bloom_up_0", "debug_overlay", "back_buffer"
+    };
+
+    Frame &frame = frame_state;
+    kai::FrameGraphResource *r = frame.resources;
+
+    graph.begin();
+
+    r[shadow_map] = graph.create_resource(names[shadow_map], make_info(2048, 2048, kai::RenderFormat::r_f32));
+    r[depth] = graph.create_resource(names[depth], make_info(width, height, kai::RenderFormat::r_f32));
+    r[albedo] = graph.create_resource(names[albedo], make_info(width, height, kai::RenderFormat::rgba_unorm8));
+    r[normals] = graph.create_resource(names[normals], make_info(width, height, kai::RenderFormat::rgba_f16));
+    r[material] = graph.create_resource(names[material], make_info(width, height, kai::RenderFormat::rgba_unorm8));
+    r[velocity] = graph.create_resource(names[velocity], make_info(width, height, kai::RenderFormat::rg_f16));
+    r[ssao] = graph.create_resource(names[ssao], make_info(width / 2, height / 2, kai::RenderFormat::r_f32));
+    r[ssao_blurred] = graph.create_resource(names[ssao_blurred], make_info(width / 2, height / 2, kai::RenderFormat::r_f32));
+    r[hdr] = graph.create_resource(names[hdr], make_info(width, height, kai::RenderFormat::rgba_f16));
+    r[motion_blurred] = graph.create_resource(names[motion_blurred], make_info(width, height, kai::RenderFormat::rgba_f16));
+    r[bloom_0] = graph.create_resource(names[bloom_0], make_info(width / 2, height / 2, kai::RenderFormat::rgba_f16));
+    r[bloom_1] = graph.create_resource(names[bloom_1], make_info(width / 4, height / 4, kai::RenderFormat::rgba_f16));
+    r[bloom_2] = graph.create_resource(names[bloom_2], make_info(width / 8, height / 8, kai::RenderFormat::rgba_f16));
+    r[bloom_up_1] = graph.create_resource(names[bloom_up_1], make_info(width / 4, height / 4, kai::RenderFormat::rgba_f16));
+    r[bloom_up_0] = graph.create_resource(names[bloom_up_0], make_info(width / 2, height / 2, kai::RenderFormat::rgba_f16));
+    r[debug_overlay] = graph.create_resource(names[debug_overlay], make_info(width, height, kai::RenderFormat::rgba_unorm8));
+    r[back_buffer] = graph.import_resource(names[back_buffer], back_buffer_memory, make_info(width, height, kai::RenderFormat::rgba_unorm8));
+
+    for(const PassData &data : pass_data) {
+        kai::FrameGraphPass pass = graph.add_pass(data.name, run_pass, const_cast<PassData *>(&data));
+
+        for(Uint32 i = 0; i < data.read_count; i++) {
+            graph.read(pass, r[data.reads[i]]);
+        }
+
+        for(Uint32 i = 0; i < data.write_count; i++) {
+            graph.write(pass, r[data.writes[i]]);
+        }
+    }
+}
+
+static void count_pass(const kai::FrameGraphContext &, void *user_data) {
+    (*static_cast<Uint32 *>(user_data))++;
+}
+
+// Graphs of nothing but independent passes with side effects, they have neither edges nor resources. Returns the
+// number of pass counts that failed to compile or didn't run every pass
+static Uint32 check_side_effect_graphs(Uint32 max_passes) {
+    Uint32 failures = 0;
+
+    for(Uint32 pass_count = 1; pass_count <= max_passes; pass_count++) {
+        kai::FrameGraph graph(pass_count, 1, 1);
+        Uint32 runs = 0;
+
+        graph.begin();
+        for(Uint32 i = 0; i < pass_count; i++) {
+            graph.add_pass("side_effects", count_pass, &runs, true);
+        }
+
+        bool compiled = graph.compile();
+        if(compiled) {
+            graph.execute();
+        }
+
+        if(!compiled || graph.get_scheduled_pass_count() != pass_count || runs != pass_count) {
+            printf("Error: a graph of %u passes with side effects and no resources %s!\n", pass_count,
+                   compiled ? "didn't run all of them" : "could not be compiled");
+            failures++;
+        }
+
+        graph.destroy();
+    }
+
+    return failures;
+}
+
+static Float64 to_mib(Uint64 bytes) {
+    return static_cast<Float64>(bytes) / (1024.0 * 1024.0);
+}
+
+int main(int argc, char **argv) {
+    Uint32 width = 1920;
+    Uint32 height = 1080;
+    Uint32 frame_count = 100;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frame_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--size") && i + 2 < argc) {
+            width = static_cast<Uint32>(atoi(argv[++i]));
+            height = static_cast<Uint32>(atoi(argv[++i]));
+        } else {
+            printf("Usage: %s [--frames N] [--size WIDTH HEIGHT]\n", argv[0]);
+            return 0;
+        }
+    }
+
+    frame_count = kai::max(frame_count, 1u);
+    kai::clamp(width, 8u, 16384u);
+    kai::clamp(height, 8u, 16384u);
+    window.width = width;
+    window.height = height;
+
+    MemoryManager::init(kai::gibibytes(4));
+    engine_memory = kai::StackAllocator(static_cast<Uint32>(kai::mebibytes(1)));
+
+    init_renderer(kai::RenderingBackend::null);
+    kai::RenderDevice *device = kai::RenderDevice::get();
+    NullRenderer *null_device = static_cast<NullRenderer *>(get_backend_device());
+
+    if(!device) {
+        printf("Error: could not create the null render device!\n");
+        return -1;
+    }
+
+    kai::RenderPipelineInfo pipeline_info = {};
+    pipeline_info.vertex_shader_source = "fullscreen";
+    pipeline_info.vertex_shader_entry = "main";
+    pipeline_info.pixel_shader_source = "pass";
+    pipeline_info.pixel_shader_entry = "main";
+    device->create_render_pipeline(pipeline_info, nullptr, 0, frame_state.pipeline);
+
+    kai::CommandBuffer buffer(8);
+    void *back_buffer_memory = malloc(static_cast<size_t>(width) * height * 4);
+
+    frame_state.device = device;
+    frame_state.buffer = &buffer;
+
+    kai::FrameGraph graph(32, 32, 128);
+
+    Uint32 errors = 0;
+    Uint32 expected_runs = 0;
+    Bool32 compile_failed = false;
+    Float64 compile_ms = 0.0;
+    Float64 execute_ms = 0.0;
+
+    for(Uint32 frame = 0; frame < frame_count; frame++) {
+        frame_state.frame = frame;
+
+        build_frame(graph, width, height, back_buffer_memory);
+
+        if(!graph.compile()) {
+            compile_failed = true;
+            break;
+        }
+
+        Uint64 start = kai::get_timestamp();
+        graph.execute();
+        execute_ms += static_cast<Float64>(kai::get_timestamp() - start) * 1000.0 / static_cast<Float64>(kai::get_timestamp_frequency());
+
+        device->present();
+
+        compile_ms += graph.get_stats().compile_ms;
+        expected_runs += graph.get_scheduled_pass_count();
+        errors += null_device->get_frame_stats().errors;
+    }
+
+    const kai::FrameGraphStats &stats = graph.get_stats();
+
+    printf("%u passes, %u transient resources at %ux%u, %u frames\n\n", stats.pass_count, stats.resource_count, width, height, frame_count);
+
+    printf("Schedule:\n");
+    for(Uint32 i = 0; i < graph.get_scheduled_pass_count(); i++) {
+        printf("  %2u  %s\n", i, graph.get_pass_name(graph.get_scheduled_pass(i)));
+    }
+
+    printf("Culled:\n");
+    for(Uint32 i = 0; i < stats.pass_count; i++) {
+        if(graph.is_culled(i)) {
+            printf("      %s\n", graph.get_pass_name(i));
+        }
+    }
+
+    printf("\n%-16s %10s %10s %10s\n", "resource", "MiB", "lifetime", "offset");
+    for(Uint32 i = 0; i < graph.get_resource_count(); i++) {
+        const kai::FrameGraphResourceInfo &info = graph.get_resource_info(i);
+        Uint64 offset;
+        Uint32 first, last;
+
+        Float64 size = to_mib(get_size(info));
+        if(graph.get_placement(i, offset, first, last)) {
+            printf("%-16s %10.2f %5u-%-4u %10.2f\n", graph.get_resource_name(i), size, first, last, to_mib(offset));
+        } else {
+            printf("%-16s %10.2f %10s %10s\n", graph.get_resource_name(i), size, "-", "-");
+        }
+    }
+
+    Float64 saved = stats.transient_bytes ? 100.0 * (1.0 - static_cast<Float64>(stats.heap_bytes) / static_cast<Float64>(stats.transient_bytes)) : 0.0;
+
+    printf("\ntransient memory   %8.2f MiB without aliasing\n", to_mib(stats.transient_bytes));
+    printf("heap               %8.2f MiB (%.1f%% saved)\n", to_mib(stats.heap_bytes), saved);
+    printf("compile            %8.3f ms per frame\n", compile_ms / static_cast<Float64>(frame_count));
+    printf("execute            %8.3f ms per frame\n", execute_ms / static_cast<Float64>(frame_count));
+
+    int retval = 0;
+    if(compile_failed) {
+        printf("Error: the frame graph could not be compiled!\n");
+        retval = -1;
+    }
+
+    const char *expected_culled[] = { "velocity", "motion_blur", "debug_overlay" };
+    if(stats.culled_pass_count != KAI_ARRAY_COUNT(expected_culled)) {
+        printf("Error: %u passes were culled instead of %u!\n", stats.culled_pass_count, static_cast<Uint32>(KAI_ARRAY_COUNT(expected_culled)));
+        retval = -1;
+    }
+
+    for(Uint32 i = 0; i < stats.pass_count; i++) {
+        bool should_cull = false;
+        for(const char *name : expected_culled) {
+            should_cull = should_cull || !strcmp(name, graph.get_pass_name(i));
+        }
+
+        if(should_cull != graph.is_culled(i)) {
+            printf("Error: '%s' should%s have been culled!\n", graph.get_pass_name(i), should_cull ? "" : "n't");
+            retval = -1;
+        }
+    }
+
+    if(frame_state.corrupted_reads > 0) {
+        printf("Error: %u reads found a resource that was overwritten while it was alive!\n", frame_state.corrupted_reads);
+        retval = -1;
+    }
+
+    if(frame_state.missing_memory > 0 || frame_state.pass_runs != expected_runs) {
+        printf("Error: %u passes ran instead of %u, %u resources had no memory!\n", frame_state.pass_runs, expected_runs, frame_state.missing_memory);
+        retval = -1;
+    }
+
+    if(errors > 0) {
+        printf("Error: the null device found %u invalid commands!\n", errors);
+        retval = -1;
+    }
+
+    if(check_side_effect_graphs(64) > 0) {
+        retval = -1;
+    }
+
+    graph.destroy();
+    buffer.destroy();
+    free(back_buffer_memory);
+
+    destroy_renderer();
+    destroy_command_chunk_pool();
+    engine_memory.destroy();
+    MemoryManager::destroy();
+
+    return retval;
+}
@@ -1,3 +1,4 @@
+#include "../../core/includes/pack.h"
 #include "../../core/includes/utils.h"
 #include <stdio.h>
 
@@ -5,3 +6,28 @@
 extern "C" KAI_API Uint64 kai_fnv1a64_str_hash(const char *str) {
     return kai::fnv1a64_str_hash(str);
 }
+
+// Vertex compression kernels, these write into buffers that are allocated on the python side
+extern "C" KAI_API void kai_convert_to_f16(const Float32 *in, Uint16 *out, Uint32 count) {
+    kai::convert_to_f16(in, reinterpret_cast<kai::Float16 *>(out), count);
+}
+
+extern "C" KAI_API void kai_pack_unorm8(const Float32 *in, Uint8 *out, Uint32 count) {
+    kai::pack_unorm8(in, out, count);
+}
+
+extern "C" KAI_API void kai_pack_snorm8(const Float32 *in, Int8 *out, Uint32 count) {
+    kai::pack_snorm8(in, out, count);
+}
+
+extern "C" KAI_API void kai_pack_unorm16(const Float32 *in, Uint16 *out, Uint32 count) {
+    kai::pack_unorm16(in, out, count);
+}
+
+extern "C" KAI_API void kai_pack_snorm16(const Float32 *in, Int16 *out, Uint32 count) {
+    kai::pack_snorm16(in, out, count);
+}
+
+extern "C" KAI_API void kai_encode_octahedral_snorm16(const Float32 *normals, Int16 *out, Uint32 count) {
+    kai::encode_octahedral_snorm16(normals, out, count);
+}
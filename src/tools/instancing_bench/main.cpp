@@ -0,0 +1,260 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+// Headless benchmark for auto-instancing. A scene of objects that share a small set of meshes is
+// recorded and executed with and without auto-instancing, in both CommandBufferModes. The device
+// decodes the commands, copies the instance data like a backend would upload it and counts the
+// draw calls that it would have issued. It also checks that every object is drawn exactly once
+// with its own transform, so the numbers can't come from dropped draws.
+// Without a graphics API the cost of the draw calls themselves isn't part of the measurement,
+// --call-cost adds a busy wait of that many nanoseconds per draw call to stand in for the driver.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/headless.h"
+
+#define MESH_COUNT 64
+#define PIPELINE_COUNT 4
+
+static void spin(Uint64 nanoseconds) {
+    Uint64 end = kai::get_timestamp() + nanoseconds * kai::get_timestamp_frequency() / 1000000000ull;
+    while(kai::get_timestamp() < end) {
+    }
+}
+
+// Does everything a backend does on the CPU, except for calling into the graphics API
+struct CountingDevice : public HeadlessDevice {
+    using HeadlessDevice::execute;
+
+    void execute(const kai::CommandBuffer &command_buffer) const override {
+        Uint32 size = command_buffer.get_instance_data_size();
+        KAI_ASSERT(size <= upload_size);
+        memcpy(upload, command_buffer.get_instance_data(), size);
+
+        CommandDecoder decoder(command_buffer, true);
+        CommandEncodingData command;
+        while(decoder.next(command)) {
+            switch(command.draw.encoding) {
+                case CommandEncoding::draw_indexed:
+                    spin(call_cost);
+                    draw_calls++;
+                    objects_drawn++;
+                    break;
+                case CommandEncoding::draw_indexed_instanced: {
+                    const auto c = &command.draw_indexed_instanced;
+                    const kai::InstanceTransform *transforms =
+                        reinterpret_cast<const kai::InstanceTransform *>(upload + c->instance_offset);
+
+                    for(Uint32 i = 0; i < c->instance_count; i++) {
+                        translation_sum += static_cast<Float64>(transforms[i].rows[0][3]);
+                    }
+
+                    spin(call_cost);
+                    draw_calls++;
+                    objects_drawn += c->instance_count;
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+
+    Uint8 *upload;
+    Uint32 upload_size;
+    Uint64 call_cost;
+
+    mutable Uint32 draw_calls = 0;
+    mutable Uint32 objects_drawn = 0;
+    mutable Float64 translation_sum = 0.0;
+};
+
+struct Object {
+    Uint32 mesh;
+    kai::Mat4x4 transform;
+};
+
+static kai::RenderPipeline pipelines[PIPELINE_COUNT];
+static kai::RenderBuffer vertex_buffers[MESH_COUNT];
+static kai::RenderBuffer index_buffers[MESH_COUNT];
+static kai::RenderBuffer constant_buffer;
+
+static KAI_FORCEINLINE Uint32 xorshift(Uint32 &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void record(kai::CommandBuffer &buffer, const Object *objects, Uint32 object_count) {
+    buffer.begin();
+    buffer.bind_buffer(constant_buffer, kai::RenderBufferType::constant);
+
+    for(Uint32 i = 0; i < object_count; i++) {
+        const Object &object = objects[i];
+
+        buffer.set_render_pipeline(pipelines[object.mesh % PIPELINE_COUNT]);
+        buffer.bind_buffer(vertex_buffers[object.mesh], kai::RenderBufferType::vertex);
+        buffer.bind_buffer(index_buffers[object.mesh], kai::RenderBufferType::index);
+        buffer.set_instance_transform(object.transform);
+        buffer.draw_indexed(36 * (object.mesh + 1));
+    }
+
+    buffer.end();
+}
+
+struct Result {
+    Uint32 draw_calls;
+    Float64 record_ms;
+    Float64 execute_ms;
+    Bool32 valid;
+};
+
+static Result run(const Object *objects, Uint32 object_count, Uint32 frame_count, Uint64 call_cost,
+                  kai::CommandBufferMode mode, Bool32 auto_instancing, Float64 translation_sum) {
+    kai::CommandBuffer buffer(object_count, mode);
+    buffer.set_auto_instancing(auto_instancing);
+
+    CountingDevice device;
+    device.upload_size = object_count * static_cast<Uint32>(sizeof(kai::InstanceTransform));
+    device.upload = static_cast<Uint8 *>(malloc(device.upload_size));
+    device.call_cost = call_cost;
+
+    Result result = {};
+    result.valid = true;
+    Uint64 best_record = ~0ull;
+    Uint64 best_execute = ~0ull;
+
+    for(Uint32 frame = 0; frame < frame_count; frame++) {
+        Uint64 start = kai::get_timestamp();
+        record(buffer, objects, object_count);
+        Uint64 recorded = kai::get_timestamp();
+
+        device.draw_calls = 0;
+        device.objects_drawn = 0;
+        device.translation_sum = 0.0;
+        device.execute(buffer);
+        Uint64 executed = kai::get_timestamp();
+
+        best_record = kai::min(best_record, recorded - start);
+        best_execute = kai::min(best_execute, executed - recorded);
+
+        // Plain draws don't carry their transform, only the instanced ones can be checked
+        result.valid &= device.objects_drawn == object_count;
+        result.valid &= !auto_instancing || device.translation_sum == translation_sum;
+    }
+
+    result.draw_calls = device.draw_calls;
+
+    Float64 frequency = static_cast<Float64>(kai::get_timestamp_frequency());
+    result.record_ms = static_cast<Float64>(best_record) * 1000.0 / frequency;
+    result.execute_ms = static_cast<Float64>(best_execute) * 1000.0 / frequency;
+
+    free(device.upload);
+    buffer.destroy();
+
+    return result;
+}
+
+int main(int argc, char **argv) {
+    Uint32 object_count = 20000;
+    Uint32 frame_count = 20;
+    Uint64 call_cost = 0;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--objects") && i + 1 < argc) {
+            object_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frame_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--call-cost") && i + 1 < argc) {
+            call_cost = static_cast<Uint64>(atoi(argv[++i]));
+        } else {
+            printf("Usage: %s [--objects N] [--frames N] [--call-cost NANOSECONDS]\n", argv[0]);
+            return 0;
+        }
+    }
+
+    object_count = kai::max(object_count, 1u);
+
+    MemoryManager::init(kai::gibibytes(4));
+    engine_memory = kai::StackAllocator(static_cast<Uint32>(kai::mebibytes(1)));
+
+    // Handles like the ones a backend hands out for freshly created resources, nothing resolves them here.
+    // CommandBufferMode::sorted groups the draws by them, with null handles every draw would get the same key
+    for(Uint32 i = 0; i < PIPELINE_COUNT; i++) {
+        pipelines[i].handle = (1u << RENDER_HANDLE_INDEX_BITS) | i;
+    }
+
+    for(Uint32 i = 0; i < MESH_COUNT; i++) {
+        vertex_buffers[i].handle = (1u << RENDER_HANDLE_INDEX_BITS) | i;
+        index_buffers[i].handle = (1u << RENDER_HANDLE_INDEX_BITS) | (MESH_COUNT + i);
+    }
+
+    constant_buffer.handle = (1u << RENDER_HANDLE_INDEX_BITS) | (2 * MESH_COUNT);
+
+    // The same objects in two orders: grouped by mesh, the way a scene graph often hands them out,
+    // and shuffled, which only CommandBufferMode::sorted can group back together
+    Object *grouped = static_cast<Object *>(malloc(object_count * sizeof(Object)));
+    Object *shuffled = static_cast<Object *>(malloc(object_count * sizeof(Object)));
+
+    Float64 translation_sum = 0.0;
+    for(Uint32 i = 0; i < object_count; i++) {
+        Float32 x = static_cast<Float32>(i % 1000);
+        grouped[i].mesh = static_cast<Uint32>((static_cast<Uint64>(i) * MESH_COUNT) / object_count);
+        grouped[i].transform = kai::Mat4x4::translate(x, static_cast<Float32>(i / 1000), 0.0f);
+        translation_sum += static_cast<Float64>(x);
+    }
+
+    memcpy(shuffled, grouped, object_count * sizeof(Object));
+
+    Uint32 rng = 0x9e3779b9u;
+    for(Uint32 i = object_count - 1; i > 0; i--) {
+        kai::swap(shuffled[i], shuffled[xorshift(rng) % (i + 1)]);
+    }
+
+    printf("%u objects using %u meshes, best of %u frames, %llu ns per draw call\n\n",
+           object_count, MESH_COUNT, frame_count, static_cast<unsigned long long>(call_cost));
+    printf("%-9s %-10s %-5s %11s %10s %11s %10s %9s\n",
+           "order", "mode", "auto", "draw calls", "record ms", "execute ms", "total ms", "speedup");
+
+    int retval = 0;
+    const Object *orders[] = { grouped, shuffled };
+    const kai::CommandBufferMode modes[] = { kai::CommandBufferMode::immediate, kai::CommandBufferMode::sorted };
+
+    for(Uint32 order = 0; order < KAI_ARRAY_COUNT(orders); order++) {
+        for(kai::CommandBufferMode mode : modes) {
+            Float64 baseline_ms = 0.0;
+
+            for(Bool32 auto_instancing = 0; auto_instancing < 2; auto_instancing++) {
+                Result result = run(orders[order], object_count, frame_count, call_cost,
+                                    mode, auto_instancing, translation_sum);
+                Float64 total_ms = result.record_ms + result.execute_ms;
+                baseline_ms = auto_instancing ? baseline_ms : total_ms;
+
+                printf("%-9s %-10s %-5s %11u %10.3f %11.3f %10.3f %8.2fx\n",
+                       order ? "shuffled" : "grouped",
+                       (mode == kai::CommandBufferMode::sorted) ? "sorted" : "immediate",
+                       auto_instancing ? "on" : "off",
+                       result.draw_calls, result.record_ms, result.execute_ms, total_ms, baseline_ms / total_ms);
+
+                if(!result.valid) {
+                    printf("Error: not every object was drawn exactly once with its own transform!\n");
+                    retval = -1;
+                }
+            }
+        }
+    }
+
+    free(grouped);
+    free(shuffled);
+
+    destroy_command_chunk_pool();
+    engine_memory.destroy();
+    MemoryManager::destroy();
+
+    return retval;
+}
@@ -0,0 +1,660 @@
+// Benchmark and accuracy harness for math.h. Every function is timed and its results are
+// compared against a double precision reference, the error is reported in ULPs.
+//
+// The report is one line per measurement in a fixed key=value format so that the output
+// of two runs can be diffed or parsed by scripts:
+//   <group> <name> <variant> ns=<ns per op> max_ulp=<max> mean_ulp=<mean>
+// Pass --table to get the human readable table for the trig/sqrt functions instead.
+//
+// A report can be stored as a baseline (baseline.txt next to this file is one) and later runs
+// checked against it with --check <baseline>, which exits with 1 if anything regressed: an error
+// of more than ULP_TOLERANCE ULPs over the baseline, or a time more than TIME_TOLERANCE (plus
+// TIME_SLACK_NS) above it.
+// The times only mean something on the machine that recorded the baseline, record a new one with
+//   math_bench > baseline.txt
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "../../core/includes/math.h"
+
+#define SAMPLE_COUNT (1 << 18)
+#define ITERATIONS 32
+#define ULP_TOLERANCE 0.01 // Of the max and the mean error, over the baseline
+#define TIME_TOLERANCE 0.5 // Times over the baseline that count as a regression, 0.5 = 50% slower
+#define TIME_SLACK_NS 1.0 // Added on top, the few ns functions are mostly timer and scheduling noise
+
+// Keeps the optimizer from throwing away the results
+static volatile Float32 g_sink;
+
+struct ErrorStats {
+    Float64 max_ulp = 0.0;
+    Float64 sum_ulp = 0.0;
+    Uint64 count = 0;
+
+    // The distance is measured in units of the ULP of the float closest to the reference.
+    // Values close to zero are measured against the ULP of 'scale' instead, since
+    // cancellation makes the relative error meaningless there
+    void add(Float32 value, Float64 reference, Float64 scale = 0.0) {
+        Float64 magnitude = kai::max(fabs(reference), scale);
+        Float32 ref_f = static_cast<Float32>(magnitude);
+        Float64 ulp = static_cast<Float64>(nextafterf(ref_f, INFINITY) - ref_f);
+
+        if(ulp > 0.0 && isfinite(ulp)) {
+            Float64 e = fabs(static_cast<Float64>(value) - reference) / ulp;
+            max_ulp = kai::max(max_ulp, e);
+            sum_ulp += e;
+            count++;
+        }
+    }
+
+    Float64 mean_ulp(void) const {
+        return (count > 0) ? sum_ulp / static_cast<Float64>(count) : 0.0;
+    }
+};
+
+// The fastest of the iterations is kept, it's the one least disturbed by the rest of the machine
+// and what keeps the --check times stable from run to run
+template<typename FUNC>
+static Float64 time_ns_per_op(FUNC func, Uint32 ops) {
+    Float64 best_ns = 0.0;
+
+    for(Uint32 i = 0; i < ITERATIONS; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        func();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        Float64 ns = static_cast<Float64>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        if(i == 0 || ns < best_ns) {
+            best_ns = ns;
+        }
+    }
+
+    return best_ns / static_cast<Float64>(ops);
+}
+
+struct Measurement {
+    char key[96]; // "<group> <name> <variant>"
+    Float64 ns;
+    Float64 max_ulp;
+    Float64 mean_ulp;
+};
+
+// Of this run, for --check
+static std::vector<Measurement> g_measurements;
+
+static void report(const char *group, const char *name, const char *variant, Float64 ns, const ErrorStats &error) {
+    fprintf(stdout, "%-8s %-20s %-8s ns=%-9.3f max_ulp=%-10.2f mean_ulp=%.3f\n",
+            group, name, variant, ns, error.max_ulp, error.mean_ulp());
+
+    Measurement m;
+    snprintf(m.key, sizeof(m.key), "%s %s %s", group, name, variant);
+    m.ns = ns;
+    m.max_ulp = error.max_ulp;
+    m.mean_ulp = error.mean_ulp();
+    g_measurements.push_back(m);
+}
+
+// Compares the measurements of this run against the report in 'path', returns false if any of them regressed
+static bool check_baseline(const char *path) {
+    FILE *f = fopen(path, "r");
+    if(!f) {
+        fprintf(stderr, "Could not open the baseline \"%s\"\n", path);
+        return false;
+    }
+
+    std::vector<Measurement> baseline;
+    char line[256];
+    while(fgets(line, sizeof(line), f)) {
+        char group[32];
+        char name[32];
+        char variant[32];
+        Measurement m;
+
+        if(line[0] != '#' && sscanf(line, "%31s %31s %31s ns=%lf max_ulp=%lf mean_ulp=%lf",
+                                    group, name, variant, &m.ns, &m.max_ulp, &m.mean_ulp) == 6) {
+            snprintf(m.key, sizeof(m.key), "%s %s %s", group, name, variant);
+            baseline.push_back(m);
+        }
+    }
+
+    fclose(f);
+
+    Uint32 regressions = 0;
+    Uint32 checked = 0;
+
+    for(const Measurement &m : g_measurements) {
+        const Measurement *base = nullptr;
+        for(const Measurement &b : baseline) {
+            if(strcmp(b.key, m.key) == 0) {
+                base = &b;
+                break;
+            }
+        }
+
+        if(!base) {
+            fprintf(stdout, "NEW        %-40s not in the baseline\n", m.key);
+            continue;
+        }
+
+        checked++;
+
+        if(m.max_ulp > base->max_ulp + ULP_TOLERANCE || m.mean_ulp > base->mean_ulp + ULP_TOLERANCE) {
+            fprintf(stdout, "REGRESSION %-40s max_ulp=%.2f mean_ulp=%.3f, baseline max_ulp=%.2f mean_ulp=%.3f\n",
+                    m.key, m.max_ulp, m.mean_ulp, base->max_ulp, base->mean_ulp);
+            regressions++;
+        }
+
+        if(m.ns > base->ns * (1.0 + TIME_TOLERANCE) + TIME_SLACK_NS) {
+            fprintf(stdout, "REGRESSION %-40s ns=%.3f, baseline ns=%.3f (%.0f%% slower)\n",
+                    m.key, m.ns, base->ns, (m.ns / base->ns - 1.0) * 100.0);
+            regressions++;
+        }
+    }
+
+    fprintf(stdout, "# %u measurements checked against \"%s\", %u regressions\n", checked, path, regressions);
+    return regressions == 0;
+}
+
+// Deterministic LCG so that runs are comparable
+struct Random {
+    Float32 next(Float32 lo, Float32 hi) {
+        state = state * 1664525u + 1013904223u;
+        Float32 t = static_cast<Float32>(state >> 8) / static_cast<Float32>(1u << 24);
+        return lo + (hi - lo) * t;
+    }
+
+    kai::Vec4 next_vec4(Float32 lo, Float32 hi, Float32 w) {
+        return kai::Vec4(next(lo, hi), next(lo, hi), next(lo, hi), w);
+    }
+
+    Uint32 state = 0x12345678u;
+};
+
+// -------------------------------------------------- Scalar functions -------------------------------------------------- //
+static Float64 reference_rsqrt(Float64 x) { return 1.0 / sqrt(x); }
+
+template<kai::Precision P, typename SCALAR_FUNC, typename BATCH_FUNC>
+static void bench_function(const char *name, const std::vector<Float32> &in, Float64 (*reference)(Float64),
+                           SCALAR_FUNC scalar_func, BATCH_FUNC batch_func, bool table) {
+    std::vector<Float32> out(in.size());
+    const Uint32 count = static_cast<Uint32>(in.size());
+    const char *mode = (P == kai::Precision::fast) ? "fast" : "exact";
+
+    // Trig results are measured in absolute terms (scale 1) since the reference goes through zero
+    Float64 scale = (reference == static_cast<Float64 (*)(Float64)>(sin) ||
+                     reference == static_cast<Float64 (*)(Float64)>(cos)) ? 1.0 : 0.0;
+
+    ErrorStats scalar_error;
+    Float64 scalar_ns = time_ns_per_op([&]() {
+        for(Uint32 i = 0; i < count; i++) {
+            out[i] = scalar_func(in[i]);
+        }
+        g_sink = out[count / 2];
+    }, count);
+    for(Uint32 i = 0; i < count; i++) {
+        scalar_error.add(out[i], reference(in[i]), scale);
+    }
+
+    ErrorStats batch_error;
+    Float64 max_abs = 0.0;
+    Float64 max_rel = 0.0;
+    Float64 batch_ns = time_ns_per_op([&]() {
+        batch_func(in.data(), out.data(), count);
+        g_sink = out[count / 2];
+    }, count);
+    for(Uint32 i = 0; i < count; i++) {
+        Float64 expected = reference(in[i]);
+        Float64 error = fabs(static_cast<Float64>(out[i]) - expected);
+
+        batch_error.add(out[i], expected, scale);
+        max_abs = kai::max(max_abs, error);
+        if(fabs(expected) > 1e-3) {
+            max_rel = kai::max(max_rel, error / fabs(expected));
+        }
+    }
+
+    if(table) {
+        fprintf(stdout, "| %-12s | %-5s | %12.3e | %12.3e | %10.3f | %10.3f |\n",
+                name, mode, max_abs, max_rel, scalar_ns, batch_ns);
+    } else {
+        char variant[32];
+        snprintf(variant, sizeof(variant), "%s", mode);
+        report("scalar", name, variant, scalar_ns, scalar_error);
+        snprintf(variant, sizeof(variant), "%s_x%u", mode, (P == kai::Precision::fast) ? kai::simd::FloatN::lanes : 1);
+        report("batch", name, variant, batch_ns, batch_error);
+    }
+}
+
+static void bench_functions(bool table) {
+    std::vector<Float32> angles(SAMPLE_COUNT);
+    std::vector<Float32> small_angles(SAMPLE_COUNT);
+    std::vector<Float32> positives(SAMPLE_COUNT);
+
+    Random random;
+    for(Uint32 i = 0; i < SAMPLE_COUNT; i++) {
+        angles[i] = random.next(-100.0f * kai::pi, 100.0f * kai::pi);
+        small_angles[i] = random.next(-1.5f, 1.5f);
+        positives[i] = random.next(1e-6f, 1e6f);
+    }
+
+    if(table) {
+        fprintf(stdout, "Lanes: %u (batch), %d samples\n\n", kai::simd::FloatN::lanes, SAMPLE_COUNT);
+        fprintf(stdout, "| %-12s | %-5s | %12s | %12s | %10s | %10s |\n",
+                "function", "mode", "max abs err", "max rel err", "scalar ns", "batch ns");
+        fprintf(stdout, "|--------------|-------|--------------|--------------|------------|------------|\n");
+    }
+
+#define BENCH_FUNC(name, input, reference) \
+    bench_function<kai::Precision::exact>(#name, input, reference, \
+                                          [](Float32 v) { return kai::name<kai::Precision::exact>(v); }, \
+                                          [](const Float32 *i, Float32 *o, Uint32 c) { kai::name<kai::Precision::exact>(i, o, c); }, \
+                                          table); \
+    bench_function<kai::Precision::fast>(#name, input, reference, \
+                                         [](Float32 v) { return kai::name<kai::Precision::fast>(v); }, \
+                                         [](const Float32 *i, Float32 *o, Uint32 c) { kai::name<kai::Precision::fast>(i, o, c); }, \
+                                         table)
+
+    BENCH_FUNC(sine, angles, sin);
+    BENCH_FUNC(cosine, angles, cos);
+    BENCH_FUNC(tangent, small_angles, tan);
+    BENCH_FUNC(square_root, positives, sqrt);
+    BENCH_FUNC(rsqrt, positives, reference_rsqrt);
+
+#undef BENCH_FUNC
+}
+
+// -------------------------------------------------- Vectors -------------------------------------------------- //
+struct DVec4 {
+    Float64 x, y, z, w;
+};
+
+static DVec4 to_double(const kai::Vec4 &v) {
+    return { v.x, v.y, v.z, v.w };
+}
+
+static void add_error(ErrorStats &error, const kai::Vec4 &v, const DVec4 &r, Float64 scale) {
+    error.add(v.x, r.x, scale);
+    error.add(v.y, r.y, scale);
+    error.add(v.z, r.z, scale);
+    error.add(v.w, r.w, scale);
+}
+
+static void bench_vectors(void) {
+    const Uint32 count = SAMPLE_COUNT;
+
+    std::vector<kai::Vec4> a(count);
+    std::vector<kai::Vec4> b(count);
+    std::vector<kai::Vec4> out(count);
+    std::vector<kai::Vec2> a2(count);
+    std::vector<kai::Vec2> b2(count);
+    std::vector<kai::Vec2> out2(count);
+    std::vector<Float32> scalars(count);
+
+    Random random;
+    for(Uint32 i = 0; i < count; i++) {
+        a[i] = random.next_vec4(-10.0f, 10.0f, random.next(-10.0f, 10.0f));
+        b[i] = random.next_vec4(-10.0f, 10.0f, random.next(-10.0f, 10.0f));
+        a2[i] = kai::Vec2(a[i].x, a[i].y);
+        b2[i] = kai::Vec2(b[i].x, b[i].y);
+    }
+
+#define BENCH_VEC4_BINARY(name, expr, ref_x, ref_y, ref_z, ref_w) \
+    { \
+        Float64 ns = time_ns_per_op([&]() { \
+            for(Uint32 i = 0; i < count; i++) { \
+                const kai::Vec4 &l = a[i]; const kai::Vec4 &r = b[i]; \
+                out[i] = expr; \
+            } \
+            g_sink = out[count / 2].x; \
+        }, count); \
+        ErrorStats error; \
+        for(Uint32 i = 0; i < count; i++) { \
+            DVec4 l = to_double(a[i]); DVec4 r = to_double(b[i]); \
+            add_error(error, out[i], { ref_x, ref_y, ref_z, ref_w }, 10.0); \
+        } \
+        report("vec4", name, "scalar", ns, error); \
+    }
+
+    BENCH_VEC4_BINARY("add", l + r, l.x + r.x, l.y + r.y, l.z + r.z, l.w + r.w);
+    BENCH_VEC4_BINARY("mul", l * r, l.x * r.x, l.y * r.y, l.z * r.z, l.w * r.w);
+    BENCH_VEC4_BINARY("cross", kai::cross(l, r), l.y * r.z - l.z * r.y, l.z * r.x - l.x * r.z, l.x * r.y - l.y * r.x, 0.0);
+
+#undef BENCH_VEC4_BINARY
+
+    {
+        Float64 ns = time_ns_per_op([&]() {
+            for(Uint32 i = 0; i < count; i++) {
+                scalars[i] = kai::dot(a[i], b[i]);
+            }
+            g_sink = scalars[count / 2];
+        }, count);
+
+        ErrorStats error;
+        for(Uint32 i = 0; i < count; i++) {
+            DVec4 l = to_double(a[i]);
+            DVec4 r = to_double(b[i]);
+            error.add(scalars[i], l.x * r.x + l.y * r.y + l.z * r.z + l.w * r.w, 100.0);
+        }
+        report("vec4", "dot", "scalar", ns, error);
+    }
+
+    {
+        Float64 ns = time_ns_per_op([&]() {
+            for(Uint32 i = 0; i < count; i++) {
+                out2[i] = a2[i] + b2[i];
+            }
+            g_sink = out2[count / 2].x;
+        }, count);
+
+        ErrorStats error;
+        for(Uint32 i = 0; i < count; i++) {
+            error.add(out2[i].x, static_cast<Float64>(a2[i].x) + b2[i].x, 10.0);
+            error.add(out2[i].y, static_cast<Float64>(a2[i].y) + b2[i].y, 10.0);
+        }
+        report("vec2", "add", "scalar", ns, error);
+    }
+
+    {
+        Float64 ns = time_ns_per_op([&]() {
+            for(Uint32 i = 0; i < count; i++) {
+                out2[i] = a2[i];
+                out2[i].normalize();
+            }
+            g_sink = out2[count / 2].x;
+        }, count);
+
+        ErrorStats error;
+        for(Uint32 i = 0; i < count; i++) {
+            Float64 x = a2[i].x;
+            Float64 y = a2[i].y;
+            Float64 mag = sqrt(x * x + y * y);
+            error.add(out2[i].x, x / mag);
+            error.add(out2[i].y, y / mag);
+        }
+        report("vec2", "normalize", "scalar", ns, error);
+    }
+
+    // Normalization: scalar member function vs the 4-wide batch version, both precisions
+    auto normalize_error = [&](ErrorStats &error) {
+        for(Uint32 i = 0; i < count; i++) {
+            DVec4 v = to_double(a[i]);
+            Float64 mag = sqrt(v.x * v.x + v.y * v.y + v.z * v.z + v.w * v.w);
+            add_error(error, out[i], { v.x / mag, v.y / mag, v.z / mag, v.w / mag }, 0.0);
+        }
+    };
+
+#define BENCH_NORMALIZE(precision, variant) \
+    { \
+        Float64 ns = time_ns_per_op([&]() { \
+            for(Uint32 i = 0; i < count; i++) { \
+                out[i] = a[i]; \
+                out[i].normalize<precision>(); \
+            } \
+            g_sink = out[count / 2].x; \
+        }, count); \
+        ErrorStats error; \
+        normalize_error(error); \
+        report("vec4", "normalize", variant, ns, error); \
+        ns = time_ns_per_op([&]() { \
+            memcpy(out.data(), a.data(), sizeof(kai::Vec4) * count); \
+            kai::normalize<precision>(out.data(), count); \
+            g_sink = out[count / 2].x; \
+        }, count); \
+        ErrorStats batch_error; \
+        normalize_error(batch_error); \
+        report("vec4", "normalize", variant "_x4", ns, batch_error); \
+    }
+
+    BENCH_NORMALIZE(kai::Precision::exact, "exact");
+    BENCH_NORMALIZE(kai::Precision::fast, "fast");
+
+#undef BENCH_NORMALIZE
+}
+
+// -------------------------------------------------- Matrices -------------------------------------------------- //
+struct DMat4 {
+    Float64 m[4][4]; // Same column-major layout as kai::Mat4x4
+};
+
+static DMat4 to_double(const kai::Mat4x4 &m) {
+    DMat4 d;
+    for(Uint32 i = 0; i < 4; i++) {
+        for(Uint32 j = 0; j < 4; j++) {
+            d.m[i][j] = m.m[i][j];
+        }
+    }
+    return d;
+}
+
+static DVec4 mul(const DMat4 &m, const DVec4 &v) {
+    return {
+        m.m[0][0] * v.x + m.m[1][0] * v.y + m.m[2][0] * v.z + m.m[3][0] * v.w,
+        m.m[0][1] * v.x + m.m[1][1] * v.y + m.m[2][1] * v.z + m.m[3][1] * v.w,
+        m.m[0][2] * v.x + m.m[1][2] * v.y + m.m[2][2] * v.z + m.m[3][2] * v.w,
+        m.m[0][3] * v.x + m.m[1][3] * v.y + m.m[2][3] * v.z + m.m[3][3] * v.w
+    };
+}
+
+// Plain scalar reference of the matrix product, the library version is vectorized. GCC and MSVC
+// vectorize loops like this one by themselves at -O2, which left the "scalar" row measuring the
+// same code as the "x4" one, so that's turned off for this function
+#if defined(__GNUC__) && !defined(__clang__)
+__attribute__((noinline, optimize("no-tree-vectorize", "no-tree-slp-vectorize")))
+#elif defined(__clang__)
+__attribute__((noinline))
+#elif defined(_MSC_VER)
+__declspec(noinline)
+#endif
+static kai::Mat4x4 mul_scalar(const kai::Mat4x4 &a, const kai::Mat4x4 &b) {
+    kai::Mat4x4 m;
+
+#if defined(_MSC_VER)
+#pragma loop(no_vector)
+#elif defined(__clang__)
+#pragma clang loop vectorize(disable)
+#endif
+    for(Int32 i = 0; i < 4; i++) {
+        for(Int32 j = 0; j < 4; j++) {
+            m.m[i][j] = a.m[0][j] * b.m[i][0] + a.m[1][j] * b.m[i][1] +
+                a.m[2][j] * b.m[i][2] + a.m[3][j] * b.m[i][3];
+        }
+    }
+
+    return m;
+}
+
+static void bench_matrices(void) {
+    const Uint32 matrix_count = SAMPLE_COUNT / 16;
+    const Uint32 count = SAMPLE_COUNT;
+
+    std::vector<kai::Mat4x4> ma(matrix_count);
+    std::vector<kai::Mat4x4> mb(matrix_count);
+    std::vector<kai::Mat4x4> mout(matrix_count);
+
+    Random random;
+    for(Uint32 i = 0; i < matrix_count; i++) {
+        for(Uint32 j = 0; j < 16; j++) {
+            ma[i].m[j / 4][j % 4] = random.next(-2.0f, 2.0f);
+            mb[i].m[j / 4][j % 4] = random.next(-2.0f, 2.0f);
+        }
+    }
+
+    auto matrix_error = [&](ErrorStats &error) {
+        for(Uint32 n = 0; n < matrix_count; n++) {
+            DMat4 a = to_double(ma[n]);
+            DMat4 b = to_double(mb[n]);
+            for(Uint32 i = 0; i < 4; i++) {
+                for(Uint32 j = 0; j < 4; j++) {
+                    Float64 r = a.m[0][j] * b.m[i][0] + a.m[1][j] * b.m[i][1] +
+                        a.m[2][j] * b.m[i][2] + a.m[3][j] * b.m[i][3];
+                    error.add(mout[n].m[i][j], r, 4.0);
+                }
+            }
+        }
+    };
+
+    {
+        Float64 ns = time_ns_per_op([&]() {
+            for(Uint32 i = 0; i < matrix_count; i++) {
+                mout[i] = mul_scalar(ma[i], mb[i]);
+            }
+            g_sink = mout[matrix_count / 2].m00;
+        }, matrix_count);
+        ErrorStats error;
+        matrix_error(error);
+        report("mat4", "mul", "scalar", ns, error);
+    }
+
+    {
+        Float64 ns = time_ns_per_op([&]() {
+            for(Uint32 i = 0; i < matrix_count; i++) {
+                mout[i] = ma[i] * mb[i];
+            }
+            g_sink = mout[matrix_count / 2].m00;
+        }, matrix_count);
+        ErrorStats error;
+        matrix_error(error);
+        report("mat4", "mul", "x4", ns, error);
+    }
+
+    // Transforms and projections of a point cloud through a typical camera
+    kai::Mat4x4 projection = kai::Mat4x4::perspective(kai::deg_to_rad(60.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+    kai::Mat4x4 view = kai::Mat4x4::look_at_rh(kai::Vec4(3.0f, 4.0f, 10.0f), kai::Vec4(0.0f, 0.0f, 0.0f));
+    kai::Mat4x4 model = kai::Mat4x4::rotate_y(0.5f) * kai::Mat4x4::scale(2.0f, 2.0f, 2.0f);
+    kai::Mat4x4 mvp = projection * view * model;
+    DMat4 dmvp = to_double(mvp);
+
+    std::vector<kai::Vec4> points(count);
+    std::vector<kai::Vec4> out(count);
+    for(Uint32 i = 0; i < count; i++) {
+        points[i] = random.next_vec4(-1.0f, 1.0f, 1.0f);
+    }
+
+    auto transform_error = [&](ErrorStats &error) {
+        for(Uint32 i = 0; i < count; i++) {
+            add_error(error, out[i], mul(dmvp, to_double(points[i])), 1.0);
+        }
+    };
+
+    auto project_error = [&](ErrorStats &error) {
+        for(Uint32 i = 0; i < count; i++) {
+            DVec4 c = mul(dmvp, to_double(points[i]));
+            add_error(error, out[i], { c.x / c.w, c.y / c.w, c.z / c.w, 1.0 / c.w }, 1.0);
+        }
+    };
+
+    {
+        Float64 ns = time_ns_per_op([&]() {
+            for(Uint32 i = 0; i < count; i++) {
+                out[i] = mvp * points[i];
+            }
+            g_sink = out[count / 2].x;
+        }, count);
+        ErrorStats error;
+        transform_error(error);
+        report("mat4", "transform", "scalar", ns, error);
+    }
+
+    {
+        Float64 ns = time_ns_per_op([&]() {
+            kai::transform(mvp, points.data(), out.data(), count);
+            g_sink = out[count / 2].x;
+        }, count);
+        ErrorStats error;
+        transform_error(error);
+        report("mat4", "transform", "x4", ns, error);
+    }
+
+    {
+        Float64 ns = time_ns_per_op([&]() {
+            for(Uint32 i = 0; i < count; i++) {
+                kai::Vec4 c = mvp * points[i];
+                Float32 inv_w = 1.0f / c.w;
+                out[i] = kai::Vec4(c.x * inv_w, c.y * inv_w, c.z * inv_w, inv_w);
+            }
+            g_sink = out[count / 2].x;
+        }, count);
+        ErrorStats error;
+        project_error(error);
+        report("mat4", "project", "scalar", ns, error);
+    }
+
+    {
+        Float64 ns = time_ns_per_op([&]() {
+            kai::project(mvp, points.data(), out.data(), count);
+            g_sink = out[count / 2].x;
+        }, count);
+        ErrorStats error;
+        project_error(error);
+        report("mat4", "project", "x4", ns, error);
+    }
+
+    // Construction of the camera matrices
+    {
+        Float64 ns = time_ns_per_op([&]() {
+            for(Uint32 i = 0; i < matrix_count; i++) {
+                mout[i] = kai::Mat4x4::perspective(0.5f + points[i].x * 0.1f, 1.7f, 0.1f, 100.0f);
+            }
+            g_sink = mout[matrix_count / 2].m00;
+        }, matrix_count);
+
+        ErrorStats error;
+        for(Uint32 i = 0; i < matrix_count; i++) {
+            Float64 t = tan((static_cast<Float64>(0.5f + points[i].x * 0.1f)) * 0.5);
+            error.add(mout[i].m00, 1.0 / (1.7 * t));
+            error.add(mout[i].m11, 1.0 / t);
+            error.add(mout[i].m22, (100.0 + 0.1) / (0.1 - 100.0));
+        }
+        report("mat4", "perspective", "scalar", ns, error);
+    }
+
+    {
+        Float64 ns = time_ns_per_op([&]() {
+            for(Uint32 i = 0; i < matrix_count; i++) {
+                mout[i] = kai::Mat4x4::look_at_rh(points[i] * kai::Vec4(10.0f, 10.0f, 10.0f, 0.0f) + kai::Vec4(0.0f, 0.0f, 20.0f),
+                                                  kai::Vec4(0.0f, 0.0f, 0.0f));
+            }
+            g_sink = mout[matrix_count / 2].m00;
+        }, matrix_count);
+
+        ErrorStats error;
+        for(Uint32 i = 0; i < matrix_count; i++) {
+            // The forward axis of the view matrix (third row) is the normalized eye - target direction
+            Float64 ex = static_cast<Float64>(points[i].x * 10.0f);
+            Float64 ey = static_cast<Float64>(points[i].y * 10.0f);
+            Float64 ez = static_cast<Float64>(points[i].z * 10.0f + 20.0f);
+            Float64 mag = sqrt(ex * ex + ey * ey + ez * ez);
+            error.add(mout[i].m[0][2], ex / mag, 1.0);
+            error.add(mout[i].m[1][2], ey / mag, 1.0);
+            error.add(mout[i].m[2][2], ez / mag, 1.0);
+        }
+        report("mat4", "look_at_rh", "scalar", ns, error);
+    }
+}
+
+int main(int argc, char **argv) {
+    bool table = argc > 1 && strcmp(argv[1], "--table") == 0;
+    const char *baseline = (argc > 2 && strcmp(argv[1], "--check") == 0) ? argv[2] : nullptr;
+
+    if(!table) {
+        fprintf(stdout, "# kai math_bench, %u batch lanes, %d samples, %d iterations\n",
+                kai::simd::FloatN::lanes, SAMPLE_COUNT, ITERATIONS);
+    }
+
+    bench_functions(table);
+
+    if(!table) {
+        bench_vectors();
+        bench_matrices();
+    }
+
+    if(baseline && !check_baseline(baseline)) {
+        return 1;
+    }
+
+    return 0;
+}
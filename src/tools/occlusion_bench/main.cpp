@@ -0,0 +1,249 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+// Benchmark for the OcclusionBuffer. The camera stands inside a walled courtyard in the middle of a
+// dense field of objects, so most of them are hidden behind the walls and only show through the gates.
+// Every frame the walls are rasterized as occluders, the bounding box of every object is tested and
+// only the visible ones are recorded into a CommandBuffer. The camera turns around over the frames.
+// The time for all of that is compared to recording every object.
+//
+// Recording a draw only takes a few ns here, a real backend spends far more on every draw it submits and
+// the GPU on drawing it, which is what culling saves. The report shows the break-even point: how much a
+// draw has to cost in total, from recording it to drawing it, for the culling to pay off. --draw-cost adds
+// a busy wait of that many nanoseconds to every recorded draw to stand in for the rest.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/headless.h"
+
+#include "../../core/occlusion.cpp"
+
+#define MESH_COUNT 8
+#define WALL_COUNT 8
+
+// Unit cube from -1 to 1
+static const Float32 cube_vertices[8][3] = {
+    { -1.0f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { -1.0f, 1.0f, -1.0f }, { 1.0f, 1.0f, -1.0f },
+    { -1.0f, -1.0f,  1.0f }, { 1.0f, -1.0f,  1.0f }, { -1.0f, 1.0f,  1.0f }, { 1.0f, 1.0f,  1.0f }
+};
+
+static const Uint32 cube_indices[36] = {
+    0, 2, 1, 1, 2, 3, // -z
+    4, 5, 6, 5, 7, 6, // +z
+    0, 4, 2, 2, 4, 6, // -x
+    1, 3, 5, 3, 7, 5, // +x
+    0, 1, 4, 1, 5, 4, // -y
+    2, 6, 3, 3, 6, 7  // +y
+};
+
+struct Object {
+    kai::Mat4x4 world;
+    Uint32 mesh;
+};
+
+static kai::RenderPipeline pipeline;
+static kai::RenderBuffer vertex_buffers[MESH_COUNT];
+static kai::RenderBuffer index_buffers[MESH_COUNT];
+
+static Uint64 draw_cost_ticks;
+
+static void record(kai::CommandBuffer &buffer, const Object &object) {
+    if(draw_cost_ticks) {
+        Uint64 end = kai::get_timestamp() + draw_cost_ticks;
+        while(kai::get_timestamp() < end) {
+        }
+    }
+
+    buffer.bind_buffer(vertex_buffers[object.mesh], kai::RenderBufferType::vertex);
+    buffer.bind_buffer(index_buffers[object.mesh], kai::RenderBufferType::index);
+    buffer.set_instance_transform(object.world);
+    buffer.draw_indexed(36);
+}
+
+static Float64 to_ms(Uint64 ticks) {
+    return static_cast<Float64>(ticks) * 1000.0 / static_cast<Float64>(kai::get_timestamp_frequency());
+}
+
+int main(int argc, char **argv) {
+    Uint32 grid = 100;
+    Uint32 frame_count = 100;
+    Uint32 width = 320;
+    Uint32 height = 184;
+    Uint64 draw_cost = 0;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--grid") && i + 1 < argc) {
+            grid = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frame_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--size") && i + 2 < argc) {
+            width = static_cast<Uint32>(atoi(argv[++i]));
+            height = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--draw-cost") && i + 1 < argc) {
+            draw_cost = static_cast<Uint64>(atoi(argv[++i]));
+        } else {
+            printf("Usage: %s [--grid N] [--frames N] [--size WIDTH HEIGHT] [--draw-cost NANOSECONDS]\n", argv[0]);
+            return 0;
+        }
+    }
+
+    grid = kai::max(grid, 1u);
+    frame_count = kai::max(frame_count, 1u);
+
+    draw_cost_ticks = draw_cost * kai::get_timestamp_frequency() / 1000000000ull;
+
+    MemoryManager::init(kai::gibibytes(4));
+    engine_memory = kai::StackAllocator(static_cast<Uint32>(kai::mebibytes(1)));
+
+    // N x N small objects, 3 units apart
+    Uint32 object_count = grid * grid;
+    Object *objects = static_cast<Object *>(malloc(object_count * sizeof(Object)));
+
+    for(Uint32 i = 0; i < object_count; i++) {
+        Float32 x = (static_cast<Float32>(i % grid) - static_cast<Float32>(grid - 1) * 0.5f) * 3.0f;
+        Float32 z = (static_cast<Float32>(i / grid) - static_cast<Float32>(grid - 1) * 0.5f) * 3.0f;
+
+        objects[i].world = kai::Mat4x4::translate(x, 0.5f, z) * kai::Mat4x4::scale(0.5f, 0.5f, 0.5f);
+        objects[i].mesh = i % MESH_COUNT;
+    }
+
+    // A 40 x 40 courtyard around the camera with a gate in the middle of every side
+    kai::Mat4x4 walls[WALL_COUNT];
+    for(Uint32 side = 0; side < 4; side++) {
+        for(Uint32 half = 0; half < 2; half++) {
+            Float32 along = half ? 11.5f : -11.5f;
+            kai::Mat4x4 wall = kai::Mat4x4::translate(along, 4.0f, -20.0f) * kai::Mat4x4::scale(8.5f, 4.0f, 0.5f);
+            walls[side * 2 + half] = kai::Mat4x4::rotate_y(static_cast<Float32>(side) * kai::pi * 0.5f) * wall;
+        }
+    }
+
+    kai::OcclusionBuffer occlusion(width, height);
+    kai::CommandBuffer culled_buffer(object_count);
+    kai::CommandBuffer full_buffer(object_count);
+
+    const kai::Vec4 box_min(-1.0f, -1.0f, -1.0f);
+    const kai::Vec4 box_max(1.0f, 1.0f, 1.0f);
+    const kai::Mat4x4 projection = kai::Mat4x4::perspective(kai::deg_to_rad(70.0f), 16.0f / 9.0f, 0.1f, 500.0f);
+
+    Uint64 occluder_ticks = 0;
+    Uint64 test_ticks = 0;
+    Uint64 culled_record_ticks = 0;
+    Uint64 full_record_ticks = 0;
+    Uint64 visible_count = 0;
+    Uint64 frustum_count = 0;
+    Uint64 occluded_count = 0;
+    Uint32 unexpected_occlusions = 0;
+
+    for(Uint32 frame = 0; frame < frame_count; frame++) {
+        Float32 yaw = kai::pi2 * static_cast<Float32>(frame) / static_cast<Float32>(frame_count);
+        kai::Vec4 eye(0.0f, 1.7f, 0.0f, 1.0f);
+        kai::Vec4 target(kai::sine(yaw), 1.5f, -kai::cosine(yaw), 1.0f);
+        kai::Mat4x4 view_projection = projection * kai::Mat4x4::look_at_rh(eye, target);
+
+        Uint64 start = kai::get_timestamp();
+
+        occlusion.begin();
+        for(const kai::Mat4x4 &wall : walls) {
+            occlusion.add_occluder(view_projection * wall, cube_vertices, sizeof(cube_vertices[0]), KAI_ARRAY_COUNT(cube_vertices),
+                                   cube_indices, KAI_ARRAY_COUNT(cube_indices));
+        }
+        occlusion.end();
+
+        Uint64 occluders_done = kai::get_timestamp();
+
+        culled_buffer.begin();
+        culled_buffer.set_render_pipeline(pipeline);
+
+        Uint64 record_ticks = 0;
+        for(Uint32 i = 0; i < object_count; i++) {
+            switch(occlusion.test_box(view_projection * objects[i].world, box_min, box_max)) {
+                case kai::OcclusionResult::visible: {
+                    Uint64 record_start = kai::get_timestamp();
+                    record(culled_buffer, objects[i]);
+                    record_ticks += kai::get_timestamp() - record_start;
+                    visible_count++;
+                    break;
+                }
+                case kai::OcclusionResult::outside_frustum:
+                    frustum_count++;
+                    break;
+                case kai::OcclusionResult::occluded: {
+                    occluded_count++;
+
+                    // Everything inside of the courtyard is in front of the walls
+                    Float32 x = objects[i].world.m30;
+                    Float32 z = objects[i].world.m32;
+                    unexpected_occlusions += (x > -19.0f && x < 19.0f && z > -19.0f && z < 19.0f) ? 1 : 0;
+                    break;
+                }
+            }
+        }
+
+        culled_buffer.end();
+        Uint64 culled_done = kai::get_timestamp();
+
+        occluder_ticks += occluders_done - start;
+        test_ticks += (culled_done - occluders_done) - record_ticks;
+        culled_record_ticks += record_ticks;
+
+        full_buffer.begin();
+        full_buffer.set_render_pipeline(pipeline);
+        for(Uint32 i = 0; i < object_count; i++) {
+            record(full_buffer, objects[i]);
+        }
+        full_buffer.end();
+
+        full_record_ticks += kai::get_timestamp() - culled_done;
+    }
+
+    Float64 frames = static_cast<Float64>(frame_count);
+    Float64 tests = static_cast<Float64>(object_count) * frames;
+    Float64 occluder_ms = to_ms(occluder_ticks) / frames;
+    Float64 test_ms = to_ms(test_ticks) / frames;
+    Float64 culled_record_ms = to_ms(culled_record_ticks) / frames;
+    Float64 full_record_ms = to_ms(full_record_ticks) / frames;
+
+    printf("%u objects, %u occluders, %ux%u occlusion buffer, %u frames, %llu ns per draw\n\n", object_count, WALL_COUNT,
+           occlusion.get_width(), occlusion.get_height(), frame_count, static_cast<unsigned long long>(draw_cost));
+    printf("visible            %6.2f%%\n", 100.0 * static_cast<Float64>(visible_count) / tests);
+    printf("outside frustum    %6.2f%%\n", 100.0 * static_cast<Float64>(frustum_count) / tests);
+    printf("occluded           %6.2f%%\n", 100.0 * static_cast<Float64>(occluded_count) / tests);
+    printf("culled             %6.2f%%\n\n", 100.0 * static_cast<Float64>(frustum_count + occluded_count) / tests);
+
+    printf("Per frame:\n");
+    printf("  occluders        %8.3f ms\n", occluder_ms);
+    printf("  box tests        %8.3f ms (%.1f ns per box)\n", test_ms, test_ms * 1000000.0 / static_cast<Float64>(object_count));
+    printf("  record visible   %8.3f ms\n", culled_record_ms);
+    printf("  total culled     %8.3f ms\n", occluder_ms + test_ms + culled_record_ms);
+    printf("  record all       %8.3f ms\n", full_record_ms);
+    printf("  draws submitted  %8.0f vs %u\n", static_cast<Float64>(visible_count) / frames, object_count);
+
+    // Every culled draw saves everything a draw costs, so the culling pays off once the occluders and the box
+    // tests cost less than the culled draws would have
+    Float64 culled_draws = static_cast<Float64>(object_count) - static_cast<Float64>(visible_count) / frames;
+    if(culled_draws > 0.0) {
+        printf("  break-even       %8.1f ns per draw (recording one takes %.1f ns)\n",
+               (occluder_ms + test_ms) * 1000000.0 / culled_draws, full_record_ms * 1000000.0 / static_cast<Float64>(object_count));
+    }
+
+    int retval = 0;
+    if(unexpected_occlusions > 0) {
+        printf("Error: %u objects inside of the courtyard were reported as occluded!\n", unexpected_occlusions);
+        retval = -1;
+    }
+
+    free(objects);
+    culled_buffer.destroy();
+    full_buffer.destroy();
+    occlusion.destroy();
+
+    destroy_command_chunk_pool();
+    engine_memory.destroy();
+    MemoryManager::destroy();
+
+    return retval;
+}
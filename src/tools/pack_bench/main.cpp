@@ -0,0 +1,260 @@
+// Offline tool used to measure the throughput of the vertex compression kernels in pack.h
+// and to verify their round-trip error. Exits with a non-zero code if any of the error
+// bounds are exceeded
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "../../core/includes/pack.h"
+#include "../../core/includes/utils.h"
+
+#define SAMPLE_COUNT (1 << 20)
+#define ITERATIONS 32
+
+static volatile Uint32 g_sink;
+static bool g_failed = false;
+
+template<typename FUNC>
+static Float64 time_mvalues_per_sec(FUNC func, Uint32 count) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for(Uint32 i = 0; i < ITERATIONS; i++) {
+        func();
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    Float64 seconds = std::chrono::duration<Float64>(end - start).count();
+    return (static_cast<Float64>(count) * ITERATIONS) / (seconds * 1e6);
+}
+
+static void fill_uniform(std::vector<Float32> &values, Float32 lo, Float32 hi) {
+    Uint32 state = 0x12345678u;
+    for(Float32 &v : values) {
+        state = state * 1664525u + 1013904223u;
+        Float32 t = static_cast<Float32>(state >> 8) / static_cast<Float32>(1u << 24);
+        v = lo + (hi - lo) * t;
+    }
+}
+
+static void report(const char *name, Float64 mvalues, Float64 error, Float64 bound) {
+    bool ok = error <= bound;
+    g_failed |= !ok;
+
+    fprintf(stdout, "| %-24s | %10.1f | %12.3e | %10.3e | %-4s |\n", name, mvalues, error, bound, ok ? "ok" : "FAIL");
+}
+
+static void bench_f16(const std::vector<Float32> &values) {
+    const Uint32 count = static_cast<Uint32>(values.size());
+    std::vector<kai::Float16> halfs(count);
+    std::vector<Float32> back(count);
+
+    Float64 to = time_mvalues_per_sec([&]() {
+        kai::convert_to_f16(values.data(), halfs.data(), count);
+        g_sink = halfs[count / 2].bits;
+    }, count);
+
+    Float64 from = time_mvalues_per_sec([&]() {
+        kai::convert_from_f16(halfs.data(), back.data(), count);
+        g_sink = static_cast<Uint32>(back[count / 2]);
+    }, count);
+
+    // The batch kernels need to match the scalar reference bit for bit
+    Float64 mismatches = 0.0;
+    Float64 max_rel_error = 0.0;
+    for(Uint32 i = 0; i < count; i++) {
+        if(halfs[i].bits != kai::Float16::from_float(values[i])) {
+            mismatches += 1.0;
+        }
+
+        if(fabs(values[i]) > 6.2e-5f && fabs(values[i]) <= 65504.0f) { // Normal half range
+            max_rel_error = kai::max(max_rel_error, fabs(static_cast<Float64>(back[i]) - values[i]) / fabs(values[i]));
+        }
+    }
+
+    report("f32 -> f16", to, mismatches, 0.0);
+    report("f16 -> f32 (rel error)", from, max_rel_error, 1.0 / 2048.0);
+
+    // The SSE2 kernel on its own, since the batch version uses F16C when it can. Every half has to come out with
+    // the same bits as the scalar version
+    Float64 sse2 = time_mvalues_per_sec([&]() {
+        for(Uint32 i = 0; (i + 4) <= count; i += 4) {
+            __m128i h = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(halfs.data() + i));
+            _mm_storeu_ps(back.data() + i, kai::half_to_float_sse2(_mm_unpacklo_epi16(h, _mm_setzero_si128())));
+        }
+        g_sink = static_cast<Uint32>(back[count / 2]);
+    }, count);
+
+    Float64 sse2_mismatches = 0.0;
+    for(Uint32 bits = 0; bits <= 0xffff; bits += 4) {
+        alignas(16) Float32 converted[4];
+        _mm_store_ps(converted, kai::half_to_float_sse2(_mm_setr_epi32(bits, bits + 1, bits + 2, bits + 3)));
+
+        for(Uint32 i = 0; i < 4; i++) {
+            Float32 expected = kai::Float16::to_float(static_cast<Uint16>(bits + i));
+            sse2_mismatches += (memcmp(&converted[i], &expected, sizeof(expected)) == 0) ? 0.0 : 1.0;
+        }
+    }
+
+    report("f16 -> f32 sse2 (all)", sse2, sse2_mismatches, 0.0);
+
+    // Special values
+    const Float32 specials[] = { 0.0f, -0.0f, 65504.0f, 1e6f, -1e6f, 5.96e-8f, INFINITY, -INFINITY };
+    Float64 special_errors = 0.0;
+    for(Float32 v : specials) {
+        Float32 r = kai::Float16(v).to_float();
+        Float32 expected = (fabs(v) > 65504.0f) ? copysignf(INFINITY, v) : v;
+        special_errors += (r == expected || fabs(r - expected) <= 1e-9f) ? 0.0 : 1.0;
+    }
+    special_errors += isnan(kai::Float16(NAN).to_float()) ? 0.0 : 1.0;
+    report("f16 special values", 0.0, special_errors, 0.0);
+}
+
+// The values around every tie of the rounding and the ones that have to be clamped, the batch version has to pack
+// them the same way as 'scalar'
+static std::vector<Float32> get_edge_values(Float32 scale, Float32 lo) {
+    std::vector<Float32> values;
+    for(Float32 k = lo * scale; k < scale; k += 1.0f) {
+        Float32 tie = (k + 0.5f) / scale;
+        values.push_back(tie);
+        values.push_back(nextafterf(tie, -INFINITY));
+        values.push_back(nextafterf(tie, INFINITY));
+    }
+
+    const Float32 specials[] = { NAN, -NAN, INFINITY, -INFINITY, 2.0f, -2.0f, 0.0f, -0.0f, 1.0f, -1.0f };
+    values.insert(values.end(), specials, specials + KAI_ARRAY_COUNT(specials));
+    return values;
+}
+
+template<typename T, typename PACK, typename SCALAR, typename UNPACK>
+static void bench_normalized(const char *name, const std::vector<Float32> &values, Float64 bound, Float32 scale,
+                             Float32 lo, PACK pack, SCALAR scalar, UNPACK unpack) {
+    const Uint32 count = static_cast<Uint32>(values.size());
+    std::vector<T> packed(count);
+
+    Float64 mvalues = time_mvalues_per_sec([&]() {
+        pack(values.data(), packed.data(), count);
+        g_sink = static_cast<Uint32>(packed[count / 2]);
+    }, count);
+
+    Float64 max_error = 0.0;
+    for(Uint32 i = 0; i < count; i++) {
+        max_error = kai::max(max_error, fabs(static_cast<Float64>(unpack(packed[i])) - values[i]));
+    }
+
+    report(name, mvalues, max_error, bound);
+
+    std::vector<Float32> edges = get_edge_values(scale, lo);
+    std::vector<T> edges_packed(edges.size());
+    pack(edges.data(), edges_packed.data(), static_cast<Uint32>(edges.size()));
+
+    Float64 mismatches = 0.0;
+    for(size_t i = 0; i < edges.size(); i++) {
+        mismatches += (edges_packed[i] == scalar(edges[i])) ? 0.0 : 1.0;
+    }
+
+    char mismatch_name[64];
+    snprintf(mismatch_name, sizeof(mismatch_name), "%s batch vs scalar", name);
+    report(mismatch_name, 0.0, mismatches, 0.0);
+}
+
+// Angle between two unit vectors in degrees, computed in double precision since acos of a
+// float dot product can't resolve angles below ~0.02 degrees
+static Float64 angle_degrees(const kai::Vec4 &a, const kai::Vec4 &b) {
+    Float64 cx = static_cast<Float64>(a.y) * b.z - static_cast<Float64>(a.z) * b.y;
+    Float64 cy = static_cast<Float64>(a.z) * b.x - static_cast<Float64>(a.x) * b.z;
+    Float64 cz = static_cast<Float64>(a.x) * b.y - static_cast<Float64>(a.y) * b.x;
+    Float64 d = static_cast<Float64>(a.x) * b.x + static_cast<Float64>(a.y) * b.y + static_cast<Float64>(a.z) * b.z;
+
+    return atan2(sqrt(cx * cx + cy * cy + cz * cz), d) * 180.0 / 3.14159265358979;
+}
+
+static void bench_octahedral(void) {
+    const Uint32 count = SAMPLE_COUNT / 4;
+    std::vector<Float32> normals(count * 3);
+
+    Uint32 state = 0xdeadbeefu;
+    auto next = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (static_cast<Float32>(state >> 8) / static_cast<Float32>(1u << 24)) * 2.0f - 1.0f;
+    };
+
+    for(Uint32 i = 0; i < count; i++) {
+        kai::Vec4 n;
+        do {
+            n = kai::Vec4(next(), next(), next());
+        } while(n.dot(n) < 1e-4f || n.dot(n) > 1.0f);
+        n.normalize();
+
+        normals[i * 3 + 0] = n.x;
+        normals[i * 3 + 1] = n.y;
+        normals[i * 3 + 2] = n.z;
+    }
+
+    std::vector<Int16> packed16(count * 2);
+    std::vector<Int8> packed8(count * 2);
+
+    Float64 m16 = time_mvalues_per_sec([&]() {
+        kai::encode_octahedral_snorm16(normals.data(), packed16.data(), count);
+        g_sink = static_cast<Uint32>(packed16[count]);
+    }, count);
+
+    Float64 m8 = time_mvalues_per_sec([&]() {
+        kai::encode_octahedral_snorm8(normals.data(), packed8.data(), count);
+        g_sink = static_cast<Uint32>(packed8[count]);
+    }, count);
+
+    Float64 max_deg16 = 0.0;
+    Float64 max_deg8 = 0.0;
+    for(Uint32 i = 0; i < count; i++) {
+        kai::Vec4 n(normals[i * 3 + 0], normals[i * 3 + 1], normals[i * 3 + 2]);
+
+        kai::Vec4 d16 = kai::decode_octahedral(kai::unpack_snorm16(packed16[i * 2]), kai::unpack_snorm16(packed16[i * 2 + 1]));
+        kai::Vec4 d8 = kai::decode_octahedral(kai::unpack_snorm8(packed8[i * 2]), kai::unpack_snorm8(packed8[i * 2 + 1]));
+
+        max_deg16 = kai::max(max_deg16, angle_degrees(n, d16));
+        max_deg8 = kai::max(max_deg8, angle_degrees(n, d8));
+    }
+
+    report("octahedral snorm16 (deg)", m16, max_deg16, 0.01);
+    report("octahedral snorm8 (deg)", m8, max_deg8, 1.0);
+}
+
+int main(void) {
+    std::vector<Float32> values(SAMPLE_COUNT);
+    std::vector<Float32> unit(SAMPLE_COUNT);
+    std::vector<Float32> signed_unit(SAMPLE_COUNT);
+
+    fill_uniform(values, -70000.0f, 70000.0f);
+    fill_uniform(unit, 0.0f, 1.0f);
+    fill_uniform(signed_unit, -1.0f, 1.0f);
+
+    // Mix in small magnitudes so that denormal halfs are covered as well
+    for(Uint32 i = 0; i < SAMPLE_COUNT; i += 7) {
+        values[i] *= 1e-9f;
+    }
+
+    fprintf(stdout, "| %-24s | %10s | %12s | %10s | %-4s |\n", "kernel", "Mvalues/s", "max error", "bound", "");
+    fprintf(stdout, "|--------------------------|------------|--------------|------------|------|\n");
+
+    bench_f16(values);
+
+    bench_normalized<Uint8>("unorm8", unit, 0.5 / 255.0 + 1e-6, 255.0f, 0.0f,
+                            [](const Float32 *i, Uint8 *o, Uint32 c) { kai::pack_unorm8(i, o, c); },
+                            [](Float32 v) { return kai::pack_unorm8(v); }, kai::unpack_unorm8);
+    bench_normalized<Int8>("snorm8", signed_unit, 0.5 / 127.0 + 1e-6, 127.0f, -1.0f,
+                           [](const Float32 *i, Int8 *o, Uint32 c) { kai::pack_snorm8(i, o, c); },
+                           [](Float32 v) { return kai::pack_snorm8(v); }, kai::unpack_snorm8);
+    bench_normalized<Uint16>("unorm16", unit, 0.5 / 65535.0 + 1e-6, 65535.0f, 0.0f,
+                             [](const Float32 *i, Uint16 *o, Uint32 c) { kai::pack_unorm16(i, o, c); },
+                             [](Float32 v) { return kai::pack_unorm16(v); }, kai::unpack_unorm16);
+    bench_normalized<Int16>("snorm16", signed_unit, 0.5 / 32767.0 + 1e-6, 32767.0f, -1.0f,
+                            [](const Float32 *i, Int16 *o, Uint32 c) { kai::pack_snorm16(i, o, c); },
+                            [](Float32 v) { return kai::pack_snorm16(v); }, kai::unpack_snorm16);
+
+    bench_octahedral();
+
+    return g_failed ? -1 : 0;
+}
@@ -0,0 +1,297 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+// Exercises the shader and pipeline caches without a GPU. Shaders go through the same steps as in the Direct3D11
+// backend, with a stub compiler that takes a fixed amount of time and makes up bytecode from the source:
+//  - A cold start compiles every distinct shader once, no matter how often it's requested, and saves the cache
+//  - A warm start loads the cache file and compiles nothing, the loaded bytecode has to match the compiled one
+//  - A damaged cache file is rejected and everything gets compiled again
+// Then the null backend creates many pipelines out of a few distinct descriptions. Every description is a fresh copy
+// of the strings, so only the content can make them match. Identical ones have to share a pipeline and the
+// pipeline pool of the backend must not run out.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KAI_HEADLESS_NULL_RENDERER
+#include "../common/headless.h"
+
+#define SHADER_COUNT 64 // Distinct vertex and pixel shaders each
+#define MAX_SOURCE_SIZE 256
+#define PIPELINE_VARIANTS 24 // Distinct pipeline descriptions
+
+static Uint32 compile_count;
+static Uint64 compile_ticks;
+
+// Stands in for D3DCompile: waits for 'compile_ticks' and derives 1-4KB of bytecode from the source
+static Uint32 stub_compile(const char *source, const char *entry, kai::ShaderType type, Uint8 *out_bytecode) {
+    Uint64 start = kai::get_timestamp();
+    while(kai::get_timestamp() - start < compile_ticks) {
+    }
+
+    Uint64 state = kai::fnv1a64_str_hash(source) ^ (kai::fnv1a64_str_hash(entry) * 31) ^ static_cast<Uint64>(type);
+    Uint32 size = 1024 + static_cast<Uint32>(state % 3072);
+
+    for(Uint32 i = 0; i < size; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        out_bytecode[i] = static_cast<Uint8>(state);
+    }
+
+    compile_count++;
+    return size;
+}
+
+// What DX11Renderer::compile_shader does, with the stub instead of D3DCompile
+static bool get_bytecode(const char *source, const char *entry, kai::ShaderType type, const void *&out_bytecode, Uint32 &out_size) {
+    const char *target = (type == kai::ShaderType::vertex) ? "vs_5_0" : "ps_5_0";
+    Uint64 key = hash_shader(source, entry, type, target, 0);
+
+    if(find_shader_bytecode(key, out_bytecode, out_size)) {
+        return true;
+    }
+
+    Uint8 bytecode[4096];
+    out_size = stub_compile(source, entry, type, bytecode);
+
+    return store_shader_bytecode(key, bytecode, out_size, out_bytecode);
+}
+
+struct Run {
+    Float64 ms;
+    Uint32 compiles;
+    Uint32 mismatches;
+};
+
+// Requests every shader 'repeats' times and checks the bytecode against what the stub compiles
+static Run request_shaders(const char (*sources)[MAX_SOURCE_SIZE], Uint32 repeats) {
+    Run run = {};
+    Uint32 compiles_before = compile_count;
+    Uint64 start = kai::get_timestamp();
+
+    for(Uint32 repeat = 0; repeat < repeats; repeat++) {
+        for(Uint32 i = 0; i < SHADER_COUNT * 2; i++) {
+            kai::ShaderType type = (i & 1) ? kai::ShaderType::pixel : kai::ShaderType::vertex;
+            const void *bytecode;
+            Uint32 size;
+
+            if(!get_bytecode(sources[i], "main", type, bytecode, size)) {
+                run.mismatches++;
+            }
+        }
+    }
+
+    run.ms = static_cast<Float64>(kai::get_timestamp() - start) * 1000.0 / static_cast<Float64>(kai::get_timestamp_frequency());
+    run.compiles = compile_count - compiles_before;
+
+    // Outside of the timing, compiling again doesn't go through the cache
+    Uint64 saved_ticks = compile_ticks;
+    compile_ticks = 0;
+
+    for(Uint32 i = 0; i < SHADER_COUNT * 2; i++) {
+        kai::ShaderType type = (i & 1) ? kai::ShaderType::pixel : kai::ShaderType::vertex;
+        const void *bytecode;
+        Uint32 size;
+        Uint8 expected[4096];
+
+        Uint32 expected_size = stub_compile(sources[i], "main", type, expected);
+        if(!get_bytecode(sources[i], "main", type, bytecode, size) || size != expected_size || memcmp(bytecode, expected, size)) {
+            run.mismatches++;
+        }
+    }
+
+    compile_ticks = saved_ticks;
+    compile_count -= SHADER_COUNT * 2;
+
+    return run;
+}
+
+int main(int argc, char **argv) {
+    const char *cache_path = "pipeline_cache_bench.bin";
+    Uint32 repeats = 4;
+    Uint32 pipeline_count = 200;
+    Float64 compile_ms = 0.5;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--cache") && i + 1 < argc) {
+            cache_path = argv[++i];
+        } else if(!strcmp(argv[i], "--repeats") && i + 1 < argc) {
+            repeats = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--pipelines") && i + 1 < argc) {
+            pipeline_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--compile-ms") && i + 1 < argc) {
+            compile_ms = atof(argv[++i]);
+        } else {
+            printf("Usage: %s [--cache PATH] [--repeats N] [--pipelines N] [--compile-ms MS]\n", argv[0]);
+            return 0;
+        }
+    }
+
+    repeats = kai::max(repeats, 1u);
+    pipeline_count = kai::max(pipeline_count, 1u);
+
+    MemoryManager::init(kai::gibibytes(4));
+    engine_memory = kai::StackAllocator(static_cast<Uint32>(kai::mebibytes(1)));
+    compile_ticks = static_cast<Uint64>(compile_ms * static_cast<Float64>(kai::get_timestamp_frequency()) / 1000.0);
+
+    // Even entries are vertex shaders, odd ones pixel shaders
+    static char sources[SHADER_COUNT * 2][MAX_SOURCE_SIZE];
+    for(Uint32 i = 0; i < SHADER_COUNT * 2; i++) {
+        snprintf(sources[i], MAX_SOURCE_SIZE, "%s shader %u\nfloat4 main(float4 p : POSITION) : SV_Target { return p * %u; }",
+                 (i & 1) ? "pixel" : "vertex", i / 2, i);
+    }
+
+    int retval = 0;
+    remove(cache_path);
+
+    // ----- Shader bytecode ----- //
+    Run cold = request_shaders(sources, repeats);
+    const ShaderCacheStats cold_stats = get_shader_cache_stats();
+    bool saved = save_shader_cache(cache_path);
+    destroy_shader_cache();
+
+    bool loaded = load_shader_cache(cache_path);
+    Run warm = request_shaders(sources, repeats);
+    const ShaderCacheStats warm_stats = get_shader_cache_stats();
+    destroy_shader_cache();
+
+    // Cut the file in half, it has to be rejected instead of handing out broken bytecode
+    bool rejected = false;
+    {
+        kai::FileHandle file = kai::open_file(cache_path);
+        size_t size = file ? kai::get_file_size(file) : 0;
+        Uint8 *data = static_cast<Uint8 *>(malloc(size + 1));
+        bool read = file && kai::read_file(file, data, size);
+
+        if(file) {
+            kai::close_file(file);
+        }
+
+        kai::FileHandle truncated = kai::open_file(cache_path, static_cast<kai::FileFlags>(kai::FILE_WRITE | kai::FILE_CREATE));
+        if(read && truncated && kai::write_file(truncated, data, size / 2)) {
+            kai::close_file(truncated);
+            rejected = !load_shader_cache(cache_path);
+        } else if(truncated) {
+            kai::close_file(truncated);
+        }
+
+        free(data);
+    }
+
+    Run damaged = request_shaders(sources, 1);
+    destroy_shader_cache();
+    remove(cache_path);
+
+    printf("%u vertex and %u pixel shaders, each requested %u times, %.2f ms per compile\n\n",
+           SHADER_COUNT, SHADER_COUNT, repeats, compile_ms);
+    printf("cold start   %8.2f ms  %4u compiles  %u shaders, %u bytes of bytecode\n",
+           cold.ms, cold.compiles, cold_stats.shader_count, cold_stats.bytecode_size);
+    printf("warm start   %8.2f ms  %4u compiles  %u hits, %u misses\n", warm.ms, warm.compiles, warm_stats.hits, warm_stats.misses);
+    printf("damaged file %8.2f ms  %4u compiles\n\n", damaged.ms, damaged.compiles);
+
+    if(cold.compiles != SHADER_COUNT * 2 || cold.mismatches) {
+        printf("Error: the cold start compiled %u shaders instead of %u, %u didn't match!\n", cold.compiles, SHADER_COUNT * 2, cold.mismatches);
+        retval = -1;
+    }
+
+    if(!saved || !loaded || warm.compiles != 0 || warm.mismatches) {
+        printf("Error: the warm start compiled %u shaders, %u didn't match (saved: %d, loaded: %d)!\n",
+               warm.compiles, warm.mismatches, saved, loaded);
+        retval = -1;
+    }
+
+    if(!rejected || damaged.compiles != SHADER_COUNT * 2 || damaged.mismatches) {
+        printf("Error: the damaged cache file wasn't rejected!\n");
+        retval = -1;
+    }
+
+    // ----- Pipelines ----- //
+    init_renderer(kai::RenderingBackend::null);
+    kai::RenderDevice *device = kai::RenderDevice::get();
+
+    if(!device) {
+        printf("Error: could not create the null render device!\n");
+        return -1;
+    }
+
+    kai::RenderPipeline *pipelines = static_cast<kai::RenderPipeline *>(malloc(pipeline_count * sizeof(kai::RenderPipeline)));
+    char (*strings)[4][MAX_SOURCE_SIZE] = static_cast<char (*)[4][MAX_SOURCE_SIZE]>(malloc(pipeline_count * sizeof(*strings)));
+    Uint32 failed_creates = 0;
+    Uint32 wrong_shares = 0;
+
+    Uint64 start = kai::get_timestamp();
+
+    for(Uint32 i = 0; i < pipeline_count; i++) {
+        Uint32 variant = (i * 7) % PIPELINE_VARIANTS;
+
+        // Copies, so that equal pointers can't be what makes two descriptions match
+        strcpy(strings[i][0], sources[(variant % 8) * 2]);
+        strcpy(strings[i][1], "main");
+        strcpy(strings[i][2], sources[(variant % 8) * 2 + 1]);
+        strcpy(strings[i][3], "main");
+
+        kai::RenderPipelineInfo info = {};
+        info.vertex_shader_source = strings[i][0];
+        info.vertex_shader_entry = strings[i][1];
+        info.pixel_shader_source = strings[i][2];
+        info.pixel_shader_entry = strings[i][3];
+        info.depth_enable = variant / 8 == 1;
+        info.cull_mode = (variant / 8 == 2) ? kai::RenderPipelineInfo::CullMode::none : kai::RenderPipelineInfo::CullMode::back;
+
+        if(!device->create_render_pipeline(info, nullptr, 0, pipelines[i])) {
+            failed_creates++;
+            pipelines[i] = {};
+        }
+    }
+
+    Float64 create_ms = static_cast<Float64>(kai::get_timestamp() - start) * 1000.0 / static_cast<Float64>(kai::get_timestamp_frequency());
+
+    // Equal variants share their pipeline and different ones never do
+    for(Uint32 i = 0; i < pipeline_count && i < 64; i++) {
+        for(Uint32 j = i + 1; j < pipeline_count && j < 64; j++) {
+            bool same_variant = (i * 7) % PIPELINE_VARIANTS == (j * 7) % PIPELINE_VARIANTS;
+            wrong_shares += (same_variant != (pipelines[i].handle == pipelines[j].handle)) ? 1 : 0;
+        }
+    }
+
+    Uint32 distinct = 0;
+    Uint32 references = 0;
+    get_pipeline_cache_counts(distinct, references);
+
+    for(Uint32 i = 0; i < pipeline_count; i++) {
+        if(pipelines[i].handle) {
+            device->destroy_render_pipeline(pipelines[i]);
+        }
+    }
+
+    Uint32 distinct_left = 0;
+    Uint32 references_left = 0;
+    get_pipeline_cache_counts(distinct_left, references_left);
+
+    Uint32 expected_distinct = kai::min(pipeline_count, static_cast<Uint32>(PIPELINE_VARIANTS));
+    printf("%u pipelines requested, %u distinct, %u references, %.3f ms\n", pipeline_count, distinct, references, create_ms);
+
+    if(failed_creates > 0 || distinct != expected_distinct || references != pipeline_count || wrong_shares > 0) {
+        printf("Error: %u pipelines failed, %u distinct instead of %u, %u were shared wrongly!\n",
+               failed_creates, distinct, expected_distinct, wrong_shares);
+        retval = -1;
+    }
+
+    if(distinct_left != 0 || references_left != 0) {
+        printf("Error: %u pipelines with %u references are left after destroying all of them!\n", distinct_left, references_left);
+        retval = -1;
+    }
+
+    free(strings);
+    free(pipelines);
+
+    destroy_renderer();
+    engine_memory.destroy();
+    MemoryManager::destroy();
+
+    return retval;
+}
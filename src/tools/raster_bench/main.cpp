@@ -0,0 +1,355 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+// Benchmark of the software rasterizer backend. A reference scene (a grid of spheres on a ground
+// plane, stored as MeshHeader assets and uploaded the same way the asset manager does it) is
+// rendered for a number of frames with a growing number of rasterizer threads. The frames of every
+// thread count have to be identical, the last one can be written to a TGA file with --out.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+
+#include "../common/headless.h"
+
+#include "../../asset/mesh.h"
+
+#include "../../platform/soft/soft_renderer.cpp"
+
+#define GRID_X 16
+#define GRID_Z 12
+#define SPHERE_RINGS 24
+#define SPHERE_SEGMENTS 48
+
+struct Vertex {
+    Float32 position[3];
+    Float32 normal[3];
+};
+
+struct ObjectConstants {
+    kai::Mat4x4 transform;
+    Float32 color[4];
+};
+
+// A mesh asset as it's laid out in memory: the header, immediately followed by the vertices and indices
+struct MeshAsset {
+    kai::MeshHeader *header;
+    kai::StackAllocator memory;
+};
+
+static MeshAsset create_mesh_asset(const Vertex *vertices, Uint32 vertex_count, const Uint32 *indices, Uint32 index_count) {
+    Uint32 vertex_size = vertex_count * static_cast<Uint32>(sizeof(Vertex));
+    Uint32 index_size = index_count * static_cast<Uint32>(sizeof(Uint32));
+
+    MeshAsset asset;
+    asset.memory = kai::StackAllocator(static_cast<Uint32>(sizeof(kai::MeshHeader)) + vertex_size + index_size);
+    asset.header = static_cast<kai::MeshHeader *>(asset.memory.get_data());
+
+    kai::MeshHeader *header = asset.header;
+    memset(header, 0, sizeof(*header));
+    header->asset_type = kai::AssetType::mesh;
+    header->buffer_start = sizeof(kai::MeshHeader);
+    header->buffer_size = vertex_size + index_size;
+    header->vertices.count = vertex_count;
+    header->vertices.start = 0;
+    header->vertices.size = vertex_size;
+    header->vertices.stride = sizeof(Vertex);
+    header->indices.count = index_count;
+    header->indices.start = vertex_size;
+    header->indices.size = index_size;
+
+    Uint8 *data = reinterpret_cast<Uint8 *>(header) + header->buffer_start;
+    memcpy(data + header->vertices.start, vertices, vertex_size);
+    memcpy(data + header->indices.start, indices, index_size);
+
+    return asset;
+}
+
+static MeshAsset create_sphere(void) {
+    static Vertex vertices[(SPHERE_RINGS + 1) * (SPHERE_SEGMENTS + 1)];
+    static Uint32 indices[SPHERE_RINGS * SPHERE_SEGMENTS * 6];
+
+    Uint32 vertex_count = 0;
+    for(Uint32 ring = 0; ring <= SPHERE_RINGS; ring++) {
+        Float32 theta = kai::pi * static_cast<Float32>(ring) / SPHERE_RINGS;
+
+        for(Uint32 segment = 0; segment <= SPHERE_SEGMENTS; segment++) {
+            Float32 phi = kai::pi2 * static_cast<Float32>(segment) / SPHERE_SEGMENTS;
+            Vertex &v = vertices[vertex_count++];
+
+            v.normal[0] = kai::sine(theta) * kai::cosine(phi);
+            v.normal[1] = kai::cosine(theta);
+            v.normal[2] = kai::sine(theta) * kai::sine(phi);
+            memcpy(v.position, v.normal, sizeof(v.position));
+        }
+    }
+
+    Uint32 index_count = 0;
+    for(Uint32 ring = 0; ring < SPHERE_RINGS; ring++) {
+        for(Uint32 segment = 0; segment < SPHERE_SEGMENTS; segment++) {
+            Uint32 a = ring * (SPHERE_SEGMENTS + 1) + segment;
+            Uint32 b = a + SPHERE_SEGMENTS + 1;
+
+            // Counter-clockwise seen from the outside
+            indices[index_count++] = a;
+            indices[index_count++] = a + 1;
+            indices[index_count++] = b;
+            indices[index_count++] = a + 1;
+            indices[index_count++] = b + 1;
+            indices[index_count++] = b;
+        }
+    }
+
+    return create_mesh_asset(vertices, vertex_count, indices, index_count);
+}
+
+static MeshAsset create_ground(void) {
+    const Vertex vertices[] = {
+        { { -1.0f, 0.0f, -1.0f }, { 0.0f, 1.0f, 0.0f } },
+        { {  1.0f, 0.0f, -1.0f }, { 0.0f, 1.0f, 0.0f } },
+        { {  1.0f, 0.0f,  1.0f }, { 0.0f, 1.0f, 0.0f } },
+        { { -1.0f, 0.0f,  1.0f }, { 0.0f, 1.0f, 0.0f } }
+    };
+
+    const Uint32 indices[] = { 0, 2, 1, 0, 3, 2 };
+
+    return create_mesh_asset(vertices, KAI_ARRAY_COUNT(vertices), indices, KAI_ARRAY_COUNT(indices));
+}
+
+struct Mesh {
+    kai::RenderBuffer vertex_buffer;
+    kai::RenderBuffer index_buffer;
+    Uint32 index_count;
+};
+
+// Same as the asset manager's prepare_asset_data()
+static Mesh upload_mesh(kai::RenderDevice *device, const kai::MeshHeader *header) {
+    const Uint8 *data_start = reinterpret_cast<const Uint8 *>(header) + header->buffer_start;
+
+    Mesh mesh;
+    mesh.index_count = header->indices.count;
+
+    kai::RenderBufferInfo buffer_info;
+    buffer_info.data = data_start + header->vertices.start;
+    buffer_info.byte_size = header->vertices.size;
+    buffer_info.stride = header->vertices.stride;
+    buffer_info.type = kai::RenderBufferType::vertex;
+    device->create_buffer(buffer_info, mesh.vertex_buffer);
+
+    buffer_info = kai::RenderBufferInfo();
+    buffer_info.data = data_start + header->indices.start;
+    buffer_info.byte_size = header->indices.size;
+    buffer_info.type = kai::RenderBufferType::index;
+    device->create_buffer(buffer_info, mesh.index_buffer);
+
+    return mesh;
+}
+
+static void draw_object(kai::RenderDevice *device, kai::CommandBuffer &buffer, Mesh &mesh,
+                        const kai::Mat4x4 &transform, Float32 r, Float32 g, Float32 b) {
+    kai::ConstantSlice slice;
+    if(!device->allocate_constants(sizeof(ObjectConstants), slice)) {
+        return;
+    }
+
+    ObjectConstants *constants = static_cast<ObjectConstants *>(slice.data);
+    constants->transform = transform;
+    constants->color[0] = r;
+    constants->color[1] = g;
+    constants->color[2] = b;
+    constants->color[3] = 1.0f;
+
+    buffer.bind_buffer(mesh.vertex_buffer, kai::RenderBufferType::vertex);
+    buffer.bind_buffer(mesh.index_buffer, kai::RenderBufferType::index);
+    buffer.bind_constants(slice);
+    buffer.draw_indexed(mesh.index_count);
+}
+
+struct Result {
+    Float64 fps;
+    Float64 execute_ms;
+    Float64 raster_ms;
+    Uint64 frame_hash;
+    SoftFrameStats stats;
+};
+
+static Result run(const MeshAsset &sphere_asset, const MeshAsset &ground_asset, Uint32 width, Uint32 height,
+                  Uint32 thread_count, Uint32 frame_count, const char *out_path) {
+    kai::StackAllocator device_memory(static_cast<Uint32>(kai::kibibytes(64)));
+    SoftRenderer *device = static_cast<SoftRenderer *>(soft_renderer_init_device(device_memory, width, height, thread_count));
+
+    Result result = {};
+    if(!device) {
+        device_memory.destroy();
+        return result;
+    }
+
+    const kai::RenderInputLayoutInfo input_layouts[] = {
+        { "POSITION", 0, kai::RenderFormat::rgb_f32, 0 },
+        { "NORMAL", 0, kai::RenderFormat::rgb_f32, 12 }
+    };
+
+    kai::RenderPipelineInfo pipeline_info = {};
+    pipeline_info.vertex_shader_source = "vs";
+    pipeline_info.vertex_shader_entry = "main";
+    pipeline_info.pixel_shader_source = "ps";
+    pipeline_info.pixel_shader_entry = "main";
+    pipeline_info.color_clear_values[0] = 0.4f;
+    pipeline_info.color_clear_values[1] = 0.6f;
+    pipeline_info.color_clear_values[2] = 0.9f;
+    pipeline_info.depth_enable = true;
+    pipeline_info.depth_clear_value = 1.0f;
+    pipeline_info.front_ccw = true;
+
+    kai::RenderPipeline pipeline;
+    device->create_render_pipeline(pipeline_info, input_layouts, KAI_ARRAY_COUNT(input_layouts), pipeline);
+
+    Mesh sphere = upload_mesh(device, sphere_asset.header);
+    Mesh ground = upload_mesh(device, ground_asset.header);
+
+    kai::CommandBuffer buffer(GRID_X * GRID_Z + 8);
+
+    Float32 aspect_ratio = static_cast<Float32>(width) / static_cast<Float32>(height);
+    kai::Mat4x4 view_projection = kai::Mat4x4::perspective(kai::deg_to_rad(60.0f), aspect_ratio, 0.5f, 200.0f) *
+                                  kai::Mat4x4::look_at_rh(kai::Vec4(0.0f, 9.0f, 18.0f, 1.0f), kai::Vec4(0.0f, 0.0f, -6.0f, 1.0f));
+
+    Float64 execute_ms = 0.0;
+    Float64 raster_ms = 0.0;
+    Uint64 start = kai::get_timestamp();
+
+    for(Uint32 frame = 0; frame < frame_count; frame++) {
+        buffer.begin();
+        buffer.set_render_pipeline(pipeline);
+        buffer.clear_color();
+        buffer.clear_depth();
+
+        draw_object(device, buffer, ground, view_projection * kai::Mat4x4::scale(40.0f, 1.0f, 40.0f), 0.5f, 0.5f, 0.45f);
+
+        Float32 spin = static_cast<Float32>(frame) * 0.05f;
+        for(Uint32 z = 0; z < GRID_Z; z++) {
+            for(Uint32 x = 0; x < GRID_X; x++) {
+                Float32 px = (static_cast<Float32>(x) - (GRID_X - 1) * 0.5f) * 2.5f;
+                Float32 pz = -static_cast<Float32>(z) * 2.5f;
+                kai::Mat4x4 world = kai::Mat4x4::translate(px, 1.0f, pz) * kai::Mat4x4::rotate_y(spin);
+
+                draw_object(device, buffer, sphere, view_projection * world,
+                            static_cast<Float32>(x) / GRID_X, 0.3f, static_cast<Float32>(z) / GRID_Z);
+            }
+        }
+
+        buffer.end();
+
+        device->execute(buffer);
+        device->present();
+
+        execute_ms += device->get_frame_stats().execute_ms;
+        raster_ms += device->get_frame_stats().raster_ms;
+    }
+
+    Float64 seconds = static_cast<Float64>(kai::get_timestamp() - start) / static_cast<Float64>(kai::get_timestamp_frequency());
+    result.fps = static_cast<Float64>(frame_count) / seconds;
+    result.execute_ms = execute_ms / frame_count;
+    result.raster_ms = raster_ms / frame_count;
+    result.stats = device->get_frame_stats();
+
+    const Uint32 *pixels = device->get_frame();
+    result.frame_hash = 14695981039346656037ull;
+    for(Uint32 y = 0; y < height; y++) {
+        for(Uint32 x = 0; x < width; x++) {
+            result.frame_hash = (result.frame_hash ^ pixels[y * device->get_frame_pitch() + x]) * 1099511628211ull;
+        }
+    }
+
+    if(out_path) {
+        device->save_frame(out_path);
+    }
+
+    buffer.destroy();
+    device->destroy_buffer(sphere.vertex_buffer);
+    device->destroy_buffer(sphere.index_buffer);
+    device->destroy_buffer(ground.vertex_buffer);
+    device->destroy_buffer(ground.index_buffer);
+    device->destroy_render_pipeline(pipeline);
+    device->destroy();
+    device_memory.destroy();
+
+    return result;
+}
+
+int main(int argc, char **argv) {
+    Uint32 width = 1920;
+    Uint32 height = 1080;
+    Uint32 frame_count = 30;
+    Uint32 max_threads = std::thread::hardware_concurrency();
+    const char *out_path = nullptr;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frame_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            max_threads = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--size") && i + 2 < argc) {
+            width = static_cast<Uint32>(atoi(argv[++i]));
+            height = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--out") && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            printf("Usage: %s [--frames N] [--threads MAX] [--size WIDTH HEIGHT] [--out FILE.tga]\n", argv[0]);
+            return 0;
+        }
+    }
+
+    frame_count = kai::max(frame_count, 1u);
+    kai::clamp(max_threads, 1u, static_cast<Uint32>(SOFT_MAX_THREADS));
+
+    MemoryManager::init(kai::gibibytes(4));
+    engine_memory = kai::StackAllocator(static_cast<Uint32>(kai::mebibytes(1)));
+    init_soft_renderer();
+
+    MeshAsset sphere = create_sphere();
+    MeshAsset ground = create_ground();
+
+    printf("%ux%u, %u spheres of %u triangles, %u frames\n\n", width, height, GRID_X * GRID_Z,
+           SPHERE_RINGS * SPHERE_SEGMENTS * 2, frame_count);
+    printf("%7s %9s %11s %10s %8s %10s %9s\n", "threads", "fps", "execute ms", "raster ms", "speedup", "triangles", "culled");
+
+    int retval = 0;
+    Float64 baseline_fps = 0.0;
+    Uint64 frame_hash = 0;
+
+    for(Uint32 thread_count = 1; thread_count <= max_threads; thread_count *= 2) {
+        bool last = thread_count * 2 > max_threads && thread_count != max_threads;
+        Result result = run(sphere, ground, width, height, thread_count, frame_count,
+                            (thread_count == max_threads) ? out_path : nullptr);
+
+        baseline_fps = (thread_count == 1) ? result.fps : baseline_fps;
+        frame_hash = (thread_count == 1) ? result.frame_hash : frame_hash;
+
+        printf("%7u %9.1f %11.3f %10.3f %7.2fx %10u %9u\n", thread_count, result.fps, result.execute_ms,
+               result.raster_ms, result.fps / baseline_fps, result.stats.triangles, result.stats.triangles_culled);
+
+        if(result.frame_hash != frame_hash) {
+            printf("Error: the frame differs from the one rendered with a single thread!\n");
+            retval = -1;
+        }
+
+        // Always finish with all of the threads, even if it's not a power of two
+        if(last) {
+            thread_count = max_threads / 2;
+        }
+    }
+
+    sphere.memory.destroy();
+    ground.memory.destroy();
+
+    destroy_soft_renderer();
+    destroy_command_chunk_pool();
+    engine_memory.destroy();
+    MemoryManager::destroy();
+
+    return retval;
+}
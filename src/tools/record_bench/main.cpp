@@ -0,0 +1,348 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+// Headless benchmark for recording CommandBuffers on multiple threads. Every frame records
+// the same number of draws, split evenly across the recording threads, and then submits the
+// buffers (in shuffled order) in a single RenderDevice::execute call that has to restore
+// their submission order. No GPU or window is needed, only the engine's core sources.
+// It also reports the size of the encoded commands per draw and how fast they decode.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+
+#include "../common/headless.h"
+
+#define MAX_THREADS 64
+#define PIPELINE_COUNT 16
+#define BUFFER_COUNT 256
+
+// Only checks that the buffers arrive in submission order
+struct OrderCheckDevice : public HeadlessDevice {
+    using HeadlessDevice::execute;
+
+    void execute(const kai::CommandBuffer &command_buffer) const override {
+        if(command_buffer.get_submission_order() < last_order) {
+            order_errors++;
+        }
+
+        last_order = command_buffer.get_submission_order();
+    }
+
+    mutable Uint32 last_order = 0;
+    mutable Uint32 order_errors = 0;
+};
+
+static kai::RenderPipeline pipelines[PIPELINE_COUNT];
+static kai::RenderBuffer vertex_buffers[BUFFER_COUNT];
+static kai::RenderBuffer index_buffers[BUFFER_COUNT];
+static kai::RenderBuffer constant_buffer;
+
+static KAI_FORCEINLINE Uint32 xorshift(Uint32 &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void record(kai::CommandBuffer &buffer, Uint32 draw_count, Uint32 seed) {
+    Uint32 rng = seed | 1;
+
+    buffer.begin();
+    for(Uint32 i = 0; i < draw_count; i++) {
+        Uint32 r = xorshift(rng);
+        Uint32 mesh = (r >> 8) % BUFFER_COUNT;
+
+        buffer.set_render_pipeline(pipelines[r % PIPELINE_COUNT]);
+        buffer.bind_buffer(vertex_buffers[mesh], kai::RenderBufferType::vertex);
+        buffer.bind_buffer(index_buffers[mesh], kai::RenderBufferType::index);
+        buffer.bind_buffer(constant_buffer, kai::RenderBufferType::constant);
+        buffer.set_sort_depth(static_cast<Float32>(r >> 16) / 65535.0f);
+        buffer.draw_indexed(36);
+    }
+    buffer.end();
+}
+
+struct Workers {
+    std::thread threads[MAX_THREADS];
+    kai::CommandBuffer *buffers;
+    Uint32 thread_count;
+    Uint32 draws_per_thread;
+
+    std::atomic<Uint32> frame;
+    std::atomic<Uint32> done;
+    std::atomic<Bool32> quit;
+};
+
+static void worker_main(Workers *workers, Uint32 index) {
+    Uint32 seen = 0;
+    for(;;) {
+        Uint32 frame;
+        while((frame = workers->frame.load(std::memory_order_acquire)) == seen) {
+            if(workers->quit.load(std::memory_order_relaxed)) {
+                return;
+            }
+
+            std::this_thread::yield();
+        }
+
+        seen = frame;
+        record(workers->buffers[index], workers->draws_per_thread, (index + 1) * 0x9e3779b9u + frame);
+        workers->done.fetch_add(1, std::memory_order_acq_rel);
+    }
+}
+
+struct Result {
+    Float64 frame_ms;
+    Float64 bytes_per_draw;
+    Float64 decode_mcmds; // Million commands per second
+    Float64 decode_gbs;
+    Uint32 order_errors;
+};
+
+// Decodes all of the buffers without executing anything, the best of a few runs
+static void measure_decode(const kai::CommandBuffer *buffers, Uint32 count, Result &result) {
+    Uint64 best = ~0ull;
+    Uint32 command_count = 0;
+    Uint64 bytes = 0;
+
+    for(Uint32 run = 0; run < 5; run++) {
+        Uint64 start = kai::get_timestamp();
+
+        command_count = 0;
+        bytes = 0;
+        for(Uint32 i = 0; i < count; i++) {
+            CommandDecoder decoder(buffers[i], false);
+            CommandEncodingData command;
+            while(decoder.next(command)) {
+                command_count++;
+            }
+
+            bytes += buffers[i].get_size();
+        }
+
+        Uint64 elapsed = kai::get_timestamp() - start;
+        best = (elapsed < best) ? elapsed : best;
+    }
+
+    Float64 seconds = static_cast<Float64>(best) / static_cast<Float64>(kai::get_timestamp_frequency());
+    result.decode_mcmds = static_cast<Float64>(command_count) / seconds / 1e6;
+    result.decode_gbs = static_cast<Float64>(bytes) / seconds / 1e9;
+}
+
+// Records draws that continue each other and checks which of them the decoder merges for a topology. Merging
+// must never change the primitives that the draws make up
+static Uint32 check_draw_merging(void) {
+    typedef kai::RenderPipelineInfo::TopologyType Topology;
+
+    struct MergeCase {
+        Topology topology;
+        Uint32 vertices; // Per primitive
+        Uint32 counts[4];
+        Uint32 expected_draws;
+    };
+
+    const MergeCase cases[] = {
+        { Topology::triangle_list, 3, { 3, 6, 3, 0 }, 1 },
+        { Topology::triangle_list, 3, { 4, 2, 0, 0 }, 2 },
+        { Topology::triangle_list, 3, { 3, 4, 2, 3 }, 4 },
+        { Topology::line_list, 2, { 3, 3, 0, 0 }, 2 },
+        { Topology::line_list, 2, { 2, 4, 2, 0 }, 1 },
+        { Topology::point_list, 1, { 1, 2, 5, 0 }, 1 },
+        { Topology::triangle_strip, 1, { 3, 3, 0, 0 }, 2 }
+    };
+
+    Uint32 failures = 0;
+    kai::CommandBuffer buffer(16);
+
+    for(const MergeCase &c : cases) {
+        Uint32 recorded_primitives = 0;
+        Uint32 start = 0;
+
+        buffer.begin();
+        for(Uint32 count : c.counts) {
+            if(count) {
+                buffer.draw(count, start);
+                recorded_primitives += count / c.vertices;
+                start += count;
+            }
+        }
+        buffer.end();
+
+        CommandDecoder decoder(buffer, false);
+        decoder.set_merge_draws(c.topology);
+
+        Uint32 draws = 0;
+        Uint32 primitives = 0;
+        CommandEncodingData command;
+        while(decoder.next(command)) {
+            if(command.draw.encoding == CommandEncoding::draw) {
+                draws++;
+                primitives += command.draw.count / c.vertices;
+            }
+        }
+
+        if(draws != c.expected_draws || primitives != recorded_primitives) {
+            printf("Error: draws of %u, %u, %u and %u vertices decoded to %u draws (expected %u) and %u primitives (expected %u)!\n",
+                   c.counts[0], c.counts[1], c.counts[2], c.counts[3], draws, c.expected_draws, primitives, recorded_primitives);
+            failures++;
+        }
+    }
+
+    buffer.destroy();
+    return failures;
+}
+
+static Result run(Uint32 thread_count, Uint32 total_draws, Uint32 frame_count, kai::CommandBufferMode mode) {
+    Uint32 draws_per_thread = total_draws / thread_count;
+
+    kai::CommandBuffer buffers[MAX_THREADS];
+    for(Uint32 i = 0; i < thread_count; i++) {
+        buffers[i] = kai::CommandBuffer(draws_per_thread, mode);
+        buffers[i].set_submission_order(i);
+    }
+
+    Workers *workers = new Workers();
+    workers->buffers = buffers;
+    workers->thread_count = thread_count;
+    workers->draws_per_thread = draws_per_thread;
+    workers->frame = 0;
+    workers->done = 0;
+    workers->quit = false;
+
+    // The main thread records the first buffer itself
+    for(Uint32 i = 1; i < thread_count; i++) {
+        workers->threads[i] = std::thread(worker_main, workers, i);
+    }
+
+    // Submit the buffers back to front, the device has to restore the order
+    const kai::CommandBuffer *submit[MAX_THREADS];
+    for(Uint32 i = 0; i < thread_count; i++) {
+        submit[i] = &buffers[thread_count - i - 1];
+    }
+
+    OrderCheckDevice device;
+    Uint64 best = ~0ull;
+
+    for(Uint32 frame = 1; frame <= frame_count; frame++) {
+        Uint64 start = kai::get_timestamp();
+
+        workers->done.store(0, std::memory_order_relaxed);
+        workers->frame.store(frame, std::memory_order_release);
+
+        record(buffers[0], draws_per_thread, 0x9e3779b9u + frame);
+
+        while(workers->done.load(std::memory_order_acquire) != thread_count - 1) {
+            std::this_thread::yield();
+        }
+
+        device.last_order = 0;
+        device.execute(submit, thread_count);
+
+        Uint64 elapsed = kai::get_timestamp() - start;
+        best = (elapsed < best) ? elapsed : best;
+    }
+
+    workers->quit = true;
+    for(Uint32 i = 1; i < thread_count; i++) {
+        workers->threads[i].join();
+    }
+
+    delete workers;
+
+    Result result;
+    Uint64 bytes = 0;
+    for(Uint32 i = 0; i < thread_count; i++) {
+        bytes += buffers[i].get_size();
+    }
+
+    result.bytes_per_draw = static_cast<Float64>(bytes) / static_cast<Float64>(draws_per_thread * thread_count);
+    measure_decode(buffers, thread_count, result);
+
+    for(Uint32 i = 0; i < thread_count; i++) {
+        buffers[i].destroy();
+    }
+
+    result.frame_ms = static_cast<Float64>(best) * 1000.0 / static_cast<Float64>(kai::get_timestamp_frequency());
+    result.order_errors = device.order_errors;
+    return result;
+}
+
+int main(int argc, char **argv) {
+    Uint32 total_draws = 200000;
+    Uint32 frame_count = 20;
+    Uint32 max_threads = std::thread::hardware_concurrency();
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--draws") && i + 1 < argc) {
+            total_draws = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frame_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            max_threads = static_cast<Uint32>(atoi(argv[++i]));
+        } else {
+            printf("Usage: %s [--draws N] [--frames N] [--threads N]\n", argv[0]);
+            return 0;
+        }
+    }
+
+    max_threads = (max_threads == 0) ? 1 : ((max_threads > MAX_THREADS) ? MAX_THREADS : max_threads);
+
+    MemoryManager::init(kai::gibibytes(4));
+    engine_memory = kai::StackAllocator(static_cast<Uint32>(kai::mebibytes(1)));
+
+    // Handles like the ones a backend hands out for freshly created resources, nothing resolves them here
+    for(Uint32 i = 0; i < PIPELINE_COUNT; i++) {
+        pipelines[i].handle = (1u << RENDER_HANDLE_INDEX_BITS) | i;
+    }
+
+    for(Uint32 i = 0; i < BUFFER_COUNT; i++) {
+        vertex_buffers[i].handle = (1u << RENDER_HANDLE_INDEX_BITS) | i;
+        index_buffers[i].handle = (1u << RENDER_HANDLE_INDEX_BITS) | (BUFFER_COUNT + i);
+    }
+
+    constant_buffer.handle = (1u << RENDER_HANDLE_INDEX_BITS) | (2 * BUFFER_COUNT);
+
+    printf("%u draws per frame, best of %u frames, %u hardware threads\n\n",
+           total_draws, frame_count, std::thread::hardware_concurrency());
+    printf("%-10s %8s %10s %12s %8s %11s %14s %11s\n",
+           "mode", "threads", "ms/frame", "Mdraws/s", "speedup", "bytes/draw", "decode Mcmd/s", "decode GB/s");
+
+    int retval = check_draw_merging() ? -1 : 0;
+    const kai::CommandBufferMode modes[] = { kai::CommandBufferMode::immediate, kai::CommandBufferMode::sorted };
+    for(kai::CommandBufferMode mode : modes) {
+        Float64 single_thread_ms = 0.0;
+
+        for(Uint32 threads = 1; threads <= max_threads; threads *= 2) {
+            Result result = run(threads, total_draws, frame_count, mode);
+            single_thread_ms = (threads == 1) ? result.frame_ms : single_thread_ms;
+
+            printf("%-10s %8u %10.3f %12.2f %7.2fx %11.2f %14.1f %11.2f\n",
+                   (mode == kai::CommandBufferMode::sorted) ? "sorted" : "immediate",
+                   threads, result.frame_ms,
+                   static_cast<Float64>(total_draws) / (result.frame_ms * 1000.0),
+                   single_thread_ms / result.frame_ms,
+                   result.bytes_per_draw, result.decode_mcmds, result.decode_gbs);
+
+            if(result.order_errors) {
+                printf("Error: %u CommandBuffers were executed out of submission order!\n", result.order_errors);
+                retval = -1;
+            }
+
+            if(threads < max_threads && threads * 2 > max_threads) {
+                threads = max_threads / 2;
+            }
+        }
+    }
+
+    destroy_command_chunk_pool();
+    engine_memory.destroy();
+    MemoryManager::destroy();
+
+    return retval;
+}
@@ -0,0 +1,593 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+// Executes a frame capture (see capture_internal.h) again on one of the backends that run on Linux,
+// so a slow frame from a game can be profiled offline and kept around as a regression benchmark.
+// The pipelines, buffers and textures of the capture are created on the device, then every iteration records
+// the captured commands into CommandBuffers, executes them and presents the frame like the game did.
+//
+// --per-command executes every command in a CommandBuffer of its own instead and reports how much
+// CPU time the backend spends on each of them. The cost of an execute() call without any commands
+// is measured up front and subtracted, the draws can't be merged across commands in this mode.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/headless.h"
+
+#include "../../core/capture_internal.h"
+
+#include "../../platform/null/null_renderer.cpp"
+#include "../../platform/soft/soft_renderer.cpp"
+
+#define MAX_ITERATIONS 100000
+
+static const char *command_names[] = {
+    "draw",
+    "draw_indexed",
+    "set_render_pipeline",
+    "bind_buffer",
+    "clear_color",
+    "clear_depth",
+    "clear_stencil",
+    "clear_depth_stencil",
+    "draw_instanced",
+    "draw_indexed_instanced",
+    "bind_constants",
+    "bind_texture"
+};
+
+static_assert(KAI_ARRAY_COUNT(command_names) == static_cast<Uint32>(CommandEncoding::end),
+              "Every CommandEncoding needs a name");
+
+// The resources of the capture, created on the device that replays it
+struct Replay {
+    const Capture *capture;
+    kai::RenderDevice *device;
+    kai::RenderPipeline *pipelines;
+    kai::RenderBuffer *buffers;
+    kai::RenderTexture *textures;
+    Uint32 command_count;
+};
+
+// Checks everything that the commands reference, so the replay itself doesn't have to
+static bool validate_capture(const Capture &capture, Uint32 &out_command_count) {
+    out_command_count = 0;
+
+    for(Uint32 i = 0; i < capture.list_count; i++) {
+        const Capture::List &list = capture.lists[i];
+        const Uint8 *stream = list.commands;
+        const Uint8 *end = list.commands + list.command_size;
+
+        for(Uint32 j = 0; j < list.command_count; j++) {
+            if(stream >= end || *stream >= static_cast<Uint8>(CommandEncoding::end)) {
+                printf("Error: command %u of list %u is invalid!\n", j, i);
+                return false;
+            }
+
+            CaptureCommand command;
+            read_capture_command(stream, command);
+            const CommandEncodingData &c = command.data;
+            bool valid = stream <= end;
+
+            switch(c.draw.encoding) {
+                case CommandEncoding::set_render_pipeline:
+                    valid = valid && command.resource < capture.pipeline_count;
+                    break;
+                case CommandEncoding::bind_buffer:
+                    valid = valid && command.resource < capture.buffer_count &&
+                            c.bind_buffer.type <= kai::RenderBufferType::constant &&
+                            c.bind_buffer.shader_type <= kai::ShaderType::pixel;
+                    break;
+                case CommandEncoding::bind_constants:
+                    valid = valid && c.bind_constants.size > 0 &&
+                            static_cast<Uint64>(c.bind_constants.offset) + c.bind_constants.size <= list.constant_size &&
+                            c.bind_constants.shader_type <= kai::ShaderType::pixel;
+                    break;
+                case CommandEncoding::bind_texture:
+                    valid = valid && command.resource < capture.texture_count && c.bind_texture.slot < KAI_TEXTURE_SLOT_COUNT;
+                    break;
+                case CommandEncoding::draw_instanced:
+                case CommandEncoding::draw_indexed_instanced: {
+                    const auto d = &c.draw_indexed_instanced;
+                    valid = valid && static_cast<Uint64>(d->instance_offset) +
+                            static_cast<Uint64>(d->instance_count) * d->instance_stride <= list.instance_size;
+                    break;
+                }
+                default:
+                    break;
+            }
+
+            if(!valid) {
+                printf("Error: command %u of list %u references data that isn't part of the capture!\n", j, i);
+                return false;
+            }
+        }
+
+        out_command_count += list.command_count;
+    }
+
+    return true;
+}
+
+static bool create_resources(Replay &replay) {
+    const Capture &capture = *replay.capture;
+
+    replay.pipelines = static_cast<kai::RenderPipeline *>(calloc(kai::max(capture.pipeline_count, 1u), sizeof(kai::RenderPipeline)));
+    replay.buffers = static_cast<kai::RenderBuffer *>(calloc(kai::max(capture.buffer_count, 1u), sizeof(kai::RenderBuffer)));
+    replay.textures = static_cast<kai::RenderTexture *>(calloc(kai::max(capture.texture_count, 1u), sizeof(kai::RenderTexture)));
+
+    for(Uint32 i = 0; i < capture.pipeline_count; i++) {
+        const Capture::Pipeline &p = capture.pipelines[i];
+        if(!replay.device->create_render_pipeline(p.info, p.input_layouts, p.input_layout_count, replay.pipelines[i])) {
+            printf("Error: could not create pipeline %u of the capture!\n", i);
+            return false;
+        }
+    }
+
+    for(Uint32 i = 0; i < capture.buffer_count; i++) {
+        if(!replay.device->create_buffer(capture.buffers[i], replay.buffers[i])) {
+            printf("Error: could not create buffer %u of the capture!\n", i);
+            return false;
+        }
+    }
+
+    for(Uint32 i = 0; i < capture.texture_count; i++) {
+        if(!replay.device->create_texture(capture.textures[i], replay.textures[i])) {
+            printf("Error: could not create texture %u of the capture!\n", i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void destroy_resources(Replay &replay) {
+    const Capture &capture = *replay.capture;
+
+    for(Uint32 i = 0; i < capture.texture_count; i++) {
+        if(replay.textures[i].handle) {
+            replay.device->destroy_texture(replay.textures[i]);
+        }
+    }
+
+    for(Uint32 i = 0; i < capture.buffer_count; i++) {
+        if(replay.buffers[i].handle) {
+            replay.device->destroy_buffer(replay.buffers[i]);
+        }
+    }
+
+    for(Uint32 i = 0; i < capture.pipeline_count; i++) {
+        if(replay.pipelines[i].handle) {
+            replay.device->destroy_render_pipeline(replay.pipelines[i]);
+        }
+    }
+
+    free(replay.pipelines);
+    free(replay.buffers);
+    free(replay.textures);
+}
+
+// Records the command at 'stream' into 'buffer'. Returns false if the constants didn't fit into the ring buffer
+static bool record_command(Replay &replay, const Capture::List &list, const Uint8 *&stream, kai::CommandBuffer &buffer) {
+    CaptureCommand command;
+    read_capture_command(stream, command);
+    const CommandEncodingData &c = command.data;
+
+    switch(c.draw.encoding) {
+        case CommandEncoding::draw:
+            buffer.draw(c.draw.count, c.draw.start);
+            break;
+        case CommandEncoding::draw_indexed:
+            buffer.draw_indexed(c.draw_indexed.count, c.draw_indexed.start, c.draw_indexed.base);
+            break;
+        case CommandEncoding::draw_instanced:
+        case CommandEncoding::draw_indexed_instanced: {
+            const auto d = &c.draw_indexed_instanced;
+            const void *instance_data = d->instance_stride ? list.instance_data + d->instance_offset : nullptr;
+
+            if(d->encoding == CommandEncoding::draw_indexed_instanced) {
+                buffer.draw_indexed_instanced(d->count, d->instance_count, instance_data, d->instance_stride, d->start, d->base);
+            } else {
+                buffer.draw_instanced(d->count, d->instance_count, instance_data, d->instance_stride, d->start);
+            }
+
+            break;
+        }
+        case CommandEncoding::set_render_pipeline:
+            buffer.set_render_pipeline(replay.pipelines[command.resource]);
+            break;
+        case CommandEncoding::bind_buffer:
+            buffer.bind_buffer(replay.buffers[command.resource], c.bind_buffer.type, c.bind_buffer.shader_type);
+            break;
+        case CommandEncoding::bind_constants: {
+            kai::ConstantSlice slice;
+            if(!replay.device->allocate_constants(c.bind_constants.size, slice)) {
+                return false;
+            }
+
+            memcpy(slice.data, list.constants + c.bind_constants.offset, c.bind_constants.size);
+            buffer.bind_constants(slice, c.bind_constants.shader_type);
+            break;
+        }
+        case CommandEncoding::bind_texture:
+            buffer.bind_texture(replay.textures[command.resource], c.bind_texture.slot);
+            break;
+        case CommandEncoding::clear_color:
+            buffer.clear_color();
+            break;
+        case CommandEncoding::clear_depth:
+            buffer.clear_depth();
+            break;
+        case CommandEncoding::clear_stencil:
+            buffer.clear_stencil();
+            break;
+        case CommandEncoding::clear_depth_stencil:
+            buffer.clear_depth_stencil();
+            break;
+        default:
+            break;
+    }
+
+    return true;
+}
+
+static void apply_device_call(Replay &replay, const Capture::List &list) {
+    if(list.type == CaptureListType::set_viewport) {
+        replay.device->set_viewport(list.viewport[0], list.viewport[1],
+                                    static_cast<Uint32>(list.viewport[2]), static_cast<Uint32>(list.viewport[3]));
+    } else if(list.type == CaptureListType::set_render_pipeline) {
+        replay.device->set_render_pipeline(replay.pipelines[list.pipeline]);
+    }
+}
+
+static void set_initial_viewport(Replay &replay) {
+    const Int32 *viewport = replay.capture->viewport;
+    replay.device->set_viewport(viewport[0], viewport[1], static_cast<Uint32>(viewport[2]), static_cast<Uint32>(viewport[3]));
+}
+
+static Float64 to_ms(Uint64 ticks) {
+    return static_cast<Float64>(ticks) * 1000.0 / static_cast<Float64>(kai::get_timestamp_frequency());
+}
+
+static int compare_float64(const void *a, const void *b) {
+    Float64 x = *static_cast<const Float64 *>(a);
+    Float64 y = *static_cast<const Float64 *>(b);
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+// Replays the whole frame 'iterations' times and reports the time of every list
+static bool replay_frames(Replay &replay, Uint32 iterations) {
+    const Capture &capture = *replay.capture;
+
+    kai::CommandBuffer *buffers = static_cast<kai::CommandBuffer *>(calloc(kai::max(capture.list_count, 1u), sizeof(kai::CommandBuffer)));
+    Uint64 *record_ticks = static_cast<Uint64 *>(calloc(kai::max(capture.list_count, 1u), sizeof(Uint64)));
+    Uint64 *execute_ticks = static_cast<Uint64 *>(calloc(kai::max(capture.list_count, 1u), sizeof(Uint64)));
+    Float64 *frame_times = static_cast<Float64 *>(malloc(iterations * sizeof(Float64)));
+
+    for(Uint32 i = 0; i < capture.list_count; i++) {
+        if(capture.lists[i].type == CaptureListType::command_buffer) {
+            new(&buffers[i]) kai::CommandBuffer(capture.lists[i].command_count);
+        }
+    }
+
+    bool result = true;
+    Uint64 present_ticks = 0;
+
+    for(Uint32 iteration = 0; iteration < iterations && result; iteration++) {
+        Uint64 frame_start = kai::get_timestamp();
+        set_initial_viewport(replay);
+
+        for(Uint32 i = 0; i < capture.list_count && result; i++) {
+            const Capture::List &list = capture.lists[i];
+            if(list.type != CaptureListType::command_buffer) {
+                apply_device_call(replay, list);
+                continue;
+            }
+
+            Uint64 start = kai::get_timestamp();
+
+            kai::CommandBuffer &buffer = buffers[i];
+            buffer.begin();
+
+            const Uint8 *stream = list.commands;
+            for(Uint32 j = 0; j < list.command_count && result; j++) {
+                result = record_command(replay, list, stream, buffer);
+            }
+
+            buffer.end();
+            Uint64 recorded = kai::get_timestamp();
+
+            replay.device->execute(buffer);
+            Uint64 executed = kai::get_timestamp();
+
+            record_ticks[i] += recorded - start;
+            execute_ticks[i] += executed - recorded;
+        }
+
+        Uint64 present_start = kai::get_timestamp();
+        replay.device->present();
+        Uint64 frame_end = kai::get_timestamp();
+
+        present_ticks += frame_end - present_start;
+        frame_times[iteration] = to_ms(frame_end - frame_start);
+    }
+
+    if(!result) {
+        printf("Error: the constants of the capture don't fit into the constant ring buffer!\n");
+    } else {
+        Float64 n = static_cast<Float64>(iterations);
+        Float64 mean = 0.0;
+        for(Uint32 i = 0; i < iterations; i++) {
+            mean += frame_times[i];
+        }
+
+        mean /= n;
+        qsort(frame_times, iterations, sizeof(Float64), compare_float64);
+
+        printf("frame ms     mean %.3f  p50 %.3f  p99 %.3f  min %.3f  max %.3f\n",
+               mean, frame_times[iterations / 2], frame_times[(iterations * 99) / 100],
+               frame_times[0], frame_times[iterations - 1]);
+        printf("present ms   %.3f\n\n", to_ms(present_ticks) / n);
+
+        printf("list  type                  commands   record ms  execute ms\n");
+        for(Uint32 i = 0; i < capture.list_count; i++) {
+            const Capture::List &list = capture.lists[i];
+
+            if(list.type == CaptureListType::command_buffer) {
+                printf("%4u  command buffer      %10u  %10.3f  %10.3f\n", i, list.command_count,
+                       to_ms(record_ticks[i]) / n, to_ms(execute_ticks[i]) / n);
+            } else {
+                printf("%4u  %-20s\n", i, (list.type == CaptureListType::set_viewport) ? "set_viewport" : "set_render_pipeline");
+            }
+        }
+    }
+
+    for(Uint32 i = 0; i < capture.list_count; i++) {
+        if(capture.lists[i].type == CaptureListType::command_buffer) {
+            buffers[i].destroy();
+        }
+    }
+
+    free(frame_times);
+    free(execute_ticks);
+    free(record_ticks);
+    free(buffers);
+
+    return result;
+}
+
+struct CommandTiming {
+    Uint64 ticks;
+    Uint32 list;
+    Uint32 index;
+    CommandEncoding encoding;
+};
+
+static int compare_command_timing(const void *a, const void *b) {
+    Uint64 x = static_cast<const CommandTiming *>(a)->ticks;
+    Uint64 y = static_cast<const CommandTiming *>(b)->ticks;
+    return (x > y) ? -1 : ((x < y) ? 1 : 0);
+}
+
+// Executes every command on its own and reports the time per command. The state that the commands
+// set stays bound on the device in between the execute() calls, just like in between CommandBuffers
+static bool replay_commands(Replay &replay, Uint32 iterations, Uint32 top_count) {
+    const Capture &capture = *replay.capture;
+
+    CommandTiming *timings = static_cast<CommandTiming *>(calloc(kai::max(replay.command_count, 1u), sizeof(CommandTiming)));
+    kai::CommandBuffer buffer(16);
+
+    // What an execute() costs without any commands
+    Uint64 empty_ticks = ~0ull;
+    for(Uint32 i = 0; i < 1000; i++) {
+        buffer.begin();
+        buffer.end();
+
+        Uint64 start = kai::get_timestamp();
+        replay.device->execute(buffer);
+        empty_ticks = kai::min(empty_ticks, kai::get_timestamp() - start);
+    }
+
+    bool result = true;
+
+    for(Uint32 iteration = 0; iteration < iterations && result; iteration++) {
+        set_initial_viewport(replay);
+        Uint32 command = 0;
+
+        for(Uint32 i = 0; i < capture.list_count && result; i++) {
+            const Capture::List &list = capture.lists[i];
+            if(list.type != CaptureListType::command_buffer) {
+                apply_device_call(replay, list);
+                continue;
+            }
+
+            const Uint8 *stream = list.commands;
+            for(Uint32 j = 0; j < list.command_count && result; j++, command++) {
+                CommandTiming &timing = timings[command];
+                timing.list = i;
+                timing.index = j;
+                timing.encoding = static_cast<CommandEncoding>(*stream);
+
+                buffer.begin();
+                result = record_command(replay, list, stream, buffer);
+                buffer.end();
+
+                Uint64 start = kai::get_timestamp();
+                replay.device->execute(buffer);
+                Uint64 ticks = kai::get_timestamp() - start;
+
+                timing.ticks += (ticks > empty_ticks) ? ticks - empty_ticks : 0;
+            }
+        }
+
+        replay.device->present();
+    }
+
+    if(!result) {
+        printf("Error: the constants of the capture don't fit into the constant ring buffer!\n");
+    } else {
+        Float64 n = static_cast<Float64>(iterations);
+
+        Uint64 kind_ticks[KAI_ARRAY_COUNT(command_names)] = {};
+        Uint32 kind_counts[KAI_ARRAY_COUNT(command_names)] = {};
+        Uint64 total_ticks = 0;
+
+        for(Uint32 i = 0; i < replay.command_count; i++) {
+            Uint32 kind = static_cast<Uint32>(timings[i].encoding);
+            kind_ticks[kind] += timings[i].ticks;
+            kind_counts[kind]++;
+            total_ticks += timings[i].ticks;
+        }
+
+        printf("\nPer command, execute() only (%.3f us per call subtracted):\n\n", to_ms(empty_ticks) * 1000.0);
+        printf("command                      count    total ms     mean us\n");
+
+        for(Uint32 i = 0; i < KAI_ARRAY_COUNT(command_names); i++) {
+            if(kind_counts[i]) {
+                printf("%-24s %9u  %10.3f  %10.3f\n", command_names[i], kind_counts[i], to_ms(kind_ticks[i]) / n,
+                       to_ms(kind_ticks[i]) * 1000.0 / (n * static_cast<Float64>(kind_counts[i])));
+            }
+        }
+
+        printf("%-24s %9u  %10.3f\n", "all", replay.command_count, to_ms(total_ticks) / n);
+
+        qsort(timings, replay.command_count, sizeof(CommandTiming), compare_command_timing);
+        top_count = kai::min(top_count, replay.command_count);
+
+        printf("\nSlowest commands:\n\n");
+        printf("list     index  command                      mean us\n");
+        for(Uint32 i = 0; i < top_count; i++) {
+            const CommandTiming &timing = timings[i];
+            printf("%4u  %8u  %-24s  %10.3f\n", timing.list, timing.index,
+                   command_names[static_cast<Uint32>(timing.encoding)], to_ms(timing.ticks) * 1000.0 / n);
+        }
+    }
+
+    buffer.destroy();
+    free(timings);
+
+    return result;
+}
+
+int main(int argc, char **argv) {
+    const char *path = nullptr;
+    const char *backend_name = "null";
+    Uint32 iterations = 100;
+    Uint32 thread_count = 0;
+    Uint32 top_count = 10;
+    Bool32 per_command = false;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--backend") && i + 1 < argc) {
+            backend_name = argv[++i];
+        } else if(!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+            iterations = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--size") && i + 2 < argc) {
+            window.width = static_cast<Uint32>(atoi(argv[++i]));
+            window.height = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            thread_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--per-command")) {
+            per_command = true;
+        } else if(!strcmp(argv[i], "--top") && i + 1 < argc) {
+            top_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+
+    kai::RenderingBackend backend = kai::RenderingBackend::unknown;
+    if(!strcmp(backend_name, "null")) {
+        backend = kai::RenderingBackend::null;
+    } else if(!strcmp(backend_name, "software")) {
+        backend = kai::RenderingBackend::software;
+    }
+
+    if(!path || backend == kai::RenderingBackend::unknown || window.width == 0 || window.height == 0) {
+        printf("Usage: %s CAPTURE [--backend null|software] [--iterations N] [--per-command] [--top N]\n"
+               "       [--size WIDTH HEIGHT] [--threads N]\n", argv[0]);
+        return 0;
+    }
+
+    kai::clamp(iterations, 1u, static_cast<Uint32>(MAX_ITERATIONS));
+
+    MemoryManager::init(kai::gibibytes(4));
+    engine_memory = kai::StackAllocator(static_cast<Uint32>(kai::mebibytes(1)));
+
+    Capture capture;
+    Replay replay = {};
+    replay.capture = &capture;
+
+    if(!load_capture(path, capture) || !validate_capture(capture, replay.command_count)) {
+        engine_memory.destroy();
+        MemoryManager::destroy();
+        return -1;
+    }
+
+    kai::StackAllocator device_memory(static_cast<Uint32>(kai::kibibytes(64)));
+    if(backend == kai::RenderingBackend::null) {
+        init_null_renderer();
+        replay.device = null_renderer_init_device(device_memory);
+    } else {
+        init_soft_renderer();
+        replay.device = soft_renderer_init_device(device_memory, window.width, window.height, thread_count);
+    }
+
+    int retval = 0;
+
+    if(!replay.device) {
+        printf("Error: could not create the %s render device!\n", backend_name);
+        retval = -1;
+    } else {
+        printf("%s: %u pipelines, %u buffers, %u textures, %u lists, %u commands, %u bytes\n", path, capture.pipeline_count,
+               capture.buffer_count, capture.texture_count, capture.list_count, replay.command_count, capture.file_size);
+        printf("Replaying on the %s device (%s) for %u iterations\n\n", backend_name, replay.device->name, iterations);
+
+        bool replayed = create_resources(replay);
+
+        // The first present() only starts the clock of the backends
+        replay.device->present();
+
+        replayed = replayed && replay_frames(replay, iterations);
+        replayed = replayed && (!per_command || replay_commands(replay, iterations, top_count));
+
+        if(backend == kai::RenderingBackend::null) {
+            Uint32 errors = static_cast<NullRenderer *>(replay.device)->get_frame_stats().errors;
+            if(errors > 0) {
+                printf("Error: the null device found %u invalid commands in the last frame!\n", errors);
+                replayed = false;
+            }
+        } else {
+            Uint32 skipped = static_cast<SoftRenderer *>(replay.device)->get_frame_stats().clears_skipped;
+            if(skipped > 0) {
+                printf("%u clears of the last frame were skipped, they had no pipeline with the clear values\n", skipped);
+            }
+        }
+
+        retval = replayed ? 0 : -1;
+
+        destroy_resources(replay);
+        replay.device->destroy();
+    }
+
+    if(backend == kai::RenderingBackend::null) {
+        destroy_null_renderer();
+    } else {
+        destroy_soft_renderer();
+    }
+
+    device_memory.destroy();
+    destroy_capture(capture);
+    destroy_command_chunk_pool();
+    engine_memory.destroy();
+    MemoryManager::destroy();
+
+    return retval;
+}
@@ -0,0 +1,370 @@
+// Offline tool that compiles the shaders of a pipeline ahead of time into a shader asset (see src/asset/shader.h), so that
+// the engine only has to create them from their bytecode instead of compiling them on every start.
+//
+// The input is a text file that describes one shader asset:
+//
+//   # Comment
+//   source shaders/mesh.hlsl        The HLSL file with both shaders
+//   vertex vs_main                  Entry point of the vertex shader
+//   pixel ps_main                   Entry point of the pixel shader
+//   input POSITION 0 rgb_f32 0      Input layout: semantic name, index, RenderFormat, offset (or "append") and
+//   input TEXCOORD 0 rg_f32 12      an optional "instance" for per-instance data
+//
+// Every backend gets a variant. The D3D11 one is compiled with the same settings as the runtime and its input signature
+// is checked against the input layout, which needs the Windows build. The null and software backends don't run shaders,
+// their variants only carry the entry point and source, so that every shader still has its own id
+
+#include <stdio.h>
+#include <string>
+#include <string.h>
+#include <vector>
+
+#ifdef KAI_PLATFORM_WIN32
+#include <d3d11shader.h>
+#include <d3dcompiler.h>
+#endif
+
+#include "../../asset/shader.h"
+#include "../../core/includes/render.h"
+
+struct InputLayout {
+    std::string name;
+    Uint32 index;
+    Uint32 format;
+    Uint32 offset;
+    Uint32 per_instance;
+};
+
+struct Variant {
+    kai::RenderingBackend backend;
+    std::vector<unsigned char> vertex;
+    std::vector<unsigned char> pixel;
+};
+
+static const char *format_names[] = {
+    "unknown", "r_u8", "rg_u8", "rgba_u8", "r_f32", "rg_f32", "rgb_f32", "rgba_f32",
+    "r_f16", "rg_f16", "rgba_f16", "r_unorm8", "rg_unorm8", "rgba_unorm8", "r_snorm8", "rg_snorm8", "rgba_snorm8",
+    "r_unorm16", "rg_unorm16", "rgba_unorm16", "r_snorm16", "rg_snorm16", "rgba_snorm16"
+};
+
+// Only the vertex formats, the block-compressed ones after them are for textures
+static_assert(KAI_ARRAY_COUNT(format_names) == static_cast<size_t>(kai::RenderFormat::rgba_snorm16) + 1,
+              "Every vertex RenderFormat needs a name");
+
+static void print_usage(void) {
+    fprintf(stdout, "Shader bake usage:\n"
+            "\tshader_bake <name of text file> <name of shader asset>\n");
+}
+
+static bool read_text_file(const char *path, std::string &out_text) {
+    FILE *f = fopen(path, "rb");
+    if(!f) {
+        fprintf(stderr, "[ERROR] - File \"%s\" was not found or it couldn't be opened\n", path);
+        return false;
+    }
+
+    char buffer[4096];
+    size_t read;
+    while((read = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        out_text.append(buffer, read);
+    }
+
+    fclose(f);
+    return true;
+}
+
+static bool parse_input_layout(char *args, InputLayout &out_layout) {
+    char name[128];
+    char format[32];
+    char offset[32];
+    char instance[32] = {};
+    unsigned int index;
+
+    int count = sscanf(args, "%127s %u %31s %31s %31s", name, &index, format, offset, instance);
+    if(count < 4 || (count == 5 && strcmp(instance, "instance") != 0)) {
+        return false;
+    }
+
+    out_layout.name = name;
+    out_layout.index = index;
+    out_layout.per_instance = (count == 5) ? 1 : 0;
+    out_layout.format = 0;
+
+    for(Uint32 i = 1; i < KAI_ARRAY_COUNT(format_names); i++) {
+        if(!strcmp(format, format_names[i])) {
+            out_layout.format = i;
+            break;
+        }
+    }
+
+    if(!strcmp(offset, "append")) {
+        out_layout.offset = KAI_INPUT_LAYOUT_APPEND;
+    } else {
+        char *end;
+        out_layout.offset = static_cast<Uint32>(strtoul(offset, &end, 10));
+
+        if(*end != '\0') {
+            return false;
+        }
+    }
+
+    return out_layout.format != 0;
+}
+
+// The entry point followed by the source, both null-terminated
+static std::vector<unsigned char> make_source_bytecode(const std::string &source, const std::string &entry) {
+    std::vector<unsigned char> bytecode(entry.begin(), entry.end());
+    bytecode.push_back('\0');
+    bytecode.insert(bytecode.end(), source.begin(), source.end());
+    bytecode.push_back('\0');
+
+    return bytecode;
+}
+
+#ifdef KAI_PLATFORM_WIN32
+// The same flags as get_dx11_bytecode() in win32_dx11.cpp, defining KAI_DEBUG bakes debug shaders like a debug build compiles
+static bool compile_dx11(const std::string &source, const std::string &entry, const char *target,
+                         std::vector<unsigned char> &out_bytecode) {
+    UINT compile_flags = D3DCOMPILE_PACK_MATRIX_COLUMN_MAJOR;
+#ifdef KAI_DEBUG
+    compile_flags |= D3DCOMPILE_DEBUG;
+#endif
+
+    ID3DBlob *buffer = nullptr;
+    ID3DBlob *error = nullptr;
+
+    D3DCompile(source.data(), source.size(), nullptr, nullptr, nullptr, entry.c_str(), target,
+               compile_flags, 0, &buffer, &error);
+
+    if(error) {
+        fprintf(stderr, "[ERROR] - %s\n", static_cast<const char *>(error->GetBufferPointer()));
+        error->Release();
+    }
+
+    if(!buffer) {
+        return false;
+    }
+
+    const unsigned char *code = static_cast<const unsigned char *>(buffer->GetBufferPointer());
+    out_bytecode.assign(code, code + buffer->GetBufferSize());
+    buffer->Release();
+
+    return true;
+}
+
+// Every input of the vertex shader (except the system values) has to be in the input layout
+static bool check_dx11_inputs(const std::vector<unsigned char> &bytecode, const std::vector<InputLayout> &layouts) {
+    ID3D11ShaderReflection *reflection = nullptr;
+    if(D3DReflect(bytecode.data(), bytecode.size(), IID_ID3D11ShaderReflection, reinterpret_cast<void **>(&reflection)) != S_OK) {
+        fprintf(stderr, "[ERROR] - Couldn't reflect the vertex shader\n");
+        return false;
+    }
+
+    D3D11_SHADER_DESC shader_desc;
+    reflection->GetDesc(&shader_desc);
+
+    bool valid = true;
+    for(UINT i = 0; i < shader_desc.InputParameters; i++) {
+        D3D11_SIGNATURE_PARAMETER_DESC param;
+        reflection->GetInputParameterDesc(i, &param);
+
+        if(param.SystemValueType != D3D_NAME_UNDEFINED) {
+            continue;
+        }
+
+        bool found = false;
+        for(const InputLayout &layout : layouts) {
+            found |= !_stricmp(layout.name.c_str(), param.SemanticName) && layout.index == param.SemanticIndex;
+        }
+
+        if(!found) {
+            fprintf(stderr, "[ERROR] - The vertex shader reads %s%u, but it's not in the input layout\n",
+                    param.SemanticName, param.SemanticIndex);
+            valid = false;
+        }
+    }
+
+    reflection->Release();
+    return valid;
+}
+#endif
+
+static Uint32 pad_to_4(std::vector<unsigned char> &data) {
+    while(data.size() % 4) {
+        data.push_back(0);
+    }
+
+    return static_cast<Uint32>(data.size());
+}
+
+static Uint32 append(std::vector<unsigned char> &data, const void *bytes, size_t size) {
+    Uint32 start = pad_to_4(data);
+    const unsigned char *b = static_cast<const unsigned char *>(bytes);
+    data.insert(data.end(), b, b + size);
+
+    return start;
+}
+
+int main(int argc, char **argv) {
+    if(argc != 3) {
+        print_usage();
+        return -1;
+    }
+
+    std::string description;
+    if(!read_text_file(argv[1], description)) {
+        return -1;
+    }
+
+    std::string source_path;
+    std::string vertex_entry;
+    std::string pixel_entry;
+    std::vector<InputLayout> layouts;
+
+    size_t line_start = 0;
+    Uint32 line_number = 0;
+    while(line_start < description.size()) {
+        size_t line_end = description.find('\n', line_start);
+        line_end = (line_end == std::string::npos) ? description.size() : line_end;
+
+        std::string line = description.substr(line_start, line_end - line_start);
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        line_start = line_end + 1;
+        line_number++;
+
+        char key[16];
+        int key_length = 0;
+        if(line.empty() || line[0] == '#' || sscanf(line.c_str(), "%15s%n", key, &key_length) != 1) {
+            continue;
+        }
+
+        size_t value_start = line.find_first_not_of(" \t", key_length);
+        std::string value = (value_start == std::string::npos) ? std::string() : line.substr(value_start);
+
+        bool valid = !value.empty();
+        if(valid && !strcmp(key, "source")) {
+            source_path = value;
+        } else if(valid && !strcmp(key, "vertex")) {
+            vertex_entry = value;
+        } else if(valid && !strcmp(key, "pixel")) {
+            pixel_entry = value;
+        } else if(valid && !strcmp(key, "input")) {
+            InputLayout layout;
+            valid = parse_input_layout(&value[0], layout);
+            layouts.push_back(layout);
+        } else {
+            valid = false;
+        }
+
+        if(!valid) {
+            fprintf(stderr, "[ERROR] - %s(%u): Couldn't parse \"%s\"\n", argv[1], line_number, line.c_str());
+            return -1;
+        }
+    }
+
+    if(source_path.empty() || vertex_entry.empty() || pixel_entry.empty()) {
+        fprintf(stderr, "[ERROR] - \"%s\" needs a source, a vertex and a pixel entry point\n", argv[1]);
+        return -1;
+    }
+
+    if(layouts.size() > KAI_SHADER_MAX_INPUT_LAYOUTS) {
+        fprintf(stderr, "[ERROR] - A shader can have at most %u inputs\n", KAI_SHADER_MAX_INPUT_LAYOUTS);
+        return -1;
+    }
+
+    // The source path is relative to the text file
+    std::string text_path = argv[1];
+    size_t separator = text_path.find_last_of("/\\");
+    if(separator != std::string::npos && source_path[0] != '/' && source_path.find(':') == std::string::npos) {
+        source_path = text_path.substr(0, separator + 1) + source_path;
+    }
+
+    std::string source;
+    if(!read_text_file(source_path.c_str(), source)) {
+        return -1;
+    }
+
+    std::vector<Variant> variants;
+
+#ifdef KAI_PLATFORM_WIN32
+    {
+        Variant variant;
+        variant.backend = kai::RenderingBackend::dx11;
+
+        if(!compile_dx11(source, vertex_entry, "vs_5_0", variant.vertex) ||
+           !compile_dx11(source, pixel_entry, "ps_5_0", variant.pixel) ||
+           !check_dx11_inputs(variant.vertex, layouts)) {
+            return -1;
+        }
+
+        variants.push_back(variant);
+    }
+#else
+    fprintf(stdout, "[WARNING] - D3D11 shaders can only be baked on Windows, \"%s\" won't have them\n", argv[2]);
+#endif
+
+    for(kai::RenderingBackend backend : { kai::RenderingBackend::null, kai::RenderingBackend::software }) {
+        Variant variant;
+        variant.backend = backend;
+        variant.vertex = make_source_bytecode(source, vertex_entry);
+        variant.pixel = make_source_bytecode(source, pixel_entry);
+        variants.push_back(variant);
+    }
+
+    // Header, variants and input layouts first, followed by the names and the bytecode
+    kai::ShaderHeader header = {};
+    header.asset_type = kai::AssetType::shader;
+    header.version = KAI_SHADER_VERSION;
+    header.variants.count = static_cast<Uint32>(variants.size());
+    header.variants.start = sizeof(kai::ShaderHeader);
+    header.input_layouts.count = static_cast<Uint32>(layouts.size());
+    header.input_layouts.start = header.variants.start + header.variants.count * sizeof(kai::ShaderVariant);
+
+    std::vector<unsigned char> data(header.input_layouts.start + header.input_layouts.count * sizeof(kai::ShaderInputLayout));
+
+    std::vector<kai::ShaderInputLayout> file_layouts;
+    for(const InputLayout &layout : layouts) {
+        kai::ShaderInputLayout file_layout;
+        file_layout.name_start = append(data, layout.name.c_str(), layout.name.size() + 1);
+        file_layout.index = layout.index;
+        file_layout.format = layout.format;
+        file_layout.offset = layout.offset;
+        file_layout.per_instance = layout.per_instance;
+        file_layouts.push_back(file_layout);
+    }
+
+    std::vector<kai::ShaderVariant> file_variants;
+    for(const Variant &variant : variants) {
+        kai::ShaderVariant file_variant;
+        file_variant.backend = static_cast<Uint32>(variant.backend);
+        file_variant.vertex.start = append(data, variant.vertex.data(), variant.vertex.size());
+        file_variant.vertex.size = static_cast<Uint32>(variant.vertex.size());
+        file_variant.pixel.start = append(data, variant.pixel.data(), variant.pixel.size());
+        file_variant.pixel.size = static_cast<Uint32>(variant.pixel.size());
+        file_variants.push_back(file_variant);
+    }
+
+    header.size = pad_to_4(data);
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + header.variants.start, file_variants.data(), file_variants.size() * sizeof(kai::ShaderVariant));
+    if(!file_layouts.empty()) {
+        memcpy(data.data() + header.input_layouts.start, file_layouts.data(), file_layouts.size() * sizeof(kai::ShaderInputLayout));
+    }
+
+    FILE *out = fopen(argv[2], "wb");
+    if(!out || fwrite(data.data(), 1, data.size(), out) != data.size()) {
+        fprintf(stderr, "[ERROR] - Couldn't write the shader asset \"%s\"\n", argv[2]);
+
+        if(out) {
+            fclose(out);
+        }
+
+        return -1;
+    }
+
+    fclose(out);
+    fprintf(stdout, "Baked \"%s\": %u variants, %u inputs, %u bytes\n", argv[2], header.variants.count,
+            header.input_layouts.count, header.size);
+
+    return 0;
+}
@@ -0,0 +1,381 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+// Benchmark for SpriteBatch on the null backend. Every frame adds sprites with a random texture and layer and
+// ends with the upload, sort and draws of SpriteBatch::end(). --grouped adds them in layer and texture order
+// instead, which doesn't need a sort. For comparison the same quads are uploaded and drawn with a texture bind
+// and a draw call each, the way they would be without batching. The null device validates every command and
+// the draws are checked through the uploaded indices and vertices: every sprite has to be drawn exactly once,
+// in layer and texture order, and with its own texture.
+//
+// The null device doesn't do any work per draw call, so the draws are as cheap as they can be here. A real
+// backend pays the driver for every one of them on top.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KAI_HEADLESS_NULL_RENDERER
+#include "../common/headless.h"
+
+#include "../../core/sprite_batch.cpp"
+
+static Float64 to_ms(Uint64 ticks) {
+    return static_cast<Float64>(ticks) * 1000.0 / static_cast<Float64>(kai::get_timestamp_frequency());
+}
+
+static Uint32 hash(Uint32 x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static Uint32 sprite_count = 200000;
+static Bool32 grouped = false;
+
+// The texture and layer of every sprite are random unless they're grouped, but the same in every frame
+static Uint32 get_texture_index(Uint32 sprite, Uint32 texture_count, Uint32 layer_count) {
+    if(grouped) {
+        return static_cast<Uint32>(static_cast<Uint64>(sprite) * layer_count * texture_count / sprite_count) % texture_count;
+    }
+
+    return hash(sprite) % texture_count;
+}
+
+static Uint8 get_layer(Uint32 sprite, Uint32 layer_count) {
+    if(grouped) {
+        return static_cast<Uint8>(static_cast<Uint64>(sprite) * layer_count / sprite_count);
+    }
+
+    return static_cast<Uint8>(hash(sprite ^ 0x9e3779b9) % layer_count);
+}
+
+// The color is the index of the sprite, which is how the uploaded vertices are matched with the sprites
+static kai::Sprite get_sprite(const kai::RenderTexture *textures, Uint32 texture_count, Uint32 layer_count, Uint32 i) {
+    kai::Sprite sprite;
+    sprite.texture = textures[get_texture_index(i, texture_count, layer_count)];
+    sprite.position = kai::Vec2(static_cast<Float32>(i % 1280), static_cast<Float32>((i / 1280) % 720));
+    sprite.size = kai::Vec2(16.0f, 16.0f);
+    sprite.origin = kai::Vec2(0.0f, 0.0f);
+    sprite.rotation = (i & 1) ? static_cast<Float32>(i & 0xff) * 0.01f : 0.0f;
+    sprite.uv[2] = 0.5f;
+    sprite.uv[3] = 0.5f;
+    sprite.color = i;
+    sprite.layer = get_layer(i, layer_count);
+    return sprite;
+}
+
+// The quad of a sprite like SpriteBatch builds it, for drawing them one by one
+static void write_quad(const kai::Sprite &sprite, kai::SpriteVertex *out) {
+    Float32 s;
+    Float32 c;
+    kai::sine_cosine<kai::Precision::fast>(sprite.rotation, s, c);
+    Float32 corner_u[4] = { 0.0f, 1.0f, 1.0f, 0.0f };
+    Float32 corner_v[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+    for(Uint32 i = 0; i < 4; i++) {
+        Float32 x = (corner_u[i] - sprite.origin.x) * sprite.size.x;
+        Float32 y = (corner_v[i] - sprite.origin.y) * sprite.size.y;
+
+        out[i].position[0] = sprite.position.x + c * x - s * y;
+        out[i].position[1] = sprite.position.y + s * x + c * y;
+        out[i].uv[0] = corner_u[i] ? sprite.uv[2] : sprite.uv[0];
+        out[i].uv[1] = corner_v[i] ? sprite.uv[3] : sprite.uv[1];
+        out[i].color = sprite.color;
+    }
+}
+
+int main(int argc, char **argv) {
+    Uint32 texture_count = 64;
+    Uint32 layer_count = 4;
+    Uint32 frame_count = 100;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--sprites") && i + 1 < argc) {
+            sprite_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--textures") && i + 1 < argc) {
+            texture_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--layers") && i + 1 < argc) {
+            layer_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frame_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--grouped")) {
+            grouped = true;
+        } else {
+            printf("Usage: %s [--sprites N] [--textures N] [--layers N] [--frames N] [--grouped]\n", argv[0]);
+            return 0;
+        }
+    }
+
+    kai::clamp(sprite_count, 1u, 4000000u);
+    kai::clamp(texture_count, 1u, 1000u);
+    kai::clamp(layer_count, 1u, 256u);
+    frame_count = kai::max(frame_count, 1u);
+
+    MemoryManager::init(kai::gibibytes(4));
+    engine_memory = kai::StackAllocator(static_cast<Uint32>(kai::mebibytes(1)));
+
+    init_renderer(kai::RenderingBackend::null, nullptr, false);
+    kai::RenderDevice *device = kai::RenderDevice::get();
+    NullRenderer *null_device = static_cast<NullRenderer *>(get_backend_device());
+
+    if(!device) {
+        printf("Error: could not create the null render device!\n");
+        return -1;
+    }
+
+    kai::RenderTexture *textures = static_cast<kai::RenderTexture *>(calloc(texture_count, sizeof(kai::RenderTexture)));
+    Uint32 pixels[16];
+
+    for(Uint32 i = 0; i < texture_count; i++) {
+        for(Uint32 &pixel : pixels) {
+            pixel = 0xff000000 | hash(i);
+        }
+
+        kai::RenderTextureInfo texture_info = {};
+        texture_info.data = pixels;
+        texture_info.width = 4;
+        texture_info.height = 4;
+        device->create_texture(texture_info, textures[i]);
+    }
+
+    kai::SpriteBatch sprite_batch(device, sprite_count);
+    kai::CommandBuffer buffer(1024);
+
+    // The best frame of each, so that a frame that got preempted doesn't count
+    Uint64 add_ticks = ~0ull;
+    Uint64 end_ticks = ~0ull;
+    Uint64 batched_ticks = ~0ull;
+    Uint32 errors = 0;
+    Uint32 mismatches = 0;
+
+    kai::Mat4x4 view_projection = kai::Mat4x4::ortho(0.0f, 1280.0f, 720.0f, 0.0f, 0.0f, 1.0f);
+
+    // The sprites are generated once, so that the timings only cover the batching and not the hashing above
+    kai::Sprite *sprites = static_cast<kai::Sprite *>(malloc(static_cast<size_t>(sprite_count) * sizeof(kai::Sprite)));
+    for(Uint32 i = 0; i < sprite_count; i++) {
+        sprites[i] = get_sprite(textures, texture_count, layer_count, i);
+    }
+
+    // ----- Batched ----- //
+    for(Uint32 frame = 0; frame < frame_count; frame++) {
+        Uint64 start = kai::get_timestamp();
+
+        sprite_batch.begin();
+        sprite_batch.add(sprites, sprite_count);
+
+        Uint64 added = kai::get_timestamp();
+
+        buffer.begin();
+        sprite_batch.end(buffer, view_projection);
+        buffer.end();
+
+        Uint64 ended = kai::get_timestamp();
+
+        device->execute(buffer);
+        device->present();
+
+        add_ticks = kai::min(add_ticks, added - start);
+        end_ticks = kai::min(end_ticks, ended - added);
+        batched_ticks = kai::min(batched_ticks, kai::get_timestamp() - start);
+        errors += null_device->get_frame_stats().errors;
+    }
+
+    const kai::RenderFrameCounters batched_counters = device->get_frame_counters();
+    Uint32 draw_count = sprite_batch.get_draw_count();
+    Uint32 dropped_count = sprite_batch.get_dropped_count();
+
+    // Walks the draws of the last frame and checks the quads that each of them covers. The batch uses 16-bit
+    // indices whenever its vertices fit
+    Uint8 *seen = static_cast<Uint8 *>(calloc(sprite_count, 1));
+    const kai::SpriteVertex *uploaded = nullptr;
+    const void *uploaded_indices = nullptr;
+    Bool32 small_indices = sprite_count * 4 <= 0x10000;
+    Uint32 bound_texture = 0;
+    Uint32 previous_draw_texture = 0;
+    Uint32 previous_key = 0;
+    Uint32 redundant_draws = 0;
+
+    CommandDecoder decoder(buffer, false);
+    CommandEncodingData command;
+
+    while(decoder.next(command)) {
+        if(command.bind_buffer.encoding == CommandEncoding::bind_buffer && command.bind_buffer.type == kai::RenderBufferType::vertex) {
+            uploaded = static_cast<const kai::SpriteVertex *>(null_device->get_buffer_data({ command.bind_buffer.buffer }));
+        } else if(command.bind_buffer.encoding == CommandEncoding::bind_buffer && command.bind_buffer.type == kai::RenderBufferType::index) {
+            uploaded_indices = null_device->get_buffer_data({ command.bind_buffer.buffer });
+        } else if(command.bind_texture.encoding == CommandEncoding::bind_texture) {
+            bound_texture = command.bind_texture.texture;
+        } else if(command.draw_indexed.encoding == CommandEncoding::draw_indexed && uploaded && uploaded_indices) {
+            // Two draws in a row with the same texture could have been one
+            if(bound_texture == previous_draw_texture) {
+                redundant_draws++;
+            }
+
+            previous_draw_texture = bound_texture;
+
+            for(Uint32 n = command.draw_indexed.start; n < command.draw_indexed.start + command.draw_indexed.count; n += 6) {
+                Uint32 first = small_indices ? static_cast<const Uint16 *>(uploaded_indices)[n] : static_cast<const Uint32 *>(uploaded_indices)[n];
+                Uint32 q = first / 4;
+                Uint32 i = uploaded[q * 4].color;
+                if(i >= sprite_count || seen[i]) {
+                    mismatches++;
+                    continue;
+                }
+
+                seen[i] = 1;
+
+                const kai::Sprite &sprite = sprites[i];
+                Uint32 key = (static_cast<Uint32>(sprite.layer) << 24) | get_texture_index(i, texture_count, layer_count);
+
+                if(sprite.texture.handle != bound_texture || key < previous_key) {
+                    mismatches++;
+                }
+
+                previous_key = key;
+
+                // The corner at the min uv is the position, as the origin is 0
+                if(uploaded[q * 4].position[0] != sprite.position.x || uploaded[q * 4].position[1] != sprite.position.y ||
+                   uploaded[q * 4 + 2].uv[0] != sprite.uv[2] || uploaded[q * 4 + 2].uv[1] != sprite.uv[3]) {
+                    mismatches++;
+                }
+
+                // The unrotated ones have to span their size exactly
+                if(sprite.rotation == 0.0f && (uploaded[q * 4 + 2].position[0] != sprite.position.x + sprite.size.x ||
+                                               uploaded[q * 4 + 2].position[1] != sprite.position.y + sprite.size.y)) {
+                    mismatches++;
+                }
+            }
+        }
+    }
+
+    for(Uint32 i = 0; i < sprite_count; i++) {
+        mismatches += seen[i] ? 0 : 1;
+    }
+
+    free(seen);
+
+    // ----- One draw per sprite ----- //
+    kai::RenderBufferInfo buffer_info = {};
+    buffer_info.byte_size = static_cast<size_t>(sprite_count) * 4 * sizeof(kai::SpriteVertex);
+    buffer_info.stride = sizeof(kai::SpriteVertex);
+    buffer_info.type = kai::RenderBufferType::vertex;
+    buffer_info.cpu_usage = kai::RenderCPUUsage::write;
+    buffer_info.resource_usage = kai::RenderResourceUsage::cpu_w_gpu_r;
+
+    kai::RenderBuffer quad_buffer;
+    device->create_buffer(buffer_info, quad_buffer);
+
+    Uint32 *indices = static_cast<Uint32 *>(malloc(static_cast<size_t>(sprite_count) * 6 * sizeof(Uint32)));
+    write_quad_indices(indices, nullptr, sprite_count);
+
+    buffer_info = {};
+    buffer_info.data = indices;
+    buffer_info.byte_size = static_cast<size_t>(sprite_count) * 6 * sizeof(Uint32);
+    buffer_info.stride = sizeof(Uint32);
+    buffer_info.type = kai::RenderBufferType::index;
+
+    kai::RenderBuffer index_buffer;
+    device->create_buffer(buffer_info, index_buffer);
+    free(indices);
+
+    kai::RenderPipelineInfo pipeline_info = {};
+    pipeline_info.vertex_shader_source = "vs";
+    pipeline_info.vertex_shader_entry = "main";
+    pipeline_info.pixel_shader_source = "ps";
+    pipeline_info.pixel_shader_entry = "main";
+
+    kai::RenderPipeline pipeline;
+    device->create_render_pipeline(pipeline_info, nullptr, 0, pipeline);
+
+    // The quads are written in the order the sprites are added and uploaded at once, only the draws aren't batched
+    kai::SpriteVertex *quads = static_cast<kai::SpriteVertex *>(malloc(static_cast<size_t>(sprite_count) * 4 * sizeof(kai::SpriteVertex)));
+    Uint64 unbatched_ticks = ~0ull;
+
+    for(Uint32 frame = 0; frame < frame_count; frame++) {
+        Uint64 start = kai::get_timestamp();
+
+        buffer.begin();
+        buffer.set_render_pipeline(pipeline);
+        buffer.bind_buffer(quad_buffer, kai::RenderBufferType::vertex);
+        buffer.bind_buffer(index_buffer, kai::RenderBufferType::index);
+
+        for(Uint32 i = 0; i < sprite_count; i++) {
+            write_quad(sprites[i], quads + i * 4);
+
+            buffer.bind_texture(sprites[i].texture);
+            buffer.draw_indexed(6, i * 6);
+        }
+
+        buffer.end();
+
+        device->update_buffer(quad_buffer, quads, sprite_count * 4 * static_cast<Uint32>(sizeof(kai::SpriteVertex)));
+        device->execute(buffer);
+        device->present();
+
+        unbatched_ticks = kai::min(unbatched_ticks, kai::get_timestamp() - start);
+        errors += null_device->get_frame_stats().errors;
+    }
+
+    const kai::RenderFrameCounters unbatched_counters = device->get_frame_counters();
+
+    Float64 sprites_per_frame = static_cast<Float64>(sprite_count);
+    printf("%u sprites per frame with %u textures in %u layers, %s, best of %u frames\n\n", sprite_count, texture_count, layer_count,
+           grouped ? "grouped" : "random order", frame_count);
+
+    printf("Batched (SpriteBatch):\n");
+    printf("  frame ms            %.3f (%.0f sprites per ms)\n", to_ms(batched_ticks), sprites_per_frame / to_ms(batched_ticks));
+    printf("  adding sprites ms   %.3f (%.2f ns per sprite)\n", to_ms(add_ticks), to_ms(add_ticks) * 1e6 / sprites_per_frame);
+    printf("  end() ms            %.3f (%.2f ns per sprite)\n", to_ms(end_ticks), to_ms(end_ticks) * 1e6 / sprites_per_frame);
+    printf("  dropped sprites     %u\n", dropped_count);
+    printf("  draw calls          %u\n", batched_counters.draws);
+    printf("  texture binds       %u\n", batched_counters.texture_binds);
+    printf("  bytes updated       %u\n\n", batched_counters.buffer_bytes_updated);
+
+    printf("One draw per sprite:\n");
+    printf("  frame ms            %.3f (%.0f sprites per ms)\n", to_ms(unbatched_ticks), sprites_per_frame / to_ms(unbatched_ticks));
+    printf("  draw calls          %u\n", unbatched_counters.draws);
+    printf("  texture binds       %u\n", unbatched_counters.texture_binds);
+    printf("  encoded bytes       %u\n", unbatched_counters.command_bytes);
+
+    int retval = 0;
+    if(errors > 0) {
+        printf("Error: the null device found %u invalid commands!\n", errors);
+        retval = -1;
+    }
+
+    if(mismatches > 0) {
+        printf("Error: %u uploaded sprites don't match the sprites that were added!\n", mismatches);
+        retval = -1;
+    }
+
+    if(redundant_draws > 0 || draw_count != batched_counters.draws) {
+        printf("Error: %u of the %u draws could have been merged!\n", redundant_draws, draw_count);
+        retval = -1;
+    }
+
+    free(quads);
+    free(sprites);
+    buffer.destroy();
+    sprite_batch.destroy();
+    device->destroy_buffer(quad_buffer);
+    device->destroy_buffer(index_buffer);
+    device->destroy_render_pipeline(pipeline);
+
+    for(Uint32 i = 0; i < texture_count; i++) {
+        device->destroy_texture(textures[i]);
+    }
+
+    free(textures);
+
+    destroy_renderer();
+    engine_memory.destroy();
+    MemoryManager::destroy();
+
+    return retval;
+}
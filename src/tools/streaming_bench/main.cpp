@@ -0,0 +1,415 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+// Benchmark for the TextureStreamer on the null backend. It writes --textures texture assets of --size pixels into
+// a directory, lines them up and flies a camera along them and back. Every frame requests the textures in view at
+// the size they have on screen, which falls off with their distance, and calls update() like a game would, paced at
+// --frame-ms. The streamer has to keep up with a --budget of MiB.
+//
+// Every frame is validated against the null device: the texture of every streamed texture has to have the size and
+// the mip count of its resident mips and the pixels that the asset has for them, and the bytes that the streamer
+// counts have to match the textures. In the end everything is removed and the device has to be left without textures.
+// For comparison, it reports how much memory and time loading all of the textures at full size would take.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define KAI_HEADLESS_NULL_RENDERER
+#include "../common/headless.h"
+
+#include "../../asset/asset_manager.cpp"
+#include "../../asset/texture_streamer.cpp"
+
+#define SPACING 10.0f // Between the textures
+#define VIEW_RANGE 100.0f
+#define SCREEN_SCALE 2000.0f // Pixels on screen at a distance of 1
+#define SAMPLES_PER_MIP 16
+
+static Float64 to_ms(Uint64 ticks) {
+    return static_cast<Float64>(ticks) * 1000.0 / static_cast<Float64>(kai::get_timestamp_frequency());
+}
+
+static Float64 to_mib(Uint64 bytes) {
+    return static_cast<Float64>(bytes) / (1024.0 * 1024.0);
+}
+
+static Uint32 hash(Uint32 x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+// Every texel says which texture, mip and texel it is, so a texture with the wrong mips can't pass
+static Uint32 get_texel(Uint32 texture, Uint32 mip, Uint32 x, Uint32 y) {
+    return hash((texture << 20) ^ (mip << 16) ^ hash(x * 65537 + y));
+}
+
+static void get_path(char *out_path, size_t size, const char *directory, Uint32 texture) {
+    snprintf(out_path, size, "%s/texture_%u.texture", directory, texture);
+}
+
+static bool write_texture(const char *path, Uint32 texture, Uint32 size) {
+    kai::TextureHeader header = {};
+    header.asset_type = kai::AssetType::texture;
+    header.version = KAI_TEXTURE_VERSION;
+    header.format = static_cast<Uint32>(kai::RenderFormat::rgba_unorm8);
+    header.mip_count = kai::get_mip_count(size, size);
+
+    Uint32 start = sizeof(kai::TextureHeader);
+    for(Uint32 i = 0; i < header.mip_count; i++) {
+        header.mips[i].width = kai::max(size >> i, 1u);
+        header.mips[i].height = kai::max(size >> i, 1u);
+        header.mips[i].start = start;
+        header.mips[i].size = header.mips[i].width * header.mips[i].height * 4;
+        start += header.mips[i].size;
+    }
+
+    header.size = start;
+
+    FILE *f = fopen(path, "wb");
+    if(!f) {
+        return false;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, f) == 1;
+    Uint32 *row = static_cast<Uint32 *>(malloc(static_cast<size_t>(size) * 4));
+
+    for(Uint32 i = 0; i < header.mip_count; i++) {
+        for(Uint32 y = 0; y < header.mips[i].height; y++) {
+            for(Uint32 x = 0; x < header.mips[i].width; x++) {
+                row[x] = get_texel(texture, i, x, y);
+            }
+
+            written = written && fwrite(row, 4, header.mips[i].width, f) == header.mips[i].width;
+        }
+    }
+
+    free(row);
+    return (fclose(f) == 0) && written;
+}
+
+// The texture has to match what the streamer says is resident, returns the bytes of the texture or 0 if it doesn't
+static Uint64 validate_texture(NullRenderer *null_device, kai::TextureStreamer &streamer, const kai::StreamedTexture &texture,
+                               Uint32 index, Uint32 size) {
+    kai::RenderTextureInfo info;
+    Uint32 first_mip = streamer.get_resident_mip(texture);
+    Uint32 mip_count = kai::get_mip_count(size, size);
+
+    if(first_mip >= mip_count || !null_device->get_texture_info(streamer.get_texture(texture), info) ||
+       info.width != kai::max(size >> first_mip, 1u) || info.height != info.width || info.mip_count != mip_count - first_mip ||
+       info.format != kai::RenderFormat::rgba_unorm8) {
+        return 0;
+    }
+
+    const Uint32 *texels = static_cast<const Uint32 *>(info.data);
+    for(Uint32 i = 0; i < info.mip_count; i++) {
+        Uint32 mip_size = kai::max(info.width >> i, 1u);
+
+        for(Uint32 sample = 0; sample < SAMPLES_PER_MIP; sample++) {
+            Uint32 x = (sample == 0) ? 0 : (sample == 1) ? mip_size - 1 : hash(sample * 7 + i) % mip_size;
+            Uint32 y = (sample == 0) ? 0 : (sample == 1) ? mip_size - 1 : hash(sample * 13 + i) % mip_size;
+
+            if(texels[y * mip_size + x] != get_texel(index, first_mip + i, x, y)) {
+                return 0;
+            }
+        }
+
+        texels += mip_size * mip_size;
+    }
+
+    return kai::get_texture_size(info.format, info.width, info.height, info.mip_count);
+}
+
+int main(int argc, char **argv) {
+    Uint32 texture_count = 64;
+    Uint32 size = 512;
+    Uint32 budget_mib = 16;
+    Uint32 frame_count = 600;
+    Uint32 frame_ms = 8;
+    Uint32 max_loads = 4;
+    const char *directory = "streaming_bench_data";
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--textures") && i + 1 < argc) {
+            texture_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--size") && i + 1 < argc) {
+            size = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--budget") && i + 1 < argc) {
+            budget_mib = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frame_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--frame-ms") && i + 1 < argc) {
+            frame_ms = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--loads") && i + 1 < argc) {
+            max_loads = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--dir") && i + 1 < argc) {
+            directory = argv[++i];
+        } else {
+            printf("Usage: %s [--textures N] [--size PIXELS] [--budget MIB] [--frames N] [--frame-ms MS] [--loads N] [--dir PATH]\n",
+                   argv[0]);
+            return 0;
+        }
+    }
+
+    kai::clamp(texture_count, 1u, 4096u);
+    kai::clamp(size, 64u, 8192u);
+    frame_count = kai::max(frame_count, 2u);
+
+    MemoryManager::init(kai::gibibytes(4));
+    engine_memory = kai::StackAllocator(static_cast<Uint32>(kai::mebibytes(1)));
+
+    init_renderer(kai::RenderingBackend::null, nullptr, false);
+    kai::RenderDevice *device = kai::RenderDevice::get();
+    NullRenderer *null_device = static_cast<NullRenderer *>(get_backend_device());
+
+    if(!device) {
+        printf("Error: could not create the null render device!\n");
+        return -1;
+    }
+
+    mkdir(directory, 0755);
+
+    char path[256];
+    for(Uint32 i = 0; i < texture_count; i++) {
+        get_path(path, sizeof(path), directory, i);
+        if(!write_texture(path, i, size)) {
+            printf("Error: could not write \"%s\"!\n", path);
+            return -1;
+        }
+    }
+
+    printf("%u textures of %ux%u, a budget of %u MiB, %u frames of %u ms, %u loads in flight\n\n", texture_count, size, size,
+           budget_mib, frame_count, frame_ms, max_loads);
+
+    // ----- Everything at full size ----- //
+    Uint64 full_start = kai::get_timestamp();
+    Uint64 full_bytes = 0;
+    void *full_data = malloc(static_cast<size_t>(kai::get_texture_size(kai::RenderFormat::rgba_unorm8, size, size,
+                                                                       kai::get_mip_count(size, size))));
+
+    for(Uint32 i = 0; i < texture_count; i++) {
+        get_path(path, sizeof(path), directory, i);
+        kai::FileHandle file = kai::open_file(path);
+
+        kai::RenderTextureInfo info;
+        info.data = full_data;
+        info.width = size;
+        info.height = size;
+        info.mip_count = kai::get_mip_count(size, size);
+
+        Uint64 bytes = kai::get_texture_size(info.format, size, size, info.mip_count);
+        kai::RenderTexture texture;
+
+        if(file && kai::read_file_at(file, full_data, static_cast<size_t>(bytes), sizeof(kai::TextureHeader)) &&
+           device->create_texture(info, texture)) {
+            device->destroy_texture(texture);
+            full_bytes += bytes;
+        }
+
+        kai::close_file(file);
+    }
+
+    Uint64 full_ticks = kai::get_timestamp() - full_start;
+    free(full_data);
+
+    // ----- Streamed ----- //
+    kai::TextureStreamer streamer(device, kai::mebibytes(budget_mib), texture_count, max_loads);
+    kai::StreamedTexture *textures = static_cast<kai::StreamedTexture *>(calloc(texture_count, sizeof(kai::StreamedTexture)));
+    Uint64 *wanted_since = static_cast<Uint64 *>(calloc(texture_count, sizeof(Uint64))); // When it first wanted more mips
+
+    Uint64 add_start = kai::get_timestamp();
+    for(Uint32 i = 0; i < texture_count; i++) {
+        get_path(path, sizeof(path), directory, i);
+        textures[i] = streamer.add(path);
+
+        if(!textures[i].handle) {
+            printf("Error: could not add \"%s\" to the streamer!\n", path);
+            return -1;
+        }
+    }
+
+    Uint64 add_ticks = kai::get_timestamp() - add_start;
+    Uint64 tail_bytes = streamer.get_stats().resident_bytes;
+
+    Uint64 update_ticks = 0;
+    Uint64 max_update_ticks = 0;
+    Uint64 latency_ticks = 0;
+    Uint64 max_latency_ticks = 0;
+    Uint32 latency_count = 0;
+    Uint64 resident_sum = 0;
+    Uint64 wanted_sum = 0;
+    Uint64 peak_resident = 0;
+    Uint64 peak_device = 0;
+    Uint64 upgrades = 0;
+    Uint64 downgrades = 0;
+    Uint64 limited_sum = 0;
+    Uint32 max_bias = 0;
+    Uint32 mismatches = 0;
+    Uint32 miscounts = 0;
+    Uint32 over_budget = 0;
+    Uint32 errors = 0;
+
+    Float32 track = static_cast<Float32>(texture_count - 1) * SPACING + 2.0f * VIEW_RANGE;
+    Uint64 loop_start = kai::get_timestamp();
+
+    for(Uint32 frame = 0; frame < frame_count; frame++) {
+        Uint64 frame_start = kai::get_timestamp();
+
+        // There and back again, offset from the line so no texture gets infinitely large
+        Float32 t = static_cast<Float32>(frame) / static_cast<Float32>(frame_count - 1) * 2.0f;
+        Float32 camera = ((t <= 1.0f) ? t : 2.0f - t) * track - VIEW_RANGE;
+
+        for(Uint32 i = 0; i < texture_count; i++) {
+            Float32 distance = kai::abs(static_cast<Float32>(i) * SPACING - camera) + 1.0f;
+
+            if(distance < VIEW_RANGE) {
+                Float32 screen_size = SCREEN_SCALE / distance;
+                streamer.request(textures[i], screen_size);
+
+                Uint32 mip = 0;
+                while(mip + 1 < kai::get_mip_count(size, size) && static_cast<Float32>(size >> (mip + 1)) >= screen_size) {
+                    mip++;
+                }
+
+                if(streamer.get_resident_mip(textures[i]) > mip) {
+                    wanted_since[i] = wanted_since[i] ? wanted_since[i] : frame_start;
+                } else if(wanted_since[i]) {
+                    Uint64 latency = frame_start - wanted_since[i];
+                    latency_ticks += latency;
+                    max_latency_ticks = kai::max(max_latency_ticks, latency);
+                    latency_count++;
+                    wanted_since[i] = 0;
+                }
+            } else {
+                wanted_since[i] = 0;
+            }
+        }
+
+        Uint64 update_start = kai::get_timestamp();
+        streamer.update();
+        Uint64 ticks = kai::get_timestamp() - update_start;
+
+        update_ticks += ticks;
+        max_update_ticks = kai::max(max_update_ticks, ticks);
+
+        const kai::TextureStreamerStats &stats = streamer.get_stats();
+        Uint64 bytes = 0;
+
+        for(Uint32 i = 0; i < texture_count; i++) {
+            Uint64 texture_bytes = validate_texture(null_device, streamer, textures[i], i, size);
+            mismatches += texture_bytes ? 0 : 1;
+            bytes += texture_bytes;
+        }
+
+        miscounts += (bytes != stats.resident_bytes) ? 1 : 0;
+        over_budget += (stats.resident_bytes > stats.budget && stats.resident_bytes > tail_bytes) ? 1 : 0;
+
+        device->present();
+
+        resident_sum += stats.resident_bytes;
+        wanted_sum += stats.wanted_bytes;
+        peak_resident = kai::max(peak_resident, stats.resident_bytes);
+        peak_device = kai::max(peak_device, device->get_frame_counters().texture_bytes);
+        upgrades += stats.upgrades;
+        downgrades += stats.downgrades;
+        limited_sum += stats.limited_count;
+        max_bias = kai::max(max_bias, stats.mip_bias);
+        errors += null_device->get_frame_stats().errors;
+
+        Uint64 elapsed = kai::get_timestamp() - frame_start;
+        Uint64 frame_ticks = kai::get_timestamp_frequency() * frame_ms / 1000;
+        if(elapsed < frame_ticks) {
+            std::this_thread::sleep_for(std::chrono::microseconds((frame_ticks - elapsed) * 1000000 / kai::get_timestamp_frequency()));
+        }
+    }
+
+    Uint64 loop_ticks = kai::get_timestamp() - loop_start;
+    const kai::TextureStreamerStats stats = streamer.get_stats();
+
+    for(Uint32 i = 0; i < texture_count; i++) {
+        streamer.remove(textures[i]);
+    }
+
+    Uint64 removed_bytes = streamer.get_stats().resident_bytes;
+    streamer.destroy();
+
+    for(Uint32 i = 0; i < FRAMES_IN_FLIGHT + 1; i++) {
+        device->present();
+    }
+
+    Uint64 leaked_bytes = device->get_frame_counters().texture_bytes;
+
+    for(Uint32 i = 0; i < texture_count; i++) {
+        get_path(path, sizeof(path), directory, i);
+        unlink(path);
+    }
+
+    rmdir(directory);
+
+    Float64 frames = static_cast<Float64>(frame_count);
+
+    printf("Everything at full size:\n");
+    printf("  texture MiB         %.1f\n", to_mib(full_bytes));
+    printf("  load ms             %.1f (%.1f MiB/s)\n\n", to_ms(full_ticks), to_mib(full_bytes) / (to_ms(full_ticks) / 1000.0));
+
+    printf("Streamed (TextureStreamer):\n");
+    printf("  add() ms            %.1f (%.1f MiB of tails)\n", to_ms(add_ticks), to_mib(tail_bytes));
+    printf("  update() ms         %.3f (%.3f at most)\n", to_ms(update_ticks) / frames, to_ms(max_update_ticks));
+    printf("  resident MiB        %.1f on average, %.1f at most (%.1f on the device with the swaps)\n",
+           to_mib(resident_sum) / frames, to_mib(peak_resident), to_mib(peak_device));
+    printf("  wanted MiB          %.1f on average\n", to_mib(wanted_sum) / frames);
+    printf("  limited textures    %.1f on average, a mip bias of up to %u\n", static_cast<Float64>(limited_sum) / frames, max_bias);
+    printf("  upgrades            %llu (%llu downgrades)\n", static_cast<unsigned long long>(upgrades),
+           static_cast<unsigned long long>(downgrades));
+    printf("  loaded MiB          %.1f (%.1f MiB/s over the run)\n", to_mib(stats.loaded_bytes),
+           to_mib(stats.loaded_bytes) / (to_ms(loop_ticks + add_ticks) / 1000.0));
+    printf("  latency ms          %.1f on average, %.1f at most (%u times a texture got what it wanted)\n",
+           latency_count ? to_ms(latency_ticks) / latency_count : 0.0, to_ms(max_latency_ticks), latency_count);
+    printf("  full size memory    %.1f%%\n", 100.0 * static_cast<Float64>(peak_resident) / static_cast<Float64>(full_bytes));
+
+    int retval = 0;
+    if(errors > 0) {
+        printf("Error: the null device found %u invalid commands!\n", errors);
+        retval = -1;
+    }
+
+    if(mismatches > 0) {
+        printf("Error: %u times a texture didn't have the size or the pixels of its resident mips!\n", mismatches);
+        retval = -1;
+    }
+
+    if(miscounts > 0) {
+        printf("Error: the resident bytes of the streamer didn't match its textures in %u frames!\n", miscounts);
+        retval = -1;
+    }
+
+    if(over_budget > 0) {
+        printf("Error: the streamer went over its budget in %u frames!\n", over_budget);
+        retval = -1;
+    }
+
+    if(removed_bytes != 0 || leaked_bytes != 0) {
+        printf("Error: %llu bytes were left after removing every texture, %llu on the device!\n",
+               static_cast<unsigned long long>(removed_bytes), static_cast<unsigned long long>(leaked_bytes));
+        retval = -1;
+    }
+
+    free(wanted_since);
+    free(textures);
+    destroy_renderer();
+    engine_memory.destroy();
+
+    return retval;
+}
@@ -0,0 +1,549 @@
+/**************************************************
+ * Copyright (c) 2021 Amanch Esmailzadeh
+ * See LICENSE for details
+ **************************************************/
+
+// Benchmark for TextBatch on the null backend. Every frame lays out a screen full of text and ends with the atlas
+// update, the upload and the single draw of TextBatch::end(). The text mixes the ASCII glyphs of the font with
+// --extra glyphs that change from frame to frame, so with a small --atlas the cache keeps evicting glyphs. For
+// comparison the same glyphs are drawn with a texture of their own and a draw call each, the way they would be
+// without an atlas. The null device validates every command, and the quads of the last frame are checked against
+// the atlas: every glyph has to be drawn once, at its size and with its pixels in the atlas around it.
+//
+// It also checks that fonts without glyphs are rejected and that broken or overlong UTF-8 decodes to U+FFFD.
+//
+// --font draws with a font asset from src/tools/font_bake instead of the generated one, which only has ASCII.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KAI_HEADLESS_NULL_RENDERER
+#include "../common/headless.h"
+
+#include "../../asset/asset_manager.cpp"
+#include "../../core/text.cpp"
+
+#define ASCII_FIRST 32
+#define ASCII_LAST 126
+#define EXTRA_FIRST 0x4e00
+#define EXTRA_WINDOW 128
+#define EXTRA_STEP 16
+#define COLUMNS 100
+
+static Float64 to_ms(Uint64 ticks) {
+    return static_cast<Float64>(ticks) * 1000.0 / static_cast<Float64>(kai::get_timestamp_frequency());
+}
+
+static Uint32 hash(Uint32 x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+// A terminal-like font with noise for glyphs: 7x12 ASCII on 16 pixel lines and 14x14 extra glyphs from EXTRA_FIRST
+static kai::FontHeader * make_font(Uint32 extra_count) {
+    Uint32 ascii_count = ASCII_LAST - ASCII_FIRST + 1;
+    Uint32 glyph_count = ascii_count + extra_count;
+    Uint32 bitmaps_start = sizeof(kai::FontHeader) + glyph_count * sizeof(kai::FontGlyph);
+    Uint32 size = bitmaps_start + (ascii_count - 1) * 7 * 12 + extra_count * 14 * 14;
+    size = (size + 3) & ~3u;
+
+    Uint8 *data = static_cast<Uint8 *>(calloc(size, 1));
+    kai::FontHeader *font = reinterpret_cast<kai::FontHeader *>(data);
+    kai::FontGlyph *glyphs = reinterpret_cast<kai::FontGlyph *>(data + sizeof(kai::FontHeader));
+
+    font->asset_type = kai::AssetType::font;
+    font->version = KAI_FONT_VERSION;
+    font->size = size;
+    font->line_height = 16;
+    font->ascent = 12;
+    font->max_glyph_size = 14;
+    font->glyphs.count = glyph_count;
+    font->glyphs.start = sizeof(kai::FontHeader);
+    font->default_glyph = '?' - ASCII_FIRST;
+
+    Uint32 bitmap_start = bitmaps_start;
+    for(Uint32 i = 0; i < glyph_count; i++) {
+        kai::FontGlyph &glyph = glyphs[i];
+        bool ascii = i < ascii_count;
+
+        glyph.codepoint = ascii ? ASCII_FIRST + i : EXTRA_FIRST + (i - ascii_count);
+        glyph.bitmap_start = bitmap_start;
+        glyph.width = (glyph.codepoint == ' ') ? 0 : ascii ? 7 : 14;
+        glyph.height = (glyph.codepoint == ' ') ? 0 : ascii ? 12 : 14;
+        glyph.offset_y = ascii ? -12 : -13;
+        glyph.advance = ascii ? 8 : 16;
+
+        for(Uint32 p = 0; p < static_cast<Uint32>(glyph.width) * glyph.height; p++) {
+            data[bitmap_start + p] = (hash(glyph.codepoint * 977 + p) & 1) ? 255 : 0;
+        }
+
+        bitmap_start += glyph.width * glyph.height;
+    }
+
+    return font;
+}
+
+// Fonts without glyphs and broken or overlong UTF-8, returns the number of cases that failed
+static Uint32 check_edge_cases(void) {
+    Uint32 failures = 0;
+
+    kai::FontHeader empty = {};
+    empty.asset_type = kai::AssetType::font;
+    empty.version = KAI_FONT_VERSION;
+    empty.size = sizeof(kai::FontHeader);
+    empty.glyphs.start = sizeof(kai::FontHeader);
+    empty.default_glyph = KAI_FONT_NO_GLYPH;
+
+    if(validate_font(&empty, sizeof(empty)) || find_glyph(&empty, 'a') != KAI_FONT_NO_GLYPH) {
+        printf("Error: a font without glyphs was accepted or found a glyph!\n");
+        failures++;
+    }
+
+    struct Utf8Case {
+        const char *text;
+        Uint32 codepoint;
+        Uint32 length;
+    };
+
+    const Utf8Case cases[] = {
+        { "\xc2\x80", 0x80, 2 },
+        { "\xe0\xa0\x80", 0x800, 3 },
+        { "\xef\xbf\xbd", 0xfffd, 3 },
+        { "\xf0\x90\x80\x80", 0x10000, 4 },
+        { "\xf4\x8f\xbf\xbf", 0x10ffff, 4 },
+        { "\x80", 0xfffd, 1 }, // Continuation byte without a lead byte
+        { "\xc3", 0xfffd, 1 }, // Cut off by the end of the text
+        { "\xf8\x88\x80\x80\x80", 0xfffd, 1 }, // 5 byte sequences aren't UTF-8
+        { "\xfc\x84\x80\x80\x80\x80", 0xfffd, 1 },
+        { "\xff\x80\x80", 0xfffd, 1 },
+        { "\xc0\x80", 0xfffd, 1 }, // Overlong NUL
+        { "\xc1\xbf", 0xfffd, 1 },
+        { "\xe0\x80\xaf", 0xfffd, 1 },
+        { "\xf0\x82\x82\xac", 0xfffd, 1 },
+        { "\xed\xa0\x80", 0xfffd, 1 }, // Surrogate
+        { "\xf4\x90\x80\x80", 0xfffd, 1 } // Past U+10FFFF
+    };
+
+    for(const Utf8Case &c : cases) {
+        const char *text = c.text;
+        Uint32 codepoint = decode_utf8(text);
+        Uint32 length = static_cast<Uint32>(text - c.text);
+
+        if(codepoint != c.codepoint || length != c.length) {
+            printf("Error: decoded U+%04X from %u bytes instead of U+%04X from %u bytes (first byte 0x%02x)!\n", codepoint,
+                   length, c.codepoint, c.length, static_cast<Uint8>(c.text[0]));
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+static kai::FontHeader * read_font(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if(!f) {
+        printf("Error: could not open \"%s\"!\n", path);
+        return nullptr;
+    }
+
+    fseek(f, 0, SEEK_END);
+    size_t size = static_cast<size_t>(ftell(f));
+    fseek(f, 0, SEEK_SET);
+
+    kai::FontHeader *font = static_cast<kai::FontHeader *>(malloc(size));
+    bool read = fread(font, 1, size, f) == size;
+    fclose(f);
+
+    if(!read || !validate_font(font, size)) {
+        printf("Error: \"%s\" is not a valid font asset!\n", path);
+        free(font);
+        return nullptr;
+    }
+
+    return font;
+}
+
+static Uint32 encode_utf8(Uint32 codepoint, char *out) {
+    if(codepoint < 0x80) {
+        out[0] = static_cast<char>(codepoint);
+        return 1;
+    } else if(codepoint < 0x800) {
+        out[0] = static_cast<char>(0xc0 | (codepoint >> 6));
+        out[1] = static_cast<char>(0x80 | (codepoint & 0x3f));
+        return 2;
+    }
+
+    out[0] = static_cast<char>(0xe0 | (codepoint >> 12));
+    out[1] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f));
+    out[2] = static_cast<char>(0x80 | (codepoint & 0x3f));
+    return 3;
+}
+
+// Every eighth glyph is an extra one out of a window of EXTRA_WINDOW of them, which moves on by EXTRA_STEP every frame
+static Uint32 get_codepoint(Uint32 i, Uint32 frame, Uint32 extra_count) {
+    if(extra_count && (hash(i) & 7) == 0) {
+        return EXTRA_FIRST + (hash(i ^ 0x5bd1e995) % EXTRA_WINDOW + frame * EXTRA_STEP) % extra_count;
+    }
+
+    return ASCII_FIRST + hash(i + frame) % (ASCII_LAST - ASCII_FIRST + 1);
+}
+
+// The lines of a frame, each one a null-terminated UTF-8 string
+static void write_text(char *text, Uint32 line_count, Uint32 frame, Uint32 extra_count) {
+    for(Uint32 line = 0; line < line_count; line++) {
+        char *out = text + line * (COLUMNS * 3 + 1);
+
+        for(Uint32 column = 0; column < COLUMNS; column++) {
+            out += encode_utf8(get_codepoint(line * COLUMNS + column, frame, extra_count), out);
+        }
+
+        *out = '\0';
+    }
+}
+
+int main(int argc, char **argv) {
+    Uint32 line_count = 80;
+    Uint32 extra_count = 0;
+    Uint32 cell_size = 16;
+    Uint32 atlas_size = 1024;
+    Uint32 frame_count = 100;
+    const char *font_path = nullptr;
+
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--lines") && i + 1 < argc) {
+            line_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--extra") && i + 1 < argc) {
+            extra_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--cell") && i + 1 < argc) {
+            cell_size = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--atlas") && i + 1 < argc) {
+            atlas_size = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frame_count = static_cast<Uint32>(atoi(argv[++i]));
+        } else if(!strcmp(argv[i], "--font") && i + 1 < argc) {
+            font_path = argv[++i];
+        } else {
+            printf("Usage: %s [--lines N] [--extra N] [--cell PIXELS] [--atlas PIXELS] [--frames N] [--font ASSET]\n", argv[0]);
+            return 0;
+        }
+    }
+
+    kai::clamp(line_count, 1u, 10000u);
+    kai::clamp(extra_count, 0u, 20000u);
+    frame_count = kai::max(frame_count, 1u);
+
+    kai::FontHeader *font = font_path ? read_font(font_path) : make_font(extra_count);
+    if(!font) {
+        return -1;
+    }
+
+    if(font_path) {
+        extra_count = 0;
+    }
+
+    MemoryManager::init(kai::gibibytes(4));
+    engine_memory = kai::StackAllocator(static_cast<Uint32>(kai::mebibytes(1)));
+
+    init_renderer(kai::RenderingBackend::null, nullptr, false);
+    kai::RenderDevice *device = kai::RenderDevice::get();
+    NullRenderer *null_device = static_cast<NullRenderer *>(get_backend_device());
+
+    if(!device) {
+        printf("Error: could not create the null render device!\n");
+        return -1;
+    }
+
+    Uint32 max_glyphs = line_count * COLUMNS;
+    char *text = static_cast<char *>(malloc(static_cast<size_t>(line_count) * (COLUMNS * 3 + 1)));
+
+    kai::TextBatch text_batch(device, max_glyphs, cell_size, atlas_size);
+    kai::CommandBuffer buffer(1024);
+
+    Uint64 add_ticks = 0;
+    Uint64 end_ticks = 0;
+    Uint64 batched_ticks = 0;
+    Uint64 misses = 0;
+    Uint64 evictions = 0;
+    Uint32 errors = 0;
+    Uint32 mismatches = 0;
+
+    kai::Mat4x4 view_projection = kai::Mat4x4::ortho(0.0f, 1280.0f, 720.0f, 0.0f, 0.0f, 1.0f);
+    const kai::FontGlyph *glyphs = get_glyphs(font);
+    Float32 line_height = static_cast<Float32>(font->line_height);
+
+    // ----- Batched ----- //
+    for(Uint32 frame = 0; frame < frame_count; frame++) {
+        write_text(text, line_count, frame, extra_count);
+
+        Uint64 start = kai::get_timestamp();
+
+        text_batch.begin();
+
+        for(Uint32 line = 0; line < line_count; line++) {
+            const char *line_text = text + line * (COLUMNS * 3 + 1);
+            text_batch.add(font, line_text, kai::Vec2(0.0f, static_cast<Float32>(line) * line_height), 1.0f, line);
+        }
+
+        Uint64 added = kai::get_timestamp();
+
+        buffer.begin();
+        text_batch.end(buffer, view_projection);
+        buffer.end();
+
+        Uint64 ended = kai::get_timestamp();
+
+        device->execute(buffer);
+        device->present();
+
+        add_ticks += added - start;
+        end_ticks += ended - added;
+        batched_ticks += kai::get_timestamp() - start;
+        misses += text_batch.get_cache_miss_count();
+        evictions += text_batch.get_eviction_count();
+        errors += null_device->get_frame_stats().errors;
+    }
+
+    const kai::RenderFrameCounters batched_counters = device->get_frame_counters();
+    Uint32 glyph_count = text_batch.get_glyph_count();
+    Uint32 dropped_count = text_batch.get_dropped_count();
+    Uint32 draw_count = text_batch.get_draw_count();
+
+    // The quads of the last frame follow the glyphs of the text that have pixels, each one has to cover its glyph in the
+    // atlas that the device has, with empty pixels to its right and below it. Dropped glyphs leave gaps that can't be
+    // told apart, so the quads are only checked if every glyph got a cell
+    const Uint8 *atlas = static_cast<const Uint8 *>(null_device->get_texture_data(text_batch.get_atlas()));
+    const kai::GlyphVertex *uploaded = nullptr;
+
+    CommandDecoder decoder(buffer, false);
+    CommandEncodingData command;
+
+    while(decoder.next(command)) {
+        if(command.bind_buffer.encoding == CommandEncoding::bind_buffer && command.bind_buffer.type == kai::RenderBufferType::vertex) {
+            uploaded = static_cast<const kai::GlyphVertex *>(null_device->get_buffer_data({ command.bind_buffer.buffer }));
+        }
+    }
+
+    Uint32 quad = 0;
+    for(Uint32 i = 0; !dropped_count && uploaded && atlas && i < line_count * COLUMNS; i++) {
+        Uint32 index = find_glyph(font, get_codepoint(i, frame_count - 1, extra_count));
+        const kai::FontGlyph &glyph = glyphs[(index == KAI_FONT_NO_GLYPH) ? 0 : index];
+
+        if(index == KAI_FONT_NO_GLYPH || !glyph.width || !glyph.height) {
+            continue;
+        }
+
+        if(quad == glyph_count) {
+            mismatches++;
+            break;
+        }
+
+        const kai::GlyphVertex *v = uploaded + quad * 4;
+        quad++;
+
+        Uint32 x = static_cast<Uint32>(v[0].uv[0] * static_cast<Float32>(atlas_size) + 0.5f);
+        Uint32 y = static_cast<Uint32>(v[0].uv[1] * static_cast<Float32>(atlas_size) + 0.5f);
+
+        if(v[2].position[0] - v[0].position[0] != glyph.width || v[2].position[1] - v[0].position[1] != glyph.height ||
+           v[0].color != i / COLUMNS || x + glyph.width >= atlas_size || y + glyph.height >= atlas_size) {
+            mismatches++;
+            continue;
+        }
+
+        const Uint8 *bitmap = reinterpret_cast<const Uint8 *>(font) + glyph.bitmap_start;
+        for(Uint32 gy = 0; gy <= glyph.height; gy++) {
+            for(Uint32 gx = 0; gx <= glyph.width; gx++) {
+                Uint8 expected = (gx < glyph.width && gy < glyph.height) ? bitmap[gy * glyph.width + gx] : 0;
+                if(atlas[(y + gy) * atlas_size + x + gx] != expected) {
+                    mismatches++;
+                    gy = glyph.height;
+                    break;
+                }
+            }
+        }
+    }
+
+    if(!dropped_count) {
+        mismatches += glyph_count - quad;
+    }
+
+    // ----- One texture and draw per glyph ----- //
+    kai::RenderTexture *glyph_textures = static_cast<kai::RenderTexture *>(calloc(font->glyphs.count, sizeof(kai::RenderTexture)));
+
+    for(Uint32 i = 0; i < font->glyphs.count; i++) {
+        if(glyphs[i].width && glyphs[i].height) {
+            kai::RenderTextureInfo texture_info = {};
+            texture_info.data = reinterpret_cast<const Uint8 *>(font) + glyphs[i].bitmap_start;
+            texture_info.width = glyphs[i].width;
+            texture_info.height = glyphs[i].height;
+            texture_info.format = kai::RenderFormat::r_unorm8;
+            device->create_texture(texture_info, glyph_textures[i]);
+        }
+    }
+
+    kai::RenderBufferInfo buffer_info = {};
+    buffer_info.byte_size = static_cast<size_t>(max_glyphs) * 4 * sizeof(kai::GlyphVertex);
+    buffer_info.stride = sizeof(kai::GlyphVertex);
+    buffer_info.type = kai::RenderBufferType::vertex;
+    buffer_info.cpu_usage = kai::RenderCPUUsage::write;
+    buffer_info.resource_usage = kai::RenderResourceUsage::cpu_w_gpu_r;
+
+    kai::RenderBuffer quad_buffer;
+    device->create_buffer(buffer_info, quad_buffer);
+
+    Uint32 *indices = static_cast<Uint32 *>(malloc(static_cast<size_t>(max_glyphs) * 6 * sizeof(Uint32)));
+    for(Uint32 i = 0; i < max_glyphs; i++) {
+        Uint32 quad_indices[6] = { i * 4, i * 4 + 1, i * 4 + 2, i * 4, i * 4 + 2, i * 4 + 3 };
+        memcpy(indices + i * 6, quad_indices, sizeof(quad_indices));
+    }
+
+    buffer_info = {};
+    buffer_info.data = indices;
+    buffer_info.byte_size = static_cast<size_t>(max_glyphs) * 6 * sizeof(Uint32);
+    buffer_info.stride = sizeof(Uint32);
+    buffer_info.type = kai::RenderBufferType::index;
+
+    kai::RenderBuffer index_buffer;
+    device->create_buffer(buffer_info, index_buffer);
+    free(indices);
+
+    kai::RenderPipelineInfo pipeline_info = {};
+    pipeline_info.vertex_shader_source = "vs";
+    pipeline_info.vertex_shader_entry = "main";
+    pipeline_info.pixel_shader_source = "ps";
+    pipeline_info.pixel_shader_entry = "main";
+
+    kai::RenderPipeline pipeline;
+    device->create_render_pipeline(pipeline_info, nullptr, 0, pipeline);
+
+    // The same layout, but every glyph is a whole texture
+    kai::GlyphVertex *quads = static_cast<kai::GlyphVertex *>(malloc(static_cast<size_t>(max_glyphs) * 4 * sizeof(kai::GlyphVertex)));
+    Uint64 unbatched_ticks = 0;
+
+    for(Uint32 frame = 0; frame < frame_count; frame++) {
+        write_text(text, line_count, frame, extra_count);
+
+        Uint64 start = kai::get_timestamp();
+
+        buffer.begin();
+        buffer.set_render_pipeline(pipeline);
+        buffer.bind_buffer(quad_buffer, kai::RenderBufferType::vertex);
+        buffer.bind_buffer(index_buffer, kai::RenderBufferType::index);
+
+        Uint32 count = 0;
+        for(Uint32 line = 0; line < line_count; line++) {
+            const char *s = text + line * (COLUMNS * 3 + 1);
+            Float32 x = 0.0f;
+            Float32 y = static_cast<Float32>(line) * line_height + static_cast<Float32>(font->ascent);
+
+            while(*s) {
+                Uint32 index = find_glyph(font, decode_utf8(s));
+                if(index == KAI_FONT_NO_GLYPH) {
+                    continue;
+                }
+
+                const kai::FontGlyph &glyph = glyphs[index];
+                if(glyph.width && glyph.height) {
+                    Float32 x0 = x + glyph.offset_x;
+                    Float32 y0 = y + glyph.offset_y;
+                    Float32 x1 = x0 + glyph.width;
+                    Float32 y1 = y0 + glyph.height;
+
+                    kai::GlyphVertex *v = quads + count * 4;
+                    v[0] = { { x0, y0 }, { 0.0f, 0.0f }, line };
+                    v[1] = { { x1, y0 }, { 1.0f, 0.0f }, line };
+                    v[2] = { { x1, y1 }, { 1.0f, 1.0f }, line };
+                    v[3] = { { x0, y1 }, { 0.0f, 1.0f }, line };
+
+                    buffer.bind_texture(glyph_textures[index]);
+                    buffer.draw_indexed(6, count * 6);
+                    count++;
+                }
+
+                x += glyph.advance;
+            }
+        }
+
+        buffer.end();
+
+        device->update_buffer(quad_buffer, quads, count * 4 * static_cast<Uint32>(sizeof(kai::GlyphVertex)));
+        device->execute(buffer);
+        device->present();
+
+        unbatched_ticks += kai::get_timestamp() - start;
+        errors += null_device->get_frame_stats().errors;
+    }
+
+    const kai::RenderFrameCounters unbatched_counters = device->get_frame_counters();
+
+    Float64 frames = static_cast<Float64>(frame_count);
+    Float64 glyphs_per_frame = static_cast<Float64>(glyph_count);
+    printf("%u lines of %u glyphs per frame, %u extra glyphs, %u pixel cells in a %u pixel atlas, %u frames\n\n", line_count,
+           COLUMNS, extra_count, cell_size, atlas_size, frame_count);
+
+    printf("Batched (TextBatch):\n");
+    printf("  frame ms            %.3f\n", to_ms(batched_ticks) / frames);
+    printf("  adding text ms      %.3f (%.2f ns per glyph)\n", to_ms(add_ticks) / frames,
+           to_ms(add_ticks) * 1e6 / (frames * glyphs_per_frame));
+    printf("  end() ms            %.3f\n", to_ms(end_ticks) / frames);
+    printf("  glyphs              %u (%u dropped)\n", glyph_count, dropped_count);
+    printf("  cache misses        %.1f per frame (%.1f evictions)\n", static_cast<Float64>(misses) / frames,
+           static_cast<Float64>(evictions) / frames);
+    printf("  draw calls          %u\n", batched_counters.draws);
+    printf("  bytes updated       %u buffer, %u texture\n\n", batched_counters.buffer_bytes_updated,
+           batched_counters.texture_bytes_updated);
+
+    printf("One texture and draw per glyph:\n");
+    printf("  frame ms            %.3f\n", to_ms(unbatched_ticks) / frames);
+    printf("  draw calls          %u\n", unbatched_counters.draws);
+    printf("  texture binds       %u\n", unbatched_counters.texture_binds);
+    printf("  encoded bytes       %u\n", unbatched_counters.command_bytes);
+
+    int retval = check_edge_cases() ? -1 : 0;
+    if(errors > 0) {
+        printf("Error: the null device found %u invalid commands!\n", errors);
+        retval = -1;
+    }
+
+    if(dropped_count > 0) {
+        printf("Error: %u glyphs were dropped, the atlas is too small for the glyphs of a frame!\n", dropped_count);
+        retval = -1;
+    }
+
+    if(mismatches > 0) {
+        printf("Error: %u glyphs don't match their quads or their pixels in the atlas!\n", mismatches);
+        retval = -1;
+    }
+
+    if(draw_count != 1 || batched_counters.draws != 1) {
+        printf("Error: the text took %u draws instead of one!\n", batched_counters.draws);
+        retval = -1;
+    }
+
+    free(quads);
+    free(text);
+    buffer.destroy();
+    text_batch.destroy();
+    device->destroy_buffer(quad_buffer);
+    device->destroy_buffer(index_buffer);
+    device->destroy_render_pipeline(pipeline);
+
+    for(Uint32 i = 0; i < font->glyphs.count; i++) {
+        if(glyph_textures[i].handle) {
+            device->destroy_texture(glyph_textures[i]);
+        }
+    }
+
+    free(glyph_textures);
+    free(font);
+
+    destroy_renderer();
+    engine_memory.destroy();
+    MemoryManager::destroy();
+
+    return retval;
+}
@@ -0,0 +1,1196 @@
+#include "block_compress.h"
+
+#include <emmintrin.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+
+#define BLOCK_PIXELS 16
+#define MAX_THREADS 64
+#define BC7_PARTITION_CANDIDATES 2 // Of mode 1 that are fully encoded, the ones whose subsets fit a line best
+#define BC7_MODE1_MIN_ERROR 64.0f // The squared error of mode 6 over a block below which mode 1 isn't tried
+
+// The pixels of a block, a channel after another so that 4 pixels fit into an SSE register
+struct BlockPixels {
+    alignas(16) Float32 channels[4][BLOCK_PIXELS]; // RGBA from 0 to 255
+};
+
+// The colors that the indices of a block pick from
+struct Palette {
+    Float32 colors[16][4];
+    Uint32 count;
+};
+
+// The fields of a bc7 block are packed from its lowest bit on
+struct BlockWriter {
+    Uint8 bytes[16] = {};
+    Uint32 position = 0;
+
+    void write(Uint32 value, Uint32 bit_count) {
+        for(Uint32 i = 0; i < bit_count; i++, position++) {
+            bytes[position >> 3] |= static_cast<Uint8>(((value >> i) & 1) << (position & 7));
+        }
+    }
+};
+
+struct BlockReader {
+    const Uint8 *bytes;
+    Uint32 position = 0;
+
+    Uint32 read(Uint32 bit_count) {
+        Uint32 value = 0;
+        for(Uint32 i = 0; i < bit_count; i++, position++) {
+            value |= ((bytes[position >> 3] >> (position & 7)) & 1u) << i;
+        }
+
+        return value;
+    }
+};
+
+static const Float32 bc1_weights[2][4] = {
+    { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f }, // 4 colors
+    { 0.0f, 1.0f, 0.5f, 0.0f } // 3 colors and transparent black
+};
+
+static const Float32 bc4_weights[2][8] = {
+    { 0.0f, 1.0f, 1.0f / 7.0f, 2.0f / 7.0f, 3.0f / 7.0f, 4.0f / 7.0f, 5.0f / 7.0f, 6.0f / 7.0f }, // 8 values
+    { 0.0f, 1.0f, 1.0f / 5.0f, 2.0f / 5.0f, 3.0f / 5.0f, 4.0f / 5.0f, 0.0f, 0.0f } // 6 values, 0 and 255
+};
+
+static const Uint32 bc7_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const Uint32 bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// The partitions of the bc7 modes with 2 subsets, bit i is set for the pixels of the second subset
+static const Uint16 bc7_partitions2[64] = {
+    0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80, 0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+    0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce, 0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+    0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a, 0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+    0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c, 0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22
+};
+
+// The pixel of the second subset whose index has its highest bit left out, like pixel 0 for the first subset
+static const Uint8 bc7_anchors2[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+    15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+    6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15
+};
+
+static Uint32 get_block_bytes(kai::RenderFormat format) {
+    switch(format) {
+        case kai::RenderFormat::bc1_unorm:
+        case kai::RenderFormat::bc4_unorm:
+            return 8;
+        case kai::RenderFormat::bc3_unorm:
+        case kai::RenderFormat::bc5_unorm:
+        case kai::RenderFormat::bc7_unorm:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+bool is_compressed_format(kai::RenderFormat format) {
+    return get_block_bytes(format) != 0;
+}
+
+Uint64 get_compressed_size(kai::RenderFormat format, Uint32 width, Uint32 height) {
+    return static_cast<Uint64>((width + 3) / 4) * ((height + 3) / 4) * get_block_bytes(format);
+}
+
+static Uint32 to_byte(Float32 value) {
+    kai::clamp(value, 0.0f, 255.0f);
+    return static_cast<Uint32>(value + 0.5f);
+}
+
+// Picks the closest color of the palette for every pixel, over the channels from 'first_channel' on. Returns the sum
+// of the squared errors of the pixels, the error of every pixel goes into 'out_errors' unless it's null
+template<Uint32 channel_count>
+static Float32 find_indices(const BlockPixels &block, Uint32 first_channel, const Palette &palette, Uint8 *out_indices,
+                            Float32 *out_errors) {
+    __m128 total = _mm_setzero_ps();
+
+    for(Uint32 group = 0; group < BLOCK_PIXELS; group += 4) {
+        __m128 pixel[channel_count];
+        for(Uint32 c = 0; c < channel_count; c++) {
+            pixel[c] = _mm_load_ps(&block.channels[first_channel + c][group]);
+        }
+
+        __m128 best = _mm_set1_ps(FLT_MAX);
+        __m128 best_index = _mm_setzero_ps();
+
+        for(Uint32 i = 0; i < palette.count; i++) {
+            __m128 error = _mm_setzero_ps();
+            for(Uint32 c = 0; c < channel_count; c++) {
+                __m128 difference = _mm_sub_ps(pixel[c], _mm_set1_ps(palette.colors[i][first_channel + c]));
+                error = _mm_add_ps(error, _mm_mul_ps(difference, difference));
+            }
+
+            __m128 closer = _mm_cmplt_ps(error, best);
+            best = _mm_min_ps(error, best);
+            best_index = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps(static_cast<Float32>(i))), _mm_andnot_ps(closer, best_index));
+        }
+
+        alignas(16) Int32 indices[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(indices), _mm_cvttps_epi32(best_index));
+
+        for(Uint32 i = 0; i < 4; i++) {
+            out_indices[group + i] = static_cast<Uint8>(indices[i]);
+        }
+
+        if(out_errors) {
+            _mm_storeu_ps(out_errors + group, best);
+        }
+
+        total = _mm_add_ps(total, best);
+    }
+
+    alignas(16) Float32 sums[4];
+    _mm_store_ps(sums, total);
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+static Float32 sum_errors(const Float32 *errors, Uint32 mask) {
+    Float32 sum = 0.0f;
+    for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+        sum += (mask & (1u << i)) ? errors[i] : 0.0f;
+    }
+
+    return sum;
+}
+
+// The ends of the line through the pixels of 'mask' along their principal axis, just far enough apart to cover all of
+// them. Both ends are the same for a single color
+template<Uint32 channel_count>
+static void fit_line(const BlockPixels &block, Uint32 mask, Float32 *out_start, Float32 *out_end) {
+    // The pixels that aren't in 'mask' are weighed by 0 rather than skipped, the masks of the partitions are too
+    // random for a branch
+    Float32 in_mask[BLOCK_PIXELS];
+    Float32 count = 0.0f;
+
+    for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+        in_mask[i] = static_cast<Float32>((mask >> i) & 1);
+        count += in_mask[i];
+    }
+
+    Float32 mean[channel_count] = {};
+    for(Uint32 c = 0; c < channel_count; c++) {
+        for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+            mean[c] += block.channels[c][i] * in_mask[i];
+        }
+
+        mean[c] = (count > 0.0f) ? mean[c] / count : 0.0f;
+        out_start[c] = mean[c];
+        out_end[c] = mean[c];
+    }
+
+    Float32 offsets[channel_count][BLOCK_PIXELS];
+    for(Uint32 c = 0; c < channel_count; c++) {
+        for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+            offsets[c][i] = (block.channels[c][i] - mean[c]) * in_mask[i];
+        }
+    }
+
+    Float32 covariance[channel_count][channel_count] = {};
+    for(Uint32 a = 0; a < channel_count; a++) {
+        for(Uint32 b = a; b < channel_count; b++) {
+            for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+                covariance[a][b] += offsets[a][i] * offsets[b][i];
+            }
+
+            covariance[b][a] = covariance[a][b];
+        }
+    }
+
+    // Power iteration, starting from the channel with the most spread
+    Uint32 widest = 0;
+    for(Uint32 c = 1; c < channel_count; c++) {
+        widest = (covariance[c][c] > covariance[widest][widest]) ? c : widest;
+    }
+
+    if(covariance[widest][widest] <= 0.0f) {
+        return;
+    }
+
+    Float32 axis[channel_count];
+    for(Uint32 c = 0; c < channel_count; c++) {
+        axis[c] = covariance[widest][c];
+    }
+
+    for(Uint32 iteration = 0; iteration < 8; iteration++) {
+        Float32 next[channel_count] = {};
+        Float32 largest = 0.0f;
+
+        for(Uint32 a = 0; a < channel_count; a++) {
+            for(Uint32 b = 0; b < channel_count; b++) {
+                next[a] += covariance[a][b] * axis[b];
+            }
+
+            largest = kai::max(largest, fabsf(next[a]));
+        }
+
+        if(largest <= 0.0f) {
+            break;
+        }
+
+        for(Uint32 c = 0; c < channel_count; c++) {
+            axis[c] = next[c] / largest;
+        }
+    }
+
+    Float32 length = 0.0f;
+    for(Uint32 c = 0; c < channel_count; c++) {
+        length += axis[c] * axis[c];
+    }
+
+    length = sqrtf(length);
+    if(length <= 0.0f) {
+        return;
+    }
+
+    for(Uint32 c = 0; c < channel_count; c++) {
+        axis[c] /= length;
+    }
+
+    Float32 low = FLT_MAX;
+    Float32 high = -FLT_MAX;
+
+    for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+        Float32 t = 0.0f;
+        for(Uint32 c = 0; c < channel_count; c++) {
+            t += offsets[c][i] * axis[c];
+        }
+
+        low = in_mask[i] ? kai::min(low, t) : low;
+        high = in_mask[i] ? kai::max(high, t) : high;
+    }
+
+    for(Uint32 c = 0; c < channel_count; c++) {
+        out_start[c] = mean[c] + axis[c] * low;
+        out_end[c] = mean[c] + axis[c] * high;
+        kai::clamp(out_start[c], 0.0f, 255.0f);
+        kai::clamp(out_end[c], 0.0f, 255.0f);
+    }
+}
+
+// Moves the ends of the line so that the colors that the pixels of 'mask' picked get as close to the pixels as they
+// can, 'weights' is how far along the line the color of every index is. Keeps the ends if all of them picked the same
+template<Uint32 channel_count>
+static void refine_line(const BlockPixels &block, Uint32 first_channel, Uint32 mask, const Uint8 *indices,
+                        const Float32 *weights, Float32 *start, Float32 *end) {
+    Float32 aa = 0.0f;
+    Float32 ab = 0.0f;
+    Float32 bb = 0.0f;
+    Float32 ax[channel_count] = {};
+    Float32 bx[channel_count] = {};
+
+    for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+        // Weighed by 0 outside of 'mask' like in fit_line()
+        Float32 in_mask = static_cast<Float32>((mask >> i) & 1);
+        Float32 b = weights[indices[i]] * in_mask;
+        Float32 a = in_mask - b;
+
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+
+        for(Uint32 c = 0; c < channel_count; c++) {
+            ax[c] += a * block.channels[first_channel + c][i];
+            bx[c] += b * block.channels[first_channel + c][i];
+        }
+    }
+
+    Float32 determinant = aa * bb - ab * ab;
+    if(determinant < 1e-3f) {
+        return;
+    }
+
+    for(Uint32 c = 0; c < channel_count; c++) {
+        start[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+        end[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+        kai::clamp(start[c], 0.0f, 255.0f);
+        kai::clamp(end[c], 0.0f, 255.0f);
+    }
+}
+
+// ----- bc1 ----- //
+static Uint16 to_565(const Float32 *color) {
+    Uint32 r = (to_byte(color[0]) * 31 + 127) / 255;
+    Uint32 g = (to_byte(color[1]) * 63 + 127) / 255;
+    Uint32 b = (to_byte(color[2]) * 31 + 127) / 255;
+    return static_cast<Uint16>((r << 11) | (g << 5) | b);
+}
+
+static void from_565(Uint32 value, Uint32 *out_color) {
+    Uint32 r = (value >> 11) & 31;
+    Uint32 g = (value >> 5) & 63;
+    Uint32 b = value & 31;
+
+    out_color[0] = (r << 3) | (r >> 2);
+    out_color[1] = (g << 2) | (g >> 4);
+    out_color[2] = (b << 3) | (b >> 2);
+}
+
+// 4 colors between the endpoints, or 3 of them and transparent black
+static void get_bc1_colors(Uint32 c0, Uint32 c1, bool four_colors, Uint32 (*out_colors)[4]) {
+    from_565(c0, out_colors[0]);
+    from_565(c1, out_colors[1]);
+
+    for(Uint32 c = 0; c < 3; c++) {
+        Uint32 a = out_colors[0][c];
+        Uint32 b = out_colors[1][c];
+
+        out_colors[2][c] = four_colors ? (2 * a + b + 1) / 3 : (a + b + 1) / 2;
+        out_colors[3][c] = four_colors ? (a + 2 * b + 1) / 3 : 0;
+    }
+
+    out_colors[0][3] = 255;
+    out_colors[1][3] = 255;
+    out_colors[2][3] = 255;
+    out_colors[3][3] = four_colors ? 255 : 0;
+}
+
+// Without 'allow_transparent' the block always has 4 colors, like the color block of bc3
+static void encode_bc1(const BlockPixels &block, bool allow_transparent, Uint8 *out_block) {
+    Uint32 transparent = 0;
+    for(Uint32 i = 0; allow_transparent && i < BLOCK_PIXELS; i++) {
+        transparent |= (block.channels[3][i] < 128.0f) ? (1u << i) : 0;
+    }
+
+    Uint32 opaque = ~transparent & 0xffff;
+    bool four_colors = transparent == 0;
+
+    Uint32 c0 = 0;
+    Uint32 c1 = 0;
+    Uint8 indices[BLOCK_PIXELS] = {};
+
+    if(opaque) {
+        Float32 start[3];
+        Float32 end[3];
+        fit_line<3>(block, opaque, start, end);
+
+        Float32 best_error = FLT_MAX;
+        for(Uint32 iteration = 0; iteration < 3; iteration++) {
+            Uint32 candidate0 = to_565(start);
+            Uint32 candidate1 = to_565(end);
+            Uint32 colors[4][4];
+            get_bc1_colors(candidate0, candidate1, four_colors, colors);
+
+            Palette palette;
+            palette.count = four_colors ? 4 : 3;
+            for(Uint32 i = 0; i < palette.count; i++) {
+                for(Uint32 c = 0; c < 4; c++) {
+                    palette.colors[i][c] = static_cast<Float32>(colors[i][c]);
+                }
+            }
+
+            Uint8 candidate_indices[BLOCK_PIXELS];
+            Float32 errors[BLOCK_PIXELS];
+            find_indices<3>(block, 0, palette, candidate_indices, errors);
+
+            Float32 error = sum_errors(errors, opaque);
+            if(error < best_error) {
+                best_error = error;
+                c0 = candidate0;
+                c1 = candidate1;
+                memcpy(indices, candidate_indices, sizeof(indices));
+            }
+
+            if(error == 0.0f) {
+                break;
+            }
+
+            refine_line<3>(block, 0, opaque, candidate_indices, bc1_weights[four_colors ? 0 : 1], start, end);
+        }
+    }
+
+    // 4 colors need c0 > c1 and 3 colors c0 <= c1, swapping the endpoints swaps their indices
+    static const Uint8 swapped[2][4] = { { 1, 0, 3, 2 }, { 1, 0, 2, 3 } };
+    if(four_colors ? (c0 < c1) : (c0 > c1)) {
+        Uint32 temp = c0;
+        c0 = c1;
+        c1 = temp;
+
+        for(Uint8 &index : indices) {
+            index = swapped[four_colors ? 0 : 1][index];
+        }
+    }
+
+    // With the same endpoints it's a block of 3 colors, where index 3 would be transparent
+    if(four_colors && c0 == c1) {
+        memset(indices, 0, sizeof(indices));
+    }
+
+    Uint32 bits = 0;
+    for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+        bits |= static_cast<Uint32>((transparent & (1u << i)) ? 3 : indices[i]) << (i * 2);
+    }
+
+    out_block[0] = static_cast<Uint8>(c0);
+    out_block[1] = static_cast<Uint8>(c0 >> 8);
+    out_block[2] = static_cast<Uint8>(c1);
+    out_block[3] = static_cast<Uint8>(c1 >> 8);
+    memcpy(out_block + 4, &bits, sizeof(bits));
+}
+
+static void decode_bc1(const Uint8 *block, bool allow_transparent, Uint8 *out_pixels) {
+    Uint32 c0 = block[0] | (block[1] << 8);
+    Uint32 c1 = block[2] | (block[3] << 8);
+    Uint32 bits;
+    memcpy(&bits, block + 4, sizeof(bits));
+
+    Uint32 colors[4][4];
+    get_bc1_colors(c0, c1, !allow_transparent || c0 > c1, colors);
+
+    for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+        const Uint32 *color = colors[(bits >> (i * 2)) & 3];
+        for(Uint32 c = 0; c < 4; c++) {
+            out_pixels[i * 4 + c] = static_cast<Uint8>(color[c]);
+        }
+    }
+}
+
+// ----- bc4 ----- //
+// 8 values between the endpoints if the first one is larger, otherwise 6 of them and 0 and 255
+static void get_bc4_values(Uint32 a0, Uint32 a1, Float32 *out_values) {
+    bool eight_values = a0 > a1;
+    out_values[0] = static_cast<Float32>(a0);
+    out_values[1] = static_cast<Float32>(a1);
+
+    for(Uint32 i = 2; i < 8; i++) {
+        Float32 weight = bc4_weights[eight_values ? 0 : 1][i];
+        out_values[i] = (1.0f - weight) * static_cast<Float32>(a0) + weight * static_cast<Float32>(a1);
+    }
+
+    if(!eight_values) {
+        out_values[6] = 0.0f;
+        out_values[7] = 255.0f;
+    }
+}
+
+// Endpoints for either kind of block from 'start' and 'end', and the error and indices that they give
+static Float32 try_bc4_endpoints(const BlockPixels &block, Uint32 channel, bool eight_values, Float32 start, Float32 end,
+                                 Uint32 &out_a0, Uint32 &out_a1, Uint8 *out_indices) {
+    Uint32 a0 = to_byte(start);
+    Uint32 a1 = to_byte(end);
+
+    if(eight_values) {
+        if(a0 == a1) {
+            a0 = (a0 < 255) ? a0 + 1 : a0;
+            a1 = (a1 == 255) ? a1 - 1 : a1;
+        }
+
+        if(a0 < a1) {
+            Uint32 temp = a0;
+            a0 = a1;
+            a1 = temp;
+        }
+    } else if(a0 > a1) {
+        Uint32 temp = a0;
+        a0 = a1;
+        a1 = temp;
+    }
+
+    Float32 values[8];
+    get_bc4_values(a0, a1, values);
+
+    Palette palette;
+    palette.count = 8;
+    for(Uint32 i = 0; i < 8; i++) {
+        palette.colors[i][channel] = values[i];
+    }
+
+    out_a0 = a0;
+    out_a1 = a1;
+    return find_indices<1>(block, channel, palette, out_indices, nullptr);
+}
+
+static void encode_bc4(const BlockPixels &block, Uint32 channel, Uint8 *out_block) {
+    const Float32 *values = block.channels[channel];
+    Float32 low = 255.0f;
+    Float32 high = 0.0f;
+    Float32 inner_low = 255.0f; // Of the values that 0 and 255 don't cover in a block of 6 values
+    Float32 inner_high = 0.0f;
+
+    for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+        low = kai::min(low, values[i]);
+        high = kai::max(high, values[i]);
+
+        if(values[i] > 0.0f && values[i] < 255.0f) {
+            inner_low = kai::min(inner_low, values[i]);
+            inner_high = kai::max(inner_high, values[i]);
+        }
+    }
+
+    Uint32 a0 = to_byte(low);
+    Uint32 a1 = a0;
+    Uint8 indices[BLOCK_PIXELS] = {};
+    Float32 best_error = FLT_MAX;
+
+    if(to_byte(low) != to_byte(high)) {
+        for(Uint32 kind = 0; kind < 2; kind++) {
+            bool eight_values = kind == 0;
+            bool has_inner = inner_low <= inner_high;
+            Float32 start = eight_values ? high : (has_inner ? inner_low : 0.0f);
+            Float32 end = eight_values ? low : (has_inner ? inner_high : 0.0f);
+
+            for(Uint32 iteration = 0; iteration < 3; iteration++) {
+                Uint32 candidate0;
+                Uint32 candidate1;
+                Uint8 candidate_indices[BLOCK_PIXELS];
+                Float32 error = try_bc4_endpoints(block, channel, eight_values, start, end, candidate0, candidate1,
+                                                  candidate_indices);
+
+                if(error < best_error) {
+                    best_error = error;
+                    a0 = candidate0;
+                    a1 = candidate1;
+                    memcpy(indices, candidate_indices, sizeof(indices));
+                }
+
+                if(error == 0.0f) {
+                    break;
+                }
+
+                // The indices of 0 and 255 don't move with the endpoints
+                Uint32 mask = 0;
+                for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+                    mask |= (eight_values || candidate_indices[i] < 6) ? (1u << i) : 0;
+                }
+
+                start = static_cast<Float32>(candidate0);
+                end = static_cast<Float32>(candidate1);
+                refine_line<1>(block, channel, mask, candidate_indices, bc4_weights[kind], &start, &end);
+            }
+        }
+    }
+
+    Uint64 bits = 0;
+    for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+        bits |= static_cast<Uint64>(indices[i]) << (i * 3);
+    }
+
+    out_block[0] = static_cast<Uint8>(a0);
+    out_block[1] = static_cast<Uint8>(a1);
+    for(Uint32 i = 0; i < 6; i++) {
+        out_block[2 + i] = static_cast<Uint8>(bits >> (i * 8));
+    }
+}
+
+static void decode_bc4(const Uint8 *block, Uint32 channel, Uint8 *out_pixels) {
+    Float32 values[8];
+    get_bc4_values(block[0], block[1], values);
+
+    Uint64 bits = 0;
+    for(Uint32 i = 0; i < 6; i++) {
+        bits |= static_cast<Uint64>(block[2 + i]) << (i * 8);
+    }
+
+    for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+        out_pixels[i * 4 + channel] = static_cast<Uint8>(to_byte(values[(bits >> (i * 3)) & 7]));
+    }
+}
+
+// ----- bc7 ----- //
+static void get_bc7_colors(const Uint32 *e0, const Uint32 *e1, const Uint32 *weights, Uint32 count, Uint32 channel_count,
+                           Palette &out_palette) {
+    out_palette.count = count;
+    for(Uint32 i = 0; i < count; i++) {
+        for(Uint32 c = 0; c < channel_count; c++) {
+            out_palette.colors[i][c] = static_cast<Float32>(((64 - weights[i]) * e0[c] + weights[i] * e1[c] + 32) >> 6);
+        }
+    }
+}
+
+// Mode 6: a single subset of RGBA endpoints of 7 bits and a bit per endpoint that all of its channels share, 4 bit indices
+static Float32 encode_bc7_mode6(const BlockPixels &block, Uint8 *out_block) {
+    Float32 start[4];
+    Float32 end[4];
+    fit_line<4>(block, 0xffff, start, end);
+
+    Float32 weights[16];
+    for(Uint32 i = 0; i < 16; i++) {
+        weights[i] = static_cast<Float32>(bc7_weights4[i]) / 64.0f;
+    }
+
+    Float32 best_error = FLT_MAX;
+    Uint32 best_endpoints[2][4] = {};
+    Uint32 best_pbits[2] = {};
+    Uint8 best_indices[BLOCK_PIXELS] = {};
+
+    for(Uint32 iteration = 0; iteration < 3 && best_error > 0.0f; iteration++) {
+        // Every endpoint gets the bit that rounds it the closest, rather than trying all of the combinations
+        Uint32 endpoints[2][4];
+        Uint32 expanded[2][4];
+        Uint32 pbits[2];
+
+        for(Uint32 e = 0; e < 2; e++) {
+            const Float32 *ends = e ? end : start;
+            Uint32 rounded[2][4];
+            Float32 errors[2] = {};
+
+            for(Uint32 pbit = 0; pbit < 2; pbit++) {
+                for(Uint32 c = 0; c < 4; c++) {
+                    Float32 value = (ends[c] - static_cast<Float32>(pbit)) * 0.5f;
+                    kai::clamp(value, 0.0f, 127.0f);
+
+                    rounded[pbit][c] = static_cast<Uint32>(value + 0.5f);
+                    Float32 difference = ends[c] - static_cast<Float32>((rounded[pbit][c] << 1) | pbit);
+                    errors[pbit] += difference * difference;
+                }
+            }
+
+            pbits[e] = (errors[1] < errors[0]) ? 1 : 0;
+            for(Uint32 c = 0; c < 4; c++) {
+                endpoints[e][c] = rounded[pbits[e]][c];
+                expanded[e][c] = (endpoints[e][c] << 1) | pbits[e];
+            }
+        }
+
+        Palette palette;
+        get_bc7_colors(expanded[0], expanded[1], bc7_weights4, 16, 4, palette);
+
+        Uint8 indices[BLOCK_PIXELS];
+        Float32 error = find_indices<4>(block, 0, palette, indices, nullptr);
+
+        if(error < best_error) {
+            best_error = error;
+            memcpy(best_endpoints, endpoints, sizeof(endpoints));
+            memcpy(best_pbits, pbits, sizeof(pbits));
+            memcpy(best_indices, indices, sizeof(indices));
+        }
+
+        refine_line<4>(block, 0, 0xffff, best_indices, weights, start, end);
+    }
+
+    // The highest bit of the index of pixel 0 is left out, so it has to be in the first half
+    if(best_indices[0] >= 8) {
+        for(Uint32 c = 0; c < 4; c++) {
+            Uint32 temp = best_endpoints[0][c];
+            best_endpoints[0][c] = best_endpoints[1][c];
+            best_endpoints[1][c] = temp;
+        }
+
+        Uint32 temp = best_pbits[0];
+        best_pbits[0] = best_pbits[1];
+        best_pbits[1] = temp;
+
+        for(Uint8 &index : best_indices) {
+            index = static_cast<Uint8>(15 - index);
+        }
+    }
+
+    BlockWriter writer;
+    writer.write(1u << 6, 7);
+
+    for(Uint32 c = 0; c < 4; c++) {
+        writer.write(best_endpoints[0][c], 7);
+        writer.write(best_endpoints[1][c], 7);
+    }
+
+    writer.write(best_pbits[0], 1);
+    writer.write(best_pbits[1], 1);
+
+    for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+        writer.write(best_indices[i], (i == 0) ? 3 : 4);
+    }
+
+    memcpy(out_block, writer.bytes, sizeof(writer.bytes));
+    return best_error;
+}
+
+// How far the pixels of a subset are from the line through them, the variance that their principal axis leaves out,
+// for 4 subsets at a time. 'moments' are the sums of R, G, B, RR, RG, RB, GG, GB, BB and the count of the pixels of
+// every subset. The axis is a step of power iteration away from the sums of the rows of the covariance, a quick
+// estimate of how well a subset of a partition can be encoded
+static __m128 get_line_residuals(const __m128 *moments) {
+    __m128 count = moments[9];
+    __m128 inverse_count = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(count, _mm_set1_ps(1.0f)));
+
+    __m128 mean[3];
+    for(Uint32 c = 0; c < 3; c++) {
+        mean[c] = _mm_mul_ps(moments[c], inverse_count);
+    }
+
+    __m128 rr = _mm_sub_ps(_mm_mul_ps(moments[3], inverse_count), _mm_mul_ps(mean[0], mean[0]));
+    __m128 rg = _mm_sub_ps(_mm_mul_ps(moments[4], inverse_count), _mm_mul_ps(mean[0], mean[1]));
+    __m128 rb = _mm_sub_ps(_mm_mul_ps(moments[5], inverse_count), _mm_mul_ps(mean[0], mean[2]));
+    __m128 gg = _mm_sub_ps(_mm_mul_ps(moments[6], inverse_count), _mm_mul_ps(mean[1], mean[1]));
+    __m128 gb = _mm_sub_ps(_mm_mul_ps(moments[7], inverse_count), _mm_mul_ps(mean[1], mean[2]));
+    __m128 bb = _mm_sub_ps(_mm_mul_ps(moments[8], inverse_count), _mm_mul_ps(mean[2], mean[2]));
+
+    auto multiply = [&](const __m128 *v, __m128 *out) {
+        out[0] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rr, v[0]), _mm_mul_ps(rg, v[1])), _mm_mul_ps(rb, v[2]));
+        out[1] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rg, v[0]), _mm_mul_ps(gg, v[1])), _mm_mul_ps(gb, v[2]));
+        out[2] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rb, v[0]), _mm_mul_ps(gb, v[1])), _mm_mul_ps(bb, v[2]));
+    };
+
+    __m128 rows[3] = { _mm_add_ps(_mm_add_ps(rr, rg), rb), _mm_add_ps(_mm_add_ps(rg, gg), gb),
+                       _mm_add_ps(_mm_add_ps(rb, gb), bb) };
+    __m128 axis[3];
+    __m128 next[3];
+    multiply(rows, axis);
+    multiply(axis, next);
+
+    // The variance along the axis, its Rayleigh quotient
+    __m128 axis_length = _mm_add_ps(_mm_add_ps(_mm_mul_ps(axis[0], axis[0]), _mm_mul_ps(axis[1], axis[1])),
+                                    _mm_mul_ps(axis[2], axis[2]));
+    __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(axis[0], next[0]), _mm_mul_ps(axis[1], next[1])),
+                              _mm_mul_ps(axis[2], next[2]));
+    __m128 has_axis = _mm_cmpgt_ps(axis_length, _mm_setzero_ps());
+    __m128 largest = _mm_and_ps(has_axis, _mm_div_ps(along, _mm_max_ps(axis_length, _mm_set1_ps(FLT_MIN))));
+
+    __m128 variance = _mm_add_ps(_mm_add_ps(rr, gg), bb);
+    __m128 residual = _mm_mul_ps(_mm_max_ps(_mm_sub_ps(variance, largest), _mm_setzero_ps()), count);
+    return _mm_and_ps(_mm_cmpge_ps(count, _mm_set1_ps(2.0f)), residual);
+}
+
+// Mode 1: two subsets that the partition picks the pixels of, RGB endpoints of 6 bits and a bit that both endpoints of a
+// subset share, 3 bit indices. Alpha is always 255
+static Float32 encode_bc7_mode1(const BlockPixels &block, Uint8 *out_block) {
+    // The moments of every pixel and a 1 to count them. The ones of 4 partitions are summed at a time, a lane for
+    // every partition with the pixels that aren't in its second subset masked out, and the first subset is what's left
+    // of the whole block
+    Float32 moments[10][BLOCK_PIXELS];
+    Float32 block_moments[10] = {};
+
+    for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+        Float32 r = block.channels[0][i];
+        Float32 g = block.channels[1][i];
+        Float32 b = block.channels[2][i];
+
+        moments[0][i] = r;
+        moments[1][i] = g;
+        moments[2][i] = b;
+        moments[3][i] = r * r;
+        moments[4][i] = r * g;
+        moments[5][i] = r * b;
+        moments[6][i] = g * g;
+        moments[7][i] = g * b;
+        moments[8][i] = b * b;
+        moments[9][i] = 1.0f;
+
+        for(Uint32 s = 0; s < 10; s++) {
+            block_moments[s] += moments[s][i];
+        }
+    }
+
+    Uint32 candidates[BC7_PARTITION_CANDIDATES];
+    Float32 candidate_residuals[BC7_PARTITION_CANDIDATES];
+    for(Uint32 i = 0; i < BC7_PARTITION_CANDIDATES; i++) {
+        candidates[i] = i;
+        candidate_residuals[i] = FLT_MAX;
+    }
+
+    for(Uint32 first = 0; first < 64; first += 4) {
+        __m128i masks = _mm_set_epi32(bc7_partitions2[first + 3], bc7_partitions2[first + 2], bc7_partitions2[first + 1],
+                                      bc7_partitions2[first]);
+        __m128 subset_moments[2][10];
+        for(Uint32 s = 0; s < 10; s++) {
+            subset_moments[1][s] = _mm_setzero_ps();
+        }
+
+        for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+            __m128i bit = _mm_set1_epi32(1 << i);
+            __m128 lanes = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(masks, bit), bit));
+
+            for(Uint32 s = 0; s < 10; s++) {
+                subset_moments[1][s] = _mm_add_ps(subset_moments[1][s], _mm_and_ps(lanes, _mm_set1_ps(moments[s][i])));
+            }
+        }
+
+        for(Uint32 s = 0; s < 10; s++) {
+            subset_moments[0][s] = _mm_sub_ps(_mm_set1_ps(block_moments[s]), subset_moments[1][s]);
+        }
+
+        alignas(16) Float32 residuals[4];
+        _mm_store_ps(residuals, _mm_add_ps(get_line_residuals(subset_moments[0]), get_line_residuals(subset_moments[1])));
+
+        for(Uint32 lane = 0; lane < 4; lane++) {
+            Uint32 p = first + lane;
+            Float32 residual = residuals[lane];
+
+            // Keeps the candidates sorted from the best
+            for(Uint32 i = 0; i < BC7_PARTITION_CANDIDATES; i++) {
+                if(residual < candidate_residuals[i]) {
+                    for(Uint32 j = BC7_PARTITION_CANDIDATES - 1; j > i; j--) {
+                        candidates[j] = candidates[j - 1];
+                        candidate_residuals[j] = candidate_residuals[j - 1];
+                    }
+
+                    candidates[i] = p;
+                    candidate_residuals[i] = residual;
+                    break;
+                }
+            }
+        }
+    }
+
+    Float32 weights[8];
+    for(Uint32 i = 0; i < 8; i++) {
+        weights[i] = static_cast<Float32>(bc7_weights3[i]) / 64.0f;
+    }
+
+    Float32 best_error = FLT_MAX;
+    Uint32 best_partition = 0;
+    Uint32 best_endpoints[2][2][3] = {}; // Of every subset
+    Uint32 best_pbits[2] = {};
+    Uint8 best_indices[BLOCK_PIXELS] = {};
+
+    for(Uint32 candidate = 0; candidate < BC7_PARTITION_CANDIDATES; candidate++) {
+        Uint32 partition = candidates[candidate];
+        Float32 error = 0.0f;
+        Uint32 endpoints[2][2][3] = {};
+        Uint32 pbits[2] = {};
+        Uint8 indices[BLOCK_PIXELS] = {};
+
+        for(Uint32 subset = 0; subset < 2 && error < best_error; subset++) {
+            Uint32 mask = subset ? bc7_partitions2[partition] : (~bc7_partitions2[partition] & 0xffff);
+            Float32 start[3];
+            Float32 end[3];
+            fit_line<3>(block, mask, start, end);
+
+            Float32 subset_error = FLT_MAX;
+            Uint8 subset_indices[BLOCK_PIXELS] = {};
+
+            for(Uint32 iteration = 0; iteration < 3 && subset_error > 0.0f; iteration++) {
+                // Like mode 6 the bit that rounds the endpoints the closest, both of them share it here
+                Uint32 rounded[2][2][3];
+                Float32 rounding_errors[2] = {};
+
+                for(Uint32 pbit = 0; pbit < 2; pbit++) {
+                    for(Uint32 c = 0; c < 3; c++) {
+                        Float32 ends[2] = { start[c] * (127.0f / 255.0f), end[c] * (127.0f / 255.0f) };
+                        for(Uint32 e = 0; e < 2; e++) {
+                            Float32 value = (ends[e] - static_cast<Float32>(pbit)) * 0.5f;
+                            kai::clamp(value, 0.0f, 63.0f);
+
+                            rounded[pbit][e][c] = static_cast<Uint32>(value + 0.5f);
+                            Float32 difference = ends[e] - static_cast<Float32>((rounded[pbit][e][c] << 1) | pbit);
+                            rounding_errors[pbit] += difference * difference;
+                        }
+                    }
+                }
+
+                Uint32 pbit = (rounding_errors[1] < rounding_errors[0]) ? 1 : 0;
+                Uint32 expanded[2][3];
+
+                for(Uint32 e = 0; e < 2; e++) {
+                    for(Uint32 c = 0; c < 3; c++) {
+                        Uint32 bits7 = (rounded[pbit][e][c] << 1) | pbit;
+                        expanded[e][c] = (bits7 << 1) | (bits7 >> 6);
+                    }
+                }
+
+                Palette palette;
+                get_bc7_colors(expanded[0], expanded[1], bc7_weights3, 8, 3, palette);
+
+                Uint8 candidate_indices[BLOCK_PIXELS];
+                Float32 errors[BLOCK_PIXELS];
+                find_indices<3>(block, 0, palette, candidate_indices, errors);
+
+                Float32 candidate_error = sum_errors(errors, mask);
+                if(candidate_error < subset_error) {
+                    subset_error = candidate_error;
+                    memcpy(endpoints[subset], rounded[pbit], sizeof(rounded[pbit]));
+                    pbits[subset] = pbit;
+                    memcpy(subset_indices, candidate_indices, sizeof(subset_indices));
+                }
+
+                refine_line<3>(block, 0, mask, subset_indices, weights, start, end);
+            }
+
+            for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+                indices[i] = (mask & (1u << i)) ? subset_indices[i] : indices[i];
+            }
+
+            error += subset_error;
+        }
+
+        if(error < best_error) {
+            best_error = error;
+            best_partition = partition;
+            memcpy(best_endpoints, endpoints, sizeof(endpoints));
+            memcpy(best_pbits, pbits, sizeof(pbits));
+            memcpy(best_indices, indices, sizeof(indices));
+        }
+    }
+
+    // Like mode 6, the anchor of every subset needs an index in the first half
+    Uint32 anchors[2] = { 0, bc7_anchors2[best_partition] };
+    for(Uint32 subset = 0; subset < 2; subset++) {
+        if(best_indices[anchors[subset]] < 4) {
+            continue;
+        }
+
+        for(Uint32 c = 0; c < 3; c++) {
+            Uint32 temp = best_endpoints[subset][0][c];
+            best_endpoints[subset][0][c] = best_endpoints[subset][1][c];
+            best_endpoints[subset][1][c] = temp;
+        }
+
+        Uint32 mask = subset ? bc7_partitions2[best_partition] : (~bc7_partitions2[best_partition] & 0xffff);
+        for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+            best_indices[i] = (mask & (1u << i)) ? static_cast<Uint8>(7 - best_indices[i]) : best_indices[i];
+        }
+    }
+
+    BlockWriter writer;
+    writer.write(1u << 1, 2);
+    writer.write(best_partition, 6);
+
+    for(Uint32 c = 0; c < 3; c++) {
+        for(Uint32 subset = 0; subset < 2; subset++) {
+            writer.write(best_endpoints[subset][0][c], 6);
+            writer.write(best_endpoints[subset][1][c], 6);
+        }
+    }
+
+    writer.write(best_pbits[0], 1);
+    writer.write(best_pbits[1], 1);
+
+    for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+        writer.write(best_indices[i], (i == anchors[0] || i == anchors[1]) ? 2 : 3);
+    }
+
+    memcpy(out_block, writer.bytes, sizeof(writer.bytes));
+    return best_error;
+}
+
+// Mode 6 for every block, and mode 1 for the opaque ones that it fits better. Mode 1 takes most of the time, so blocks
+// that mode 6 already gets close to skip it
+static void encode_bc7(const BlockPixels &block, Uint8 *out_block) {
+    Float32 error = encode_bc7_mode6(block, out_block);
+
+    bool opaque = true;
+    for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+        opaque = opaque && block.channels[3][i] == 255.0f;
+    }
+
+    if(opaque && error > BC7_MODE1_MIN_ERROR) {
+        Uint8 mode1_block[16];
+        if(encode_bc7_mode1(block, mode1_block) < error) {
+            memcpy(out_block, mode1_block, sizeof(mode1_block));
+        }
+    }
+}
+
+static bool decode_bc7(const Uint8 *block, Uint8 *out_pixels) {
+    BlockReader reader = { block };
+    Uint32 mode = 0;
+    while(mode < 8 && !reader.read(1)) {
+        mode++;
+    }
+
+    if(mode == 6) {
+        Uint32 endpoints[2][4];
+        for(Uint32 c = 0; c < 4; c++) {
+            endpoints[0][c] = reader.read(7) << 1;
+            endpoints[1][c] = reader.read(7) << 1;
+        }
+
+        Uint32 pbits[2] = { reader.read(1), reader.read(1) };
+        for(Uint32 c = 0; c < 4; c++) {
+            endpoints[0][c] |= pbits[0];
+            endpoints[1][c] |= pbits[1];
+        }
+
+        Palette palette;
+        get_bc7_colors(endpoints[0], endpoints[1], bc7_weights4, 16, 4, palette);
+
+        for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+            const Float32 *color = palette.colors[reader.read((i == 0) ? 3 : 4)];
+            for(Uint32 c = 0; c < 4; c++) {
+                out_pixels[i * 4 + c] = static_cast<Uint8>(color[c]);
+            }
+        }
+
+        return true;
+    }
+
+    if(mode == 1) {
+        Uint32 partition = reader.read(6);
+        Uint32 endpoints[2][2][3];
+
+        for(Uint32 c = 0; c < 3; c++) {
+            for(Uint32 subset = 0; subset < 2; subset++) {
+                endpoints[subset][0][c] = reader.read(6);
+                endpoints[subset][1][c] = reader.read(6);
+            }
+        }
+
+        Palette palettes[2];
+        for(Uint32 subset = 0; subset < 2; subset++) {
+            Uint32 pbit = reader.read(1);
+            for(Uint32 e = 0; e < 2; e++) {
+                for(Uint32 c = 0; c < 3; c++) {
+                    Uint32 bits7 = (endpoints[subset][e][c] << 1) | pbit;
+                    endpoints[subset][e][c] = (bits7 << 1) | (bits7 >> 6);
+                }
+            }
+
+            get_bc7_colors(endpoints[subset][0], endpoints[subset][1], bc7_weights3, 8, 3, palettes[subset]);
+        }
+
+        for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+            Uint32 subset = (bc7_partitions2[partition] >> i) & 1;
+            bool anchor = i == 0 || i == bc7_anchors2[partition];
+            const Float32 *color = palettes[subset].colors[reader.read(anchor ? 2 : 3)];
+
+            for(Uint32 c = 0; c < 3; c++) {
+                out_pixels[i * 4 + c] = static_cast<Uint8>(color[c]);
+            }
+
+            out_pixels[i * 4 + 3] = 255;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+// ----- Images ----- //
+static void encode_block(kai::RenderFormat format, const BlockPixels &block, Uint8 *out_block) {
+    switch(format) {
+        case kai::RenderFormat::bc1_unorm:
+            encode_bc1(block, true, out_block);
+            break;
+        case kai::RenderFormat::bc3_unorm:
+            encode_bc4(block, 3, out_block);
+            encode_bc1(block, false, out_block + 8);
+            break;
+        case kai::RenderFormat::bc4_unorm:
+            encode_bc4(block, 0, out_block);
+            break;
+        case kai::RenderFormat::bc5_unorm:
+            encode_bc4(block, 0, out_block);
+            encode_bc4(block, 1, out_block + 8);
+            break;
+        case kai::RenderFormat::bc7_unorm:
+            encode_bc7(block, out_block);
+            break;
+        default:
+            break;
+    }
+}
+
+struct CompressJob {
+    kai::RenderFormat format;
+    const Uint8 *pixels;
+    Uint32 width;
+    Uint32 height;
+    Uint8 *blocks;
+    std::atomic<Uint32> next_row; // Of blocks, that the threads take one at a time
+};
+
+static void compress_rows(CompressJob *job) {
+    Uint32 blocks_x = (job->width + 3) / 4;
+    Uint32 blocks_y = (job->height + 3) / 4;
+    Uint32 block_bytes = get_block_bytes(job->format);
+    Uint32 row;
+
+    while((row = job->next_row.fetch_add(1, std::memory_order_relaxed)) < blocks_y) {
+        for(Uint32 block_x = 0; block_x < blocks_x; block_x++) {
+            BlockPixels block;
+
+            for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+                Uint32 x = kai::min(block_x * 4 + (i & 3), job->width - 1);
+                Uint32 y = kai::min(row * 4 + (i >> 2), job->height - 1);
+                const Uint8 *pixel = job->pixels + (static_cast<size_t>(y) * job->width + x) * 4;
+
+                for(Uint32 c = 0; c < 4; c++) {
+                    block.channels[c][i] = static_cast<Float32>(pixel[c]);
+                }
+            }
+
+            encode_block(job->format, block, job->blocks + (static_cast<size_t>(row) * blocks_x + block_x) * block_bytes);
+        }
+    }
+}
+
+void compress_image(kai::RenderFormat format, const Uint8 *pixels, Uint32 width, Uint32 height, Uint32 thread_count,
+                    Uint8 *out_blocks) {
+    CompressJob job;
+    job.format = format;
+    job.pixels = pixels;
+    job.width = width;
+    job.height = height;
+    job.blocks = out_blocks;
+    job.next_row.store(0, std::memory_order_relaxed);
+
+    kai::clamp(thread_count, 1u, kai::min(static_cast<Uint32>(MAX_THREADS), (height + 3) / 4));
+
+    std::thread threads[MAX_THREADS];
+    for(Uint32 i = 1; i < thread_count; i++) {
+        threads[i] = std::thread(compress_rows, &job);
+    }
+
+    compress_rows(&job);
+
+    for(Uint32 i = 1; i < thread_count; i++) {
+        threads[i].join();
+    }
+}
+
+bool decompress_image(kai::RenderFormat format, const Uint8 *blocks, Uint32 width, Uint32 height, Uint8 *out_pixels) {
+    Uint32 blocks_x = (width + 3) / 4;
+    Uint32 blocks_y = (height + 3) / 4;
+    Uint32 block_bytes = get_block_bytes(format);
+
+    if(!block_bytes) {
+        return false;
+    }
+
+    for(Uint32 block_y = 0; block_y < blocks_y; block_y++) {
+        for(Uint32 block_x = 0; block_x < blocks_x; block_x++) {
+            const Uint8 *block = blocks + (static_cast<size_t>(block_y) * blocks_x + block_x) * block_bytes;
+            Uint8 pixels[BLOCK_PIXELS * 4];
+
+            for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+                pixels[i * 4 + 0] = 0;
+                pixels[i * 4 + 1] = 0;
+                pixels[i * 4 + 2] = 0;
+                pixels[i * 4 + 3] = 255;
+            }
+
+            switch(format) {
+                case kai::RenderFormat::bc1_unorm:
+                    decode_bc1(block, true, pixels);
+                    break;
+                case kai::RenderFormat::bc3_unorm:
+                    decode_bc1(block + 8, false, pixels);
+                    decode_bc4(block, 3, pixels);
+                    break;
+                case kai::RenderFormat::bc4_unorm:
+                    decode_bc4(block, 0, pixels);
+                    break;
+                case kai::RenderFormat::bc5_unorm:
+                    decode_bc4(block, 0, pixels);
+                    decode_bc4(block + 8, 1, pixels);
+                    break;
+                case kai::RenderFormat::bc7_unorm:
+                    if(!decode_bc7(block, pixels)) {
+                        return false;
+                    }
+                    break;
+                default:
+                    return false;
+            }
+
+            for(Uint32 i = 0; i < BLOCK_PIXELS; i++) {
+                Uint32 x = block_x * 4 + (i & 3);
+                Uint32 y = block_y * 4 + (i >> 2);
+
+                if(x < width && y < height) {
+                    memcpy(out_pixels + (static_cast<size_t>(y) * width + x) * 4, pixels + i * 4, 4);
+                }
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,38 @@
+// Encoders and decoders for the block-compressed texture formats (RenderFormat::bc1_unorm and the ones after it). The
+// pixels are stored in blocks of 4x4, every block has a few endpoint colors and an index per pixel that picks one of
+// the colors in between them:
+//
+//   bc1  RGB and 1 bit of alpha, 2 endpoints and 4 colors, 8 bytes per block
+//   bc3  bc1 for RGB and bc4 for the alpha, 16 bytes per block
+//   bc4  A single channel (red), 2 endpoints and 8 values, 8 bytes per block
+//   bc5  Two bc4 blocks for red and green, like the XY of a normal map, 16 bytes per block
+//   bc7  RGBA with either 2 endpoints and 16 colors (mode 6), or two pairs of endpoints that each cover a part of the
+//        block (mode 1, for opaque blocks), whichever is closer, 16 bytes per block
+//
+// The endpoints are fit along the principal axis of the pixels and then refined by least squares on the indices, the
+// closest index of every pixel is found 4 pixels at a time with SSE2. The partitions of mode 1 are ranked 4 at a time
+// by how well their subsets fit a line, and only the best ones are encoded. The rows of blocks are split between
+// threads.
+
+#ifndef KAI_BLOCK_COMPRESS_H
+#define KAI_BLOCK_COMPRESS_H
+
+#include "../../core/includes/render.h"
+#include "../../core/includes/types.h"
+
+// Whether 'format' is one of the formats that are encoded here
+bool is_compressed_format(kai::RenderFormat format);
+
+// The bytes of a 'width' x 'height' image in 'format', sizes that aren't a multiple of the block take whole blocks
+Uint64 get_compressed_size(kai::RenderFormat format, Uint32 width, Uint32 height);
+
+// Encodes RGBA pixels (rows from the top, no padding) into the blocks of 'format', a row of blocks after another.
+// Images that aren't a multiple of the block repeat their last row and column to fill the blocks at the edges
+void compress_image(kai::RenderFormat format, const Uint8 *pixels, Uint32 width, Uint32 height, Uint32 thread_count,
+                    Uint8 *out_blocks);
+
+// Decodes blocks of 'format' back into RGBA pixels, like a GPU would sample them: the channels that the format doesn't
+// have are 0 and alpha is 255. Only handles the modes of bc7 that compress_image() writes, returns false for the rest
+bool decompress_image(kai::RenderFormat format, const Uint8 *blocks, Uint32 width, Uint32 height, Uint8 *out_pixels);
+
+#endif /* KAI_BLOCK_COMPRESS_H */
@@ -0,0 +1,626 @@
+// Offline tool that bakes a TGA image into a texture asset (see src/asset/texture.h) with its full chain of mips,
+// which the TextureStreamer loads as much of as the screen needs.
+//
+// Every mip is a 2x2 box filter of the one before it. The colors are treated as sRGB and filtered in linear light, so
+// the smaller mips don't get darker. Textures that don't hold colors, like normal maps, should be baked with "linear"
+// to filter their values as they are. The texture is rgba_unorm8 unless one of the block-compressed formats is given
+// (see block_compress.h), which the image then has to be a multiple of 4 in size for:
+//
+//   texture_bake output/brick.tga data/brick.texture bc7
+//   texture_bake output/brick_normal.tga data/brick_normal.texture linear bc5
+//
+// "bench" encodes a set of images into every format and prints the speed, the size and the PSNR of each. Without any
+// TGA images it uses a synthetic reference set of photo-like colors, hard-edged detail, a normal map, a grayscale
+// mask and a texture with alpha:
+//
+//   texture_bake bench [TGA images]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../../asset/texture.h"
+
+#include "block_compress.cpp"
+
+#define BENCH_SIZE 512 // Of the images of the reference set
+#define BENCH_RUNS 3 // The fastest run counts
+
+static const struct {
+    const char *name;
+    kai::RenderFormat format;
+} formats[] = {
+    { "rgba", kai::RenderFormat::rgba_unorm8 },
+    { "bc1", kai::RenderFormat::bc1_unorm },
+    { "bc3", kai::RenderFormat::bc3_unorm },
+    { "bc4", kai::RenderFormat::bc4_unorm },
+    { "bc5", kai::RenderFormat::bc5_unorm },
+    { "bc7", kai::RenderFormat::bc7_unorm }
+};
+
+struct Image {
+    Uint32 width;
+    Uint32 height;
+    std::vector<unsigned char> pixels; // RGBA, rows from the top
+};
+
+static void print_usage(void) {
+    fprintf(stdout, "Texture bake usage:\n"
+            "\ttexture_bake <name of TGA image> <name of texture asset> [linear] [rgba|bc1|bc3|bc4|bc5|bc7]\n"
+            "\ttexture_bake bench [names of TGA images]\n");
+}
+
+static bool read_file(const char *path, std::vector<unsigned char> &out_data) {
+    FILE *f = fopen(path, "rb");
+    if(!f) {
+        fprintf(stderr, "[ERROR] - File \"%s\" was not found or it couldn't be opened\n", path);
+        return false;
+    }
+
+    unsigned char buffer[4096];
+    size_t read;
+    while((read = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        out_data.insert(out_data.end(), buffer, buffer + read);
+    }
+
+    fclose(f);
+    return true;
+}
+
+// Uncompressed and RLE true-color (24 or 32 bits) and grayscale (8 bits) images, which covers what PIL writes
+static bool read_tga(const char *path, Image &out_image) {
+    std::vector<unsigned char> data;
+    if(!read_file(path, data)) {
+        return false;
+    }
+
+    if(data.size() < 18) {
+        fprintf(stderr, "[ERROR] - \"%s\" is not a TGA image\n", path);
+        return false;
+    }
+
+    Uint32 id_length = data[0];
+    Uint32 color_map_type = data[1];
+    Uint32 image_type = data[2];
+    Uint32 width = data[12] | (data[13] << 8);
+    Uint32 height = data[14] | (data[15] << 8);
+    Uint32 bits = data[16];
+    bool top_left = (data[17] & 0x20) != 0;
+    bool rle = image_type == 10 || image_type == 11;
+    bool gray = image_type == 3 || image_type == 11;
+
+    if(color_map_type != 0 || (image_type != 2 && image_type != 3 && image_type != 10 && image_type != 11) ||
+       (gray && bits != 8) || (!gray && bits != 24 && bits != 32) || width == 0 || height == 0) {
+        fprintf(stderr, "[ERROR] - \"%s\" is not a true-color or grayscale TGA image without a color map\n", path);
+        return false;
+    }
+
+    if(width > (1u << (KAI_TEXTURE_MAX_MIPS - 1)) || height > (1u << (KAI_TEXTURE_MAX_MIPS - 1))) {
+        fprintf(stderr, "[ERROR] - \"%s\" is larger than %u pixels\n", path, 1u << (KAI_TEXTURE_MAX_MIPS - 1));
+        return false;
+    }
+
+    Uint32 pixel_size = bits / 8;
+    size_t pixel_count = static_cast<size_t>(width) * height;
+    size_t position = 18 + id_length;
+
+    // The pixels in the order of the file, BGR(A) or gray
+    std::vector<unsigned char> file_pixels(pixel_count * pixel_size);
+    size_t pixel = 0;
+
+    while(pixel < pixel_count) {
+        size_t count = 1;
+        bool repeat = false;
+
+        if(rle) {
+            if(position >= data.size()) {
+                break;
+            }
+
+            count = (data[position] & 0x7f) + 1;
+            repeat = (data[position] & 0x80) != 0;
+            position++;
+
+            if(count > pixel_count - pixel) {
+                break;
+            }
+        }
+
+        size_t bytes = (repeat ? 1 : count) * pixel_size;
+        if(bytes > data.size() - position) {
+            break;
+        }
+
+        for(size_t i = 0; i < count; i++) {
+            memcpy(&file_pixels[(pixel + i) * pixel_size], &data[position + (repeat ? 0 : i * pixel_size)], pixel_size);
+        }
+
+        position += bytes;
+        pixel += count;
+    }
+
+    if(pixel < pixel_count) {
+        fprintf(stderr, "[ERROR] - \"%s\" ends before all of its pixels\n", path);
+        return false;
+    }
+
+    out_image.width = width;
+    out_image.height = height;
+    out_image.pixels.resize(pixel_count * 4);
+
+    for(Uint32 y = 0; y < height; y++) {
+        const unsigned char *src = &file_pixels[static_cast<size_t>(top_left ? y : height - 1 - y) * width * pixel_size];
+        unsigned char *dst = &out_image.pixels[static_cast<size_t>(y) * width * 4];
+
+        for(Uint32 x = 0; x < width; x++, src += pixel_size, dst += 4) {
+            dst[0] = gray ? src[0] : src[2];
+            dst[1] = gray ? src[0] : src[1];
+            dst[2] = src[0];
+            dst[3] = (pixel_size == 4) ? src[3] : 255;
+        }
+    }
+
+    return true;
+}
+
+static float srgb_to_linear(float value) {
+    return (value <= 0.04045f) ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linear_to_srgb(float value) {
+    return (value <= 0.0031308f) ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// Halves the image, odd sizes repeat their last row or column
+static Image make_mip(const Image &image, bool srgb, const float *to_linear) {
+    Image mip;
+    mip.width = (image.width > 1) ? image.width / 2 : 1;
+    mip.height = (image.height > 1) ? image.height / 2 : 1;
+    mip.pixels.resize(static_cast<size_t>(mip.width) * mip.height * 4);
+
+    for(Uint32 y = 0; y < mip.height; y++) {
+        Uint32 y0 = kai::min(y * 2, image.height - 1);
+        Uint32 y1 = kai::min(y * 2 + 1, image.height - 1);
+
+        for(Uint32 x = 0; x < mip.width; x++) {
+            Uint32 x0 = kai::min(x * 2, image.width - 1);
+            Uint32 x1 = kai::min(x * 2 + 1, image.width - 1);
+
+            const unsigned char *texels[4] = {
+                &image.pixels[(static_cast<size_t>(y0) * image.width + x0) * 4],
+                &image.pixels[(static_cast<size_t>(y0) * image.width + x1) * 4],
+                &image.pixels[(static_cast<size_t>(y1) * image.width + x0) * 4],
+                &image.pixels[(static_cast<size_t>(y1) * image.width + x1) * 4]
+            };
+
+            unsigned char *dst = &mip.pixels[(static_cast<size_t>(y) * mip.width + x) * 4];
+
+            for(Uint32 c = 0; c < 4; c++) {
+                float sum = 0.0f;
+                for(const unsigned char *texel : texels) {
+                    sum += (srgb && c < 3) ? to_linear[texel[c]] : texel[c] / 255.0f;
+                }
+
+                float value = sum * 0.25f;
+                value = (srgb && c < 3) ? linear_to_srgb(value) : value;
+                kai::clamp(value, 0.0f, 1.0f);
+                dst[c] = static_cast<unsigned char>(value * 255.0f + 0.5f);
+            }
+        }
+    }
+
+    return mip;
+}
+
+static bool get_format(const char *name, kai::RenderFormat &out_format) {
+    for(const auto &format : formats) {
+        if(strcmp(name, format.name) == 0) {
+            out_format = format.format;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static const char * get_format_name(kai::RenderFormat format) {
+    for(const auto &entry : formats) {
+        if(entry.format == format) {
+            return entry.name;
+        }
+    }
+
+    return "unknown";
+}
+
+// The color channels that a format keeps, which its PSNR is measured over. Alpha is measured on its own
+static Uint32 get_color_channels(kai::RenderFormat format) {
+    return (format == kai::RenderFormat::bc4_unorm) ? 1 : (format == kai::RenderFormat::bc5_unorm) ? 2 : 3;
+}
+
+static bool has_alpha(kai::RenderFormat format) {
+    return format != kai::RenderFormat::bc4_unorm && format != kai::RenderFormat::bc5_unorm;
+}
+
+// The pixels of the image in the format, and the seconds that encoding them took
+static std::vector<unsigned char> encode_image(const Image &image, kai::RenderFormat format, Uint32 thread_count,
+                                               double &out_seconds) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<unsigned char> data;
+
+    if(is_compressed_format(format)) {
+        data.resize(static_cast<size_t>(get_compressed_size(format, image.width, image.height)));
+        compress_image(format, image.pixels.data(), image.width, image.height, thread_count, data.data());
+    } else {
+        data = image.pixels;
+    }
+
+    out_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return data;
+}
+
+// Over 'channel_count' channels from 'first_channel' on, infinite for the same pixels. The pixels that are fully
+// transparent are left out of the color unless 'all_pixels', their color doesn't show (and bc1 drops it)
+static double get_psnr(const Image &image, const std::vector<unsigned char> &decoded, Uint32 first_channel, Uint32 channel_count,
+                       bool all_pixels) {
+    double sum = 0.0;
+    double count = 0.0;
+
+    for(size_t i = 0; i < image.pixels.size(); i += 4) {
+        if(!all_pixels && image.pixels[i + 3] == 0) {
+            continue;
+        }
+
+        for(Uint32 c = first_channel; c < first_channel + channel_count; c++) {
+            double difference = static_cast<double>(image.pixels[i + c]) - static_cast<double>(decoded[i + c]);
+            sum += difference * difference;
+        }
+
+        count += channel_count;
+    }
+
+    double mse = (count > 0.0) ? sum / count : 0.0;
+    return (mse > 0.0) ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+// The PSNR of the color and the alpha of the encoded image, the alpha is infinite for a format without it
+static bool measure_image(const Image &image, kai::RenderFormat format, const std::vector<unsigned char> &data,
+                          double &out_color_psnr, double &out_alpha_psnr) {
+    std::vector<unsigned char> decoded = data;
+    if(is_compressed_format(format)) {
+        decoded.resize(image.pixels.size());
+        if(!decompress_image(format, data.data(), image.width, image.height, decoded.data())) {
+            return false;
+        }
+    }
+
+    out_color_psnr = get_psnr(image, decoded, 0, get_color_channels(format), false);
+    out_alpha_psnr = has_alpha(format) ? get_psnr(image, decoded, 3, 1, true) : INFINITY;
+    return true;
+}
+
+static Uint32 hash(Uint32 x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+// Smoothly interpolated random values on a grid, with finer octaves on top, from 0 to 1
+static float get_noise(float x, float y, Uint32 seed, Uint32 octaves) {
+    float sum = 0.0f;
+    float total = 0.0f;
+    float amplitude = 1.0f;
+
+    for(Uint32 octave = 0; octave < octaves; octave++, x *= 2.0f, y *= 2.0f, amplitude *= 0.5f) {
+        Int32 cell_x = static_cast<Int32>(floorf(x));
+        Int32 cell_y = static_cast<Int32>(floorf(y));
+        float fx = x - static_cast<float>(cell_x);
+        float fy = y - static_cast<float>(cell_y);
+        fx = fx * fx * (3.0f - 2.0f * fx);
+        fy = fy * fy * (3.0f - 2.0f * fy);
+
+        float corners[4];
+        for(Uint32 i = 0; i < 4; i++) {
+            Uint32 key = hash(static_cast<Uint32>(cell_x + static_cast<Int32>(i & 1)) * 73856093u ^
+                              static_cast<Uint32>(cell_y + static_cast<Int32>(i >> 1)) * 19349663u ^ (seed + octave) * 83492791u);
+            corners[i] = static_cast<float>(key & 0xffff) / 65535.0f;
+        }
+
+        float top = corners[0] + (corners[1] - corners[0]) * fx;
+        float bottom = corners[2] + (corners[3] - corners[2]) * fx;
+        sum += (top + (bottom - top) * fy) * amplitude;
+        total += amplitude;
+    }
+
+    return sum / total;
+}
+
+static unsigned char to_unorm8(float value) {
+    kai::clamp(value, 0.0f, 1.0f);
+    return static_cast<unsigned char>(value * 255.0f + 0.5f);
+}
+
+static const char *reference_names[] = { "photo", "detail", "normal", "mask", "alpha" };
+
+static Image make_reference_image(Uint32 kind) {
+    Image image;
+    image.width = BENCH_SIZE;
+    image.height = BENCH_SIZE;
+    image.pixels.resize(BENCH_SIZE * BENCH_SIZE * 4);
+
+    for(Uint32 y = 0; y < BENCH_SIZE; y++) {
+        for(Uint32 x = 0; x < BENCH_SIZE; x++) {
+            float u = static_cast<float>(x) / BENCH_SIZE;
+            float v = static_cast<float>(y) / BENCH_SIZE;
+            float rgba[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+            if(kind == 0 || kind == 4) {
+                // Soft shapes and gradients with fine detail and some grain on top, like a photo
+                float grain = static_cast<float>(hash(y * BENCH_SIZE + x) & 0xff) / 255.0f - 0.5f;
+                rgba[0] = get_noise(u * 6.0f, v * 6.0f, 1, 8) * 0.8f + u * 0.2f + grain * 0.06f;
+                rgba[1] = get_noise(u * 6.0f, v * 6.0f, 2, 8) * 0.6f + v * 0.3f + grain * 0.05f;
+                rgba[2] = get_noise(u * 4.0f, v * 4.0f, 3, 8) * 0.5f + rgba[0] * 0.3f + grain * 0.04f;
+
+                if(kind == 4) {
+                    // A cutout with a soft edge in the middle and hard ones around it
+                    float distance = sqrtf((u - 0.5f) * (u - 0.5f) + (v - 0.5f) * (v - 0.5f));
+                    float edge = get_noise(u * 8.0f, v * 8.0f, 4, 3);
+                    rgba[3] = (distance < 0.25f) ? 1.0f - distance * 2.0f : (edge > 0.5f) ? 1.0f : 0.0f;
+                }
+            } else if(kind == 1) {
+                // Cells of flat colors with dark borders and checkers, hard edges everywhere
+                Uint32 cell = hash((x / 24) * 7919 + (y / 24) * 104729);
+                bool border = (x % 24) < 2 || (y % 24) < 2;
+                bool checker = (cell & 0x1000000) && (((x / 3) ^ (y / 3)) & 1);
+
+                for(Uint32 c = 0; c < 3; c++) {
+                    rgba[c] = border ? 0.1f : static_cast<float>((cell >> (c * 8)) & 0xff) / 255.0f * (checker ? 0.5f : 1.0f);
+                }
+            } else if(kind == 2) {
+                // The normals of a bumpy height field, XYZ from -1 to 1 stored from 0 to 1
+                float step = 1.0f / BENCH_SIZE;
+                float dx = get_noise((u + step) * 16.0f, v * 16.0f, 5, 4) - get_noise((u - step) * 16.0f, v * 16.0f, 5, 4);
+                float dy = get_noise(u * 16.0f, (v + step) * 16.0f, 5, 4) - get_noise(u * 16.0f, (v - step) * 16.0f, 5, 4);
+                float normal[3] = { -dx * 20.0f, -dy * 20.0f, 1.0f };
+                float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+                for(Uint32 c = 0; c < 3; c++) {
+                    rgba[c] = normal[c] / length * 0.5f + 0.5f;
+                }
+            } else {
+                // A single channel of fine detail, like a roughness mask
+                float value = get_noise(u * 24.0f, v * 24.0f, 6, 5);
+                rgba[0] = rgba[1] = rgba[2] = value;
+            }
+
+            for(Uint32 c = 0; c < 4; c++) {
+                image.pixels[(static_cast<size_t>(y) * BENCH_SIZE + x) * 4 + c] = to_unorm8(rgba[c]);
+            }
+        }
+    }
+
+    return image;
+}
+
+static void print_psnr(double psnr) {
+    if(isinf(psnr)) {
+        fprintf(stdout, "  %8s", "lossless");
+    } else {
+        fprintf(stdout, "  %8.2f", psnr);
+    }
+}
+
+static int run_bench(int image_count, char **image_paths) {
+    std::vector<Image> images;
+    std::vector<const char *> names;
+
+    if(image_count == 0) {
+        for(Uint32 i = 0; i < KAI_ARRAY_COUNT(reference_names); i++) {
+            images.push_back(make_reference_image(i));
+            names.push_back(reference_names[i]);
+        }
+    }
+
+    for(int i = 0; i < image_count; i++) {
+        Image image;
+        if(!read_tga(image_paths[i], image)) {
+            return -1;
+        }
+
+        if(image.width % 4 || image.height % 4) {
+            fprintf(stderr, "[ERROR] - \"%s\" is not a multiple of 4 in size\n", image_paths[i]);
+            return -1;
+        }
+
+        images.push_back(image);
+        names.push_back(image_paths[i]);
+    }
+
+    Uint32 thread_count = kai::max(std::thread::hardware_concurrency(), 1u);
+    fprintf(stdout, "%u images, %u threads, the fastest of %u runs. PSNR in dB over RGB (R for bc4, RG for bc5) and alpha\n\n",
+            static_cast<Uint32>(images.size()), thread_count, BENCH_RUNS);
+    fprintf(stdout, "%-12s %-6s %12s %12s %10s %6s %9s %9s\n", "image", "format", "Mpix/s (1)", "Mpix/s (all)", "bytes",
+            "bpp", "color", "alpha");
+
+    double total_pixels = 0.0;
+    for(const Image &image : images) {
+        total_pixels += static_cast<double>(image.width) * image.height;
+    }
+
+    for(const auto &format : formats) {
+        double seconds_single = 0.0;
+        double seconds_all = 0.0;
+        double psnr_sum = 0.0;
+        Uint32 psnr_count = 0; // The lossless ones are left out of the average
+        Uint64 byte_count = 0;
+
+        for(size_t i = 0; i < images.size(); i++) {
+            const Image &image = images[i];
+            double pixels = static_cast<double>(image.width) * image.height;
+            double best[2] = { INFINITY, INFINITY };
+            std::vector<unsigned char> data;
+
+            for(Uint32 run = 0; run < BENCH_RUNS; run++) {
+                for(Uint32 threads = 0; threads < 2; threads++) {
+                    double seconds;
+                    data = encode_image(image, format.format, threads ? thread_count : 1, seconds);
+                    best[threads] = kai::min(best[threads], seconds);
+                }
+            }
+
+            double color_psnr;
+            double alpha_psnr;
+            if(!measure_image(image, format.format, data, color_psnr, alpha_psnr)) {
+                fprintf(stderr, "[ERROR] - Could not decode \"%s\" as %s\n", names[i], format.name);
+                return -1;
+            }
+
+            fprintf(stdout, "%-12s %-6s %12.1f %12.1f %10u %6.1f", names[i], format.name, pixels / best[0] / 1e6,
+                    pixels / best[1] / 1e6, static_cast<Uint32>(data.size()), data.size() * 8.0 / pixels);
+            print_psnr(color_psnr);
+
+            if(has_alpha(format.format)) {
+                print_psnr(alpha_psnr);
+            } else {
+                fprintf(stdout, "  %8s", "-");
+            }
+
+            fprintf(stdout, "\n");
+
+            seconds_single += best[0];
+            seconds_all += best[1];
+            psnr_sum += isinf(color_psnr) ? 0.0 : color_psnr;
+            psnr_count += isinf(color_psnr) ? 0 : 1;
+            byte_count += data.size();
+        }
+
+        fprintf(stdout, "%-12s %-6s %12.1f %12.1f %10u %6.1f", "all", format.name, total_pixels / seconds_single / 1e6,
+                total_pixels / seconds_all / 1e6, static_cast<Uint32>(byte_count), byte_count * 8.0 / total_pixels);
+        print_psnr(psnr_count ? psnr_sum / psnr_count : INFINITY);
+        fprintf(stdout, "\n\n");
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if(argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        return run_bench(argc - 2, argv + 2);
+    }
+
+    if(argc < 3) {
+        print_usage();
+        return -1;
+    }
+
+    bool srgb = true;
+    kai::RenderFormat format = kai::RenderFormat::rgba_unorm8;
+
+    for(int i = 3; i < argc; i++) {
+        if(strcmp(argv[i], "linear") == 0) {
+            srgb = false;
+        } else if(!get_format(argv[i], format)) {
+            print_usage();
+            return -1;
+        }
+    }
+
+    std::vector<Image> mips(1);
+    if(!read_tga(argv[1], mips[0])) {
+        return -1;
+    }
+
+    if(is_compressed_format(format) && (mips[0].width % 4 || mips[0].height % 4)) {
+        fprintf(stderr, "[ERROR] - \"%s\" has to be a multiple of 4 in size for %s\n", argv[1], get_format_name(format));
+        return -1;
+    }
+
+    float to_linear[256];
+    for(Uint32 i = 0; i < 256; i++) {
+        to_linear[i] = srgb_to_linear(i / 255.0f);
+    }
+
+    while(mips.back().width > 1 || mips.back().height > 1) {
+        mips.push_back(make_mip(mips.back(), srgb, to_linear));
+    }
+
+    Uint32 thread_count = kai::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<std::vector<unsigned char>> mip_data(mips.size());
+    double seconds = 0.0;
+
+    for(size_t i = 0; i < mips.size(); i++) {
+        double mip_seconds;
+        mip_data[i] = encode_image(mips[i], format, thread_count, mip_seconds);
+        seconds += mip_seconds;
+    }
+
+    double color_psnr;
+    double alpha_psnr;
+    if(!measure_image(mips[0], format, mip_data[0], color_psnr, alpha_psnr)) {
+        fprintf(stderr, "[ERROR] - Could not decode the %s blocks of \"%s\"\n", get_format_name(format), argv[1]);
+        return -1;
+    }
+
+    kai::TextureHeader header = {};
+    header.asset_type = kai::AssetType::texture;
+    header.version = KAI_TEXTURE_VERSION;
+    header.format = static_cast<Uint32>(format);
+    header.mip_count = static_cast<Uint32>(mips.size());
+
+    Uint64 size = sizeof(kai::TextureHeader);
+    double pixel_count = 0.0;
+
+    for(size_t i = 0; i < mips.size(); i++) {
+        header.mips[i].width = mips[i].width;
+        header.mips[i].height = mips[i].height;
+        header.mips[i].start = static_cast<Uint32>(size);
+        header.mips[i].size = static_cast<Uint32>(mip_data[i].size());
+        size += mip_data[i].size();
+        pixel_count += static_cast<double>(mips[i].width) * mips[i].height;
+
+        if(size > 0xffffffff) {
+            fprintf(stderr, "[ERROR] - The mips of \"%s\" don't fit into a texture asset of up to 4GB\n", argv[1]);
+            return -1;
+        }
+    }
+
+    header.size = static_cast<Uint32>(size);
+
+    FILE *f = fopen(argv[2], "wb");
+    if(!f) {
+        fprintf(stderr, "[ERROR] - Could not create \"%s\"\n", argv[2]);
+        return -1;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, f) == 1;
+    for(const std::vector<unsigned char> &data : mip_data) {
+        written = written && fwrite(data.data(), 1, data.size(), f) == data.size();
+    }
+
+    if(fclose(f) != 0 || !written) {
+        fprintf(stderr, "[ERROR] - Could not write \"%s\"\n", argv[2]);
+        return -1;
+    }
+
+    fprintf(stdout, "Baked \"%s\": %ux%u %s with %u mips, %u bytes, %.1f Mpixel/s", argv[2], mips[0].width, mips[0].height,
+            get_format_name(format), header.mip_count, header.size, pixel_count / kai::max(seconds, 1e-9) / 1e6);
+
+    if(!isinf(color_psnr)) {
+        fprintf(stdout, ", PSNR of the largest mip %.2f dB", color_psnr);
+    }
+
+    if(has_alpha(format) && !isinf(alpha_psnr)) {
+        fprintf(stdout, " (alpha %.2f dB)", alpha_psnr);
+    }
+
+    fprintf(stdout, "\n");
+    return 0;
+}